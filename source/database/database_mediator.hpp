@@ -33,6 +33,7 @@
 #include "database/photo_block_relation_resource.hpp"
 #include "database/photo_measure_resource.hpp"
 #include "hs_progress/progress_utility/progress_manager.hpp"
+#include "workflow/common/chunked_point_cloud.hpp"
 
 namespace hs
 {
@@ -1159,6 +1160,7 @@ struct ResponseGetPhotoOrientation
   std::string point_cloud_path;
   std::string tracks_path;
   std::string similar_transform_path;
+  std::string color_balance_path;
   std::string workspace_path;
 };
 
@@ -1187,6 +1189,8 @@ struct DatabaseRequestHandler<RequestGetPhotoOrientation,
       photo_orientation_path + "tracks.bin";
     response.similar_transform_path =
       photo_orientation_path + "similar_transform.bin";
+    response.color_balance_path =
+      photo_orientation_path + "color_balance.bin";
     response.workspace_path = photo_orientation_path;
     return response.error_code;
   }
@@ -1631,15 +1635,10 @@ struct DatabaseRequestHandler <RequestUpdatePhotoOrientationParams,
       }
 
       hs::graphics::PointCloudData<double> pcd;
+      if (workflow::LoadPointCloud(point_cloud_path, pcd) != 0)
       {
-        std::ifstream pcd_file(point_cloud_path, std::ios::binary);
-        if (!pcd_file)
-        {
-          response.error_code = DatabaseMediator::ERROR_PARAMS_FILE_NOT_EXIST;
-          break;
-        }
-        cereal::PortableBinaryInputArchive archive(pcd_file);
-        archive(pcd);
+        response.error_code = DatabaseMediator::ERROR_PARAMS_FILE_NOT_EXIST;
+        break;
       }
 
       if (pcd.PointCloudSize() != request.points_new.size())
@@ -1673,11 +1672,8 @@ struct DatabaseRequestHandler <RequestUpdatePhotoOrientationParams,
         archive(request.extrinsic_params_map_new);
       }
 
-      {
-        std::ofstream pcd_file(point_cloud_path, std::ios::binary);
-        cereal::PortableBinaryOutputArchive archive(pcd_file);
-        archive(pcd);
-      }
+      //稀疏点云按连接点轨迹索引, 保持点的顺序
+      workflow::SavePointCloud(pcd, point_cloud_path, false);
 
       break;
     }
@@ -2608,6 +2604,8 @@ struct ResponseGetTexture
 {
   RESPONSE_HEADER
   TextureResource::Record record;
+  //Textured model, there if the texture step generated one.
+  std::string model_path;
 };
 
 template <>
@@ -2620,6 +2618,8 @@ struct DatabaseRequestHandler<RequestGetTexture, ResponseGetTexture>
     response.error_code =
       database_mediator.texture_resource_->GetById(request.id,
                                                    response.record);
+    response.model_path =
+      database_mediator.GetTexturePath(request.id) + "model.obj";
 
     return response.error_code;
   }
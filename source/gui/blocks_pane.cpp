@@ -7,6 +7,7 @@
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
 
+#include <cereal/types/array.hpp>
 #include <cereal/types/utility.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/map.hpp>
@@ -24,12 +25,14 @@
 //#include "workflow/feature_match//openmvg_feature_match.hpp"
 #include "workflow/feature_match/opencv_feature_match.hpp"
 #include "workflow/mesh_surface/delaunay_surface_model.hpp"
+#include "workflow/mesh_surface/poisson_surface_model.hpp"
 
 #include "gui/blocks_pane.hpp"
 #include "gui/block_photos_select_dialog.hpp"
 #include "gui/main_window.hpp"
 #include "gui/workflow_configure_dialog.hpp"
 #include "gui/default_longitude_latitude_convertor.hpp"
+#include "gui/cartographics_geographic_projector.hpp"
 
 namespace hs
 {
@@ -54,6 +57,7 @@ BlocksPane::BlocksPane(QWidget* parent)
   , activated_photo_orientation_id_(std::numeric_limits<uint>::max())
   , activated_point_cloud_id_(std::numeric_limits<uint>::max())
   , activated_surface_model_id_(std::numeric_limits<uint>::max())
+  , activated_texture_id_(std::numeric_limits<uint>::max())
 {
   timer_ = new QTimer(this);
   blocks_tree_widget_ = new BlocksTreeWidget(this);
@@ -697,6 +701,11 @@ void BlocksPane::OnItemDoubleClicked(QTreeWidgetItem* item, int column)
       ActivateSurfaceModelItem(item);
       break;
     }
+  case BlocksTreeWidget::TEXTURE:
+    {
+      ActivateTextureItem(item);
+      break;
+    }
   }
 }
 
@@ -1633,6 +1642,14 @@ void BlocksPane::ActivatePhotoOrientationItem(
     last_surface_model_item->setBackground(0, backup_background_);
     activated_surface_model_id_ = std::numeric_limits<uint>::max();
   }
+  //清除texture_item颜色
+  QTreeWidgetItem* last_texture_item =
+    blocks_tree_widget_->TextureItem(activated_texture_id_);
+  if (last_texture_item)
+  {
+    last_texture_item->setBackground(0, backup_background_);
+    activated_texture_id_ = std::numeric_limits<uint>::max();
+  }
 
   //设置photo_orientation_item颜色
   QTreeWidgetItem* last_photo_orientation_item =
@@ -1670,6 +1687,14 @@ void BlocksPane::ActivatePointCloudItem(
     last_surface_model_item->setBackground(0, backup_background_);
     activated_surface_model_id_ = std::numeric_limits<uint>::max();
   }
+  //清除texture_item颜色
+  QTreeWidgetItem* last_texture_item =
+    blocks_tree_widget_->TextureItem(activated_texture_id_);
+  if (last_texture_item)
+  {
+    last_texture_item->setBackground(0, backup_background_);
+    activated_texture_id_ = std::numeric_limits<uint>::max();
+  }
 
   //设置point_cloud_item颜色
   QTreeWidgetItem* last_point_cloud_item =
@@ -1708,6 +1733,15 @@ void BlocksPane::ActivateSurfaceModelItem(QTreeWidgetItem* surface_model_item)
     activated_point_cloud_id_ = std::numeric_limits<uint>::max();
   }
 
+  //清除texture_item颜色
+  QTreeWidgetItem* last_texture_item =
+    blocks_tree_widget_->TextureItem(activated_texture_id_);
+  if (last_texture_item)
+  {
+    last_texture_item->setBackground(0, backup_background_);
+    activated_texture_id_ = std::numeric_limits<uint>::max();
+  }
+
   //设置surface_model_item颜色
   QTreeWidgetItem* last_surface_model_item =
     blocks_tree_widget_->SurfaceModelItem(activated_surface_model_id_);
@@ -1725,6 +1759,51 @@ void BlocksPane::ActivateSurfaceModelItem(QTreeWidgetItem* surface_model_item)
 
 }
 
+void BlocksPane::ActivateTextureItem(QTreeWidgetItem* texture_item)
+{
+  //清除photo_orientation_item颜色
+  QTreeWidgetItem* last_photo_orientation_item =
+    blocks_tree_widget_->PhotoOrientationItem(activated_photo_orientation_id_);
+  if (last_photo_orientation_item)
+  {
+    last_photo_orientation_item->setBackground(0, backup_background_);
+    activated_photo_orientation_id_ = std::numeric_limits<uint>::max();
+  }
+
+  //清除point_cloud_item颜色
+  QTreeWidgetItem* last_point_cloud_item =
+    blocks_tree_widget_->PointCloudItem(activated_point_cloud_id_);
+  if (last_point_cloud_item)
+  {
+    last_point_cloud_item->setBackground(0, backup_background_);
+    activated_point_cloud_id_ = std::numeric_limits<uint>::max();
+  }
+
+  //清除surface_model_item颜色
+  QTreeWidgetItem* last_surface_model_item =
+    blocks_tree_widget_->SurfaceModelItem(activated_surface_model_id_);
+  if (last_surface_model_item)
+  {
+    last_surface_model_item->setBackground(0, backup_background_);
+    activated_surface_model_id_ = std::numeric_limits<uint>::max();
+  }
+
+  //设置texture_item颜色
+  QTreeWidgetItem* last_texture_item =
+    blocks_tree_widget_->TextureItem(activated_texture_id_);
+  if (last_texture_item == texture_item) return;
+  if (last_texture_item)
+  {
+    last_texture_item->setBackground(0, backup_background_);
+  }
+
+  backup_background_ = texture_item->background(0);
+  texture_item->setBackground(0, QBrush(QColor(200, 110, 90)));
+  activated_texture_id_ = texture_item->data(0, Qt::UserRole).toUInt();
+  emit TextureActivated(activated_texture_id_);
+
+}
+
 int BlocksPane::SetWorkflowStep(
   const std::string& workflow_intermediate_directory,
   WorkflowStepEntry& workflow_step_entry)
@@ -2352,6 +2431,8 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetPhotoOrientationStep(
       response_photo_orientation.tracks_path);
     photo_orientation_config->set_similar_transform_path(
       response_photo_orientation.similar_transform_path);
+    photo_orientation_config->set_color_balance_path(
+      response_photo_orientation.color_balance_path);
     photo_orientation_config->set_workspace_path(
       response_photo_orientation.workspace_path);
     photo_orientation_config->set_number_of_threads(uint(number_of_threads));
@@ -2437,6 +2518,8 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetPointCloudStep(
       response_photo_orientation.extrinsic_path);
     point_cloud_config->set_sparse_point_cloud_path(
       response_photo_orientation.point_cloud_path);
+    point_cloud_config->set_tracks_path(
+      response_photo_orientation.tracks_path);
     point_cloud_config->set_intermediate_path(workflow_intermediate_directory);
     point_cloud_config->set_s_number_of_threads(number_of_threads);
     break;
@@ -2499,7 +2582,14 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetSurfaceModelStep(
     break;
   }
 
-  //return WorkflowStepPtr(new workflow::PoissonSurface);
+  workflow::MeshSurfaceConfigPtr mesh_surface_config =
+    std::static_pointer_cast<workflow::MeshSurfaceConfig>(
+    workflow_step_entry.config);
+  if (mesh_surface_config->surface_type() ==
+      workflow::MeshSurfaceConfig::SURFACE_CLOSED)
+  {
+    return WorkflowStepPtr(new workflow::PoissonSurface);
+  }
   return WorkflowStepPtr(new workflow::DelaunaySurfaceModel);
 }
 
@@ -2627,6 +2717,26 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetTextureStep(
       archive(extrinsic_params_map);
     }
 
+    //Orientations older than color balancing keep the raw photo colors, as
+    //do those whose corrections cannot be read.
+    workflow::ColorCorrectionMap color_correction_map;
+    {
+      std::ifstream color_balance_file(
+        response_photo_orientation.color_balance_path, std::ios::binary);
+      if (color_balance_file)
+      {
+        try
+        {
+          cereal::PortableBinaryInputArchive archive(color_balance_file);
+          archive(color_correction_map);
+        }
+        catch (const cereal::Exception&)
+        {
+          color_correction_map.clear();
+        }
+      }
+    }
+
     bool miss_intrinsic = false;
     for (const auto& extrinsic_params : extrinsic_params_map)
     {
@@ -2641,6 +2751,11 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetTextureStep(
       }
       image.intrinsic_params = itr_intrinsic->second;
       image.extrinsic_params = extrinsic_params.second;
+      auto itr_correction = color_correction_map.find(image_id);
+      if (itr_correction != color_correction_map.end())
+      {
+        image.color_correction = itr_correction->second;
+      }
       db::RequestGetPhotogroup request_group;
       db::ResponseGetPhotogroup response_group;
       request_group.id = db::Database::Identifier(intrinsic_id);
@@ -2677,6 +2792,88 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetTextureStep(
       break;
     }
 
+    //The georeferenced frame is the one the photo POS were converted to
+    //for the orientation, web tiles go without it if the POS are missing.
+    workflow::GeographicProjectorPtr geographic_projector;
+    {
+      typedef DefaultLongitudeLatitudeConvertor::CoordinateSystem
+              CoordinateSystem;
+      typedef CoordinateSystem::Projection Projection;
+      typedef DefaultLongitudeLatitudeConvertor::Coordinate Coordinate;
+      typedef DefaultLongitudeLatitudeConvertor::CoordinateContainer
+              CoordinateContainer;
+      typedef hs::cartographics::format::HS_FormatterProj4<Scalar> Formatter;
+
+      int field_id =
+        db::PhotoOrientationResource::PHOTO_ORIENTATION_FIELD_FEATURE_MATCH_ID;
+      db::RequestGetFeatureMatch request_feature_match;
+      db::ResponseGetFeatureMatch response_feature_match;
+      request_feature_match.id =
+        Identifier(response_photo_orientation.record[field_id].ToInt());
+      ((MainWindow*)parent())->database_mediator().Request(
+        this, db::DatabaseMediator::REQUEST_GET_FEATURE_MATCH,
+        request_feature_match, response_feature_match, false);
+
+      db::RequestGetPhotosInBlock request_get_photos_in_block;
+      db::ResponseGetPhotosInBlock response_get_photos_in_block;
+      request_get_photos_in_block.block_id =
+        Identifier(
+          response_feature_match.record[
+            db::FeatureMatchResource::FEATURE_MATCH_FIELD_BLOCK_ID].ToInt());
+      if (response_feature_match.error_code ==
+          db::Database::DATABASE_NO_ERROR)
+      {
+        ((MainWindow*)parent())->database_mediator().Request(
+          this, db::DatabaseMediator::REQUEST_GET_PHOTOS_IN_BLOCK,
+          request_get_photos_in_block, response_get_photos_in_block, false);
+      }
+
+      double invalid_value = -1e-100;
+      CoordinateSystem coordinate_system;
+      CoordinateContainer coordinates;
+      if (response_feature_match.error_code ==
+            db::Database::DATABASE_NO_ERROR &&
+          response_get_photos_in_block.error_code ==
+            db::Database::DATABASE_NO_ERROR)
+      {
+        for (const auto& photo : response_get_photos_in_block.records)
+        {
+          Coordinate coordinate;
+          coordinate << photo.second[
+                          db::PhotoResource::PHOTO_FIELD_POS_X].ToFloat(),
+                        photo.second[
+                          db::PhotoResource::PHOTO_FIELD_POS_Y].ToFloat(),
+                        photo.second[
+                          db::PhotoResource::PHOTO_FIELD_POS_Z].ToFloat();
+          if (coordinate[0] > invalid_value &&
+              coordinate[1] > invalid_value &&
+              coordinate[2] > invalid_value)
+          {
+            Formatter formatter;
+            formatter.StringToCoordinateSystem(
+              photo.second[
+                db::PhotoResource::PHOTO_FIELD_COORDINATE_SYSTEM].ToString(),
+              coordinate_system);
+            coordinates.push_back(coordinate);
+          }
+        }
+      }
+      if (!coordinates.empty())
+      {
+        if (coordinate_system.projection().projection_type() ==
+            Projection::TYPE_LAT_LONG)
+        {
+          CoordinateSystem coordinate_system_cartisian;
+          DefaultLongitudeLatitudeConvertor default_convertor;
+          default_convertor.GetDefaultCoordinateSystem(
+            coordinate_system, coordinates, coordinate_system_cartisian);
+          coordinate_system = coordinate_system_cartisian;
+        }
+        geographic_projector.reset(
+          new CartographicsGeographicProjector(coordinate_system));
+      }
+    }
+
     QSettings settings;
     QString number_of_threads_key = QString("number_of_threads");
     uint number_of_threads = settings.value(number_of_threads_key,
@@ -2685,6 +2882,9 @@ BlocksPane::WorkflowStepPtr BlocksPane::SetTextureStep(
     texture_config->set_surface_model_path(surface_model_path);
     texture_config->set_similar_transform(similar_transform);
     texture_config->set_images(images);
+    texture_config->set_number_of_threads(number_of_threads);
+    texture_config->set_model_path(response_texture.model_path);
+    texture_config->set_geographic_projector(geographic_projector);
 
     break;
   }
@@ -86,6 +86,7 @@ private:
   void ActivatePhotoOrientationItem(QTreeWidgetItem* photo_orientation_item);
   void ActivatePointCloudItem(QTreeWidgetItem* point_cloud_item);
   void ActivateSurfaceModelItem(QTreeWidgetItem* surface_model_item);
+  void ActivateTextureItem(QTreeWidgetItem* texture_item);
 
   int SetWorkflowStep(const std::string& workflow_intermediate_directory,
                       WorkflowStepEntry& workflow_step_entry);
@@ -138,6 +139,7 @@ signals:
   void PhotoOrientationActivated(uint photo_orientation_id);
   void PointCloudActivated(uint point_cloud_id);
   void SurfaceModelActivated(uint surface_model_id);
+  void TextureActivated(uint texture_id);
 
 private:
   BlocksTreeWidget* blocks_tree_widget_;
@@ -168,6 +170,7 @@ private:
   uint activated_photo_orientation_id_;
   uint activated_point_cloud_id_;
   uint activated_surface_model_id_;
+  uint activated_texture_id_;
 
   QTimer* timer_;
   QProgressBar* progress_bar_;
@@ -0,0 +1,95 @@
+#include <QIntValidator>
+#include <QDoubleValidator>
+
+#include "gui/bundle_adjustment_options_widget.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace gui
+{
+
+BundleAdjustmentOptionsWidget::BundleAdjustmentOptionsWidget(
+  QWidget* parent, Qt::WindowFlags f,
+  const workflow::BundleAdjustmentOptions& options)
+  : QWidget(parent, f)
+  , options_(options)
+{
+  layout_all_ = new QVBoxLayout(this);
+  layout_all_->setContentsMargins(0, 0, 0, 0);
+  setLayout(layout_all_);
+
+  layout_backend_ = new QHBoxLayout;
+  label_backend_ = new QLabel(tr("Bundle Adjustment Solver:"));
+  combo_box_backend_ = new QComboBox;
+  combo_box_backend_->addItem(
+    tr("Builtin"),
+    QVariant(int(workflow::BundleAdjustmentOptions::BACKEND_BUILTIN)));
+  combo_box_backend_->addItem(
+    tr("Ceres Sparse Schur"),
+    QVariant(int(
+      workflow::BundleAdjustmentOptions::BACKEND_CERES_SPARSE_SCHUR)));
+  combo_box_backend_->addItem(
+    tr("Ceres Iterative Schur (Large Blocks)"),
+    QVariant(int(
+      workflow::BundleAdjustmentOptions::BACKEND_CERES_ITERATIVE_SCHUR)));
+  int backend_index = combo_box_backend_->findData(QVariant(options.backend));
+  combo_box_backend_->setCurrentIndex(backend_index < 0 ? 0 : backend_index);
+  layout_backend_->addWidget(label_backend_);
+  layout_backend_->addWidget(combo_box_backend_);
+  layout_all_->addLayout(layout_backend_);
+
+  layout_number_of_threads_ = new QHBoxLayout;
+  label_number_of_threads_ =
+    new QLabel(tr("Solver Threads (0 for Default):"));
+  line_edit_number_of_threads_ = new QLineEdit;
+  line_edit_number_of_threads_->setValidator(
+    new QIntValidator(0, 256, this));
+  line_edit_number_of_threads_->setText(
+    QString::number(options.number_of_threads));
+  layout_number_of_threads_->addWidget(label_number_of_threads_);
+  layout_number_of_threads_->addWidget(line_edit_number_of_threads_);
+  layout_all_->addLayout(layout_number_of_threads_);
+
+  layout_time_budget_ = new QHBoxLayout;
+  label_time_budget_ =
+    new QLabel(tr("Solver Time Budget (Seconds, 0 for No Limit):"));
+  line_edit_time_budget_ = new QLineEdit;
+  QDoubleValidator* validator = new QDoubleValidator(this);
+  validator->setBottom(0.0);
+  line_edit_time_budget_->setValidator(validator);
+  line_edit_time_budget_->setText(QString::number(options.time_budget));
+  layout_time_budget_->addWidget(label_time_budget_);
+  layout_time_budget_->addWidget(line_edit_time_budget_);
+  layout_all_->addLayout(layout_time_budget_);
+
+  OnBackendChanged(combo_box_backend_->currentIndex());
+  QObject::connect(combo_box_backend_,
+                   static_cast<void (QComboBox::*)(int)>(
+                     &QComboBox::currentIndexChanged),
+                   this, &BundleAdjustmentOptionsWidget::OnBackendChanged);
+}
+
+workflow::BundleAdjustmentOptions
+BundleAdjustmentOptionsWidget::GetBundleAdjustmentOptions() const
+{
+  workflow::BundleAdjustmentOptions options = options_;
+  options.backend = combo_box_backend_->currentData().toInt();
+  options.number_of_threads = line_edit_number_of_threads_->text().toInt();
+  options.time_budget = line_edit_time_budget_->text().toDouble();
+  return options;
+}
+
+void BundleAdjustmentOptionsWidget::OnBackendChanged(int index)
+{
+  bool is_ceres =
+    combo_box_backend_->itemData(index).toInt() !=
+    workflow::BundleAdjustmentOptions::BACKEND_BUILTIN;
+  line_edit_number_of_threads_->setEnabled(is_ceres);
+  line_edit_time_budget_->setEnabled(is_ceres);
+}
+
+}
+}
+}
@@ -0,0 +1,56 @@
+#ifndef _HS_3D_RECONSTRUCTOR_GUI_BUNDLE_ADJUSTMENT_OPTIONS_WIDGET_HPP_
+#define _HS_3D_RECONSTRUCTOR_GUI_BUNDLE_ADJUSTMENT_OPTIONS_WIDGET_HPP_
+
+#include <QWidget>
+#include <QLabel>
+#include <QLineEdit>
+#include <QComboBox>
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+
+#include "workflow/photo_orientation/ceres_bundle_adjuster.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace gui
+{
+
+class BundleAdjustmentOptionsWidget : public QWidget
+{
+  Q_OBJECT
+public:
+  BundleAdjustmentOptionsWidget(
+    QWidget* parent = nullptr, Qt::WindowFlags f = 0,
+    const workflow::BundleAdjustmentOptions& options =
+      workflow::BundleAdjustmentOptions());
+
+  workflow::BundleAdjustmentOptions GetBundleAdjustmentOptions() const;
+
+private slots:
+  void OnBackendChanged(int index);
+
+private:
+  workflow::BundleAdjustmentOptions options_;
+
+  QVBoxLayout* layout_all_;
+
+  QHBoxLayout* layout_backend_;
+  QLabel* label_backend_;
+  QComboBox* combo_box_backend_;
+
+  QHBoxLayout* layout_number_of_threads_;
+  QLabel* label_number_of_threads_;
+  QLineEdit* line_edit_number_of_threads_;
+
+  QHBoxLayout* layout_time_budget_;
+  QLabel* label_time_budget_;
+  QLineEdit* line_edit_time_budget_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,108 @@
+#include <cstdlib>
+#include <string>
+
+#include "hs_cartographics/cartographics_format/formatter_proj4.hpp"
+
+#include "gui/cartographics_geographic_projector.hpp"
+
+namespace
+{
+
+//Integer following key in a proj4 definition, 0 without the key.
+int Proj4Integer(const std::string& proj4, const std::string& key)
+{
+  size_t position = proj4.find(key);
+  if (position == std::string::npos) return 0;
+  return std::atoi(proj4.c_str() + position + key.size());
+}
+
+/**
+ *  EPSG code named by a proj4 definition, either through an init file or
+ *  as a WGS84 UTM zone, 0 for anything else.
+ */
+int Proj4EpsgCode(const std::string& proj4)
+{
+  int code = Proj4Integer(proj4, "+init=epsg:");
+  if (code == 0) code = Proj4Integer(proj4, "+init=EPSG:");
+  if (code > 0) return code;
+
+  if (proj4.find("+proj=utm") == std::string::npos) return 0;
+  if (proj4.find("+datum=WGS84") == std::string::npos &&
+      proj4.find("+ellps=WGS84") == std::string::npos)
+  {
+    return 0;
+  }
+  int zone = Proj4Integer(proj4, "+zone=");
+  if (zone < 1 || zone > 60) return 0;
+  bool south = proj4.find("+south") != std::string::npos;
+  return (south ? 32700 : 32600) + zone;
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace gui
+{
+
+CartographicsGeographicProjector::CartographicsGeographicProjector(
+  const CoordinateSystem& frame_system)
+  : frame_system_(frame_system)
+  , epsg_code_(0)
+{
+  hs::cartographics::format::HS_FormatterProj4<Scalar> formatter;
+  formatter.StringToCoordinateSystem("+proj=longlat +datum=WGS84 +no_defs",
+                                     wgs84_system_);
+  std::string frame_proj4;
+  formatter.CoordinateSystemToString(frame_system_, frame_proj4);
+  epsg_code_ = Proj4EpsgCode(frame_proj4);
+}
+
+//Heights play no part in the planar position, the convertor gets zero.
+int CartographicsGeographicProjector::ToLongitudeLatitude(
+  double x, double y, double& longitude, double& latitude) const
+{
+  Coordinate frame_coordinate;
+  frame_coordinate << x, y, 0;
+  Coordinate wgs84_coordinate;
+  //One convertor per call, nothing is shared between threads.
+  Convertor convertor;
+  if (convertor.CoordinateSystemToCoordinateSystem(
+        frame_system_, wgs84_system_,
+        frame_coordinate, wgs84_coordinate) != 0)
+  {
+    return -1;
+  }
+  longitude = wgs84_coordinate[0];
+  latitude = wgs84_coordinate[1];
+  return 0;
+}
+
+int CartographicsGeographicProjector::FromLongitudeLatitude(
+  double longitude, double latitude, double& x, double& y) const
+{
+  Coordinate wgs84_coordinate;
+  wgs84_coordinate << longitude, latitude, 0;
+  Coordinate frame_coordinate;
+  Convertor convertor;
+  if (convertor.CoordinateSystemToCoordinateSystem(
+        wgs84_system_, frame_system_,
+        wgs84_coordinate, frame_coordinate) != 0)
+  {
+    return -1;
+  }
+  x = frame_coordinate[0];
+  y = frame_coordinate[1];
+  return 0;
+}
+
+int CartographicsGeographicProjector::EpsgCode() const
+{
+  return epsg_code_;
+}
+
+}
+}
+}
@@ -0,0 +1,48 @@
+#ifndef _HS_3D_RECONSTRUCTOR_GUI_CARTOGRAPHICS_GEOGRAPHIC_PROJECTOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_GUI_CARTOGRAPHICS_GEOGRAPHIC_PROJECTOR_HPP_
+
+#include "hs_cartographics/cartographics_conversion/convertor.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+#include "workflow/texture/geographic_projector.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace gui
+{
+
+/**
+ *  Converts between the coordinate system of the georeferenced frame and
+ *  WGS84 longitude and latitude with the cartographics convertor.
+ */
+class HS_EXPORT CartographicsGeographicProjector
+  : public workflow::GeographicProjector
+{
+public:
+  typedef double Scalar;
+  typedef hs::cartographics::HS_CoordinateSystem<Scalar> CoordinateSystem;
+  typedef hs::cartographics::conversion::Convertor<Scalar> Convertor;
+  typedef Convertor::Coordinate Coordinate;
+
+  CartographicsGeographicProjector(const CoordinateSystem& frame_system);
+
+  virtual int ToLongitudeLatitude(double x, double y,
+                                  double& longitude,
+                                  double& latitude) const;
+  virtual int FromLongitudeLatitude(double longitude, double latitude,
+                                    double& x, double& y) const;
+  virtual int EpsgCode() const;
+
+private:
+  CoordinateSystem frame_system_;
+  CoordinateSystem wgs84_system_;
+  int epsg_code_;
+};
+
+}
+}
+}
+
+#endif
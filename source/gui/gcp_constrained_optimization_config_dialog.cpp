@@ -12,7 +12,8 @@ GCPConstrainedOptimizationConfigDialog::GCPConstrainedOptimizationConfigDialog(
   double gcp_planar_accuracy,
   double gcp_height_accuracy,
   double tiepoint_feature_accuracy,
-  double gcp_marker_accuracy)
+  double gcp_marker_accuracy,
+  const workflow::BundleAdjustmentOptions& bundle_adjustment_options)
   : QDialog(parent, f)
 {
   layout_ = new QVBoxLayout(this);
@@ -22,7 +23,8 @@ GCPConstrainedOptimizationConfigDialog::GCPConstrainedOptimizationConfigDialog(
                                                gcp_planar_accuracy,
                                                gcp_height_accuracy,
                                                tiepoint_feature_accuracy,
-                                               gcp_marker_accuracy);
+                                               gcp_marker_accuracy,
+                                               bundle_adjustment_options);
   layout_->addWidget(widget_);
 
   button_box_ = new QDialogButtonBox(QDialogButtonBox::Ok |
@@ -55,6 +57,12 @@ double GCPConstrainedOptimizationConfigDialog::GetGCPMarkerAccuracy() const
   return widget_->GetGCPMarkerAccuracy();
 }
 
+workflow::BundleAdjustmentOptions
+GCPConstrainedOptimizationConfigDialog::GetBundleAdjustmentOptions() const
+{
+  return widget_->GetBundleAdjustmentOptions();
+}
+
 }
 }
 }
\ No newline at end of file
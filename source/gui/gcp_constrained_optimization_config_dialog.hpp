@@ -24,12 +24,16 @@ public:
                                          double gcp_planar_accuracy = 0.005,
                                          double gcp_height_accuracy = 0.01,
                                          double tiepoint_feature_accuracy = 0.1,
-                                         double gcp_marker_accuracy = 4.0);
+                                         double gcp_marker_accuracy = 4.0,
+                                         const workflow::BundleAdjustmentOptions&
+                                           bundle_adjustment_options =
+                                           workflow::BundleAdjustmentOptions());
 
   double GetGCPPlanarAccuracy() const;
   double GetGCPHeightAccuracy() const;
   double GetTiepointFeatureAccuracy() const;
   double GetGCPMarkerAccuracy() const;
+  workflow::BundleAdjustmentOptions GetBundleAdjustmentOptions() const;
 
 private:
   GCPConstrainedOptimizationConfigWidget* widget_;
@@ -14,7 +14,8 @@ GCPConstrainedOptimizationConfigWidget::GCPConstrainedOptimizationConfigWidget(
   double gcp_planar_accuracy,
   double gcp_height_accuracy,
   double tiepoint_feature_accuracy,
-  double gcp_marker_accuracy)
+  double gcp_marker_accuracy,
+  const workflow::BundleAdjustmentOptions& bundle_adjustment_options)
   : QWidget(parent, f)
 {
   layout_all_ = new QVBoxLayout(this);
@@ -66,6 +67,9 @@ GCPConstrainedOptimizationConfigWidget::GCPConstrainedOptimizationConfigWidget(
   layout_gcp_marker_accuracy_->addWidget(line_edit_gcp_marker_accuracy_);
   layout_all_->addLayout(layout_gcp_marker_accuracy_);
 
+  bundle_adjustment_options_widget_ =
+    new BundleAdjustmentOptionsWidget(this, 0, bundle_adjustment_options);
+  layout_all_->addWidget(bundle_adjustment_options_widget_);
 }
 
 double GCPConstrainedOptimizationConfigWidget::GetGCPPlanarAccuracy() const
@@ -88,6 +92,12 @@ double GCPConstrainedOptimizationConfigWidget::GetGCPMarkerAccuracy() const
   return line_edit_gcp_marker_accuracy_->text().toDouble();
 }
 
+workflow::BundleAdjustmentOptions
+GCPConstrainedOptimizationConfigWidget::GetBundleAdjustmentOptions() const
+{
+  return bundle_adjustment_options_widget_->GetBundleAdjustmentOptions();
+}
+
 }
 }
 }
\ No newline at end of file
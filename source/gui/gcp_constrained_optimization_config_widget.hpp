@@ -7,6 +7,8 @@
 #include <QHBoxLayout>
 #include <QVBoxLayout>
 
+#include "gui/bundle_adjustment_options_widget.hpp"
+
 namespace hs
 {
 namespace recon
@@ -23,12 +25,16 @@ public:
                                          double gcp_planar_accuracy = 0.005,
                                          double gcp_height_accuracy = 0.01,
                                          double tiepoint_feature_accuracy = 0.1,
-                                         double gcp_marker_accuracy = 4.0);
+                                         double gcp_marker_accuracy = 4.0,
+                                         const workflow::BundleAdjustmentOptions&
+                                           bundle_adjustment_options =
+                                           workflow::BundleAdjustmentOptions());
 
   double GetGCPPlanarAccuracy() const;
   double GetGCPHeightAccuracy() const;
   double GetTiepointFeatureAccuracy() const;
   double GetGCPMarkerAccuracy() const;
+  workflow::BundleAdjustmentOptions GetBundleAdjustmentOptions() const;
 
 private:
   QVBoxLayout* layout_all_;
@@ -48,6 +54,8 @@ private:
   QHBoxLayout* layout_gcp_marker_accuracy_;
   QLabel* label_gcp_marker_accuracy_;
   QLineEdit* line_edit_gcp_marker_accuracy_;
+
+  BundleAdjustmentOptionsWidget* bundle_adjustment_options_widget_;
 };
 
 }
@@ -19,6 +19,9 @@
 #include "hs_sfm/sfm_pipeline/bundle_adjustment_gcp_constrained_optimizor.hpp"
 #include "hs_sfm/sfm_pipeline/point_cloud_norm_calculator.hpp"
 
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/photo_orientation/compact_track_container.hpp"
+
 #include "gui/property_field_asignment_dialog.hpp"
 #include "gui/main_window.hpp"
 #include "gui/gcp_constrained_optimization_config_dialog.hpp"
@@ -773,7 +776,8 @@ void GCPsPane::OnActionGCPConfigTriggered()
                                                 gcp_planar_accuracy_,
                                                 gcp_height_accuracy_,
                                                 tiepoint_feature_accuracy_,
-                                                gcp_marker_accuracy_);
+                                                gcp_marker_accuracy_,
+                                                bundle_adjustment_options_);
 
   if (dialog.exec())
   {
@@ -781,6 +785,7 @@ void GCPsPane::OnActionGCPConfigTriggered()
     gcp_height_accuracy_ = dialog.GetGCPHeightAccuracy();
     tiepoint_feature_accuracy_ = dialog.GetTiepointFeatureAccuracy();
     gcp_marker_accuracy_ = dialog.GetGCPMarkerAccuracy();
+    bundle_adjustment_options_ = dialog.GetBundleAdjustmentOptions();
   }
 }
 
@@ -1308,7 +1313,6 @@ void GCPsPane::GCPConstrainedOptimize(
   typedef hs::sfm::Track Track;
   typedef hs::sfm::TrackContainer TrackContainer;
   typedef hs::sfm::ViewInfoIndexer ViewInfoIndexer;
-  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
   typedef hs::recon::db::Identifier Identifier;
   typedef EIGEN_STD_MAP(size_t, ImageKeyset) ImageKeysetMap;
   typedef hs::sfm::pipeline::PointCloudNormCalculator<Scalar> NormCalculator;
@@ -1415,41 +1419,75 @@ void GCPsPane::GCPConstrainedOptimize(
   TrackPointMap track_point_map;
   ViewInfoIndexer view_info_indexer;
   {
-    std::string tracks_path = response_photo_orientation.tracks_path;
-    std::ifstream tracks_file(tracks_path, std::ios::binary);
-    cereal::PortableBinaryInputArchive archive(tracks_file);
-    archive(tracks, track_point_map);
-  }
-  for (size_t i = 0; i < tracks.size(); i++)
-  {
-    for (size_t j = 0; j < tracks[i].size(); j++)
+    typedef workflow::CompactTrackContainer::Index Index;
+    workflow::CompactTrackContainer compact_tracks;
+    if (compact_tracks.Load(response_photo_orientation.tracks_path) != 0)
+    {
+      QMessageBox box;
+      box.setText(tr("Optimize error: Unable to load the tracks!"));
+      box.exec();
+      return;
+    }
+
+    //Photo id to reordered image id, flat so the lookup per view is cheap.
+    std::vector<size_t> reordered_image_id_table;
+    if (!reordered_image_ids.empty())
     {
-      size_t image_id = tracks[i][j].first;
-      tracks[i][j].first = reordered_image_ids[image_id];
+      reordered_image_id_table.resize(
+        reordered_image_ids.rbegin()->first + 1, size_t(-1));
+      for (const auto& reordered_image_id : reordered_image_ids)
+      {
+        reordered_image_id_table[reordered_image_id.first] =
+          reordered_image_id.second;
+      }
+    }
+
+    size_t number_of_tracks = compact_tracks.NumberOfTracks();
+    tracks.resize(number_of_tracks);
+    track_point_map = TrackPointMap(number_of_tracks);
+    for (size_t i = 0; i < number_of_tracks; i++)
+    {
+      size_t track_size = compact_tracks.TrackSize(i);
+      const Index* image_ids = compact_tracks.TrackImageIds(i);
+      const Index* key_ids = compact_tracks.TrackKeyIds(i);
+      Track& track = tracks[i];
+      track.reserve(track_size);
+      for (size_t j = 0; j < track_size; j++)
+      {
+        size_t photo_id = size_t(image_ids[j]);
+        if (photo_id >= reordered_image_id_table.size() ||
+            reordered_image_id_table[photo_id] == size_t(-1))
+        {
+          continue;
+        }
+        track.push_back(std::make_pair(reordered_image_id_table[photo_id],
+                                       size_t(key_ids[j])));
+      }
+      if (compact_tracks.IsPointValid(i))
+      {
+        track_point_map[i] = size_t(compact_tracks.PointId(i));
+      }
     }
   }
   view_info_indexer.SetViewInfoByTracks(tracks);
 
   //Get points
-  PointCloudData pcd;
+  workflow::PointPositionView positions;
+  if (positions.Open(response_photo_orientation.point_cloud_path) != 0)
   {
-    std::ifstream point_cloud_file(response_photo_orientation.point_cloud_path,
-                                   std::ios::binary);
-    cereal::PortableBinaryInputArchive archive(point_cloud_file);
-    archive(pcd);
+    return;
   }
 
-  PointContainer points(pcd.VertexData().size());
-  for (size_t i = 0; i < pcd.VertexData().size(); i++)
+  //Transformed straight out of the mapping into the adjusted points.
+  PointContainer points(positions.size());
+  for (size_t i = 0; i < positions.size(); i++)
   {
-    points[i][0] = pcd.VertexData()[i][0];
-    points[i][1] = pcd.VertexData()[i][1];
-    points[i][2] = pcd.VertexData()[i][2];
-
+    Point position = positions[i];
     points[i] =
-      similar_scale_ * (similar_rotation_ * points[i]) +
+      similar_scale_ * (similar_rotation_ * position) +
       (similar_translate_ - offset);
   }
+  positions.Close();
 
   //Get image_keysets_gcp tracks_gcp gcps_measure
   ImageKeysetContainer image_keysets_gcp(image_keysets.size());
@@ -1506,27 +1544,63 @@ void GCPsPane::GCPConstrainedOptimize(
   QString number_of_threads_key = tr("number_of_threads");
   uint number_of_threads = settings.value(number_of_threads_key,
                                           QVariant(uint(1))).toUInt();
-  Optimizor optimizor(size_t(number_of_threads),
-                      gcp_planar_accuracy_,
-                      gcp_height_accuracy_,
-                      tiepoint_feature_accuracy_,
-                      gcp_marker_accuracy_);
-  if (optimizor(image_keysets,
-                image_intrinsic_map,
-                tracks,
-                image_extrinsic_map,
-                track_point_map,
-                view_info_indexer,
-                image_keysets_gcp,
-                tracks_gcp,
-                gcps_measure,
-                intrinsic_params_set,
-                extrinsic_params_set,
-                points,
-                gcps_estimate,
-                estimate_measure_map) != 0)
+  if (bundle_adjustment_options_.backend !=
+      workflow::BundleAdjustmentOptions::BACKEND_BUILTIN)
   {
-    return;
+    workflow::CeresBundleAdjuster::ControlPoints control_points;
+    control_points.keysets = image_keysets_gcp;
+    control_points.tracks = tracks_gcp;
+    control_points.measures = gcps_measure;
+    control_points.planar_accuracy = gcp_planar_accuracy_;
+    control_points.height_accuracy = gcp_height_accuracy_;
+    control_points.marker_accuracy = gcp_marker_accuracy_;
+    workflow::CeresBundleAdjuster bundle_adjuster(bundle_adjustment_options_,
+                                                  size_t(number_of_threads),
+                                                  tiepoint_feature_accuracy_);
+    if (bundle_adjuster(image_keysets,
+                        image_intrinsic_map,
+                        image_extrinsic_map,
+                        tracks,
+                        track_point_map,
+                        view_info_indexer,
+                        intrinsic_params_set,
+                        extrinsic_params_set,
+                        points,
+                        &control_points) != 0)
+    {
+      return;
+    }
+    gcps_estimate.swap(control_points.estimates);
+    estimate_measure_map = TrackPointMap(gcps_estimate.size());
+    for (size_t i = 0; i < gcps_estimate.size(); i++)
+    {
+      estimate_measure_map[i] = i;
+    }
+  }
+  else
+  {
+    Optimizor optimizor(size_t(number_of_threads),
+                        gcp_planar_accuracy_,
+                        gcp_height_accuracy_,
+                        tiepoint_feature_accuracy_,
+                        gcp_marker_accuracy_);
+    if (optimizor(image_keysets,
+                  image_intrinsic_map,
+                  tracks,
+                  image_extrinsic_map,
+                  track_point_map,
+                  view_info_indexer,
+                  image_keysets_gcp,
+                  tracks_gcp,
+                  gcps_measure,
+                  intrinsic_params_set,
+                  extrinsic_params_set,
+                  points,
+                  gcps_estimate,
+                  estimate_measure_map) != 0)
+    {
+      return;
+    }
   }
 
   if (progress_manager)
@@ -11,6 +11,7 @@
 #include "hs_progress/progress_utility/progress_manager.hpp"
 
 #include "database/database_mediator.hpp"
+#include "workflow/photo_orientation/ceres_bundle_adjuster.hpp"
 #include "gui/manager_pane.hpp"
 #include "gui/gcps_table_widget.hpp"
 #include "gui/tiepoint_measure_widget.hpp"
@@ -142,6 +143,7 @@ private:
   Scalar gcp_height_accuracy_;
   Scalar tiepoint_feature_accuracy_;
   Scalar gcp_marker_accuracy_;
+  workflow::BundleAdjustmentOptions bundle_adjustment_options_;
 
   Scalar similar_scale_;
   Rotation similar_rotation_;
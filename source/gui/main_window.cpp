@@ -119,6 +119,8 @@ MainWindow::MainWindow()
                     scene_window_, &SceneWindow::SetPointCloud);
   QObject::connect(blocks_pane_, &BlocksPane::SurfaceModelActivated,
                     scene_window_, &SceneWindow::SetSurfaceModel);
+  QObject::connect(blocks_pane_, &BlocksPane::TextureActivated,
+                   scene_window_, &SceneWindow::SetTexture);
   QObject::connect(blocks_pane_, &BlocksPane::PhotoOrientationActivated,
                    gcps_pane_, &GCPsPane::UpdatePhotoOrientation);
   QObject::connect(gcps_pane_, &GCPsPane::GCPRelateLocationState,
@@ -21,6 +21,11 @@ PhotoOrientationConfigureWidget::PhotoOrientationConfigureWidget(
   layout_inbox_ = new QVBoxLayout;
   group_box_->setLayout(layout_inbox_);
 
+  bundle_adjustment_options_widget_ =
+    new BundleAdjustmentOptionsWidget(group_box_);
+  layout_inbox_->addWidget(bundle_adjustment_options_widget_);
+  layout_inbox_->addStretch();
+
   //push_button_config_coordinate_system_ =
   //  new QPushButton(tr("Configure Coordinate System"), this);
   //layout_inbox_->addWidget(push_button_config_coordinate_system_);
@@ -34,6 +39,8 @@ PhotoOrientationConfigureWidget::PhotoOrientationConfigureWidget(
 void PhotoOrientationConfigureWidget::FetchPhotoOrientationConfig(
   workflow::PhotoOrientationConfig& photo_orientation_config)
 {
+  photo_orientation_config.set_bundle_adjustment_options(
+    bundle_adjustment_options_widget_->GetBundleAdjustmentOptions());
 }
 
 void PhotoOrientationConfigureWidget::OnButtonConfigCoordinateSystemClicked()
@@ -12,6 +12,8 @@
 
 #include "workflow/photo_orientation/incremental_photo_orientation.hpp"
 
+#include "gui/bundle_adjustment_options_widget.hpp"
+
 namespace hs
 {
 namespace recon
@@ -38,6 +40,7 @@ private:
   QVBoxLayout* layout_inbox_;
   QGroupBox* group_box_;
   QPushButton* push_button_config_coordinate_system_;
+  BundleAdjustmentOptionsWidget* bundle_adjustment_options_widget_;
 
   CoordinateSystem coordinate_system_;
 };
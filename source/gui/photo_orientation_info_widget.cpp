@@ -1,10 +1,14 @@
 ﻿#include <fstream>
 
+#include <boost/filesystem.hpp>
+
+#include <QSettings>
+
 #include <cereal/types/map.hpp>
 #include <cereal/types/utility.hpp>
 #include <cereal/archives/portable_binary.hpp>
 
-#include "hs_sfm/sfm_utility/projective_functions.hpp"
+#include "workflow/common/mapped_point_cloud.hpp"
 
 #include "photo_orientation_info_widget.hpp"
 
@@ -17,8 +21,8 @@ namespace gui
 
 PhotoOrientationInfoWidget::PhotoOrientationInfoWidget(QWidget* parent)
   : QWidget(parent)
-  , reprojection_error_(0.0)
   , reprojection_error_computed_(false)
+  , number_of_threads_(1)
 {
   layout_main_ = new QVBoxLayout;
   setLayout(layout_main_);
@@ -45,9 +49,33 @@ PhotoOrientationInfoWidget::PhotoOrientationInfoWidget(QWidget* parent)
   layout_reprojection_error_->addWidget(label_reprojection_error_);
   layout_reprojection_error_->addWidget(lineedit_reprojection_error_);
 
+  layout_reprojection_rms_ = new QHBoxLayout;
+  label_reprojection_rms_ = new QLabel(tr("Reprojection RMS:"));
+  lineedit_reprojection_rms_ = new QLineEdit;
+  lineedit_reprojection_rms_->setReadOnly(true);
+  layout_reprojection_rms_->addWidget(label_reprojection_rms_);
+  layout_reprojection_rms_->addWidget(lineedit_reprojection_rms_);
+
+  layout_reprojection_median_ = new QHBoxLayout;
+  label_reprojection_median_ = new QLabel(tr("Reprojection Median:"));
+  lineedit_reprojection_median_ = new QLineEdit;
+  lineedit_reprojection_median_->setReadOnly(true);
+  layout_reprojection_median_->addWidget(label_reprojection_median_);
+  layout_reprojection_median_->addWidget(lineedit_reprojection_median_);
+
+  layout_reprojection_outliers_ = new QHBoxLayout;
+  label_reprojection_outliers_ = new QLabel(tr("Reprojection Outliers:"));
+  lineedit_reprojection_outliers_ = new QLineEdit;
+  lineedit_reprojection_outliers_->setReadOnly(true);
+  layout_reprojection_outliers_->addWidget(label_reprojection_outliers_);
+  layout_reprojection_outliers_->addWidget(lineedit_reprojection_outliers_);
+
   layout_general_->addLayout(layout_num_used_photo_);
   layout_general_->addLayout(layout_num_pointcloud_);
   layout_general_->addLayout(layout_reprojection_error_);
+  layout_general_->addLayout(layout_reprojection_rms_);
+  layout_general_->addLayout(layout_reprojection_median_);
+  layout_general_->addLayout(layout_reprojection_outliers_);
   layout_main_->addLayout(layout_general_);
 
   spacer_ = new QSpacerItem(0,0);
@@ -59,6 +87,18 @@ PhotoOrientationInfoWidget::PhotoOrientationInfoWidget(QWidget* parent)
   layout_intrinsic_param_->addWidget(treewidget_intrinsic_param_);
   layout_main_->addLayout(layout_intrinsic_param_);
 
+  treewidget_reprojection_statistics_ = new QTreeWidget;
+  treewidget_reprojection_statistics_->setColumnCount(5);
+  QStringList reprojection_statistics_labels;
+  reprojection_statistics_labels << tr("Photo")
+                                 << tr("Projections")
+                                 << tr("RMS")
+                                 << tr("Median")
+                                 << tr("Outliers");
+  treewidget_reprojection_statistics_->setHeaderLabels(
+    reprojection_statistics_labels);
+  layout_main_->addWidget(treewidget_reprojection_statistics_);
+
   timer_reprojection_error_ = new QTimer(this);
 }
 
@@ -102,14 +142,12 @@ int PhotoOrientationInfoWidget::Initialize(
 
   //读取稀疏点云获取num_pointcloud
   {
-    std::ifstream sparse_point_cloud_file(
-      sparse_point_cloud_path, std::ios::binary);
-    if(!sparse_point_cloud_file) return -1;
-    cereal::PortableBinaryInputArchive archive_sparse_point_cloud(
-      sparse_point_cloud_file);
-    archive_sparse_point_cloud(pcd_);
+    if (sparse_points_.Open(sparse_point_cloud_path) != 0)
+    {
+      return -1;
+    }
     lineedit_num_pointcloud_->setText(
-      QString::number(pcd_.PointCloudSize()));
+      QString::number(sparse_points_.size()));
   }
 
   //读取内参数
@@ -135,14 +173,32 @@ int PhotoOrientationInfoWidget::Initialize(
   }
 
   //读取tracks
-  {
-    std::ifstream tracks_file(tracks_path, std::ios::binary);
-    if (!tracks_file) return -1;
-    cereal::PortableBinaryInputArchive archive(tracks_file);
-    archive(tracks_, track_point_map_);
-  }
+  if (tracks_.Load(tracks_path) != 0) return -1;
+
+  //Statistics are cached next to the tracks and reused while the
+  //orientation files are unchanged.
+  reprojection_statistics_path_ =
+    (boost::filesystem::path(tracks_path).parent_path() /
+     "reprojection_statistics.bin").string();
+  std::vector<std::string> source_paths;
+  source_paths.push_back(keysets_path);
+  source_paths.push_back(intrinsic_path);
+  source_paths.push_back(extrinsic_path);
+  source_paths.push_back(sparse_point_cloud_path);
+  source_paths.push_back(tracks_path);
+  reprojection_source_stamps_ =
+    workflow::ReprojectionStatistics::SourceStamps(source_paths);
+
+  QSettings settings;
+  QString number_of_threads_key = tr("number_of_threads");
+  number_of_threads_ = size_t(settings.value(number_of_threads_key,
+                                             QVariant(uint(1))).toUInt());
 
   lineedit_reprojection_error_->setText(tr("Computing..."));
+  lineedit_reprojection_rms_->clear();
+  lineedit_reprojection_median_->clear();
+  lineedit_reprojection_outliers_->clear();
+  treewidget_reprojection_statistics_->clear();
   reprojection_error_computed_ = false;
   timer_reprojection_error_->start(100);
   QObject::connect(timer_reprojection_error_, &QTimer::timeout,
@@ -156,56 +212,44 @@ int PhotoOrientationInfoWidget::Initialize(
 
 void PhotoOrientationInfoWidget::ComputeReprojectionError()
 {
-  typedef Keyset::Key Key;
+  typedef workflow::ReprojectionStatisticsCalculator Calculator;
 
-  std::map<size_t, size_t> image_intrinsic_map;
-  for (const auto& extrinsic_params : extrinsic_params_map_)
+  if (reprojection_statistics_.Load(reprojection_statistics_path_) == 0 &&
+      reprojection_statistics_.source_stamps == reprojection_source_stamps_)
   {
-    image_intrinsic_map[extrinsic_params.first.first] =
-      extrinsic_params.first.second;
+    sparse_points_.Close();
+    reprojection_error_computed_ = true;
+    return;
   }
 
-  reprojection_error_ = 0.0;
-  size_t number_of_projection = 0;
-  for (size_t track_id = 0; track_id < tracks_.size(); track_id++)
+  //One camera per oriented photo, lookups are done once here instead of
+  //per observation.
+  Calculator::CameraContainer cameras;
+  for (const auto& extrinsic_params : extrinsic_params_map_)
   {
-    if (track_point_map_.IsValid(track_id))
-    {
-      size_t point_id = track_point_map_[track_id];
-      for (size_t view_id = 0; view_id < tracks_[track_id].size(); view_id++)
-      {
-        size_t image_id = tracks_[track_id][view_id].first;
-        size_t key_id = tracks_[track_id][view_id].second;
-
-        auto itr_intrinsic_id = image_intrinsic_map.find(image_id);
-        if (itr_intrinsic_id == image_intrinsic_map.end()) continue;
-        size_t intrinsic_id = itr_intrinsic_id->second;
-
-        auto itr_intrinsic = intrinsic_params_map_.find(intrinsic_id);
-        if (itr_intrinsic == intrinsic_params_map_.end()) continue;
-
-        auto itr_extrinsic =
-          extrinsic_params_map_.find(std::make_pair(image_id, intrinsic_id));
-        if (itr_extrinsic == extrinsic_params_map_.end()) continue;
-
-        auto itr_keyset = keysets_.find(image_id);
-        if (itr_keyset == keysets_.end()) continue;
-
-        Key projected =
-          hs::sfm::ProjectiveFunctions<Scalar>::WorldPointProjectToImageKey(
-            itr_intrinsic->second,
-            itr_extrinsic->second,
-            pcd_.VertexData()[point_id]);
-
-        reprojection_error_ +=
-          (projected - itr_keyset->second[key_id]).norm();
-        number_of_projection++;
-
-      }
-    }
+    size_t image_id = extrinsic_params.first.first;
+    size_t intrinsic_id = extrinsic_params.first.second;
+    auto itr_intrinsic = intrinsic_params_map_.find(intrinsic_id);
+    if (itr_intrinsic == intrinsic_params_map_.end()) continue;
+    auto itr_keyset = keysets_.find(image_id);
+    if (itr_keyset == keysets_.end()) continue;
+
+    Calculator::Camera camera;
+    camera.photo_id = uint32_t(image_id);
+    camera.intrinsic_params = itr_intrinsic->second;
+    camera.extrinsic_params = extrinsic_params.second;
+    camera.keyset = &itr_keyset->second;
+    cameras.push_back(camera);
   }
 
-  reprojection_error_ /= Scalar(number_of_projection);
+  Calculator calculator(number_of_threads_);
+  if (calculator(tracks_, sparse_points_, cameras,
+                 reprojection_statistics_) == 0)
+  {
+    reprojection_statistics_.source_stamps = reprojection_source_stamps_;
+    reprojection_statistics_.Save(reprojection_statistics_path_);
+  }
+  sparse_points_.Close();
   reprojection_error_computed_ = true;
 }
 
@@ -213,7 +257,7 @@ void PhotoOrientationInfoWidget::OnTimeOut()
 {
   if (reprojection_error_computed_)
   {
-    lineedit_reprojection_error_->setText(QString::number(reprojection_error_));
+    UpdateReprojectionStatistics();
     if (timer_reprojection_error_->isActive())
     {
       timer_reprojection_error_->stop();
@@ -221,6 +265,57 @@ void PhotoOrientationInfoWidget::OnTimeOut()
   }
 }
 
+void PhotoOrientationInfoWidget::UpdateReprojectionStatistics()
+{
+  const workflow::ReprojectionErrorSummary& overall =
+    reprojection_statistics_.overall;
+  lineedit_reprojection_error_->setText(QString::number(overall.mean));
+  lineedit_reprojection_rms_->setText(QString::number(overall.rms));
+  lineedit_reprojection_median_->setText(QString::number(overall.median));
+  lineedit_reprojection_outliers_->setText(
+    QString::number(qulonglong(overall.number_of_outliers)) + tr(" (> ") +
+    QString::number(reprojection_statistics_.outlier_threshold) + tr(")"));
+
+  treewidget_reprojection_statistics_->clear();
+  QTreeWidgetItem* photos_item = new QTreeWidgetItem;
+  photos_item->setText(0, tr("Photos"));
+  treewidget_reprojection_statistics_->addTopLevelItem(photos_item);
+  for (size_t i = 0; i < reprojection_statistics_.photo_ids.size(); i++)
+  {
+    const workflow::ReprojectionErrorSummary& summary =
+      reprojection_statistics_.photo_summaries[i];
+    QTreeWidgetItem* photo_item = new QTreeWidgetItem;
+    photo_item->setText(
+      0, QString::number(reprojection_statistics_.photo_ids[i]));
+    photo_item->setText(
+      1, QString::number(qulonglong(summary.number_of_projections)));
+    photo_item->setText(2, QString::number(summary.rms));
+    photo_item->setText(3, QString::number(summary.median));
+    photo_item->setText(
+      4, QString::number(qulonglong(summary.number_of_outliers)));
+    photos_item->addChild(photo_item);
+  }
+
+  QTreeWidgetItem* histogram_item = new QTreeWidgetItem;
+  histogram_item->setText(0, tr("Histogram"));
+  treewidget_reprojection_statistics_->addTopLevelItem(histogram_item);
+  double bin_width = reprojection_statistics_.histogram_bin_width;
+  size_t number_of_bins = reprojection_statistics_.histogram.size();
+  for (size_t i = 0; i < number_of_bins; i++)
+  {
+    QTreeWidgetItem* bin_item = new QTreeWidgetItem;
+    QString range = QString::number(double(i) * bin_width) + tr(" - ");
+    if (i + 1 < number_of_bins)
+    {
+      range += QString::number(double(i + 1) * bin_width);
+    }
+    bin_item->setText(0, range);
+    bin_item->setText(
+      1, QString::number(qulonglong(reprojection_statistics_.histogram[i])));
+    histogram_item->addChild(bin_item);
+  }
+}
+
 IntrinsicParaminfoWidget::IntrinsicParaminfoWidget(const IntrinsicParams& ip)
 {
   layout_main_ = new QVBoxLayout;
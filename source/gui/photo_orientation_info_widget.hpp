@@ -19,7 +19,11 @@
 #include "hs_sfm/sfm_utility/key_type.hpp"
 #include "hs_sfm/sfm_utility/camera_type.hpp"
 #include "hs_sfm/sfm_utility/match_type.hpp"
-#include "hs_graphics/graphics_utility/pointcloud_data.hpp"
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/photo_orientation/compact_track_container.hpp"
+#include "workflow/photo_orientation/reprojection_statistics.hpp"
 
 namespace hs
 {
@@ -45,7 +49,8 @@ public:
   typedef EIGEN_STD_MAP(ExtrinsicIndex, ExtrinsicParams)
           ExtrinsicParamsMap;
 
-  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+  typedef EIGEN_VECTOR(Scalar, 3) Point;
+  typedef EIGEN_STD_VECTOR(Point) PointContainer;
 
   PhotoOrientationInfoWidget(QWidget* parent = 0);
   ~PhotoOrientationInfoWidget();
@@ -61,15 +66,22 @@ public:
   void OnTimeOut();
 
 protected:
+  void UpdateReprojectionStatistics();
 
 private:
   QLabel* label_num_used_photo_;
   QLabel* label_reprojection_error_;
   QLabel* label_num_pointcloud_;
+  QLabel* label_reprojection_rms_;
+  QLabel* label_reprojection_median_;
+  QLabel* label_reprojection_outliers_;
 
   QLineEdit *lineedit_num_used_photo_;
   QLineEdit *lineedit_reprojection_error_;
   QLineEdit *lineedit_num_pointcloud_;
+  QLineEdit *lineedit_reprojection_rms_;
+  QLineEdit *lineedit_reprojection_median_;
+  QLineEdit *lineedit_reprojection_outliers_;
 
   QVBoxLayout* layout_main_;
   QVBoxLayout* layout_general_;
@@ -77,24 +89,32 @@ private:
   QHBoxLayout* layout_num_used_photo_;
   QHBoxLayout* layout_reprojection_error_;
   QHBoxLayout* layout_num_pointcloud_;
+  QHBoxLayout* layout_reprojection_rms_;
+  QHBoxLayout* layout_reprojection_median_;
+  QHBoxLayout* layout_reprojection_outliers_;
 
   QSpacerItem* spacer_;
 
   QTreeWidget* treewidget_intrinsic_param_;
+  QTreeWidget* treewidget_reprojection_statistics_;
 
   QTimer* timer_reprojection_error_;
 
   IntrinsicParamsMap intrinsic_params_map_;
   ExtrinsicParamsMap extrinsic_params_map_;
 
-  Scalar reprojection_error_;
   int reprojection_error_computed_;
   std::thread reprojection_compute_thread_;
+  size_t number_of_threads_;
+  std::string reprojection_statistics_path_;
+  std::vector<uint64_t> reprojection_source_stamps_;
+  workflow::ReprojectionStatistics reprojection_statistics_;
 
   KeysetMap keysets_;
-  PointCloudData pcd_;
-  hs::sfm::TrackContainer tracks_;
-  hs::sfm::ObjectIndexMap track_point_map_;
+  //Only positions are needed by the reprojection statistics, read in place
+  //from the mapped file and released once they are computed.
+  workflow::PointPositionView sparse_points_;
+  workflow::CompactTrackContainer tracks_;
 };
 
 class IntrinsicParaminfoWidget: public QWidget
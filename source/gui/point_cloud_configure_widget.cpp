@@ -31,6 +31,8 @@ PointCloudConfigureWidget::PointCloudConfigureWidget(
   layout_inbox_->addLayout(layout_using_sparse_);
   layout_point_cloud_quality_ = new QHBoxLayout;
   layout_inbox_->addLayout(layout_point_cloud_quality_);
+  layout_dense_method_ = new QHBoxLayout;
+  layout_inbox_->addLayout(layout_dense_method_);
   QSpacerItem* spaceritem2 = new QSpacerItem(0, 0);
   layout_inbox_->addItem(spaceritem2);
 
@@ -49,6 +51,17 @@ PointCloudConfigureWidget::PointCloudConfigureWidget(
   combo_box_->setCurrentIndex(1);
   layout_point_cloud_quality_->addWidget(combo_box_);
 
+  label_dense_method_ = new QLabel(tr("Dense Method"), group_box_);
+  layout_dense_method_->addWidget(label_dense_method_);
+  combo_box_dense_method_ = new QComboBox;
+  combo_box_dense_method_->setEditable(false);
+  QStringList method_text;
+  method_text << tr("Depth Map")
+              << tr("SGM (Nadir)");
+  combo_box_dense_method_->addItems(method_text);
+  combo_box_dense_method_->setCurrentIndex(0);
+  layout_dense_method_->addWidget(combo_box_dense_method_);
+
   QObject::connect(using_sparse_point_cloud_, &QCheckBox::clicked,
   this, &PointCloudConfigureWidget::UsingSparsePointCloud);
 
@@ -57,9 +70,15 @@ PointCloudConfigureWidget::PointCloudConfigureWidget(
 void PointCloudConfigureWidget::UsingSparsePointCloud()
 {
   if(using_sparse_point_cloud_->isChecked())
+  {
     combo_box_->setEnabled(false);
+    combo_box_dense_method_->setEnabled(false);
+  }
   else
+  {
     combo_box_->setEnabled(true);
+    combo_box_dense_method_->setEnabled(true);
+  }
 }
 
 void PointCloudConfigureWidget::FetchPointCloudConfig(
@@ -71,6 +90,16 @@ void PointCloudConfigureWidget::FetchPointCloudConfig(
   }
   else
   {
+    if(combo_box_dense_method_->currentIndex() == 1)
+    {
+      point_cloud_config.set_dense_method(
+        workflow::PointCloudConfig::DENSE_SGM);
+    }
+    else
+    {
+      point_cloud_config.set_dense_method(
+        workflow::PointCloudConfig::DENSE_DEPTH_MAP);
+    }
     if(combo_box_->currentIndex() == 0) //Low
     {
       point_cloud_config.set_s_pyramid_level(4);
@@ -37,11 +37,14 @@ private:
   QVBoxLayout* layout_inbox_;
   QGroupBox* group_box_;
   QComboBox* combo_box_;
+  QComboBox* combo_box_dense_method_;
   QCheckBox* using_sparse_point_cloud_;
   QLabel* label_point_cloud_quality_;
   QLabel* label_using_sparse_;
+  QLabel* label_dense_method_;
   QHBoxLayout* layout_point_cloud_quality_;
   QHBoxLayout* layout_using_sparse_;
+  QHBoxLayout* layout_dense_method_;
 
 };
 
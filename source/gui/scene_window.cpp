@@ -3,6 +3,7 @@
 #include <iostream>
 #include <limits>
 #include <algorithm>
+#include <cmath>
 
 #if 1
 #include <iomanip>
@@ -17,8 +18,23 @@
 //#include "hs_graphics/graphics_utility/read_file.hpp"
 #include "hs_sfm/sfm_utility/camera_type.hpp"
 
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/mesh_surface/mesh_simplifier.hpp"
+#include "workflow/texture/rough_texture.hpp"
+#include "workflow/texture/textured_mesh.hpp"
+
 #include "gui/scene_window.hpp"
 
+namespace
+{
+
+//Triangles drawn at most, finer levels of detail are left on disk.
+const size_t SURFACE_MODEL_MAX_TRIANGLES = 2 << 20;
+//Points sampled at most from the atlas of a textured model.
+const size_t TEXTURE_MAX_POINTS = 4 << 20;
+
+}
+
 namespace hs
 {
 namespace recon
@@ -137,6 +153,12 @@ void SceneWindow::SetSurfaceModel(uint surface_model_id)
   UpdateSurfaceModel();
 }
 
+void SceneWindow::SetTexture(uint texture_id)
+{
+  texture_id_ = texture_id;
+  UpdateTexture();
+}
+
 void SceneWindow::OnMouseClicked(Qt::KeyboardModifiers state_key,
                                  Qt::MouseButton mouse_button, QPoint pos)
 {
@@ -419,6 +441,69 @@ void SceneWindow::UpdateSurfaceModel()
               FLAG_SHOW_SURFACE_MODEL);
 }
 
+void SceneWindow::UpdateTexture()
+{
+  hs::recon::db::RequestGetTexture request_texture;
+  hs::recon::db::ResponseGetTexture response_texture;
+  request_texture.id = db::Database::Identifier(texture_id_);
+  database_mediator_.Request(
+    this, db::DatabaseMediator::REQUEST_GET_TEXTURE,
+    request_texture, response_texture, false);
+  if (response_texture.error_code !=
+      hs::recon::db::Database::DATABASE_NO_ERROR)
+  {
+    return;
+  }
+
+  hs::recon::db::RequestGetSurfaceModel request_surface_model;
+  hs::recon::db::ResponseGetSurfaceModel response_surface_model;
+  request_surface_model.id =
+    db::Database::Identifier(response_texture.record[
+      db::TextureResource::TEXTURE_FIELD_SURFACE_MODEL_ID].ToInt());
+  database_mediator_.Request(
+    this, db::DatabaseMediator::REQUEST_GET_SURFACE_MODEL,
+    request_surface_model, response_surface_model, false);
+  if (response_surface_model.error_code !=
+      hs::recon::db::Database::DATABASE_NO_ERROR)
+  {
+    return;
+  }
+
+  hs::recon::db::RequestGetPointCloud request_point_cloud;
+  hs::recon::db::ResponseGetPointCloud response_point_cloud;
+  request_point_cloud.id =
+    db::Database::Identifier(response_surface_model.record[
+      db::SurfaceModelResource::SURFACE_MODEL_FIELD_POINT_CLOUD_ID].ToInt());
+  database_mediator_.Request(
+    this, db::DatabaseMediator::REQUEST_GET_POINT_CLOUD,
+    request_point_cloud, response_point_cloud, false);
+  if (response_point_cloud.error_code !=
+      hs::recon::db::Database::DATABASE_NO_ERROR)
+  {
+    return;
+  }
+
+  hs::recon::db::RequestGetPhotoOrientation request_photo_orientation;
+  hs::recon::db::ResponseGetPhotoOrientation response_photo_orientation;
+  request_photo_orientation.id =
+    db::Database::Identifier(response_point_cloud.record[
+      db::PointCloudResource::POINT_CLOUD_FIELD_PHOTO_ORIENTATION_ID].ToInt());
+  database_mediator_.Request(
+    this, db::DatabaseMediator::REQUEST_GET_PHOTO_ORIENTATION,
+    request_photo_orientation, response_photo_orientation, false);
+  if (response_photo_orientation.error_code !=
+      hs::recon::db::Database::DATABASE_NO_ERROR)
+  {
+    return;
+  }
+
+  UpdateScene(response_photo_orientation.intrinsic_path,
+              response_photo_orientation.extrinsic_path,
+              response_texture.model_path,
+              FLAG_SHOW_TEXTURE,
+              response_photo_orientation.similar_transform_path);
+}
+
 
 void SceneWindow::BackupSelectedPointsColor(Float left, Float right,
                                             Float bottom, Float top,
@@ -465,7 +550,8 @@ void SceneWindow::BackupSelectedPointsColor(Float left, Float right,
 void SceneWindow::UpdateScene(const std::string& intrinsic_path,
                               const std::string& extrinsic_path,
                               const std::string& path,
-                              SceneFlag flag)
+                              SceneFlag flag,
+                              const std::string& similar_transform_path)
 {
   typedef hs::sfm::CameraIntrinsicParams<double> SFMIntrinsicParams;
   typedef EIGEN_STD_MAP(size_t, SFMIntrinsicParams) SFMIntrinsicParamsMap;
@@ -550,20 +636,54 @@ void SceneWindow::UpdateScene(const std::string& intrinsic_path,
   {
     //读取稀疏点云
     PointCloudData pcd;
-    hs::graphics::PointCloudData<double> pcd_double;
-    std::ifstream point_cloud_file(path, std::ios::binary);
-    cereal::PortableBinaryInputArchive archive(point_cloud_file);
-    archive(pcd_double);
-
-    pcd.VertexData().resize(pcd_double.PointCloudSize());
-    pcd.NormalData().resize(pcd_double.PointCloudSize());
-    pcd.ColorData().resize(pcd_double.PointCloudSize());
-    for(size_t i = 0; i < pcd_double.PointCloudSize(); i++)
+    workflow::MappedPointCloud mapped_pcd;
+    if (mapped_pcd.Open(path) == 0)
     {
-      pcd.VertexData()[i] =
-        (pcd_double.VertexData()[i] - offset_).cast<Float>();
-      pcd.NormalData()[i] = pcd_double.NormalData()[i].cast<Float>();
-      pcd.ColorData()[i] = pcd_double.ColorData()[i].cast<Float>();
+      //Fill the render arrays straight from the mapping, without a double
+      //copy of the cloud in between.
+      size_t number_of_points = mapped_pcd.NumberOfPoints();
+      pcd.VertexData().resize(number_of_points);
+      pcd.NormalData().resize(number_of_points, Vector3::Zero());
+      pcd.ColorData().resize(number_of_points, Vector3::Ones());
+      for (size_t i = 0; i < mapped_pcd.NumberOfChunks(); i++)
+      {
+        workflow::MappedPointCloud::Chunk chunk = mapped_pcd.GetChunk(i);
+        Vector3 origin = (chunk.origin - offset_).cast<Float>();
+        for (size_t k = 0; k < chunk.number_of_points; k++)
+        {
+          size_t point_id = chunk.first_point + k;
+          const float* position = chunk.positions.data() + k * 3;
+          pcd.VertexData()[point_id] =
+            origin + Vector3(Float(position[0]), Float(position[1]),
+                             Float(position[2]));
+          if (!chunk.normals.empty())
+          {
+            pcd.NormalData()[point_id] =
+              workflow::MappedPointCloud::Normal(chunk, k).cast<Float>();
+          }
+          if (!chunk.colors.empty())
+          {
+            pcd.ColorData()[point_id] =
+              workflow::MappedPointCloud::Color(chunk, k).cast<Float>();
+          }
+        }
+      }
+    }
+    else
+    {
+      hs::graphics::PointCloudData<double> pcd_double;
+      if (workflow::LoadPointCloud(path, pcd_double) != 0) return;
+
+      pcd.VertexData().resize(pcd_double.PointCloudSize());
+      pcd.NormalData().resize(pcd_double.PointCloudSize());
+      pcd.ColorData().resize(pcd_double.PointCloudSize());
+      for(size_t i = 0; i < pcd_double.PointCloudSize(); i++)
+      {
+        pcd.VertexData()[i] =
+          (pcd_double.VertexData()[i] - offset_).cast<Float>();
+        pcd.NormalData()[i] = pcd_double.NormalData()[i].cast<Float>();
+        pcd.ColorData()[i] = pcd_double.ColorData()[i].cast<Float>();
+      }
     }
     Vector3 min, max;
     min << std::numeric_limits<Float>::max(),
@@ -594,22 +714,21 @@ void SceneWindow::UpdateScene(const std::string& intrinsic_path,
   {
     //读取surface model
     SurfaceModelData data;
-    VertexContainer vertices;
-    TriangleContainer triangles;
-    std::ifstream is(path, std::ios_base::binary);
-    if(!is.is_open())
+    hs::recon::workflow::CompactMesh mesh;
+    if (hs::recon::workflow::LoadMeshLod(path, SURFACE_MODEL_MAX_TRIANGLES,
+                                         mesh) != 0)
       break;
-    cereal::PortableBinaryInputArchive piarchive(is);
-    piarchive(vertices, triangles);
 
+    DoubleVector3 origin = mesh.origin - offset_;
     DoubleVector3 v1, v2, v3;
     DoubleVector3 normd;
     Vector3 norm;
-    for(auto iter = triangles.begin(); iter != triangles.end(); ++iter)
+    for(auto iter = mesh.triangles.begin(); iter != mesh.triangles.end();
+        ++iter)
     {
-      v1 = vertices.at((*iter)[0]) - offset_;
-      v2 = vertices.at((*iter)[1]) - offset_;
-      v3 = vertices.at((*iter)[2]) - offset_;
+      v1 = origin + mesh.vertices[(*iter)[0]].cast<double>();
+      v2 = origin + mesh.vertices[(*iter)[1]].cast<double>();
+      v3 = origin + mesh.vertices[(*iter)[2]].cast<double>();
       normd = (v2 - v1).cross((v3 - v1));
       normd.normalize();
       norm = normd.cast<float>();
@@ -627,6 +746,125 @@ void SceneWindow::UpdateScene(const std::string& intrinsic_path,
   }
   break;
   case hs::recon::gui::SceneWindow::FLAG_SHOW_TEXTURE:
+  {
+    //The render layers draw no textures, so the model is shown as points
+    //coloured from its atlas, about as many as it has texels.
+    typedef workflow::TextureConfig::SimilarTransform SimilarTransform;
+    typedef workflow::TexturedMesh::TexCoord TexCoord;
+    workflow::TexturedMesh mesh;
+    if (workflow::LoadTexturedMesh(path, mesh) != 0) break;
+    SimilarTransform similar_transform;
+    {
+      std::ifstream similar_file(similar_transform_path, std::ios::binary);
+      if (!similar_file) break;
+      cereal::PortableBinaryInputArchive archive(similar_file);
+      archive(similar_transform.scale,
+              similar_transform.rotation,
+              similar_transform.translate);
+    }
+
+    //The model is georeferenced, the cameras are not.
+    workflow::TextureConfig::Rotation rotation_inverse =
+      similar_transform.rotation.Inverse();
+    for (auto& vertex : mesh.vertices)
+    {
+      vertex = rotation_inverse *
+               ((vertex - similar_transform.translate) /
+                similar_transform.scale) - offset_;
+    }
+
+    std::vector<double> texel_areas(mesh.triangles.size(), 0);
+    double total_texel_area = 0;
+    for (size_t i = 0; i < mesh.triangles.size(); i++)
+    {
+      size_t page_id = mesh.triangle_pages[i];
+      if (page_id == workflow::TexturedMesh::NO_PAGE) continue;
+      const workflow::TexturedMesh::Triangle& corners =
+        mesh.triangle_texcoords[i];
+      TexCoord edge1 = mesh.texcoords[corners[1]] - mesh.texcoords[corners[0]];
+      TexCoord edge2 = mesh.texcoords[corners[2]] - mesh.texcoords[corners[0]];
+      texel_areas[i] = std::abs(edge1[0] * edge2[1] - edge1[1] * edge2[0]) *
+                       0.5 * double(mesh.pages[page_id].width) *
+                       double(mesh.pages[page_id].height);
+      total_texel_area += texel_areas[i];
+    }
+    double density = 1;
+    if (total_texel_area > double(TEXTURE_MAX_POINTS))
+    {
+      density = double(TEXTURE_MAX_POINTS) / total_texel_area;
+    }
+
+    PointCloudData pcd;
+    for (size_t i = 0; i < mesh.triangles.size(); i++)
+    {
+      const workflow::TexturedMesh::Triangle& triangle = mesh.triangles[i];
+      const DoubleVector3& v0 = mesh.vertices[triangle[0]];
+      DoubleVector3 edge1 = mesh.vertices[triangle[1]] - v0;
+      DoubleVector3 edge2 = mesh.vertices[triangle[2]] - v0;
+      Vector3 normal = edge1.cross(edge2).normalized().cast<Float>();
+      size_t page_id = mesh.triangle_pages[i];
+      if (page_id == workflow::TexturedMesh::NO_PAGE)
+      {
+        pcd.VertexData().push_back(
+          (v0 + (edge1 + edge2) / 3.0).cast<Float>());
+        pcd.NormalData().push_back(normal);
+        pcd.ColorData().push_back(Vector3::Constant(Float(0.5)));
+        continue;
+      }
+
+      //Centres of the n * n sub-triangles pointing the same way as the
+      //triangle, about one for every texel it covers.
+      const workflow::AtlasPage& page = mesh.pages[page_id];
+      const workflow::TexturedMesh::Triangle& corners =
+        mesh.triangle_texcoords[i];
+      const TexCoord& t0 = mesh.texcoords[corners[0]];
+      TexCoord texcoord_edge1 = mesh.texcoords[corners[1]] - t0;
+      TexCoord texcoord_edge2 = mesh.texcoords[corners[2]] - t0;
+      size_t n = std::max(size_t(1), size_t(std::ceil(
+        std::sqrt(2 * texel_areas[i] * density))));
+      for (size_t a = 0; a < n; a++)
+      {
+        for (size_t b = 0; a + b < n; b++)
+        {
+          double s = (double(a) + 1.0 / 3.0) / double(n);
+          double t = (double(b) + 1.0 / 3.0) / double(n);
+          TexCoord texcoord = t0 + s * texcoord_edge1 + t * texcoord_edge2;
+          double x = std::floor(texcoord[0] * double(page.width));
+          double y = std::floor((1 - texcoord[1]) * double(page.height));
+          size_t column = size_t(std::min(std::max(x, 0.0),
+                                          double(page.width - 1)));
+          size_t row = size_t(std::min(std::max(y, 0.0),
+                                       double(page.height - 1)));
+          const uint8_t* texel = page.pixels.data() +
+                                 (row * page.width + column) * 3;
+          pcd.VertexData().push_back(
+            (v0 + s * edge1 + t * edge2).cast<Float>());
+          pcd.NormalData().push_back(normal);
+          pcd.ColorData().push_back(Vector3(Float(texel[0]) / Float(255),
+                                            Float(texel[1]) / Float(255),
+                                            Float(texel[2]) / Float(255)));
+        }
+      }
+    }
+
+    Vector3 min, max;
+    min << std::numeric_limits<Float>::max(),
+           std::numeric_limits<Float>::max(),
+           std::numeric_limits<Float>::max();
+    max << -std::numeric_limits<Float>::max(),
+           -std::numeric_limits<Float>::max(),
+           -std::numeric_limits<Float>::max();
+    for(const auto& point : pcd.VertexData())
+    {
+      min = min.cwiseMin(point);
+      max = max.cwiseMax(point);
+    }
+    pcd.SetBoundingBox(min, max);
+    bounding_box_ = pcd.GetBoundingBox();
+    RemoveRenderLayer(surface_model_render_layer_);
+    AddRenderLayer(sparse_point_cloud_render_layer_);
+    sparse_point_cloud_render_layer_->SetupPointCloudData(pcd);
+  }
   break;
   default:
   break;
@@ -93,6 +93,7 @@ public slots:
   void SetPhotoOrientation(uint photo_orientation_id_);
   void SetPointCloud(uint point_cloud_id);
   void SetSurfaceModel(uint surface_model_id);
+  void SetTexture(uint texture_id);
 
 protected slots:
   void OnMouseClicked(Qt::KeyboardModifiers state_key,
@@ -117,13 +118,16 @@ private:
   void UpdatePhotoOrientation();
   void UpdatePointCloud();
   void UpdateSurfaceModel();
+  void UpdateTexture();
   void BackupSelectedPointsColor(Float left, Float right,
                                  Float bottom, Float top,
                                  PointCloudData& pcd);
   void UpdateScene(const std::string& intrinsic_path,
                    const std::string& extrinsic_path,
                    const std::string& path,
-                   SceneFlag flag =  FLAG_SHOW_SPARSE_POINT_CLOUD);
+                   SceneFlag flag =  FLAG_SHOW_SPARSE_POINT_CLOUD,
+                   const std::string& similar_transform_path =
+                     std::string());
 
 signals:
   void FilterPhotosBySelectedPoints(const PointContainer& selected_points);
@@ -133,6 +137,7 @@ private:
   uint photo_orientation_id_;
   uint point_cloud_id_;
   uint surface_model_id_;
+  uint texture_id_;
 
   DoubleVector3 offset_;
 
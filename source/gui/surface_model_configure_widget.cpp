@@ -40,6 +40,20 @@ SurfaceModelConfigureWidget::SurfaceModelConfigureWidget(
   combo_box_->setCurrentIndex(1);
   layout_surface_model_quality_->addWidget(combo_box_);
 
+  layout_surface_type_ = new QHBoxLayout;
+  group_box_layout_->addLayout(layout_surface_type_);
+  label_surface_type_ = new QLabel(tr("Surface Type "), group_box_);
+  layout_surface_type_->addWidget(label_surface_type_);
+  //In the order of MeshSurfaceConfig::SurfaceType.
+  combo_box_surface_type_ = new QComboBox;
+  combo_box_surface_type_->setEditable(false);
+  QStringList surface_type_text;
+  surface_type_text << tr("Height Field")
+                    << tr("Closed Surface");
+  combo_box_surface_type_->addItems(surface_type_text);
+  combo_box_surface_type_->setCurrentIndex(0);
+  layout_surface_type_->addWidget(combo_box_surface_type_);
+
 
 
 }
@@ -47,6 +61,8 @@ SurfaceModelConfigureWidget::SurfaceModelConfigureWidget(
 void SurfaceModelConfigureWidget::FetchSurfaceModelConfig(
   workflow::MeshSurfaceConfig& mesh_surface_config)
 {
+  mesh_surface_config.set_surface_type(
+    combo_box_surface_type_->currentIndex());
   if (combo_box_->currentIndex() == 0)
   {
     mesh_surface_config.set_octree_depth(6);
@@ -37,6 +37,9 @@ private:
   QComboBox* combo_box_;
   QLabel* label_surface_model_quality_;
   QHBoxLayout* layout_surface_model_quality_;
+  QComboBox* combo_box_surface_type_;
+  QLabel* label_surface_type_;
+  QHBoxLayout* layout_surface_type_;
 };
 
 }
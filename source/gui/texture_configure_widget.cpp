@@ -116,13 +116,34 @@ TextureConfigureWidget::TextureConfigureWidget(
   group_box_dom_->setChecked(false);
   main_layout_->addWidget(group_box_dom_);
 
+  group_box_dem_type_ = new QGroupBox(tr("DEM Output Type"), this);
+  layout_dem_type_ = new QHBoxLayout;
+  label_dem_type_tiff_ = new QLabel(tr("TIFF"), this);
+  label_dem_type_cog_ = new QLabel(tr("COG"), this);
+  check_box_dem_type_tiff_ = new QCheckBox(this);
+  check_box_dem_type_tiff_->setChecked(true);
+  check_box_dem_type_cog_ = new QCheckBox(this);
+
+  layout_dem_type_->addWidget(label_dem_type_tiff_);
+  layout_dem_type_->addWidget(check_box_dem_type_tiff_);
+
+  layout_dem_type_->addWidget(label_dem_type_cog_);
+  layout_dem_type_->addWidget(check_box_dem_type_cog_);
+
+  group_box_dem_type_->setLayout(layout_dem_type_);
+  layout_group_box_dem_->addWidget(group_box_dem_type_);
+
   group_box_dom_type_ = new QGroupBox(tr("DOM Output Type"), this);
   layout_dom_type_ = new QHBoxLayout;
   label_dom_type_tiff_ = new QLabel(tr("TIFF"), this);
   label_dom_type_jpg_ = new QLabel(tr("JPG"), this);
+  label_dom_type_cog_ = new QLabel(tr("COG"), this);
+  label_dom_type_web_tiles_ = new QLabel(tr("Web Tiles"), this);
   check_box_dom_type_tiff_ = new QCheckBox(this);
   check_box_dom_type_tiff_->setChecked(true);
   check_box_dom_type_jpg_ = new QCheckBox(this);
+  check_box_dom_type_cog_ = new QCheckBox(this);
+  check_box_dom_type_web_tiles_ = new QCheckBox(this);
 
   layout_dom_type_->addWidget(label_dom_type_tiff_);
   layout_dom_type_->addWidget(check_box_dom_type_tiff_);
@@ -130,13 +151,104 @@ TextureConfigureWidget::TextureConfigureWidget(
   layout_dom_type_->addWidget(label_dom_type_jpg_);
   layout_dom_type_->addWidget(check_box_dom_type_jpg_);
 
+  layout_dom_type_->addWidget(label_dom_type_cog_);
+  layout_dom_type_->addWidget(check_box_dom_type_cog_);
+
+  layout_dom_type_->addWidget(label_dom_type_web_tiles_);
+  layout_dom_type_->addWidget(check_box_dom_type_web_tiles_);
+
   group_box_dom_type_->setLayout(layout_dom_type_);
   layout_group_box_dom_->addWidget(group_box_dom_type_);
 
+  layout_web_tiles_ = new QHBoxLayout;
+  label_web_tile_format_ = new QLabel(tr("Web Tile Format:"));
+  //In the order of WebTileSink::Format.
+  combo_box_web_tile_format_ = new QComboBox;
+  combo_box_web_tile_format_->setEditable(false);
+  QStringList web_tile_format_text;
+  web_tile_format_text << tr("JPG")
+                       << tr("PNG");
+  combo_box_web_tile_format_->addItems(web_tile_format_text);
+  combo_box_web_tile_format_->setCurrentIndex(0);
+  label_web_tile_scheme_ = new QLabel(tr("Web Tile Scheme:"));
+  //In the order of WebTileSink::Scheme.
+  combo_box_web_tile_scheme_ = new QComboBox;
+  combo_box_web_tile_scheme_->setEditable(false);
+  QStringList web_tile_scheme_text;
+  web_tile_scheme_text << tr("XYZ")
+                       << tr("TMS");
+  combo_box_web_tile_scheme_->addItems(web_tile_scheme_text);
+  combo_box_web_tile_scheme_->setCurrentIndex(0);
+  layout_web_tiles_->addWidget(label_web_tile_format_);
+  layout_web_tiles_->addWidget(combo_box_web_tile_format_);
+  layout_web_tiles_->addWidget(label_web_tile_scheme_);
+  layout_web_tiles_->addWidget(combo_box_web_tile_scheme_);
+  layout_group_box_dom_->addLayout(layout_web_tiles_);
+
+  layout_image_selector_ = new QHBoxLayout;
+  label_image_selector_ = new QLabel(tr("Photo Selection:"));
+  //In the order of TextureConfig::ImageSelectorType.
+  combo_box_image_selector_ = new QComboBox;
+  combo_box_image_selector_->setEditable(false);
+  QStringList image_selector_text;
+  image_selector_text << tr("Exhaustive")
+                      << tr("Visibility Index");
+  combo_box_image_selector_->addItems(image_selector_text);
+  combo_box_image_selector_->setCurrentIndex(0);
+  layout_image_selector_->addWidget(label_image_selector_);
+  layout_image_selector_->addWidget(combo_box_image_selector_);
+  layout_group_box_dom_->addLayout(layout_image_selector_);
+
+  //Only the split DEM and DOM tiles over the region are rewritten, in
+  //place of those of the earlier run.
+  QDoubleValidator* coordinate_validator = new QDoubleValidator(this);
+  layout_region_ = new QHBoxLayout;
+  label_region_min_x_ = new QLabel(tr("Min X:"));
+  line_edit_region_min_x_ = new QLineEdit;
+  line_edit_region_min_x_->setValidator(coordinate_validator);
+  label_region_min_y_ = new QLabel(tr("Min Y:"));
+  line_edit_region_min_y_ = new QLineEdit;
+  line_edit_region_min_y_->setValidator(coordinate_validator);
+  label_region_max_x_ = new QLabel(tr("Max X:"));
+  line_edit_region_max_x_ = new QLineEdit;
+  line_edit_region_max_x_->setValidator(coordinate_validator);
+  label_region_max_y_ = new QLabel(tr("Max Y:"));
+  line_edit_region_max_y_ = new QLineEdit;
+  line_edit_region_max_y_->setValidator(coordinate_validator);
+  layout_region_->addWidget(label_region_min_x_);
+  layout_region_->addWidget(line_edit_region_min_x_);
+  layout_region_->addWidget(label_region_min_y_);
+  layout_region_->addWidget(line_edit_region_min_y_);
+  layout_region_->addWidget(label_region_max_x_);
+  layout_region_->addWidget(line_edit_region_max_x_);
+  layout_region_->addWidget(label_region_max_y_);
+  layout_region_->addWidget(line_edit_region_max_y_);
+  group_box_region_ = new QGroupBox(tr("Regenerate Region Only"), this);
+  group_box_region_->setLayout(layout_region_);
+  group_box_region_->setCheckable(true);
+  group_box_region_->setChecked(false);
+  main_layout_->addWidget(group_box_region_);
+
+  //The textured model goes with the texture resources.
+  layout_model_page_size_ = new QHBoxLayout;
+  label_model_page_size_ = new QLabel(tr("Atlas Page Size:"));
+  line_edit_model_page_size_ = new QLineEdit;
+  line_edit_model_page_size_->setValidator(int_validator);
+  line_edit_model_page_size_->setText(QString::number(4096));
+  layout_model_page_size_->addWidget(label_model_page_size_);
+  layout_model_page_size_->addWidget(line_edit_model_page_size_);
+  group_box_model_ = new QGroupBox(tr("3D Model Generation"), this);
+  group_box_model_->setLayout(layout_model_page_size_);
+  group_box_model_->setCheckable(true);
+  group_box_model_->setChecked(false);
+  main_layout_->addWidget(group_box_model_);
+
   QObject::connect(button_browse_dem_, &QPushButton::clicked,
                    this,  &TextureConfigureWidget::OnButtonBrowseDEMClicked);
   QObject::connect(button_browse_dom_, &QPushButton::clicked,
                    this,  &TextureConfigureWidget::OnButtonBrowseDOMClicked);
+  QObject::connect(group_box_region_, &QGroupBox::toggled,
+                   this,  &TextureConfigureWidget::OnGroupBoxRegionToggled);
 }
 
 void TextureConfigureWidget::FetchTextureConfig(
@@ -156,6 +268,17 @@ void TextureConfigureWidget::FetchTextureConfig(
     texture_config.set_dem_tile_y_size(dem_tile_y_size);
     texture_config.set_dem_x_scale(dem_x_scale);
     texture_config.set_dem_y_scale(dem_y_scale);
+    int output_type_flag;
+    output_type_flag = hs::recon::workflow::TextureConfig::NO_OUTPUT;
+    if (check_box_dem_type_tiff_->isChecked())
+    {
+      output_type_flag |= hs::recon::workflow::TextureConfig::OUTPUT_TIFF;
+    }
+    if (check_box_dem_type_cog_->isChecked())
+    {
+      output_type_flag |= hs::recon::workflow::TextureConfig::OUTPUT_COG;
+    }
+    texture_config.set_dem_output_type(output_type_flag);
   }
 
   if (group_box_dom_->isChecked())
@@ -182,7 +305,45 @@ void TextureConfigureWidget::FetchTextureConfig(
     {
       output_type_flag |= hs::recon::workflow::TextureConfig::OUTPUT_JPG;
     }
+    if (check_box_dom_type_cog_->isChecked())
+    {
+      output_type_flag |= hs::recon::workflow::TextureConfig::OUTPUT_COG;
+    }
+    if (check_box_dom_type_web_tiles_->isChecked())
+    {
+      output_type_flag |=
+        hs::recon::workflow::TextureConfig::OUTPUT_WEB_TILES;
+    }
     texture_config.set_dom_output_type(output_type_flag);
+    texture_config.set_web_tile_format(
+      combo_box_web_tile_format_->currentIndex());
+    texture_config.set_web_tile_scheme(
+      combo_box_web_tile_scheme_->currentIndex());
+    texture_config.set_image_selector_type(
+      combo_box_image_selector_->currentIndex());
+  }
+
+  //An empty box leaves the whole surface to be generated.
+  if (group_box_region_->isChecked())
+  {
+    double min_x = line_edit_region_min_x_->text().toDouble();
+    double min_y = line_edit_region_min_y_->text().toDouble();
+    double max_x = line_edit_region_max_x_->text().toDouble();
+    double max_y = line_edit_region_max_y_->text().toDouble();
+    if (min_x < max_x && min_y < max_y)
+    {
+      texture_config.set_region_box(min_x, min_y, max_x, max_y);
+    }
+  }
+
+  if (group_box_model_->isChecked())
+  {
+    texture_config.set_model_page_size(
+      line_edit_model_page_size_->text().toInt());
+  }
+  else
+  {
+    texture_config.set_model_page_size(0);
   }
 }
 
@@ -208,6 +369,23 @@ void TextureConfigureWidget::OnButtonBrowseDOMClicked()
   }
 }
 
+//The texture step fails on outputs covering the whole surface when
+//regenerating a region, so they cannot be asked for together.
+void TextureConfigureWidget::OnGroupBoxRegionToggled(bool on)
+{
+  if (on)
+  {
+    check_box_dem_type_cog_->setChecked(false);
+    check_box_dom_type_cog_->setChecked(false);
+    check_box_dom_type_web_tiles_->setChecked(false);
+    group_box_model_->setChecked(false);
+  }
+  check_box_dem_type_cog_->setEnabled(!on);
+  check_box_dom_type_cog_->setEnabled(!on);
+  check_box_dom_type_web_tiles_->setEnabled(!on);
+  group_box_model_->setEnabled(!on);
+}
+
 
 }
 }
@@ -9,6 +9,7 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QCheckBox>
+#include <QComboBox>
 
 #include "workflow/texture/rough_texture.hpp"
 
@@ -29,6 +30,7 @@ public:
 private:
   void OnButtonBrowseDEMClicked();
   void OnButtonBrowseDOMClicked();
+  void OnGroupBoxRegionToggled(bool on);
 
 private:
   QVBoxLayout* main_layout_;
@@ -53,6 +55,13 @@ private:
   QLabel* label_dem_tile_y_size_;
   QLineEdit* line_edit_dem_tile_y_size_;
 
+  QGroupBox* group_box_dem_type_;
+  QHBoxLayout* layout_dem_type_;
+  QLabel* label_dem_type_tiff_;
+  QLabel* label_dem_type_cog_;
+  QCheckBox* check_box_dem_type_tiff_;
+  QCheckBox* check_box_dem_type_cog_;
+
   QGroupBox* group_box_dom_;
   QVBoxLayout* layout_group_box_dom_;
 
@@ -77,8 +86,39 @@ private:
   QHBoxLayout* layout_dom_type_;
   QLabel* label_dom_type_tiff_;
   QLabel* label_dom_type_jpg_;
+  QLabel* label_dom_type_cog_;
+  QLabel* label_dom_type_web_tiles_;
   QCheckBox* check_box_dom_type_tiff_;
   QCheckBox* check_box_dom_type_jpg_;
+  QCheckBox* check_box_dom_type_cog_;
+  QCheckBox* check_box_dom_type_web_tiles_;
+
+  QHBoxLayout* layout_web_tiles_;
+  QLabel* label_web_tile_format_;
+  QComboBox* combo_box_web_tile_format_;
+  QLabel* label_web_tile_scheme_;
+  QComboBox* combo_box_web_tile_scheme_;
+
+  QHBoxLayout* layout_image_selector_;
+  QLabel* label_image_selector_;
+  QComboBox* combo_box_image_selector_;
+
+  //Box in the georeferenced frame whose split tiles are regenerated.
+  QGroupBox* group_box_region_;
+  QHBoxLayout* layout_region_;
+  QLabel* label_region_min_x_;
+  QLineEdit* line_edit_region_min_x_;
+  QLabel* label_region_min_y_;
+  QLineEdit* line_edit_region_min_y_;
+  QLabel* label_region_max_x_;
+  QLineEdit* line_edit_region_max_x_;
+  QLabel* label_region_max_y_;
+  QLineEdit* line_edit_region_max_y_;
+
+  QGroupBox* group_box_model_;
+  QHBoxLayout* layout_model_page_size_;
+  QLabel* label_model_page_size_;
+  QLineEdit* line_edit_model_page_size_;
 
 };
 
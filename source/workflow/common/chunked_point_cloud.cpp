@@ -0,0 +1,515 @@
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/common/morton_code.hpp"
+#include "workflow/common/chunked_point_cloud.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef ChunkedPointCloudWriter::Scalar Scalar;
+typedef ChunkedPointCloudWriter::Vector3 Vector3;
+typedef ChunkedPointCloudWriter::PointCloudData PointCloudData;
+
+//Cells per axis of the grid the points are ordered on.
+const Scalar ORDER_GRID_SIZE = Scalar(1 << 10);
+const float SNORM16_SCALE = 32767.0f;
+
+//Chunks start at multiples of 8 so their arrays can be mapped in place.
+size_t AlignedChunkBytes(const ChunkedPointCloudHeader& header,
+                         size_t number_of_points)
+{
+  return (header.ChunkBytes(number_of_points) + 7) / 8 * 8;
+}
+
+float SignNotZero(float value)
+{
+  return value < 0.0f ? -1.0f : 1.0f;
+}
+
+uint8_t ColorToByte(Scalar value)
+{
+  Scalar byte = std::floor(value * Scalar(255) + Scalar(0.5));
+  return uint8_t(std::min(std::max(byte, Scalar(0)), Scalar(255)));
+}
+
+}
+
+void PackNormal(const double* normal, int16_t* packed)
+{
+  float x = float(normal[0]);
+  float y = float(normal[1]);
+  float z = float(normal[2]);
+  float norm = std::abs(x) + std::abs(y) + std::abs(z);
+  if (norm <= 0.0f)
+  {
+    packed[0] = 0;
+    packed[1] = 0;
+    return;
+  }
+  x /= norm;
+  y /= norm;
+  if (z < 0.0f)
+  {
+    //Fold the lower hemisphere over the diagonals.
+    float folded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+    float folded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+    x = folded_x;
+    y = folded_y;
+  }
+  packed[0] = int16_t(std::floor(x * SNORM16_SCALE + 0.5f));
+  packed[1] = int16_t(std::floor(y * SNORM16_SCALE + 0.5f));
+}
+
+void UnpackNormal(const int16_t* packed, double* normal)
+{
+  float x = float(packed[0]) / SNORM16_SCALE;
+  float y = float(packed[1]) / SNORM16_SCALE;
+  float z = 1.0f - std::abs(x) - std::abs(y);
+  if (z < 0.0f)
+  {
+    float unfolded_x = (1.0f - std::abs(y)) * SignNotZero(x);
+    float unfolded_y = (1.0f - std::abs(x)) * SignNotZero(y);
+    x = unfolded_x;
+    y = unfolded_y;
+  }
+  float norm = std::sqrt(x * x + y * y + z * z);
+  normal[0] = double(x / norm);
+  normal[1] = double(y / norm);
+  normal[2] = double(z / norm);
+}
+
+ChunkedPointCloudWriter::ChunkedPointCloudWriter(size_t chunk_capacity)
+  : chunk_capacity_(std::max(chunk_capacity, size_t(1)))
+{
+}
+
+ChunkedPointCloudWriter::~ChunkedPointCloudWriter()
+{
+  if (file_.is_open()) Close();
+}
+
+int ChunkedPointCloudWriter::Open(const std::string& path,
+                                  bool has_normals, bool has_colors)
+{
+  if (file_.is_open()) Close();
+  file_.open(path, std::ios::binary);
+  if (!file_) return -1;
+
+  header_ = ChunkedPointCloudHeader();
+  header_.magic = CHUNKED_POINT_CLOUD_MAGIC;
+  header_.version = CHUNKED_POINT_CLOUD_VERSION;
+  header_.flags = 0;
+  if (has_normals) header_.flags |= ChunkedPointCloudHeader::FLAG_NORMALS;
+  if (has_colors) header_.flags |= ChunkedPointCloudHeader::FLAG_COLORS;
+  header_.reserved = 0;
+  header_.number_of_points = 0;
+  header_.number_of_chunks = 0;
+  header_.chunk_table_offset = 0;
+  for (int axis = 0; axis < 3; axis++)
+  {
+    header_.box_min[axis] = 0;
+    header_.box_max[axis] = 0;
+  }
+  chunks_.clear();
+  //Written again with the totals on Close.
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  return file_ ? 0 : -1;
+}
+
+int ChunkedPointCloudWriter::WriteChunk(const PointCloudData& point_cloud,
+                                        const std::vector<size_t>* order,
+                                        size_t begin, size_t end)
+{
+  size_t number_of_points = end - begin;
+  if (number_of_points == 0) return 0;
+  const PointCloudData::Vector3Container& points = point_cloud.VertexData();
+
+  Vector3 box_min = points[order ? (*order)[begin] : begin];
+  Vector3 box_max = box_min;
+  for (size_t i = begin; i < end; i++)
+  {
+    const Vector3& point = points[order ? (*order)[i] : i];
+    box_min = box_min.cwiseMin(point);
+    box_max = box_max.cwiseMax(point);
+  }
+  ChunkedPointCloudChunk chunk;
+  Vector3 origin = (box_min + box_max) * Scalar(0.5);
+  for (int axis = 0; axis < 3; axis++)
+  {
+    chunk.origin[axis] = origin[axis];
+    chunk.box_min[axis] = float(box_min[axis] - origin[axis]);
+    chunk.box_max[axis] = float(box_max[axis] - origin[axis]);
+  }
+  chunk.data_offset = uint64_t(file_.tellp());
+  chunk.first_point = header_.number_of_points;
+  chunk.number_of_points = uint32_t(number_of_points);
+  chunk.reserved = 0;
+
+  std::vector<char> buffer(AlignedChunkBytes(header_,
+                                             number_of_points), 0);
+  float* positions = reinterpret_cast<float*>(buffer.data());
+  int16_t* normals = reinterpret_cast<int16_t*>(positions +
+                                                number_of_points * 3);
+  uint8_t* colors = reinterpret_cast<uint8_t*>(normals);
+  if (header_.flags & ChunkedPointCloudHeader::FLAG_NORMALS)
+  {
+    colors += number_of_points * sizeof(int16_t) * 2;
+  }
+  for (size_t k = 0; k < number_of_points; k++)
+  {
+    size_t point_id = order ? (*order)[begin + k] : begin + k;
+    Vector3 offset = points[point_id] - origin;
+    for (int axis = 0; axis < 3; axis++)
+    {
+      positions[k * 3 + axis] = float(offset[axis]);
+    }
+    if (header_.flags & ChunkedPointCloudHeader::FLAG_NORMALS)
+    {
+      PackNormal(point_cloud.NormalData()[point_id].data(), normals + k * 2);
+    }
+    if (header_.flags & ChunkedPointCloudHeader::FLAG_COLORS)
+    {
+      const Vector3& color = point_cloud.ColorData()[point_id];
+      for (int c = 0; c < 3; c++)
+      {
+        colors[k * 3 + c] = ColorToByte(color[c]);
+      }
+    }
+  }
+  file_.write(buffer.data(), buffer.size());
+  if (!file_) return -1;
+
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (chunks_.empty())
+    {
+      header_.box_min[axis] = box_min[axis];
+      header_.box_max[axis] = box_max[axis];
+    }
+    header_.box_min[axis] = std::min(header_.box_min[axis], box_min[axis]);
+    header_.box_max[axis] = std::max(header_.box_max[axis], box_max[axis]);
+  }
+  chunks_.push_back(chunk);
+  header_.number_of_points += number_of_points;
+  return 0;
+}
+
+int ChunkedPointCloudWriter::Append(const PointCloudData& point_cloud)
+{
+  if (!file_.is_open()) return -1;
+  size_t number_of_points = point_cloud.VertexData().size();
+  if (((header_.flags & ChunkedPointCloudHeader::FLAG_NORMALS) &&
+       point_cloud.NormalData().size() != number_of_points) ||
+      ((header_.flags & ChunkedPointCloudHeader::FLAG_COLORS) &&
+       point_cloud.ColorData().size() != number_of_points))
+  {
+    return -1;
+  }
+  for (size_t begin = 0; begin < number_of_points; begin += chunk_capacity_)
+  {
+    size_t end = std::min(begin + chunk_capacity_, number_of_points);
+    if (WriteChunk(point_cloud, nullptr, begin, end) != 0) return -1;
+  }
+  return 0;
+}
+
+int ChunkedPointCloudWriter::Close()
+{
+  if (!file_.is_open()) return -1;
+  header_.number_of_chunks = chunks_.size();
+  header_.chunk_table_offset = uint64_t(file_.tellp());
+  if (!chunks_.empty())
+  {
+    file_.write(reinterpret_cast<const char*>(chunks_.data()),
+                chunks_.size() * sizeof(ChunkedPointCloudChunk));
+  }
+  file_.seekp(0);
+  file_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+  bool good = bool(file_);
+  file_.close();
+  chunks_.clear();
+  return good ? 0 : -1;
+}
+
+int ChunkedPointCloudWriter::operator() (const PointCloudData& point_cloud,
+                                         const std::string& path,
+                                         bool spatial_order)
+{
+  const PointCloudData::Vector3Container& points = point_cloud.VertexData();
+  size_t number_of_points = points.size();
+  bool has_normals = !point_cloud.NormalData().empty();
+  bool has_colors = !point_cloud.ColorData().empty();
+  if (Open(path, has_normals, has_colors) != 0) return -1;
+  if (!spatial_order || number_of_points <= chunk_capacity_)
+  {
+    if (Append(point_cloud) != 0)
+    {
+      Close();
+      return -1;
+    }
+    return Close();
+  }
+
+  Vector3 box_min = points[0];
+  Vector3 box_max = points[0];
+  for (size_t i = 1; i < number_of_points; i++)
+  {
+    box_min = box_min.cwiseMin(points[i]);
+    box_max = box_max.cwiseMax(points[i]);
+  }
+  Scalar cell_size = (box_max - box_min).maxCoeff() / ORDER_GRID_SIZE;
+  if (!(cell_size > Scalar(0))) cell_size = Scalar(1);
+  std::vector<std::pair<uint64_t, size_t> > coded_points(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    uint32_t cell[3];
+    for (int axis = 0; axis < 3; axis++)
+    {
+      Scalar value = (points[i][axis] - box_min[axis]) / cell_size;
+      cell[axis] = uint32_t(std::min(value, ORDER_GRID_SIZE - 1));
+    }
+    coded_points[i] = std::make_pair(MortonCode(cell[0], cell[1], cell[2]),
+                                     i);
+  }
+  std::sort(coded_points.begin(), coded_points.end());
+  std::vector<size_t> order(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    order[i] = coded_points[i].second;
+  }
+  coded_points.clear();
+  coded_points.shrink_to_fit();
+
+  if ((has_normals && point_cloud.NormalData().size() != number_of_points) ||
+      (has_colors && point_cloud.ColorData().size() != number_of_points))
+  {
+    Close();
+    return -1;
+  }
+  for (size_t begin = 0; begin < number_of_points; begin += chunk_capacity_)
+  {
+    size_t end = std::min(begin + chunk_capacity_, number_of_points);
+    if (WriteChunk(point_cloud, &order, begin, end) != 0)
+    {
+      Close();
+      return -1;
+    }
+  }
+  return Close();
+}
+
+ChunkedPointCloudReader::ChunkedPointCloudReader()
+{
+}
+
+int ChunkedPointCloudReader::Open(const std::string& path)
+{
+  Close();
+  file_.open(path, std::ios::binary);
+  if (!file_) return -1;
+  file_.read(reinterpret_cast<char*>(&header_), sizeof(header_));
+  if (!file_ || header_.magic != CHUNKED_POINT_CLOUD_MAGIC ||
+      header_.version != CHUNKED_POINT_CLOUD_VERSION)
+  {
+    Close();
+    return -1;
+  }
+  chunks_.resize(size_t(header_.number_of_chunks));
+  file_.seekg(std::streamoff(header_.chunk_table_offset));
+  if (!chunks_.empty())
+  {
+    file_.read(reinterpret_cast<char*>(chunks_.data()),
+               chunks_.size() * sizeof(ChunkedPointCloudChunk));
+  }
+  if (!file_)
+  {
+    Close();
+    return -1;
+  }
+  return 0;
+}
+
+void ChunkedPointCloudReader::Close()
+{
+  if (file_.is_open()) file_.close();
+  file_.clear();
+  chunks_.clear();
+  header_ = ChunkedPointCloudHeader();
+}
+
+bool ChunkedPointCloudReader::IsOpen() const
+{
+  return file_.is_open();
+}
+
+const ChunkedPointCloudHeader& ChunkedPointCloudReader::header() const
+{
+  return header_;
+}
+
+size_t ChunkedPointCloudReader::NumberOfPoints() const
+{
+  return size_t(header_.number_of_points);
+}
+
+size_t ChunkedPointCloudReader::NumberOfChunks() const
+{
+  return chunks_.size();
+}
+
+const ChunkedPointCloudChunk& ChunkedPointCloudReader::Chunk(
+  size_t chunk_id) const
+{
+  return chunks_[chunk_id];
+}
+
+bool ChunkedPointCloudReader::ChunkIntersects(size_t chunk_id,
+                                              const Vector3& box_min,
+                                              const Vector3& box_max) const
+{
+  const ChunkedPointCloudChunk& chunk = chunks_[chunk_id];
+  for (int axis = 0; axis < 3; axis++)
+  {
+    if (chunk.origin[axis] + chunk.box_max[axis] < box_min[axis] ||
+        chunk.origin[axis] + chunk.box_min[axis] > box_max[axis])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int ChunkedPointCloudReader::DecodeChunk(size_t chunk_id,
+                                         const Vector3* box_min,
+                                         const Vector3* box_max,
+                                         PointCloudData& point_cloud)
+{
+  if (!IsOpen() || chunk_id >= chunks_.size()) return -1;
+  const ChunkedPointCloudChunk& chunk = chunks_[chunk_id];
+  size_t number_of_points = chunk.number_of_points;
+  std::vector<char> buffer(header_.ChunkBytes(number_of_points));
+  file_.seekg(std::streamoff(chunk.data_offset));
+  file_.read(buffer.data(), buffer.size());
+  if (!file_) return -1;
+
+  bool has_normals = (header_.flags & ChunkedPointCloudHeader::FLAG_NORMALS);
+  bool has_colors = (header_.flags & ChunkedPointCloudHeader::FLAG_COLORS);
+  const float* positions = reinterpret_cast<const float*>(buffer.data());
+  const int16_t* normals = reinterpret_cast<const int16_t*>(
+    positions + number_of_points * 3);
+  const uint8_t* colors = reinterpret_cast<const uint8_t*>(normals);
+  if (has_normals) colors += number_of_points * sizeof(int16_t) * 2;
+  Vector3 origin(chunk.origin[0], chunk.origin[1], chunk.origin[2]);
+  for (size_t k = 0; k < number_of_points; k++)
+  {
+    Vector3 point = origin + Vector3(Scalar(positions[k * 3 + 0]),
+                                     Scalar(positions[k * 3 + 1]),
+                                     Scalar(positions[k * 3 + 2]));
+    if (box_min && box_max &&
+        ((point.array() < box_min->array()).any() ||
+         (point.array() > box_max->array()).any())) continue;
+    point_cloud.VertexData().push_back(point);
+    if (has_normals)
+    {
+      Vector3 normal;
+      UnpackNormal(normals + k * 2, normal.data());
+      point_cloud.NormalData().push_back(normal);
+    }
+    if (has_colors)
+    {
+      point_cloud.ColorData().push_back(
+        Vector3(Scalar(colors[k * 3 + 0]),
+                Scalar(colors[k * 3 + 1]),
+                Scalar(colors[k * 3 + 2])) / Scalar(255));
+    }
+  }
+  return 0;
+}
+
+int ChunkedPointCloudReader::ReadChunk(size_t chunk_id,
+                                       PointCloudData& point_cloud)
+{
+  return DecodeChunk(chunk_id, nullptr, nullptr, point_cloud);
+}
+
+int ChunkedPointCloudReader::Read(PointCloudData& point_cloud)
+{
+  if (!IsOpen()) return -1;
+  point_cloud = PointCloudData();
+  size_t number_of_points = NumberOfPoints();
+  point_cloud.VertexData().reserve(number_of_points);
+  if (header_.flags & ChunkedPointCloudHeader::FLAG_NORMALS)
+  {
+    point_cloud.NormalData().reserve(number_of_points);
+  }
+  if (header_.flags & ChunkedPointCloudHeader::FLAG_COLORS)
+  {
+    point_cloud.ColorData().reserve(number_of_points);
+  }
+  for (size_t i = 0; i < chunks_.size(); i++)
+  {
+    if (DecodeChunk(i, nullptr, nullptr, point_cloud) != 0) return -1;
+  }
+  return 0;
+}
+
+int ChunkedPointCloudReader::Read(const Vector3& box_min,
+                                  const Vector3& box_max,
+                                  PointCloudData& point_cloud)
+{
+  if (!IsOpen()) return -1;
+  point_cloud = PointCloudData();
+  for (size_t i = 0; i < chunks_.size(); i++)
+  {
+    if (!ChunkIntersects(i, box_min, box_max)) continue;
+    if (DecodeChunk(i, &box_min, &box_max, point_cloud) != 0) return -1;
+  }
+  return 0;
+}
+
+bool ChunkedPointCloudReader::IsChunkedFile(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  uint32_t magic = 0;
+  file.read(reinterpret_cast<char*>(&magic), sizeof(magic));
+  return file && magic == CHUNKED_POINT_CLOUD_MAGIC;
+}
+
+int LoadPointCloud(const std::string& path,
+                   hs::graphics::PointCloudData<double>& point_cloud)
+{
+  if (ChunkedPointCloudReader::IsChunkedFile(path))
+  {
+    ChunkedPointCloudReader reader;
+    if (reader.Open(path) != 0) return -1;
+    return reader.Read(point_cloud);
+  }
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return -1;
+  cereal::PortableBinaryInputArchive archive(file);
+  archive(point_cloud);
+  return 0;
+}
+
+int SavePointCloud(const hs::graphics::PointCloudData<double>& point_cloud,
+                   const std::string& path,
+                   bool spatial_order)
+{
+  ChunkedPointCloudWriter writer;
+  return writer(point_cloud, path, spatial_order);
+}
+
+}
+}
+}
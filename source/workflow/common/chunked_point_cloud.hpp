@@ -0,0 +1,184 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_CHUNKED_POINT_CLOUD_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_CHUNKED_POINT_CLOUD_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_graphics/graphics_utility/pointcloud_data.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Chunked point cloud file.
+ *
+ *  A header and a table of chunks are followed by the chunk data. Each
+ *  chunk stores its points as float offsets from a double origin, normals
+ *  packed octahedrally into two int16 and colors as three bytes, 19 bytes
+ *  per point instead of 72. The table keeps the bounding box of every
+ *  chunk, so a reader only decodes the chunks a region touches.
+ */
+const uint32_t CHUNKED_POINT_CLOUD_MAGIC = 0x43505348; //"HSPC"
+const uint32_t CHUNKED_POINT_CLOUD_VERSION = 1;
+
+struct ChunkedPointCloudHeader
+{
+  enum Flag
+  {
+    FLAG_NORMALS = 1,
+    FLAG_COLORS = 2
+  };
+
+  uint32_t magic;
+  uint32_t version;
+  uint32_t flags;
+  uint32_t reserved;
+  uint64_t number_of_points;
+  uint64_t number_of_chunks;
+  uint64_t chunk_table_offset;
+  double box_min[3];
+  double box_max[3];
+
+  //Bytes of the arrays of a chunk of number_of_points points.
+  size_t ChunkBytes(size_t number_of_points) const
+  {
+    size_t bytes = number_of_points * sizeof(float) * 3;
+    if (flags & FLAG_NORMALS) bytes += number_of_points * sizeof(int16_t) * 2;
+    if (flags & FLAG_COLORS) bytes += number_of_points * 3;
+    return bytes;
+  }
+};
+
+struct ChunkedPointCloudChunk
+{
+  double origin[3];
+  //Relative to origin.
+  float box_min[3];
+  float box_max[3];
+  //Of the positions, followed by the normals and colors.
+  uint64_t data_offset;
+  //Index of the first point of the chunk in the cloud.
+  uint64_t first_point;
+  uint32_t number_of_points;
+  uint32_t reserved;
+};
+
+//Octahedral packing of a unit normal into two snorm16.
+HS_EXPORT void PackNormal(const double* normal, int16_t* packed);
+HS_EXPORT void UnpackNormal(const int16_t* packed, double* normal);
+
+/**
+ *  Writes a chunked point cloud, either chunk by chunk through Open,
+ *  Append and Close, or a whole cloud at once. Appended points are cut
+ *  into chunks of chunk_capacity points in the order given.
+ */
+class HS_EXPORT ChunkedPointCloudWriter
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+
+  ChunkedPointCloudWriter(size_t chunk_capacity = 65536);
+  ~ChunkedPointCloudWriter();
+
+  int Open(const std::string& path, bool has_normals, bool has_colors);
+  int Append(const PointCloudData& point_cloud);
+  int Close();
+
+  /**
+   *  Write point_cloud. With spatial_order the points are first sorted by
+   *  Morton code so chunks are compact. Clouds indexed by other data, such
+   *  as the sparse cloud by the tracks, must keep their order.
+   */
+  int operator() (const PointCloudData& point_cloud,
+                  const std::string& path,
+                  bool spatial_order);
+
+private:
+  ChunkedPointCloudWriter(const ChunkedPointCloudWriter&);
+  ChunkedPointCloudWriter& operator=(const ChunkedPointCloudWriter&);
+
+  //Points order[begin, end), or [begin, end) without order.
+  int WriteChunk(const PointCloudData& point_cloud,
+                 const std::vector<size_t>* order,
+                 size_t begin, size_t end);
+
+private:
+  size_t chunk_capacity_;
+  std::ofstream file_;
+  ChunkedPointCloudHeader header_;
+  std::vector<ChunkedPointCloudChunk> chunks_;
+};
+
+/**
+ *  Reads the header and chunk table of a chunked point cloud and decodes
+ *  chunks on request.
+ */
+class HS_EXPORT ChunkedPointCloudReader
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+
+  ChunkedPointCloudReader();
+
+  int Open(const std::string& path);
+  void Close();
+  bool IsOpen() const;
+
+  const ChunkedPointCloudHeader& header() const;
+  size_t NumberOfPoints() const;
+  size_t NumberOfChunks() const;
+  const ChunkedPointCloudChunk& Chunk(size_t chunk_id) const;
+  bool ChunkIntersects(size_t chunk_id,
+                       const Vector3& box_min,
+                       const Vector3& box_max) const;
+
+  //Append the points of a chunk to point_cloud.
+  int ReadChunk(size_t chunk_id, PointCloudData& point_cloud);
+  int Read(PointCloudData& point_cloud);
+  //Read the points inside the box [box_min, box_max].
+  int Read(const Vector3& box_min, const Vector3& box_max,
+           PointCloudData& point_cloud);
+
+  //Whether path starts like a chunked point cloud file.
+  static bool IsChunkedFile(const std::string& path);
+
+private:
+  int DecodeChunk(size_t chunk_id, const Vector3* box_min,
+                  const Vector3* box_max, PointCloudData& point_cloud);
+
+private:
+  std::ifstream file_;
+  ChunkedPointCloudHeader header_;
+  std::vector<ChunkedPointCloudChunk> chunks_;
+};
+
+/**
+ *  Load a point cloud written either as a chunked file or as a cereal
+ *  archive of PointCloudData by earlier versions.
+ */
+HS_EXPORT int LoadPointCloud(const std::string& path,
+                             hs::graphics::PointCloudData<double>&
+                               point_cloud);
+HS_EXPORT int SavePointCloud(const hs::graphics::PointCloudData<double>&
+                               point_cloud,
+                             const std::string& path,
+                             bool spatial_order);
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_HALF_FLOAT_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_HALF_FLOAT_HPP_
+
+#include <cstdint>
+#include <cstring>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+typedef uint16_t HalfFloat;
+
+//IEEE 754 binary16 quiet NaN, used as the invalid marker in half buffers.
+const HalfFloat HALF_FLOAT_NAN = 0x7E00;
+
+/**
+ *  Round to nearest even float to binary16 conversion. Overflow gives
+ *  infinity, underflow gives subnormals or zero.
+ */
+inline HalfFloat FloatToHalf(float value)
+{
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  uint32_t sign = (bits >> 16) & 0x8000;
+  uint32_t float_exponent = (bits >> 23) & 0xFF;
+  uint32_t mantissa = bits & 0x7FFFFF;
+
+  if (float_exponent == 0xFF)
+  {
+    return HalfFloat(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+  }
+  int32_t exponent = int32_t(float_exponent) - 127 + 15;
+  if (exponent >= 31)
+  {
+    return HalfFloat(sign | 0x7C00);
+  }
+  if (exponent <= 0)
+  {
+    if (exponent < -10) return HalfFloat(sign);
+    mantissa |= 0x800000;
+    uint32_t shift = uint32_t(14 - exponent);
+    uint32_t half_mantissa = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway ||
+        (remainder == halfway && (half_mantissa & 1)))
+    {
+      half_mantissa++;
+    }
+    return HalfFloat(sign | half_mantissa);
+  }
+
+  uint32_t half = sign | (uint32_t(exponent) << 10) | (mantissa >> 13);
+  uint32_t remainder = mantissa & 0x1FFF;
+  //A carry into the exponent is the correct rounding.
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+  {
+    half++;
+  }
+  return HalfFloat(half);
+}
+
+inline float HalfToFloat(HalfFloat half)
+{
+  uint32_t sign = uint32_t(half & 0x8000) << 16;
+  int32_t exponent = (half >> 10) & 0x1F;
+  uint32_t mantissa = half & 0x3FF;
+  uint32_t bits;
+
+  if (exponent == 0)
+  {
+    if (mantissa == 0)
+    {
+      bits = sign;
+    }
+    else
+    {
+      //Normalize the subnormal.
+      exponent = 1;
+      while (!(mantissa & 0x400))
+      {
+        mantissa <<= 1;
+        exponent--;
+      }
+      mantissa &= 0x3FF;
+      bits = sign | (uint32_t(exponent + 112) << 23) | (mantissa << 13);
+    }
+  }
+  else if (exponent == 31)
+  {
+    bits = sign | 0x7F800000 | (mantissa << 13);
+  }
+  else
+  {
+    bits = sign | (uint32_t(exponent + 112) << 23) | (mantissa << 13);
+  }
+
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline bool IsHalfNaN(HalfFloat half)
+{
+  return (half & 0x7C00) == 0x7C00 && (half & 0x3FF) != 0;
+}
+
+}
+}
+}
+
+#endif
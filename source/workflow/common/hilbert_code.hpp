@@ -0,0 +1,51 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_HILBERT_CODE_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_HILBERT_CODE_HPP_
+
+#include <cstdint>
+#include <utility>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+//Bits of each cell coordinate in a 2D Hilbert code.
+const int HILBERT_CELL_BITS = 16;
+const uint32_t HILBERT_MAX_CELL = (uint32_t(1) << HILBERT_CELL_BITS) - 1;
+
+/**
+ *  Distance of cell (x, y) along the Hilbert curve filling the grid.
+ *  Unlike Morton order, consecutive codes are always adjacent cells, which
+ *  keeps incremental insertion local.
+ */
+inline uint64_t HilbertCode(uint32_t x, uint32_t y)
+{
+  x &= HILBERT_MAX_CELL;
+  y &= HILBERT_MAX_CELL;
+  uint64_t code = 0;
+  for (uint32_t s = uint32_t(1) << (HILBERT_CELL_BITS - 1); s > 0; s >>= 1)
+  {
+    uint32_t rx = (x & s) ? 1 : 0;
+    uint32_t ry = (y & s) ? 1 : 0;
+    code += uint64_t(s) * uint64_t(s) * uint64_t((3 * rx) ^ ry);
+    //Rotate the quadrant so its curve starts at the origin.
+    if (ry == 0)
+    {
+      if (rx == 1)
+      {
+        x = HILBERT_MAX_CELL - x;
+        y = HILBERT_MAX_CELL - y;
+      }
+      std::swap(x, y);
+    }
+  }
+  return code;
+}
+
+}
+}
+}
+
+#endif
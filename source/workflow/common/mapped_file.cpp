@@ -0,0 +1,84 @@
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+#include "workflow/common/mapped_file.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct MappedFile::Mapping
+{
+  boost::interprocess::file_mapping file;
+  boost::interprocess::mapped_region region;
+};
+
+MappedFile::MappedFile()
+  : mapping_(nullptr)
+  , data_(nullptr)
+  , size_(0)
+{
+}
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+int MappedFile::Open(const std::string& path)
+{
+  Close();
+  Mapping* mapping = new Mapping;
+  try
+  {
+    boost::interprocess::file_mapping file(
+      path.c_str(), boost::interprocess::read_only);
+    boost::interprocess::mapped_region region(
+      file, boost::interprocess::read_only);
+    mapping->file.swap(file);
+    mapping->region.swap(region);
+  }
+  catch (const boost::interprocess::interprocess_exception&)
+  {
+    delete mapping;
+    return -1;
+  }
+
+  mapping_ = mapping;
+  data_ = static_cast<const char*>(mapping_->region.get_address());
+  size_ = mapping_->region.get_size();
+  return 0;
+}
+
+void MappedFile::Close()
+{
+  if (mapping_ != nullptr)
+  {
+    delete mapping_;
+    mapping_ = nullptr;
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+
+bool MappedFile::IsOpen() const
+{
+  return data_ != nullptr;
+}
+
+const char* MappedFile::data() const
+{
+  return data_;
+}
+
+size_t MappedFile::size() const
+{
+  return size_;
+}
+
+}
+}
+}
@@ -0,0 +1,52 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MAPPED_FILE_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MAPPED_FILE_HPP_
+
+#include <memory>
+#include <string>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Read-only memory mapping of a whole file.
+ *
+ *  Used by the flat binary outputs (tracks, point clouds) so that readers
+ *  can take typed pointers into the file instead of deserializing it.
+ */
+class HS_EXPORT MappedFile
+{
+public:
+  MappedFile();
+  ~MappedFile();
+
+  int Open(const std::string& path);
+  void Close();
+
+  bool IsOpen() const;
+  const char* data() const;
+  size_t size() const;
+
+private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+private:
+  struct Mapping;
+  Mapping* mapping_;
+  const char* data_;
+  size_t size_;
+};
+
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <utility>
+
+#include "workflow/common/mapped_point_cloud.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+MappedPointCloud::MappedPointCloud()
+  : header_(nullptr)
+  , chunks_(nullptr)
+{
+}
+
+int MappedPointCloud::Open(const std::string& path)
+{
+  Close();
+  if (mapped_file_.Open(path) != 0) return -1;
+  const char* data = mapped_file_.data();
+  size_t size = mapped_file_.size();
+  if (size < sizeof(ChunkedPointCloudHeader))
+  {
+    Close();
+    return -1;
+  }
+  const ChunkedPointCloudHeader* header =
+    reinterpret_cast<const ChunkedPointCloudHeader*>(data);
+  uint64_t table_bytes =
+    header->number_of_chunks * sizeof(ChunkedPointCloudChunk);
+  if (header->magic != CHUNKED_POINT_CLOUD_MAGIC ||
+      header->version != CHUNKED_POINT_CLOUD_VERSION ||
+      header->chunk_table_offset % 8 != 0 ||
+      header->chunk_table_offset > size ||
+      table_bytes > size - header->chunk_table_offset)
+  {
+    Close();
+    return -1;
+  }
+  const ChunkedPointCloudChunk* chunks =
+    reinterpret_cast<const ChunkedPointCloudChunk*>(
+      data + header->chunk_table_offset);
+  //Every array must lie inside the mapping and be aligned to be read in
+  //place.
+  for (uint64_t i = 0; i < header->number_of_chunks; i++)
+  {
+    const ChunkedPointCloudChunk& chunk = chunks[i];
+    if (chunk.first_point + chunk.number_of_points >
+        header->number_of_points ||
+        chunk.data_offset % 8 != 0 || chunk.data_offset > size ||
+        header->ChunkBytes(chunk.number_of_points) >
+        size - chunk.data_offset)
+    {
+      Close();
+      return -1;
+    }
+  }
+  header_ = header;
+  chunks_ = chunks;
+  return 0;
+}
+
+void MappedPointCloud::Close()
+{
+  mapped_file_.Close();
+  header_ = nullptr;
+  chunks_ = nullptr;
+}
+
+bool MappedPointCloud::IsOpen() const
+{
+  return header_ != nullptr;
+}
+
+const ChunkedPointCloudHeader& MappedPointCloud::header() const
+{
+  return *header_;
+}
+
+size_t MappedPointCloud::NumberOfPoints() const
+{
+  return header_ ? size_t(header_->number_of_points) : 0;
+}
+
+size_t MappedPointCloud::NumberOfChunks() const
+{
+  return header_ ? size_t(header_->number_of_chunks) : 0;
+}
+
+bool MappedPointCloud::HasNormals() const
+{
+  return header_ &&
+         (header_->flags & ChunkedPointCloudHeader::FLAG_NORMALS) != 0;
+}
+
+bool MappedPointCloud::HasColors() const
+{
+  return header_ &&
+         (header_->flags & ChunkedPointCloudHeader::FLAG_COLORS) != 0;
+}
+
+MappedPointCloud::Vector3 MappedPointCloud::BoxMin() const
+{
+  return Vector3(header_->box_min[0], header_->box_min[1],
+                 header_->box_min[2]);
+}
+
+MappedPointCloud::Vector3 MappedPointCloud::BoxMax() const
+{
+  return Vector3(header_->box_max[0], header_->box_max[1],
+                 header_->box_max[2]);
+}
+
+MappedPointCloud::Chunk MappedPointCloud::GetChunk(size_t chunk_id) const
+{
+  const ChunkedPointCloudChunk& record = chunks_[chunk_id];
+  size_t number_of_points = record.number_of_points;
+  const char* data = mapped_file_.data() + record.data_offset;
+
+  Chunk chunk;
+  chunk.origin = Vector3(record.origin[0], record.origin[1],
+                         record.origin[2]);
+  chunk.first_point = size_t(record.first_point);
+  chunk.number_of_points = number_of_points;
+  const float* positions = reinterpret_cast<const float*>(data);
+  chunk.positions = ConstSpan<float>(positions, number_of_points * 3);
+  data += number_of_points * sizeof(float) * 3;
+  if (HasNormals())
+  {
+    chunk.normals = ConstSpan<int16_t>(
+      reinterpret_cast<const int16_t*>(data), number_of_points * 2);
+    data += number_of_points * sizeof(int16_t) * 2;
+  }
+  if (HasColors())
+  {
+    chunk.colors = ConstSpan<uint8_t>(
+      reinterpret_cast<const uint8_t*>(data), number_of_points * 3);
+  }
+  return chunk;
+}
+
+MappedPointCloud::Vector3 MappedPointCloud::Position(const Chunk& chunk,
+                                                     size_t k)
+{
+  return chunk.origin + Vector3(Scalar(chunk.positions[k * 3 + 0]),
+                                Scalar(chunk.positions[k * 3 + 1]),
+                                Scalar(chunk.positions[k * 3 + 2]));
+}
+
+MappedPointCloud::Vector3 MappedPointCloud::Normal(const Chunk& chunk,
+                                                   size_t k)
+{
+  Vector3 normal;
+  UnpackNormal(chunk.normals.data() + k * 2, normal.data());
+  return normal;
+}
+
+MappedPointCloud::Vector3 MappedPointCloud::Color(const Chunk& chunk,
+                                                  size_t k)
+{
+  return Vector3(Scalar(chunk.colors[k * 3 + 0]),
+                 Scalar(chunk.colors[k * 3 + 1]),
+                 Scalar(chunk.colors[k * 3 + 2])) / Scalar(255);
+}
+
+PointPositionView::PointPositionView()
+  : positions_(nullptr)
+  , number_of_points_(0)
+{
+}
+
+PointPositionView::PointPositionView(const Vector3* positions,
+                                     size_t number_of_points)
+  : positions_(positions)
+  , number_of_points_(number_of_points)
+{
+}
+
+int PointPositionView::Open(const std::string& path)
+{
+  Close();
+  if (mapped_point_cloud_.Open(path) != 0)
+  {
+    hs::graphics::PointCloudData<double> point_cloud;
+    if (LoadPointCloud(path, point_cloud) != 0) return -1;
+    decoded_.assign(point_cloud.VertexData().begin(),
+                    point_cloud.VertexData().end());
+    positions_ = decoded_.data();
+    number_of_points_ = decoded_.size();
+    return 0;
+  }
+
+  //Chunks are written in point order but looked up by first point, so
+  //sort them rather than rely on it.
+  size_t number_of_chunks = mapped_point_cloud_.NumberOfChunks();
+  std::vector<std::pair<size_t, size_t> > chunk_order(number_of_chunks);
+  for (size_t i = 0; i < number_of_chunks; i++)
+  {
+    chunk_order[i] = std::make_pair(
+      size_t(mapped_point_cloud_.GetChunk(i).first_point), i);
+  }
+  std::sort(chunk_order.begin(), chunk_order.end());
+  chunks_.reserve(number_of_chunks);
+  chunk_first_points_.reserve(number_of_chunks);
+  for (size_t i = 0; i < number_of_chunks; i++)
+  {
+    MappedPointCloud::Chunk chunk =
+      mapped_point_cloud_.GetChunk(chunk_order[i].second);
+    if (chunk.number_of_points == 0) continue;
+    chunks_.push_back(chunk);
+    chunk_first_points_.push_back(chunk.first_point);
+  }
+  number_of_points_ = mapped_point_cloud_.NumberOfPoints();
+  return 0;
+}
+
+void PointPositionView::Close()
+{
+  mapped_point_cloud_.Close();
+  chunks_.clear();
+  chunk_first_points_.clear();
+  Vector3Container().swap(decoded_);
+  positions_ = nullptr;
+  number_of_points_ = 0;
+}
+
+size_t PointPositionView::size() const
+{
+  return number_of_points_;
+}
+
+bool PointPositionView::empty() const
+{
+  return number_of_points_ == 0;
+}
+
+PointPositionView::Vector3 PointPositionView::operator[] (
+  size_t point_id) const
+{
+  if (positions_) return positions_[point_id];
+  std::vector<size_t>::const_iterator itr =
+    std::upper_bound(chunk_first_points_.begin(), chunk_first_points_.end(),
+                     point_id);
+  const MappedPointCloud::Chunk& chunk =
+    chunks_[size_t(itr - chunk_first_points_.begin()) - 1];
+  return MappedPointCloud::Position(chunk, point_id - chunk.first_point);
+}
+
+int LoadPointCloudPositions(const std::string& path,
+                            MappedPointCloud::Vector3Container& positions)
+{
+  PointPositionView view;
+  if (view.Open(path) != 0) return -1;
+  positions.resize(view.size());
+  for (size_t i = 0; i < view.size(); i++)
+  {
+    positions[i] = view[i];
+  }
+  return 0;
+}
+
+int LoadOrientedPointCloud(const std::string& path,
+                           MappedPointCloud::Vector3Container& positions,
+                           MappedPointCloud::Vector3Container& normals)
+{
+  MappedPointCloud mapped_point_cloud;
+  if (mapped_point_cloud.Open(path) != 0)
+  {
+    hs::graphics::PointCloudData<double> point_cloud;
+    if (LoadPointCloud(path, point_cloud) != 0) return -1;
+    if (point_cloud.NormalData().size() != point_cloud.VertexData().size())
+    {
+      return -1;
+    }
+    positions.assign(point_cloud.VertexData().begin(),
+                     point_cloud.VertexData().end());
+    normals.assign(point_cloud.NormalData().begin(),
+                   point_cloud.NormalData().end());
+    return 0;
+  }
+  if (!mapped_point_cloud.HasNormals()) return -1;
+
+  positions.resize(mapped_point_cloud.NumberOfPoints());
+  normals.resize(mapped_point_cloud.NumberOfPoints());
+  for (size_t i = 0; i < mapped_point_cloud.NumberOfChunks(); i++)
+  {
+    MappedPointCloud::Chunk chunk = mapped_point_cloud.GetChunk(i);
+    for (size_t k = 0; k < chunk.number_of_points; k++)
+    {
+      positions[chunk.first_point + k] =
+        MappedPointCloud::Position(chunk, k);
+      normals[chunk.first_point + k] = MappedPointCloud::Normal(chunk, k);
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
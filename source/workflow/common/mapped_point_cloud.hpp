@@ -0,0 +1,160 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MAPPED_POINT_CLOUD_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MAPPED_POINT_CLOUD_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/common/chunked_point_cloud.hpp"
+#include "workflow/common/mapped_file.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Read-only view of a typed array owned by someone else.
+ */
+template <typename T>
+class ConstSpan
+{
+public:
+  ConstSpan() : data_(nullptr), size_(0) {}
+  ConstSpan(const T* data, size_t size) : data_(data), size_(size) {}
+
+  const T* data() const { return data_; }
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T& operator[] (size_t i) const { return data_[i]; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+
+private:
+  const T* data_;
+  size_t size_;
+};
+
+/**
+ *  Maps a chunked point cloud file and exposes the arrays of each chunk in
+ *  place: opening costs the chunk table lookup whatever the cloud size and
+ *  no point is copied until a caller decodes it.
+ */
+class HS_EXPORT MappedPointCloud
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+
+  struct Chunk
+  {
+    Vector3 origin;
+    //x, y, z offsets from origin of each point.
+    ConstSpan<float> positions;
+    //Two octahedral snorm16 per point, empty without normals.
+    ConstSpan<int16_t> normals;
+    //Three bytes per point, empty without colors.
+    ConstSpan<uint8_t> colors;
+    size_t first_point;
+    size_t number_of_points;
+  };
+
+  MappedPointCloud();
+
+  int Open(const std::string& path);
+  void Close();
+  bool IsOpen() const;
+
+  const ChunkedPointCloudHeader& header() const;
+  size_t NumberOfPoints() const;
+  size_t NumberOfChunks() const;
+  bool HasNormals() const;
+  bool HasColors() const;
+  Vector3 BoxMin() const;
+  Vector3 BoxMax() const;
+
+  Chunk GetChunk(size_t chunk_id) const;
+
+  static Vector3 Position(const Chunk& chunk, size_t k);
+  static Vector3 Normal(const Chunk& chunk, size_t k);
+  //In [0, 1], as PointCloudData colors.
+  static Vector3 Color(const Chunk& chunk, size_t k);
+
+private:
+  MappedPointCloud(const MappedPointCloud&);
+  MappedPointCloud& operator=(const MappedPointCloud&);
+
+private:
+  MappedFile mapped_file_;
+  const ChunkedPointCloudHeader* header_;
+  const ChunkedPointCloudChunk* chunks_;
+};
+
+/**
+ *  Random access to the positions of a point cloud by point id.
+ *
+ *  A chunked file is read in place from its mapping, each lookup finding
+ *  its chunk among the chunk first points. Older cereal archives have no
+ *  layout to map and are deserialized into the view. A view can also wrap
+ *  an array the caller owns.
+ */
+class HS_EXPORT PointPositionView
+{
+public:
+  typedef MappedPointCloud::Scalar Scalar;
+  typedef MappedPointCloud::Vector3 Vector3;
+  typedef MappedPointCloud::Vector3Container Vector3Container;
+
+  PointPositionView();
+  PointPositionView(const Vector3* positions, size_t number_of_points);
+
+  int Open(const std::string& path);
+  //Releases the mapping, the view is empty afterwards.
+  void Close();
+
+  size_t size() const;
+  bool empty() const;
+  Vector3 operator[] (size_t point_id) const;
+
+private:
+  PointPositionView(const PointPositionView&);
+  PointPositionView& operator=(const PointPositionView&);
+
+private:
+  MappedPointCloud mapped_point_cloud_;
+  std::vector<MappedPointCloud::Chunk> chunks_;
+  std::vector<size_t> chunk_first_points_;
+  Vector3Container decoded_;
+  const Vector3* positions_;
+  size_t number_of_points_;
+};
+
+/**
+ *  Positions of a point cloud in file order, for callers that need an array
+ *  of their own to reorder. Read through a PointPositionView.
+ */
+HS_EXPORT int LoadPointCloudPositions(
+  const std::string& path,
+  MappedPointCloud::Vector3Container& positions);
+
+/**
+ *  Positions and normals of a point cloud in file order, -1 when the cloud
+ *  has no normals.
+ */
+HS_EXPORT int LoadOrientedPointCloud(
+  const std::string& path,
+  MappedPointCloud::Vector3Container& positions,
+  MappedPointCloud::Vector3Container& normals);
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MORTON_CODE_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_MORTON_CODE_HPP_
+
+#include <cstdint>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+//Bits of each cell coordinate in a 3D Morton code.
+const int MORTON_CELL_BITS = 21;
+const uint32_t MORTON_MAX_CELL = (uint32_t(1) << MORTON_CELL_BITS) - 1;
+
+//Spread the low 21 bits of value to every third bit.
+inline uint64_t SpreadMortonBits(uint32_t value)
+{
+  uint64_t x = uint64_t(value) & MORTON_MAX_CELL;
+  x = (x | x << 32) & 0x1F00000000FFFFULL;
+  x = (x | x << 16) & 0x1F0000FF0000FFULL;
+  x = (x | x << 8) & 0x100F00F00F00F00FULL;
+  x = (x | x << 4) & 0x10C30C30C30C30C3ULL;
+  x = (x | x << 2) & 0x1249249249249249ULL;
+  return x;
+}
+
+/**
+ *  Interleave the bits of cell (x, y, z), x lowest. Cells close in space
+ *  mostly get close codes, so sorting by code clusters points spatially.
+ */
+inline uint64_t MortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+  return SpreadMortonBits(x) | SpreadMortonBits(y) << 1 |
+         SpreadMortonBits(z) << 2;
+}
+
+}
+}
+}
+
+#endif
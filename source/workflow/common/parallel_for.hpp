@@ -0,0 +1,105 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_PARALLEL_FOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMMON_PARALLEL_FOR_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Split [begin, end) into number_of_threads contiguous ranges and run
+ *  function(range_begin, range_end) on each in its own thread.
+ *  The calling thread works on the last range.
+ */
+template <typename Function>
+void ParallelFor(size_t begin, size_t end, size_t number_of_threads,
+                 Function& function)
+{
+  if (end <= begin) return;
+  number_of_threads = std::max(number_of_threads, size_t(1));
+  number_of_threads = std::min(number_of_threads, end - begin);
+  size_t chunk = (end - begin + number_of_threads - 1) / number_of_threads;
+
+  std::vector<std::thread> threads;
+  size_t range_begin = begin;
+  for (; range_begin + chunk < end; range_begin += chunk)
+  {
+    threads.push_back(std::thread(std::ref(function),
+                                  range_begin, range_begin + chunk));
+  }
+  function(range_begin, end);
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i].join();
+  }
+}
+
+namespace detail
+{
+
+template <typename Function>
+struct DynamicRangeWorker
+{
+  DynamicRangeWorker(size_t end_, size_t block_size_,
+                     std::atomic<size_t>& next_, Function& function_)
+    : end(end_), block_size(block_size_), next(next_), function(function_) {}
+
+  void operator() ()
+  {
+    while (1)
+    {
+      size_t range_begin = next.fetch_add(block_size);
+      if (range_begin >= end) break;
+      function(range_begin, std::min(range_begin + block_size, end));
+    }
+  }
+
+  size_t end;
+  size_t block_size;
+  std::atomic<size_t>& next;
+  Function& function;
+};
+
+}
+
+/**
+ *  Hand out [begin, end) in blocks of block_size to number_of_threads
+ *  workers. For work whose cost varies a lot between items.
+ */
+template <typename Function>
+void ParallelForDynamic(size_t begin, size_t end, size_t number_of_threads,
+                        size_t block_size, Function& function)
+{
+  if (end <= begin) return;
+  number_of_threads = std::max(number_of_threads, size_t(1));
+  block_size = std::max(block_size, size_t(1));
+
+  std::atomic<size_t> next(begin);
+  detail::DynamicRangeWorker<Function> worker(end, block_size, next, function);
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < number_of_threads; i++)
+  {
+    threads.push_back(std::thread(std::ref(worker)));
+  }
+  worker();
+
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i].join();
+  }
+}
+
+}
+}
+}
+
+#endif
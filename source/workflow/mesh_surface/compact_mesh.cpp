@@ -0,0 +1,212 @@
+#include <fstream>
+#include <limits>
+
+#include <cereal/types/array.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::CompactMesh CompactMesh;
+typedef EIGEN_STD_VECTOR(CompactMesh::Position) PositionContainer;
+typedef std::array<size_t, 3> LegacyTriangle;
+typedef std::vector<LegacyTriangle> LegacyTriangleContainer;
+
+static_assert(sizeof(CompactMesh::Vertex) == 3 * sizeof(CompactMesh::Float),
+              "compact mesh vertices must be tightly packed");
+static_assert(sizeof(CompactMesh::Triangle) == 3 * sizeof(CompactMesh::Index),
+              "compact mesh triangles must be tightly packed");
+
+const size_t MAX_VERTICES = std::numeric_limits<CompactMesh::Index>::max();
+
+bool ValidTriangles(const CompactMesh& mesh)
+{
+  size_t number_of_vertices = mesh.vertices.size();
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    const CompactMesh::Triangle& triangle = mesh.triangles[i];
+    if (triangle[0] >= number_of_vertices ||
+        triangle[1] >= number_of_vertices ||
+        triangle[2] >= number_of_vertices)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+int LoadCompactMesh(cereal::PortableBinaryInputArchive& archive,
+                    CompactMesh& mesh)
+{
+  archive(mesh.origin[0], mesh.origin[1], mesh.origin[2]);
+  uint64_t number_of_vertices = 0;
+  archive(cereal::make_size_tag(number_of_vertices));
+  if (number_of_vertices > MAX_VERTICES) return -1;
+  mesh.vertices.resize(size_t(number_of_vertices));
+  if (!mesh.vertices.empty())
+  {
+    archive(cereal::binary_data(mesh.vertices[0].data(),
+                                mesh.vertices.size() *
+                                sizeof(CompactMesh::Vertex)));
+  }
+  uint64_t number_of_triangles = 0;
+  archive(cereal::make_size_tag(number_of_triangles));
+  mesh.triangles.resize(size_t(number_of_triangles));
+  if (!mesh.triangles.empty())
+  {
+    archive(cereal::binary_data(mesh.triangles[0].data(),
+                                mesh.triangles.size() *
+                                sizeof(CompactMesh::Triangle)));
+  }
+  return ValidTriangles(mesh) ? 0 : -1;
+}
+
+int ConvertLegacyMesh(const PositionContainer& positions,
+                      const LegacyTriangleContainer& triangles,
+                      CompactMesh& mesh)
+{
+  if (positions.size() > MAX_VERTICES) return -1;
+  mesh.origin = hs::recon::workflow::CompactMeshOrigin(positions);
+  mesh.vertices.resize(positions.size());
+  for (size_t i = 0; i < positions.size(); i++)
+  {
+    mesh.vertices[i] = (positions[i] - mesh.origin).cast<CompactMesh::Float>();
+  }
+  mesh.triangles.resize(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      if (triangles[i][j] >= positions.size()) return -1;
+      mesh.triangles[i][j] = CompactMesh::Index(triangles[i][j]);
+    }
+  }
+  return 0;
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+CompactMesh::Position CompactMeshOrigin(
+  const EIGEN_STD_VECTOR(CompactMesh::Position)& positions)
+{
+  if (positions.empty()) return CompactMesh::Position::Zero();
+  CompactMesh::Position min = positions[0];
+  CompactMesh::Position max = positions[0];
+  for (size_t i = 1; i < positions.size(); i++)
+  {
+    min = min.cwiseMin(positions[i]);
+    max = max.cwiseMax(positions[i]);
+  }
+  return (min + max) * 0.5;
+}
+
+int LoadMesh(const std::string& path, CompactMesh& mesh)
+{
+  std::ifstream mesh_file(path, std::ios::binary);
+  if (!mesh_file) return -1;
+
+  try
+  {
+    {
+      cereal::PortableBinaryInputArchive archive(mesh_file);
+      uint32_t magic = 0;
+      uint32_t version = 0;
+      archive(magic, version);
+      if (magic == COMPACT_MESH_MAGIC && version == COMPACT_MESH_VERSION)
+      {
+        return LoadCompactMesh(archive, mesh);
+      }
+    }
+
+    //Legacy layout, the magic was the low half of the vertex count.
+    mesh_file.clear();
+    mesh_file.seekg(0);
+    cereal::PortableBinaryInputArchive archive(mesh_file);
+    PositionContainer positions;
+    LegacyTriangleContainer triangles;
+    archive(positions, triangles);
+    return ConvertLegacyMesh(positions, triangles, mesh);
+  }
+  catch (const cereal::Exception&)
+  {
+    return -1;
+  }
+}
+
+int SaveMesh(const std::string& path, const CompactMesh& mesh)
+{
+  std::ofstream mesh_file(path, std::ios::binary);
+  if (!mesh_file) return -1;
+
+  cereal::PortableBinaryOutputArchive archive(mesh_file);
+  archive(COMPACT_MESH_MAGIC, COMPACT_MESH_VERSION,
+          mesh.origin[0], mesh.origin[1], mesh.origin[2]);
+  uint64_t number_of_vertices = mesh.vertices.size();
+  archive(cereal::make_size_tag(number_of_vertices));
+  if (!mesh.vertices.empty())
+  {
+    archive(cereal::binary_data(mesh.vertices[0].data(),
+                                mesh.vertices.size() *
+                                sizeof(CompactMesh::Vertex)));
+  }
+  uint64_t number_of_triangles = mesh.triangles.size();
+  archive(cereal::make_size_tag(number_of_triangles));
+  if (!mesh.triangles.empty())
+  {
+    archive(cereal::binary_data(mesh.triangles[0].data(),
+                                mesh.triangles.size() *
+                                sizeof(CompactMesh::Triangle)));
+  }
+  return mesh_file ? 0 : -1;
+}
+
+int ReadMeshSize(const std::string& path,
+                 size_t& number_of_vertices,
+                 size_t& number_of_triangles)
+{
+  std::ifstream mesh_file(path, std::ios::binary);
+  if (!mesh_file) return -1;
+
+  try
+  {
+    cereal::PortableBinaryInputArchive archive(mesh_file);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    archive(magic, version);
+    if (magic != COMPACT_MESH_MAGIC || version != COMPACT_MESH_VERSION)
+    {
+      return -1;
+    }
+    CompactMesh::Position origin;
+    archive(origin[0], origin[1], origin[2]);
+    uint64_t vertex_count = 0;
+    archive(cereal::make_size_tag(vertex_count));
+    if (vertex_count > MAX_VERTICES) return -1;
+    mesh_file.seekg(std::streamoff(vertex_count *
+                                   sizeof(CompactMesh::Vertex)),
+                    std::ios::cur);
+    uint64_t triangle_count = 0;
+    archive(cereal::make_size_tag(triangle_count));
+    number_of_vertices = size_t(vertex_count);
+    number_of_triangles = size_t(triangle_count);
+    return 0;
+  }
+  catch (const cereal::Exception&)
+  {
+    return -1;
+  }
+}
+
+}
+}
+}
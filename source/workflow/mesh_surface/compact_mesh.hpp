@@ -0,0 +1,73 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMPACT_MESH_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMPACT_MESH_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+//"HSMS", first field of a compact mesh.bin.
+const uint32_t COMPACT_MESH_MAGIC = 0x534D5348;
+const uint32_t COMPACT_MESH_VERSION = 1;
+
+/**
+ *  Triangle mesh with float vertices relative to a double origin and 32-bit
+ *  vertex ids, half the size of double vertices and size_t ids.
+ *
+ *  mesh.bin holds, in a cereal portable binary archive: the magic, the
+ *  version, the origin, the vertex count and the vertices as raw floats,
+ *  then the triangle count and the triangles as raw uint32 ids.
+ */
+struct HS_EXPORT CompactMesh
+{
+  typedef float Float;
+  typedef EIGEN_VECTOR(Float, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef uint32_t Index;
+  typedef std::array<Index, 3> Triangle;
+  typedef std::vector<Triangle> TriangleContainer;
+  typedef EIGEN_VECTOR(double, 3) Position;
+
+  Position VertexPosition(size_t vertex_id) const
+  {
+    return origin + vertices[vertex_id].cast<double>();
+  }
+
+  Position origin;
+  VertexContainer vertices;
+  TriangleContainer triangles;
+};
+
+//Center of the bounding box of positions, where floats are most precise.
+HS_EXPORT CompactMesh::Position CompactMeshOrigin(
+  const EIGEN_STD_VECTOR(CompactMesh::Position)& positions);
+
+/**
+ *  Load mesh.bin. Files written before the compact layout, a cereal archive
+ *  of double vertices and size_t triangles, are converted.
+ */
+HS_EXPORT int LoadMesh(const std::string& path, CompactMesh& mesh);
+
+HS_EXPORT int SaveMesh(const std::string& path, const CompactMesh& mesh);
+
+//Vertex and triangle counts of a compact mesh.bin, without loading it.
+HS_EXPORT int ReadMeshSize(const std::string& path,
+                           size_t& number_of_vertices,
+                           size_t& number_of_triangles);
+
+}
+}
+}
+
+#endif
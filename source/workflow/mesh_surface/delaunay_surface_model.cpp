@@ -1,14 +1,9 @@
-#include <fstream>
-#include <vector>
-
-#include <cereal/types/array.hpp>
-#include <cereal/types/vector.hpp>
-#include <cereal/archives/portable_binary.hpp>
-
-#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-#include <CGAL/Delaunay_triangulation_2.h>
-#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+#include <algorithm>
 
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/mesh_surface/mesh_simplifier.hpp"
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
+#include "workflow/mesh_surface/tiled_delaunay_triangulator.hpp"
 #include "workflow/mesh_surface/delaunay_surface_model.hpp"
 
 namespace hs
@@ -24,17 +19,17 @@ DelaunaySurfaceModel::DelaunaySurfaceModel()
 }
 
 int DelaunaySurfaceModel::LoadPointCloudData(WorkflowStepConfig* config,
-                                             PointCloudData& point_cloud_data)
+                                             VertexContainer& vertices)
 {
   MeshSurfaceConfig* surface_model_config =
     static_cast<MeshSurfaceConfig*>(config);
 
+  //Only positions are triangulated, normals and colors stay in the file.
+  //The spatial sort reorders them, so they get an array of their own.
+  if (LoadPointCloudPositions(surface_model_config->pointcloud_path(),
+                              vertices) != 0)
   {
-    std::ifstream point_cloud_file(surface_model_config->pointcloud_path(),
-                                   std::ios::binary);
-    if (!point_cloud_file) return -1;
-    cereal::PortableBinaryInputArchive archive(point_cloud_file);
-    archive(point_cloud_data);
+    return -1;
   }
   
   return 0;
@@ -42,61 +37,36 @@ int DelaunaySurfaceModel::LoadPointCloudData(WorkflowStepConfig* config,
 
 int DelaunaySurfaceModel::DelaunayTriangulate(
   WorkflowStepConfig* config,
-  const PointCloudData& point_cloud_data,
-  VertexContainer& vertices,
-  TriangleContainer& triangles)
+  VertexContainer& vertices)
 {
-  typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
-  typedef CGAL::Triangulation_vertex_base_with_info_2<size_t, Kernel> Vb;
-  typedef CGAL::Triangulation_data_structure_2<Vb> Tds;
-  typedef CGAL::Delaunay_triangulation_2<Kernel, Tds> Delaunay;
-  typedef Kernel::Point_2 Point;
-
-  std::vector<std::pair<Point, size_t> > points;
-  vertices.resize(point_cloud_data.PointCloudSize());
-  for (size_t i = 0; i < point_cloud_data.PointCloudSize(); i++)
-  {
-    Vertex point = point_cloud_data.VertexData()[i];
-    points.push_back(std::make_pair(Point(point[0], point[1]), i));
-    vertices[i] = point;
-  }
+  MeshSurfaceConfig* surface_model_config =
+    static_cast<MeshSurfaceConfig*>(config);
 
-  Delaunay triangulation;
-  triangulation.insert(points.begin(), points.end());
+  size_t tile_capacity =
+    size_t(std::max(surface_model_config->delaunay_tile_points(), 0));
+  size_t number_of_threads =
+    size_t(std::max(surface_model_config->core_use(), 1));
+  TiledDelaunayTriangulator triangulator(tile_capacity, number_of_threads);
+  triangulator.SpatialSort(vertices);
 
-  for (Delaunay::Finite_faces_iterator itr_face =
-         triangulation.finite_faces_begin();
-       itr_face != triangulation.finite_faces_end(); ++itr_face)
-  {
-    Delaunay::Face_handle face = itr_face;
-    Triangle triangle;
-    
-    triangle[0] = face->vertex(0)->info();
-    triangle[1] = face->vertex(1)->info();
-    triangle[2] = face->vertex(2)->info();
-
-    triangles.push_back(triangle);
-  }
+  std::string mesh_path = surface_model_config->output_dir() + "/mesh.bin";
+  MeshStreamWriter writer;
+  if (writer.Open(mesh_path, vertices) != 0) return -1;
+  if (triangulator(vertices, writer) != 0) return -1;
 
-  return 0;
+  return writer.Close();
 }
 
-int DelaunaySurfaceModel::SaveSurfaceModel(WorkflowStepConfig* config,
-  const VertexContainer& vertices,
-  const TriangleContainer& triangles)
+int DelaunaySurfaceModel::BuildLods(WorkflowStepConfig* config)
 {
   MeshSurfaceConfig* surface_model_config =
     static_cast<MeshSurfaceConfig*>(config);
 
-  {
-    std::string mesh_path =
-      surface_model_config->output_dir() + "/mesh.bin";
-    std::ofstream mesh_file(mesh_path, std::ios::binary);
-    cereal::PortableBinaryOutputArchive archive(mesh_file);
-    archive(vertices, triangles);
-  }
-
-  return 0;
+  return BuildMeshLods(surface_model_config->output_dir() + "/mesh.bin",
+                       surface_model_config->number_of_lods(),
+                       surface_model_config->lod_ratio(),
+                       surface_model_config->lod_max_error(),
+                       size_t(std::max(surface_model_config->core_use(), 1)));
 }
 
 int DelaunaySurfaceModel::RunImplement(WorkflowStepConfig* config)
@@ -105,20 +75,18 @@ int DelaunaySurfaceModel::RunImplement(WorkflowStepConfig* config)
   while (1)
   {
     progress_manager_.AddSubProgress(0.1f);
-    PointCloudData point_cloud_data;
-    result = LoadPointCloudData(config, point_cloud_data);
+    VertexContainer vertices;
+    result = LoadPointCloudData(config, vertices);
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
-    progress_manager_.AddSubProgress(0.8f);
-    VertexContainer vertices;
-    TriangleContainer triangles;
-    result = DelaunayTriangulate(config, point_cloud_data, vertices, triangles);
+    progress_manager_.AddSubProgress(0.7f);
+    result = DelaunayTriangulate(config, vertices);
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
-    progress_manager_.AddSubProgress(0.1f);
-    result = SaveSurfaceModel(config, vertices, triangles);
+    progress_manager_.AddSubProgress(0.2f);
+    result = BuildLods(config);
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
@@ -33,14 +33,12 @@ public:
   DelaunaySurfaceModel();
 protected:
   int LoadPointCloudData(WorkflowStepConfig* config,
-                         PointCloudData& point_cloud_data);
+                         VertexContainer& vertices);
+  //Sort vertices along a Hilbert curve, triangulate them and stream them
+  //with their triangles to mesh.bin.
   int DelaunayTriangulate(WorkflowStepConfig* config,
-                          const PointCloudData& point_cloud_data,
-                          VertexContainer& vertices,
-                          TriangleContainer& triangles);
-  int SaveSurfaceModel(WorkflowStepConfig* config,
-                       const VertexContainer& vertices,
-                       const TriangleContainer& triangles);
+                          VertexContainer& vertices);
+  int BuildLods(WorkflowStepConfig* config);
   virtual int RunImplement(WorkflowStepConfig* config);
 };
 
@@ -0,0 +1,754 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <queue>
+#include <utility>
+#include <vector>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/mesh_surface/mesh_simplifier.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::CompactMesh CompactMesh;
+typedef CompactMesh::Index Index;
+typedef CompactMesh::Triangle Triangle;
+typedef CompactMesh::TriangleContainer TriangleContainer;
+typedef double Scalar;
+typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+typedef EIGEN_MATRIX(Scalar, 3, 3) Matrix33;
+
+//Triangles per tile, simplified by a single thread.
+const size_t TILE_TRIANGLES = 1 << 16;
+//Bits of each coordinate of a packed tile.
+const int TILE_BITS = 21;
+const uint64_t MAX_TILE = (uint64_t(1) << TILE_BITS) - 1;
+//Rounds stop when one removes less than this share of the triangles.
+const Scalar MIN_ROUND_PROGRESS = 0.01;
+const int MAX_ROUNDS = 8;
+//Neighbours a vertex may end up with, fans of slivers are not worth it.
+const size_t MAX_VALENCE = 24;
+
+/**
+ *  Sum of the squared distances to a set of planes, weighted by the area
+ *  of the triangles they come from.
+ */
+struct Quadric
+{
+  Quadric()
+    : a(Matrix33::Zero()), b(Vector3::Zero()), c(0), area(0) {}
+
+  void AddPlane(const Vector3& normal, Scalar offset, Scalar weight)
+  {
+    a += weight * normal * normal.transpose();
+    b += weight * offset * normal;
+    c += weight * offset * offset;
+    area += weight;
+  }
+
+  Quadric& operator+= (const Quadric& other)
+  {
+    a += other.a;
+    b += other.b;
+    c += other.c;
+    area += other.area;
+    return *this;
+  }
+
+  //Mean squared distance of position to the planes.
+  Scalar Error(const Vector3& position) const
+  {
+    if (!(area > 0)) return 0;
+    Scalar sum = position.dot(a * position) + 2 * b.dot(position) + c;
+    return std::max(sum, Scalar(0)) / area;
+  }
+
+  //Fails when the planes leave a direction free, flat or crease areas.
+  bool Minimum(Vector3& position) const
+  {
+    Scalar scale = a.trace();
+    if (!(scale > 0)) return false;
+    Matrix33 inverse;
+    Scalar determinant;
+    bool invertible;
+    a.computeInverseAndDetWithCheck(inverse, determinant, invertible,
+                                    1e-9 * scale * scale * scale);
+    if (!invertible) return false;
+    position = -(inverse * b);
+    return true;
+  }
+
+  Matrix33 a;
+  Vector3 b;
+  Scalar c;
+  Scalar area;
+};
+
+//Collapse of removed onto kept, moved to position.
+struct Candidate
+{
+  Scalar cost;
+  Index removed;
+  Index kept;
+  uint32_t removed_stamp;
+  uint32_t kept_stamp;
+  Vector3 position;
+};
+
+//Cheapest first, ties broken by vertex so the order is reproducible.
+struct CandidateGreater
+{
+  bool operator() (const Candidate& a, const Candidate& b) const
+  {
+    if (a.cost != b.cost) return a.cost > b.cost;
+    if (a.kept != b.kept) return a.kept > b.kept;
+    return a.removed > b.removed;
+  }
+};
+
+typedef std::priority_queue<Candidate, std::vector<Candidate>,
+                            CandidateGreater> CandidateQueue;
+
+/**
+ *  Collapses the edges of the triangles of one tile. Vertices shared with
+ *  other tiles are locked: they keep their position and no edge between
+ *  two of them is created, so tiles run concurrently on the same mesh.
+ */
+class TileSimplifier
+{
+public:
+  TileSimplifier(CompactMesh& mesh, const std::vector<char>& shared,
+                 Scalar max_squared_error)
+    : mesh_(mesh), shared_(shared), max_squared_error_(max_squared_error) {}
+
+  void operator() (const Index* triangle_ids, size_t number_of_triangles,
+                   size_t target_triangles, TriangleContainer& output)
+  {
+    Build(triangle_ids, number_of_triangles);
+
+    while (number_of_alive_ > target_triangles && !queue_.empty())
+    {
+      Candidate candidate = queue_.top();
+      queue_.pop();
+      if (removed_[candidate.removed] || removed_[candidate.kept] ||
+          stamps_[candidate.removed] != candidate.removed_stamp ||
+          stamps_[candidate.kept] != candidate.kept_stamp)
+      {
+        continue;
+      }
+      if (max_squared_error_ > 0 && candidate.cost > max_squared_error_)
+      {
+        break;
+      }
+      if (!CanCollapse(candidate)) continue;
+      Collapse(candidate);
+    }
+
+    output.clear();
+    output.reserve(number_of_alive_);
+    for (size_t i = 0; i < triangles_.size(); i++)
+    {
+      if (!alive_[i]) continue;
+      Triangle triangle = {{globals_[triangles_[i][0]],
+                            globals_[triangles_[i][1]],
+                            globals_[triangles_[i][2]]}};
+      output.push_back(triangle);
+    }
+    //Unlocked vertices belong to this tile only.
+    for (size_t i = 0; i < globals_.size(); i++)
+    {
+      if (removed_[i] || locked_[i]) continue;
+      mesh_.vertices[globals_[i]] = positions_[i].cast<CompactMesh::Float>();
+    }
+  }
+
+private:
+  void Build(const Index* triangle_ids, size_t number_of_triangles)
+  {
+    globals_.clear();
+    for (size_t i = 0; i < number_of_triangles; i++)
+    {
+      const Triangle& triangle = mesh_.triangles[triangle_ids[i]];
+      globals_.insert(globals_.end(), triangle.begin(), triangle.end());
+    }
+    std::sort(globals_.begin(), globals_.end());
+    globals_.erase(std::unique(globals_.begin(), globals_.end()),
+                   globals_.end());
+
+    size_t number_of_vertices = globals_.size();
+    positions_.resize(number_of_vertices);
+    quadrics_.assign(number_of_vertices, Quadric());
+    locked_.assign(number_of_vertices, 0);
+    removed_.assign(number_of_vertices, 0);
+    stamps_.assign(number_of_vertices, 0);
+    vertex_triangles_.assign(number_of_vertices, std::vector<Index>());
+    for (size_t i = 0; i < number_of_vertices; i++)
+    {
+      positions_[i] = mesh_.vertices[globals_[i]].cast<Scalar>();
+      locked_[i] = shared_[globals_[i]];
+    }
+
+    triangles_.resize(number_of_triangles);
+    alive_.assign(number_of_triangles, 1);
+    number_of_alive_ = number_of_triangles;
+    std::vector<std::pair<Index, Index> > edges;
+    edges.reserve(number_of_triangles * 3);
+    for (size_t i = 0; i < number_of_triangles; i++)
+    {
+      const Triangle& triangle = mesh_.triangles[triangle_ids[i]];
+      for (int k = 0; k < 3; k++)
+      {
+        triangles_[i][k] = Index(
+          std::lower_bound(globals_.begin(), globals_.end(), triangle[k]) -
+          globals_.begin());
+        vertex_triangles_[triangles_[i][k]].push_back(Index(i));
+      }
+      const Vector3& a = positions_[triangles_[i][0]];
+      const Vector3& b = positions_[triangles_[i][1]];
+      const Vector3& c = positions_[triangles_[i][2]];
+      Vector3 normal = (b - a).cross(c - a);
+      Scalar double_area = normal.norm();
+      if (double_area > 0)
+      {
+        normal /= double_area;
+        for (int k = 0; k < 3; k++)
+        {
+          quadrics_[triangles_[i][k]].AddPlane(normal, -normal.dot(a),
+                                               double_area * 0.5);
+        }
+      }
+      for (int k = 0; k < 3; k++)
+      {
+        Index u = triangles_[i][k];
+        Index v = triangles_[i][(k + 1) % 3];
+        edges.push_back(std::make_pair(std::min(u, v), std::max(u, v)));
+      }
+    }
+
+    //Border and non-manifold edges hold their vertices in place.
+    std::sort(edges.begin(), edges.end());
+    queue_ = CandidateQueue();
+    size_t begin = 0;
+    while (begin < edges.size())
+    {
+      size_t end = begin + 1;
+      while (end < edges.size() && edges[end] == edges[begin]) end++;
+      if (end - begin != 2)
+      {
+        locked_[edges[begin].first] = 1;
+        locked_[edges[begin].second] = 1;
+      }
+      begin = end;
+    }
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (size_t i = 0; i < edges.size(); i++)
+    {
+      Push(edges[i].first, edges[i].second);
+    }
+  }
+
+  void Push(Index a, Index b)
+  {
+    if (locked_[a] && locked_[b]) return;
+    Candidate candidate;
+    if (locked_[a] || (!locked_[b] && a < b))
+    {
+      candidate.kept = a;
+      candidate.removed = b;
+    }
+    else
+    {
+      candidate.kept = b;
+      candidate.removed = a;
+    }
+    Quadric quadric = quadrics_[a];
+    quadric += quadrics_[b];
+    const Vector3& kept = positions_[candidate.kept];
+    const Vector3& removed = positions_[candidate.removed];
+    if (locked_[candidate.kept])
+    {
+      candidate.position = kept;
+    }
+    else
+    {
+      //The optimum, unless the quadric is too flat to pin it near the edge.
+      Vector3 middle = (kept + removed) * 0.5;
+      Vector3 optimum;
+      if (quadric.Minimum(optimum) &&
+          (optimum - middle).norm() <= (kept - removed).norm())
+      {
+        candidate.position = optimum;
+      }
+      else
+      {
+        candidate.position = middle;
+        if (quadric.Error(kept) < quadric.Error(candidate.position))
+        {
+          candidate.position = kept;
+        }
+        if (quadric.Error(removed) < quadric.Error(candidate.position))
+        {
+          candidate.position = removed;
+        }
+      }
+    }
+    candidate.cost = quadric.Error(candidate.position);
+    candidate.removed_stamp = stamps_[candidate.removed];
+    candidate.kept_stamp = stamps_[candidate.kept];
+    queue_.push(candidate);
+  }
+
+  void Neighbours(Index vertex, std::vector<Index>& neighbours) const
+  {
+    neighbours.clear();
+    const std::vector<Index>& triangle_ids = vertex_triangles_[vertex];
+    for (size_t i = 0; i < triangle_ids.size(); i++)
+    {
+      if (!alive_[triangle_ids[i]]) continue;
+      const Triangle& triangle = triangles_[triangle_ids[i]];
+      for (int k = 0; k < 3; k++)
+      {
+        if (triangle[k] != vertex) neighbours.push_back(triangle[k]);
+      }
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    neighbours.erase(std::unique(neighbours.begin(), neighbours.end()),
+                     neighbours.end());
+  }
+
+  //Triangles of vertex not around the edge must not fold over.
+  bool KeepsOrientation(Index vertex, Index other,
+                        const Vector3& position) const
+  {
+    const std::vector<Index>& triangle_ids = vertex_triangles_[vertex];
+    for (size_t i = 0; i < triangle_ids.size(); i++)
+    {
+      if (!alive_[triangle_ids[i]]) continue;
+      const Triangle& triangle = triangles_[triangle_ids[i]];
+      if (triangle[0] == other || triangle[1] == other ||
+          triangle[2] == other)
+      {
+        continue;
+      }
+      Vector3 before[3];
+      Vector3 after[3];
+      for (int k = 0; k < 3; k++)
+      {
+        before[k] = positions_[triangle[k]];
+        after[k] = triangle[k] == vertex ? position : before[k];
+      }
+      Vector3 normal_before =
+        (before[1] - before[0]).cross(before[2] - before[0]);
+      Vector3 normal_after = (after[1] - after[0]).cross(after[2] - after[0]);
+      if (!(normal_after.dot(normal_before) > 0)) return false;
+    }
+    return true;
+  }
+
+  bool CanCollapse(const Candidate& candidate)
+  {
+    Index removed = candidate.removed;
+    Index kept = candidate.kept;
+    Neighbours(removed, removed_neighbours_);
+    Neighbours(kept, kept_neighbours_);
+
+    //Link condition: the edge is in two triangles and the ends share no
+    //other neighbour, otherwise the surface pinches.
+    size_t common = 0;
+    for (size_t i = 0; i < removed_neighbours_.size(); i++)
+    {
+      Index neighbour = removed_neighbours_[i];
+      if (neighbour == kept) continue;
+      if (std::binary_search(kept_neighbours_.begin(), kept_neighbours_.end(),
+                             neighbour))
+      {
+        common++;
+      }
+      else if (locked_[kept] && locked_[neighbour])
+      {
+        //Another tile could join the same two vertices.
+        return false;
+      }
+    }
+    if (common != 2) return false;
+    if (removed_neighbours_.size() + kept_neighbours_.size() - 4 >
+        MAX_VALENCE)
+    {
+      return false;
+    }
+
+    if (!KeepsOrientation(removed, kept, candidate.position)) return false;
+    if (!locked_[kept] &&
+        !KeepsOrientation(kept, removed, candidate.position))
+    {
+      return false;
+    }
+    return true;
+  }
+
+  void Collapse(const Candidate& candidate)
+  {
+    Index removed = candidate.removed;
+    Index kept = candidate.kept;
+    std::vector<Index>& kept_triangles = vertex_triangles_[kept];
+    const std::vector<Index>& removed_triangles = vertex_triangles_[removed];
+    for (size_t i = 0; i < removed_triangles.size(); i++)
+    {
+      Index triangle_id = removed_triangles[i];
+      if (!alive_[triangle_id]) continue;
+      Triangle& triangle = triangles_[triangle_id];
+      if (triangle[0] == kept || triangle[1] == kept || triangle[2] == kept)
+      {
+        alive_[triangle_id] = 0;
+        number_of_alive_--;
+        continue;
+      }
+      for (int k = 0; k < 3; k++)
+      {
+        if (triangle[k] == removed) triangle[k] = kept;
+      }
+      kept_triangles.push_back(triangle_id);
+    }
+    std::vector<Index>().swap(vertex_triangles_[removed]);
+    size_t number_of_kept = 0;
+    for (size_t i = 0; i < kept_triangles.size(); i++)
+    {
+      if (alive_[kept_triangles[i]])
+      {
+        kept_triangles[number_of_kept++] = kept_triangles[i];
+      }
+    }
+    kept_triangles.resize(number_of_kept);
+
+    removed_[removed] = 1;
+    positions_[kept] = candidate.position;
+    quadrics_[kept] += quadrics_[removed];
+    stamps_[removed]++;
+    stamps_[kept]++;
+
+    Neighbours(kept, kept_neighbours_);
+    for (size_t i = 0; i < kept_neighbours_.size(); i++)
+    {
+      Push(kept, kept_neighbours_[i]);
+    }
+  }
+
+private:
+  CompactMesh& mesh_;
+  const std::vector<char>& shared_;
+  Scalar max_squared_error_;
+
+  //Mesh vertex of each tile vertex.
+  std::vector<Index> globals_;
+  Vector3Container positions_;
+  std::vector<Quadric> quadrics_;
+  std::vector<char> locked_;
+  std::vector<char> removed_;
+  //Changed at each collapse, outdating the queued candidates.
+  std::vector<uint32_t> stamps_;
+  std::vector<std::vector<Index> > vertex_triangles_;
+  TriangleContainer triangles_;
+  std::vector<char> alive_;
+  size_t number_of_alive_;
+  CandidateQueue queue_;
+  std::vector<Index> removed_neighbours_;
+  std::vector<Index> kept_neighbours_;
+};
+
+struct TileWorker
+{
+  TileWorker(CompactMesh& mesh_,
+             const std::vector<char>& shared_,
+             const std::vector<Index>& tile_triangles_,
+             const std::vector<size_t>& tile_begins_,
+             Scalar ratio_,
+             Scalar max_squared_error_,
+             std::vector<TriangleContainer>& outputs_)
+    : mesh(mesh_)
+    , shared(shared_)
+    , tile_triangles(tile_triangles_)
+    , tile_begins(tile_begins_)
+    , ratio(ratio_)
+    , max_squared_error(max_squared_error_)
+    , outputs(outputs_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    TileSimplifier simplifier(mesh, shared, max_squared_error);
+    for (size_t tile = begin; tile < end; tile++)
+    {
+      size_t number_of_triangles = tile_begins[tile + 1] - tile_begins[tile];
+      size_t target_triangles =
+        size_t(std::ceil(Scalar(number_of_triangles) * ratio));
+      simplifier(&tile_triangles[tile_begins[tile]], number_of_triangles,
+                 target_triangles, outputs[tile]);
+    }
+  }
+
+  CompactMesh& mesh;
+  const std::vector<char>& shared;
+  const std::vector<Index>& tile_triangles;
+  const std::vector<size_t>& tile_begins;
+  Scalar ratio;
+  Scalar max_squared_error;
+  std::vector<TriangleContainer>& outputs;
+};
+
+/**
+ *  One round of simplification on tiles, shifted by half a tile when
+ *  shifted is set.
+ */
+void SimplifyTiles(size_t target_triangles, Scalar max_squared_error,
+                   bool shifted, size_t number_of_threads, CompactMesh& mesh)
+{
+  size_t number_of_triangles = mesh.triangles.size();
+  Vector3 box_min = mesh.vertices[0].cast<Scalar>();
+  Vector3 box_max = box_min;
+  for (size_t i = 1; i < mesh.vertices.size(); i++)
+  {
+    box_min = box_min.cwiseMin(mesh.vertices[i].cast<Scalar>());
+    box_max = box_max.cwiseMax(mesh.vertices[i].cast<Scalar>());
+  }
+  //Surfaces fill tiles by area.
+  Scalar extent = std::max((box_max - box_min).maxCoeff(), Scalar(1e-6));
+  Scalar tile_size = extent * 2;
+  if (number_of_triangles > TILE_TRIANGLES)
+  {
+    tile_size = extent * std::sqrt(Scalar(TILE_TRIANGLES) /
+                                   Scalar(number_of_triangles));
+  }
+  Vector3 tile_origin = box_min;
+  if (shifted) tile_origin -= Vector3::Constant(tile_size * 0.5);
+
+  std::vector<std::pair<uint64_t, Index> > keys(number_of_triangles);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    const Triangle& triangle = mesh.triangles[i];
+    Vector3 centroid = (mesh.vertices[triangle[0]].cast<Scalar>() +
+                        mesh.vertices[triangle[1]].cast<Scalar>() +
+                        mesh.vertices[triangle[2]].cast<Scalar>()) / 3;
+    uint64_t key = 0;
+    for (int a = 0; a < 3; a++)
+    {
+      Scalar cell = std::floor((centroid[a] - tile_origin[a]) / tile_size);
+      key |= uint64_t(std::min(std::max(cell, Scalar(0)), Scalar(MAX_TILE))) <<
+             (a * TILE_BITS);
+    }
+    keys[i] = std::make_pair(key, Index(i));
+  }
+  std::sort(keys.begin(), keys.end());
+
+  std::vector<Index> tile_triangles(number_of_triangles);
+  std::vector<size_t> tile_begins;
+  std::vector<uint64_t> vertex_tiles(mesh.vertices.size(), ~uint64_t(0));
+  std::vector<char> shared(mesh.vertices.size(), 0);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    if (i == 0 || keys[i].first != keys[i - 1].first)
+    {
+      tile_begins.push_back(i);
+    }
+    tile_triangles[i] = keys[i].second;
+    const Triangle& triangle = mesh.triangles[keys[i].second];
+    for (int k = 0; k < 3; k++)
+    {
+      uint64_t& vertex_tile = vertex_tiles[triangle[k]];
+      if (vertex_tile == ~uint64_t(0))
+      {
+        vertex_tile = keys[i].first;
+      }
+      else if (vertex_tile != keys[i].first)
+      {
+        shared[triangle[k]] = 1;
+      }
+    }
+  }
+  size_t number_of_tiles = tile_begins.size();
+  tile_begins.push_back(number_of_triangles);
+
+  Scalar ratio = Scalar(target_triangles) / Scalar(number_of_triangles);
+  std::vector<TriangleContainer> outputs(number_of_tiles);
+  TileWorker worker(mesh, shared, tile_triangles, tile_begins, ratio,
+                    max_squared_error, outputs);
+  hs::recon::workflow::ParallelForDynamic(0, number_of_tiles,
+                                          number_of_threads, 1, worker);
+
+  mesh.triangles.clear();
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    mesh.triangles.insert(mesh.triangles.end(), outputs[i].begin(),
+                          outputs[i].end());
+    TriangleContainer().swap(outputs[i]);
+  }
+}
+
+//Drop the vertices no triangle uses, keeping the order of the others.
+void RemoveUnusedVertices(CompactMesh& mesh)
+{
+  const Index unused = ~Index(0);
+  std::vector<Index> new_ids(mesh.vertices.size(), unused);
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      new_ids[mesh.triangles[i][k]] = 0;
+    }
+  }
+  Index number_of_vertices = 0;
+  for (size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    if (new_ids[i] == unused) continue;
+    new_ids[i] = number_of_vertices;
+    mesh.vertices[number_of_vertices++] = mesh.vertices[i];
+  }
+  mesh.vertices.resize(number_of_vertices);
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    for (int k = 0; k < 3; k++)
+    {
+      mesh.triangles[i][k] = new_ids[mesh.triangles[i][k]];
+    }
+  }
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+MeshSimplifierOptions::MeshSimplifierOptions()
+  : target_triangles(0)
+  , max_error(0)
+  , number_of_threads(1)
+{
+}
+
+MeshSimplifier::MeshSimplifier(const MeshSimplifierOptions& options)
+  : options_(options)
+{
+  options_.number_of_threads = std::max(options_.number_of_threads,
+                                        size_t(1));
+}
+
+int MeshSimplifier::operator() (CompactMesh& mesh) const
+{
+  if (options_.target_triangles == 0 && !(options_.max_error > 0))
+  {
+    return -1;
+  }
+
+  //Triangles using a vertex twice cannot be collapsed consistently.
+  size_t number_of_triangles = 0;
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    const Triangle& triangle = mesh.triangles[i];
+    if (triangle[0] >= mesh.vertices.size() ||
+        triangle[1] >= mesh.vertices.size() ||
+        triangle[2] >= mesh.vertices.size())
+    {
+      return -1;
+    }
+    if (triangle[0] == triangle[1] || triangle[1] == triangle[2] ||
+        triangle[2] == triangle[0])
+    {
+      continue;
+    }
+    mesh.triangles[number_of_triangles++] = triangle;
+  }
+  mesh.triangles.resize(number_of_triangles);
+
+  Scalar max_squared_error = options_.max_error * options_.max_error;
+  for (int round = 0; round < MAX_ROUNDS; round++)
+  {
+    size_t before = mesh.triangles.size();
+    if (before == 0 || before <= options_.target_triangles) break;
+    SimplifyTiles(options_.target_triangles, max_squared_error,
+                  round % 2 == 1, options_.number_of_threads, mesh);
+    if (Scalar(before - mesh.triangles.size()) <
+        Scalar(before) * MIN_ROUND_PROGRESS)
+    {
+      break;
+    }
+  }
+  RemoveUnusedVertices(mesh);
+  return 0;
+}
+
+std::string MeshLodPath(const std::string& mesh_path, int level)
+{
+  if (level == 0) return mesh_path;
+  char suffix[32];
+  std::sprintf(suffix, "_lod%d", level);
+  size_t separator = mesh_path.find_last_of("/\\");
+  size_t dot = mesh_path.find_last_of('.');
+  if (dot == std::string::npos ||
+      (separator != std::string::npos && dot < separator))
+  {
+    return mesh_path + suffix;
+  }
+  return mesh_path.substr(0, dot) + suffix + mesh_path.substr(dot);
+}
+
+int BuildMeshLods(const std::string& mesh_path,
+                  int number_of_lods,
+                  double lod_ratio,
+                  double max_error,
+                  size_t number_of_threads)
+{
+  CompactMesh mesh;
+  if (LoadMesh(mesh_path, mesh) != 0) return -1;
+
+  MeshSimplifierOptions options;
+  options.max_error = max_error;
+  options.number_of_threads = number_of_threads;
+  int level = 1;
+  for (; level <= number_of_lods; level++)
+  {
+    size_t number_of_triangles = mesh.triangles.size();
+    options.target_triangles =
+      size_t(Scalar(number_of_triangles) * lod_ratio);
+    if (options.target_triangles == 0) break;
+    MeshSimplifier simplifier(options);
+    if (simplifier(mesh) != 0) return -1;
+    //Levels stop once the error bound holds the mesh back.
+    if (mesh.triangles.size() == number_of_triangles) break;
+    if (SaveMesh(MeshLodPath(mesh_path, level), mesh) != 0) return -1;
+  }
+
+  //Levels left by an earlier run would be taken for this mesh.
+  for (; std::remove(MeshLodPath(mesh_path, level).c_str()) == 0; level++);
+  return 0;
+}
+
+int LoadMeshLod(const std::string& mesh_path,
+                size_t max_triangles,
+                CompactMesh& mesh)
+{
+  int level = 0;
+  size_t number_of_vertices = 0;
+  size_t number_of_triangles = 0;
+  while (ReadMeshSize(MeshLodPath(mesh_path, level), number_of_vertices,
+                      number_of_triangles) == 0 &&
+         number_of_triangles > max_triangles)
+  {
+    size_t next_vertices = 0;
+    size_t next_triangles = 0;
+    if (ReadMeshSize(MeshLodPath(mesh_path, level + 1), next_vertices,
+                     next_triangles) != 0)
+    {
+      break;
+    }
+    level++;
+  }
+  return LoadMesh(MeshLodPath(mesh_path, level), mesh);
+}
+
+}
+}
+}
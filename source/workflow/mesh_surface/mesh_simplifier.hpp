@@ -0,0 +1,75 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_MESH_SIMPLIFIER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_MESH_SIMPLIFIER_HPP_
+
+#include <string>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct HS_EXPORT MeshSimplifierOptions
+{
+  MeshSimplifierOptions();
+
+  //Stop once the mesh has at most target_triangles triangles.
+  size_t target_triangles;
+  //Largest distance a collapse may move the surface by, as estimated by
+  //the quadrics of the triangles of the input mesh. 0 does not bound it.
+  double max_error;
+  size_t number_of_threads;
+};
+
+/**
+ *  Quadric error edge collapse simplification.
+ *
+ *  The mesh is cut in spatial tiles of about the same number of triangles
+ *  and each tile collapses its own edges in parallel, cheapest first.
+ *  Vertices shared with another tile, and the mesh border, stay in place,
+ *  so the tiles do not see each other's changes. The next round shifts the
+ *  tiles by half their size to free the vertices along their seams, until
+ *  the target is reached or a round barely removes anything.
+ */
+class HS_EXPORT MeshSimplifier
+{
+public:
+  MeshSimplifier(const MeshSimplifierOptions& options);
+
+  int operator() (CompactMesh& mesh) const;
+
+private:
+  MeshSimplifierOptions options_;
+};
+
+//mesh_lod<level>.bin next to mesh_path, mesh_path itself for level 0.
+HS_EXPORT std::string MeshLodPath(const std::string& mesh_path, int level);
+
+/**
+ *  Write number_of_lods simplified meshes next to mesh_path, each level
+ *  with lod_ratio times the triangles of the previous one.
+ */
+HS_EXPORT int BuildMeshLods(const std::string& mesh_path,
+                            int number_of_lods,
+                            double lod_ratio,
+                            double max_error,
+                            size_t number_of_threads);
+
+/**
+ *  Load the finest level of detail of mesh_path with at most max_triangles
+ *  triangles, the coarsest one when none is small enough.
+ */
+HS_EXPORT int LoadMeshLod(const std::string& mesh_path,
+                          size_t max_triangles,
+                          CompactMesh& mesh);
+
+}
+}
+}
+
+#endif
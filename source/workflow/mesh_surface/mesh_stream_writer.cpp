@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <limits>
+
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
+
+namespace
+{
+
+//Vertices converted to float per batch, not all at once.
+const size_t VERTEX_BATCH_SIZE = 1 << 16;
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+MeshStreamWriter::MeshStreamWriter()
+  : number_of_triangles_(0)
+{
+}
+
+MeshStreamWriter::~MeshStreamWriter()
+{
+  Close();
+}
+
+int MeshStreamWriter::Open(const std::string& path,
+                           const VertexContainer& vertices)
+{
+  Close();
+  if (vertices.size() > size_t(std::numeric_limits<CompactMesh::Index>::max()))
+  {
+    return -1;
+  }
+  file_.open(path, std::ios::binary);
+  if (!file_) return -1;
+  archive_.reset(new cereal::PortableBinaryOutputArchive(file_));
+  CompactMesh::Position origin = CompactMeshOrigin(vertices);
+  (*archive_)(COMPACT_MESH_MAGIC, COMPACT_MESH_VERSION,
+              origin[0], origin[1], origin[2]);
+
+  //A size tag, then the raw elements.
+  uint64_t number_of_vertices = vertices.size();
+  (*archive_)(cereal::make_size_tag(number_of_vertices));
+  CompactMesh::VertexContainer batch;
+  for (size_t begin = 0; begin < vertices.size(); begin += VERTEX_BATCH_SIZE)
+  {
+    size_t end = std::min(begin + VERTEX_BATCH_SIZE, vertices.size());
+    batch.resize(end - begin);
+    for (size_t i = begin; i < end; i++)
+    {
+      batch[i - begin] =
+        (vertices[i] - origin).cast<CompactMesh::Float>();
+    }
+    (*archive_)(cereal::binary_data(batch[0].data(),
+                                    batch.size() *
+                                    sizeof(CompactMesh::Vertex)));
+  }
+
+  triangle_count_position_ = file_.tellp();
+  number_of_triangles_ = 0;
+  uint64_t number_of_triangles = 0;
+  (*archive_)(cereal::make_size_tag(number_of_triangles));
+  if (!file_)
+  {
+    archive_.reset();
+    file_.close();
+    return -1;
+  }
+  return 0;
+}
+
+int MeshStreamWriter::Append(const TriangleContainer& triangles)
+{
+  if (!archive_) return -1;
+  if (!triangles.empty())
+  {
+    (*archive_)(cereal::binary_data(triangles[0].data(),
+                                    triangles.size() * sizeof(Triangle)));
+  }
+  number_of_triangles_ += triangles.size();
+  return file_ ? 0 : -1;
+}
+
+int MeshStreamWriter::Close()
+{
+  if (!archive_) return 0;
+  file_.seekp(triangle_count_position_);
+  uint64_t number_of_triangles = number_of_triangles_;
+  (*archive_)(cereal::make_size_tag(number_of_triangles));
+  bool good = bool(file_);
+  archive_.reset();
+  file_.close();
+  return good ? 0 : -1;
+}
+
+size_t MeshStreamWriter::NumberOfTriangles() const
+{
+  return number_of_triangles_;
+}
+
+}
+}
+}
@@ -0,0 +1,62 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_MESH_STREAM_WRITER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_MESH_STREAM_WRITER_HPP_
+
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <cereal/archives/portable_binary.hpp>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes mesh.bin in the CompactMesh layout without holding the triangles:
+ *  they are appended batch by batch and their count is patched in by Close.
+ *  Read it back with LoadMesh.
+ */
+class HS_EXPORT MeshStreamWriter
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef CompactMesh::Triangle Triangle;
+  typedef CompactMesh::TriangleContainer TriangleContainer;
+
+  MeshStreamWriter();
+  ~MeshStreamWriter();
+
+  //Fails with more vertices than 32-bit ids can address.
+  int Open(const std::string& path, const VertexContainer& vertices);
+  int Append(const TriangleContainer& triangles);
+  int Close();
+
+  size_t NumberOfTriangles() const;
+
+private:
+  MeshStreamWriter(const MeshStreamWriter&);
+  MeshStreamWriter& operator=(const MeshStreamWriter&);
+
+private:
+  std::ofstream file_;
+  std::unique_ptr<cereal::PortableBinaryOutputArchive> archive_;
+  std::streampos triangle_count_position_;
+  size_t number_of_triangles_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,1223 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <vector>
+
+#include "workflow/common/morton_code.hpp"
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/mesh_surface/poisson_reconstructor.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef PoissonReconstructor::Scalar Scalar;
+typedef PoissonReconstructor::Vector3 Vector3;
+typedef PoissonReconstructor::Vector3Container Vector3Container;
+typedef PoissonReconstructor::Triangle Triangle;
+typedef PoissonReconstructor::TriangleContainer TriangleContainer;
+
+//Grids are split in bricks of BRICK_SIZE^3 nodes.
+const int BRICK_BITS = 3;
+const int BRICK_SIZE = 1 << BRICK_BITS;
+const int BRICK_MASK = BRICK_SIZE - 1;
+const size_t BRICK_NODES = BRICK_SIZE * BRICK_SIZE * BRICK_SIZE;
+//Depth of the coarsest grid.
+const int MIN_SOLVE_DEPTH = 2;
+//Depth of the finest grid whose brick table still fits in memory.
+const int MAX_SOLVE_DEPTH = 11;
+//Iterations on a grid at most, unless min_iterations asks for more.
+const int MAX_SOLVER_ITERATIONS = 200;
+//Items handed to a thread at once.
+const size_t BRICK_BLOCK = 8;
+const size_t CELL_BLOCK = 4096;
+const size_t SAMPLE_BLOCK = 1 << 16;
+//Bits of each coordinate of a packed cell.
+const int CELL_BITS = 21;
+const uint64_t CELL_MASK = (uint64_t(1) << CELL_BITS) - 1;
+
+const int NEIGHBOURS[6][3] =
+{
+  {-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}
+};
+
+//Kuhn split of a cube along its main diagonal, corner bits are x, y, z.
+//Every edge joins a corner to one of its supersets, and the split of a
+//face matches the one of the neighbouring cube.
+const int TETRAHEDRA[6][4] =
+{
+  {0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7},
+  {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}
+};
+
+struct Sample
+{
+  //Morton code of the finest cell.
+  uint64_t code;
+  //In node units of the finest grid.
+  float position[3];
+  //Scaled by the weight.
+  float normal[3];
+  float weight;
+};
+
+bool LessCode(const Sample& a, const Sample& b)
+{
+  return a.code < b.code;
+}
+
+//Samples of a brick, contiguous once sorted by code.
+struct SampleRun
+{
+  size_t brick;
+  size_t begin;
+  size_t end;
+  //Cells holding samples, and holding samples_per_node of them.
+  size_t cells;
+  size_t dense_cells;
+};
+
+struct Level
+{
+  int BrickId(int x, int y, int z) const
+  {
+    size_t n = size_t(bricks_per_axis);
+    return brick_ids[(size_t(z >> BRICK_BITS) * n +
+                      size_t(y >> BRICK_BITS)) * n +
+                     size_t(x >> BRICK_BITS)];
+  }
+
+  void BrickOrigin(size_t brick_id, int& x, int& y, int& z) const
+  {
+    size_t n = size_t(bricks_per_axis);
+    size_t brick = bricks[brick_id];
+    x = int(brick % n) * BRICK_SIZE;
+    y = int(brick / n % n) * BRICK_SIZE;
+    z = int(brick / (n * n)) * BRICK_SIZE;
+  }
+
+  int depth;
+  int resolution;
+  int bricks_per_axis;
+  //Index in bricks of each brick of the grid, -1 when not solved.
+  std::vector<int> brick_ids;
+  std::vector<size_t> bricks;
+  //BRICK_NODES values per solved brick.
+  std::vector<float> solution;
+};
+
+typedef std::vector<Level> LevelContainer;
+
+inline size_t NodeOffset(int x, int y, int z)
+{
+  return size_t(((z & BRICK_MASK) * BRICK_SIZE + (y & BRICK_MASK)) *
+                BRICK_SIZE + (x & BRICK_MASK));
+}
+
+inline bool InGrid(int resolution, int x, int y, int z)
+{
+  return x >= 0 && y >= 0 && z >= 0 &&
+         x <= resolution && y <= resolution && z <= resolution;
+}
+
+//Value of a vector of level at node (x, y, z), 0 in bricks not solved.
+inline Scalar BrickValue(const Level& level, const std::vector<float>& values,
+                         int x, int y, int z)
+{
+  int brick_id = level.BrickId(x, y, z);
+  if (brick_id < 0) return 0;
+  return values[size_t(brick_id) * BRICK_NODES + NodeOffset(x, y, z)];
+}
+
+Scalar Interpolate(const LevelContainer& levels, size_t l,
+                   Scalar x, Scalar y, Scalar z);
+
+/**
+ *  Solution at node (x, y, z) of grid l, interpolated from the coarser
+ *  grid when its brick is not solved.
+ */
+Scalar NodeValue(const LevelContainer& levels, size_t l, int x, int y, int z)
+{
+  const Level& level = levels[l];
+  int brick_id = level.BrickId(x, y, z);
+  if (brick_id >= 0)
+  {
+    return level.solution[size_t(brick_id) * BRICK_NODES +
+                          NodeOffset(x, y, z)];
+  }
+  if (l == 0) return 0;
+  return Interpolate(levels, l - 1, Scalar(x) * 0.5, Scalar(y) * 0.5,
+                     Scalar(z) * 0.5);
+}
+
+/**
+ *  Trilinear solution at (x, y, z), in node units of grid l. A cell with
+ *  no solved corner lies in a single coarser cell and is looked up there.
+ */
+Scalar Interpolate(const LevelContainer& levels, size_t l,
+                   Scalar x, Scalar y, Scalar z)
+{
+  const Level& level = levels[l];
+  int last = level.resolution - 1;
+  int x0 = std::min(std::max(int(std::floor(x)), 0), last);
+  int y0 = std::min(std::max(int(std::floor(y)), 0), last);
+  int z0 = std::min(std::max(int(std::floor(z)), 0), last);
+  Scalar fx = std::min(std::max(x - Scalar(x0), Scalar(0)), Scalar(1));
+  Scalar fy = std::min(std::max(y - Scalar(y0), Scalar(0)), Scalar(1));
+  Scalar fz = std::min(std::max(z - Scalar(z0), Scalar(0)), Scalar(1));
+
+  int brick_ids[8];
+  bool solved = false;
+  for (int c = 0; c < 8; c++)
+  {
+    brick_ids[c] = level.BrickId(x0 + (c & 1), y0 + (c >> 1 & 1),
+                                 z0 + (c >> 2));
+    solved = solved || brick_ids[c] >= 0;
+  }
+  if (!solved && l > 0)
+  {
+    return Interpolate(levels, l - 1, x * 0.5, y * 0.5, z * 0.5);
+  }
+
+  Scalar values[8];
+  for (int c = 0; c < 8; c++)
+  {
+    int cx = x0 + (c & 1);
+    int cy = y0 + (c >> 1 & 1);
+    int cz = z0 + (c >> 2);
+    values[c] = brick_ids[c] >= 0 ?
+                level.solution[size_t(brick_ids[c]) * BRICK_NODES +
+                               NodeOffset(cx, cy, cz)] :
+                NodeValue(levels, l, cx, cy, cz);
+  }
+  Scalar v00 = values[0] + (values[1] - values[0]) * fx;
+  Scalar v10 = values[2] + (values[3] - values[2]) * fx;
+  Scalar v01 = values[4] + (values[5] - values[4]) * fx;
+  Scalar v11 = values[6] + (values[7] - values[6]) * fx;
+  Scalar v0 = v00 + (v10 - v00) * fy;
+  Scalar v1 = v01 + (v11 - v01) * fy;
+  return v0 + (v1 - v0) * fz;
+}
+
+/**
+ *  Group the samples by brick of level and count the cells they fill.
+ */
+void FindSampleRuns(const std::vector<Sample>& samples, const Level& level,
+                    int max_depth, Scalar samples_per_node,
+                    std::vector<SampleRun>& runs)
+{
+  int cell_shift = 3 * (max_depth - level.depth);
+  int brick_shift = cell_shift + 3 * BRICK_BITS;
+  int position_shift = max_depth - level.depth + BRICK_BITS;
+  int last_cell = (1 << max_depth) - 1;
+  size_t n = size_t(level.bricks_per_axis);
+
+  runs.clear();
+  size_t begin = 0;
+  while (begin < samples.size())
+  {
+    const Sample& first = samples[begin];
+    uint64_t brick_code = first.code >> brick_shift;
+    SampleRun run;
+    size_t bx = size_t(std::min(int(first.position[0]), last_cell) >>
+                       position_shift);
+    size_t by = size_t(std::min(int(first.position[1]), last_cell) >>
+                       position_shift);
+    size_t bz = size_t(std::min(int(first.position[2]), last_cell) >>
+                       position_shift);
+    run.brick = (bz * n + by) * n + bx;
+    run.begin = begin;
+    run.cells = 0;
+    run.dense_cells = 0;
+    size_t end = begin;
+    while (end < samples.size() && samples[end].code >> brick_shift ==
+                                   brick_code)
+    {
+      uint64_t cell_code = samples[end].code >> cell_shift;
+      size_t cell_end = end;
+      while (cell_end < samples.size() &&
+             samples[cell_end].code >> cell_shift == cell_code)
+      {
+        cell_end++;
+      }
+      run.cells++;
+      if (Scalar(cell_end - end) >= samples_per_node) run.dense_cells++;
+      end = cell_end;
+    }
+    run.end = end;
+    runs.push_back(run);
+    begin = end;
+  }
+}
+
+/**
+ *  Solve every brick of a dense level. Otherwise solve the bricks where at
+ *  least a row of cells is dense enough, and their neighbours so that
+ *  their samples are splatted whole.
+ */
+void SelectBricks(const std::vector<SampleRun>& runs, bool dense,
+                  Level& level)
+{
+  int n = level.bricks_per_axis;
+  size_t number_of_bricks = size_t(n) * size_t(n) * size_t(n);
+  level.brick_ids.assign(number_of_bricks, dense ? 0 : -1);
+  if (!dense)
+  {
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+      if (runs[i].dense_cells < size_t(BRICK_SIZE)) continue;
+      int bx = int(runs[i].brick % size_t(n));
+      int by = int(runs[i].brick / size_t(n) % size_t(n));
+      int bz = int(runs[i].brick / (size_t(n) * size_t(n)));
+      for (int z = std::max(bz - 1, 0); z <= std::min(bz + 1, n - 1); z++)
+      {
+        for (int y = std::max(by - 1, 0); y <= std::min(by + 1, n - 1); y++)
+        {
+          for (int x = std::max(bx - 1, 0); x <= std::min(bx + 1, n - 1);
+               x++)
+          {
+            level.brick_ids[(size_t(z) * n + y) * n + x] = 0;
+          }
+        }
+      }
+    }
+  }
+  level.bricks.clear();
+  for (size_t brick = 0; brick < number_of_bricks; brick++)
+  {
+    if (level.brick_ids[brick] < 0) continue;
+    level.brick_ids[brick] = int(level.bricks.size());
+    level.bricks.push_back(brick);
+  }
+}
+
+/**
+ *  Splat the samples of a set of runs: the screening weights to the corners
+ *  of their cell, the normals to the edges around them, as the divergence
+ *  of the normal field. Runs of bricks two apart touch disjoint nodes.
+ */
+struct SplatWorker
+{
+  SplatWorker(const std::vector<Sample>& samples_,
+              const std::vector<SampleRun>& runs_,
+              const std::vector<size_t>& run_ids_,
+              const Level& level_,
+              Scalar to_level_,
+              Scalar normal_scale_,
+              Scalar screening_,
+              std::vector<float>& rhs_,
+              std::vector<float>& screen_)
+    : samples(samples_)
+    , runs(runs_)
+    , run_ids(run_ids_)
+    , level(level_)
+    , to_level(to_level_)
+    , normal_scale(normal_scale_)
+    , screening(screening_)
+    , rhs(rhs_)
+    , screen(screen_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      const SampleRun& run = runs[run_ids[i]];
+      if (level.brick_ids[run.brick] < 0) continue;
+      for (size_t k = run.begin; k < run.end; k++)
+      {
+        Splat(samples[k]);
+      }
+    }
+  }
+
+  void Add(std::vector<float>& values, const int* node, Scalar value)
+  {
+    int brick_id = level.BrickId(node[0], node[1], node[2]);
+    if (brick_id < 0) return;
+    values[size_t(brick_id) * BRICK_NODES +
+           NodeOffset(node[0], node[1], node[2])] += float(value);
+  }
+
+  void Splat(const Sample& sample)
+  {
+    int resolution = level.resolution;
+    Scalar u[3];
+    for (int a = 0; a < 3; a++)
+    {
+      u[a] = Scalar(sample.position[a]) * to_level;
+    }
+
+    int cell[3];
+    Scalar f[3];
+    for (int a = 0; a < 3; a++)
+    {
+      cell[a] = std::min(int(u[a]), resolution - 1);
+      f[a] = u[a] - Scalar(cell[a]);
+    }
+    for (int c = 0; c < 8; c++)
+    {
+      int node[3];
+      Scalar weight = 1;
+      for (int a = 0; a < 3; a++)
+      {
+        int bit = c >> a & 1;
+        node[a] = cell[a] + bit;
+        weight *= bit ? f[a] : 1 - f[a];
+      }
+      Add(screen, node, screening * Scalar(sample.weight) * weight);
+    }
+
+    //Edges along axis a have their middle half a node further along a.
+    for (int a = 0; a < 3; a++)
+    {
+      int base[3];
+      Scalar g[3];
+      for (int b = 0; b < 3; b++)
+      {
+        Scalar v = b == a ? u[b] - Scalar(0.5) : u[b];
+        base[b] = int(std::floor(v));
+        g[b] = v - Scalar(base[b]);
+      }
+      Scalar component = normal_scale * Scalar(sample.normal[a]);
+      for (int c = 0; c < 8; c++)
+      {
+        int lower[3];
+        Scalar weight = 1;
+        for (int b = 0; b < 3; b++)
+        {
+          int bit = c >> b & 1;
+          lower[b] = base[b] + bit;
+          weight *= bit ? g[b] : 1 - g[b];
+        }
+        int upper[3] = {lower[0], lower[1], lower[2]};
+        upper[a]++;
+        if (!InGrid(resolution, lower[0], lower[1], lower[2]) ||
+            !InGrid(resolution, upper[0], upper[1], upper[2]))
+        {
+          continue;
+        }
+        Add(rhs, lower, -component * weight);
+        Add(rhs, upper, component * weight);
+      }
+    }
+  }
+
+  const std::vector<Sample>& samples;
+  const std::vector<SampleRun>& runs;
+  const std::vector<size_t>& run_ids;
+  const Level& level;
+  Scalar to_level;
+  Scalar normal_scale;
+  Scalar screening;
+  std::vector<float>& rhs;
+  std::vector<float>& screen;
+};
+
+/**
+ *  Start the solved bricks of level l from the coarser solution, and move
+ *  the values of the neighbours not solved, fixed to the coarser solution,
+ *  to the right hand side.
+ */
+struct BoundaryWorker
+{
+  BoundaryWorker(LevelContainer& levels_, size_t l_,
+                 std::vector<float>& rhs_)
+    : levels(levels_), l(l_), rhs(rhs_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    Level& level = levels[l];
+    int resolution = level.resolution;
+    for (size_t b = begin; b < end; b++)
+    {
+      int ox, oy, oz;
+      level.BrickOrigin(b, ox, oy, oz);
+      for (int k = 0; k < BRICK_SIZE; k++)
+      {
+        for (int j = 0; j < BRICK_SIZE; j++)
+        {
+          for (int i = 0; i < BRICK_SIZE; i++)
+          {
+            int x = ox + i;
+            int y = oy + j;
+            int z = oz + k;
+            if (!InGrid(resolution, x, y, z)) continue;
+            size_t node = b * BRICK_NODES + NodeOffset(x, y, z);
+            if (l > 0)
+            {
+              level.solution[node] = float(Interpolate(
+                levels, l - 1, Scalar(x) * 0.5, Scalar(y) * 0.5,
+                Scalar(z) * 0.5));
+            }
+            Scalar fixed = 0;
+            for (int d = 0; d < 6; d++)
+            {
+              int nx = x + NEIGHBOURS[d][0];
+              int ny = y + NEIGHBOURS[d][1];
+              int nz = z + NEIGHBOURS[d][2];
+              if (!InGrid(resolution, nx, ny, nz)) continue;
+              if (level.BrickId(nx, ny, nz) >= 0) continue;
+              fixed += NodeValue(levels, l, nx, ny, nz);
+            }
+            rhs[node] += float(fixed);
+          }
+        }
+      }
+    }
+  }
+
+  LevelContainer& levels;
+  size_t l;
+  std::vector<float>& rhs;
+};
+
+/**
+ *  output = A input on the solved nodes, A the graph Laplacian of the grid
+ *  plus the screening. Neighbours not solved count as 0, their fixed values
+ *  are in the right hand side. Stores input . output per brick.
+ */
+struct LaplacianWorker
+{
+  LaplacianWorker(const Level& level_, const std::vector<float>& screen_,
+                  const std::vector<float>& input_,
+                  std::vector<float>& output_, std::vector<double>& dots_)
+    : level(level_), screen(screen_), input(input_), output(output_),
+      dots(dots_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    int resolution = level.resolution;
+    for (size_t b = begin; b < end; b++)
+    {
+      int ox, oy, oz;
+      level.BrickOrigin(b, ox, oy, oz);
+      double dot = 0;
+      for (int k = 0; k < BRICK_SIZE; k++)
+      {
+        for (int j = 0; j < BRICK_SIZE; j++)
+        {
+          for (int i = 0; i < BRICK_SIZE; i++)
+          {
+            int x = ox + i;
+            int y = oy + j;
+            int z = oz + k;
+            if (!InGrid(resolution, x, y, z)) continue;
+            size_t node = b * BRICK_NODES + NodeOffset(x, y, z);
+            Scalar sum = 0;
+            int degree = 0;
+            for (int d = 0; d < 6; d++)
+            {
+              int nx = x + NEIGHBOURS[d][0];
+              int ny = y + NEIGHBOURS[d][1];
+              int nz = z + NEIGHBOURS[d][2];
+              if (!InGrid(resolution, nx, ny, nz)) continue;
+              degree++;
+              sum += BrickValue(level, input, nx, ny, nz);
+            }
+            Scalar value =
+              (Scalar(degree) + Scalar(screen[node])) * input[node] - sum;
+            output[node] = float(value);
+            dot += double(input[node]) * value;
+          }
+        }
+      }
+      dots[b] = dot;
+    }
+  }
+
+  const Level& level;
+  const std::vector<float>& screen;
+  const std::vector<float>& input;
+  std::vector<float>& output;
+  std::vector<double>& dots;
+};
+
+//residual = rhs - product, direction = residual, stores |residual|^2.
+struct ResidualWorker
+{
+  ResidualWorker(const std::vector<float>& rhs_,
+                 const std::vector<float>& product_,
+                 std::vector<float>& residual_,
+                 std::vector<float>& direction_,
+                 std::vector<double>& dots_)
+    : rhs(rhs_), product(product_), residual(residual_),
+      direction(direction_), dots(dots_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t b = begin; b < end; b++)
+    {
+      double dot = 0;
+      for (size_t node = b * BRICK_NODES; node < (b + 1) * BRICK_NODES;
+           node++)
+      {
+        residual[node] = rhs[node] - product[node];
+        direction[node] = residual[node];
+        dot += double(residual[node]) * double(residual[node]);
+      }
+      dots[b] = dot;
+    }
+  }
+
+  const std::vector<float>& rhs;
+  const std::vector<float>& product;
+  std::vector<float>& residual;
+  std::vector<float>& direction;
+  std::vector<double>& dots;
+};
+
+//Conjugate gradient step, stores |residual|^2.
+struct StepWorker
+{
+  StepWorker(Scalar alpha_, const std::vector<float>& direction_,
+             const std::vector<float>& product_,
+             std::vector<float>& solution_, std::vector<float>& residual_,
+             std::vector<double>& dots_)
+    : alpha(alpha_), direction(direction_), product(product_),
+      solution(solution_), residual(residual_), dots(dots_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t b = begin; b < end; b++)
+    {
+      double dot = 0;
+      for (size_t node = b * BRICK_NODES; node < (b + 1) * BRICK_NODES;
+           node++)
+      {
+        solution[node] += float(alpha * direction[node]);
+        residual[node] -= float(alpha * product[node]);
+        dot += double(residual[node]) * double(residual[node]);
+      }
+      dots[b] = dot;
+    }
+  }
+
+  Scalar alpha;
+  const std::vector<float>& direction;
+  const std::vector<float>& product;
+  std::vector<float>& solution;
+  std::vector<float>& residual;
+  std::vector<double>& dots;
+};
+
+struct DirectionWorker
+{
+  DirectionWorker(Scalar beta_, const std::vector<float>& residual_,
+                  std::vector<float>& direction_)
+    : beta(beta_), residual(residual_), direction(direction_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t node = begin * BRICK_NODES; node < end * BRICK_NODES; node++)
+    {
+      direction[node] = float(residual[node] + beta * direction[node]);
+    }
+  }
+
+  Scalar beta;
+  const std::vector<float>& residual;
+  std::vector<float>& direction;
+};
+
+//Summed in brick order, the same whatever the number of threads.
+double Sum(const std::vector<double>& values)
+{
+  double sum = 0;
+  for (size_t i = 0; i < values.size(); i++)
+  {
+    sum += values[i];
+  }
+  return sum;
+}
+
+void SolveLevel(const Level& level, const std::vector<float>& screen,
+                const std::vector<float>& rhs, int min_iterations,
+                Scalar accuracy, size_t number_of_threads,
+                std::vector<float>& solution)
+{
+  size_t number_of_bricks = level.bricks.size();
+  if (number_of_bricks == 0) return;
+  size_t number_of_nodes = number_of_bricks * BRICK_NODES;
+  std::vector<float> residual(number_of_nodes, 0.0f);
+  std::vector<float> direction(number_of_nodes, 0.0f);
+  std::vector<float> product(number_of_nodes, 0.0f);
+  std::vector<double> dots(number_of_bricks, 0.0);
+
+  LaplacianWorker initial_worker(level, screen, solution, product, dots);
+  ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                     initial_worker);
+  ResidualWorker residual_worker(rhs, product, residual, direction, dots);
+  ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                     residual_worker);
+  double squared_norm = Sum(dots);
+  double initial_norm = std::sqrt(squared_norm);
+
+  int max_iterations = std::max(min_iterations, MAX_SOLVER_ITERATIONS);
+  for (int iteration = 0; iteration < max_iterations; iteration++)
+  {
+    if (squared_norm <= 0) break;
+    if (iteration >= min_iterations &&
+        std::sqrt(squared_norm) <= accuracy * initial_norm)
+    {
+      break;
+    }
+    LaplacianWorker laplacian_worker(level, screen, direction, product, dots);
+    ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                       laplacian_worker);
+    double curvature = Sum(dots);
+    if (curvature <= 0) break;
+    StepWorker step_worker(Scalar(squared_norm / curvature), direction,
+                           product, solution, residual, dots);
+    ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                       step_worker);
+    double next_squared_norm = Sum(dots);
+    DirectionWorker direction_worker(
+      Scalar(next_squared_norm / squared_norm), residual, direction);
+    ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                       direction_worker);
+    squared_norm = next_squared_norm;
+  }
+}
+
+//Weighted sums of the finest solution at the samples, per block.
+struct IsoValueWorker
+{
+  IsoValueWorker(const LevelContainer& levels_,
+                 const std::vector<Sample>& samples_,
+                 std::vector<double>& sums_)
+    : levels(levels_), samples(samples_), sums(sums_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t block = begin; block < end; block++)
+    {
+      double sum = 0;
+      size_t sample_end = std::min((block + 1) * SAMPLE_BLOCK,
+                                   samples.size());
+      for (size_t i = block * SAMPLE_BLOCK; i < sample_end; i++)
+      {
+        const Sample& sample = samples[i];
+        sum += double(sample.weight) *
+               Interpolate(levels, levels.size() - 1, sample.position[0],
+                           sample.position[1], sample.position[2]);
+      }
+      sums[block] = sum;
+    }
+  }
+
+  const LevelContainer& levels;
+  const std::vector<Sample>& samples;
+  std::vector<double>& sums;
+};
+
+inline uint64_t PackCell(int x, int y, int z)
+{
+  return uint64_t(x) | uint64_t(y) << CELL_BITS | uint64_t(z) << 2 * CELL_BITS;
+}
+
+inline void UnpackCell(uint64_t cell, int& x, int& y, int& z)
+{
+  x = int(cell & CELL_MASK);
+  y = int(cell >> CELL_BITS & CELL_MASK);
+  z = int(cell >> 2 * CELL_BITS & CELL_MASK);
+}
+
+//Flags the cells of grid l with corners on both sides of iso_value.
+struct CrossingWorker
+{
+  CrossingWorker(const LevelContainer& levels_, size_t l_,
+                 const std::vector<uint64_t>& cells_, Scalar iso_value_,
+                 std::vector<char>& crossing_)
+    : levels(levels_), l(l_), cells(cells_), iso_value(iso_value_),
+      crossing(crossing_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      int x, y, z;
+      UnpackCell(cells[i], x, y, z);
+      int above = 0;
+      for (int c = 0; c < 8; c++)
+      {
+        if (NodeValue(levels, l, x + (c & 1), y + (c >> 1 & 1),
+                      z + (c >> 2)) > iso_value)
+        {
+          above++;
+        }
+      }
+      crossing[i] = above > 0 && above < 8;
+    }
+  }
+
+  const LevelContainer& levels;
+  size_t l;
+  const std::vector<uint64_t>& cells;
+  Scalar iso_value;
+  std::vector<char>& crossing;
+};
+
+/**
+ *  Children of the crossing cells and of their face neighbours, which
+ *  catches most of the surface bending out of a coarse cell.
+ */
+void RefineCells(const std::vector<uint64_t>& crossing_cells, int resolution,
+                 std::vector<uint64_t>& children)
+{
+  std::vector<uint64_t> cells;
+  cells.reserve(crossing_cells.size() * 7);
+  for (size_t i = 0; i < crossing_cells.size(); i++)
+  {
+    int x, y, z;
+    UnpackCell(crossing_cells[i], x, y, z);
+    cells.push_back(crossing_cells[i]);
+    for (int d = 0; d < 6; d++)
+    {
+      int nx = x + NEIGHBOURS[d][0];
+      int ny = y + NEIGHBOURS[d][1];
+      int nz = z + NEIGHBOURS[d][2];
+      if (nx < 0 || ny < 0 || nz < 0 ||
+          nx >= resolution || ny >= resolution || nz >= resolution)
+      {
+        continue;
+      }
+      cells.push_back(PackCell(nx, ny, nz));
+    }
+  }
+  std::sort(cells.begin(), cells.end());
+  cells.erase(std::unique(cells.begin(), cells.end()), cells.end());
+
+  children.clear();
+  children.reserve(cells.size() * 8);
+  for (size_t i = 0; i < cells.size(); i++)
+  {
+    int x, y, z;
+    UnpackCell(cells[i], x, y, z);
+    for (int c = 0; c < 8; c++)
+    {
+      children.push_back(PackCell(2 * x + (c & 1), 2 * y + (c >> 1 & 1),
+                                  2 * z + (c >> 2)));
+    }
+  }
+  std::sort(children.begin(), children.end());
+}
+
+struct EdgeVertex
+{
+  //Lower node of the edge times 8 plus the axes it steps along.
+  uint64_t key;
+  //In node units of the finest grid.
+  float position[3];
+};
+
+bool LessKey(const EdgeVertex& a, const EdgeVertex& b)
+{
+  return a.key < b.key;
+}
+
+bool EqualKey(const EdgeVertex& a, const EdgeVertex& b)
+{
+  return a.key == b.key;
+}
+
+typedef std::array<uint64_t, 3> KeyTriangle;
+
+/**
+ *  Marching tetrahedra on blocks of crossing cells of the finest grid.
+ *  Triangles face the side above iso_value, where the normals point.
+ */
+struct TetrahedraWorker
+{
+  TetrahedraWorker(const LevelContainer& levels_,
+                   const std::vector<uint64_t>& cells_,
+                   Scalar iso_value_,
+                   std::vector<std::vector<EdgeVertex> >& block_vertices_,
+                   std::vector<std::vector<KeyTriangle> >& block_triangles_)
+    : levels(levels_), cells(cells_), iso_value(iso_value_),
+      block_vertices(block_vertices_), block_triangles(block_triangles_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t block = begin; block < end; block++)
+    {
+      std::vector<EdgeVertex>& vertices = block_vertices[block];
+      std::vector<KeyTriangle>& triangles = block_triangles[block];
+      size_t cell_end = std::min((block + 1) * CELL_BLOCK, cells.size());
+      for (size_t i = block * CELL_BLOCK; i < cell_end; i++)
+      {
+        Polygonize(cells[i], vertices, triangles);
+      }
+      std::sort(vertices.begin(), vertices.end(), LessKey);
+      vertices.erase(std::unique(vertices.begin(), vertices.end(), EqualKey),
+                     vertices.end());
+    }
+  }
+
+  EdgeVertex MakeVertex(int x, int y, int z, const Scalar* values,
+                        int i, int j) const
+  {
+    int lower = (i & j) == i ? i : j;
+    int upper = lower == i ? j : i;
+    int lx = x + (lower & 1);
+    int ly = y + (lower >> 1 & 1);
+    int lz = z + (lower >> 2);
+    uint64_t nodes_per_axis = uint64_t(levels.back().resolution) + 1;
+    EdgeVertex vertex;
+    vertex.key = ((uint64_t(lz) * nodes_per_axis + uint64_t(ly)) *
+                  nodes_per_axis + uint64_t(lx)) * 8 + uint64_t(lower ^ upper);
+    Scalar t = (iso_value - values[lower]) / (values[upper] - values[lower]);
+    int step = lower ^ upper;
+    vertex.position[0] = float(Scalar(lx) + ((step & 1) ? t : Scalar(0)));
+    vertex.position[1] = float(Scalar(ly) + ((step & 2) ? t : Scalar(0)));
+    vertex.position[2] = float(Scalar(lz) + ((step & 4) ? t : Scalar(0)));
+    return vertex;
+  }
+
+  void AddTriangle(const EdgeVertex& a, const EdgeVertex& b,
+                   const EdgeVertex& c, const Vector3& outside,
+                   std::vector<EdgeVertex>& vertices,
+                   std::vector<KeyTriangle>& triangles) const
+  {
+    Vector3 pa(a.position[0], a.position[1], a.position[2]);
+    Vector3 pb(b.position[0], b.position[1], b.position[2]);
+    Vector3 pc(c.position[0], c.position[1], c.position[2]);
+    Vector3 normal = (pb - pa).cross(pc - pa);
+    Scalar facing = normal.dot(outside);
+    if (facing == 0) return;
+    KeyTriangle triangle = {{a.key, b.key, c.key}};
+    if (facing < 0) std::swap(triangle[1], triangle[2]);
+    triangles.push_back(triangle);
+    vertices.push_back(a);
+    vertices.push_back(b);
+    vertices.push_back(c);
+  }
+
+  void Polygonize(uint64_t cell, std::vector<EdgeVertex>& vertices,
+                  std::vector<KeyTriangle>& triangles) const
+  {
+    int x, y, z;
+    UnpackCell(cell, x, y, z);
+    Scalar values[8];
+    for (int c = 0; c < 8; c++)
+    {
+      values[c] = NodeValue(levels, levels.size() - 1, x + (c & 1),
+                            y + (c >> 1 & 1), z + (c >> 2));
+    }
+
+    for (int t = 0; t < 6; t++)
+    {
+      int above[4];
+      int below[4];
+      int number_above = 0;
+      int number_below = 0;
+      Vector3 above_sum = Vector3::Zero();
+      Vector3 below_sum = Vector3::Zero();
+      for (int v = 0; v < 4; v++)
+      {
+        int corner = TETRAHEDRA[t][v];
+        Vector3 position(corner & 1, corner >> 1 & 1, corner >> 2);
+        if (values[corner] > iso_value)
+        {
+          above[number_above++] = corner;
+          above_sum += position;
+        }
+        else
+        {
+          below[number_below++] = corner;
+          below_sum += position;
+        }
+      }
+      if (number_above == 0 || number_above == 4) continue;
+      //The field grows from the mean corner below to the mean one above.
+      Vector3 outside = above_sum / Scalar(number_above) -
+                        below_sum / Scalar(number_below);
+
+      if (number_above == 1 || number_above == 3)
+      {
+        int apex = number_above == 1 ? above[0] : below[0];
+        const int* base = number_above == 1 ? below : above;
+        AddTriangle(MakeVertex(x, y, z, values, apex, base[0]),
+                    MakeVertex(x, y, z, values, apex, base[1]),
+                    MakeVertex(x, y, z, values, apex, base[2]),
+                    outside, vertices, triangles);
+      }
+      else
+      {
+        EdgeVertex quad[4] =
+        {
+          MakeVertex(x, y, z, values, above[0], below[0]),
+          MakeVertex(x, y, z, values, above[0], below[1]),
+          MakeVertex(x, y, z, values, above[1], below[1]),
+          MakeVertex(x, y, z, values, above[1], below[0])
+        };
+        AddTriangle(quad[0], quad[1], quad[2], outside, vertices, triangles);
+        AddTriangle(quad[0], quad[2], quad[3], outside, vertices, triangles);
+      }
+    }
+  }
+
+  const LevelContainer& levels;
+  const std::vector<uint64_t>& cells;
+  Scalar iso_value;
+  std::vector<std::vector<EdgeVertex> >& block_vertices;
+  std::vector<std::vector<KeyTriangle> >& block_triangles;
+};
+
+struct IndexWorker
+{
+  IndexWorker(const std::vector<EdgeVertex>& vertices_,
+              const std::vector<KeyTriangle>& key_triangles_,
+              TriangleContainer& triangles_)
+    : vertices(vertices_), key_triangles(key_triangles_),
+      triangles(triangles_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    EdgeVertex probe;
+    for (size_t i = begin; i < end; i++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        probe.key = key_triangles[i][k];
+        triangles[i][k] = Triangle::value_type(
+          std::lower_bound(vertices.begin(), vertices.end(), probe, LessKey) -
+          vertices.begin());
+      }
+    }
+  }
+
+  const std::vector<EdgeVertex>& vertices;
+  const std::vector<KeyTriangle>& key_triangles;
+  TriangleContainer& triangles;
+};
+
+}
+
+PoissonReconstructorOptions::PoissonReconstructorOptions()
+  : depth(8)
+  , min_depth(5)
+  , samples_per_node(1)
+  , point_weight(4)
+  , cube_ratio(1.1f)
+  , min_iterations(8)
+  , solver_accuracy(0.001f)
+  , use_confidence(false)
+  , number_of_threads(1)
+{
+}
+
+PoissonReconstructor::PoissonReconstructor(
+  const PoissonReconstructorOptions& options)
+  : options_(options)
+{
+  options_.number_of_threads = std::max(options_.number_of_threads,
+                                        size_t(1));
+}
+
+int PoissonReconstructor::operator() (const Vector3Container& points,
+                                      const Vector3Container& normals,
+                                      Vector3Container& vertices,
+                                      TriangleContainer& triangles) const
+{
+  vertices.clear();
+  triangles.clear();
+  if (points.empty() || points.size() != normals.size()) return -1;
+  size_t number_of_threads = options_.number_of_threads;
+  int max_depth = std::min(std::max(options_.depth, MIN_SOLVE_DEPTH),
+                           MAX_SOLVE_DEPTH);
+  int min_depth = std::min(std::max(options_.min_depth, MIN_SOLVE_DEPTH),
+                           max_depth);
+  int resolution = 1 << max_depth;
+
+  //The bounding cube, centred on the samples.
+  Vector3 box_min = points[0];
+  Vector3 box_max = points[0];
+  for (size_t i = 1; i < points.size(); i++)
+  {
+    box_min = box_min.cwiseMin(points[i]);
+    box_max = box_max.cwiseMax(points[i]);
+  }
+  Scalar extent = (box_max - box_min).maxCoeff();
+  if (!(extent > 0)) return -1;
+  Scalar cube_size =
+    extent * std::max(Scalar(options_.cube_ratio), Scalar(1));
+  Vector3 cube_min = (box_min + box_max) * 0.5 -
+                     Vector3::Constant(cube_size * 0.5);
+  Scalar to_grid = Scalar(resolution) / cube_size;
+
+  std::vector<Sample> samples;
+  samples.reserve(points.size());
+  double total_weight = 0;
+  for (size_t i = 0; i < points.size(); i++)
+  {
+    Scalar length = normals[i].norm();
+    if (!(length > 0)) continue;
+    Scalar weight = options_.use_confidence ? length : Scalar(1);
+    Vector3 position = (points[i] - cube_min) * to_grid;
+    Vector3 normal = normals[i] * (weight / length);
+    Sample sample;
+    uint32_t cell[3];
+    for (int a = 0; a < 3; a++)
+    {
+      sample.position[a] = float(std::min(std::max(position[a], Scalar(0)),
+                                          Scalar(resolution)));
+      sample.normal[a] = float(normal[a]);
+      cell[a] = uint32_t(std::min(int(sample.position[a]), resolution - 1));
+    }
+    sample.weight = float(weight);
+    sample.code = MortonCode(cell[0], cell[1], cell[2]);
+    samples.push_back(sample);
+    total_weight += weight;
+  }
+  if (!(total_weight > 0)) return -1;
+  std::sort(samples.begin(), samples.end(), LessCode);
+
+  //Coarse to fine, each grid starting from the previous solution.
+  LevelContainer levels;
+  levels.reserve(size_t(max_depth - MIN_SOLVE_DEPTH + 1));
+  std::vector<SampleRun> runs;
+  for (int depth = MIN_SOLVE_DEPTH; depth <= max_depth; depth++)
+  {
+    size_t l = levels.size();
+    levels.push_back(Level());
+    Level& level = levels.back();
+    level.depth = depth;
+    level.resolution = 1 << depth;
+    level.bricks_per_axis = (level.resolution + BRICK_SIZE) / BRICK_SIZE;
+    FindSampleRuns(samples, level, max_depth,
+                   Scalar(options_.samples_per_node), runs);
+    SelectBricks(runs, depth <= min_depth, level);
+    size_t number_of_bricks = level.bricks.size();
+    level.solution.assign(number_of_bricks * BRICK_NODES, 0.0f);
+
+    //Each sample stands for the surface area of a filled cell shared by
+    //the samples in it.
+    size_t cells = 0;
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+      cells += runs[i].cells;
+    }
+    Scalar area_per_weight = Scalar(cells) / Scalar(total_weight);
+    std::vector<float> rhs(level.solution.size(), 0.0f);
+    std::vector<float> screen(level.solution.size(), 0.0f);
+    std::vector<size_t> run_ids;
+    for (int color = 0; color < 8; color++)
+    {
+      run_ids.clear();
+      size_t n = size_t(level.bricks_per_axis);
+      for (size_t i = 0; i < runs.size(); i++)
+      {
+        size_t brick = runs[i].brick;
+        int brick_color = int(brick % n & 1) | int(brick / n % n & 1) << 1 |
+                          int(brick / (n * n) & 1) << 2;
+        if (brick_color == color) run_ids.push_back(i);
+      }
+      SplatWorker splat_worker(samples, runs, run_ids, level,
+                               std::ldexp(Scalar(1), depth - max_depth),
+                               area_per_weight,
+                               Scalar(options_.point_weight) *
+                               area_per_weight,
+                               rhs, screen);
+      ParallelForDynamic(0, run_ids.size(), number_of_threads, 1,
+                         splat_worker);
+    }
+
+    BoundaryWorker boundary_worker(levels, l, rhs);
+    ParallelForDynamic(0, number_of_bricks, number_of_threads, BRICK_BLOCK,
+                       boundary_worker);
+    SolveLevel(level, screen, rhs, options_.min_iterations,
+               Scalar(options_.solver_accuracy), number_of_threads,
+               level.solution);
+  }
+
+  //The surface passes at the mean value at the samples.
+  size_t number_of_sample_blocks =
+    (samples.size() + SAMPLE_BLOCK - 1) / SAMPLE_BLOCK;
+  std::vector<double> sums(number_of_sample_blocks, 0.0);
+  IsoValueWorker iso_value_worker(levels, samples, sums);
+  ParallelForDynamic(0, number_of_sample_blocks, number_of_threads, 1,
+                     iso_value_worker);
+  Scalar iso_value = Scalar(Sum(sums) / total_weight);
+
+  //Follow the surface from the coarsest grid to the finest one.
+  std::vector<uint64_t> cells;
+  int coarsest = levels[0].resolution;
+  for (int z = 0; z < coarsest; z++)
+  {
+    for (int y = 0; y < coarsest; y++)
+    {
+      for (int x = 0; x < coarsest; x++)
+      {
+        cells.push_back(PackCell(x, y, z));
+      }
+    }
+  }
+  std::vector<uint64_t> crossing_cells;
+  for (size_t l = 0; l < levels.size(); l++)
+  {
+    std::vector<char> crossing(cells.size(), 0);
+    CrossingWorker crossing_worker(levels, l, cells, iso_value, crossing);
+    ParallelForDynamic(0, cells.size(), number_of_threads, CELL_BLOCK,
+                       crossing_worker);
+    crossing_cells.clear();
+    for (size_t i = 0; i < cells.size(); i++)
+    {
+      if (crossing[i]) crossing_cells.push_back(cells[i]);
+    }
+    if (l + 1 < levels.size())
+    {
+      RefineCells(crossing_cells, levels[l].resolution, cells);
+    }
+  }
+
+  size_t number_of_cell_blocks =
+    (crossing_cells.size() + CELL_BLOCK - 1) / CELL_BLOCK;
+  std::vector<std::vector<EdgeVertex> > block_vertices(number_of_cell_blocks);
+  std::vector<std::vector<KeyTriangle> > block_triangles(
+    number_of_cell_blocks);
+  TetrahedraWorker tetrahedra_worker(levels, crossing_cells, iso_value,
+                                     block_vertices, block_triangles);
+  ParallelForDynamic(0, number_of_cell_blocks, number_of_threads, 1,
+                     tetrahedra_worker);
+
+  //Vertices shared across blocks are merged by key.
+  std::vector<EdgeVertex> edge_vertices;
+  std::vector<KeyTriangle> key_triangles;
+  for (size_t i = 0; i < number_of_cell_blocks; i++)
+  {
+    edge_vertices.insert(edge_vertices.end(), block_vertices[i].begin(),
+                         block_vertices[i].end());
+    key_triangles.insert(key_triangles.end(), block_triangles[i].begin(),
+                         block_triangles[i].end());
+    std::vector<EdgeVertex>().swap(block_vertices[i]);
+    std::vector<KeyTriangle>().swap(block_triangles[i]);
+  }
+  std::sort(edge_vertices.begin(), edge_vertices.end(), LessKey);
+  edge_vertices.erase(std::unique(edge_vertices.begin(), edge_vertices.end(),
+                                  EqualKey),
+                      edge_vertices.end());
+
+  vertices.resize(edge_vertices.size());
+  for (size_t i = 0; i < edge_vertices.size(); i++)
+  {
+    const float* position = edge_vertices[i].position;
+    vertices[i] = cube_min + Vector3(position[0], position[1], position[2]) /
+                             to_grid;
+  }
+  triangles.resize(key_triangles.size());
+  IndexWorker index_worker(edge_vertices, key_triangles, triangles);
+  ParallelForDynamic(0, key_triangles.size(), number_of_threads, CELL_BLOCK,
+                     index_worker);
+
+  return 0;
+}
+
+}
+}
+}
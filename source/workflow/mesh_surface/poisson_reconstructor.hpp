@@ -0,0 +1,83 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_POISSON_RECONSTRUCTOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_POISSON_RECONSTRUCTOR_HPP_
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct HS_EXPORT PoissonReconstructorOptions
+{
+  PoissonReconstructorOptions();
+
+  //The finest grid has 2^depth cells along the bounding cube.
+  int depth;
+  //Grids up to min_depth cover the whole cube, finer ones only the
+  //bricks around the samples.
+  int min_depth;
+  //Bricks of a fine grid are solved where their cells hold at least
+  //samples_per_node samples, elsewhere the coarser solution is used.
+  float samples_per_node;
+  //Weight of the screening pulling the surface through the samples.
+  float point_weight;
+  //Edge of the bounding cube over the largest extent of the samples.
+  float cube_ratio;
+  //Conjugate gradient iterations run on each grid until the residual
+  //dropped by solver_accuracy, at least min_iterations.
+  int min_iterations;
+  float solver_accuracy;
+  //Weight the samples by the length of their normal.
+  bool use_confidence;
+  size_t number_of_threads;
+};
+
+/**
+ *  Screened Poisson surface reconstruction of oriented points.
+ *
+ *  The indicator function is solved on nested grids, from 4 cells along
+ *  the cube to 2^depth, each grid starting from the solution of the coarser
+ *  one. Grids are made of bricks of 8^3 nodes: past min_depth only the
+ *  bricks around the samples are solved and the others take their values
+ *  from the coarser grid, so memory follows the surface, not the volume.
+ *  The screening term is lumped to the nodes, which keeps the system
+ *  diagonal apart from the Laplacian and lets every brick be updated in
+ *  parallel.
+ *
+ *  The iso-surface is found coarse to fine and extracted with marching
+ *  tetrahedra on the finest grid, so the mesh is closed and free of
+ *  cracks where solved bricks meet interpolated ones.
+ */
+class HS_EXPORT PoissonReconstructor
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+  typedef MeshStreamWriter::Triangle Triangle;
+  typedef MeshStreamWriter::TriangleContainer TriangleContainer;
+
+  PoissonReconstructor(const PoissonReconstructorOptions& options);
+
+  //Surface of points whose normals point outwards, triangles facing out.
+  int operator() (const Vector3Container& points,
+                  const Vector3Container& normals,
+                  Vector3Container& vertices,
+                  TriangleContainer& triangles) const;
+
+private:
+  PoissonReconstructorOptions options_;
+};
+
+}
+}
+}
+
+#endif
@@ -1,113 +1,117 @@
+#include <algorithm>
+
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/mesh_surface/mesh_simplifier.hpp"
+#include "workflow/mesh_surface/poisson_reconstructor.hpp"
 #include "workflow/mesh_surface/poisson_surface_model.hpp"
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#ifdef WIN32
-#include <Windows.h>
-#endif
-#include <string>
 
 namespace hs
 {
-  namespace recon
+namespace recon
+{
+namespace workflow
+{
+
+PoissonSurface::PoissonSurface()
+{
+  type_ = STEP_SURFACE_MODEL;
+}
+
+int PoissonSurface::LoadOrientedPoints(WorkflowStepConfig* config,
+                                       Vector3Container& points,
+                                       Vector3Container& normals)
+{
+  MeshSurfaceConfig* surface_model_config =
+    static_cast<MeshSurfaceConfig*>(config);
+  return LoadOrientedPointCloud(surface_model_config->pointcloud_path(),
+                                points, normals);
+}
+
+int PoissonSurface::Reconstruct(WorkflowStepConfig* config,
+                                const Vector3Container& points,
+                                const Vector3Container& normals,
+                                Vector3Container& vertices,
+                                TriangleContainer& triangles)
+{
+  MeshSurfaceConfig* surface_model_config =
+    static_cast<MeshSurfaceConfig*>(config);
+
+  PoissonReconstructorOptions options;
+  options.depth = surface_model_config->octree_depth();
+  options.min_depth = surface_model_config->min_depth();
+  options.samples_per_node = surface_model_config->samples_per_node();
+  options.point_weight = surface_model_config->point_weight();
+  options.cube_ratio = surface_model_config->cube_ratio();
+  options.min_iterations = surface_model_config->min_iters();
+  options.solver_accuracy = surface_model_config->solver_accuracy();
+  options.use_confidence = surface_model_config->confidence() != 0;
+  options.number_of_threads =
+    size_t(std::max(surface_model_config->core_use(), 1));
+  PoissonReconstructor reconstructor(options);
+  return reconstructor(points, normals, vertices, triangles);
+}
+
+int PoissonSurface::SaveMesh(WorkflowStepConfig* config,
+                             const Vector3Container& vertices,
+                             const TriangleContainer& triangles)
+{
+  MeshSurfaceConfig* surface_model_config =
+    static_cast<MeshSurfaceConfig*>(config);
+
+  std::string mesh_path = surface_model_config->output_dir() + "/mesh.bin";
+  MeshStreamWriter writer;
+  if (writer.Open(mesh_path, vertices) != 0) return -1;
+  if (writer.Append(triangles) != 0) return -1;
+  return writer.Close();
+}
+
+int PoissonSurface::BuildLods(WorkflowStepConfig* config)
+{
+  MeshSurfaceConfig* surface_model_config =
+    static_cast<MeshSurfaceConfig*>(config);
+
+  return BuildMeshLods(surface_model_config->output_dir() + "/mesh.bin",
+                       surface_model_config->number_of_lods(),
+                       surface_model_config->lod_ratio(),
+                       surface_model_config->lod_max_error(),
+                       size_t(std::max(surface_model_config->core_use(), 1)));
+}
+
+int PoissonSurface::RunImplement(WorkflowStepConfig* config)
+{
+  int result = -1;
+  while (1)
   {
-    namespace workflow
-    {
-      int PoissonSurface::CreateConfigXml(MeshSurfaceConfig* config)
-      {
-        boost::property_tree::ptree config_tree;
-        config_tree.put("module_list.module_item.module_name",
-          "mesh_surface");
-        config_tree.put("module_list.module_item.module_version",
-          "1.0");
-        config_tree.put("module_list.module_item.pointcloud",
-          config->pointcloud_path());
-        config_tree.put("module_list.module_item.option_list.octree_depth",
-          config->octree_depth());
-        config_tree.put("module_list.module_item.option_list.core_use",
-          config->core_use());
-        config_tree.put("module_list.module_item.option_list.min_depth",
-          config->min_depth());
-        config_tree.put("module_list.module_item.option_list.point_weight",
-          config->point_weight());
-        config_tree.put("module_list.module_item.option_list.cube_ratio",
-          config->cube_ratio());
-        config_tree.put("module_list.module_item.option_list.solver_divide",
-          config->solver_divide());
-        config_tree.put("module_list.module_item.option_list.iso_divide",
-          config->iso_divide());
-        config_tree.put("module_list.module_item.option_list.samples_per_node",
-          config->samples_per_node());
-        config_tree.put("module_list.module_item.option_list.min_iters",
-          config->min_iters());
-        config_tree.put("module_list.module_item.option_list.solver_accuracy",
-          config->solver_accuracy());
-        config_tree.put("module_list.module_item.option_list.confidence",
-          config->confidence());
-        config_tree.put("module_list.module_item.option_list.polygon_mesh",
-          config->polygon_mesh());
-        config_tree.put("module_list.module_item.option_list.output_dir",
-          config->output_dir());
-        boost::property_tree::xml_parser::xml_writer_settings<boost::property_tree::ptree::key_type> settings(' ', 2);
-        //boost::property_tree::xml_parser::xml_writer_settings<char> settings(' ', 2);
-        write_xml(config->xml_path(), config_tree, std::locale(), settings);
-        return 0;
-        
-      }
-
-      PoissonSurface::PoissonSurface()
-      {
-        type_ = STEP_SURFACE_MODEL;
-      }
-
-      int PoissonSurface::RunPoissonSurface(WorkflowStepConfig* config)
-      {
-        MeshSurfaceConfig* surface_model_config =
-          static_cast<MeshSurfaceConfig*>(config);
-        if (CreateConfigXml(surface_model_config) != 0)
-        {
-          return -1;
-        }
-        bm::CBaseAgent* agent = ms::CMSAgent::create();
-        agent->init();
-        agent->input(surface_model_config->xml_path().c_str());
-        agent->start(bm::CBaseDefine::E_MX_ASYNC);
-
-        int ms_progress = 0;
-        while (ms_progress != 100)
-        {
-          if (!progress_manager_.CheckKeepWorking())
-          {
-            break;
-          }
-#ifdef WIN32
-          Sleep(100);
-#else
-          //something like Sleep
-#endif
-          ms_progress = agent->getProgress();
-          progress_manager_.SetCurrentSubProgressCompleteRatio(
-            float(ms_progress)/float(100));
-
-        }
-
-        agent->stop();
-
-        std::string outputPath = surface_model_config->output_dir() + "output.xml";
-        agent->output(outputPath.c_str());
-
-        agent->clear();
-
-        agent->uninit();
-
-        ms::CMSAgent::destroy((ms::CMSAgent*)agent);
-        return 0;
-
-      }
-
-      int PoissonSurface::RunImplement(WorkflowStepConfig *config)
-      {
-        return RunPoissonSurface(config);
-      }
-    }
+    progress_manager_.AddSubProgress(0.1f);
+    Vector3Container points;
+    Vector3Container normals;
+    result = LoadOrientedPoints(config, points, normals);
+    if (result != 0) break;
+    progress_manager_.FinishCurrentSubProgress();
+
+    progress_manager_.AddSubProgress(0.7f);
+    Vector3Container vertices;
+    TriangleContainer triangles;
+    result = Reconstruct(config, points, normals, vertices, triangles);
+    if (result != 0) break;
+    progress_manager_.FinishCurrentSubProgress();
+
+    progress_manager_.AddSubProgress(0.1f);
+    result = SaveMesh(config, vertices, triangles);
+    if (result != 0) break;
+    progress_manager_.FinishCurrentSubProgress();
+
+    progress_manager_.AddSubProgress(0.1f);
+    result = BuildLods(config);
+    if (result != 0) break;
+    progress_manager_.FinishCurrentSubProgress();
+
+    break;
   }
+
+  return result;
+}
+
+}
 }
+}
\ No newline at end of file
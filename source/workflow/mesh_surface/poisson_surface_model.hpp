@@ -1,32 +1,53 @@
 #ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_POISSON_SURFACE_MODEL_HPP_
 #define _HS_3D_RECONSTRUCTOR_WORKFLOW_POISSON_SURFACE_MODEL_HPP_
 
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
 #include "hs_3d_reconstructor/config/hs_config.hpp"
+
 #include "workflow/common/workflow_step.hpp"
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
 #include "workflow/mesh_surface/surface_model_config.hpp"
-#include "hs_flowmodule/mesh_surface/agent/ms_agent.hpp"
 
 namespace hs
 {
-  namespace recon
-  {
-    namespace workflow
-    {
-      class HS_EXPORT PoissonSurface : public WorkflowStep
-      {
-      public:
-        PoissonSurface();
-      private:
-        int RunPoissonSurface(WorkflowStepConfig* config);
-        int CreateConfigXml(MeshSurfaceConfig* config);
-      protected:
-        virtual int RunImplement(WorkflowStepConfig* config);
-      };
-
-    }
-  }
-}
+namespace recon
+{
+namespace workflow
+{
 
+/**
+ *  Closed surface model of the oriented dense cloud, written to mesh.bin as
+ *  the Delaunay surface model.
+ */
+class HS_EXPORT PoissonSurface : public WorkflowStep
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+  typedef MeshStreamWriter::TriangleContainer TriangleContainer;
+
+public:
+  PoissonSurface();
+protected:
+  int LoadOrientedPoints(WorkflowStepConfig* config,
+                         Vector3Container& points,
+                         Vector3Container& normals);
+  int Reconstruct(WorkflowStepConfig* config,
+                  const Vector3Container& points,
+                  const Vector3Container& normals,
+                  Vector3Container& vertices,
+                  TriangleContainer& triangles);
+  int SaveMesh(WorkflowStepConfig* config,
+               const Vector3Container& vertices,
+               const TriangleContainer& triangles);
+  int BuildLods(WorkflowStepConfig* config);
+  virtual int RunImplement(WorkflowStepConfig* config);
+};
 
+}
+}
+}
 
-#endif //_HS_3D_RECONSTRUCTOR_WORKFLOW_POISSON_SURFACE_MODEL_HPP_
\ No newline at end of file
+#endif
\ No newline at end of file
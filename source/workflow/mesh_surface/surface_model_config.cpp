@@ -8,6 +8,12 @@ namespace workflow
 {
 
 MeshSurfaceConfig::MeshSurfaceConfig()
+  : core_use_(1)
+  , delaunay_tile_points_(1 << 20)
+  , surface_type_(SURFACE_HEIGHT_FIELD)
+  , number_of_lods_(3)
+  , lod_ratio_(0.25f)
+  , lod_max_error_(0.0f)
 {
   type_ = STEP_SURFACE_MODEL;
 }
@@ -56,6 +62,22 @@ void MeshSurfaceConfig::set_polygon_mesh(const int& polygon_mesh){
 void MeshSurfaceConfig::set_output_dir(const std::string& output_dir){
   output_dir_ = output_dir;
 }
+void MeshSurfaceConfig::set_delaunay_tile_points(
+  const int& delaunay_tile_points){
+  delaunay_tile_points_ = delaunay_tile_points;
+}
+void MeshSurfaceConfig::set_surface_type(const int& surface_type){
+  surface_type_ = surface_type;
+}
+void MeshSurfaceConfig::set_number_of_lods(const int& number_of_lods){
+  number_of_lods_ = number_of_lods;
+}
+void MeshSurfaceConfig::set_lod_ratio(const float& lod_ratio){
+  lod_ratio_ = lod_ratio;
+}
+void MeshSurfaceConfig::set_lod_max_error(const float& lod_max_error){
+  lod_max_error_ = lod_max_error;
+}
 
 const std::string& MeshSurfaceConfig::xml_path()const{
   return xml_path_;
@@ -102,6 +124,21 @@ const float& MeshSurfaceConfig::solver_accuracy()const{
 const float& MeshSurfaceConfig::samples_per_node()const{
   return samples_per_node_;
 }
+const int& MeshSurfaceConfig::delaunay_tile_points()const{
+  return delaunay_tile_points_;
+}
+const int& MeshSurfaceConfig::surface_type()const{
+  return surface_type_;
+}
+const int& MeshSurfaceConfig::number_of_lods()const{
+  return number_of_lods_;
+}
+const float& MeshSurfaceConfig::lod_ratio()const{
+  return lod_ratio_;
+}
+const float& MeshSurfaceConfig::lod_max_error()const{
+  return lod_max_error_;
+}
 
 }
 }
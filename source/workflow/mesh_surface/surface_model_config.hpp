@@ -16,6 +16,15 @@ namespace workflow
 
 class HS_EXPORT MeshSurfaceConfig : public WorkflowStepConfig
 {
+public:
+  enum SurfaceType
+  {
+    //2.5D Delaunay triangulation of the cloud seen from above.
+    SURFACE_HEIGHT_FIELD = 0,
+    //Closed screened Poisson surface of the oriented cloud.
+    SURFACE_CLOSED
+  };
+
 public:
   MeshSurfaceConfig();
   void set_xml_path(const std::string& xml_path);
@@ -33,6 +42,14 @@ public:
   void set_confidence(const int& confidence);
   void set_polygon_mesh(const int& polygon_mesh);
   void set_output_dir(const std::string& output_dir);
+  //Points per Delaunay tile, 0 triangulates the cloud at once.
+  void set_delaunay_tile_points(const int& delaunay_tile_points);
+  void set_surface_type(const int& surface_type);
+  //Simplified meshes written next to mesh.bin, each with lod_ratio times
+  //the triangles of the previous one, within lod_max_error if not 0.
+  void set_number_of_lods(const int& number_of_lods);
+  void set_lod_ratio(const float& lod_ratio);
+  void set_lod_max_error(const float& lod_max_error);
 
   const std::string& xml_path()const;
   const std::string& pointcloud_path()const;
@@ -49,6 +66,11 @@ public:
   const float& cube_ratio()const;
   const float& solver_accuracy()const;
   const float& samples_per_node()const;
+  const int& delaunay_tile_points()const;
+  const int& surface_type()const;
+  const int& number_of_lods()const;
+  const float& lod_ratio()const;
+  const float& lod_max_error()const;
 
 private:
     std::string xml_path_;
@@ -66,6 +88,11 @@ private:
     float cube_ratio_;
     float solver_accuracy_;
     float samples_per_node_;
+    int delaunay_tile_points_;
+    int surface_type_;
+    int number_of_lods_;
+    float lod_ratio_;
+    float lod_max_error_;
 
 };
 
@@ -0,0 +1,579 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
+#include <CGAL/Delaunay_triangulation_2.h>
+#include <CGAL/Triangulation_vertex_base_with_info_2.h>
+
+#include "workflow/common/hilbert_code.hpp"
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/mesh_surface/tiled_delaunay_triangulator.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDelaunayTriangulator Triangulator;
+typedef Triangulator::Scalar Scalar;
+typedef Triangulator::Vertex Vertex;
+typedef Triangulator::VertexContainer VertexContainer;
+typedef Triangulator::Triangle Triangle;
+typedef Triangulator::TriangleContainer TriangleContainer;
+
+typedef CGAL::Exact_predicates_inexact_constructions_kernel Kernel;
+typedef CGAL::Triangulation_vertex_base_with_info_2<size_t, Kernel> Vb;
+typedef CGAL::Triangulation_data_structure_2<Vb> Tds;
+typedef CGAL::Delaunay_triangulation_2<Kernel, Tds> Delaunay;
+typedef Kernel::Point_2 Point;
+
+//Initial margin of a tile, in average point spacings.
+const Scalar MARGIN_SPACINGS = 8;
+//Margins stop growing at this fraction of a tile.
+const Scalar MAX_MARGIN_TILES = 0.5;
+//Tiles triangulated per thread between two writes.
+const size_t TILES_PER_THREAD = 2;
+
+struct Rect
+{
+  Scalar min_x;
+  Scalar min_y;
+  Scalar max_x;
+  Scalar max_y;
+};
+
+struct TileGrid
+{
+  size_t TileX(Scalar x) const
+  {
+    if (tile_width <= 0 || x <= bounds.min_x) return 0;
+    return std::min(size_t((x - bounds.min_x) / tile_width), tiles_x - 1);
+  }
+
+  size_t TileY(Scalar y) const
+  {
+    if (tile_height <= 0 || y <= bounds.min_y) return 0;
+    return std::min(size_t((y - bounds.min_y) / tile_height), tiles_y - 1);
+  }
+
+  size_t TileOf(Scalar x, Scalar y) const
+  {
+    return TileY(y) * tiles_x + TileX(x);
+  }
+
+  Rect Core(size_t tile_id) const
+  {
+    size_t ix = tile_id % tiles_x;
+    size_t iy = tile_id / tiles_x;
+    Rect core;
+    core.min_x = bounds.min_x + Scalar(ix) * tile_width;
+    core.min_y = bounds.min_y + Scalar(iy) * tile_height;
+    core.max_x = ix + 1 == tiles_x ?
+                 bounds.max_x : bounds.min_x + Scalar(ix + 1) * tile_width;
+    core.max_y = iy + 1 == tiles_y ?
+                 bounds.max_y : bounds.min_y + Scalar(iy + 1) * tile_height;
+    return core;
+  }
+
+  Rect Grow(const Rect& core, Scalar margin) const
+  {
+    Rect region;
+    region.min_x = std::max(core.min_x - margin, bounds.min_x);
+    region.min_y = std::max(core.min_y - margin, bounds.min_y);
+    region.max_x = std::min(core.max_x + margin, bounds.max_x);
+    region.max_y = std::min(core.max_y + margin, bounds.max_y);
+    return region;
+  }
+
+  Rect bounds;
+  size_t tiles_x;
+  size_t tiles_y;
+  Scalar tile_width;
+  Scalar tile_height;
+};
+
+bool DiscTouches(const Rect& rect, Scalar cx, Scalar cy,
+                 Scalar squared_radius)
+{
+  Scalar dx = cx < rect.min_x ? rect.min_x - cx :
+              (cx > rect.max_x ? cx - rect.max_x : Scalar(0));
+  Scalar dy = cy < rect.min_y ? rect.min_y - cy :
+              (cy > rect.max_y ? cy - rect.max_y : Scalar(0));
+  return dx * dx + dy * dy <= squared_radius;
+}
+
+bool HalfPlaneTouches(const Rect& rect, const Vertex& u, const Vertex& w)
+{
+  Scalar dx = w[0] - u[0];
+  Scalar dy = w[1] - u[1];
+  Scalar xs[2] = {rect.min_x, rect.max_x};
+  Scalar ys[2] = {rect.min_y, rect.max_y};
+  for (int i = 0; i < 2; i++)
+  {
+    for (int j = 0; j < 2; j++)
+    {
+      if (dx * (ys[j] - u[1]) - dy * (xs[i] - u[0]) > 0) return true;
+    }
+  }
+  return false;
+}
+
+/**
+ *  Whether some point of bounds outside region may lie inside the disc,
+ *  or with a hull edge, on the left of u->w. Tested against the strips of
+ *  bounds around region.
+ */
+template <typename Touches>
+bool TouchesOutside(const Rect& bounds, const Rect& region,
+                    const Touches& touches)
+{
+  Rect strip = bounds;
+  if (region.min_x > bounds.min_x)
+  {
+    strip.max_x = region.min_x;
+    if (touches(strip)) return true;
+  }
+  strip = bounds;
+  if (region.max_x < bounds.max_x)
+  {
+    strip.min_x = region.max_x;
+    if (touches(strip)) return true;
+  }
+  strip = region;
+  if (region.min_y > bounds.min_y)
+  {
+    strip.min_y = bounds.min_y;
+    strip.max_y = region.min_y;
+    if (touches(strip)) return true;
+  }
+  strip = region;
+  if (region.max_y < bounds.max_y)
+  {
+    strip.min_y = region.max_y;
+    strip.max_y = bounds.max_y;
+    if (touches(strip)) return true;
+  }
+  return false;
+}
+
+struct DiscTest
+{
+  DiscTest(Scalar cx_, Scalar cy_, Scalar squared_radius_)
+    : cx(cx_), cy(cy_), squared_radius(squared_radius_) {}
+
+  bool operator() (const Rect& rect) const
+  {
+    return DiscTouches(rect, cx, cy, squared_radius);
+  }
+
+  Scalar cx;
+  Scalar cy;
+  Scalar squared_radius;
+};
+
+struct HalfPlaneTest
+{
+  HalfPlaneTest(const Vertex& u_, const Vertex& w_) : u(u_), w(w_) {}
+
+  bool operator() (const Rect& rect) const
+  {
+    return HalfPlaneTouches(rect, u, w);
+  }
+
+  const Vertex& u;
+  const Vertex& w;
+};
+
+bool Overlaps(const Rect& rect, const Vertex& a, const Vertex& b,
+              const Vertex& c)
+{
+  return std::max(std::max(a[0], b[0]), c[0]) >= rect.min_x &&
+         std::min(std::min(a[0], b[0]), c[0]) <= rect.max_x &&
+         std::max(std::max(a[1], b[1]), c[1]) >= rect.min_y &&
+         std::min(std::min(a[1], b[1]), c[1]) <= rect.max_y;
+}
+
+/**
+ *  Circumcircle in xy of a triangle whose vertex ids are sorted, so every
+ *  tile computes the same value. Collinear triangles get an unbounded
+ *  circle.
+ */
+void Circumcircle(const VertexContainer& vertices, const Triangle& sorted,
+                  Scalar& cx, Scalar& cy, Scalar& squared_radius)
+{
+  const Vertex& a = vertices[sorted[0]];
+  const Vertex& b = vertices[sorted[1]];
+  const Vertex& c = vertices[sorted[2]];
+  Scalar bx = b[0] - a[0];
+  Scalar by = b[1] - a[1];
+  Scalar qx = c[0] - a[0];
+  Scalar qy = c[1] - a[1];
+  Scalar d = 2 * (bx * qy - by * qx);
+  if (d == 0)
+  {
+    cx = a[0] + (bx + qx) / 3;
+    cy = a[1] + (by + qy) / 3;
+    squared_radius = std::numeric_limits<Scalar>::max();
+    return;
+  }
+  Scalar b2 = bx * bx + by * by;
+  Scalar q2 = qx * qx + qy * qy;
+  Scalar ux = (qy * b2 - by * q2) / d;
+  Scalar uy = (bx * q2 - qx * b2) / d;
+  cx = a[0] + ux;
+  cy = a[1] + uy;
+  squared_radius = ux * ux + uy * uy;
+}
+
+struct XYLess
+{
+  XYLess(const VertexContainer& vertices_) : vertices(vertices_) {}
+
+  bool operator() (size_t i, size_t j) const
+  {
+    const Vertex& a = vertices[i];
+    const Vertex& b = vertices[j];
+    if (a[0] != b[0]) return a[0] < b[0];
+    if (a[1] != b[1]) return a[1] < b[1];
+    return i < j;
+  }
+
+  const VertexContainer& vertices;
+};
+
+struct XYEqual
+{
+  XYEqual(const VertexContainer& vertices_) : vertices(vertices_) {}
+
+  bool operator() (size_t i, size_t j) const
+  {
+    return vertices[i][0] == vertices[j][0] &&
+           vertices[i][1] == vertices[j][1];
+  }
+
+  const VertexContainer& vertices;
+};
+
+struct TileWorker
+{
+  TileWorker(const VertexContainer& vertices_,
+             const TileGrid& grid_,
+             const std::vector<size_t>& tile_offsets_,
+             const std::vector<size_t>& tile_points_,
+             Scalar initial_margin_,
+             Scalar max_margin_,
+             size_t first_tile_,
+             std::vector<TriangleContainer>& tile_triangles_)
+    : vertices(vertices_)
+    , grid(grid_)
+    , tile_offsets(tile_offsets_)
+    , tile_points(tile_points_)
+    , initial_margin(initial_margin_)
+    , max_margin(max_margin_)
+    , first_tile(first_tile_)
+    , tile_triangles(tile_triangles_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t tile_id = begin; tile_id < end; tile_id++)
+    {
+      Triangulate(tile_id, tile_triangles[tile_id - first_tile]);
+    }
+  }
+
+  void Gather(const Rect& region, std::vector<size_t>& point_ids) const
+  {
+    point_ids.clear();
+    size_t x_end = grid.TileX(region.max_x) + 1;
+    size_t y_end = grid.TileY(region.max_y) + 1;
+    for (size_t iy = grid.TileY(region.min_y); iy < y_end; iy++)
+    {
+      for (size_t ix = grid.TileX(region.min_x); ix < x_end; ix++)
+      {
+        size_t tile_id = iy * grid.tiles_x + ix;
+        for (size_t k = tile_offsets[tile_id];
+             k < tile_offsets[tile_id + 1]; k++)
+        {
+          const Vertex& vertex = vertices[tile_points[k]];
+          if (vertex[0] >= region.min_x && vertex[0] <= region.max_x &&
+              vertex[1] >= region.min_y && vertex[1] <= region.max_y)
+          {
+            point_ids.push_back(tile_points[k]);
+          }
+        }
+      }
+    }
+    //CGAL keeps one of the points sharing x and y. Keep the lowest id so
+    //neighbouring tiles agree.
+    std::sort(point_ids.begin(), point_ids.end(), XYLess(vertices));
+    point_ids.erase(std::unique(point_ids.begin(), point_ids.end(),
+                                XYEqual(vertices)),
+                    point_ids.end());
+    //Back to id order, the Hilbert order of spatially sorted vertices.
+    std::sort(point_ids.begin(), point_ids.end());
+  }
+
+  /**
+   *  The tile is done when every local triangle near the core has a
+   *  circumcircle reaching no point outside region, and every local hull
+   *  edge facing the core has no such point beyond it. The local triangles
+   *  around the core are then those of the whole cloud. Past max_margin
+   *  the triangles still in doubt, mostly long slivers along the hull, are
+   *  dropped.
+   */
+  void Triangulate(size_t tile_id, TriangleContainer& triangles) const
+  {
+    Rect core = grid.Core(tile_id);
+    std::vector<size_t> point_ids;
+    for (Scalar margin = initial_margin; ; margin *= 2)
+    {
+      Rect region = grid.Grow(core, margin);
+      bool whole = region.min_x <= grid.bounds.min_x &&
+                   region.min_y <= grid.bounds.min_y &&
+                   region.max_x >= grid.bounds.max_x &&
+                   region.max_y >= grid.bounds.max_y;
+      Gather(region, point_ids);
+      //Each point is located from the face of the previous one, a few
+      //steps away along the curve, without sorting again.
+      Delaunay triangulation;
+      Delaunay::Face_handle hint;
+      for (size_t i = 0; i < point_ids.size(); i++)
+      {
+        const Vertex& vertex = vertices[point_ids[i]];
+        Delaunay::Vertex_handle inserted =
+          triangulation.insert(Point(vertex[0], vertex[1]), hint);
+        inserted->info() = point_ids[i];
+        hint = inserted->face();
+      }
+
+      triangles.clear();
+      bool last = whole || margin >= max_margin;
+      bool resolved = whole || triangulation.dimension() == 2;
+      for (Delaunay::All_faces_iterator itr_face =
+             triangulation.all_faces_begin();
+           (resolved || last) && itr_face != triangulation.all_faces_end();
+           ++itr_face)
+      {
+        Delaunay::Face_handle face = itr_face;
+        if (triangulation.is_infinite(face))
+        {
+          //The outside of the hull lies on the left of u->w.
+          int infinite = face->index(triangulation.infinite_vertex());
+          const Vertex& u =
+            vertices[face->vertex(triangulation.ccw(infinite))->info()];
+          const Vertex& w =
+            vertices[face->vertex(triangulation.cw(infinite))->info()];
+          if (!last && HalfPlaneTouches(core, u, w) &&
+              TouchesOutside(grid.bounds, region, HalfPlaneTest(u, w)))
+          {
+            resolved = false;
+          }
+          continue;
+        }
+
+        Triangle triangle;
+        triangle[0] = face->vertex(0)->info();
+        triangle[1] = face->vertex(1)->info();
+        triangle[2] = face->vertex(2)->info();
+        if (!Overlaps(core, vertices[triangle[0]], vertices[triangle[1]],
+                      vertices[triangle[2]]))
+        {
+          continue;
+        }
+        Triangle sorted = triangle;
+        std::sort(sorted.begin(), sorted.end());
+        Scalar cx, cy, squared_radius;
+        Circumcircle(vertices, sorted, cx, cy, squared_radius);
+        if (TouchesOutside(grid.bounds, region,
+                           DiscTest(cx, cy, squared_radius)))
+        {
+          resolved = false;
+          continue;
+        }
+        //Owned by the tile holding its centroid, computed alike in every
+        //tile.
+        const Vertex& a = vertices[sorted[0]];
+        Scalar gx = a[0] + (vertices[sorted[1]][0] - a[0] +
+                            vertices[sorted[2]][0] - a[0]) / 3;
+        Scalar gy = a[1] + (vertices[sorted[1]][1] - a[1] +
+                            vertices[sorted[2]][1] - a[1]) / 3;
+        if (grid.TileOf(gx, gy) == tile_id) triangles.push_back(triangle);
+      }
+      if (resolved || last) break;
+    }
+  }
+
+  const VertexContainer& vertices;
+  const TileGrid& grid;
+  const std::vector<size_t>& tile_offsets;
+  const std::vector<size_t>& tile_points;
+  Scalar initial_margin;
+  Scalar max_margin;
+  size_t first_tile;
+  std::vector<TriangleContainer>& tile_triangles;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+TiledDelaunayTriangulator::TiledDelaunayTriangulator(
+  size_t tile_capacity, size_t number_of_threads)
+  : tile_capacity_(tile_capacity)
+  , number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , number_of_tiles_(0)
+{
+}
+
+void TiledDelaunayTriangulator::SpatialSort(VertexContainer& vertices) const
+{
+  size_t number_of_points = vertices.size();
+  if (number_of_points < 2) return;
+
+  Scalar min_x = vertices[0][0];
+  Scalar min_y = vertices[0][1];
+  Scalar max_x = min_x;
+  Scalar max_y = min_y;
+  for (size_t i = 1; i < number_of_points; i++)
+  {
+    min_x = std::min(min_x, vertices[i][0]);
+    min_y = std::min(min_y, vertices[i][1]);
+    max_x = std::max(max_x, vertices[i][0]);
+    max_y = std::max(max_y, vertices[i][1]);
+  }
+  //Square cells so the curve is not stretched along the longer side.
+  Scalar extent = std::max(max_x - min_x, max_y - min_y);
+  Scalar scale = extent > 0 ? Scalar(HILBERT_MAX_CELL) / extent : Scalar(0);
+
+  std::vector<std::pair<uint64_t, size_t> > codes(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    uint32_t x = uint32_t((vertices[i][0] - min_x) * scale);
+    uint32_t y = uint32_t((vertices[i][1] - min_y) * scale);
+    codes[i] = std::make_pair(HilbertCode(x, y), i);
+  }
+  std::sort(codes.begin(), codes.end());
+
+  VertexContainer sorted(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    sorted[i] = vertices[codes[i].second];
+  }
+  vertices.swap(sorted);
+}
+
+int TiledDelaunayTriangulator::operator() (const VertexContainer& vertices,
+                                           MeshStreamWriter& writer)
+{
+  number_of_tiles_ = 0;
+  size_t number_of_points = vertices.size();
+  if (number_of_points < 3) return 0;
+
+  TileGrid grid;
+  grid.bounds.min_x = grid.bounds.max_x = vertices[0][0];
+  grid.bounds.min_y = grid.bounds.max_y = vertices[0][1];
+  for (size_t i = 1; i < number_of_points; i++)
+  {
+    grid.bounds.min_x = std::min(grid.bounds.min_x, vertices[i][0]);
+    grid.bounds.min_y = std::min(grid.bounds.min_y, vertices[i][1]);
+    grid.bounds.max_x = std::max(grid.bounds.max_x, vertices[i][0]);
+    grid.bounds.max_y = std::max(grid.bounds.max_y, vertices[i][1]);
+  }
+  Scalar width = grid.bounds.max_x - grid.bounds.min_x;
+  Scalar height = grid.bounds.max_y - grid.bounds.min_y;
+
+  //Tiles close to square, tile_capacity points each on average.
+  size_t number_of_tiles = 1;
+  if (tile_capacity_ > 0)
+  {
+    number_of_tiles = std::max(
+      (number_of_points + tile_capacity_ - 1) / tile_capacity_, size_t(1));
+  }
+  if (width <= 0 && height <= 0)
+  {
+    grid.tiles_x = grid.tiles_y = 1;
+  }
+  else if (height <= 0)
+  {
+    grid.tiles_x = number_of_tiles;
+    grid.tiles_y = 1;
+  }
+  else if (width <= 0)
+  {
+    grid.tiles_x = 1;
+    grid.tiles_y = number_of_tiles;
+  }
+  else
+  {
+    Scalar tiles_x = std::floor(
+      std::sqrt(Scalar(number_of_tiles) * width / height) + Scalar(0.5));
+    grid.tiles_x = std::min(std::max(size_t(tiles_x), size_t(1)),
+                            number_of_tiles);
+    grid.tiles_y = (number_of_tiles + grid.tiles_x - 1) / grid.tiles_x;
+  }
+  grid.tile_width = width / Scalar(grid.tiles_x);
+  grid.tile_height = height / Scalar(grid.tiles_y);
+  number_of_tiles_ = grid.tiles_x * grid.tiles_y;
+
+  Scalar area = width * height;
+  Scalar spacing = area > 0 ? std::sqrt(area / Scalar(number_of_points)) :
+                   std::max(width, height) / Scalar(number_of_points);
+  Scalar initial_margin = MARGIN_SPACINGS * spacing;
+  Scalar max_margin =
+    MAX_MARGIN_TILES * std::max(grid.tile_width, grid.tile_height);
+
+  //Bucket the points by tile with a counting sort.
+  std::vector<size_t> tile_offsets(number_of_tiles_ + 1, 0);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    tile_offsets[grid.TileOf(vertices[i][0], vertices[i][1]) + 1]++;
+  }
+  for (size_t i = 0; i < number_of_tiles_; i++)
+  {
+    tile_offsets[i + 1] += tile_offsets[i];
+  }
+  std::vector<size_t> tile_points(number_of_points);
+  {
+    std::vector<size_t> cursors(tile_offsets.begin(), tile_offsets.end() - 1);
+    for (size_t i = 0; i < number_of_points; i++)
+    {
+      tile_points[cursors[grid.TileOf(vertices[i][0], vertices[i][1])]++] =
+        i;
+    }
+  }
+
+  //Only a batch of tiles is held in memory, written in tile order.
+  size_t batch_size = number_of_threads_ * TILES_PER_THREAD;
+  for (size_t batch_begin = 0; batch_begin < number_of_tiles_;
+       batch_begin += batch_size)
+  {
+    size_t batch_end = std::min(batch_begin + batch_size, number_of_tiles_);
+    std::vector<TriangleContainer> tile_triangles(batch_end - batch_begin);
+    TileWorker worker(vertices, grid, tile_offsets, tile_points,
+                      initial_margin, max_margin, batch_begin,
+                      tile_triangles);
+    ParallelForDynamic(batch_begin, batch_end, number_of_threads_, 1,
+                       worker);
+    for (size_t i = 0; i < tile_triangles.size(); i++)
+    {
+      if (writer.Append(tile_triangles[i]) != 0) return -1;
+    }
+  }
+
+  return 0;
+}
+
+size_t TiledDelaunayTriangulator::NumberOfTiles() const
+{
+  return number_of_tiles_;
+}
+
+}
+}
+}
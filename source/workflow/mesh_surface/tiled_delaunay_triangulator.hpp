@@ -0,0 +1,67 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TILED_DELAUNAY_TRIANGULATOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TILED_DELAUNAY_TRIANGULATOR_HPP_
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  2.5D Delaunay triangulation of a point cloud in the xy plane, computed
+ *  on a grid of tiles in parallel.
+ *
+ *  Each tile triangulates the points of its rectangle grown by a margin
+ *  and keeps the triangles whose centroid it holds. Triangles are only
+ *  trusted when no point outside the grown rectangle can fall inside their
+ *  circumcircle, tiles with doubtful ones are redone with a doubled
+ *  margin, so the seams match the triangulation of the whole cloud. Only
+ *  long slivers reaching further than half a tile, found along the hull,
+ *  may be dropped. The result does not depend on the number of threads
+ *  and is written tile by tile.
+ */
+class HS_EXPORT TiledDelaunayTriangulator
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef MeshStreamWriter::Triangle Triangle;
+  typedef MeshStreamWriter::TriangleContainer TriangleContainer;
+
+  /**
+   *  Tiles hold about tile_capacity points, 0 triangulates the cloud as a
+   *  single tile.
+   */
+  TiledDelaunayTriangulator(size_t tile_capacity, size_t number_of_threads);
+
+  /**
+   *  Reorder vertices along a Hilbert curve in xy. Tiles then insert their
+   *  points in id order, each next to the previous one, and the vertices of
+   *  mesh.bin are stored close to their neighbours.
+   */
+  void SpatialSort(VertexContainer& vertices) const;
+
+  //Append the triangles of vertices to writer, opened on vertices.
+  int operator() (const VertexContainer& vertices, MeshStreamWriter& writer);
+
+  size_t NumberOfTiles() const;
+
+private:
+  size_t tile_capacity_;
+  size_t number_of_threads_;
+  size_t number_of_tiles_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,401 @@
+#include <cmath>
+#include <vector>
+
+#include <ceres/ceres.h>
+#include <ceres/rotation.h>
+
+#include "workflow/photo_orientation/ceres_bundle_adjuster.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef CeresBundleAdjuster::Scalar Scalar;
+
+//focal length, skew, principal point x y, pixel ratio, k1 k2 k3, d1 d2
+const int NUMBER_OF_INTRINSIC_PARAMS = 10;
+
+struct ReprojectionError
+{
+  ReprojectionError(Scalar key_x_, Scalar key_y_, Scalar accuracy)
+    : key_x(key_x_), key_y(key_y_), inverse_accuracy(Scalar(1) / accuracy) {}
+
+  template <typename T>
+  bool operator() (const T* intrinsic, const T* rotation, const T* position,
+                   const T* point, T* residuals) const
+  {
+    T relative[3];
+    relative[0] = point[0] - position[0];
+    relative[1] = point[1] - position[1];
+    relative[2] = point[2] - position[2];
+    T camera[3];
+    ceres::AngleAxisRotatePoint(rotation, relative, camera);
+
+    T x = camera[0] / camera[2];
+    T y = camera[1] / camera[2];
+    T r2 = x * x + y * y;
+    T radial = T(1) + r2 * (intrinsic[5] + r2 * (intrinsic[6] +
+                                                 r2 * intrinsic[7]));
+    T x_distorted = x * radial +
+                    T(2) * intrinsic[8] * x * y +
+                    intrinsic[9] * (r2 + T(2) * x * x);
+    T y_distorted = y * radial +
+                    intrinsic[8] * (r2 + T(2) * y * y) +
+                    T(2) * intrinsic[9] * x * y;
+
+    T u = intrinsic[0] * x_distorted + intrinsic[1] * y_distorted +
+          intrinsic[2];
+    T v = intrinsic[0] * intrinsic[4] * y_distorted + intrinsic[3];
+
+    residuals[0] = (u - T(key_x)) * T(inverse_accuracy);
+    residuals[1] = (v - T(key_y)) * T(inverse_accuracy);
+    return true;
+  }
+
+  Scalar key_x;
+  Scalar key_y;
+  Scalar inverse_accuracy;
+};
+
+struct PositionPriorError
+{
+  PositionPriorError(const CeresBundleAdjuster::Point& measure_,
+                     Scalar planar_accuracy, Scalar height_accuracy)
+    : measure(measure_),
+      inverse_planar_accuracy(Scalar(1) / planar_accuracy),
+      inverse_height_accuracy(Scalar(1) / height_accuracy) {}
+
+  template <typename T>
+  bool operator() (const T* point, T* residuals) const
+  {
+    residuals[0] = (point[0] - T(measure[0])) * T(inverse_planar_accuracy);
+    residuals[1] = (point[1] - T(measure[1])) * T(inverse_planar_accuracy);
+    residuals[2] = (point[2] - T(measure[2])) * T(inverse_height_accuracy);
+    return true;
+  }
+
+  CeresBundleAdjuster::Point measure;
+  Scalar inverse_planar_accuracy;
+  Scalar inverse_height_accuracy;
+};
+
+typedef ceres::AutoDiffCostFunction<ReprojectionError, 2,
+                                    NUMBER_OF_INTRINSIC_PARAMS, 3, 3, 3>
+        ReprojectionCostFunction;
+typedef ceres::AutoDiffCostFunction<PositionPriorError, 3, 3>
+        PositionPriorCostFunction;
+
+//Hold some parameters of a block. Ceres 2.1 replaced local
+//parameterizations by manifolds and 2.2 removed them.
+void SetParametersConstant(ceres::Problem& problem, Scalar* block,
+                           int block_size,
+                           const std::vector<int>& constant_params)
+{
+#if CERES_VERSION_MAJOR > 2 || \
+    (CERES_VERSION_MAJOR == 2 && CERES_VERSION_MINOR >= 1)
+  problem.SetManifold(
+    block, new ceres::SubsetManifold(block_size, constant_params));
+#else
+  problem.SetParameterization(
+    block, new ceres::SubsetParameterization(block_size, constant_params));
+#endif
+}
+
+}
+
+BundleAdjustmentOptions::BundleAdjustmentOptions()
+  : backend(BACKEND_BUILTIN)
+  , number_of_threads(0)
+  , time_budget(0.0)
+  , max_iterations(100)
+  , refine_intrinsics(true)
+{
+}
+
+CeresBundleAdjuster::CeresBundleAdjuster(
+  const BundleAdjustmentOptions& options,
+  size_t default_number_of_threads,
+  Scalar feature_accuracy)
+  : options_(options)
+  , number_of_threads_(options.number_of_threads > 0 ?
+                       size_t(options.number_of_threads) :
+                       default_number_of_threads)
+  , feature_accuracy_(feature_accuracy)
+{
+  if (number_of_threads_ == 0) number_of_threads_ = 1;
+}
+
+int CeresBundleAdjuster::operator() (
+  const KeysetContainer& keysets,
+  const hs::sfm::ObjectIndexMap& image_intrinsic_map,
+  const hs::sfm::ObjectIndexMap& image_extrinsic_map,
+  const hs::sfm::TrackContainer& tracks,
+  const hs::sfm::ObjectIndexMap& track_point_map,
+  const hs::sfm::ViewInfoIndexer& view_info_indexer,
+  IntrinsicParamsContainer& intrinsic_params_set,
+  ExtrinsicParamsContainer& extrinsic_params_set,
+  PointContainer& points,
+  ControlPoints* control_points) const
+{
+  if (options_.backend == BundleAdjustmentOptions::BACKEND_BUILTIN) return -1;
+  if (feature_accuracy_ <= Scalar(0)) return -1;
+  size_t number_of_images = keysets.size();
+  if (image_intrinsic_map.Size() < number_of_images ||
+      image_extrinsic_map.Size() < number_of_images ||
+      track_point_map.Size() < tracks.size())
+  {
+    return -1;
+  }
+
+  //Flat parameter blocks, written back once the solver is done.
+  std::vector<Scalar> intrinsic_blocks(
+    intrinsic_params_set.size() * NUMBER_OF_INTRINSIC_PARAMS);
+  for (size_t i = 0; i < intrinsic_params_set.size(); i++)
+  {
+    const IntrinsicParams& intrinsic_params = intrinsic_params_set[i];
+    Scalar* block = intrinsic_blocks.data() + i * NUMBER_OF_INTRINSIC_PARAMS;
+    block[0] = intrinsic_params.focal_length();
+    block[1] = intrinsic_params.skew();
+    block[2] = intrinsic_params.principal_point_x();
+    block[3] = intrinsic_params.principal_point_y();
+    block[4] = intrinsic_params.pixel_ratio();
+    block[5] = intrinsic_params.k1();
+    block[6] = intrinsic_params.k2();
+    block[7] = intrinsic_params.k3();
+    block[8] = intrinsic_params.d1();
+    block[9] = intrinsic_params.d2();
+  }
+  std::vector<Scalar> rotation_blocks(extrinsic_params_set.size() * 3);
+  std::vector<Scalar> position_blocks(extrinsic_params_set.size() * 3);
+  for (size_t i = 0; i < extrinsic_params_set.size(); i++)
+  {
+    for (size_t j = 0; j < 3; j++)
+    {
+      rotation_blocks[i * 3 + j] = extrinsic_params_set[i].rotation()[j];
+      position_blocks[i * 3 + j] = extrinsic_params_set[i].position()[j];
+    }
+  }
+
+  ceres::Problem problem;
+  ceres::ParameterBlockOrdering* ordering = new ceres::ParameterBlockOrdering;
+  std::vector<char> intrinsic_used(intrinsic_params_set.size(), 0);
+  std::vector<char> extrinsic_used(extrinsic_params_set.size(), 0);
+
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    if (!track_point_map.IsValid(i)) continue;
+    size_t point_id = track_point_map[i];
+    if (point_id >= points.size()) continue;
+    Scalar* point_block = points[point_id].data();
+
+    const hs::sfm::Track& track = tracks[i];
+    bool point_used = false;
+    for (size_t j = 0; j < track.size(); j++)
+    {
+      size_t image_id = track[j].first;
+      size_t key_id = track[j].second;
+      if (image_id >= number_of_images ||
+          !image_intrinsic_map.IsValid(image_id) ||
+          !image_extrinsic_map.IsValid(image_id))
+      {
+        continue;
+      }
+      const hs::sfm::ViewInfo* view_info =
+        view_info_indexer.GetViewInfoByTrackImage(i, image_id);
+      if (view_info == nullptr || view_info->is_blunder) continue;
+
+      size_t intrinsic_id = image_intrinsic_map[image_id];
+      size_t extrinsic_id = image_extrinsic_map[image_id];
+      const Keyset::Key& key = keysets[image_id][key_id];
+      problem.AddResidualBlock(
+        new ReprojectionCostFunction(
+          new ReprojectionError(key[0], key[1], feature_accuracy_)),
+        nullptr,
+        intrinsic_blocks.data() + intrinsic_id * NUMBER_OF_INTRINSIC_PARAMS,
+        rotation_blocks.data() + extrinsic_id * 3,
+        position_blocks.data() + extrinsic_id * 3,
+        point_block);
+      intrinsic_used[intrinsic_id] = 1;
+      extrinsic_used[extrinsic_id] = 1;
+      point_used = true;
+    }
+    if (point_used)
+    {
+      ordering->AddElementToGroup(point_block, 0);
+    }
+  }
+
+  if (control_points != nullptr)
+  {
+    const hs::sfm::TrackContainer& tracks_gcp = control_points->tracks;
+    if (tracks_gcp.size() != control_points->measures.size() ||
+        control_points->keysets.size() != number_of_images ||
+        control_points->planar_accuracy <= Scalar(0) ||
+        control_points->height_accuracy <= Scalar(0) ||
+        control_points->marker_accuracy <= Scalar(0))
+    {
+      delete ordering;
+      return -1;
+    }
+
+    //Start from the measured positions.
+    control_points->estimates = control_points->measures;
+    for (size_t i = 0; i < tracks_gcp.size(); i++)
+    {
+      Scalar* point_block = control_points->estimates[i].data();
+      problem.AddResidualBlock(
+        new PositionPriorCostFunction(
+          new PositionPriorError(control_points->measures[i],
+                                 control_points->planar_accuracy,
+                                 control_points->height_accuracy)),
+        nullptr, point_block);
+      ordering->AddElementToGroup(point_block, 0);
+
+      for (size_t j = 0; j < tracks_gcp[i].size(); j++)
+      {
+        size_t image_id = tracks_gcp[i][j].first;
+        size_t key_id = tracks_gcp[i][j].second;
+        if (image_id >= number_of_images ||
+            !image_intrinsic_map.IsValid(image_id) ||
+            !image_extrinsic_map.IsValid(image_id))
+        {
+          continue;
+        }
+        size_t intrinsic_id = image_intrinsic_map[image_id];
+        size_t extrinsic_id = image_extrinsic_map[image_id];
+        const Keyset::Key& key = control_points->keysets[image_id][key_id];
+        problem.AddResidualBlock(
+          new ReprojectionCostFunction(
+            new ReprojectionError(key[0], key[1],
+                                  control_points->marker_accuracy)),
+          nullptr,
+          intrinsic_blocks.data() + intrinsic_id * NUMBER_OF_INTRINSIC_PARAMS,
+          rotation_blocks.data() + extrinsic_id * 3,
+          position_blocks.data() + extrinsic_id * 3,
+          point_block);
+        intrinsic_used[intrinsic_id] = 1;
+        extrinsic_used[extrinsic_id] = 1;
+      }
+    }
+  }
+
+  if (problem.NumResidualBlocks() == 0)
+  {
+    delete ordering;
+    return -1;
+  }
+
+  std::vector<int> fixed_intrinsic_params;
+  fixed_intrinsic_params.push_back(1);
+  fixed_intrinsic_params.push_back(4);
+  for (size_t i = 0; i < intrinsic_params_set.size(); i++)
+  {
+    if (!intrinsic_used[i]) continue;
+    Scalar* block = intrinsic_blocks.data() + i * NUMBER_OF_INTRINSIC_PARAMS;
+    if (options_.refine_intrinsics)
+    {
+      SetParametersConstant(problem, block, NUMBER_OF_INTRINSIC_PARAMS,
+                            fixed_intrinsic_params);
+    }
+    else
+    {
+      problem.SetParameterBlockConstant(block);
+    }
+    ordering->AddElementToGroup(block, 1);
+  }
+  //Without control points hold the first camera, and for the scale the
+  //largest baseline coordinate of the next camera away from it.
+  bool gauge_fixed = control_points != nullptr;
+  const Scalar* first_position = nullptr;
+  for (size_t i = 0; i < extrinsic_params_set.size(); i++)
+  {
+    if (!extrinsic_used[i]) continue;
+    Scalar* rotation_block = rotation_blocks.data() + i * 3;
+    Scalar* position_block = position_blocks.data() + i * 3;
+    if (!gauge_fixed && first_position == nullptr)
+    {
+      problem.SetParameterBlockConstant(rotation_block);
+      problem.SetParameterBlockConstant(position_block);
+      first_position = position_block;
+    }
+    else if (!gauge_fixed)
+    {
+      int axis = 0;
+      for (int j = 1; j < 3; j++)
+      {
+        if (std::abs(position_block[j] - first_position[j]) >
+            std::abs(position_block[axis] - first_position[axis]))
+        {
+          axis = j;
+        }
+      }
+      if (std::abs(position_block[axis] - first_position[axis]) > Scalar(0))
+      {
+        SetParametersConstant(problem, position_block, 3,
+                              std::vector<int>(1, axis));
+        gauge_fixed = true;
+      }
+    }
+    ordering->AddElementToGroup(rotation_block, 1);
+    ordering->AddElementToGroup(position_block, 1);
+  }
+
+  ceres::Solver::Options solver_options;
+  if (options_.backend ==
+      BundleAdjustmentOptions::BACKEND_CERES_ITERATIVE_SCHUR)
+  {
+    solver_options.linear_solver_type = ceres::ITERATIVE_SCHUR;
+    solver_options.preconditioner_type = ceres::SCHUR_JACOBI;
+  }
+  else
+  {
+    solver_options.linear_solver_type = ceres::SPARSE_SCHUR;
+  }
+  solver_options.linear_solver_ordering.reset(ordering);
+  solver_options.num_threads = int(number_of_threads_);
+#if CERES_VERSION_MAJOR < 2
+  solver_options.num_linear_solver_threads = int(number_of_threads_);
+#endif
+  solver_options.max_num_iterations = options_.max_iterations;
+  if (options_.time_budget > 0.0)
+  {
+    solver_options.max_solver_time_in_seconds = options_.time_budget;
+  }
+  solver_options.minimizer_progress_to_stdout = false;
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(solver_options, &problem, &summary);
+  if (!summary.IsSolutionUsable()) return -1;
+
+  for (size_t i = 0; i < intrinsic_params_set.size(); i++)
+  {
+    if (!intrinsic_used[i]) continue;
+    const Scalar* block =
+      intrinsic_blocks.data() + i * NUMBER_OF_INTRINSIC_PARAMS;
+    intrinsic_params_set[i] = IntrinsicParams(block[0], block[1],
+                                              block[2], block[3],
+                                              block[4],
+                                              block[5], block[6], block[7],
+                                              block[8], block[9]);
+  }
+  for (size_t i = 0; i < extrinsic_params_set.size(); i++)
+  {
+    for (size_t j = 0; j < 3; j++)
+    {
+      extrinsic_params_set[i].rotation()[j] = rotation_blocks[i * 3 + j];
+      extrinsic_params_set[i].position()[j] = position_blocks[i * 3 + j];
+    }
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,117 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_CERES_BUNDLE_ADJUSTER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_CERES_BUNDLE_ADJUSTER_HPP_
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+#include "hs_sfm/sfm_utility/match_type.hpp"
+#include "hs_sfm/sfm_utility/key_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Which bundle adjustment backend to use and how much it may spend.
+ */
+struct HS_EXPORT BundleAdjustmentOptions
+{
+  enum Backend
+  {
+    BACKEND_BUILTIN = 0,
+    BACKEND_CERES_SPARSE_SCHUR = 1,
+    BACKEND_CERES_ITERATIVE_SCHUR = 2
+  };
+
+  BundleAdjustmentOptions();
+
+  int backend;
+  /**
+   *  0 means use the number of threads of the calling step.
+   */
+  int number_of_threads;
+  /**
+   *  Wall time limit of the solver in seconds, 0 means no limit.
+   */
+  double time_budget;
+  int max_iterations;
+  bool refine_intrinsics;
+};
+
+/**
+ *  Bundle adjustment on Ceres with a selectable Schur solver.
+ *
+ *  SPARSE_SCHUR eliminates the points and factorizes the reduced camera
+ *  system. ITERATIVE_SCHUR solves the reduced system by conjugate gradients
+ *  with a Schur-Jacobi preconditioner and never forms it, so memory stays
+ *  bounded on very large blocks. The camera model is the one of
+ *  hs::sfm::ProjectiveFunctions, rotations are angle axis from world to
+ *  camera. Skew and pixel ratio are never refined.
+ *
+ *  Without control points the first camera holds rotation and translation
+ *  and one baseline coordinate of the second holds the scale.
+ *
+ *  Optional control points add marker observations and a position prior
+ *  weighted by the planar and height accuracy.
+ */
+class HS_EXPORT CeresBundleAdjuster
+{
+public:
+  typedef double Scalar;
+  typedef hs::sfm::ImageKeys<Scalar> Keyset;
+  typedef EIGEN_STD_VECTOR(Keyset) KeysetContainer;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef EIGEN_STD_VECTOR(IntrinsicParams) IntrinsicParamsContainer;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+  typedef EIGEN_STD_VECTOR(ExtrinsicParams) ExtrinsicParamsContainer;
+  typedef EIGEN_VECTOR(Scalar, 3) Point;
+  typedef EIGEN_STD_VECTOR(Point) PointContainer;
+
+  struct ControlPoints
+  {
+    /**
+     *  Marker measures, indexed like the tie point keysets.
+     */
+    KeysetContainer keysets;
+    hs::sfm::TrackContainer tracks;
+    PointContainer measures;
+    Scalar planar_accuracy;
+    Scalar height_accuracy;
+    Scalar marker_accuracy;
+    /**
+     *  Output, one per track.
+     */
+    PointContainer estimates;
+  };
+
+public:
+  CeresBundleAdjuster(const BundleAdjustmentOptions& options,
+                      size_t default_number_of_threads,
+                      Scalar feature_accuracy = Scalar(1));
+
+  int operator() (const KeysetContainer& keysets,
+                  const hs::sfm::ObjectIndexMap& image_intrinsic_map,
+                  const hs::sfm::ObjectIndexMap& image_extrinsic_map,
+                  const hs::sfm::TrackContainer& tracks,
+                  const hs::sfm::ObjectIndexMap& track_point_map,
+                  const hs::sfm::ViewInfoIndexer& view_info_indexer,
+                  IntrinsicParamsContainer& intrinsic_params_set,
+                  ExtrinsicParamsContainer& extrinsic_params_set,
+                  PointContainer& points,
+                  ControlPoints* control_points = nullptr) const;
+
+private:
+  BundleAdjustmentOptions options_;
+  size_t number_of_threads_;
+  Scalar feature_accuracy_;
+};
+
+}
+}
+}
+
+#endif
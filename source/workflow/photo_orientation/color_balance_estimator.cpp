@@ -0,0 +1,257 @@
+#include <algorithm>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/photo_orientation/color_balance_estimator.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef ColorBalanceEstimator::ObservationContainer ObservationContainer;
+typedef ColorBalanceEstimator::CorrectionContainer CorrectionContainer;
+typedef std::array<float, 3> Color;
+
+//Gains past these are taken for a bad fit rather than exposure.
+const float MIN_GAIN = 0.5f;
+const float MAX_GAIN = 2.0f;
+
+//Observations grouped by some id, those of id i being
+//indices[offsets[i]] to indices[offsets[i + 1]].
+struct ObservationGroups
+{
+  std::vector<size_t> offsets;
+  std::vector<size_t> indices;
+
+  size_t GroupSize(size_t id) const
+  {
+    return offsets[id + 1] - offsets[id];
+  }
+};
+
+void GroupObservations(const ObservationContainer& observations,
+                       size_t number_of_groups, bool by_point,
+                       ObservationGroups& groups)
+{
+  groups.offsets.assign(number_of_groups + 1, 0);
+  for (size_t i = 0; i < observations.size(); i++)
+  {
+    size_t id = by_point ? observations[i].point_id : observations[i].image_id;
+    groups.offsets[id + 1]++;
+  }
+  for (size_t i = 0; i < number_of_groups; i++)
+  {
+    groups.offsets[i + 1] += groups.offsets[i];
+  }
+  std::vector<size_t> positions(groups.offsets.begin(),
+                                groups.offsets.end() - 1);
+  groups.indices.resize(observations.size());
+  for (size_t i = 0; i < observations.size(); i++)
+  {
+    size_t id = by_point ? observations[i].point_id : observations[i].image_id;
+    groups.indices[positions[id]++] = i;
+  }
+}
+
+struct CorrectWorker
+{
+  CorrectWorker(const ObservationContainer& observations_,
+                const CorrectionContainer& corrections_,
+                std::vector<Color>& corrected_)
+    : observations(observations_), corrections(corrections_),
+      corrected(corrected_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      const ColorCorrection& correction =
+        corrections[observations[i].image_id];
+      for (size_t channel = 0; channel < 3; channel++)
+      {
+        corrected[i][channel] =
+          correction.gain[channel] * observations[i].color[channel] +
+          correction.offset[channel];
+      }
+    }
+  }
+
+  const ObservationContainer& observations;
+  const CorrectionContainer& corrections;
+  std::vector<Color>& corrected;
+};
+
+//Mean corrected color of each point seen more than once.
+struct PointMeanWorker
+{
+  PointMeanWorker(const ObservationGroups& points_,
+                  const std::vector<Color>& corrected_,
+                  std::vector<Color>& means_)
+    : points(points_), corrected(corrected_), means(means_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t point_id = begin; point_id < end; point_id++)
+    {
+      size_t size = points.GroupSize(point_id);
+      if (size < 2) continue;
+      Color sum = {{0.0f, 0.0f, 0.0f}};
+      for (size_t i = points.offsets[point_id];
+           i < points.offsets[point_id + 1]; i++)
+      {
+        const Color& color = corrected[points.indices[i]];
+        for (size_t channel = 0; channel < 3; channel++)
+        {
+          sum[channel] += color[channel];
+        }
+      }
+      for (size_t channel = 0; channel < 3; channel++)
+      {
+        means[point_id][channel] = sum[channel] / float(size);
+      }
+    }
+  }
+
+  const ObservationGroups& points;
+  const std::vector<Color>& corrected;
+  std::vector<Color>& means;
+};
+
+/**
+ *  Least squares gain g and offset o of each image and channel against the
+ *  point means t, over its observed colors c:
+ *    sum (g c + o - t)^2 + r n ((g - 1) m)^2 + r n o^2
+ *  with n observations of mean color m and regularization r.
+ */
+struct FitWorker
+{
+  FitWorker(const ObservationContainer& observations_,
+            const ObservationGroups& points_,
+            const ObservationGroups& images_,
+            const std::vector<Color>& means_,
+            float regularization_,
+            CorrectionContainer& corrections_)
+    : observations(observations_), points(points_), images(images_),
+      means(means_), regularization(regularization_),
+      corrections(corrections_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t image_id = begin; image_id < end; image_id++)
+    {
+      double sum_cc[3] = {0, 0, 0};
+      double sum_c[3] = {0, 0, 0};
+      double sum_ct[3] = {0, 0, 0};
+      double sum_t[3] = {0, 0, 0};
+      double n = 0;
+      for (size_t i = images.offsets[image_id];
+           i < images.offsets[image_id + 1]; i++)
+      {
+        const ColorBalanceEstimator::Observation& observation =
+          observations[images.indices[i]];
+        if (points.GroupSize(observation.point_id) < 2) continue;
+        const Color& target = means[observation.point_id];
+        for (size_t channel = 0; channel < 3; channel++)
+        {
+          double c = observation.color[channel];
+          double t = target[channel];
+          sum_cc[channel] += c * c;
+          sum_c[channel] += c;
+          sum_ct[channel] += c * t;
+          sum_t[channel] += t;
+        }
+        n += 1;
+      }
+      ColorCorrection& correction = corrections[image_id];
+      correction = ColorCorrection();
+      if (n == 0) continue;
+
+      double prior = double(regularization) * n;
+      for (size_t channel = 0; channel < 3; channel++)
+      {
+        double mean = std::max(sum_c[channel] / n, 1.0);
+        double a00 = sum_cc[channel] + prior * mean * mean;
+        double a01 = sum_c[channel];
+        double a11 = n + prior;
+        double b0 = sum_ct[channel] + prior * mean * mean;
+        double b1 = sum_t[channel];
+        double determinant = a00 * a11 - a01 * a01;
+        if (determinant <= 0) continue;
+        double gain = (b0 * a11 - a01 * b1) / determinant;
+        gain = std::min(std::max(gain, double(MIN_GAIN)), double(MAX_GAIN));
+        //Best offset for the clamped gain.
+        double offset = (b1 - gain * a01) / a11;
+        correction.gain[channel] = float(gain);
+        correction.offset[channel] = float(offset);
+      }
+    }
+  }
+
+  const ObservationContainer& observations;
+  const ObservationGroups& points;
+  const ObservationGroups& images;
+  const std::vector<Color>& means;
+  float regularization;
+  CorrectionContainer& corrections;
+};
+
+}
+
+ColorBalanceEstimator::ColorBalanceEstimator(size_t number_of_threads,
+                                             size_t number_of_iterations,
+                                             float regularization)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , number_of_iterations_(number_of_iterations)
+  , regularization_(regularization)
+{
+}
+
+int ColorBalanceEstimator::operator() (
+  size_t number_of_images,
+  const ObservationContainer& observations,
+  CorrectionContainer& corrections) const
+{
+  corrections.assign(number_of_images, ColorCorrection());
+  size_t number_of_points = 0;
+  for (size_t i = 0; i < observations.size(); i++)
+  {
+    if (observations[i].image_id >= number_of_images) return -1;
+    number_of_points = std::max(number_of_points,
+                                observations[i].point_id + 1);
+  }
+  if (observations.empty()) return 0;
+
+  ObservationGroups points;
+  ObservationGroups images;
+  GroupObservations(observations, number_of_points, true, points);
+  GroupObservations(observations, number_of_images, false, images);
+
+  std::vector<Color> corrected(observations.size());
+  std::vector<Color> means(number_of_points);
+  CorrectionContainer next_corrections(number_of_images);
+  for (size_t iteration = 0; iteration < number_of_iterations_; iteration++)
+  {
+    CorrectWorker correct_worker(observations, corrections, corrected);
+    ParallelFor(0, observations.size(), number_of_threads_, correct_worker);
+    //Tracks vary in length, hand them out in blocks.
+    PointMeanWorker mean_worker(points, corrected, means);
+    ParallelForDynamic(0, number_of_points, number_of_threads_, 4096,
+                       mean_worker);
+    FitWorker fit_worker(observations, points, images, means,
+                         regularization_, next_corrections);
+    ParallelForDynamic(0, number_of_images, number_of_threads_, 1,
+                       fit_worker);
+    corrections.swap(next_corrections);
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,107 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COLOR_BALANCE_ESTIMATOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COLOR_BALANCE_ESTIMATOR_HPP_
+
+#include <array>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+//Per channel gain and offset bringing the colors of a photo in line with
+//the others.
+struct ColorCorrection
+{
+  ColorCorrection()
+  {
+    gain.fill(1.0f);
+    offset.fill(0.0f);
+  }
+
+  //Correct an RGB sample in place.
+  void Apply(uint8_t* rgb) const
+  {
+    for (size_t channel = 0; channel < 3; channel++)
+    {
+      float value = gain[channel] * float(rgb[channel]) + offset[channel];
+      value = value < 0.0f ? 0.0f : (value > 255.0f ? 255.0f : value);
+      rgb[channel] = uint8_t(value + 0.5f);
+    }
+  }
+
+  bool IsIdentity() const
+  {
+    for (size_t channel = 0; channel < 3; channel++)
+    {
+      if (gain[channel] != 1.0f || offset[channel] != 0.0f) return false;
+    }
+    return true;
+  }
+
+  template <typename Archive>
+  void serialize(Archive& archive)
+  {
+    archive(gain, offset);
+  }
+
+  std::array<float, 3> gain;
+  std::array<float, 3> offset;
+};
+//Corrections by photo id.
+typedef std::map<size_t, ColorCorrection> ColorCorrectionMap;
+
+/**
+ *  Radiometric normalization of a block of photos from tie point colors.
+ *
+ *  Every photo gets a gain and an offset per channel so that the corrected
+ *  colors of each tie point agree across the photos that see it. The fit
+ *  alternates between averaging the corrected colors of each point and
+ *  refitting each photo against those averages by linear least squares,
+ *  both spread over threads. A prior pulls every photo towards no
+ *  correction, which both fixes the overall brightness of the block and
+ *  keeps photos with few ties close to their own colors.
+ */
+class HS_EXPORT ColorBalanceEstimator
+{
+public:
+  //Color of a tie point in a photo, averaged over a small window.
+  struct Observation
+  {
+    size_t point_id;
+    size_t image_id;
+    std::array<float, 3> color;
+  };
+  typedef std::vector<Observation> ObservationContainer;
+  typedef std::vector<ColorCorrection> CorrectionContainer;
+
+  ColorBalanceEstimator(size_t number_of_threads,
+                        size_t number_of_iterations = 30,
+                        float regularization = 0.01f);
+
+  /**
+   *  corrections[i] is the correction of image i. Only points seen by two
+   *  photos or more take part, photos without any keep the identity. Fails
+   *  on an image id not below number_of_images.
+   */
+  int operator() (size_t number_of_images,
+                  const ObservationContainer& observations,
+                  CorrectionContainer& corrections) const;
+
+private:
+  size_t number_of_threads_;
+  size_t number_of_iterations_;
+  float regularization_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,456 @@
+#include <fstream>
+#include <cstring>
+
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/photo_orientation/compact_track_container.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+const uint32_t COMPACT_TRACK_MAGIC = 0x4b545348; //"HSTK"
+const uint32_t COMPACT_TRACK_VERSION = 1;
+
+struct CompactTrackHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t number_of_tracks;
+  uint64_t number_of_views;
+};
+
+typedef CompactTrackContainer::Index Index;
+typedef CompactTrackContainer::Offset Offset;
+
+/**
+ *  Offsets start at zero, never decrease and end at number_of_views, so
+ *  every track range lies inside the view arrays.
+ */
+bool OffsetsValid(const Offset* offsets, size_t number_of_tracks,
+                  size_t number_of_views)
+{
+  if (offsets[0] != 0) return false;
+  for (size_t i = 0; i < number_of_tracks; i++)
+  {
+    if (offsets[i + 1] < offsets[i]) return false;
+  }
+  return offsets[number_of_tracks] == Offset(number_of_views);
+}
+
+/**
+ *  Tracks written by earlier versions, a cereal archive of the tracks with
+ *  photo ids and the track point map.
+ */
+int LoadLegacyTracks(const std::string& path,
+                     std::vector<Offset>& offsets,
+                     std::vector<Index>& image_ids,
+                     std::vector<Index>& key_ids,
+                     std::vector<Index>& point_ids)
+{
+  hs::sfm::TrackContainer tracks;
+  hs::sfm::ObjectIndexMap track_point_map;
+  {
+    std::ifstream tracks_file(path, std::ios::binary);
+    if (!tracks_file) return -1;
+    try
+    {
+      cereal::PortableBinaryInputArchive archive(tracks_file);
+      archive(tracks, track_point_map);
+    }
+    catch (...)
+    {
+      return -1;
+    }
+  }
+
+  offsets.assign(1, 0);
+  image_ids.clear();
+  key_ids.clear();
+  point_ids.clear();
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    for (size_t j = 0; j < tracks[i].size(); j++)
+    {
+      image_ids.push_back(Index(tracks[i][j].first));
+      key_ids.push_back(Index(tracks[i][j].second));
+    }
+    offsets.push_back(Offset(image_ids.size()));
+    if (i < track_point_map.Size() && track_point_map.IsValid(i))
+    {
+      point_ids.push_back(Index(track_point_map[i]));
+    }
+    else
+    {
+      point_ids.push_back(CompactTrackContainer::INVALID_INDEX);
+    }
+  }
+  return 0;
+}
+
+}
+
+const CompactTrackContainer::Index CompactTrackContainer::INVALID_INDEX;
+
+CompactTrackContainer::CompactTrackContainer()
+  : number_of_tracks_(0)
+  , number_of_views_(0)
+  , offsets_(nullptr)
+  , image_ids_(nullptr)
+  , key_ids_(nullptr)
+  , point_ids_(nullptr)
+{
+}
+
+int CompactTrackContainer::Build(
+  const hs::sfm::TrackContainer& tracks,
+  const hs::sfm::ObjectIndexMap& track_point_map,
+  const hs::sfm::ViewInfoIndexer& view_info_indexer,
+  const std::vector<int>& image_ids)
+{
+  Clear();
+
+  size_t number_of_views_upper = 0;
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    number_of_views_upper += tracks[i].size();
+  }
+
+  offsets_buffer_.reserve(tracks.size() + 1);
+  image_ids_buffer_.reserve(number_of_views_upper);
+  key_ids_buffer_.reserve(number_of_views_upper);
+  point_ids_buffer_.reserve(tracks.size());
+
+  offsets_buffer_.push_back(0);
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    const hs::sfm::Track& track = tracks[i];
+    for (size_t j = 0; j < track.size(); j++)
+    {
+      size_t image_id = track[j].first;
+      const hs::sfm::ViewInfo* view_info =
+        view_info_indexer.GetViewInfoByTrackImage(i, image_id);
+      if (view_info == nullptr || view_info->is_blunder) continue;
+      if (image_id >= image_ids.size()) return -1;
+
+      image_ids_buffer_.push_back(Index(image_ids[image_id]));
+      key_ids_buffer_.push_back(Index(track[j].second));
+    }
+    offsets_buffer_.push_back(Offset(image_ids_buffer_.size()));
+
+    if (i < track_point_map.Size() && track_point_map.IsValid(i))
+    {
+      point_ids_buffer_.push_back(Index(track_point_map[i]));
+    }
+    else
+    {
+      point_ids_buffer_.push_back(INVALID_INDEX);
+    }
+  }
+
+  number_of_tracks_ = tracks.size();
+  number_of_views_ = image_ids_buffer_.size();
+  SetupOwnedPointers();
+
+  return 0;
+}
+
+int CompactTrackContainer::Assign(std::vector<Offset>& offsets,
+                                  std::vector<Index>& image_ids,
+                                  std::vector<Index>& key_ids,
+                                  std::vector<Index>& point_ids)
+{
+  if (offsets.size() != point_ids.size() + 1 ||
+      image_ids.size() != key_ids.size() ||
+      !OffsetsValid(offsets.data(), point_ids.size(), image_ids.size()))
+  {
+    return -1;
+  }
+
+  Clear();
+  offsets_buffer_.swap(offsets);
+  image_ids_buffer_.swap(image_ids);
+  key_ids_buffer_.swap(key_ids);
+  point_ids_buffer_.swap(point_ids);
+  number_of_tracks_ = point_ids_buffer_.size();
+  number_of_views_ = image_ids_buffer_.size();
+  SetupOwnedPointers();
+
+  return 0;
+}
+
+int CompactTrackContainer::Save(const std::string& path) const
+{
+  std::ofstream tracks_file(path, std::ios::binary);
+  if (!tracks_file) return -1;
+
+  CompactTrackHeader header;
+  header.magic = COMPACT_TRACK_MAGIC;
+  header.version = COMPACT_TRACK_VERSION;
+  header.number_of_tracks = uint64_t(number_of_tracks_);
+  header.number_of_views = uint64_t(number_of_views_);
+  tracks_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  Offset offset_zero = 0;
+  const Offset* offsets = number_of_tracks_ > 0 ? offsets_ : &offset_zero;
+  tracks_file.write(reinterpret_cast<const char*>(offsets),
+                    std::streamsize((number_of_tracks_ + 1) * sizeof(Offset)));
+  tracks_file.write(reinterpret_cast<const char*>(image_ids_),
+                    std::streamsize(number_of_views_ * sizeof(Index)));
+  tracks_file.write(reinterpret_cast<const char*>(key_ids_),
+                    std::streamsize(number_of_views_ * sizeof(Index)));
+  tracks_file.write(reinterpret_cast<const char*>(point_ids_),
+                    std::streamsize(number_of_tracks_ * sizeof(Index)));
+
+  return tracks_file.good() ? 0 : -1;
+}
+
+int CompactTrackContainer::Load(const std::string& path)
+{
+  Clear();
+  if (mapped_file_.Open(path) != 0) return -1;
+
+  const char* data = mapped_file_.data();
+  size_t size = mapped_file_.size();
+  CompactTrackHeader header;
+  header.magic = 0;
+  if (size >= sizeof(CompactTrackHeader))
+  {
+    std::memcpy(&header, data, sizeof(header));
+  }
+  if (header.magic != COMPACT_TRACK_MAGIC)
+  {
+    //Projects oriented before the compact layout.
+    Clear();
+    std::vector<Offset> offsets;
+    std::vector<Index> image_ids;
+    std::vector<Index> key_ids;
+    std::vector<Index> point_ids;
+    if (LoadLegacyTracks(path, offsets, image_ids, key_ids, point_ids) != 0)
+    {
+      return -1;
+    }
+    return Assign(offsets, image_ids, key_ids, point_ids);
+  }
+  if (header.version != COMPACT_TRACK_VERSION)
+  {
+    Clear();
+    return -1;
+  }
+
+  //Counts past what the file could hold would overflow the size below.
+  if (header.number_of_tracks >= size / sizeof(Offset) ||
+      header.number_of_views > size / (sizeof(Index) * 2))
+  {
+    Clear();
+    return -1;
+  }
+  size_t number_of_tracks = size_t(header.number_of_tracks);
+  size_t number_of_views = size_t(header.number_of_views);
+  size_t expected_size = sizeof(CompactTrackHeader) +
+                         (number_of_tracks + 1) * sizeof(Offset) +
+                         number_of_views * sizeof(Index) * 2 +
+                         number_of_tracks * sizeof(Index);
+  if (size < expected_size)
+  {
+    Clear();
+    return -1;
+  }
+
+  const char* cursor = data + sizeof(CompactTrackHeader);
+  offsets_ = reinterpret_cast<const Offset*>(cursor);
+  cursor += (number_of_tracks + 1) * sizeof(Offset);
+  image_ids_ = reinterpret_cast<const Index*>(cursor);
+  cursor += number_of_views * sizeof(Index);
+  key_ids_ = reinterpret_cast<const Index*>(cursor);
+  cursor += number_of_views * sizeof(Index);
+  point_ids_ = reinterpret_cast<const Index*>(cursor);
+  if (!OffsetsValid(offsets_, number_of_tracks, number_of_views))
+  {
+    Clear();
+    return -1;
+  }
+
+  number_of_tracks_ = number_of_tracks;
+  number_of_views_ = number_of_views;
+
+  return 0;
+}
+
+void CompactTrackContainer::Clear()
+{
+  number_of_tracks_ = 0;
+  number_of_views_ = 0;
+  offsets_ = nullptr;
+  image_ids_ = nullptr;
+  key_ids_ = nullptr;
+  point_ids_ = nullptr;
+  std::vector<Offset>().swap(offsets_buffer_);
+  std::vector<Index>().swap(image_ids_buffer_);
+  std::vector<Index>().swap(key_ids_buffer_);
+  std::vector<Index>().swap(point_ids_buffer_);
+  mapped_file_.Close();
+}
+
+int CompactTrackContainer::ToTrackContainer(
+  hs::sfm::TrackContainer& tracks,
+  hs::sfm::ObjectIndexMap& track_point_map) const
+{
+  tracks.clear();
+  tracks.resize(number_of_tracks_);
+  track_point_map = hs::sfm::ObjectIndexMap(number_of_tracks_);
+  for (size_t i = 0; i < number_of_tracks_; i++)
+  {
+    size_t track_size = TrackSize(i);
+    const Index* track_image_ids = TrackImageIds(i);
+    const Index* track_key_ids = TrackKeyIds(i);
+    hs::sfm::Track& track = tracks[i];
+    track.resize(track_size);
+    for (size_t j = 0; j < track_size; j++)
+    {
+      track[j].first = size_t(track_image_ids[j]);
+      track[j].second = size_t(track_key_ids[j]);
+    }
+    if (IsPointValid(i))
+    {
+      track_point_map[i] = size_t(point_ids_[i]);
+    }
+  }
+  return 0;
+}
+
+size_t CompactTrackContainer::NumberOfTracks() const
+{
+  return number_of_tracks_;
+}
+
+size_t CompactTrackContainer::NumberOfViews() const
+{
+  return number_of_views_;
+}
+
+size_t CompactTrackContainer::TrackSize(size_t track_id) const
+{
+  return size_t(offsets_[track_id + 1] - offsets_[track_id]);
+}
+
+const CompactTrackContainer::Index*
+CompactTrackContainer::TrackImageIds(size_t track_id) const
+{
+  return image_ids_ + offsets_[track_id];
+}
+
+const CompactTrackContainer::Index*
+CompactTrackContainer::TrackKeyIds(size_t track_id) const
+{
+  return key_ids_ + offsets_[track_id];
+}
+
+bool CompactTrackContainer::IsPointValid(size_t track_id) const
+{
+  return point_ids_[track_id] != INVALID_INDEX;
+}
+
+CompactTrackContainer::Index
+CompactTrackContainer::PointId(size_t track_id) const
+{
+  return point_ids_[track_id];
+}
+
+const CompactTrackContainer::Offset* CompactTrackContainer::offsets() const
+{
+  return offsets_;
+}
+
+const CompactTrackContainer::Index* CompactTrackContainer::image_ids() const
+{
+  return image_ids_;
+}
+
+const CompactTrackContainer::Index* CompactTrackContainer::key_ids() const
+{
+  return key_ids_;
+}
+
+const CompactTrackContainer::Index* CompactTrackContainer::point_ids() const
+{
+  return point_ids_;
+}
+
+void CompactTrackContainer::SetupOwnedPointers()
+{
+  offsets_ = offsets_buffer_.data();
+  image_ids_ = image_ids_buffer_.data();
+  key_ids_ = key_ids_buffer_.data();
+  point_ids_ = point_ids_buffer_.data();
+}
+
+int CompactImageViewContainer::Build(const hs::sfm::TrackContainer& tracks,
+                                     size_t number_of_images)
+{
+  //Count views per image, then scatter them in track order.
+  offsets_.assign(number_of_images + 1, 0);
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    for (size_t j = 0; j < tracks[i].size(); j++)
+    {
+      size_t image_id = tracks[i][j].first;
+      if (image_id >= number_of_images) return -1;
+      offsets_[image_id + 1]++;
+    }
+  }
+  for (size_t i = 0; i < number_of_images; i++)
+  {
+    offsets_[i + 1] += offsets_[i];
+  }
+
+  track_ids_.resize(size_t(offsets_[number_of_images]));
+  key_ids_.resize(size_t(offsets_[number_of_images]));
+  std::vector<Offset> cursors(offsets_.begin(), offsets_.end() - 1);
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    for (size_t j = 0; j < tracks[i].size(); j++)
+    {
+      Offset& cursor = cursors[tracks[i][j].first];
+      track_ids_[size_t(cursor)] = Index(i);
+      key_ids_[size_t(cursor)] = Index(tracks[i][j].second);
+      cursor++;
+    }
+  }
+
+  return 0;
+}
+
+size_t CompactImageViewContainer::NumberOfImages() const
+{
+  return offsets_.empty() ? 0 : offsets_.size() - 1;
+}
+
+size_t CompactImageViewContainer::NumberOfViews(size_t image_id) const
+{
+  return size_t(offsets_[image_id + 1] - offsets_[image_id]);
+}
+
+const CompactImageViewContainer::Index*
+CompactImageViewContainer::TrackIds(size_t image_id) const
+{
+  return track_ids_.data() + offsets_[image_id];
+}
+
+const CompactImageViewContainer::Index*
+CompactImageViewContainer::KeyIds(size_t image_id) const
+{
+  return key_ids_.data() + offsets_[image_id];
+}
+
+}
+}
+}
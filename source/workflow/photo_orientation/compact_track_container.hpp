@@ -0,0 +1,132 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_COMPACT_TRACK_CONTAINER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_COMPACT_TRACK_CONTAINER_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hs_sfm/sfm_utility/match_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/common/mapped_file.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Tracks stored in CSR layout.
+ *
+ *  The views of track i are [offsets[i], offsets[i + 1]) of image_ids/key_ids.
+ *  Image ids are the database photo ids. point_ids[i] is the point of track i
+ *  or INVALID_INDEX. The file is the four arrays behind a small header, so
+ *  Load maps it and hands out pointers into the mapping without copying.
+ */
+class HS_EXPORT CompactTrackContainer
+{
+public:
+  typedef uint32_t Index;
+  typedef uint64_t Offset;
+  static const Index INVALID_INDEX = 0xFFFFFFFF;
+
+public:
+  CompactTrackContainer();
+
+  /**
+   *  Build from the SfM result in one pass. Blunder views are dropped and
+   *  image ids are translated to photo ids through image_ids.
+   */
+  int Build(const hs::sfm::TrackContainer& tracks,
+            const hs::sfm::ObjectIndexMap& track_point_map,
+            const hs::sfm::ViewInfoIndexer& view_info_indexer,
+            const std::vector<int>& image_ids);
+  /**
+   *  Take over already flattened arrays. offsets must have
+   *  point_ids.size() + 1 non-decreasing entries from 0 to
+   *  image_ids.size().
+   */
+  int Assign(std::vector<Offset>& offsets,
+             std::vector<Index>& image_ids,
+             std::vector<Index>& key_ids,
+             std::vector<Index>& point_ids);
+  int Save(const std::string& path) const;
+  /**
+   *  Map a file written by Save. Tracks archived by earlier versions are
+   *  read into owned arrays instead. Fails on offsets that do not cover
+   *  the views in order.
+   */
+  int Load(const std::string& path);
+  void Clear();
+
+  /**
+   *  Expand to the hs_sfm containers, for APIs that still need them.
+   */
+  int ToTrackContainer(hs::sfm::TrackContainer& tracks,
+                       hs::sfm::ObjectIndexMap& track_point_map) const;
+
+  size_t NumberOfTracks() const;
+  size_t NumberOfViews() const;
+  size_t TrackSize(size_t track_id) const;
+  const Index* TrackImageIds(size_t track_id) const;
+  const Index* TrackKeyIds(size_t track_id) const;
+  bool IsPointValid(size_t track_id) const;
+  Index PointId(size_t track_id) const;
+
+  const Offset* offsets() const;
+  const Index* image_ids() const;
+  const Index* key_ids() const;
+  const Index* point_ids() const;
+
+private:
+  CompactTrackContainer(const CompactTrackContainer&);
+  CompactTrackContainer& operator=(const CompactTrackContainer&);
+
+  void SetupOwnedPointers();
+
+private:
+  size_t number_of_tracks_;
+  size_t number_of_views_;
+  const Offset* offsets_;
+  const Index* image_ids_;
+  const Index* key_ids_;
+  const Index* point_ids_;
+
+  std::vector<Offset> offsets_buffer_;
+  std::vector<Index> image_ids_buffer_;
+  std::vector<Index> key_ids_buffer_;
+  std::vector<Index> point_ids_buffer_;
+  MappedFile mapped_file_;
+};
+
+/**
+ *  Observations grouped by image, the transpose of a track container.
+ *  Views of image i are [offsets[i], offsets[i + 1]) of track_ids/key_ids.
+ */
+class HS_EXPORT CompactImageViewContainer
+{
+public:
+  typedef CompactTrackContainer::Index Index;
+  typedef CompactTrackContainer::Offset Offset;
+
+  int Build(const hs::sfm::TrackContainer& tracks, size_t number_of_images);
+
+  size_t NumberOfImages() const;
+  size_t NumberOfViews(size_t image_id) const;
+  const Index* TrackIds(size_t image_id) const;
+  const Index* KeyIds(size_t image_id) const;
+
+private:
+  std::vector<Offset> offsets_;
+  std::vector<Index> track_ids_;
+  std::vector<Index> key_ids_;
+};
+
+}
+}
+}
+
+#endif
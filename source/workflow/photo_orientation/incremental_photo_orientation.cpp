@@ -1,4 +1,5 @@
-﻿#include <fstream>
+﻿#include <algorithm>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <array>
@@ -7,6 +8,7 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <boost/typeof/typeof.hpp> 
 
+#include <cereal/types/array.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/types/map.hpp>
 #include <cereal/types/utility.hpp>
@@ -17,12 +19,58 @@
 #include "hs_sfm/sfm_utility/similar_transform_estimator.hpp"
 #include "hs_sfm/sfm_pipeline/incremental_sfm.hpp"
 #include "hs_sfm/sfm_pipeline/reprojective_error_calculator.hpp"
-#include "hs_sfm/sfm_pipeline/point_cloud_norm_calculator.hpp"
 #include "hs_image_io/whole_io/image_data.hpp"
 #include "hs_image_io/whole_io/image_io.hpp"
 #include "hs_graphics/graphics_utility/pointcloud_data.hpp"
 
+#include "workflow/common/chunked_point_cloud.hpp"
 #include "workflow/photo_orientation/incremental_photo_orientation.hpp"
+#include "workflow/photo_orientation/color_balance_estimator.hpp"
+#include "workflow/photo_orientation/compact_track_container.hpp"
+#include "workflow/photo_orientation/streaming_track_builder.hpp"
+#include "workflow/photo_orientation/point_cloud_normal_estimator.hpp"
+
+namespace
+{
+
+/**
+ *  Mean color of a window around a key, false if it is clipped on some
+ *  channel and so no longer follows the exposure of the photo.
+ */
+bool SampleColorWindow(const hs::imgio::whole::ImageData& image_data,
+                       int row, int col, std::array<float, 3>& color)
+{
+  const int radius = 2;
+  const float saturation = 250.0f;
+  int min_row = std::max(row - radius, 0);
+  int max_row = std::min(row + radius, image_data.height() - 1);
+  int min_col = std::max(col - radius, 0);
+  int max_col = std::min(col + radius, image_data.width() - 1);
+  if (min_row > max_row || min_col > max_col) return false;
+
+  int channels = image_data.channel();
+  color.fill(0.0f);
+  for (int r = min_row; r <= max_row; r++)
+  {
+    for (int c = min_col; c <= max_col; c++)
+    {
+      for (int k = 0; k < 3; k++)
+      {
+        color[k] += float(image_data.GetByte(r, c, std::min(k, channels - 1)));
+      }
+    }
+  }
+  float number_of_pixels = float((max_row - min_row + 1) *
+                                 (max_col - min_col + 1));
+  for (int k = 0; k < 3; k++)
+  {
+    color[k] /= number_of_pixels;
+    if (color[k] >= saturation) return false;
+  }
+  return true;
+}
+
+}
 
 namespace hs
 {
@@ -96,6 +144,11 @@ void PhotoOrientationConfig::set_similar_transform_path(
 {
   similar_transform_path_ = similar_transform_path;
 }
+void PhotoOrientationConfig::set_color_balance_path(
+  const std::string& color_balance_path)
+{
+  color_balance_path_ = color_balance_path;
+}
 void PhotoOrientationConfig::set_workspace_path(
   const std::string& workspace_path)
 {
@@ -105,6 +158,11 @@ void PhotoOrientationConfig::set_number_of_threads(int number_of_threads)
 {
   number_of_threads_ = number_of_threads;
 }
+void PhotoOrientationConfig::set_bundle_adjustment_options(
+  const BundleAdjustmentOptions& bundle_adjustment_options)
+{
+  bundle_adjustment_options_ = bundle_adjustment_options;
+}
 
 void PhotoOrientationConfig::set_pos_entries(
   const PosEntryContainer& pos_entries)
@@ -162,6 +220,10 @@ const std::string& PhotoOrientationConfig::similar_transform_path() const
 {
   return similar_transform_path_;
 }
+const std::string& PhotoOrientationConfig::color_balance_path() const
+{
+  return color_balance_path_;
+}
 const std::string& PhotoOrientationConfig::workspace_path() const
 {
   return workspace_path_;
@@ -175,6 +237,11 @@ PhotoOrientationConfig::pos_entries() const
 {
   return pos_entries_;
 }
+const BundleAdjustmentOptions&
+PhotoOrientationConfig::bundle_adjustment_options() const
+{
+  return bundle_adjustment_options_;
+}
 
 IncrementalPhotoOrientation::IncrementalPhotoOrientation()
 {
@@ -215,30 +282,43 @@ int IncrementalPhotoOrientation::LoadMatches(
   const std::string& matches_path =
     photo_orientation_config->matches_path();
   const auto& image_ids = photo_orientation_config->image_ids();
-  std::map<size_t, size_t> image_id_map;
+  std::vector<size_t> image_id_table;
   for (size_t i = 0; i < image_ids.size(); i++)
   {
-    image_id_map[size_t(image_ids[i])] = i;
+    size_t photo_id = size_t(image_ids[i]);
+    if (photo_id >= image_id_table.size())
+    {
+      image_id_table.resize(photo_id + 1, size_t(-1));
+    }
+    image_id_table[photo_id] = i;
   }
 
+  //Stream the pairs and remap them in place instead of loading the whole
+  //archive and copying it into a second map. SfM needs every measured
+  //pair, pair counts drive its initial pair and relative poses.
   matches.clear();
-  hs::sfm::MatchContainer matches_feature_match;
-  {
-    std::ifstream matches_file(matches_path, std::ios::binary);
-    cereal::PortableBinaryInputArchive archive(matches_file);
-    archive(matches_feature_match);
-  }
-
-  for (const auto& image_pair : matches_feature_match)
+  MatchStreamReader reader;
+  if (reader.Open(matches_path) != 0) return -1;
+  while (1)
   {
-    size_t image_id_first = image_id_map[image_pair.first.first];
-    size_t image_id_second = image_id_map[image_pair.first.second];
-    matches[std::make_pair(image_id_first, image_id_second)] =
-      image_pair.second;
+    hs::sfm::ImagePair image_pair;
+    hs::sfm::KeyPairContainer key_pairs;
+    int result = reader.Next(image_pair, key_pairs);
+    if (result == 1) break;
+    if (result != 0) return -1;
+
+    if (image_pair.first >= image_id_table.size() ||
+        image_pair.second >= image_id_table.size()) continue;
+    size_t image_id_first = image_id_table[image_pair.first];
+    size_t image_id_second = image_id_table[image_pair.second];
+    if (image_id_first == size_t(-1) || image_id_second == size_t(-1))
+    {
+      continue;
+    }
+    matches[std::make_pair(image_id_first, image_id_second)].swap(key_pairs);
   }
 
   return 0;
-
 }
 
 int IncrementalPhotoOrientation::RunSFM(
@@ -274,6 +354,27 @@ int IncrementalPhotoOrientation::RunSFM(
                     track_point_map,
                     view_info_indexer,
                     &progress_manager_);
+  if (result != 0) return result;
+
+  //Final global adjustment on the configured backend.
+  const BundleAdjustmentOptions& bundle_adjustment_options =
+    photo_orientation_config->bundle_adjustment_options();
+  if (bundle_adjustment_options.backend !=
+      BundleAdjustmentOptions::BACKEND_BUILTIN)
+  {
+    CeresBundleAdjuster bundle_adjuster(
+      bundle_adjustment_options,
+      size_t(photo_orientation_config->number_of_threads()));
+    result = bundle_adjuster(keysets,
+                             image_intrinsic_map,
+                             image_extrinsic_map,
+                             tracks,
+                             track_point_map,
+                             view_info_indexer,
+                             intrinsic_params_set,
+                             extrinsic_params_set,
+                             points);
+  }
 
   return result;
 }
@@ -428,9 +529,6 @@ int IncrementalPhotoOrientation::SavePointCloud(
   typedef hs::imgio::whole::ImageData::Byte Byte;
   typedef std::array<Byte, 3> Color;
   typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
-  typedef hs::sfm::pipeline::PointCloudNormCalculator<Scalar> NormCalculator;
-  typedef NormCalculator::CameraParams CameraParams;
-  typedef NormCalculator::CameraParamsContainer CameraParamsContainer;
 
   PhotoOrientationConfig* photo_orientation_config =
     static_cast<PhotoOrientationConfig*>(config);
@@ -441,21 +539,18 @@ int IncrementalPhotoOrientation::SavePointCloud(
     photo_orientation_config->point_cloud_path();
   const std::vector<std::string> image_paths =
     photo_orientation_config->image_paths();
-  const hs::sfm::ObjectIndexMap& image_intrinsic_map =
-    photo_orientation_config->image_intrinsic_map();
+  const std::string& color_balance_path =
+    photo_orientation_config->color_balance_path();
 
-  hs::sfm::CameraViewContainer camera_views(image_ids.size());
-  for (size_t i = 0; i < tracks.size(); i++)
+  CompactImageViewContainer camera_views;
+  if (camera_views.Build(tracks, image_ids.size()) != 0)
   {
-    for (size_t j = 0; j < tracks[i].size(); j++)
-    {
-      size_t image_id = tracks[i][j].first;
-      size_t key_id = tracks[i][j].second;
-      camera_views[image_id].push_back(std::make_pair(i, key_id));
-    }
+    return -1;
   }
 
-  //Set point cloud color.
+  //Set point cloud color. The photos are decoded here anyway, so every
+  //view of a point also gives a tie color for balancing the photos.
+  ColorBalanceEstimator::ObservationContainer observations;
   std::vector<bool> color_flags(points.size());
   Color color_default;
   color_default[0] = 0;
@@ -470,17 +565,32 @@ int IncrementalPhotoOrientation::SavePointCloud(
     {
       return -1;
     }
-    for (size_t j = 0; j < camera_views[i].size(); j++)
+    size_t number_of_views = camera_views.NumberOfViews(i);
+    const CompactImageViewContainer::Index* track_ids =
+      camera_views.TrackIds(i);
+    const CompactImageViewContainer::Index* key_ids =
+      camera_views.KeyIds(i);
+    for (size_t j = 0; j < number_of_views; j++)
     {
-      size_t track_id = camera_views[i][j].first;
-      size_t key_id = camera_views[i][j].second;
+      size_t track_id = size_t(track_ids[j]);
+      size_t key_id = size_t(key_ids[j]);
       if (!track_point_map.IsValid(track_id)) continue;
       size_t point_id = track_point_map[track_id];
+      EIGEN_VECTOR(Scalar, 2) key = keysets[i][key_id];
+      int row = int(key[1]);
+      int col = int(key[0]);
+      if (!color_balance_path.empty())
+      {
+        ColorBalanceEstimator::Observation observation;
+        if (SampleColorWindow(image_data, row, col, observation.color))
+        {
+          observation.point_id = point_id;
+          observation.image_id = i;
+          observations.push_back(observation);
+        }
+      }
       if (!color_flags[point_id])
       {
-        EIGEN_VECTOR(Scalar, 2) key = keysets[i][key_id];
-        int row = int(key[1]);
-        int col = int(key[0]);
         if (image_data.channel() == 1)
         {
           Byte byte = image_data.GetByte(row, col, 0);
@@ -501,59 +611,68 @@ int IncrementalPhotoOrientation::SavePointCloud(
     }
   }
 
+  if (!color_balance_path.empty())
+  {
+    ColorBalanceEstimator estimator(
+      size_t(std::max(photo_orientation_config->number_of_threads(), 1)));
+    ColorBalanceEstimator::CorrectionContainer corrections;
+    if (estimator(image_ids.size(), observations, corrections) != 0)
+    {
+      return -1;
+    }
+    ColorBalanceEstimator::ObservationContainer().swap(observations);
+
+    ColorCorrectionMap correction_map;
+    for (size_t i = 0; i < image_ids.size(); i++)
+    {
+      correction_map[size_t(image_ids[i])] = corrections[i];
+    }
+    std::ofstream color_balance_file(color_balance_path, std::ios::binary);
+    if (!color_balance_file) return -1;
+    cereal::PortableBinaryOutputArchive archive(color_balance_file);
+    archive(correction_map);
+  }
+
   //计算法向量
-  PointContainer norms;
+  size_t number_of_images = image_ids.size();
+  PointCloudNormalEstimator::Vector3Container camera_centers(number_of_images);
+  std::vector<char> camera_flags(number_of_images, 0);
+  for (size_t i = 0; i < number_of_images; i++)
   {
-    NormCalculator calculator;
-    CameraParamsContainer camera_params_set;
-    hs::imgio::whole::ImageIO image_io;
-    for (size_t i = 0; i < image_intrinsic_map.Size(); i++)
+    if (i < image_extrinsic_map.Size() && image_extrinsic_map.IsValid(i))
     {
-      if (image_intrinsic_map.IsValid(i) &&
-          image_extrinsic_map.IsValid(i))
-      {
-        size_t intrinsic_id = image_intrinsic_map[i];
-        size_t extrinsic_id = image_extrinsic_map[i];
-        CameraParams camera_params;
-        camera_params.intrinsic_params = intrinsic_params_set[intrinsic_id];
-        camera_params.extrinsic_params = extrinsic_params_set[extrinsic_id];
-        image_io.GetImageDimension(image_paths[i],
-                                   camera_params.image_width,
-                                   camera_params.image_height);
-        camera_params_set.push_back(camera_params);
-      }
+      camera_centers[i] =
+        extrinsic_params_set[image_extrinsic_map[i]].position();
+      camera_flags[i] = 1;
     }
-    calculator(camera_params_set, points, norms);
   }
 
+  //Fill the point cloud buffers in place.
   PointCloudData point_cloud_data;
+  point_cloud_data.VertexData().resize(points.size());
+  point_cloud_data.ColorData().resize(points.size());
+  point_cloud_data.NormalData().resize(points.size());
+
+  PointCloudNormalEstimator normal_estimator(
+    size_t(std::max(photo_orientation_config->number_of_threads(), 1)));
+  if (normal_estimator(tracks, track_point_map,
+                       camera_centers, camera_flags, points,
+                       point_cloud_data.NormalData().data()) != 0)
+  {
+    return -1;
+  }
 
   for (size_t i = 0; i < points.size(); i++)
   {
-    PointCloudData::Vector3 point;
-    point << (points[i][0]),
-             (points[i][1]),
-             (points[i][2]);
-    point_cloud_data.VertexData().push_back(point);
-    PointCloudData::Vector3 color;
+    point_cloud_data.VertexData()[i] = points[i];
+    PointCloudData::Vector3& color = point_cloud_data.ColorData()[i];
     color << Scalar(colors[i][0]) / 255.0,
              Scalar(colors[i][1]) / 255.0,
              Scalar(colors[i][2]) / 255.0;
-    point_cloud_data.ColorData().push_back(color);
-    PointCloudData::Vector3 norm;
-    norm << norms[i][0],
-            norms[i][1],
-            norms[i][2];
-    point_cloud_data.NormalData().push_back(norm);
   }
 
-  {
-    std::ofstream point_cloud_file(point_cloud_path, std::ios::binary);
-    cereal::PortableBinaryOutputArchive archive(point_cloud_file);
-    archive(point_cloud_data);
-  }
-
-  return 0;
+  //Tracks index the points, so they keep their order.
+  return SavePointCloud(point_cloud_data, point_cloud_path, false);
 }
 
 int IncrementalPhotoOrientation::SaveTracks(
@@ -565,38 +684,17 @@ int IncrementalPhotoOrientation::SaveTracks(
   PhotoOrientationConfig* photo_orientation_config =
     static_cast<PhotoOrientationConfig*>(config);
 
-  const std::vector<int> image_ids =
+  const std::vector<int>& image_ids =
     photo_orientation_config->image_ids();
   const std::string& tracks_path =
     photo_orientation_config->tracks_path();
 
-  hs::sfm::TrackContainer tracks_wrap;
-  for (size_t i = 0; i < tracks.size(); i++)
-  {
-    hs::sfm::Track track;
-    for (size_t j = 0; j < tracks[i].size(); j++)
-    {
-      size_t image_id = tracks[i][j].first;
-      size_t key_id = tracks[i][j].second;
-      const hs::sfm::ViewInfo* view_info =
-        view_info_indexer.GetViewInfoByTrackImage(i, image_id);
-      if (view_info != nullptr &&
-        !view_info->is_blunder)
-      {
-        track.push_back(std::make_pair(size_t(image_ids[image_id]),
-                                       key_id));
-      }
-    }
-    tracks_wrap.push_back(track);
-  }
+  CompactTrackContainer compact_tracks;
+  int result = compact_tracks.Build(tracks, track_point_map,
+                                    view_info_indexer, image_ids);
+  if (result != 0) return result;
 
-  {
-    std::ofstream tracks_file(tracks_path, std::ios::binary);
-    cereal::PortableBinaryOutputArchive archive(tracks_file);
-    archive(tracks_wrap, track_point_map);
-  }
-
-  return 0;
+  return compact_tracks.Save(tracks_path);
 }
 
 int IncrementalPhotoOrientation::RunImplement(WorkflowStepConfig* config)
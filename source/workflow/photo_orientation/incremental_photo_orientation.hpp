@@ -8,6 +8,7 @@
 #include "hs_3d_reconstructor/config/hs_config.hpp"
 
 #include "workflow/common/workflow_step.hpp"
+#include "workflow/photo_orientation/ceres_bundle_adjuster.hpp"
 
 namespace hs
 {
@@ -49,9 +50,12 @@ public:
   void set_tracks_path(const std::string& tracks_path);
   void set_track_point_map_path(const std::string& track_point_map_path);
   void set_similar_transform_path(const std::string& similar_transform_path);
+  void set_color_balance_path(const std::string& color_balance_path);
   void set_workspace_path(const std::string& workspace_path);
   void set_number_of_threads(int number_of_threads);
   void set_pos_entries(const PosEntryContainer& pos_entries);
+  void set_bundle_adjustment_options(
+    const BundleAdjustmentOptions& bundle_adjustment_options);
 
   const hs::sfm::ObjectIndexMap& image_intrinsic_map() const;
   const std::string& matches_path() const;
@@ -66,9 +70,11 @@ public:
   const std::string& tracks_path() const;
   const std::string& track_point_map_path() const;
   const std::string& similar_transform_path() const;
+  const std::string& color_balance_path() const;
   const std::string& workspace_path() const;
   int number_of_threads() const;
   const PosEntryContainer& pos_entries() const;
+  const BundleAdjustmentOptions& bundle_adjustment_options() const;
 
 private:
   hs::sfm::ObjectIndexMap image_intrinsic_map_;
@@ -84,9 +90,12 @@ private:
   std::string tracks_path_;
   std::string track_point_map_path_;
   std::string similar_transform_path_;
+  //Color corrections of the photos, none estimated if empty.
+  std::string color_balance_path_;
   std::string workspace_path_;
   PosEntryContainer pos_entries_;
   int number_of_threads_;
+  BundleAdjustmentOptions bundle_adjustment_options_;
 };
 
 typedef std::shared_ptr<PhotoOrientationConfig> PhotoOrientationConfigPtr;
@@ -0,0 +1,124 @@
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/photo_orientation/point_cloud_normal_estimator.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef PointCloudNormalEstimator::Scalar Scalar;
+typedef PointCloudNormalEstimator::Vector3 Vector3;
+typedef PointCloudNormalEstimator::Vector3Container Vector3Container;
+
+struct DefaultNormalFiller
+{
+  DefaultNormalFiller(const Vector3& default_normal_, Vector3* normals_)
+    : default_normal(default_normal_), normals(normals_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      normals[i] = default_normal;
+    }
+  }
+
+  const Vector3& default_normal;
+  Vector3* normals;
+};
+
+struct TrackNormalWorker
+{
+  TrackNormalWorker(const hs::sfm::TrackContainer& tracks_,
+                    const hs::sfm::ObjectIndexMap& track_point_map_,
+                    const Vector3Container& camera_centers_,
+                    const std::vector<char>& camera_flags_,
+                    const Vector3Container& points_,
+                    Vector3* normals_)
+    : tracks(tracks_), track_point_map(track_point_map_),
+      camera_centers(camera_centers_), camera_flags(camera_flags_),
+      points(points_), normals(normals_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      if (!track_point_map.IsValid(i)) continue;
+      size_t point_id = track_point_map[i];
+      if (point_id >= points.size()) continue;
+
+      const Vector3& point = points[point_id];
+      const hs::sfm::Track& track = tracks[i];
+      Vector3 sum = Vector3::Zero();
+      for (size_t j = 0; j < track.size(); j++)
+      {
+        size_t image_id = track[j].first;
+        if (image_id >= camera_flags.size() || !camera_flags[image_id])
+        {
+          continue;
+        }
+        Vector3 direction = camera_centers[image_id] - point;
+        Scalar length = direction.norm();
+        if (length > Scalar(0))
+        {
+          sum += direction / length;
+        }
+      }
+
+      Scalar length = sum.norm();
+      if (length > Scalar(1e-8))
+      {
+        normals[point_id] = sum / length;
+      }
+    }
+  }
+
+  const hs::sfm::TrackContainer& tracks;
+  const hs::sfm::ObjectIndexMap& track_point_map;
+  const Vector3Container& camera_centers;
+  const std::vector<char>& camera_flags;
+  const Vector3Container& points;
+  Vector3* normals;
+};
+
+}
+
+PointCloudNormalEstimator::PointCloudNormalEstimator(size_t number_of_threads)
+  : number_of_threads_(number_of_threads)
+{
+}
+
+int PointCloudNormalEstimator::operator() (
+  const hs::sfm::TrackContainer& tracks,
+  const hs::sfm::ObjectIndexMap& track_point_map,
+  const Vector3Container& camera_centers,
+  const std::vector<char>& camera_flags,
+  const Vector3Container& points,
+  Vector3* normals,
+  const Vector3& default_normal) const
+{
+  if (camera_centers.size() != camera_flags.size()) return -1;
+  if (track_point_map.Size() < tracks.size()) return -1;
+  if (points.empty()) return 0;
+  if (normals == nullptr) return -1;
+
+  DefaultNormalFiller filler(default_normal, normals);
+  ParallelFor(0, points.size(), number_of_threads_, filler);
+
+  //Track lengths vary, hand them out in blocks.
+  TrackNormalWorker worker(tracks, track_point_map,
+                           camera_centers, camera_flags,
+                           points, normals);
+  ParallelForDynamic(0, tracks.size(), number_of_threads_, 4096, worker);
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,57 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_POINT_CLOUD_NORMAL_ESTIMATOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_POINT_CLOUD_NORMAL_ESTIMATOR_HPP_
+
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_sfm/sfm_utility/match_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Visibility based point normals.
+ *
+ *  The normal of a point is the normalized sum of the unit directions from
+ *  the point to the centres of the cameras that observe it, so the cost is
+ *  linear in the number of track views instead of points times cameras.
+ *  Tracks are split among threads and every track writes only the normal
+ *  of its own point. Points seen by no oriented camera get default_normal.
+ */
+class HS_EXPORT PointCloudNormalEstimator
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+
+  PointCloudNormalEstimator(size_t number_of_threads);
+
+  /**
+   *  camera_centers[i] is the centre of image i and camera_flags[i] is
+   *  non-zero if image i is oriented. normals must point to points.size()
+   *  allocated entries.
+   */
+  int operator() (const hs::sfm::TrackContainer& tracks,
+                  const hs::sfm::ObjectIndexMap& track_point_map,
+                  const Vector3Container& camera_centers,
+                  const std::vector<char>& camera_flags,
+                  const Vector3Container& points,
+                  Vector3* normals,
+                  const Vector3& default_normal = Vector3(0, 0, 1)) const;
+
+private:
+  size_t number_of_threads_;
+};
+
+}
+}
+}
+
+#endif
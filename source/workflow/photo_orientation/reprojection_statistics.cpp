@@ -0,0 +1,404 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <boost/filesystem.hpp>
+
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/photo_orientation/reprojection_statistics.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef ReprojectionStatisticsCalculator::Scalar Scalar;
+typedef ReprojectionStatisticsCalculator::Camera Camera;
+typedef ReprojectionStatisticsCalculator::CameraContainer CameraContainer;
+typedef ReprojectionStatisticsCalculator::PointContainer PointContainer;
+typedef CompactTrackContainer::Index Index;
+typedef CompactTrackContainer::Offset Offset;
+
+/**
+ *  Median of [begin, end), reorders the range.
+ */
+double Median(float* begin, float* end)
+{
+  size_t size = size_t(end - begin);
+  if (size == 0) return -1.0;
+  float* middle = begin + size / 2;
+  std::nth_element(begin, middle, end);
+  if (size % 2 == 1) return double(*middle);
+  float lower = *std::max_element(begin, middle);
+  return (double(lower) + double(*middle)) * 0.5;
+}
+
+struct TrackErrorWorker
+{
+  TrackErrorWorker(const CompactTrackContainer& tracks_,
+                   const PointPositionView& points_,
+                   const CameraContainer& cameras_,
+                   const std::vector<int>& photo_camera_table_,
+                   Scalar outlier_threshold_,
+                   std::vector<float>& errors_,
+                   std::vector<int>& view_cameras_,
+                   ReprojectionStatistics& statistics_)
+    : tracks(tracks_), points(points_), cameras(cameras_),
+      photo_camera_table(photo_camera_table_),
+      outlier_threshold(outlier_threshold_),
+      errors(errors_), view_cameras(view_cameras_),
+      statistics(statistics_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    std::vector<float> track_errors;
+    const Offset* offsets = tracks.offsets();
+    const Index* image_ids = tracks.image_ids();
+    const Index* key_ids = tracks.key_ids();
+    for (size_t i = begin; i < end; i++)
+    {
+      track_errors.clear();
+      bool point_valid = tracks.IsPointValid(i) &&
+                         size_t(tracks.PointId(i)) < points.size();
+      for (Offset v = offsets[i]; v < offsets[i + 1]; v++)
+      {
+        errors[size_t(v)] = -1.0f;
+        view_cameras[size_t(v)] = -1;
+        if (!point_valid) continue;
+
+        size_t photo_id = size_t(image_ids[v]);
+        if (photo_id >= photo_camera_table.size()) continue;
+        int camera_id = photo_camera_table[photo_id];
+        if (camera_id < 0) continue;
+        const Camera& camera = cameras[size_t(camera_id)];
+        size_t key_id = size_t(key_ids[v]);
+        if (camera.keyset == nullptr || key_id >= camera.keyset->size())
+        {
+          continue;
+        }
+
+        EIGEN_VECTOR(Scalar, 2) projected =
+          hs::sfm::ProjectiveFunctions<Scalar>::WorldPointProjectToImageKey(
+            camera.intrinsic_params,
+            camera.extrinsic_params,
+            points[size_t(tracks.PointId(i))]);
+        float error = float((projected - (*camera.keyset)[key_id]).norm());
+        if (!(error >= 0.0f)) continue;
+
+        errors[size_t(v)] = error;
+        view_cameras[size_t(v)] = camera_id;
+        track_errors.push_back(error);
+      }
+
+      if (track_errors.empty())
+      {
+        statistics.track_rms[i] = -1.0f;
+        statistics.track_median[i] = -1.0f;
+        statistics.track_outliers[i] = 0;
+        continue;
+      }
+      double square_sum = 0.0;
+      uint32_t number_of_outliers = 0;
+      for (size_t j = 0; j < track_errors.size(); j++)
+      {
+        square_sum += double(track_errors[j]) * double(track_errors[j]);
+        if (track_errors[j] > outlier_threshold) number_of_outliers++;
+      }
+      statistics.track_rms[i] =
+        float(std::sqrt(square_sum / double(track_errors.size())));
+      statistics.track_median[i] =
+        float(Median(track_errors.data(),
+                     track_errors.data() + track_errors.size()));
+      statistics.track_outliers[i] = number_of_outliers;
+    }
+  }
+
+  const CompactTrackContainer& tracks;
+  const PointPositionView& points;
+  const CameraContainer& cameras;
+  const std::vector<int>& photo_camera_table;
+  Scalar outlier_threshold;
+  std::vector<float>& errors;
+  std::vector<int>& view_cameras;
+  ReprojectionStatistics& statistics;
+};
+
+struct CameraErrorWorker
+{
+  CameraErrorWorker(const std::vector<size_t>& camera_offsets_,
+                    Scalar outlier_threshold_,
+                    Scalar histogram_bin_width_,
+                    size_t number_of_histogram_bins_,
+                    std::vector<float>& grouped_errors_,
+                    std::vector<double>& square_sums_,
+                    std::vector<double>& sums_,
+                    std::vector<uint64_t>& camera_histograms_,
+                    ReprojectionStatistics& statistics_)
+    : camera_offsets(camera_offsets_),
+      outlier_threshold(outlier_threshold_),
+      histogram_bin_width(histogram_bin_width_),
+      number_of_histogram_bins(number_of_histogram_bins_),
+      grouped_errors(grouped_errors_),
+      square_sums(square_sums_), sums(sums_),
+      camera_histograms(camera_histograms_),
+      statistics(statistics_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      ReprojectionErrorSummary& summary = statistics.photo_summaries[i];
+      uint64_t* histogram =
+        camera_histograms.data() + i * number_of_histogram_bins;
+      float* errors_begin = grouped_errors.data() + camera_offsets[i];
+      float* errors_end = grouped_errors.data() + camera_offsets[i + 1];
+      double sum = 0.0;
+      double square_sum = 0.0;
+      double max = 0.0;
+      uint64_t number_of_outliers = 0;
+      for (float* error = errors_begin; error != errors_end; ++error)
+      {
+        double value = double(*error);
+        sum += value;
+        square_sum += value * value;
+        max = std::max(max, value);
+        if (value > outlier_threshold) number_of_outliers++;
+        size_t bin = std::min(size_t(value / histogram_bin_width),
+                              number_of_histogram_bins - 1);
+        histogram[bin]++;
+      }
+
+      size_t number_of_projections = size_t(errors_end - errors_begin);
+      sums[i] = sum;
+      square_sums[i] = square_sum;
+      summary.number_of_projections = uint64_t(number_of_projections);
+      summary.number_of_outliers = number_of_outliers;
+      summary.max = max;
+      if (number_of_projections > 0)
+      {
+        summary.mean = sum / double(number_of_projections);
+        summary.rms = std::sqrt(square_sum / double(number_of_projections));
+        summary.median = Median(errors_begin, errors_end);
+      }
+    }
+  }
+
+  const std::vector<size_t>& camera_offsets;
+  Scalar outlier_threshold;
+  Scalar histogram_bin_width;
+  size_t number_of_histogram_bins;
+  std::vector<float>& grouped_errors;
+  std::vector<double>& square_sums;
+  std::vector<double>& sums;
+  std::vector<uint64_t>& camera_histograms;
+  ReprojectionStatistics& statistics;
+};
+
+}
+
+ReprojectionErrorSummary::ReprojectionErrorSummary()
+  : number_of_projections(0)
+  , number_of_outliers(0)
+  , mean(0.0)
+  , rms(0.0)
+  , median(0.0)
+  , max(0.0)
+{
+}
+
+ReprojectionStatistics::ReprojectionStatistics()
+  : outlier_threshold(0.0)
+  , histogram_bin_width(0.0)
+{
+}
+
+int ReprojectionStatistics::Save(const std::string& path) const
+{
+  std::ofstream statistics_file(path, std::ios::binary);
+  if (!statistics_file) return -1;
+  cereal::PortableBinaryOutputArchive archive(statistics_file);
+  archive(*this);
+  return statistics_file.good() ? 0 : -1;
+}
+
+int ReprojectionStatistics::Load(const std::string& path)
+{
+  std::ifstream statistics_file(path, std::ios::binary);
+  if (!statistics_file) return -1;
+  try
+  {
+    cereal::PortableBinaryInputArchive archive(statistics_file);
+    archive(*this);
+  }
+  catch (const cereal::Exception&)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+std::vector<uint64_t> ReprojectionStatistics::SourceStamps(
+  const std::vector<std::string>& source_paths)
+{
+  std::vector<uint64_t> stamps;
+  for (size_t i = 0; i < source_paths.size(); i++)
+  {
+    boost::system::error_code error_code;
+    uint64_t size = uint64_t(
+      boost::filesystem::file_size(source_paths[i], error_code));
+    if (error_code) size = 0;
+    uint64_t time = uint64_t(
+      boost::filesystem::last_write_time(source_paths[i], error_code));
+    if (error_code) time = 0;
+    stamps.push_back(size);
+    stamps.push_back(time);
+  }
+  return stamps;
+}
+
+ReprojectionStatisticsCalculator::ReprojectionStatisticsCalculator(
+  size_t number_of_threads,
+  Scalar outlier_threshold,
+  Scalar histogram_bin_width,
+  size_t number_of_histogram_bins)
+  : number_of_threads_(number_of_threads)
+  , outlier_threshold_(outlier_threshold)
+  , histogram_bin_width_(histogram_bin_width)
+  , number_of_histogram_bins_(std::max(number_of_histogram_bins, size_t(1)))
+{
+}
+
+int ReprojectionStatisticsCalculator::operator() (
+  const CompactTrackContainer& tracks,
+  const PointContainer& points,
+  const CameraContainer& cameras,
+  ReprojectionStatistics& statistics) const
+{
+  PointPositionView view(points.data(), points.size());
+  return (*this)(tracks, view, cameras, statistics);
+}
+
+int ReprojectionStatisticsCalculator::operator() (
+  const CompactTrackContainer& tracks,
+  const PointPositionView& points,
+  const CameraContainer& cameras,
+  ReprojectionStatistics& statistics) const
+{
+  if (histogram_bin_width_ <= Scalar(0)) return -1;
+
+  //Photo id to camera, flat so each view is one lookup.
+  std::vector<int> photo_camera_table;
+  for (size_t i = 0; i < cameras.size(); i++)
+  {
+    size_t photo_id = size_t(cameras[i].photo_id);
+    if (photo_id >= photo_camera_table.size())
+    {
+      photo_camera_table.resize(photo_id + 1, -1);
+    }
+    photo_camera_table[photo_id] = int(i);
+  }
+
+  size_t number_of_tracks = tracks.NumberOfTracks();
+  size_t number_of_views = tracks.NumberOfViews();
+  size_t number_of_cameras = cameras.size();
+
+  statistics = ReprojectionStatistics();
+  statistics.outlier_threshold = outlier_threshold_;
+  statistics.histogram_bin_width = histogram_bin_width_;
+  statistics.track_rms.resize(number_of_tracks);
+  statistics.track_median.resize(number_of_tracks);
+  statistics.track_outliers.resize(number_of_tracks);
+  statistics.photo_ids.resize(number_of_cameras);
+  statistics.photo_summaries.resize(number_of_cameras);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    statistics.photo_ids[i] = cameras[i].photo_id;
+  }
+
+  std::vector<float> errors(number_of_views);
+  std::vector<int> view_cameras(number_of_views);
+  TrackErrorWorker track_worker(tracks, points, cameras, photo_camera_table,
+                                outlier_threshold_, errors, view_cameras,
+                                statistics);
+  ParallelForDynamic(0, number_of_tracks, number_of_threads_, 1024,
+                     track_worker);
+
+  //Regroup the errors by camera.
+  std::vector<size_t> camera_offsets(number_of_cameras + 1, 0);
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    if (view_cameras[i] >= 0) camera_offsets[size_t(view_cameras[i]) + 1]++;
+  }
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    camera_offsets[i + 1] += camera_offsets[i];
+  }
+  std::vector<float> grouped_errors(camera_offsets[number_of_cameras]);
+  {
+    std::vector<size_t> cursors(camera_offsets.begin(),
+                                camera_offsets.end() - 1);
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      if (view_cameras[i] < 0) continue;
+      grouped_errors[cursors[size_t(view_cameras[i])]++] = errors[i];
+    }
+  }
+  std::vector<float>().swap(errors);
+  std::vector<int>().swap(view_cameras);
+
+  std::vector<double> square_sums(number_of_cameras, 0.0);
+  std::vector<double> sums(number_of_cameras, 0.0);
+  std::vector<uint64_t> camera_histograms(
+    number_of_cameras * number_of_histogram_bins_, 0);
+  CameraErrorWorker camera_worker(camera_offsets, outlier_threshold_,
+                                  histogram_bin_width_,
+                                  number_of_histogram_bins_,
+                                  grouped_errors, square_sums, sums,
+                                  camera_histograms, statistics);
+  ParallelForDynamic(0, number_of_cameras, number_of_threads_, 16,
+                     camera_worker);
+
+  //Merge.
+  ReprojectionErrorSummary& overall = statistics.overall;
+  statistics.histogram.assign(number_of_histogram_bins_, 0);
+  double sum = 0.0;
+  double square_sum = 0.0;
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    const ReprojectionErrorSummary& summary = statistics.photo_summaries[i];
+    overall.number_of_projections += summary.number_of_projections;
+    overall.number_of_outliers += summary.number_of_outliers;
+    overall.max = std::max(overall.max, summary.max);
+    sum += sums[i];
+    square_sum += square_sums[i];
+    for (size_t j = 0; j < number_of_histogram_bins_; j++)
+    {
+      statistics.histogram[j] +=
+        camera_histograms[i * number_of_histogram_bins_ + j];
+    }
+  }
+  if (overall.number_of_projections > 0)
+  {
+    overall.mean = sum / double(overall.number_of_projections);
+    overall.rms =
+      std::sqrt(square_sum / double(overall.number_of_projections));
+    overall.median = Median(grouped_errors.data(),
+                            grouped_errors.data() + grouped_errors.size());
+  }
+
+  return 0;
+}
+
+}
+}
+}
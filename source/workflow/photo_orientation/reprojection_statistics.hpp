@@ -0,0 +1,147 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_REPROJECTION_STATISTICS_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_REPROJECTION_STATISTICS_HPP_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+#include "hs_sfm/sfm_utility/key_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/common/mapped_point_cloud.hpp"
+#include "workflow/photo_orientation/compact_track_container.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct HS_EXPORT ReprojectionErrorSummary
+{
+  ReprojectionErrorSummary();
+
+  uint64_t number_of_projections;
+  uint64_t number_of_outliers;
+  double mean;
+  double rms;
+  double median;
+  double max;
+
+  template <typename Archive>
+  void serialize(Archive& archive)
+  {
+    archive(number_of_projections, number_of_outliers,
+            mean, rms, median, max);
+  }
+};
+
+/**
+ *  Reprojection errors of one orientation, overall, per photo and per track.
+ *
+ *  Per track values are flat arrays indexed by track id, tracks without a
+ *  projection get a negative rms and median. histogram[i] counts errors in
+ *  [i * histogram_bin_width, (i + 1) * histogram_bin_width), the last bin
+ *  also takes everything larger.
+ */
+struct HS_EXPORT ReprojectionStatistics
+{
+  ReprojectionStatistics();
+
+  int Save(const std::string& path) const;
+  int Load(const std::string& path);
+
+  /**
+   *  Size and modification time of each file, to tell whether cached
+   *  statistics still belong to the orientation on disk.
+   */
+  static std::vector<uint64_t> SourceStamps(
+    const std::vector<std::string>& source_paths);
+
+  std::vector<uint64_t> source_stamps;
+  double outlier_threshold;
+
+  ReprojectionErrorSummary overall;
+
+  std::vector<uint32_t> photo_ids;
+  std::vector<ReprojectionErrorSummary> photo_summaries;
+
+  std::vector<float> track_rms;
+  std::vector<float> track_median;
+  std::vector<uint32_t> track_outliers;
+
+  double histogram_bin_width;
+  std::vector<uint64_t> histogram;
+
+  template <typename Archive>
+  void serialize(Archive& archive)
+  {
+    archive(source_stamps, outlier_threshold, overall,
+            photo_ids, photo_summaries,
+            track_rms, track_median, track_outliers,
+            histogram_bin_width, histogram);
+  }
+};
+
+/**
+ *  Computes ReprojectionStatistics over the compact tracks.
+ *
+ *  Cameras are looked up through a table indexed by photo id, errors are
+ *  written to one flat array in track order, then regrouped by photo with
+ *  a counting sort. Tracks and photos are split among threads, medians use
+ *  nth_element on the grouped ranges.
+ */
+class HS_EXPORT ReprojectionStatisticsCalculator
+{
+public:
+  typedef double Scalar;
+  typedef hs::sfm::ImageKeys<Scalar> Keyset;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+  typedef EIGEN_VECTOR(Scalar, 3) Point;
+  typedef EIGEN_STD_VECTOR(Point) PointContainer;
+
+  struct Camera
+  {
+    uint32_t photo_id;
+    IntrinsicParams intrinsic_params;
+    ExtrinsicParams extrinsic_params;
+    const Keyset* keyset;
+  };
+  typedef EIGEN_STD_VECTOR(Camera) CameraContainer;
+
+public:
+  ReprojectionStatisticsCalculator(size_t number_of_threads,
+                                   Scalar outlier_threshold = Scalar(2),
+                                   Scalar histogram_bin_width = Scalar(0.25),
+                                   size_t number_of_histogram_bins = 40);
+
+  int operator() (const CompactTrackContainer& tracks,
+                  const PointContainer& points,
+                  const CameraContainer& cameras,
+                  ReprojectionStatistics& statistics) const;
+  /**
+   *  Reads the points through a view, so a mapped point cloud is not
+   *  decoded up front.
+   */
+  int operator() (const CompactTrackContainer& tracks,
+                  const PointPositionView& points,
+                  const CameraContainer& cameras,
+                  ReprojectionStatistics& statistics) const;
+
+private:
+  size_t number_of_threads_;
+  Scalar outlier_threshold_;
+  Scalar histogram_bin_width_;
+  size_t number_of_histogram_bins_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,428 @@
+#include <fstream>
+#include <thread>
+#include <algorithm>
+
+#include <cereal/types/vector.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/photo_orientation/streaming_track_builder.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct MatchStreamReader::Stream
+{
+  Stream(const std::string& matches_path)
+    : file(matches_path, std::ios::binary)
+    , archive(file) {}
+
+  std::ifstream file;
+  cereal::PortableBinaryInputArchive archive;
+};
+
+MatchStreamReader::MatchStreamReader()
+  : stream_(nullptr)
+  , number_of_image_pairs_(0)
+  , number_of_image_pairs_read_(0)
+{
+}
+
+MatchStreamReader::~MatchStreamReader()
+{
+  Close();
+}
+
+int MatchStreamReader::Open(const std::string& matches_path)
+{
+  Close();
+  {
+    std::ifstream matches_file(matches_path, std::ios::binary);
+    if (!matches_file) return -1;
+  }
+
+  try
+  {
+    stream_ = new Stream(matches_path);
+    //Same layout as cereal's std::map: a size tag, then key value items.
+    cereal::size_type number_of_image_pairs = 0;
+    stream_->archive(cereal::make_size_tag(number_of_image_pairs));
+    number_of_image_pairs_ = size_t(number_of_image_pairs);
+  }
+  catch (const cereal::Exception&)
+  {
+    Close();
+    return -1;
+  }
+
+  return 0;
+}
+
+void MatchStreamReader::Close()
+{
+  if (stream_ != nullptr)
+  {
+    delete stream_;
+    stream_ = nullptr;
+  }
+  number_of_image_pairs_ = 0;
+  number_of_image_pairs_read_ = 0;
+}
+
+size_t MatchStreamReader::NumberOfImagePairs() const
+{
+  return number_of_image_pairs_;
+}
+
+size_t MatchStreamReader::NumberOfImagePairsRead() const
+{
+  return number_of_image_pairs_read_;
+}
+
+int MatchStreamReader::Next(hs::sfm::ImagePair& image_pair,
+                            hs::sfm::KeyPairContainer& key_pairs)
+{
+  if (stream_ == nullptr) return -1;
+  if (number_of_image_pairs_read_ >= number_of_image_pairs_) return 1;
+
+  try
+  {
+    stream_->archive(image_pair, key_pairs);
+  }
+  catch (const cereal::Exception&)
+  {
+    return -1;
+  }
+  number_of_image_pairs_read_++;
+
+  return 0;
+}
+
+StreamingTrackBuilder::StreamingTrackBuilder(size_t number_of_threads,
+                                             size_t min_track_length,
+                                             size_t batch_size)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , min_track_length_(std::max(min_track_length, size_t(2)))
+  , batch_size_(std::max(batch_size, size_t(1)))
+  , number_of_nodes_(0)
+  , reading_finished_(false)
+{
+}
+
+int StreamingTrackBuilder::operator() (
+  const std::string& matches_path,
+  const std::vector<int>& image_ids,
+  const std::vector<size_t>& number_of_keys,
+  CompactTrackContainer& tracks,
+  hs::progress::ProgressManager* progress_manager)
+{
+  if (image_ids.size() != number_of_keys.size()) return -1;
+
+  key_offsets_.resize(number_of_keys.size() + 1);
+  key_offsets_[0] = 0;
+  for (size_t i = 0; i < number_of_keys.size(); i++)
+  {
+    key_offsets_[i + 1] = key_offsets_[i] + Offset(number_of_keys[i]);
+  }
+  if (key_offsets_.back() >= Offset(CompactTrackContainer::INVALID_INDEX))
+  {
+    return -1;
+  }
+  number_of_nodes_ = size_t(key_offsets_.back());
+
+  parents_.reset(new std::atomic<Index>[number_of_nodes_]);
+  for (size_t i = 0; i < number_of_nodes_; i++)
+  {
+    parents_[i].store(Index(i), std::memory_order_relaxed);
+  }
+
+  queue_.clear();
+  reading_finished_ = false;
+  std::vector<std::thread> workers;
+  for (size_t i = 0; i < number_of_threads_; i++)
+  {
+    workers.push_back(std::thread(&StreamingTrackBuilder::UniteWorker, this));
+  }
+
+  int result = ReadMatches(matches_path, image_ids, progress_manager);
+
+  {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    reading_finished_ = true;
+  }
+  queue_not_empty_.notify_all();
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+
+  if (result == 0)
+  {
+    result = CollectTracks(image_ids, tracks);
+  }
+
+  parents_.reset();
+  std::vector<Offset>().swap(key_offsets_);
+  return result;
+}
+
+StreamingTrackBuilder::Index StreamingTrackBuilder::Find(Index node)
+{
+  //Path halving. A failed CAS only means someone else shortened the path.
+  while (1)
+  {
+    Index parent = parents_[node].load(std::memory_order_relaxed);
+    if (parent == node) return node;
+    Index grand_parent = parents_[parent].load(std::memory_order_relaxed);
+    if (parent != grand_parent)
+    {
+      parents_[node].compare_exchange_weak(parent, grand_parent,
+                                           std::memory_order_relaxed);
+    }
+    node = grand_parent;
+  }
+}
+
+void StreamingTrackBuilder::Unite(Index node_a, Index node_b)
+{
+  while (1)
+  {
+    node_a = Find(node_a);
+    node_b = Find(node_b);
+    if (node_a == node_b) return;
+    if (node_a < node_b) std::swap(node_a, node_b);
+    Index expected = node_a;
+    if (parents_[node_a].compare_exchange_strong(expected, node_b,
+                                                 std::memory_order_acq_rel))
+    {
+      return;
+    }
+  }
+}
+
+void StreamingTrackBuilder::UniteWorker()
+{
+  while (1)
+  {
+    NodePairBatchPtr batch = PopBatch();
+    if (!batch) break;
+    for (size_t i = 0; i < batch->size(); i++)
+    {
+      Unite((*batch)[i].first, (*batch)[i].second);
+    }
+  }
+}
+
+void StreamingTrackBuilder::FlattenWorker(size_t begin, size_t end)
+{
+  for (size_t i = begin; i < end; i++)
+  {
+    parents_[i].store(Find(Index(i)), std::memory_order_relaxed);
+  }
+}
+
+bool StreamingTrackBuilder::PushBatch(const NodePairBatchPtr& batch)
+{
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (queue_.size() >= number_of_threads_ * 2)
+  {
+    queue_not_full_.wait(lock);
+  }
+  queue_.push_back(batch);
+  lock.unlock();
+  queue_not_empty_.notify_one();
+  return true;
+}
+
+StreamingTrackBuilder::NodePairBatchPtr StreamingTrackBuilder::PopBatch()
+{
+  std::unique_lock<std::mutex> lock(queue_mutex_);
+  while (queue_.empty() && !reading_finished_)
+  {
+    queue_not_empty_.wait(lock);
+  }
+  if (queue_.empty()) return NodePairBatchPtr();
+  NodePairBatchPtr batch = queue_.front();
+  queue_.pop_front();
+  lock.unlock();
+  queue_not_full_.notify_one();
+  return batch;
+}
+
+int StreamingTrackBuilder::ReadMatches(
+  const std::string& matches_path,
+  const std::vector<int>& image_ids,
+  hs::progress::ProgressManager* progress_manager)
+{
+  //Photo id to image index.
+  std::vector<Index> image_index_table;
+  for (size_t i = 0; i < image_ids.size(); i++)
+  {
+    if (image_ids[i] < 0) return -1;
+    size_t photo_id = size_t(image_ids[i]);
+    if (photo_id >= image_index_table.size())
+    {
+      image_index_table.resize(photo_id + 1, CompactTrackContainer::INVALID_INDEX);
+    }
+    image_index_table[photo_id] = Index(i);
+  }
+
+  MatchStreamReader reader;
+  if (reader.Open(matches_path) != 0) return -1;
+
+  hs::sfm::ImagePair image_pair;
+  hs::sfm::KeyPairContainer key_pairs;
+  NodePairBatchPtr batch(new NodePairBatch);
+  batch->reserve(batch_size_);
+  while (1)
+  {
+    int result = reader.Next(image_pair, key_pairs);
+    if (result == 1) break;
+    if (result != 0) return -1;
+
+    if (image_pair.first >= image_index_table.size() ||
+        image_pair.second >= image_index_table.size()) continue;
+    Index image_first = image_index_table[image_pair.first];
+    Index image_second = image_index_table[image_pair.second];
+    if (image_first == CompactTrackContainer::INVALID_INDEX ||
+        image_second == CompactTrackContainer::INVALID_INDEX) continue;
+
+    Offset keys_first = key_offsets_[image_first + 1] -
+                        key_offsets_[image_first];
+    Offset keys_second = key_offsets_[image_second + 1] -
+                         key_offsets_[image_second];
+    for (size_t i = 0; i < key_pairs.size(); i++)
+    {
+      Offset key_first = Offset(key_pairs[i].first);
+      Offset key_second = Offset(key_pairs[i].second);
+      if (key_first >= keys_first || key_second >= keys_second) continue;
+      batch->push_back(
+        NodePair(Index(key_offsets_[image_first] + key_first),
+                 Index(key_offsets_[image_second] + key_second)));
+      if (batch->size() >= batch_size_)
+      {
+        PushBatch(batch);
+        batch.reset(new NodePairBatch);
+        batch->reserve(batch_size_);
+      }
+    }
+
+    if (progress_manager)
+    {
+      if (!progress_manager->CheckKeepWorking()) return -1;
+      progress_manager->SetCurrentSubProgressCompleteRatio(
+        float(reader.NumberOfImagePairsRead()) /
+        float(reader.NumberOfImagePairs()));
+    }
+  }
+  if (!batch->empty())
+  {
+    PushBatch(batch);
+  }
+
+  return 0;
+}
+
+int StreamingTrackBuilder::CollectTracks(const std::vector<int>& image_ids,
+                                         CompactTrackContainer& tracks)
+{
+  //After flattening every node points at its root, the smallest node of
+  //its component, so roots are met before their members in node order.
+  std::vector<std::thread> workers;
+  size_t chunk = (number_of_nodes_ + number_of_threads_ - 1) /
+                 number_of_threads_;
+  for (size_t begin = 0; begin < number_of_nodes_; begin += chunk)
+  {
+    size_t end = std::min(begin + chunk, number_of_nodes_);
+    workers.push_back(
+      std::thread(&StreamingTrackBuilder::FlattenWorker, this, begin, end));
+  }
+  for (size_t i = 0; i < workers.size(); i++)
+  {
+    workers[i].join();
+  }
+
+  std::vector<Index> root_tracks(number_of_nodes_, 0);
+  for (size_t i = 0; i < number_of_nodes_; i++)
+  {
+    root_tracks[parents_[i].load(std::memory_order_relaxed)]++;
+  }
+
+  std::vector<Offset> offsets(1, 0);
+  for (size_t i = 0; i < number_of_nodes_; i++)
+  {
+    if (parents_[i].load(std::memory_order_relaxed) != Index(i)) continue;
+    if (size_t(root_tracks[i]) >= min_track_length_)
+    {
+      offsets.push_back(offsets.back() + Offset(root_tracks[i]));
+      root_tracks[i] = Index(offsets.size() - 2);
+    }
+    else
+    {
+      root_tracks[i] = CompactTrackContainer::INVALID_INDEX;
+    }
+  }
+
+  size_t number_of_tracks = offsets.size() - 1;
+  size_t number_of_views = size_t(offsets.back());
+  std::vector<Index> track_image_ids(number_of_views);
+  std::vector<Index> track_key_ids(number_of_views);
+  std::vector<Offset> cursors(offsets.begin(), offsets.end() - 1);
+  for (size_t image_id = 0; image_id + 1 < key_offsets_.size(); image_id++)
+  {
+    for (Offset node = key_offsets_[image_id];
+         node < key_offsets_[image_id + 1]; node++)
+    {
+      Index root = parents_[size_t(node)].load(std::memory_order_relaxed);
+      Index track_id = root_tracks[root];
+      if (track_id == CompactTrackContainer::INVALID_INDEX) continue;
+      Offset& cursor = cursors[track_id];
+      track_image_ids[size_t(cursor)] = Index(image_ids[image_id]);
+      track_key_ids[size_t(cursor)] = Index(node - key_offsets_[image_id]);
+      cursor++;
+    }
+  }
+  std::vector<Index>().swap(root_tracks);
+
+  //Views were scattered in image order, so a repeated image is adjacent.
+  std::vector<Offset> offsets_consistent(1, 0);
+  size_t number_of_views_consistent = 0;
+  for (size_t i = 0; i < number_of_tracks; i++)
+  {
+    size_t begin = size_t(offsets[i]);
+    size_t end = size_t(offsets[i + 1]);
+    bool is_consistent = true;
+    for (size_t j = begin + 1; j < end; j++)
+    {
+      if (track_image_ids[j] == track_image_ids[j - 1])
+      {
+        is_consistent = false;
+        break;
+      }
+    }
+    if (!is_consistent) continue;
+
+    for (size_t j = begin; j < end; j++)
+    {
+      track_image_ids[number_of_views_consistent] = track_image_ids[j];
+      track_key_ids[number_of_views_consistent] = track_key_ids[j];
+      number_of_views_consistent++;
+    }
+    offsets_consistent.push_back(Offset(number_of_views_consistent));
+  }
+  track_image_ids.resize(number_of_views_consistent);
+  track_key_ids.resize(number_of_views_consistent);
+
+  std::vector<Index> point_ids(offsets_consistent.size() - 1,
+                               CompactTrackContainer::INVALID_INDEX);
+  return tracks.Assign(offsets_consistent, track_image_ids, track_key_ids,
+                       point_ids);
+}
+
+}
+}
+}
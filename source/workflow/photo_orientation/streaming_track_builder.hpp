@@ -0,0 +1,128 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_STREAMING_TRACK_BUILDER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_STREAMING_TRACK_BUILDER_HPP_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+#include "hs_sfm/sfm_utility/match_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/photo_orientation/compact_track_container.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Reads the image pairs of a cereal MatchContainer archive one at a time,
+ *  so the whole match map never has to be in memory.
+ */
+class HS_EXPORT MatchStreamReader
+{
+public:
+  MatchStreamReader();
+  ~MatchStreamReader();
+
+  int Open(const std::string& matches_path);
+  void Close();
+
+  size_t NumberOfImagePairs() const;
+  size_t NumberOfImagePairsRead() const;
+  /**
+   *  Read the next image pair. Returns 1 when all pairs have been read,
+   *  -1 on a stream error.
+   */
+  int Next(hs::sfm::ImagePair& image_pair,
+           hs::sfm::KeyPairContainer& key_pairs);
+
+private:
+  MatchStreamReader(const MatchStreamReader&);
+  MatchStreamReader& operator=(const MatchStreamReader&);
+
+private:
+  struct Stream;
+  Stream* stream_;
+  size_t number_of_image_pairs_;
+  size_t number_of_image_pairs_read_;
+};
+
+/**
+ *  Builds tracks straight from the matches file.
+ *
+ *  Every (image, key) is a node. Match pairs are streamed from disk and
+ *  united by worker threads in a lock-free union-find, the larger root is
+ *  always linked under the smaller one so the result does not depend on
+ *  scheduling. Components holding two keys of one image are inconsistent
+ *  and dropped, as are components shorter than min_track_length.
+ */
+class HS_EXPORT StreamingTrackBuilder
+{
+public:
+  typedef CompactTrackContainer::Index Index;
+  typedef CompactTrackContainer::Offset Offset;
+
+  StreamingTrackBuilder(size_t number_of_threads,
+                        size_t min_track_length = 2,
+                        size_t batch_size = 65536);
+
+  /**
+   *  image_ids are the photo ids in matches, in image index order.
+   *  number_of_keys[i] is the keyset size of image i.
+   *  The resulting tracks carry photo ids and no points.
+   */
+  int operator() (const std::string& matches_path,
+                  const std::vector<int>& image_ids,
+                  const std::vector<size_t>& number_of_keys,
+                  CompactTrackContainer& tracks,
+                  hs::progress::ProgressManager* progress_manager = nullptr);
+
+private:
+  typedef std::pair<Index, Index> NodePair;
+  typedef std::vector<NodePair> NodePairBatch;
+  typedef std::shared_ptr<NodePairBatch> NodePairBatchPtr;
+
+  Index Find(Index node);
+  void Unite(Index node_a, Index node_b);
+  void UniteWorker();
+  void FlattenWorker(size_t begin, size_t end);
+
+  bool PushBatch(const NodePairBatchPtr& batch);
+  NodePairBatchPtr PopBatch();
+
+  int ReadMatches(const std::string& matches_path,
+                  const std::vector<int>& image_ids,
+                  hs::progress::ProgressManager* progress_manager);
+  int CollectTracks(const std::vector<int>& image_ids,
+                    CompactTrackContainer& tracks);
+
+private:
+  size_t number_of_threads_;
+  size_t min_track_length_;
+  size_t batch_size_;
+
+  std::vector<Offset> key_offsets_;
+  size_t number_of_nodes_;
+  std::unique_ptr<std::atomic<Index>[]> parents_;
+
+  std::mutex queue_mutex_;
+  std::condition_variable queue_not_empty_;
+  std::condition_variable queue_not_full_;
+  std::deque<NodePairBatchPtr> queue_;
+  bool reading_finished_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include <Eigen/Eigenvalues>
+
+#include "workflow/point_cloud/depth_map_estimator.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef MVSCamera::Scalar Scalar;
+typedef MVSCamera::Vector2 Vector2;
+typedef MVSCamera::Vector3 Vector3;
+typedef MVSCamera::Matrix33 Matrix33;
+
+//Relative depth jump that breaks surface continuity between samples.
+const float DEPTH_DISCONTINUITY = 0.05f;
+//Windows with a smaller gray level deviation are treated as textureless.
+const float MIN_WINDOW_DEVIATION = 1.0f;
+//Normals are fitted over (2 * NORMAL_RADIUS + 1)^2 samples.
+const int NORMAL_RADIUS = 2;
+
+}
+
+DepthMap::DepthMap()
+  : width(0)
+  , height(0)
+  , step(1)
+{
+}
+
+void DepthMap::Reset(int width_, int height_, int step_)
+{
+  width = width_;
+  height = height_;
+  step = step_;
+  size_t size = Size();
+  depths.assign(size, 0.0f);
+  scores.assign(size, 0.0f);
+  normals.assign(size * 3, 0.0f);
+  colors.assign(size * 3, 0);
+}
+
+size_t DepthMap::Size() const
+{
+  return size_t(width) * size_t(height);
+}
+
+void DepthMap::Release()
+{
+  width = 0;
+  height = 0;
+  std::vector<float>().swap(depths);
+  std::vector<float>().swap(scores);
+  std::vector<float>().swap(normals);
+  std::vector<Byte>().swap(colors);
+}
+
+DepthMapEstimator::DepthMapEstimator(int window_radius,
+                                     int step,
+                                     float ncc_threshold,
+                                     int min_views,
+                                     int max_number_of_depths)
+  : window_radius_(std::max(window_radius, 1))
+  , step_(std::max(step, 1))
+  , ncc_threshold_(ncc_threshold)
+  , min_views_(std::max(min_views, 2))
+  , max_number_of_depths_(std::max(max_number_of_depths, 3))
+{
+}
+
+int DepthMapEstimator::NumberOfDepths(
+  const MVSView& reference,
+  const std::vector<const MVSView*>& neighbours,
+  float depth_min, float depth_max) const
+{
+  //About half a pixel of epipolar motion per hypothesis.
+  Scalar col = Scalar(reference.width) * Scalar(0.5);
+  Scalar row = Scalar(reference.height) * Scalar(0.5);
+  Vector3 near_point = reference.camera.BackProject(col, row, depth_min);
+  Vector3 far_point = reference.camera.BackProject(col, row, depth_max);
+  Scalar max_distance = 0;
+  for (size_t i = 0; i < neighbours.size(); i++)
+  {
+    Vector2 near_pixel, far_pixel;
+    if (neighbours[i]->camera.Project(near_point, near_pixel) <= 0 ||
+        neighbours[i]->camera.Project(far_point, far_pixel) <= 0) continue;
+    max_distance = std::max(max_distance, (near_pixel - far_pixel).norm());
+  }
+  int number_of_depths = int(std::ceil(max_distance * Scalar(2))) + 1;
+  return std::min(std::max(number_of_depths, 32), max_number_of_depths_);
+}
+
+int DepthMapEstimator::operator() (
+  const MVSView& reference,
+  const std::vector<const MVSView*>& neighbours,
+  float depth_min,
+  float depth_max,
+  DepthMap& depth_map) const
+{
+  int radius = window_radius_;
+  int grid_width = (reference.width + step_ - 1) / step_;
+  int grid_height = (reference.height + step_ - 1) / step_;
+  depth_map.Reset(grid_width, grid_height, step_);
+  if (neighbours.empty() || depth_min <= 0.0f || depth_max <= depth_min ||
+      reference.width <= 2 * radius || reference.height <= 2 * radius)
+  {
+    return 0;
+  }
+
+  size_t number_of_neighbours = neighbours.size();
+  size_t number_of_best =
+    std::min(size_t(min_views_ - 1), number_of_neighbours);
+  int number_of_depths =
+    NumberOfDepths(reference, neighbours, depth_min, depth_max);
+  float inverse_near = 1.0f / depth_min;
+  float inverse_far = 1.0f / depth_max;
+  float inverse_step =
+    (inverse_far - inverse_near) / float(number_of_depths - 1);
+
+  //x_n ~ A * x_r + b / depth for a fronto-parallel plane in the reference.
+  std::vector<float> homographies(
+    size_t(number_of_depths) * number_of_neighbours * 9);
+  for (size_t n = 0; n < number_of_neighbours; n++)
+  {
+    const MVSCamera& camera = neighbours[n]->camera;
+    Matrix33 a = camera.K * camera.R * reference.camera.R.transpose() *
+                 reference.camera.K_inverse;
+    Vector3 b = camera.K * camera.R * (reference.camera.C - camera.C);
+    for (int d = 0; d < number_of_depths; d++)
+    {
+      Scalar inverse_depth = Scalar(inverse_near + float(d) * inverse_step);
+      float* h = &homographies[(size_t(d) * number_of_neighbours + n) * 9];
+      for (int i = 0; i < 3; i++)
+      {
+        h[i * 3 + 0] = float(a(i, 0));
+        h[i * 3 + 1] = float(a(i, 1));
+        h[i * 3 + 2] = float(a(i, 2) + b[i] * inverse_depth);
+      }
+    }
+  }
+
+  int window_size = (2 * radius + 1) * (2 * radius + 1);
+  std::vector<float> reference_window(window_size);
+  std::vector<float> neighbour_scores(number_of_neighbours);
+  std::vector<float> depth_scores(number_of_depths);
+  for (int i = 0; i < grid_height; i++)
+  {
+    int row = i * step_;
+    if (row < radius || row >= reference.height - radius) continue;
+    for (int j = 0; j < grid_width; j++)
+    {
+      int col = j * step_;
+      if (col < radius || col >= reference.width - radius) continue;
+
+      //Zero mean reference window.
+      float mean = 0.0f;
+      int k = 0;
+      for (int dy = -radius; dy <= radius; dy++)
+      {
+        for (int dx = -radius; dx <= radius; dx++, k++)
+        {
+          reference_window[k] = reference.Gray(row + dy, col + dx);
+          mean += reference_window[k];
+        }
+      }
+      mean /= float(window_size);
+      float reference_variance = 0.0f;
+      for (k = 0; k < window_size; k++)
+      {
+        reference_window[k] -= mean;
+        reference_variance += reference_window[k] * reference_window[k];
+      }
+      if (reference_variance < MIN_WINDOW_DEVIATION * MIN_WINDOW_DEVIATION *
+                               float(window_size)) continue;
+
+      int best_depth = -1;
+      float best_score = -1.0f;
+      for (int d = 0; d < number_of_depths; d++)
+      {
+        for (size_t n = 0; n < number_of_neighbours; n++)
+        {
+          const float* h =
+            &homographies[(size_t(d) * number_of_neighbours + n) * 9];
+          const MVSView& neighbour = *neighbours[n];
+          float sum = 0.0f;
+          float sum_square = 0.0f;
+          float sum_product = 0.0f;
+          bool inside = true;
+          k = 0;
+          for (int dy = -radius; dy <= radius && inside; dy++)
+          {
+            float y = float(row + dy);
+            for (int dx = -radius; dx <= radius; dx++, k++)
+            {
+              float x = float(col + dx);
+              float w = h[6] * x + h[7] * y + h[8];
+              if (w <= 0.0f)
+              {
+                inside = false;
+                break;
+              }
+              float u = (h[0] * x + h[1] * y + h[2]) / w;
+              float v = (h[3] * x + h[4] * y + h[5]) / w;
+              float value;
+              if (!neighbour.SampleGray(u, v, value))
+              {
+                inside = false;
+                break;
+              }
+              sum += value;
+              sum_square += value * value;
+              sum_product += reference_window[k] * value;
+            }
+          }
+          float ncc = -1.0f;
+          if (inside)
+          {
+            float variance =
+              sum_square - sum * sum / float(window_size);
+            if (variance > 1e-6f)
+            {
+              //Reference window is zero mean, so the product needs no
+              //correction for the neighbour mean.
+              ncc = sum_product / std::sqrt(variance * reference_variance);
+            }
+          }
+          neighbour_scores[n] = ncc;
+        }
+        std::partial_sort(neighbour_scores.begin(),
+                          neighbour_scores.begin() + number_of_best,
+                          neighbour_scores.end(),
+                          std::greater<float>());
+        float score = 0.0f;
+        for (size_t n = 0; n < number_of_best; n++)
+        {
+          score += neighbour_scores[n];
+        }
+        score /= float(number_of_best);
+        depth_scores[d] = score;
+        if (score > best_score)
+        {
+          best_score = score;
+          best_depth = d;
+        }
+      }
+      if (best_depth < 0 || best_score < ncc_threshold_) continue;
+
+      float offset = 0.0f;
+      if (best_depth > 0 && best_depth + 1 < number_of_depths)
+      {
+        float previous = depth_scores[best_depth - 1];
+        float next = depth_scores[best_depth + 1];
+        float denominator = previous - 2.0f * best_score + next;
+        if (denominator < 0.0f)
+        {
+          offset = 0.5f * (previous - next) / denominator;
+          offset = std::min(std::max(offset, -0.5f), 0.5f);
+        }
+      }
+      float inverse_depth =
+        inverse_near + (float(best_depth) + offset) * inverse_step;
+
+      size_t sample_id = size_t(i) * size_t(grid_width) + size_t(j);
+      depth_map.depths[sample_id] = 1.0f / inverse_depth;
+      depth_map.scores[sample_id] = best_score;
+      size_t pixel_id = size_t(row) * size_t(reference.width) + size_t(col);
+      for (int c = 0; c < 3; c++)
+      {
+        depth_map.colors[sample_id * 3 + c] =
+          reference.colors[pixel_id * 3 + c];
+      }
+    }
+  }
+
+  ComputeNormals(reference, depth_map);
+  return 0;
+}
+
+void DepthMapEstimator::ComputeNormals(const MVSView& reference,
+                                       DepthMap& depth_map) const
+{
+  typedef EIGEN_MATRIX(Scalar, 3, 3) Covariance;
+
+  int width = depth_map.width;
+  int height = depth_map.height;
+  int step = depth_map.step;
+  const MVSCamera& camera = reference.camera;
+  Vector3 backward = -camera.ViewDirection();
+  std::vector<char> isolated(depth_map.Size(), 0);
+
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width; j++)
+    {
+      size_t sample_id = size_t(i) * size_t(width) + size_t(j);
+      float depth = depth_map.depths[sample_id];
+      if (depth <= 0.0f) continue;
+
+      //Plane fit over the continuous samples of the neighbourhood.
+      Vector3 point = camera.BackProject(Scalar(j * step), Scalar(i * step),
+                                         Scalar(depth));
+      Vector3 sum = Vector3::Zero();
+      Covariance sum_outer = Covariance::Zero();
+      int number_of_points = 0;
+      int number_of_adjacent = 0;
+      for (int di = -NORMAL_RADIUS; di <= NORMAL_RADIUS; di++)
+      {
+        int ni = i + di;
+        if (ni < 0 || ni >= height) continue;
+        for (int dj = -NORMAL_RADIUS; dj <= NORMAL_RADIUS; dj++)
+        {
+          int nj = j + dj;
+          if (nj < 0 || nj >= width) continue;
+          float neighbour_depth =
+            depth_map.depths[size_t(ni) * size_t(width) + size_t(nj)];
+          if (neighbour_depth <= 0.0f) continue;
+          if (std::abs(neighbour_depth - depth) >
+              DEPTH_DISCONTINUITY * depth) continue;
+          if (std::abs(di) + std::abs(dj) == 1) number_of_adjacent++;
+          Vector3 neighbour_point = camera.BackProject(
+            Scalar(nj * step), Scalar(ni * step), Scalar(neighbour_depth));
+          Vector3 offset = neighbour_point - point;
+          sum += offset;
+          sum_outer += offset * offset.transpose();
+          number_of_points++;
+        }
+      }
+      if (number_of_adjacent == 0)
+      {
+        isolated[sample_id] = 1;
+        continue;
+      }
+
+      Vector3 normal = backward;
+      if (number_of_points >= 4)
+      {
+        Vector3 mean = sum / Scalar(number_of_points);
+        Covariance covariance = sum_outer / Scalar(number_of_points) -
+                                mean * mean.transpose();
+        Eigen::SelfAdjointEigenSolver<Covariance> solver(covariance);
+        //Eigen values are sorted increasingly.
+        if (solver.info() == Eigen::Success &&
+            solver.eigenvalues()[1] > Scalar(0))
+        {
+          normal = solver.eigenvectors().col(0);
+          if (normal.dot(camera.C - point) < Scalar(0)) normal = -normal;
+        }
+      }
+      for (int c = 0; c < 3; c++)
+      {
+        depth_map.normals[sample_id * 3 + c] = float(normal[c]);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < isolated.size(); i++)
+  {
+    if (isolated[i]) depth_map.depths[i] = 0.0f;
+  }
+}
+
+}
+}
+}
@@ -0,0 +1,85 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_ESTIMATOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_ESTIMATOR_HPP_
+
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/mvs_view.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Depth, matching score, normal and color of a reference view, sampled
+ *  every step pixels. Sample (i, j) lies at pixel (j * step, i * step).
+ *  Invalid samples have depth 0.
+ */
+struct HS_EXPORT DepthMap
+{
+  typedef unsigned char Byte;
+
+  DepthMap();
+
+  void Reset(int width, int height, int step);
+  size_t Size() const;
+  void Release();
+
+  int width;
+  int height;
+  int step;
+  std::vector<float> depths;
+  std::vector<float> scores;
+  //Three world frame components per sample.
+  std::vector<float> normals;
+  //Three bytes per sample.
+  std::vector<Byte> colors;
+};
+
+/**
+ *  Fronto-parallel plane sweep with NCC.
+ *
+ *  For every depth hypothesis each neighbour is warped to the reference by
+ *  the plane homography. The score of a hypothesis is the mean of the best
+ *  min_views - 1 neighbour NCCs, so a depth is only kept if enough views
+ *  agree on it. Depths are sampled uniformly in inverse depth and refined
+ *  by a parabola through the best score and its two neighbours.
+ */
+class HS_EXPORT DepthMapEstimator
+{
+public:
+  DepthMapEstimator(int window_radius,
+                    int step,
+                    float ncc_threshold,
+                    int min_views,
+                    int max_number_of_depths = 256);
+
+  int operator() (const MVSView& reference,
+                  const std::vector<const MVSView*>& neighbours,
+                  float depth_min,
+                  float depth_max,
+                  DepthMap& depth_map) const;
+
+private:
+  int NumberOfDepths(const MVSView& reference,
+                     const std::vector<const MVSView*>& neighbours,
+                     float depth_min, float depth_max) const;
+  void ComputeNormals(const MVSView& reference, DepthMap& depth_map) const;
+
+private:
+  int window_radius_;
+  int step_;
+  float ncc_threshold_;
+  int min_views_;
+  int max_number_of_depths_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,307 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+
+#include <boost/filesystem.hpp>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/point_cloud/depth_map_fusion.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef DepthMapFusion::Scalar Scalar;
+typedef DepthMapFusion::PointCloudData PointCloudData;
+typedef PointCloudData::Vector3 Vector3;
+typedef MVSCamera::Vector2 Vector2;
+typedef DepthMapTileReader::Byte Byte;
+typedef std::unique_ptr<DepthMapTileReader> DepthMapTileReaderPtr;
+
+//Record of the per view point files.
+struct FusedPoint
+{
+  double position[3];
+  float normal[3];
+  Byte color[3];
+  Byte padding;
+};
+
+//Points buffered per view before they are appended to its file.
+const size_t FUSION_BUFFER_SIZE = 65536;
+
+struct FusionWorker
+{
+  FusionWorker(const std::vector<MVSCamera>& cameras_,
+               const std::vector<std::string>& depth_map_paths_,
+               const std::vector<std::vector<size_t> >& neighbours_,
+               const std::vector<std::string>& fused_paths_,
+               const std::vector<char>* reference_views_,
+               int min_views_, float depth_tolerance_,
+               int min_reference_views_,
+               std::vector<char>& view_results_)
+    : cameras(cameras_), depth_map_paths(depth_map_paths_),
+      neighbours(neighbours_), fused_paths(fused_paths_),
+      reference_views(reference_views_),
+      min_views(min_views_), depth_tolerance(depth_tolerance_),
+      min_reference_views(min_reference_views_),
+      view_results(view_results_) {}
+
+  bool IsReference(size_t view_id) const
+  {
+    return !reference_views || (*reference_views)[view_id];
+  }
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t view_id = begin; view_id < end; view_id++)
+    {
+      view_results[view_id] = char(FuseView(view_id) == 0);
+    }
+  }
+
+  int FlushPoints(std::ofstream& file, std::vector<FusedPoint>& points)
+  {
+    if (!points.empty())
+    {
+      file.write(reinterpret_cast<const char*>(points.data()),
+                 points.size() * sizeof(FusedPoint));
+      points.clear();
+    }
+    return file.good() ? 0 : -1;
+  }
+
+  int FuseView(size_t view_id)
+  {
+    std::ofstream fused_file(fused_paths[view_id], std::ios::binary);
+    if (!fused_file) return -1;
+    if (!IsReference(view_id)) return 0;
+
+    DepthMapTileReader reference;
+    if (reference.Open(depth_map_paths[view_id]) != 0) return 0;
+
+    const MVSCamera& camera = cameras[view_id];
+    const std::vector<size_t>& view_neighbours = neighbours[view_id];
+    std::vector<DepthMapTileReaderPtr> readers(view_neighbours.size());
+    for (size_t k = 0; k < view_neighbours.size(); k++)
+    {
+      readers[k].reset(new DepthMapTileReader);
+      if (readers[k]->Open(depth_map_paths[view_neighbours[k]]) != 0)
+      {
+        readers[k].reset();
+      }
+    }
+
+    std::vector<FusedPoint> buffer;
+    buffer.reserve(FUSION_BUFFER_SIZE);
+    int step = reference.step();
+    for (int i = 0; i < reference.height(); i++)
+    {
+      for (int j = 0; j < reference.width(); j++)
+      {
+        float depth;
+        float normal[3];
+        Byte color[3];
+        if (!reference.Sample(i, j, depth, normal, color)) continue;
+
+        Vector3 point = camera.BackProject(Scalar(j * step),
+                                           Scalar(i * step),
+                                           Scalar(depth));
+        Vector3 point_sum = point;
+        Vector3 normal_sum(normal[0], normal[1], normal[2]);
+        Vector3 color_sum(color[0], color[1], color[2]);
+        int number_of_views = 1;
+        int number_of_references = 1;
+        bool owned = true;
+        for (size_t k = 0; k < view_neighbours.size() && owned; k++)
+        {
+          const DepthMapTileReader* reader = readers[k].get();
+          if (!reader) continue;
+          size_t neighbour_id = view_neighbours[k];
+          const MVSCamera& neighbour_camera = cameras[neighbour_id];
+          Vector2 pixel;
+          Scalar projected_depth = neighbour_camera.Project(point, pixel);
+          if (projected_depth <= Scalar(0)) continue;
+          int neighbour_step = reader->step();
+          int ni = int(std::floor(pixel[1] / neighbour_step + 0.5));
+          int nj = int(std::floor(pixel[0] / neighbour_step + 0.5));
+          float neighbour_depth;
+          float neighbour_normal[3];
+          Byte neighbour_color[3];
+          if (!reader->Sample(ni, nj, neighbour_depth,
+                              neighbour_normal, neighbour_color)) continue;
+          if (std::abs(Scalar(neighbour_depth) - projected_depth) >
+              Scalar(depth_tolerance) * projected_depth) continue;
+
+          bool is_reference = IsReference(neighbour_id);
+          if (is_reference && neighbour_id < view_id)
+          {
+            owned = false;
+            break;
+          }
+          point_sum += neighbour_camera.BackProject(
+                         Scalar(nj * neighbour_step),
+                         Scalar(ni * neighbour_step),
+                         Scalar(neighbour_depth));
+          for (int c = 0; c < 3; c++)
+          {
+            normal_sum[c] += neighbour_normal[c];
+            color_sum[c] += neighbour_color[c];
+          }
+          number_of_views++;
+          if (is_reference) number_of_references++;
+        }
+        if (!owned || number_of_views < min_views ||
+            number_of_references < min_reference_views) continue;
+
+        Scalar inverse_count = Scalar(1) / Scalar(number_of_views);
+        Scalar normal_length = normal_sum.norm();
+        if (normal_length > Scalar(0)) normal_sum /= normal_length;
+        FusedPoint fused_point;
+        for (int c = 0; c < 3; c++)
+        {
+          fused_point.position[c] = point_sum[c] * inverse_count;
+          fused_point.normal[c] = float(normal_sum[c]);
+          fused_point.color[c] =
+            Byte(std::min(color_sum[c] * inverse_count + Scalar(0.5),
+                          Scalar(255)));
+        }
+        fused_point.padding = 0;
+        buffer.push_back(fused_point);
+        if (buffer.size() >= FUSION_BUFFER_SIZE &&
+            FlushPoints(fused_file, buffer) != 0) return -1;
+      }
+    }
+
+    return FlushPoints(fused_file, buffer);
+  }
+
+  const std::vector<MVSCamera>& cameras;
+  const std::vector<std::string>& depth_map_paths;
+  const std::vector<std::vector<size_t> >& neighbours;
+  const std::vector<std::string>& fused_paths;
+  const std::vector<char>* reference_views;
+  int min_views;
+  float depth_tolerance;
+  int min_reference_views;
+  std::vector<char>& view_results;
+};
+
+}
+
+DepthMapFusion::DepthMapFusion(size_t number_of_threads,
+                               int min_views,
+                               float depth_tolerance,
+                               int min_reference_views)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , min_views_(std::max(min_views, 1))
+  , depth_tolerance_(depth_tolerance)
+  , min_reference_views_(std::max(min_reference_views, 1))
+{
+}
+
+int DepthMapFusion::operator() (
+  const std::vector<MVSCamera>& cameras,
+  const std::vector<std::string>& depth_map_paths,
+  const std::vector<std::vector<size_t> >& neighbours,
+  const std::vector<std::string>& fused_paths,
+  PointCloudData& point_cloud,
+  const std::vector<char>* reference_views) const
+{
+  size_t number_of_views = cameras.size();
+  if (depth_map_paths.size() != number_of_views ||
+      neighbours.size() != number_of_views ||
+      fused_paths.size() != number_of_views ||
+      (reference_views && reference_views->size() != number_of_views))
+  {
+    return -1;
+  }
+
+  std::vector<char> view_results(number_of_views, 0);
+  FusionWorker worker(cameras, depth_map_paths, neighbours, fused_paths,
+                      reference_views, min_views_, depth_tolerance_,
+                      min_reference_views_, view_results);
+  ParallelForDynamic(0, number_of_views, number_of_threads_, 1, worker);
+  int result = 0;
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    if (!view_results[i]) result = -1;
+  }
+  if (result == 0)
+  {
+    result = Collect(fused_paths, point_cloud);
+  }
+
+  boost::system::error_code error_code;
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    boost::filesystem::remove(boost::filesystem::path(fused_paths[i]),
+                              error_code);
+  }
+  return result;
+}
+
+int DepthMapFusion::Collect(const std::vector<std::string>& fused_paths,
+                            PointCloudData& point_cloud) const
+{
+  //Concatenate in view order so the result does not depend on scheduling.
+  boost::system::error_code error_code;
+  size_t number_of_points = 0;
+  for (size_t i = 0; i < fused_paths.size(); i++)
+  {
+    uintmax_t file_size = boost::filesystem::file_size(
+      boost::filesystem::path(fused_paths[i]), error_code);
+    if (error_code) return -1;
+    number_of_points += size_t(file_size / sizeof(FusedPoint));
+  }
+
+  point_cloud.VertexData().clear();
+  point_cloud.NormalData().clear();
+  point_cloud.ColorData().clear();
+  point_cloud.VertexData().reserve(number_of_points);
+  point_cloud.NormalData().reserve(number_of_points);
+  point_cloud.ColorData().reserve(number_of_points);
+  std::vector<FusedPoint> buffer(FUSION_BUFFER_SIZE);
+  for (size_t i = 0; i < fused_paths.size(); i++)
+  {
+    std::ifstream fused_file(fused_paths[i], std::ios::binary);
+    if (!fused_file) return -1;
+    while (fused_file)
+    {
+      fused_file.read(reinterpret_cast<char*>(buffer.data()),
+                      buffer.size() * sizeof(FusedPoint));
+      size_t number_read =
+        size_t(fused_file.gcount()) / sizeof(FusedPoint);
+      for (size_t k = 0; k < number_read; k++)
+      {
+        const FusedPoint& fused_point = buffer[k];
+        point_cloud.VertexData().push_back(
+          Vector3(fused_point.position[0],
+                  fused_point.position[1],
+                  fused_point.position[2]));
+        point_cloud.NormalData().push_back(
+          Vector3(fused_point.normal[0],
+                  fused_point.normal[1],
+                  fused_point.normal[2]));
+        point_cloud.ColorData().push_back(
+          Vector3(fused_point.color[0],
+                  fused_point.color[1],
+                  fused_point.color[2]) / 255.0);
+      }
+    }
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,74 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_FUSION_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_FUSION_HPP_
+
+#include <string>
+#include <vector>
+
+#include "hs_graphics/graphics_utility/pointcloud_data.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/mvs_view.hpp"
+#include "workflow/point_cloud/depth_map_tiles.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Fuses tiled depth maps into a point cloud out of core.
+ *
+ *  A sample of view i is kept if at least min_views views, itself included,
+ *  see the same surface within depth_tolerance relative depth. The fused
+ *  point is the mean of the agreeing samples. It is emitted only by the
+ *  lowest indexed agreeing view, so surfaces seen by many views are not
+ *  duplicated and views can be fused in parallel without sharing state.
+ *  neighbours[i] should be symmetric for that rule to hold.
+ *
+ *  If reference_views is given, only the views set in it emit points, and
+ *  a point also needs min_reference_views of them among the agreeing views.
+ *  The other views still vote, which is how views borrowed by a cluster
+ *  support it without duplicating the points of their own cluster.
+ *
+ *  Depth maps are read through DepthMapTileReader mappings and the points
+ *  of view i are streamed to fused_paths[i], so memory does not grow with
+ *  the number of views. The point files are concatenated in view order at
+ *  the end and removed.
+ */
+class HS_EXPORT DepthMapFusion
+{
+public:
+  typedef MVSCamera::Scalar Scalar;
+  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+
+  DepthMapFusion(size_t number_of_threads,
+                 int min_views,
+                 float depth_tolerance = 0.01f,
+                 int min_reference_views = 1);
+
+  int operator() (const std::vector<MVSCamera>& cameras,
+                  const std::vector<std::string>& depth_map_paths,
+                  const std::vector<std::vector<size_t> >& neighbours,
+                  const std::vector<std::string>& fused_paths,
+                  PointCloudData& point_cloud,
+                  const std::vector<char>* reference_views = nullptr) const;
+
+private:
+  int Collect(const std::vector<std::string>& fused_paths,
+              PointCloudData& point_cloud) const;
+
+private:
+  size_t number_of_threads_;
+  int min_views_;
+  float depth_tolerance_;
+  int min_reference_views_;
+};
+
+}
+}
+}
+
+#endif
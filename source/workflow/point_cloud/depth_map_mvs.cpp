@@ -0,0 +1,1095 @@
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <utility>
+
+#include <boost/filesystem.hpp>
+
+#include "workflow/common/chunked_point_cloud.hpp"
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/point_cloud/depth_map_fusion.hpp"
+#include "workflow/point_cloud/depth_map_tiles.hpp"
+#include "workflow/point_cloud/sgm_depth_estimator.hpp"
+#include "workflow/point_cloud/view_clusterer.hpp"
+#include "workflow/point_cloud/depth_map_mvs.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef DepthMapMVS::Scalar Scalar;
+typedef DepthMapMVS::Vector3 Vector3;
+typedef DepthMapMVS::Vector3Container Vector3Container;
+typedef DepthMapMVS::PointCloudData PointCloudData;
+typedef MVSCamera::Vector2 Vector2;
+typedef CompactTrackContainer::Index Index;
+
+//Views seeing fewer sparse points are not reconstructed.
+const size_t MIN_VISIBLE_POINTS = 8;
+//Sparse points per view used to score neighbours.
+const size_t MAX_SCORING_POINTS = 512;
+//Candidate neighbours per requested neighbour, nearest centres first.
+const size_t CANDIDATE_FACTOR = 8;
+//Sparse points sampled to estimate the sample distance.
+const size_t MAX_DISTANCE_POINTS = 4096;
+//Best neighbours each view is paired with for SGM.
+const size_t SGM_PAIRS_PER_VIEW = 2;
+const int SGM_MAX_DISPARITIES = 256;
+
+/**
+ *  Thread safe progress of one stage, mapped into [base, base + span].
+ */
+class StageProgress
+{
+public:
+  StageProgress(hs::progress::ProgressManager* progress_manager,
+                float base, float span, size_t total)
+    : progress_manager_(progress_manager), base_(base), span_(span),
+      total_(std::max(total, size_t(1))), finished_(0) {}
+
+  //Returns false if the user cancelled.
+  bool Advance()
+  {
+    if (!progress_manager_) return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    finished_++;
+    progress_manager_->SetCurrentSubProgressCompleteRatio(
+      base_ + span_ * float(finished_) / float(total_));
+    return progress_manager_->CheckKeepWorking();
+  }
+
+  bool KeepWorking()
+  {
+    if (!progress_manager_) return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    return progress_manager_->CheckKeepWorking();
+  }
+
+private:
+  hs::progress::ProgressManager* progress_manager_;
+  float base_;
+  float span_;
+  size_t total_;
+  size_t finished_;
+  std::mutex mutex_;
+};
+
+void SortUnique(std::vector<size_t>& values)
+{
+  std::sort(values.begin(), values.end());
+  values.erase(std::unique(values.begin(), values.end()), values.end());
+}
+
+bool IsInside(const MVSView& view, const Vector2& pixel)
+{
+  return pixel[0] >= Scalar(0) && pixel[1] >= Scalar(0) &&
+         pixel[0] <= Scalar(view.width - 1) &&
+         pixel[1] <= Scalar(view.height - 1);
+}
+
+//Photo ids are small and dense, so a flat table maps them to views.
+void BuildPhotoViewTable(const std::vector<MVSView>& views,
+                         std::vector<Index>& photo_views)
+{
+  size_t number_of_photos = 0;
+  for (size_t i = 0; i < views.size(); i++)
+  {
+    if (views[i].photo_id >= 0)
+    {
+      number_of_photos = std::max(number_of_photos,
+                                  size_t(views[i].photo_id) + 1);
+    }
+  }
+  photo_views.assign(number_of_photos, CompactTrackContainer::INVALID_INDEX);
+  for (size_t i = 0; i < views.size(); i++)
+  {
+    if (views[i].photo_id >= 0) photo_views[views[i].photo_id] = Index(i);
+  }
+}
+
+//Robust depth range with a margin.
+void SetDepthRange(std::vector<Scalar>& depths, size_t view_id,
+                   std::vector<float>& depth_ranges)
+{
+  size_t low = depths.size() / 50;
+  size_t high = depths.size() - 1 - low;
+  std::nth_element(depths.begin(), depths.begin() + low, depths.end());
+  Scalar depth_min = depths[low];
+  std::nth_element(depths.begin(), depths.begin() + high, depths.end());
+  Scalar depth_max = depths[high];
+  depth_ranges[view_id * 2 + 0] = float(depth_min * Scalar(0.8));
+  depth_ranges[view_id * 2 + 1] = float(depth_max * Scalar(1.25));
+}
+
+//scores hold (-score, view id), so higher score first, lower index on ties.
+void KeepBestNeighbours(std::vector<std::pair<Scalar, size_t> >& scores,
+                        size_t number_of_neighbours,
+                        std::vector<size_t>& view_neighbours)
+{
+  std::sort(scores.begin(), scores.end());
+  for (size_t k = 0; k < scores.size() && k < number_of_neighbours; k++)
+  {
+    view_neighbours.push_back(scores[k].second);
+  }
+}
+
+struct ViewBuildWorker
+{
+  ViewBuildWorker(const DepthMapMVS::PhotoContainer& photos_,
+                  const MVSViewBuilder& builder_,
+                  const std::vector<std::string>& cache_paths_,
+                  std::vector<MVSView>& views_,
+                  StageProgress& progress_)
+    : photos(photos_), builder(builder_), cache_paths(cache_paths_),
+      views(views_), progress(progress_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      if (!progress.KeepWorking()) return;
+      const DepthMapMVS::Photo& photo = photos[i];
+      MVSView& view = views[i];
+      if (builder(photo.photo_id, photo.path,
+                  photo.intrinsic_params, photo.extrinsic_params,
+                  view) != 0 ||
+          view.SaveImages(cache_paths[i]) != 0)
+      {
+        view.width = 0;
+        view.height = 0;
+      }
+      view.ReleaseImages();
+      progress.Advance();
+    }
+  }
+
+  const DepthMapMVS::PhotoContainer& photos;
+  const MVSViewBuilder& builder;
+  const std::vector<std::string>& cache_paths;
+  std::vector<MVSView>& views;
+  StageProgress& progress;
+};
+
+struct NeighbourWorker
+{
+  NeighbourWorker(const std::vector<MVSView>& views_,
+                  const Vector3Container& sparse_points_,
+                  size_t number_of_neighbours_,
+                  std::vector<std::vector<size_t> >& neighbours_,
+                  std::vector<float>& depth_ranges_)
+    : views(views_), sparse_points(sparse_points_),
+      number_of_neighbours(number_of_neighbours_),
+      neighbours(neighbours_), depth_ranges(depth_ranges_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      SelectView(i);
+    }
+  }
+
+  void SelectView(size_t view_id)
+  {
+    const MVSView& view = views[view_id];
+    neighbours[view_id].clear();
+    depth_ranges[view_id * 2 + 0] = 0.0f;
+    depth_ranges[view_id * 2 + 1] = 0.0f;
+    if (view.width <= 0 || view.height <= 0) return;
+
+    std::vector<size_t> visible_points;
+    std::vector<Scalar> depths;
+    for (size_t i = 0; i < sparse_points.size(); i++)
+    {
+      Vector2 pixel;
+      Scalar depth = view.camera.Project(sparse_points[i], pixel);
+      if (depth <= Scalar(0) || !IsInside(view, pixel)) continue;
+      visible_points.push_back(i);
+      depths.push_back(depth);
+    }
+    if (visible_points.size() < MIN_VISIBLE_POINTS) return;
+    SetDepthRange(depths, view_id, depth_ranges);
+
+    //Nearest camera centres looking the same way are the candidates.
+    Vector3 direction = view.camera.ViewDirection();
+    std::vector<std::pair<Scalar, size_t> > candidates;
+    for (size_t j = 0; j < views.size(); j++)
+    {
+      if (j == view_id || views[j].width <= 0) continue;
+      if (direction.dot(views[j].camera.ViewDirection()) < Scalar(0)) continue;
+      candidates.push_back(std::make_pair(
+        (views[j].camera.C - view.camera.C).squaredNorm(), j));
+    }
+    size_t number_of_candidates =
+      std::min(candidates.size(), number_of_neighbours * CANDIDATE_FACTOR);
+    std::partial_sort(candidates.begin(),
+                      candidates.begin() + number_of_candidates,
+                      candidates.end());
+
+    size_t stride = std::max(visible_points.size() / MAX_SCORING_POINTS,
+                             size_t(1));
+    std::vector<std::pair<Scalar, size_t> > scores;
+    for (size_t k = 0; k < number_of_candidates; k++)
+    {
+      size_t candidate_id = candidates[k].second;
+      const MVSView& candidate = views[candidate_id];
+      Scalar score = 0;
+      for (size_t i = 0; i < visible_points.size(); i += stride)
+      {
+        const Vector3& point = sparse_points[visible_points[i]];
+        Vector2 pixel;
+        if (candidate.camera.Project(point, pixel) <= Scalar(0) ||
+            !IsInside(candidate, pixel)) continue;
+        score += TriangulationWeight(view.camera.C, candidate.camera.C,
+                                     point);
+      }
+      if (score > Scalar(0))
+      {
+        scores.push_back(std::make_pair(-score, candidate_id));
+      }
+    }
+    KeepBestNeighbours(scores, number_of_neighbours, neighbours[view_id]);
+  }
+
+  const std::vector<MVSView>& views;
+  const Vector3Container& sparse_points;
+  size_t number_of_neighbours;
+  std::vector<std::vector<size_t> >& neighbours;
+  std::vector<float>& depth_ranges;
+};
+
+/**
+ *  Scores the views sharing tracks with each view, the tracks of a view
+ *  being those of its photo in photo_tracks.
+ */
+struct TrackNeighbourWorker
+{
+  TrackNeighbourWorker(const std::vector<MVSView>& views_,
+                       const CompactTrackContainer& tracks_,
+                       const Vector3Container& sparse_points_,
+                       const std::vector<Index>& photo_views_,
+                       const DepthMapMVS::PhotoTracks& photo_tracks_,
+                       size_t number_of_neighbours_,
+                       std::vector<std::vector<size_t> >& neighbours_,
+                       std::vector<float>& depth_ranges_)
+    : views(views_), tracks(tracks_), sparse_points(sparse_points_),
+      photo_views(photo_views_), photo_tracks(photo_tracks_),
+      number_of_neighbours(number_of_neighbours_),
+      neighbours(neighbours_), depth_ranges(depth_ranges_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    //Dense scores reset through the touched list, one pair per block.
+    std::vector<Scalar> scores(views.size(), Scalar(0));
+    std::vector<size_t> touched;
+    for (size_t i = begin; i < end; i++)
+    {
+      SelectView(i, scores, touched);
+    }
+  }
+
+  void SelectView(size_t view_id, std::vector<Scalar>& scores,
+                  std::vector<size_t>& touched)
+  {
+    const MVSView& view = views[view_id];
+    neighbours[view_id].clear();
+    depth_ranges[view_id * 2 + 0] = 0.0f;
+    depth_ranges[view_id * 2 + 1] = 0.0f;
+    if (view.width <= 0 || view.height <= 0 || view.photo_id < 0 ||
+        size_t(view.photo_id) + 1 >= photo_tracks.offsets.size()) return;
+
+    std::vector<Scalar> depths;
+    touched.clear();
+    size_t photo_id = size_t(view.photo_id);
+    for (size_t k = photo_tracks.offsets[photo_id];
+         k < photo_tracks.offsets[photo_id + 1]; k++)
+    {
+      Index track_id = photo_tracks.track_ids[k];
+      const Vector3& point = sparse_points[tracks.PointId(track_id)];
+      Vector2 pixel;
+      Scalar depth = view.camera.Project(point, pixel);
+      if (depth <= Scalar(0)) continue;
+      depths.push_back(depth);
+
+      const Index* image_ids = tracks.TrackImageIds(track_id);
+      size_t track_size = tracks.TrackSize(track_id);
+      for (size_t l = 0; l < track_size; l++)
+      {
+        Index other_id = image_ids[l] < photo_views.size() ?
+                         photo_views[image_ids[l]] :
+                         CompactTrackContainer::INVALID_INDEX;
+        if (other_id == CompactTrackContainer::INVALID_INDEX ||
+            other_id == view_id || views[other_id].width <= 0) continue;
+        Scalar weight = TriangulationWeight(view.camera.C,
+                                            views[other_id].camera.C,
+                                            point);
+        if (weight <= Scalar(0)) continue;
+        if (scores[other_id] == Scalar(0)) touched.push_back(other_id);
+        scores[other_id] += weight;
+      }
+    }
+
+    std::vector<std::pair<Scalar, size_t> > view_scores;
+    for (size_t k = 0; k < touched.size(); k++)
+    {
+      view_scores.push_back(std::make_pair(-scores[touched[k]], touched[k]));
+      scores[touched[k]] = Scalar(0);
+    }
+    if (depths.size() < MIN_VISIBLE_POINTS) return;
+    SetDepthRange(depths, view_id, depth_ranges);
+    KeepBestNeighbours(view_scores, number_of_neighbours,
+                       neighbours[view_id]);
+  }
+
+  const std::vector<MVSView>& views;
+  const CompactTrackContainer& tracks;
+  const Vector3Container& sparse_points;
+  const std::vector<Index>& photo_views;
+  const DepthMapMVS::PhotoTracks& photo_tracks;
+  size_t number_of_neighbours;
+  std::vector<std::vector<size_t> >& neighbours;
+  std::vector<float>& depth_ranges;
+};
+
+/**
+ *  Estimates the depth map of each view and writes it as tiles, so only
+ *  the maps in flight are held in memory.
+ */
+struct DepthMapWorker
+{
+  DepthMapWorker(const std::vector<MVSView>& views_,
+                 const std::vector<std::string>& cache_paths_,
+                 const std::vector<std::vector<size_t> >& neighbours_,
+                 const std::vector<float>& depth_ranges_,
+                 const DepthMapEstimator& estimator_,
+                 const DepthMapTileWriter& writer_,
+                 const std::vector<std::string>& depth_map_paths_,
+                 StageProgress& progress_)
+    : views(views_), cache_paths(cache_paths_), neighbours(neighbours_),
+      depth_ranges(depth_ranges_), estimator(estimator_), writer(writer_),
+      depth_map_paths(depth_map_paths_), progress(progress_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      if (!progress.KeepWorking()) return;
+      EstimateView(i);
+      progress.Advance();
+    }
+  }
+
+  void EstimateView(size_t view_id)
+  {
+    const std::vector<size_t>& view_neighbours = neighbours[view_id];
+    if (view_neighbours.empty()) return;
+
+    MVSView reference = views[view_id];
+    if (reference.LoadImages(cache_paths[view_id]) != 0) return;
+    std::vector<MVSView> neighbour_views(view_neighbours.size());
+    std::vector<const MVSView*> neighbour_pointers;
+    for (size_t k = 0; k < view_neighbours.size(); k++)
+    {
+      size_t neighbour_id = view_neighbours[k];
+      neighbour_views[k] = views[neighbour_id];
+      if (neighbour_views[k].LoadImages(cache_paths[neighbour_id]) != 0)
+      {
+        continue;
+      }
+      neighbour_pointers.push_back(&neighbour_views[k]);
+    }
+
+    DepthMap depth_map;
+    if (estimator(reference, neighbour_pointers,
+                  depth_ranges[view_id * 2 + 0],
+                  depth_ranges[view_id * 2 + 1],
+                  depth_map) != 0) return;
+    //A view whose tiles are missing is skipped by the fusion.
+    writer(depth_map, depth_map_paths[view_id]);
+  }
+
+  const std::vector<MVSView>& views;
+  const std::vector<std::string>& cache_paths;
+  const std::vector<std::vector<size_t> >& neighbours;
+  const std::vector<float>& depth_ranges;
+  const DepthMapEstimator& estimator;
+  const DepthMapTileWriter& writer;
+  const std::vector<std::string>& depth_map_paths;
+  StageProgress& progress;
+};
+
+/**
+ *  Reconstructs each cluster on its own: neighbours, depth maps and fusion
+ *  only see the views of the cluster, so clusters run side by side. Only
+ *  the home views of a cluster emit points, which merges the overlapping
+ *  clusters without duplicates. The points of a cluster are appended to
+ *  the writer as soon as it is fused and dropped.
+ */
+struct ClusterWorker
+{
+  ClusterWorker(const DepthMapMVSOptions& options_,
+                const std::vector<MVSView>& views_,
+                const std::vector<std::string>& cache_paths_,
+                const std::vector<std::vector<size_t> >& clusters_,
+                const std::vector<size_t>& home_clusters_,
+                const std::vector<std::vector<std::string> >& depth_map_paths_,
+                const std::vector<std::vector<std::string> >& fused_paths_,
+                const Vector3Container& sparse_points_,
+                const CompactTrackContainer* tracks_,
+                const DepthMapMVS::PhotoTracks* photo_tracks_,
+                const PointCloudFilterOptions* filter_options_,
+                StageProgress& progress_,
+                ChunkedPointCloudWriter& writer_,
+                std::mutex& writer_mutex_,
+                size_t& number_of_points_,
+                std::vector<char>& cluster_results_)
+    : options(options_), views(views_), cache_paths(cache_paths_),
+      clusters(clusters_), home_clusters(home_clusters_),
+      depth_map_paths(depth_map_paths_), fused_paths(fused_paths_),
+      sparse_points(sparse_points_), tracks(tracks_),
+      photo_tracks(photo_tracks_), filter_options(filter_options_),
+      progress(progress_), writer(writer_), writer_mutex(writer_mutex_),
+      number_of_points(number_of_points_),
+      cluster_results(cluster_results_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      if (!progress.KeepWorking()) return;
+      cluster_results[i] = char(ReconstructCluster(i) == 0);
+    }
+  }
+
+  int ReconstructCluster(size_t cluster_id)
+  {
+    const std::vector<size_t>& cluster = clusters[cluster_id];
+    size_t number_of_views = cluster.size();
+    std::vector<MVSView> cluster_views(number_of_views);
+    std::vector<std::string> cluster_cache_paths(number_of_views);
+    std::vector<char> home_views(number_of_views);
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      cluster_views[i] = views[cluster[i]];
+      cluster_cache_paths[i] = cache_paths[cluster[i]];
+      home_views[i] = char(home_clusters[cluster[i]] == cluster_id);
+    }
+
+    DepthMapMVS depth_map_mvs(options);
+    std::vector<std::vector<size_t> > neighbours;
+    std::vector<float> depth_ranges;
+    if (tracks && photo_tracks)
+    {
+      depth_map_mvs.SelectNeighboursFromTracks(cluster_views, *tracks,
+                                               sparse_points, *photo_tracks,
+                                               neighbours, depth_ranges);
+    }
+    else
+    {
+      depth_map_mvs.SelectNeighbours(cluster_views, sparse_points,
+                                     neighbours, depth_ranges);
+    }
+
+    //Fusion checks agreement both ways, so make the neighbourhood
+    //symmetric.
+    std::vector<std::vector<size_t> > fusion_neighbours(neighbours);
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      for (size_t k = 0; k < neighbours[i].size(); k++)
+      {
+        fusion_neighbours[neighbours[i][k]].push_back(i);
+      }
+    }
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      SortUnique(fusion_neighbours[i]);
+    }
+
+    std::vector<MVSCamera> cameras;
+    std::vector<std::string> map_paths;
+    std::vector<std::string> map_fused_paths;
+    std::vector<std::vector<size_t> > map_neighbours;
+    std::vector<char> reference_maps;
+    if (options.method == DepthMapMVSOptions::METHOD_SGM)
+    {
+      EstimatePairs(cluster_id, cluster_views, cluster_cache_paths,
+                    neighbours, fusion_neighbours, depth_ranges, home_views,
+                    cameras, map_paths, map_fused_paths, map_neighbours,
+                    reference_maps);
+    }
+    else
+    {
+      map_paths = depth_map_paths[cluster_id];
+      map_fused_paths = fused_paths[cluster_id];
+      map_neighbours.swap(fusion_neighbours);
+      reference_maps.swap(home_views);
+      cameras.resize(number_of_views);
+      for (size_t i = 0; i < number_of_views; i++)
+      {
+        cameras[i] = cluster_views[i].camera;
+      }
+      DepthMapEstimator estimator(options.window_radius,
+                                  options.sample_step,
+                                  options.ncc_threshold,
+                                  options.min_views);
+      DepthMapTileWriter writer(options.tile_size);
+      DepthMapWorker worker(cluster_views, cluster_cache_paths,
+                            neighbours, depth_ranges,
+                            estimator, writer, map_paths,
+                            progress);
+      ParallelForDynamic(0, number_of_views, options.number_of_threads, 1,
+                         worker);
+    }
+
+    int result = -1;
+    if (progress.KeepWorking())
+    {
+      DepthMapFusion fusion(options.number_of_threads, options.min_views,
+                            options.depth_tolerance, options.min_home_views);
+      PointCloudData cluster_cloud;
+      result = fusion(cameras, map_paths, map_neighbours,
+                      map_fused_paths, cluster_cloud, &reference_maps);
+      //The filter only fails when nothing or a degenerate cloud is left,
+      //which drops the cluster rather than the whole block.
+      if (result == 0 && filter_options &&
+          !cluster_cloud.VertexData().empty())
+      {
+        PointCloudFilterOptions cluster_filter_options = *filter_options;
+        cluster_filter_options.number_of_threads = options.number_of_threads;
+        PointCloudFilter filter(cluster_filter_options);
+        if (filter(cluster_cloud) != 0) cluster_cloud = PointCloudData();
+      }
+      if (result == 0)
+      {
+        std::lock_guard<std::mutex> lock(writer_mutex);
+        result = writer.Append(cluster_cloud);
+        number_of_points += cluster_cloud.VertexData().size();
+      }
+    }
+
+    boost::system::error_code error_code;
+    for (size_t i = 0; i < map_paths.size(); i++)
+    {
+      boost::filesystem::remove(boost::filesystem::path(map_paths[i]),
+                                error_code);
+    }
+    return result;
+  }
+
+  /**
+   *  Matches each view with its best neighbours by SGM. Every pair gives
+   *  one depth map in the rectified camera of its left view, which is the
+   *  view with the lower index. Maps are neighbours in the fusion if their
+   *  views are, and belong to the home of their left view.
+   */
+  void EstimatePairs(size_t cluster_id,
+                     const std::vector<MVSView>& cluster_views,
+                     const std::vector<std::string>& cluster_cache_paths,
+                     const std::vector<std::vector<size_t> >& neighbours,
+                     const std::vector<std::vector<size_t> >&
+                       fusion_neighbours,
+                     const std::vector<float>& depth_ranges,
+                     const std::vector<char>& home_views,
+                     std::vector<MVSCamera>& cameras,
+                     std::vector<std::string>& map_paths,
+                     std::vector<std::string>& map_fused_paths,
+                     std::vector<std::vector<size_t> >& map_neighbours,
+                     std::vector<char>& reference_maps)
+  {
+    size_t number_of_views = cluster_views.size();
+    std::vector<std::vector<size_t> > right_views(number_of_views);
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      size_t number_of_pairs =
+        std::min(neighbours[i].size(), SGM_PAIRS_PER_VIEW);
+      for (size_t k = 0; k < number_of_pairs; k++)
+      {
+        size_t j = neighbours[i][k];
+        right_views[std::min(i, j)].push_back(std::max(i, j));
+      }
+    }
+
+    std::string prefix = options.cache_path + "cluster_" +
+                         std::to_string(cluster_id) + "_";
+    std::vector<std::pair<size_t, size_t> > pairs;
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      SortUnique(right_views[i]);
+      for (size_t k = 0; k < right_views[i].size(); k++)
+      {
+        size_t j = right_views[i][k];
+        std::string pair_name =
+          std::to_string(cluster_views[i].photo_id) + "_" +
+          std::to_string(cluster_views[j].photo_id) + ".bin";
+        pairs.push_back(std::make_pair(i, j));
+        map_paths.push_back(prefix + "pair_" + pair_name);
+        map_fused_paths.push_back(prefix + "fused_" + pair_name);
+        reference_maps.push_back(home_views[i]);
+      }
+    }
+    size_t number_of_maps = pairs.size();
+    cameras.resize(number_of_maps);
+
+    //Pairs sharing the left view are matched in turn, each spreading its
+    //tiles over the threads.
+    SGMDepthEstimator estimator(options.sample_step, SGM_MAX_DISPARITIES,
+                                options.number_of_threads);
+    DepthMapTileWriter writer(options.tile_size);
+    size_t map_id = 0;
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      if (!progress.KeepWorking()) return;
+      MVSView left = cluster_views[i];
+      if (right_views[i].empty() ||
+          left.LoadImages(cluster_cache_paths[i]) != 0)
+      {
+        map_id += right_views[i].size();
+        progress.Advance();
+        continue;
+      }
+      for (size_t k = 0; k < right_views[i].size(); k++, map_id++)
+      {
+        size_t j = right_views[i][k];
+        MVSView right = cluster_views[j];
+        if (right.LoadImages(cluster_cache_paths[j]) != 0) continue;
+        float depth_min = std::min(depth_ranges[i * 2 + 0],
+                                   depth_ranges[j * 2 + 0]);
+        float depth_max = std::max(depth_ranges[i * 2 + 1],
+                                   depth_ranges[j * 2 + 1]);
+        DepthMap depth_map;
+        if (estimator(left, right, depth_min, depth_max,
+                      cameras[map_id], depth_map) != 0) continue;
+        writer(depth_map, map_paths[map_id]);
+      }
+      progress.Advance();
+    }
+
+    std::vector<std::vector<size_t> > view_maps(number_of_views);
+    for (size_t m = 0; m < number_of_maps; m++)
+    {
+      view_maps[pairs[m].first].push_back(m);
+      view_maps[pairs[m].second].push_back(m);
+    }
+    map_neighbours.assign(number_of_maps, std::vector<size_t>());
+    for (size_t m = 0; m < number_of_maps; m++)
+    {
+      std::vector<size_t> related(1, pairs[m].first);
+      related.push_back(pairs[m].second);
+      for (int side = 0; side < 2; side++)
+      {
+        const std::vector<size_t>& view_neighbours =
+          fusion_neighbours[side == 0 ? pairs[m].first : pairs[m].second];
+        related.insert(related.end(),
+                       view_neighbours.begin(), view_neighbours.end());
+      }
+      SortUnique(related);
+      for (size_t k = 0; k < related.size(); k++)
+      {
+        const std::vector<size_t>& maps = view_maps[related[k]];
+        for (size_t l = 0; l < maps.size(); l++)
+        {
+          if (maps[l] != m) map_neighbours[m].push_back(maps[l]);
+        }
+      }
+      SortUnique(map_neighbours[m]);
+    }
+  }
+
+  const DepthMapMVSOptions& options;
+  const std::vector<MVSView>& views;
+  const std::vector<std::string>& cache_paths;
+  const std::vector<std::vector<size_t> >& clusters;
+  const std::vector<size_t>& home_clusters;
+  const std::vector<std::vector<std::string> >& depth_map_paths;
+  const std::vector<std::vector<std::string> >& fused_paths;
+  const Vector3Container& sparse_points;
+  const CompactTrackContainer* tracks;
+  const DepthMapMVS::PhotoTracks* photo_tracks;
+  const PointCloudFilterOptions* filter_options;
+  StageProgress& progress;
+  ChunkedPointCloudWriter& writer;
+  std::mutex& writer_mutex;
+  size_t& number_of_points;
+  std::vector<char>& cluster_results;
+};
+
+}
+
+DepthMapMVSOptions::DepthMapMVSOptions()
+  : method(METHOD_DEPTH_MAP)
+  , pyramid_level(1)
+  , sample_step(2)
+  , window_radius(2)
+  , ncc_threshold(0.7f)
+  , min_views(2)
+  , number_of_neighbours(6)
+  , depth_tolerance(0.01f)
+  , number_of_threads(1)
+  , tile_size(64)
+  , cluster_size(0)
+  , cluster_accuracy_threshold(0.7f)
+  , cluster_coverage_threshold(0.7f)
+  , min_home_views(1)
+{
+}
+
+DepthMapMVS::DepthMapMVS(const DepthMapMVSOptions& options)
+  : options_(options)
+{
+  options_.number_of_threads =
+    std::max(options_.number_of_threads, size_t(1));
+  options_.number_of_neighbours = std::max(options_.number_of_neighbours,
+                                           options_.min_views - 1);
+  options_.number_of_neighbours = std::max(options_.number_of_neighbours, 1);
+}
+
+std::string DepthMapMVS::CachePath(const std::string& prefix,
+                                   int photo_id) const
+{
+  return options_.cache_path + prefix + std::to_string(photo_id) + ".bin";
+}
+
+void DepthMapMVS::SelectNeighbours(
+  const std::vector<MVSView>& views,
+  const Vector3Container& sparse_points,
+  std::vector<std::vector<size_t> >& neighbours,
+  std::vector<float>& depth_ranges) const
+{
+  neighbours.assign(views.size(), std::vector<size_t>());
+  depth_ranges.assign(views.size() * 2, 0.0f);
+  NeighbourWorker worker(views, sparse_points,
+                         size_t(options_.number_of_neighbours),
+                         neighbours, depth_ranges);
+  ParallelForDynamic(0, views.size(), options_.number_of_threads, 1, worker);
+}
+
+void DepthMapMVS::BuildPhotoTracks(const CompactTrackContainer& tracks,
+                                   const Vector3Container& sparse_points,
+                                   PhotoTracks& photo_tracks) const
+{
+  size_t number_of_tracks = tracks.NumberOfTracks();
+  size_t number_of_photos = 0;
+  for (Index track_id = 0; track_id < Index(number_of_tracks); track_id++)
+  {
+    const Index* image_ids = tracks.TrackImageIds(track_id);
+    size_t track_size = tracks.TrackSize(track_id);
+    for (size_t k = 0; k < track_size; k++)
+    {
+      number_of_photos = std::max(number_of_photos,
+                                  size_t(image_ids[k]) + 1);
+    }
+  }
+
+  photo_tracks.offsets.assign(number_of_photos + 1, 0);
+  for (Index track_id = 0; track_id < Index(number_of_tracks); track_id++)
+  {
+    if (!tracks.IsPointValid(track_id) ||
+        tracks.PointId(track_id) >= sparse_points.size()) continue;
+    const Index* image_ids = tracks.TrackImageIds(track_id);
+    size_t track_size = tracks.TrackSize(track_id);
+    for (size_t k = 0; k < track_size; k++)
+    {
+      photo_tracks.offsets[image_ids[k] + 1]++;
+    }
+  }
+  for (size_t i = 0; i < number_of_photos; i++)
+  {
+    photo_tracks.offsets[i + 1] += photo_tracks.offsets[i];
+  }
+  photo_tracks.track_ids.resize(photo_tracks.offsets[number_of_photos]);
+  std::vector<size_t> cursors(photo_tracks.offsets.begin(),
+                              photo_tracks.offsets.end() - 1);
+  for (Index track_id = 0; track_id < Index(number_of_tracks); track_id++)
+  {
+    if (!tracks.IsPointValid(track_id) ||
+        tracks.PointId(track_id) >= sparse_points.size()) continue;
+    const Index* image_ids = tracks.TrackImageIds(track_id);
+    size_t track_size = tracks.TrackSize(track_id);
+    for (size_t k = 0; k < track_size; k++)
+    {
+      photo_tracks.track_ids[cursors[image_ids[k]]++] = track_id;
+    }
+  }
+}
+
+void DepthMapMVS::SelectNeighboursFromTracks(
+  const std::vector<MVSView>& views,
+  const CompactTrackContainer& tracks,
+  const Vector3Container& sparse_points,
+  std::vector<std::vector<size_t> >& neighbours,
+  std::vector<float>& depth_ranges) const
+{
+  PhotoTracks photo_tracks;
+  BuildPhotoTracks(tracks, sparse_points, photo_tracks);
+  SelectNeighboursFromTracks(views, tracks, sparse_points, photo_tracks,
+                             neighbours, depth_ranges);
+}
+
+void DepthMapMVS::SelectNeighboursFromTracks(
+  const std::vector<MVSView>& views,
+  const CompactTrackContainer& tracks,
+  const Vector3Container& sparse_points,
+  const PhotoTracks& photo_tracks,
+  std::vector<std::vector<size_t> >& neighbours,
+  std::vector<float>& depth_ranges) const
+{
+  size_t number_of_views = views.size();
+  neighbours.assign(number_of_views, std::vector<size_t>());
+  depth_ranges.assign(number_of_views * 2, 0.0f);
+
+  std::vector<Index> photo_views;
+  BuildPhotoViewTable(views, photo_views);
+
+  TrackNeighbourWorker worker(views, tracks, sparse_points, photo_views,
+                              photo_tracks,
+                              size_t(options_.number_of_neighbours),
+                              neighbours, depth_ranges);
+  ParallelForDynamic(0, number_of_views, options_.number_of_threads, 1,
+                     worker);
+}
+
+DepthMapMVS::Scalar DepthMapMVS::SampleDistance(
+  const PhotoContainer& photos,
+  const Vector3Container& sparse_points) const
+{
+  if (sparse_points.empty()) return Scalar(0);
+  size_t stride = (sparse_points.size() + MAX_DISTANCE_POINTS - 1) /
+                  MAX_DISTANCE_POINTS;
+  MVSViewBuilder builder(options_.pyramid_level);
+  std::vector<Scalar> distances;
+  std::vector<Scalar> depths;
+  for (size_t i = 0; i < photos.size(); i++)
+  {
+    MVSCamera camera = builder.BuildCamera(photos[i].intrinsic_params,
+                                           photos[i].extrinsic_params);
+    //The principal point is taken as the image centre.
+    Scalar width = Scalar(2) * (camera.K(0, 2) + Scalar(0.5));
+    Scalar height = Scalar(2) * (camera.K(1, 2) + Scalar(0.5));
+    depths.clear();
+    for (size_t j = 0; j < sparse_points.size(); j += stride)
+    {
+      Vector2 pixel;
+      Scalar depth = camera.Project(sparse_points[j], pixel);
+      if (depth <= Scalar(0) || pixel[0] < Scalar(0) ||
+          pixel[1] < Scalar(0) || pixel[0] > width ||
+          pixel[1] > height) continue;
+      depths.push_back(depth);
+    }
+    if (depths.empty()) continue;
+    std::nth_element(depths.begin(), depths.begin() + depths.size() / 2,
+                     depths.end());
+    distances.push_back(depths[depths.size() / 2] *
+                        Scalar(options_.sample_step) / camera.K(0, 0));
+  }
+  if (distances.empty()) return Scalar(0);
+  std::nth_element(distances.begin(),
+                   distances.begin() + distances.size() / 2,
+                   distances.end());
+  return distances[distances.size() / 2];
+}
+
+int DepthMapMVS::ClusterViews(
+  const std::vector<MVSView>& views,
+  const Vector3Container& sparse_points,
+  const CompactTrackContainer* tracks,
+  std::vector<std::vector<size_t> >& clusters,
+  std::vector<size_t>& home_clusters) const
+{
+  size_t number_of_views = views.size();
+  Vector3Container centers(number_of_views);
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    centers[i] = views[i].camera.C;
+  }
+
+  //Views seeing each sparse point, from the tracks if there are any.
+  Vector3Container points;
+  std::vector<size_t> point_offsets(1, 0);
+  std::vector<size_t> point_views;
+  if (tracks && tracks->NumberOfTracks() > 0)
+  {
+    std::vector<Index> photo_views;
+    BuildPhotoViewTable(views, photo_views);
+    for (size_t track_id = 0; track_id < tracks->NumberOfTracks();
+         track_id++)
+    {
+      if (!tracks->IsPointValid(track_id) ||
+          tracks->PointId(track_id) >= sparse_points.size()) continue;
+      const Index* image_ids = tracks->TrackImageIds(track_id);
+      size_t track_size = tracks->TrackSize(track_id);
+      for (size_t k = 0; k < track_size; k++)
+      {
+        if (image_ids[k] >= photo_views.size()) continue;
+        Index view_id = photo_views[image_ids[k]];
+        if (view_id != CompactTrackContainer::INVALID_INDEX &&
+            views[view_id].width > 0)
+        {
+          point_views.push_back(view_id);
+        }
+      }
+      points.push_back(sparse_points[tracks->PointId(track_id)]);
+      point_offsets.push_back(point_views.size());
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < sparse_points.size(); i++)
+    {
+      for (size_t j = 0; j < number_of_views; j++)
+      {
+        Vector2 pixel;
+        if (views[j].width <= 0 ||
+            views[j].camera.Project(sparse_points[i], pixel) <= Scalar(0) ||
+            !IsInside(views[j], pixel)) continue;
+        point_views.push_back(j);
+      }
+      points.push_back(sparse_points[i]);
+      point_offsets.push_back(point_views.size());
+    }
+  }
+
+  ViewClusterer clusterer(size_t(options_.cluster_size),
+                          options_.cluster_accuracy_threshold,
+                          options_.cluster_coverage_threshold);
+  return clusterer(centers, points, point_offsets, point_views,
+                   clusters, home_clusters);
+}
+
+int DepthMapMVS::operator() (const PhotoContainer& photos,
+                             const Vector3Container& sparse_points,
+                             const std::string& point_cloud_path,
+                             const CompactTrackContainer* tracks,
+                             const PointCloudFilterOptions* filter_options,
+                             hs::progress::ProgressManager* progress_manager)
+{
+  size_t number_of_views = photos.size();
+  if (number_of_views == 0) return -1;
+
+  boost::system::error_code error_code;
+  if (!options_.cache_path.empty())
+  {
+    boost::filesystem::create_directories(
+      boost::filesystem::path(options_.cache_path), error_code);
+  }
+
+  std::vector<std::string> cache_paths(number_of_views);
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    cache_paths[i] = CachePath("mvs_view_", photos[i].photo_id);
+  }
+
+  //Undistort and cache the views.
+  std::vector<MVSView> views(number_of_views);
+  {
+    MVSViewBuilder builder(options_.pyramid_level);
+    StageProgress progress(progress_manager, 0.0f, 0.2f, number_of_views);
+    ViewBuildWorker worker(photos, builder, cache_paths, views, progress);
+    ParallelForDynamic(0, number_of_views, options_.number_of_threads, 1,
+                       worker);
+    if (!progress.KeepWorking()) return -1;
+  }
+
+  std::vector<std::vector<size_t> > clusters;
+  std::vector<size_t> home_clusters;
+  if (options_.cluster_size <= 0 ||
+      number_of_views <= size_t(options_.cluster_size) ||
+      ClusterViews(views, sparse_points, tracks,
+                   clusters, home_clusters) != 0)
+  {
+    clusters.assign(1, std::vector<size_t>());
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      clusters[0].push_back(i);
+    }
+    home_clusters.assign(number_of_views, 0);
+  }
+  if (progress_manager)
+  {
+    progress_manager->SetCurrentSubProgressCompleteRatio(0.25f);
+  }
+
+  size_t number_of_clusters = clusters.size();
+  size_t number_of_cluster_views = 0;
+  std::vector<std::vector<std::string> > depth_map_paths(number_of_clusters);
+  std::vector<std::vector<std::string> > fused_paths(number_of_clusters);
+  for (size_t c = 0; c < number_of_clusters; c++)
+  {
+    std::string prefix = "cluster_" + std::to_string(c) + "_";
+    for (size_t i = 0; i < clusters[c].size(); i++)
+    {
+      int photo_id = photos[clusters[c][i]].photo_id;
+      depth_map_paths[c].push_back(CachePath(prefix + "depth_map_",
+                                             photo_id));
+      fused_paths[c].push_back(CachePath(prefix + "fused_", photo_id));
+    }
+    number_of_cluster_views += clusters[c].size();
+  }
+
+  //Clusters run side by side and share the threads.
+  size_t number_of_workers =
+    std::min(options_.number_of_threads, number_of_clusters);
+  DepthMapMVSOptions cluster_options = options_;
+  cluster_options.number_of_threads =
+    std::max(options_.number_of_threads / number_of_workers, size_t(1));
+  //Every cluster takes its neighbours from the same inverted tracks.
+  PhotoTracks photo_tracks;
+  bool has_tracks = tracks && tracks->NumberOfTracks() > 0;
+  if (has_tracks)
+  {
+    BuildPhotoTracks(*tracks, sparse_points, photo_tracks);
+  }
+
+  ChunkedPointCloudWriter writer;
+  if (writer.Open(point_cloud_path, true, true) != 0) return -1;
+  std::mutex writer_mutex;
+  size_t number_of_points = 0;
+  std::vector<char> cluster_results(number_of_clusters, 0);
+  {
+    StageProgress progress(progress_manager, 0.25f, 0.7f,
+                           number_of_cluster_views);
+    ClusterWorker worker(cluster_options, views, cache_paths,
+                         clusters, home_clusters,
+                         depth_map_paths, fused_paths,
+                         sparse_points, tracks,
+                         has_tracks ? &photo_tracks : nullptr,
+                         filter_options, progress,
+                         writer, writer_mutex, number_of_points,
+                         cluster_results);
+    ParallelForDynamic(0, number_of_clusters, number_of_workers, 1, worker);
+  }
+
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    boost::filesystem::remove(boost::filesystem::path(cache_paths[i]),
+                              error_code);
+  }
+
+  int result = writer.Close();
+  for (size_t c = 0; c < number_of_clusters; c++)
+  {
+    if (!cluster_results[c]) result = -1;
+  }
+  if (number_of_points == 0) result = -1;
+  if (result != 0)
+  {
+    boost::filesystem::remove(boost::filesystem::path(point_cloud_path),
+                              error_code);
+    return -1;
+  }
+  if (progress_manager)
+  {
+    progress_manager->SetCurrentSubProgressCompleteRatio(1.0f);
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,186 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_MVS_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_MVS_HPP_
+
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+#include "hs_graphics/graphics_utility/pointcloud_data.hpp"
+#include "hs_progress/progress_utility/progress_manager.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/photo_orientation/compact_track_container.hpp"
+#include "workflow/point_cloud/mvs_view.hpp"
+#include "workflow/point_cloud/depth_map_estimator.hpp"
+#include "workflow/point_cloud/point_cloud_filter.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct HS_EXPORT DepthMapMVSOptions
+{
+  enum Method
+  {
+    //Plane sweep of each view against all its neighbours.
+    METHOD_DEPTH_MAP = 0,
+    //Semi-global matching of rectified pairs, for nadir blocks.
+    METHOD_SGM
+  };
+
+  DepthMapMVSOptions();
+
+  int method;
+  //Photos are matched at 1 / 2^pyramid_level of their size.
+  int pyramid_level;
+  //A depth is estimated every sample_step pixels.
+  int sample_step;
+  //NCC window is (2 * window_radius + 1)^2 pixels.
+  int window_radius;
+  float ncc_threshold;
+  //Minimum number of views that must agree on a point.
+  int min_views;
+  int number_of_neighbours;
+  float depth_tolerance;
+  size_t number_of_threads;
+  //Samples per side of the depth map tiles.
+  int tile_size;
+  //Most views per cluster, 0 reconstructs all views as one cluster.
+  int cluster_size;
+  float cluster_accuracy_threshold;
+  float cluster_coverage_threshold;
+  //Views of the cluster a point is merged from that must agree on it.
+  int min_home_views;
+  //Directory for the undistorted views, depth map tiles and fused points.
+  std::string cache_path;
+};
+
+/**
+ *  CPU depth map multi-view stereo.
+ *
+ *  1. Every photo is undistorted at the pyramid level and cached on disk.
+ *  2. Blocks larger than cluster_size are split into overlapping clusters
+ *     by ViewClusterer. Steps 3 to 5 run for several clusters at once.
+ *  3. Neighbours and depth range of each view come from the SfM tracks it
+ *     takes part in, or from the sparse points it sees if there are none.
+ *  4. A depth and normal map is swept for each view against its neighbours
+ *     and written as half float tiles. With METHOD_SGM each view is
+ *     instead rectified with its best neighbours and every pair is matched
+ *     by SemiGlobalMatcher, giving one map per pair.
+ *  5. The tiles are fused into points agreed on by min_views views,
+ *     streaming each view's points to disk. Only the home views of the
+ *     cluster emit points, so the clusters are merged by concatenation:
+ *     the points of each cluster are filtered and appended to the chunked
+ *     output file as soon as it is fused.
+ *
+ *  Each stage runs in parallel across views and only holds the views in
+ *  flight, so memory does not depend on the size of the block.
+ */
+class HS_EXPORT DepthMapMVS
+{
+public:
+  typedef MVSCamera::Scalar Scalar;
+  typedef MVSCamera::Vector3 Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+
+  struct Photo
+  {
+    int photo_id;
+    std::string path;
+    IntrinsicParams intrinsic_params;
+    ExtrinsicParams extrinsic_params;
+  };
+  typedef EIGEN_STD_VECTOR(Photo) PhotoContainer;
+
+  /**
+   *  Tracks with a valid point each photo takes part in, in CSR form: those
+   *  of photo p are track_ids[offsets[p]] to track_ids[offsets[p + 1]].
+   */
+  struct PhotoTracks
+  {
+    std::vector<size_t> offsets;
+    std::vector<CompactTrackContainer::Index> track_ids;
+  };
+
+  DepthMapMVS(const DepthMapMVSOptions& options);
+
+  /**
+   *  Writes the dense cloud to point_cloud_path as a chunked point cloud.
+   *  tracks carry photo ids and index sparse_points. Without them the
+   *  neighbours are found by projecting sparse_points. With filter_options
+   *  the points of each cluster are filtered before they are written.
+   */
+  int operator() (const PhotoContainer& photos,
+                  const Vector3Container& sparse_points,
+                  const std::string& point_cloud_path,
+                  const CompactTrackContainer* tracks = nullptr,
+                  const PointCloudFilterOptions* filter_options = nullptr,
+                  hs::progress::ProgressManager* progress_manager = nullptr);
+
+  /**
+   *  Pick up to number_of_neighbours views sharing sparse points with good
+   *  triangulation angles with each view, and its depth range.
+   *  Views without enough sparse points get no neighbours.
+   */
+  void SelectNeighbours(const std::vector<MVSView>& views,
+                        const Vector3Container& sparse_points,
+                        std::vector<std::vector<size_t> >& neighbours,
+                        std::vector<float>& depth_ranges) const;
+  /**
+   *  Same as SelectNeighbours, but only the views of the tracks a view
+   *  takes part in are scored, which is linear in the track length.
+   */
+  void SelectNeighboursFromTracks(
+    const std::vector<MVSView>& views,
+    const CompactTrackContainer& tracks,
+    const Vector3Container& sparse_points,
+    std::vector<std::vector<size_t> >& neighbours,
+    std::vector<float>& depth_ranges) const;
+  /**
+   *  Same, with the tracks already inverted by BuildPhotoTracks so that
+   *  several clusters share them.
+   */
+  void SelectNeighboursFromTracks(
+    const std::vector<MVSView>& views,
+    const CompactTrackContainer& tracks,
+    const Vector3Container& sparse_points,
+    const PhotoTracks& photo_tracks,
+    std::vector<std::vector<size_t> >& neighbours,
+    std::vector<float>& depth_ranges) const;
+  void BuildPhotoTracks(const CompactTrackContainer& tracks,
+                        const Vector3Container& sparse_points,
+                        PhotoTracks& photo_tracks) const;
+
+  /**
+   *  Median ground distance between neighbouring depth samples of the
+   *  photos, from the depths of the sparse points they see. 0 if none of
+   *  them sees any.
+   */
+  Scalar SampleDistance(const PhotoContainer& photos,
+                        const Vector3Container& sparse_points) const;
+
+private:
+  int ClusterViews(const std::vector<MVSView>& views,
+                   const Vector3Container& sparse_points,
+                   const CompactTrackContainer* tracks,
+                   std::vector<std::vector<size_t> >& clusters,
+                   std::vector<size_t>& home_clusters) const;
+  std::string CachePath(const std::string& prefix, int photo_id) const;
+
+private:
+  DepthMapMVSOptions options_;
+};
+
+}
+}
+}
+
+#endif
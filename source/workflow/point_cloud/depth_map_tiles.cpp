@@ -0,0 +1,337 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include "workflow/point_cloud/depth_map_tiles.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+const uint32_t DEPTH_MAP_TILE_MAGIC = 0x4d445348; //"HSDM"
+const uint32_t DEPTH_MAP_TILE_VERSION = 1;
+const uint64_t EMPTY_TILE = 0;
+
+struct DepthMapTileHeader
+{
+  uint32_t magic;
+  uint32_t version;
+  int32_t width;
+  int32_t height;
+  int32_t step;
+  int32_t tile_size;
+  int32_t tiles_x;
+  int32_t tiles_y;
+};
+
+size_t TileBytes(int tile_size)
+{
+  size_t number_of_samples = size_t(tile_size) * size_t(tile_size);
+  return sizeof(float) + number_of_samples * (sizeof(HalfFloat) * 5 + 3);
+}
+
+}
+
+DepthMapTileWriter::DepthMapTileWriter(int tile_size)
+  : tile_size_(std::max(tile_size, 1))
+{
+}
+
+int DepthMapTileWriter::operator() (const DepthMap& depth_map,
+                                    const std::string& path) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file) return -1;
+
+  DepthMapTileHeader header;
+  header.magic = DEPTH_MAP_TILE_MAGIC;
+  header.version = DEPTH_MAP_TILE_VERSION;
+  header.width = depth_map.width;
+  header.height = depth_map.height;
+  header.step = depth_map.step;
+  header.tile_size = tile_size_;
+  header.tiles_x = (depth_map.width + tile_size_ - 1) / tile_size_;
+  header.tiles_y = (depth_map.height + tile_size_ - 1) / tile_size_;
+  size_t number_of_tiles = size_t(header.tiles_x) * size_t(header.tiles_y);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  std::vector<uint64_t> tile_offsets(number_of_tiles, EMPTY_TILE);
+  std::streamoff offsets_position = file.tellp();
+  file.write(reinterpret_cast<const char*>(tile_offsets.data()),
+             number_of_tiles * sizeof(uint64_t));
+  uint64_t offset = uint64_t(sizeof(header)) +
+                    uint64_t(number_of_tiles * sizeof(uint64_t));
+
+  size_t number_of_samples = size_t(tile_size_) * size_t(tile_size_);
+  std::vector<HalfFloat> depths(number_of_samples);
+  std::vector<HalfFloat> scores(number_of_samples);
+  std::vector<HalfFloat> normals(number_of_samples * 3);
+  std::vector<DepthMap::Byte> colors(number_of_samples * 3);
+  for (int tile_y = 0; tile_y < header.tiles_y; tile_y++)
+  {
+    for (int tile_x = 0; tile_x < header.tiles_x; tile_x++)
+    {
+      int row_begin = tile_y * tile_size_;
+      int col_begin = tile_x * tile_size_;
+      int row_end = std::min(row_begin + tile_size_, depth_map.height);
+      int col_end = std::min(col_begin + tile_size_, depth_map.width);
+
+      float base_depth = 0.0f;
+      bool has_valid = false;
+      for (int i = row_begin; i < row_end; i++)
+      {
+        for (int j = col_begin; j < col_end; j++)
+        {
+          float depth =
+            depth_map.depths[size_t(i) * size_t(depth_map.width) + j];
+          if (depth <= 0.0f) continue;
+          base_depth = has_valid ? std::min(base_depth, depth) : depth;
+          has_valid = true;
+        }
+      }
+      if (!has_valid) continue;
+
+      std::fill(depths.begin(), depths.end(), HALF_FLOAT_NAN);
+      std::fill(scores.begin(), scores.end(), HalfFloat(0));
+      std::fill(normals.begin(), normals.end(), HalfFloat(0));
+      std::fill(colors.begin(), colors.end(), DepthMap::Byte(0));
+      for (int i = row_begin; i < row_end; i++)
+      {
+        for (int j = col_begin; j < col_end; j++)
+        {
+          size_t sample_id = size_t(i) * size_t(depth_map.width) + j;
+          float depth = depth_map.depths[sample_id];
+          if (depth <= 0.0f) continue;
+          size_t tile_sample = size_t(i - row_begin) * size_t(tile_size_) +
+                               size_t(j - col_begin);
+          HalfFloat depth_offset = FloatToHalf(depth - base_depth);
+          //Offsets beyond the half range are dropped as invalid.
+          if ((depth_offset & 0x7C00) == 0x7C00) continue;
+          depths[tile_sample] = depth_offset;
+          scores[tile_sample] = FloatToHalf(depth_map.scores[sample_id]);
+          for (int c = 0; c < 3; c++)
+          {
+            normals[tile_sample * 3 + c] =
+              FloatToHalf(depth_map.normals[sample_id * 3 + c]);
+            colors[tile_sample * 3 + c] = depth_map.colors[sample_id * 3 + c];
+          }
+        }
+      }
+
+      tile_offsets[size_t(tile_y) * size_t(header.tiles_x) + tile_x] = offset;
+      file.write(reinterpret_cast<const char*>(&base_depth), sizeof(float));
+      file.write(reinterpret_cast<const char*>(depths.data()),
+                 depths.size() * sizeof(HalfFloat));
+      file.write(reinterpret_cast<const char*>(scores.data()),
+                 scores.size() * sizeof(HalfFloat));
+      file.write(reinterpret_cast<const char*>(normals.data()),
+                 normals.size() * sizeof(HalfFloat));
+      file.write(reinterpret_cast<const char*>(colors.data()),
+                 colors.size());
+      offset += uint64_t(TileBytes(tile_size_));
+    }
+  }
+
+  file.seekp(offsets_position);
+  file.write(reinterpret_cast<const char*>(tile_offsets.data()),
+             number_of_tiles * sizeof(uint64_t));
+  return file.good() ? 0 : -1;
+}
+
+DepthMapTileReader::DepthMapTileReader()
+  : width_(0)
+  , height_(0)
+  , step_(1)
+  , tile_size_(1)
+  , tiles_x_(0)
+  , tiles_y_(0)
+  , tile_offsets_(nullptr)
+{
+}
+
+int DepthMapTileReader::Open(const std::string& path)
+{
+  Close();
+  if (mapped_file_.Open(path) != 0) return -1;
+  const char* data = mapped_file_.data();
+  size_t size = mapped_file_.size();
+  if (size < sizeof(DepthMapTileHeader))
+  {
+    Close();
+    return -1;
+  }
+
+  DepthMapTileHeader header;
+  std::memcpy(&header, data, sizeof(header));
+  if (header.magic != DEPTH_MAP_TILE_MAGIC ||
+      header.version != DEPTH_MAP_TILE_VERSION ||
+      header.width < 0 || header.height < 0 ||
+      header.step <= 0 || header.tile_size <= 0 ||
+      header.tiles_x < 0 || header.tiles_y < 0)
+  {
+    Close();
+    return -1;
+  }
+  size_t number_of_tiles = size_t(header.tiles_x) * size_t(header.tiles_y);
+  size_t tile_bytes = TileBytes(header.tile_size);
+  if (size < sizeof(header) + number_of_tiles * sizeof(uint64_t))
+  {
+    Close();
+    return -1;
+  }
+  tile_offsets_ = reinterpret_cast<const uint64_t*>(data + sizeof(header));
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    if (tile_offsets_[i] != EMPTY_TILE &&
+        tile_offsets_[i] + tile_bytes > size)
+    {
+      Close();
+      return -1;
+    }
+  }
+
+  width_ = header.width;
+  height_ = header.height;
+  step_ = header.step;
+  tile_size_ = header.tile_size;
+  tiles_x_ = header.tiles_x;
+  tiles_y_ = header.tiles_y;
+  return 0;
+}
+
+void DepthMapTileReader::Close()
+{
+  mapped_file_.Close();
+  width_ = 0;
+  height_ = 0;
+  step_ = 1;
+  tile_size_ = 1;
+  tiles_x_ = 0;
+  tiles_y_ = 0;
+  tile_offsets_ = nullptr;
+}
+
+bool DepthMapTileReader::IsOpen() const
+{
+  return mapped_file_.IsOpen();
+}
+
+int DepthMapTileReader::width() const
+{
+  return width_;
+}
+
+int DepthMapTileReader::height() const
+{
+  return height_;
+}
+
+int DepthMapTileReader::step() const
+{
+  return step_;
+}
+
+const char* DepthMapTileReader::Tile(int i, int j,
+                                     size_t& sample_in_tile) const
+{
+  if (i < 0 || i >= height_ || j < 0 || j >= width_) return nullptr;
+  int tile_y = i / tile_size_;
+  int tile_x = j / tile_size_;
+  uint64_t offset = tile_offsets_[size_t(tile_y) * size_t(tiles_x_) + tile_x];
+  if (offset == EMPTY_TILE) return nullptr;
+  sample_in_tile = size_t(i - tile_y * tile_size_) * size_t(tile_size_) +
+                   size_t(j - tile_x * tile_size_);
+  return mapped_file_.data() + offset;
+}
+
+float DepthMapTileReader::Depth(int i, int j) const
+{
+  size_t sample_in_tile;
+  const char* tile = Tile(i, j, sample_in_tile);
+  if (!tile) return 0.0f;
+  HalfFloat depth_offset;
+  std::memcpy(&depth_offset,
+              tile + sizeof(float) + sample_in_tile * sizeof(HalfFloat),
+              sizeof(HalfFloat));
+  if (IsHalfNaN(depth_offset)) return 0.0f;
+  float base_depth;
+  std::memcpy(&base_depth, tile, sizeof(float));
+  return base_depth + HalfToFloat(depth_offset);
+}
+
+bool DepthMapTileReader::Sample(int i, int j, float& depth,
+                                float* normal, Byte* color) const
+{
+  size_t sample_in_tile;
+  const char* tile = Tile(i, j, sample_in_tile);
+  if (!tile) return false;
+  size_t number_of_samples = size_t(tile_size_) * size_t(tile_size_);
+  const char* depths = tile + sizeof(float);
+  const char* normals = depths + number_of_samples * sizeof(HalfFloat) * 2;
+  const char* colors = normals + number_of_samples * sizeof(HalfFloat) * 3;
+
+  HalfFloat depth_offset;
+  std::memcpy(&depth_offset, depths + sample_in_tile * sizeof(HalfFloat),
+              sizeof(HalfFloat));
+  if (IsHalfNaN(depth_offset)) return false;
+  float base_depth;
+  std::memcpy(&base_depth, tile, sizeof(float));
+  depth = base_depth + HalfToFloat(depth_offset);
+
+  HalfFloat normal_halves[3];
+  std::memcpy(normal_halves,
+              normals + sample_in_tile * 3 * sizeof(HalfFloat),
+              sizeof(normal_halves));
+  float length = 0.0f;
+  for (int c = 0; c < 3; c++)
+  {
+    normal[c] = HalfToFloat(normal_halves[c]);
+    length += normal[c] * normal[c];
+  }
+  if (length > 0.0f)
+  {
+    length = std::sqrt(length);
+    for (int c = 0; c < 3; c++) normal[c] /= length;
+  }
+  std::memcpy(color, colors + sample_in_tile * 3, 3);
+  return true;
+}
+
+int DepthMapTileReader::Read(DepthMap& depth_map) const
+{
+  if (!IsOpen()) return -1;
+  depth_map.Reset(width_, height_, step_);
+  for (int i = 0; i < height_; i++)
+  {
+    for (int j = 0; j < width_; j++)
+    {
+      size_t sample_id = size_t(i) * size_t(width_) + size_t(j);
+      size_t sample_in_tile;
+      const char* tile = Tile(i, j, sample_in_tile);
+      if (!tile) continue;
+      float depth;
+      if (!Sample(i, j, depth, &depth_map.normals[sample_id * 3],
+                  &depth_map.colors[sample_id * 3])) continue;
+      depth_map.depths[sample_id] = depth;
+      size_t number_of_samples = size_t(tile_size_) * size_t(tile_size_);
+      HalfFloat score;
+      std::memcpy(&score,
+                  tile + sizeof(float) +
+                  (number_of_samples + sample_in_tile) * sizeof(HalfFloat),
+                  sizeof(HalfFloat));
+      depth_map.scores[sample_id] = HalfToFloat(score);
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,87 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_TILES_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_DEPTH_MAP_TILES_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/common/half_float.hpp"
+#include "workflow/common/mapped_file.hpp"
+#include "workflow/point_cloud/depth_map_estimator.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes a depth map as square tiles of tile_size x tile_size samples.
+ *
+ *  A tile stores a float base depth followed by half float depth offsets,
+ *  scores and normals and byte colors, 13 bytes per sample. Offsets from
+ *  the tile minimum keep half precision relative to the depth variation
+ *  inside the tile rather than to the flying height. Tiles without a
+ *  valid sample are not written.
+ */
+class HS_EXPORT DepthMapTileWriter
+{
+public:
+  DepthMapTileWriter(int tile_size = 64);
+
+  int operator() (const DepthMap& depth_map, const std::string& path) const;
+
+private:
+  int tile_size_;
+};
+
+/**
+ *  Maps a tiled depth map file and decodes samples on access, so a reader
+ *  costs no heap however large the depth map is.
+ */
+class HS_EXPORT DepthMapTileReader
+{
+public:
+  typedef DepthMap::Byte Byte;
+
+  DepthMapTileReader();
+
+  int Open(const std::string& path);
+  void Close();
+  bool IsOpen() const;
+
+  int width() const;
+  int height() const;
+  int step() const;
+
+  //Depth of sample (i, j), 0 if invalid or outside.
+  float Depth(int i, int j) const;
+  /**
+   *  Depth, unit normal and color of sample (i, j). Returns false if the
+   *  sample is invalid or outside.
+   */
+  bool Sample(int i, int j, float& depth, float* normal, Byte* color) const;
+  //Decode the whole depth map.
+  int Read(DepthMap& depth_map) const;
+
+private:
+  const char* Tile(int i, int j, size_t& sample_in_tile) const;
+
+private:
+  MappedFile mapped_file_;
+  int width_;
+  int height_;
+  int step_;
+  int tile_size_;
+  int tiles_x_;
+  int tiles_y_;
+  const uint64_t* tile_offsets_;
+};
+
+}
+}
+}
+
+#endif
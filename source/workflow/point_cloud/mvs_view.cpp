@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <fstream>
+
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/point_cloud/mvs_view.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+MVSCamera::MVSCamera()
+  : K(Matrix33::Identity())
+  , K_inverse(Matrix33::Identity())
+  , R(Matrix33::Identity())
+  , C(Vector3::Zero())
+{
+}
+
+MVSCamera::Scalar MVSCamera::Project(const Vector3& point,
+                                     Vector2& pixel) const
+{
+  Vector3 camera_point = K * (R * (point - C));
+  if (camera_point[2] > Scalar(0))
+  {
+    pixel[0] = camera_point[0] / camera_point[2];
+    pixel[1] = camera_point[1] / camera_point[2];
+  }
+  return camera_point[2];
+}
+
+MVSCamera::Vector3 MVSCamera::BackProject(Scalar col, Scalar row,
+                                          Scalar depth) const
+{
+  Vector3 ray = K_inverse * Vector3(col, row, Scalar(1));
+  return C + R.transpose() * (ray * depth);
+}
+
+MVSCamera::Vector3 MVSCamera::ViewDirection() const
+{
+  return R.row(2).transpose();
+}
+
+MVSCamera::Scalar TriangulationWeight(const MVSCamera::Vector3& center_a,
+                                      const MVSCamera::Vector3& center_b,
+                                      const MVSCamera::Vector3& point)
+{
+  typedef MVSCamera::Scalar Scalar;
+  MVSCamera::Vector3 ray_a = (center_a - point).normalized();
+  MVSCamera::Vector3 ray_b = (center_b - point).normalized();
+  Scalar cosine = std::min(std::max(ray_a.dot(ray_b), Scalar(-1)), Scalar(1));
+  Scalar angle = std::acos(cosine) * Scalar(180) /
+                 Scalar(3.14159265358979323846);
+  if (angle < Scalar(1)) return Scalar(0);
+  if (angle < Scalar(10)) return angle / Scalar(10);
+  if (angle < Scalar(40)) return Scalar(1);
+  return std::max(Scalar(0), Scalar(1) - (angle - Scalar(40)) / Scalar(40));
+}
+
+MVSView::MVSView()
+  : photo_id(-1)
+  , width(0)
+  , height(0)
+{
+}
+
+int MVSView::SaveImages(const std::string& path) const
+{
+  std::ofstream file(path, std::ios::binary);
+  if (!file) return -1;
+  cereal::PortableBinaryOutputArchive archive(file);
+  archive(photo_id, width, height, gray, colors);
+  return file.good() ? 0 : -1;
+}
+
+int MVSView::LoadImages(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file) return -1;
+  cereal::PortableBinaryInputArchive archive(file);
+  archive(photo_id, width, height, gray, colors);
+  size_t number_of_pixels = size_t(width) * size_t(height);
+  if (gray.size() != number_of_pixels ||
+      colors.size() != number_of_pixels * 3) return -1;
+  return 0;
+}
+
+void MVSView::ReleaseImages()
+{
+  std::vector<float>().swap(gray);
+  std::vector<Byte>().swap(colors);
+}
+
+MVSViewBuilder::MVSViewBuilder(int pyramid_level)
+  : pyramid_level_(std::max(pyramid_level, 0))
+{
+}
+
+int MVSViewBuilder::LevelSize(int size) const
+{
+  return std::max(size >> pyramid_level_, 1);
+}
+
+MVSCamera MVSViewBuilder::BuildCamera(
+  const IntrinsicParams& intrinsic_params,
+  const ExtrinsicParams& extrinsic_params) const
+{
+  //Image keys put the value of pixel i at i + 0.5, views at i.
+  Scalar scale = Scalar(1) / Scalar(1 << pyramid_level_);
+  MVSCamera camera;
+  camera.K << intrinsic_params.focal_length(),
+              intrinsic_params.skew(),
+              intrinsic_params.principal_point_x(),
+              0,
+              intrinsic_params.focal_length() *
+              intrinsic_params.pixel_ratio(),
+              intrinsic_params.principal_point_y(),
+              0, 0, 1;
+  camera.K.row(0) *= scale;
+  camera.K.row(1) *= scale;
+  camera.K(0, 2) -= Scalar(0.5);
+  camera.K(1, 2) -= Scalar(0.5);
+  camera.K_inverse = camera.K.inverse();
+  MVSCamera::Matrix33 rotation(extrinsic_params.rotation());
+  camera.R = rotation;
+  camera.C = extrinsic_params.position();
+  return camera;
+}
+
+int MVSViewBuilder::operator() (int photo_id,
+                                const std::string& photo_path,
+                                const IntrinsicParams& intrinsic_params,
+                                const ExtrinsicParams& extrinsic_params,
+                                MVSView& view) const
+{
+  typedef hs::imgio::whole::ImageData ImageData;
+  typedef hs::sfm::ProjectiveFunctions<Scalar> ProjectiveFunctions;
+  typedef EIGEN_VECTOR(Scalar, 2) Key;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+
+  ImageData image_data;
+  hs::imgio::whole::ImageIO image_io;
+  if (image_io.LoadImage(photo_path, image_data) != 0) return -1;
+  int photo_width = image_data.width();
+  int photo_height = image_data.height();
+  int channel = image_data.channel();
+  if (photo_width <= 0 || photo_height <= 0 || channel <= 0) return -1;
+
+  //Box filter to the pyramid level, three float channels per pixel.
+  int factor = 1 << pyramid_level_;
+  int width = LevelSize(photo_width);
+  int height = LevelSize(photo_height);
+  std::vector<float> level_image(size_t(width) * size_t(height) * 3, 0.0f);
+  for (int row = 0; row < height; row++)
+  {
+    int row_end = std::min((row + 1) * factor, photo_height);
+    for (int col = 0; col < width; col++)
+    {
+      int col_end = std::min((col + 1) * factor, photo_width);
+      float sum[3] = {0.0f, 0.0f, 0.0f};
+      int count = 0;
+      for (int r = row * factor; r < row_end; r++)
+      {
+        for (int c = col * factor; c < col_end; c++)
+        {
+          for (int k = 0; k < 3; k++)
+          {
+            sum[k] += float(image_data.GetByte(r, c, std::min(k, channel - 1)));
+          }
+          count++;
+        }
+      }
+      float* pixel = &level_image[(size_t(row) * size_t(width) + col) * 3];
+      for (int k = 0; k < 3; k++)
+      {
+        pixel[k] = sum[k] / float(std::max(count, 1));
+      }
+    }
+  }
+  image_data = ImageData();
+
+  //Resample through the distortion model.
+  view.photo_id = photo_id;
+  view.width = width;
+  view.height = height;
+  view.camera = BuildCamera(intrinsic_params, extrinsic_params);
+  view.gray.assign(size_t(width) * size_t(height), 0.0f);
+  view.colors.assign(size_t(width) * size_t(height) * 3, 0);
+
+  ExtrinsicParams identity;
+  identity.rotation()[0] = Scalar(0);
+  identity.rotation()[1] = Scalar(0);
+  identity.rotation()[2] = Scalar(0);
+  identity.position() = Vector3::Zero();
+  Scalar scale = Scalar(1) / Scalar(factor);
+  for (int row = 0; row < height; row++)
+  {
+    for (int col = 0; col < width; col++)
+    {
+      Vector3 ray = view.camera.K_inverse *
+                    Vector3(Scalar(col), Scalar(row), Scalar(1));
+      Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                  intrinsic_params, identity, ray);
+      float x = float(key[0] * scale - Scalar(0.5));
+      float y = float(key[1] * scale - Scalar(0.5));
+      if (x < 0.0f || y < 0.0f ||
+          x > float(width - 1) || y > float(height - 1)) continue;
+      int x0 = int(x);
+      int y0 = int(y);
+      int x1 = std::min(x0 + 1, width - 1);
+      int y1 = std::min(y0 + 1, height - 1);
+      float u = x - float(x0);
+      float v = y - float(y0);
+      const float* p00 = &level_image[(size_t(y0) * size_t(width) + x0) * 3];
+      const float* p01 = &level_image[(size_t(y0) * size_t(width) + x1) * 3];
+      const float* p10 = &level_image[(size_t(y1) * size_t(width) + x0) * 3];
+      const float* p11 = &level_image[(size_t(y1) * size_t(width) + x1) * 3];
+      size_t pixel_id = size_t(row) * size_t(width) + size_t(col);
+      float rgb[3];
+      for (int k = 0; k < 3; k++)
+      {
+        rgb[k] = (p00[k] * (1.0f - u) + p01[k] * u) * (1.0f - v) +
+                 (p10[k] * (1.0f - u) + p11[k] * u) * v;
+        view.colors[pixel_id * 3 + k] =
+          MVSView::Byte(std::min(std::max(rgb[k] + 0.5f, 0.0f), 255.0f));
+      }
+      view.gray[pixel_id] = 0.299f * rgb[0] + 0.587f * rgb[1] +
+                            0.114f * rgb[2];
+    }
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,147 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_MVS_VIEW_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_MVS_VIEW_HPP_
+
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Undistorted pinhole camera of a dense matching view.
+ *
+ *  A world point X projects to K * R * (X - C). Pixel coordinates are in
+ *  index space of the view, the value of pixel (col, row) lies at (col, row).
+ */
+struct HS_EXPORT MVSCamera
+{
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 2) Vector2;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef EIGEN_MATRIX(Scalar, 3, 3) Matrix33;
+
+  MVSCamera();
+
+  /**
+   *  Project point to pixel. Returns the depth of the point, which is not
+   *  positive for points behind the camera.
+   */
+  Scalar Project(const Vector3& point, Vector2& pixel) const;
+  //World point at depth along the ray of pixel (col, row).
+  Vector3 BackProject(Scalar col, Scalar row, Scalar depth) const;
+  //Optical axis in world frame.
+  Vector3 ViewDirection() const;
+
+  Matrix33 K;
+  Matrix33 K_inverse;
+  Matrix33 R;
+  Vector3 C;
+};
+
+/**
+ *  Weight of the triangulation angle at point between two camera centres
+ *  for dense matching, 1 for angles of 10 to 40 degrees.
+ */
+HS_EXPORT MVSCamera::Scalar TriangulationWeight(
+  const MVSCamera::Vector3& center_a,
+  const MVSCamera::Vector3& center_b,
+  const MVSCamera::Vector3& point);
+
+/**
+ *  Undistorted image of one oriented photo at a pyramid level.
+ *  gray holds one float per pixel, colors three bytes per pixel.
+ */
+struct HS_EXPORT MVSView
+{
+  typedef MVSCamera::Scalar Scalar;
+  typedef unsigned char Byte;
+
+  MVSView();
+
+  float Gray(int row, int col) const
+  {
+    return gray[size_t(row) * size_t(width) + size_t(col)];
+  }
+
+  /**
+   *  Bilinear sample. Returns false if (col, row) is outside the image.
+   */
+  bool SampleGray(float col, float row, float& value) const
+  {
+    if (col < 0.0f || row < 0.0f ||
+        col > float(width - 1) || row > float(height - 1)) return false;
+    int col0 = int(col);
+    int row0 = int(row);
+    int col1 = col0 + 1 < width ? col0 + 1 : col0;
+    int row1 = row0 + 1 < height ? row0 + 1 : row0;
+    float u = col - float(col0);
+    float v = row - float(row0);
+    const float* line0 = &gray[size_t(row0) * size_t(width)];
+    const float* line1 = &gray[size_t(row1) * size_t(width)];
+    value = (line0[col0] * (1.0f - u) + line0[col1] * u) * (1.0f - v) +
+            (line1[col0] * (1.0f - u) + line1[col1] * u) * v;
+    return true;
+  }
+
+  /**
+   *  The images are cached without the camera, which is rebuilt from the
+   *  orientation on load.
+   */
+  int SaveImages(const std::string& path) const;
+  int LoadImages(const std::string& path);
+  void ReleaseImages();
+
+  int photo_id;
+  int width;
+  int height;
+  MVSCamera camera;
+  std::vector<float> gray;
+  std::vector<Byte> colors;
+};
+
+/**
+ *  Builds MVS views from photos and their orientation.
+ *
+ *  The photo is box filtered down by 2^pyramid_level and resampled through
+ *  the distortion model, so all later matching is pure pinhole.
+ */
+class HS_EXPORT MVSViewBuilder
+{
+public:
+  typedef MVSCamera::Scalar Scalar;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+
+  MVSViewBuilder(int pyramid_level);
+
+  int operator() (int photo_id,
+                  const std::string& photo_path,
+                  const IntrinsicParams& intrinsic_params,
+                  const ExtrinsicParams& extrinsic_params,
+                  MVSView& view) const;
+
+  MVSCamera BuildCamera(const IntrinsicParams& intrinsic_params,
+                        const ExtrinsicParams& extrinsic_params) const;
+
+  //Size of a photo of width x height at the pyramid level.
+  int LevelSize(int size) const;
+
+private:
+  int pyramid_level_;
+};
+
+}
+}
+}
+
+#endif
@@ -1,4 +1,5 @@
-﻿#include <iostream>
+﻿#include <algorithm>
+#include <iostream>
 #include <fstream>
 
 #if WIN32
@@ -10,11 +11,15 @@
 #include <boost/typeof/typeof.hpp> 
 #include <boost/filesystem.hpp>
 
+#include <cereal/types/vector.hpp>
 #include <cereal/types/map.hpp>
 #include <cereal/types/utility.hpp>
 #include <cereal/archives/portable_binary.hpp>
 
+#include "workflow/common/chunked_point_cloud.hpp"
 #include "workflow/point_cloud/pmvs_point_cloud.hpp"
+#include "workflow/point_cloud/depth_map_mvs.hpp"
+#include "workflow/point_cloud/point_cloud_filter.hpp"
 
 //#include "hs_flowmodule/point_cloud/define/pc_define.hpp"
 //#include "hs_flowmodule/point_cloud/agent/pc_agent.hpp"
@@ -29,6 +34,10 @@ namespace workflow
 
 PointCloudConfig::PointCloudConfig()
   :using_sparse_point_cloud_(false)
+  , dense_method_(DENSE_DEPTH_MAP)
+  , f_voxel_size_(0.0f)
+  , f_outlier_neighbours_(8)
+  , f_outlier_std_ratio_(2.0f)
 {
   type_ = STEP_POINT_CLOUD;
 }
@@ -62,6 +71,10 @@ void PointCloudConfig::set_sparse_point_cloud_path(
 {
   sparse_point_cloud_path_ = sparse_point_cloud_path;
 }
+void PointCloudConfig::set_tracks_path(const std::string& tracks_path)
+{
+  tracks_path_ = tracks_path;
+}
 void PointCloudConfig::set_intermediate_path(
   const std::string& intermediate_path)
 {
@@ -114,6 +127,22 @@ void PointCloudConfig::set_m_visibility_threshold(int m_visibility_threshold)
 {
   m_visibility_threshold_ = m_visibility_threshold;
 }
+void PointCloudConfig::set_dense_method(int dense_method)
+{
+  dense_method_ = dense_method;
+}
+void PointCloudConfig::set_f_voxel_size(float f_voxel_size)
+{
+  f_voxel_size_ = f_voxel_size;
+}
+void PointCloudConfig::set_f_outlier_neighbours(int f_outlier_neighbours)
+{
+  f_outlier_neighbours_ = f_outlier_neighbours;
+}
+void PointCloudConfig::set_f_outlier_std_ratio(float f_outlier_std_ratio)
+{
+  f_outlier_std_ratio_ = f_outlier_std_ratio;
+}
 
 bool PointCloudConfig::using_sparse_point_cloud() const
 {
@@ -139,6 +168,10 @@ const std::string& PointCloudConfig::sparse_point_cloud_path() const
 {
   return sparse_point_cloud_path_;
 }
+const std::string& PointCloudConfig::tracks_path() const
+{
+  return tracks_path_;
+}
 const std::string& PointCloudConfig::intermediate_path() const
 {
   return intermediate_path_;
@@ -191,6 +224,22 @@ int PointCloudConfig::m_visibility_threshold() const
 {
   return m_visibility_threshold_;
 }
+int PointCloudConfig::dense_method() const
+{
+  return dense_method_;
+}
+float PointCloudConfig::f_voxel_size() const
+{
+  return f_voxel_size_;
+}
+int PointCloudConfig::f_outlier_neighbours() const
+{
+  return f_outlier_neighbours_;
+}
+float PointCloudConfig::f_outlier_std_ratio() const
+{
+  return f_outlier_std_ratio_;
+}
 
 std::map<int, std::string>& PointCloudConfig::photo_paths()
 {
@@ -368,17 +417,19 @@ int PointCloud::ReadExtrinsicFile(
 
 int PointCloud::RunImplement(WorkflowStepConfig* config)
 {
+  typedef DepthMapMVS::PointCloudData PointCloudData;
+
   PointCloudConfig* point_cloud_config =
     static_cast<PointCloudConfig*>(config);
 
-  //if (point_cloud_config->using_sparse_point_cloud())
-  //{
-    //复制稀疏点云
-    std::string sparse_point_cloud_path = 
-      point_cloud_config->sparse_point_cloud_path();
-    std::string dense_point_cloud_path =
-      point_cloud_config->workspace_path() + "dense_pointcloud.bin";
+  std::string sparse_point_cloud_path =
+    point_cloud_config->sparse_point_cloud_path();
+  std::string dense_point_cloud_path =
+    point_cloud_config->workspace_path() + "dense_pointcloud.bin";
 
+  if (point_cloud_config->using_sparse_point_cloud())
+  {
+    //复制稀疏点云
     boost::filesystem::copy_file(
       boost::filesystem::path(sparse_point_cloud_path),
       boost::filesystem::path(dense_point_cloud_path),
@@ -386,42 +437,112 @@ int PointCloud::RunImplement(WorkflowStepConfig* config)
 
     progress_manager_.SetCurrentSubProgressCompleteRatio(1);
     return 0;
-  //}
-  
-//  if (CreateConfigXml(point_cloud_config) != 0)
-//  {
-//    return -1;
-//  }
-
-//  std::string point_cloud_xml =
-//    point_cloud_config->intermediate_path() + "point_cloud_input.xml";
-//  std::string point_cloud_xml_out = 
-//    point_cloud_config->intermediate_path() + "point_cloud_output.xml";
-
-//  bm::CBaseAgent *agent = pc::CPCAgent::create();
-//  agent->init();
-//  agent->input(point_cloud_xml.c_str());
-//  agent->start(bm::CBaseDefine::E_MX_ASYNC);
-
-//  int pc_progress = 0;
-//  while(agent->getState() == bm::CBaseDefine::E_MS_BUSY)
-//  {
-//#if WIN32
-//    Sleep(1000);
-//#else
-//    sleep(1);
-//#endif
-//    pc_progress = agent->getProgress();
-//    progress_manager_.SetCurrentSubProgressCompleteRatio(
-//      float(pc_progress)/float(100));
-//  }
-
-//  agent->stop();
-//  agent->output(point_cloud_xml_out.c_str());
-//  agent->uninit();
-//  pc::CPCAgent::destroy((pc::CPCAgent*)agent);
-
-//  return 0;
+  }
+
+  //读取内外参数
+  IntrinsicParamsMap intrinsic_params_map;
+  ExtrinsicParamsMap extrinsic_params_map;
+  if (ReadIntrinsicFile(point_cloud_config->intrinsic_path(),
+                        intrinsic_params_map) != 0 ||
+      ReadExtrinsicFile(point_cloud_config->extrinsic_path(),
+                        extrinsic_params_map) != 0)
+  {
+    return -1;
+  }
+
+  //稀疏点云用于选择邻近影像和深度范围
+  PointCloudData sparse_point_cloud;
+  if (LoadPointCloud(sparse_point_cloud_path, sparse_point_cloud) != 0)
+  {
+    return -1;
+  }
+  DepthMapMVS::Vector3Container sparse_points(
+    sparse_point_cloud.VertexData().begin(),
+    sparse_point_cloud.VertexData().end());
+  sparse_point_cloud = PointCloudData();
+
+  //连接点轨迹用于选择邻近影像,读取失败时改为投影稀疏点
+  CompactTrackContainer tracks;
+  if (!point_cloud_config->tracks_path().empty())
+  {
+    tracks.Load(point_cloud_config->tracks_path());
+  }
+
+  DepthMapMVS::PhotoContainer photos;
+  auto itr_extrinsic = extrinsic_params_map.begin();
+  auto itr_extrinsic_end = extrinsic_params_map.end();
+  for (; itr_extrinsic != itr_extrinsic_end; ++itr_extrinsic)
+  {
+    auto itr_photo_path = point_cloud_config->photo_paths().find(
+      int(itr_extrinsic->first.first));
+    auto itr_intrinsic =
+      intrinsic_params_map.find(itr_extrinsic->first.second);
+    if (itr_photo_path == point_cloud_config->photo_paths().end() ||
+        itr_intrinsic == intrinsic_params_map.end())
+    {
+      continue;
+    }
+    DepthMapMVS::Photo photo;
+    photo.photo_id = int(itr_extrinsic->first.first);
+    photo.path = itr_photo_path->second;
+    photo.intrinsic_params = itr_intrinsic->second;
+    photo.extrinsic_params = itr_extrinsic->second;
+    photos.push_back(photo);
+  }
+
+  //PMVS参数: pyramid level, cell size, window size, NCC threshold,
+  //minimum number of views.
+  DepthMapMVSOptions options;
+  options.pyramid_level = point_cloud_config->s_pyramid_level();
+  options.sample_step = std::max(point_cloud_config->s_patch_density(), 1);
+  options.window_radius = std::max(point_cloud_config->s_patch_range(), 1);
+  options.ncc_threshold = point_cloud_config->p_consistency_threshold();
+  options.min_views = std::max(point_cloud_config->p_visibility_threshold(),
+                               point_cloud_config->m_visibility_threshold());
+  options.min_views = std::max(options.min_views, 2);
+  options.number_of_threads =
+    size_t(std::max(point_cloud_config->s_number_of_threads(), 1));
+  options.cache_path =
+    point_cloud_config->intermediate_path() + "depth_map_mvs/";
+  //CMVS参数: 分块影像数, 精度与覆盖率阈值; 合并参数.
+  options.cluster_size = std::max(point_cloud_config->c_cluster_size(), 0);
+  options.cluster_accuracy_threshold =
+    point_cloud_config->c_accuracy_threshold();
+  options.cluster_coverage_threshold =
+    point_cloud_config->c_coverage_threshold();
+  options.min_home_views =
+    std::max(point_cloud_config->m_quality_threshold(), 1);
+  if (point_cloud_config->dense_method() == PointCloudConfig::DENSE_SGM)
+  {
+    options.method = DepthMapMVSOptions::METHOD_SGM;
+  }
+
+  //点云后处理: 合并重复点, 去除离群点, 按密集点间距体素化.
+  DepthMapMVS depth_map_mvs(options);
+  float sample_distance =
+    float(depth_map_mvs.SampleDistance(photos, sparse_points));
+  float voxel_size = point_cloud_config->f_voxel_size();
+  if (voxel_size == 0.0f) voxel_size = sample_distance;
+  float base_distance = voxel_size > 0.0f ? voxel_size : sample_distance;
+  PointCloudFilterOptions filter_options;
+  filter_options.duplicate_distance = 0.25f * base_distance;
+  filter_options.outlier_neighbours =
+    std::max(point_cloud_config->f_outlier_neighbours(), 0);
+  filter_options.outlier_radius = 4.0f * base_distance;
+  filter_options.outlier_std_ratio =
+    point_cloud_config->f_outlier_std_ratio();
+  filter_options.voxel_size = std::max(voxel_size, 0.0f);
+  filter_options.number_of_threads = options.number_of_threads;
+
+  //各分块融合并过滤后即写入文件
+  if (depth_map_mvs(photos, sparse_points, dense_point_cloud_path,
+                    &tracks, &filter_options, &progress_manager_) != 0)
+  {
+    return -1;
+  }
+
+  progress_manager_.SetCurrentSubProgressCompleteRatio(1);
+  return 0;
 }
 
 
@@ -19,6 +19,14 @@ namespace workflow
 
 class HS_EXPORT PointCloudConfig : public WorkflowStepConfig
 {
+public:
+  enum DenseMethod
+  {
+    DENSE_DEPTH_MAP = 0,
+    //适用于下视航摄影像
+    DENSE_SGM
+  };
+
 public:
   PointCloudConfig();
 
@@ -28,6 +36,7 @@ public:
   void set_intrinsic_path(const std::string& intrinsic_path);
   void set_extrinsic_path(const std::string& extrinsic_path);
   void set_sparse_point_cloud_path(const std::string& sparse_point_cloud_path);
+  void set_tracks_path(const std::string& tracks_path);
   void set_intermediate_path(const std::string& intermediate_path);
   void set_s_number_of_threads(int s_number_of_threads);
   void set_s_pyramid_level(int s_pyramid_level);
@@ -41,12 +50,17 @@ public:
   void set_p_group_threshold(float p_group_threshold);
   void set_m_quality_threshold(int m_quality_threshold);
   void set_m_visibility_threshold(int m_visibility_threshold);
+  void set_dense_method(int dense_method);
+  void set_f_voxel_size(float f_voxel_size);
+  void set_f_outlier_neighbours(int f_outlier_neighbours);
+  void set_f_outlier_std_ratio(float f_outlier_std_ratio);
 
   bool using_sparse_point_cloud() const;
   const std::string& photo_orientation_path() const;
   const std::string& intrinsic_path() const;
   const std::string& extrinsic_path() const;
   const std::string& sparse_point_cloud_path() const;
+  const std::string& tracks_path() const;
   const std::string& workspace_path() const;
   const std::string& intermediate_path() const;
   int s_number_of_threads() const;
@@ -61,6 +75,10 @@ public:
   int p_visibility_threshold() const;
   int m_quality_threshold() const;
   int m_visibility_threshold() const;
+  int dense_method() const;
+  float f_voxel_size() const;
+  int f_outlier_neighbours() const;
+  float f_outlier_std_ratio() const;
 
   std::map<int, std::string>& photo_paths();
   const std::map<int, std::string>& photo_paths() const;
@@ -71,6 +89,7 @@ private:
   std::string intrinsic_path_;
   std::string extrinsic_path_;
   std::string sparse_point_cloud_path_;
+  std::string tracks_path_;
   std::string workspace_path_; //Point Cloud 工作路径
   std::string intermediate_path_; //临时工作路径
   //photo_paths_<photo_id, photo_path>
@@ -91,6 +110,14 @@ private:
   //merge_section
   int m_quality_threshold_;
   int m_visibility_threshold_;
+  //密集匹配方法
+  int dense_method_;
+  //filter_section
+  //体素边长, 0为密集点间距, 负值不做体素化
+  float f_voxel_size_;
+  //离群点判断的邻点数, 0不去除离群点
+  int   f_outlier_neighbours_;
+  float f_outlier_std_ratio_;
 
 };
 
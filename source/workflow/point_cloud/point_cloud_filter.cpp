@@ -0,0 +1,415 @@
+#include <algorithm>
+#include <cmath>
+
+#include "workflow/common/morton_code.hpp"
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/point_cloud/point_cloud_filter.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef PointCloudFilter::Scalar Scalar;
+typedef PointCloudFilter::Vector3 Vector3;
+typedef PointCloudFilter::PointCloudData PointCloudData;
+typedef PointCloudFilter::Code Code;
+typedef PointCloudFilter::CodedPoint CodedPoint;
+typedef PointCloudData::Vector3Container Vector3Container;
+
+//Points sorted by one thread before the blocks are merged.
+const size_t MIN_SORT_BLOCK = 1 << 16;
+//Neighbours searched for outliers, the rest count as outlier_radius away.
+const int MAX_OUTLIER_NEIGHBOURS = 64;
+
+bool LessCode(const CodedPoint& a, const CodedPoint& b)
+{
+  return a.first < b.first;
+}
+
+uint32_t CellCoordinate(Scalar value, Scalar origin, Scalar cell_size)
+{
+  Scalar cell = std::floor((value - origin) / cell_size);
+  if (cell <= Scalar(0)) return 0;
+  return std::min(uint32_t(cell), MORTON_MAX_CELL);
+}
+
+struct CodeWorker
+{
+  CodeWorker(const Vector3Container& points_, const Vector3& origin_,
+             Scalar cell_size_, std::vector<CodedPoint>& coded_points_)
+    : points(points_), origin(origin_), cell_size(cell_size_),
+      coded_points(coded_points_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      const Vector3& point = points[i];
+      coded_points[i] = CodedPoint(PointCloudFilter::MortonCode(
+        CellCoordinate(point[0], origin[0], cell_size),
+        CellCoordinate(point[1], origin[1], cell_size),
+        CellCoordinate(point[2], origin[2], cell_size)), i);
+    }
+  }
+
+  const Vector3Container& points;
+  const Vector3& origin;
+  Scalar cell_size;
+  std::vector<CodedPoint>& coded_points;
+};
+
+/**
+ *  Sorts blocks of block_size points, or merges pairs of sorted blocks of
+ *  block_size points when merging.
+ */
+struct SortWorker
+{
+  SortWorker(std::vector<CodedPoint>& coded_points_, size_t block_size_,
+             bool merging_)
+    : coded_points(coded_points_), block_size(block_size_),
+      merging(merging_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    size_t span = merging ? block_size * 2 : block_size;
+    for (size_t block = begin; block < end; block++)
+    {
+      size_t first = block * span;
+      size_t last = std::min(first + span, coded_points.size());
+      if (!merging)
+      {
+        std::sort(coded_points.begin() + first,
+                  coded_points.begin() + last, LessCode);
+      }
+      else if (first + block_size < last)
+      {
+        std::inplace_merge(coded_points.begin() + first,
+                           coded_points.begin() + first + block_size,
+                           coded_points.begin() + last, LessCode);
+      }
+    }
+  }
+
+  std::vector<CodedPoint>& coded_points;
+  size_t block_size;
+  bool merging;
+};
+
+void ParallelSort(std::vector<CodedPoint>& coded_points,
+                  size_t number_of_threads)
+{
+  size_t number_of_points = coded_points.size();
+  size_t block_size = std::max(
+    (number_of_points + number_of_threads - 1) / number_of_threads,
+    MIN_SORT_BLOCK);
+  size_t number_of_blocks = (number_of_points + block_size - 1) / block_size;
+  SortWorker sorter(coded_points, block_size, false);
+  ParallelFor(0, number_of_blocks, number_of_threads, sorter);
+  for (; block_size < number_of_points; block_size *= 2)
+  {
+    size_t number_of_merges =
+      (number_of_points + block_size * 2 - 1) / (block_size * 2);
+    SortWorker merger(coded_points, block_size, true);
+    ParallelFor(0, number_of_merges, number_of_threads, merger);
+  }
+}
+
+/**
+ *  Averages the points of each run of equal codes.
+ */
+struct MergeWorker
+{
+  MergeWorker(const PointCloudData& input_,
+              const std::vector<CodedPoint>& coded_points_,
+              const std::vector<size_t>& run_begins_,
+              PointCloudData& output_)
+    : input(input_), coded_points(coded_points_), run_begins(run_begins_),
+      output(output_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    bool has_normals = !input.NormalData().empty();
+    bool has_colors = !input.ColorData().empty();
+    for (size_t run = begin; run < end; run++)
+    {
+      size_t first = run_begins[run];
+      size_t last = run_begins[run + 1];
+      Vector3 point = Vector3::Zero();
+      Vector3 normal = Vector3::Zero();
+      Vector3 color = Vector3::Zero();
+      for (size_t k = first; k < last; k++)
+      {
+        size_t point_id = coded_points[k].second;
+        point += input.VertexData()[point_id];
+        if (has_normals) normal += input.NormalData()[point_id];
+        if (has_colors) color += input.ColorData()[point_id];
+      }
+      Scalar weight = Scalar(1) / Scalar(last - first);
+      output.VertexData()[run] = point * weight;
+      if (has_normals)
+      {
+        //Opposite normals cancel out, keep the first one then.
+        Scalar norm = normal.norm();
+        output.NormalData()[run] = norm > Scalar(0) ? Vector3(normal / norm) :
+          input.NormalData()[coded_points[first].second];
+      }
+      if (has_colors) output.ColorData()[run] = color * weight;
+    }
+  }
+
+  const PointCloudData& input;
+  const std::vector<CodedPoint>& coded_points;
+  const std::vector<size_t>& run_begins;
+  PointCloudData& output;
+};
+
+/**
+ *  Mean distance of each sorted point to its nearest neighbours, searched
+ *  in the 27 cells around its own.
+ */
+struct NeighbourDistanceWorker
+{
+  NeighbourDistanceWorker(const Vector3Container& points_,
+                          const std::vector<CodedPoint>& coded_points_,
+                          const Vector3& origin_,
+                          Scalar cell_size_,
+                          int number_of_neighbours_,
+                          Scalar radius_,
+                          std::vector<Scalar>& mean_distances_)
+    : points(points_), coded_points(coded_points_), origin(origin_),
+      cell_size(cell_size_), number_of_neighbours(number_of_neighbours_),
+      radius(radius_), mean_distances(mean_distances_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    Scalar distances[MAX_OUTLIER_NEIGHBOURS];
+    for (size_t i = begin; i < end; i++)
+    {
+      const Vector3& point = points[coded_points[i].second];
+      int64_t cell[3];
+      for (int axis = 0; axis < 3; axis++)
+      {
+        cell[axis] = int64_t(CellCoordinate(point[axis], origin[axis],
+                                            cell_size));
+      }
+      for (int k = 0; k < number_of_neighbours; k++)
+      {
+        distances[k] = radius;
+      }
+      for (int offset = 0; offset < 27; offset++)
+      {
+        int64_t x = cell[0] + offset % 3 - 1;
+        int64_t y = cell[1] + offset / 3 % 3 - 1;
+        int64_t z = cell[2] + offset / 9 - 1;
+        int64_t max_cell = int64_t(MORTON_MAX_CELL);
+        if (x < 0 || y < 0 || z < 0 ||
+            x > max_cell || y > max_cell || z > max_cell) continue;
+        CodedPoint key(PointCloudFilter::MortonCode(
+          uint32_t(x), uint32_t(y), uint32_t(z)), 0);
+        std::vector<CodedPoint>::const_iterator itr =
+          std::lower_bound(coded_points.begin(), coded_points.end(), key,
+                           LessCode);
+        for (; itr != coded_points.end() && itr->first == key.first; ++itr)
+        {
+          if (itr->second == coded_points[i].second) continue;
+          Scalar distance = (points[itr->second] - point).norm();
+          if (distance >= distances[number_of_neighbours - 1]) continue;
+          //Insertion into the sorted nearest distances.
+          int k = number_of_neighbours - 1;
+          for (; k > 0 && distances[k - 1] > distance; k--)
+          {
+            distances[k] = distances[k - 1];
+          }
+          distances[k] = distance;
+        }
+      }
+      Scalar sum = 0;
+      for (int k = 0; k < number_of_neighbours; k++)
+      {
+        sum += distances[k];
+      }
+      mean_distances[i] = sum / Scalar(number_of_neighbours);
+    }
+  }
+
+  const Vector3Container& points;
+  const std::vector<CodedPoint>& coded_points;
+  const Vector3& origin;
+  Scalar cell_size;
+  int number_of_neighbours;
+  Scalar radius;
+  std::vector<Scalar>& mean_distances;
+};
+
+}
+
+PointCloudFilterOptions::PointCloudFilterOptions()
+  : duplicate_distance(0)
+  , outlier_neighbours(8)
+  , outlier_radius(0)
+  , outlier_std_ratio(2.0f)
+  , voxel_size(0)
+  , number_of_threads(1)
+{
+}
+
+PointCloudFilter::PointCloudFilter(const PointCloudFilterOptions& options)
+  : options_(options)
+{
+  options_.number_of_threads =
+    std::max(options_.number_of_threads, size_t(1));
+  options_.outlier_neighbours =
+    std::min(options_.outlier_neighbours, MAX_OUTLIER_NEIGHBOURS);
+}
+
+PointCloudFilter::Code PointCloudFilter::MortonCode(uint32_t x,
+                                                    uint32_t y,
+                                                    uint32_t z)
+{
+  return workflow::MortonCode(x, y, z);
+}
+
+PointCloudFilter::Scalar PointCloudFilter::SortByCell(
+  const PointCloudData& point_cloud,
+  Scalar cell_size,
+  Vector3& origin,
+  std::vector<CodedPoint>& coded_points) const
+{
+  const Vector3Container& points = point_cloud.VertexData();
+  if (points.empty() || !(cell_size > Scalar(0))) return Scalar(0);
+  origin = points[0];
+  Vector3 corner = points[0];
+  for (size_t i = 1; i < points.size(); i++)
+  {
+    origin = origin.cwiseMin(points[i]);
+    corner = corner.cwiseMax(points[i]);
+  }
+  Scalar extent = (corner - origin).maxCoeff();
+  cell_size = std::max(cell_size, extent / Scalar(MORTON_MAX_CELL));
+
+  coded_points.resize(points.size());
+  CodeWorker coder(points, origin, cell_size, coded_points);
+  ParallelFor(0, points.size(), options_.number_of_threads, coder);
+  ParallelSort(coded_points, options_.number_of_threads);
+  return cell_size;
+}
+
+int PointCloudFilter::MergeCells(Scalar cell_size,
+                                 PointCloudData& point_cloud) const
+{
+  Vector3 origin;
+  std::vector<CodedPoint> coded_points;
+  if (SortByCell(point_cloud, cell_size, origin, coded_points) <= Scalar(0))
+  {
+    return -1;
+  }
+
+  std::vector<size_t> run_begins;
+  for (size_t i = 0; i < coded_points.size(); i++)
+  {
+    if (i == 0 || coded_points[i].first != coded_points[i - 1].first)
+    {
+      run_begins.push_back(i);
+    }
+  }
+  size_t number_of_runs = run_begins.size();
+  run_begins.push_back(coded_points.size());
+
+  PointCloudData merged;
+  merged.VertexData().resize(number_of_runs);
+  if (!point_cloud.NormalData().empty())
+  {
+    merged.NormalData().resize(number_of_runs);
+  }
+  if (!point_cloud.ColorData().empty())
+  {
+    merged.ColorData().resize(number_of_runs);
+  }
+  MergeWorker worker(point_cloud, coded_points, run_begins, merged);
+  ParallelFor(0, number_of_runs, options_.number_of_threads, worker);
+  point_cloud = merged;
+  return 0;
+}
+
+int PointCloudFilter::RemoveOutliers(PointCloudData& point_cloud) const
+{
+  Scalar radius = Scalar(options_.outlier_radius);
+  Vector3 origin;
+  std::vector<CodedPoint> coded_points;
+  Scalar cell_size = SortByCell(point_cloud, radius, origin, coded_points);
+  if (cell_size <= Scalar(0)) return -1;
+  size_t number_of_points = coded_points.size();
+
+  std::vector<Scalar> mean_distances(number_of_points);
+  NeighbourDistanceWorker worker(point_cloud.VertexData(), coded_points,
+                                 origin, cell_size,
+                                 options_.outlier_neighbours, radius,
+                                 mean_distances);
+  ParallelForDynamic(0, number_of_points, options_.number_of_threads, 4096,
+                     worker);
+
+  Scalar mean = 0;
+  Scalar square_mean = 0;
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    mean += mean_distances[i];
+    square_mean += mean_distances[i] * mean_distances[i];
+  }
+  mean /= Scalar(number_of_points);
+  square_mean /= Scalar(number_of_points);
+  Scalar deviation = std::sqrt(std::max(square_mean - mean * mean,
+                                        Scalar(0)));
+  Scalar threshold = mean + Scalar(options_.outlier_std_ratio) * deviation;
+
+  //Kept points stay in cell order.
+  bool has_normals = !point_cloud.NormalData().empty();
+  bool has_colors = !point_cloud.ColorData().empty();
+  PointCloudData kept;
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    if (mean_distances[i] > threshold) continue;
+    size_t point_id = coded_points[i].second;
+    kept.VertexData().push_back(point_cloud.VertexData()[point_id]);
+    if (has_normals)
+    {
+      kept.NormalData().push_back(point_cloud.NormalData()[point_id]);
+    }
+    if (has_colors)
+    {
+      kept.ColorData().push_back(point_cloud.ColorData()[point_id]);
+    }
+  }
+  point_cloud = kept;
+  return 0;
+}
+
+int PointCloudFilter::operator() (PointCloudData& point_cloud) const
+{
+  if (point_cloud.VertexData().empty()) return -1;
+  if (options_.duplicate_distance > 0.0f &&
+      MergeCells(Scalar(options_.duplicate_distance), point_cloud) != 0)
+  {
+    return -1;
+  }
+  if (options_.outlier_neighbours > 0 && options_.outlier_radius > 0.0f &&
+      RemoveOutliers(point_cloud) != 0)
+  {
+    return -1;
+  }
+  if (options_.voxel_size > 0.0f &&
+      MergeCells(Scalar(options_.voxel_size), point_cloud) != 0)
+  {
+    return -1;
+  }
+  return point_cloud.VertexData().empty() ? -1 : 0;
+}
+
+}
+}
+}
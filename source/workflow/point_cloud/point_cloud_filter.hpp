@@ -0,0 +1,87 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_POINT_CLOUD_FILTER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_POINT_CLOUD_FILTER_HPP_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_graphics/graphics_utility/pointcloud_data.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+struct HS_EXPORT PointCloudFilterOptions
+{
+  PointCloudFilterOptions();
+
+  //Points closer than duplicate_distance are merged, 0 keeps them.
+  float duplicate_distance;
+  //Points whose mean distance to their outlier_neighbours nearest points
+  //exceeds the cloud mean by outlier_std_ratio standard deviations are
+  //removed. Neighbours are searched within outlier_radius. 0 neighbours
+  //keeps all points.
+  int outlier_neighbours;
+  float outlier_radius;
+  float outlier_std_ratio;
+  //Edge of the voxels points are averaged in, 0 keeps the density.
+  float voxel_size;
+  size_t number_of_threads;
+};
+
+/**
+ *  Post-processing of a dense cloud: duplicate merging, statistical outlier
+ *  removal and voxel grid downsampling, in that order.
+ *
+ *  Every stage sorts the points by the Morton code of their grid cell, so
+ *  points of a cell are contiguous and nearby cells mostly are too. Cells
+ *  are merged by scanning the sorted codes and neighbouring cells are found
+ *  by binary search, which needs no hash map and parallelizes over ranges.
+ */
+class HS_EXPORT PointCloudFilter
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vector3;
+  typedef hs::graphics::PointCloudData<Scalar> PointCloudData;
+  typedef uint64_t Code;
+  typedef std::pair<Code, size_t> CodedPoint;
+
+  PointCloudFilter(const PointCloudFilterOptions& options);
+
+  int operator() (PointCloudData& point_cloud) const;
+
+  /**
+   *  Average the points, normals and colors of each cell of edge
+   *  cell_size.
+   */
+  int MergeCells(Scalar cell_size, PointCloudData& point_cloud) const;
+  int RemoveOutliers(PointCloudData& point_cloud) const;
+
+  /**
+   *  Sort the points by the Morton code of their cell. The cell grows if
+   *  the cloud spans more than 2^21 cells along an axis. Returns the cell
+   *  size used, 0 on failure.
+   */
+  Scalar SortByCell(const PointCloudData& point_cloud,
+                    Scalar cell_size,
+                    Vector3& origin,
+                    std::vector<CodedPoint>& coded_points) const;
+
+  static Code MortonCode(uint32_t x, uint32_t y, uint32_t z);
+
+private:
+  PointCloudFilterOptions options_;
+};
+
+}
+}
+}
+
+#endif
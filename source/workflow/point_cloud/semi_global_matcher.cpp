@@ -0,0 +1,435 @@
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define HS_SGM_SSE2
+#include <emmintrin.h>
+#endif
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/point_cloud/semi_global_matcher.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef SemiGlobalMatcher::Cost Cost;
+typedef RectifiedPair::Byte Byte;
+
+const int CENSUS_RADIUS = 2;
+const Byte INVALID_COST = 24;
+//Padding of path buffers, large but safe to add penalties to as int16.
+const Cost PATH_PADDING = 0x3FFF;
+//Context around a tile for the paths to settle.
+const int TILE_MARGIN = 32;
+//The second best cost must be this much worse, in percent.
+const int UNIQUENESS_RATIO = 5;
+
+int PopCount(uint32_t bits)
+{
+  bits = bits - ((bits >> 1) & 0x55555555u);
+  bits = (bits & 0x33333333u) + ((bits >> 2) & 0x33333333u);
+  bits = (bits + (bits >> 4)) & 0x0F0F0F0Fu;
+  return int((bits * 0x01010101u) >> 24);
+}
+
+/**
+ *  5x5 census transform. Pixels whose window leaves the image or the mask
+ *  are marked invalid.
+ */
+void Census(int width, int height,
+            const std::vector<Byte>& gray, const std::vector<Byte>& mask,
+            std::vector<uint32_t>& census, std::vector<Byte>& valid)
+{
+  size_t number_of_pixels = size_t(width) * size_t(height);
+  census.assign(number_of_pixels, 0);
+  valid.assign(number_of_pixels, 0);
+  for (int row = CENSUS_RADIUS; row < height - CENSUS_RADIUS; row++)
+  {
+    for (int col = CENSUS_RADIUS; col < width - CENSUS_RADIUS; col++)
+    {
+      size_t pixel_id = size_t(row) * size_t(width) + size_t(col);
+      Byte center = gray[pixel_id];
+      uint32_t bits = 0;
+      bool is_valid = true;
+      for (int i = -CENSUS_RADIUS; i <= CENSUS_RADIUS && is_valid; i++)
+      {
+        for (int j = -CENSUS_RADIUS; j <= CENSUS_RADIUS; j++)
+        {
+          size_t neighbour_id = size_t(row + i) * size_t(width) +
+                                size_t(col + j);
+          if (!mask[neighbour_id])
+          {
+            is_valid = false;
+            break;
+          }
+          if (i == 0 && j == 0) continue;
+          bits = (bits << 1) | uint32_t(gray[neighbour_id] < center);
+        }
+      }
+      census[pixel_id] = bits;
+      valid[pixel_id] = Byte(is_valid);
+    }
+  }
+}
+
+/**
+ *  One step of a path: out[d] = cost[d] + min(prev[d], prev[d -+ 1] + p1,
+ *  prev_min + p2) - prev_min, accumulated into sum. prev and out point past
+ *  a padding element on either side, prev is null at the start of a path.
+ *  Returns the minimum of out.
+ */
+Cost UpdatePath(const Byte* cost, const Cost* prev, Cost prev_min,
+                Cost* out, Cost* sum, int number_of_disparities,
+                int p1, int p2)
+{
+  if (!prev)
+  {
+    Cost out_min = PATH_PADDING;
+    for (int d = 0; d < number_of_disparities; d++)
+    {
+      out[d] = cost[d];
+      sum[d] = Cost(sum[d] + out[d]);
+      out_min = std::min(out_min, out[d]);
+    }
+    return out_min;
+  }
+
+#ifdef HS_SGM_SSE2
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i penalty1 = _mm_set1_epi16(short(p1));
+  const __m128i jump = _mm_set1_epi16(short(prev_min + p2));
+  const __m128i base = _mm_set1_epi16(short(prev_min));
+  __m128i minimum = _mm_set1_epi16(short(PATH_PADDING));
+  for (int d = 0; d < number_of_disparities; d += 8)
+  {
+    __m128i costs = _mm_unpacklo_epi8(
+      _mm_loadl_epi64(reinterpret_cast<const __m128i*>(cost + d)), zero);
+    __m128i same =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + d));
+    __m128i lower =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + d - 1));
+    __m128i upper =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev + d + 1));
+    __m128i best = _mm_min_epi16(_mm_adds_epu16(lower, penalty1),
+                                 _mm_adds_epu16(upper, penalty1));
+    best = _mm_min_epi16(_mm_min_epi16(best, same), jump);
+    __m128i value = _mm_sub_epi16(_mm_add_epi16(costs, best), base);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + d), value);
+    minimum = _mm_min_epi16(minimum, value);
+    __m128i total =
+      _mm_loadu_si128(reinterpret_cast<const __m128i*>(sum + d));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(sum + d),
+                     _mm_adds_epu16(total, value));
+  }
+  minimum = _mm_min_epi16(minimum, _mm_srli_si128(minimum, 8));
+  minimum = _mm_min_epi16(minimum, _mm_srli_si128(minimum, 4));
+  minimum = _mm_min_epi16(minimum, _mm_srli_si128(minimum, 2));
+  return Cost(_mm_cvtsi128_si32(minimum) & 0xFFFF);
+#else
+  Cost out_min = PATH_PADDING;
+  int jump = int(prev_min) + p2;
+  for (int d = 0; d < number_of_disparities; d++)
+  {
+    int best = std::min(int(prev[d - 1]), int(prev[d + 1])) + p1;
+    best = std::min(std::min(best, int(prev[d])), jump);
+    out[d] = Cost(int(cost[d]) + best - int(prev_min));
+    sum[d] = Cost(sum[d] + out[d]);
+    out_min = std::min(out_min, out[d]);
+  }
+  return out_min;
+#endif
+}
+
+/**
+ *  Matches single tiles. Holds the cost volume and path buffers, so each
+ *  thread works on its own copy.
+ */
+struct TileMatcher
+{
+  TileMatcher(const RectifiedPair& pair_,
+              const std::vector<uint32_t>& left_census_,
+              const std::vector<Byte>& left_valid_,
+              const std::vector<uint32_t>& right_census_,
+              const std::vector<Byte>& right_valid_,
+              int number_of_disparities_, int p1_, int p2_, int tile_size_,
+              std::vector<float>& disparities_)
+    : pair(pair_), left_census(left_census_), left_valid(left_valid_),
+      right_census(right_census_), right_valid(right_valid_),
+      number_of_disparities(number_of_disparities_), p1(p1_), p2(p2_),
+      tile_size(tile_size_), disparities(disparities_)
+  {
+    tiles_x = (pair.width + tile_size - 1) / tile_size;
+  }
+
+  /**
+   *  Aggregate the 4 paths coming from above and the left (forward) or
+   *  from below and the right (backward).
+   */
+  void AggregatePass(bool forward)
+  {
+    int stride = number_of_disparities + 2;
+    int directions[3] = {-1, 0, 1};
+    if (!forward)
+    {
+      directions[0] = 1;
+      directions[2] = -1;
+    }
+    for (int k = 0; k < 3; k++)
+    {
+      previous_rows[k].assign(size_t(extent_width) * size_t(stride),
+                              PATH_PADDING);
+      current_rows[k].assign(size_t(extent_width) * size_t(stride),
+                             PATH_PADDING);
+      previous_minima[k].assign(size_t(extent_width), 0);
+      current_minima[k].assign(size_t(extent_width), 0);
+    }
+    std::vector<Cost> previous_pixel(size_t(stride), PATH_PADDING);
+    std::vector<Cost> current_pixel(size_t(stride), PATH_PADDING);
+
+    for (int r = 0; r < extent_height; r++)
+    {
+      int row = forward ? r : extent_height - 1 - r;
+      Cost previous_pixel_min = 0;
+      for (int c = 0; c < extent_width; c++)
+      {
+        int col = forward ? c : extent_width - 1 - c;
+        size_t pixel_id = (size_t(row) * size_t(extent_width) + size_t(col)) *
+                          size_t(number_of_disparities);
+        const Byte* cost = &costs[pixel_id];
+        Cost* sum = &sums[pixel_id];
+
+        previous_pixel_min = UpdatePath(
+          cost, c == 0 ? nullptr : &previous_pixel[1], previous_pixel_min,
+          &current_pixel[1], sum, number_of_disparities, p1, p2);
+        previous_pixel.swap(current_pixel);
+
+        for (int k = 0; k < 3; k++)
+        {
+          int previous_col = col + directions[k];
+          bool has_previous = r > 0 && previous_col >= 0 &&
+                              previous_col < extent_width;
+          const Cost* previous = has_previous ?
+            &previous_rows[k][size_t(previous_col) * stride + 1] : nullptr;
+          current_minima[k][col] = UpdatePath(
+            cost, previous,
+            has_previous ? previous_minima[k][previous_col] : Cost(0),
+            &current_rows[k][size_t(col) * stride + 1], sum,
+            number_of_disparities, p1, p2);
+        }
+      }
+      for (int k = 0; k < 3; k++)
+      {
+        previous_rows[k].swap(current_rows[k]);
+        previous_minima[k].swap(current_minima[k]);
+      }
+    }
+  }
+
+  void MatchTile(size_t tile_id)
+  {
+    int tile_x = int(tile_id % size_t(tiles_x));
+    int tile_y = int(tile_id / size_t(tiles_x));
+    int core_x0 = tile_x * tile_size;
+    int core_y0 = tile_y * tile_size;
+    int core_x1 = std::min(core_x0 + tile_size, pair.width);
+    int core_y1 = std::min(core_y0 + tile_size, pair.height);
+    //Extra context on the left for the right image check.
+    extent_x0 = std::max(core_x0 - TILE_MARGIN - number_of_disparities, 0);
+    extent_y0 = std::max(core_y0 - TILE_MARGIN, 0);
+    int extent_x1 = std::min(core_x1 + TILE_MARGIN, pair.width);
+    int extent_y1 = std::min(core_y1 + TILE_MARGIN, pair.height);
+    extent_width = extent_x1 - extent_x0;
+    extent_height = extent_y1 - extent_y0;
+
+    size_t volume_size = size_t(extent_width) * size_t(extent_height) *
+                         size_t(number_of_disparities);
+    costs.assign(volume_size, INVALID_COST);
+    sums.assign(volume_size, 0);
+    for (int row = 0; row < extent_height; row++)
+    {
+      size_t image_row = size_t(row + extent_y0) * size_t(pair.width);
+      for (int col = 0; col < extent_width; col++)
+      {
+        int image_col = col + extent_x0;
+        size_t left_id = image_row + size_t(image_col);
+        if (!left_valid[left_id]) continue;
+        Byte* cost = &costs[(size_t(row) * size_t(extent_width) +
+                             size_t(col)) * size_t(number_of_disparities)];
+        int d_end = std::min(number_of_disparities, image_col + 1);
+        for (int d = 0; d < d_end; d++)
+        {
+          size_t right_id = left_id - size_t(d);
+          if (!right_valid[right_id]) continue;
+          cost[d] = Byte(PopCount(left_census[left_id] ^
+                                  right_census[right_id]));
+        }
+      }
+    }
+
+    AggregatePass(true);
+    AggregatePass(false);
+
+    for (int row = core_y0 - extent_y0; row < core_y1 - extent_y0; row++)
+    {
+      //Best disparity of each right pixel, for the consistency check.
+      std::vector<int> right_disparities(size_t(extent_width), -1);
+      std::vector<Cost> right_costs(size_t(extent_width), 0xFFFF);
+      for (int col = 0; col < extent_width; col++)
+      {
+        const Cost* sum = &sums[(size_t(row) * size_t(extent_width) +
+                                 size_t(col)) * size_t(number_of_disparities)];
+        int d_end = std::min(number_of_disparities, col + 1);
+        for (int d = 0; d < d_end; d++)
+        {
+          if (sum[d] < right_costs[col - d])
+          {
+            right_costs[col - d] = sum[d];
+            right_disparities[col - d] = d;
+          }
+        }
+      }
+
+      for (int col = core_x0 - extent_x0; col < core_x1 - extent_x0; col++)
+      {
+        size_t image_id = size_t(row + extent_y0) * size_t(pair.width) +
+                          size_t(col + extent_x0);
+        disparities[image_id] = -1.0f;
+        if (!left_valid[image_id]) continue;
+        size_t volume_id = (size_t(row) * size_t(extent_width) +
+                            size_t(col)) * size_t(number_of_disparities);
+        const Cost* sum = &sums[volume_id];
+        int best_d = 0;
+        for (int d = 1; d < number_of_disparities; d++)
+        {
+          if (sum[d] < sum[best_d]) best_d = d;
+        }
+        if (costs[volume_id + best_d] == INVALID_COST) continue;
+        if (best_d > col) continue;
+        int second = 0xFFFF;
+        for (int d = 0; d < number_of_disparities; d++)
+        {
+          if (d < best_d - 1 || d > best_d + 1)
+          {
+            second = std::min(second, int(sum[d]));
+          }
+        }
+        if (int(sum[best_d]) * (100 + UNIQUENESS_RATIO) > second * 100)
+        {
+          continue;
+        }
+        int right_d = right_disparities[col - best_d];
+        if (right_d < 0 || std::abs(right_d - best_d) > 1) continue;
+
+        float refined = float(best_d);
+        if (best_d > 0 && best_d < number_of_disparities - 1)
+        {
+          float left_sum = float(sum[best_d - 1]);
+          float center_sum = float(sum[best_d]);
+          float right_sum = float(sum[best_d + 1]);
+          float denominator = left_sum - 2.0f * center_sum + right_sum;
+          if (denominator > 0.0f)
+          {
+            refined += 0.5f * (left_sum - right_sum) / denominator;
+          }
+        }
+        disparities[image_id] = refined;
+      }
+    }
+  }
+
+  const RectifiedPair& pair;
+  const std::vector<uint32_t>& left_census;
+  const std::vector<Byte>& left_valid;
+  const std::vector<uint32_t>& right_census;
+  const std::vector<Byte>& right_valid;
+  int number_of_disparities;
+  int p1;
+  int p2;
+  int tile_size;
+  int tiles_x;
+  std::vector<float>& disparities;
+
+  //Per tile buffers.
+  int extent_x0;
+  int extent_y0;
+  int extent_width;
+  int extent_height;
+  std::vector<Byte> costs;
+  std::vector<Cost> sums;
+  std::vector<Cost> previous_rows[3];
+  std::vector<Cost> current_rows[3];
+  std::vector<Cost> previous_minima[3];
+  std::vector<Cost> current_minima[3];
+};
+
+struct SGMTileWorker
+{
+  SGMTileWorker(const TileMatcher& prototype_)
+    : prototype(prototype_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    TileMatcher matcher(prototype);
+    for (size_t i = begin; i < end; i++)
+    {
+      matcher.MatchTile(i);
+    }
+  }
+
+  const TileMatcher& prototype;
+};
+
+}
+
+SemiGlobalMatcher::SemiGlobalMatcher(int p1, int p2, int tile_size,
+                                     size_t number_of_threads)
+  : p1_(p1)
+  , p2_(std::max(p2, p1))
+  , tile_size_(std::max(tile_size, 16))
+  , number_of_threads_(std::max(number_of_threads, size_t(1)))
+{
+}
+
+int SemiGlobalMatcher::operator() (const RectifiedPair& pair,
+                                   int number_of_disparities,
+                                   std::vector<float>& disparities) const
+{
+  if (pair.width <= 0 || pair.height <= 0 ||
+      number_of_disparities <= 0 || number_of_disparities % 16 != 0)
+  {
+    return -1;
+  }
+
+  std::vector<uint32_t> left_census;
+  std::vector<uint32_t> right_census;
+  std::vector<Byte> left_valid;
+  std::vector<Byte> right_valid;
+  Census(pair.width, pair.height, pair.left_gray, pair.left_mask,
+         left_census, left_valid);
+  Census(pair.width, pair.height, pair.right_gray, pair.right_mask,
+         right_census, right_valid);
+
+  disparities.assign(size_t(pair.width) * size_t(pair.height), -1.0f);
+  int tiles_x = (pair.width + tile_size_ - 1) / tile_size_;
+  int tiles_y = (pair.height + tile_size_ - 1) / tile_size_;
+  TileMatcher prototype(pair, left_census, left_valid,
+                        right_census, right_valid,
+                        number_of_disparities, p1_, p2_, tile_size_,
+                        disparities);
+  SGMTileWorker worker(prototype);
+  ParallelForDynamic(0, size_t(tiles_x) * size_t(tiles_y),
+                     number_of_threads_, 1, worker);
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,56 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_SEMI_GLOBAL_MATCHER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_SEMI_GLOBAL_MATCHER_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/stereo_rectifier.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Semi-global matching of a rectified pair with a 5x5 census cost.
+ *
+ *  Costs are aggregated along 8 paths. The image is cut into tiles of
+ *  tile_size pixels that are matched in parallel, each padded so that the
+ *  paths and the left-right check see enough context. Path aggregation
+ *  runs on 8 disparities at a time with SSE2 where it is available.
+ */
+class HS_EXPORT SemiGlobalMatcher
+{
+public:
+  typedef uint16_t Cost;
+
+  SemiGlobalMatcher(int p1 = 8,
+                    int p2 = 96,
+                    int tile_size = 256,
+                    size_t number_of_threads = 1);
+
+  /**
+   *  disparities receive x_left - x_right with subpixel refinement for every
+   *  left pixel, negative where the match is invalid or inconsistent.
+   *  number_of_disparities must be a multiple of 16.
+   */
+  int operator() (const RectifiedPair& pair,
+                  int number_of_disparities,
+                  std::vector<float>& disparities) const;
+
+private:
+  int p1_;
+  int p2_;
+  int tile_size_;
+  size_t number_of_threads_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,136 @@
+#include <algorithm>
+#include <cmath>
+
+#include <Eigen/Eigenvalues>
+
+#include "workflow/point_cloud/sgm_depth_estimator.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef MVSCamera::Scalar Scalar;
+typedef MVSCamera::Vector3 Vector3;
+typedef MVSCamera::Matrix33 Matrix33;
+
+//Relative depth change between samples treated as a discontinuity.
+const Scalar DEPTH_DISCONTINUITY = Scalar(0.05);
+//Plane fit window of the normals in samples.
+const int NORMAL_RADIUS = 2;
+const int MIN_NORMAL_SAMPLES = 6;
+const int DEFAULT_P1 = 8;
+const int DEFAULT_P2 = 96;
+const int DEFAULT_TILE_SIZE = 256;
+
+}
+
+SGMDepthEstimator::SGMDepthEstimator(int step,
+                                     int max_disparities,
+                                     size_t number_of_threads)
+  : step_(std::max(step, 1))
+  , max_disparities_(std::max(max_disparities, 16))
+  , matcher_(DEFAULT_P1, DEFAULT_P2, DEFAULT_TILE_SIZE, number_of_threads)
+{
+}
+
+int SGMDepthEstimator::operator() (const MVSView& left,
+                                   const MVSView& right,
+                                   float depth_min,
+                                   float depth_max,
+                                   MVSCamera& camera,
+                                   DepthMap& depth_map) const
+{
+  RectifiedPair pair;
+  int number_of_disparities;
+  if (rectifier_(left, right, depth_min, depth_max, max_disparities_,
+                 pair, number_of_disparities) != 0) return -1;
+  std::vector<float> disparities;
+  if (matcher_(pair, number_of_disparities, disparities) != 0) return -1;
+  camera = pair.left_camera;
+
+  int width = (pair.width + step_ - 1) / step_;
+  int height = (pair.height + step_ - 1) / step_;
+  depth_map.Reset(width, height, step_);
+  std::vector<Vector3> points(depth_map.Size(), Vector3::Zero());
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width; j++)
+    {
+      size_t pixel_id = size_t(i * step_) * size_t(pair.width) +
+                        size_t(j * step_);
+      if (disparities[pixel_id] < 0.0f) continue;
+      Scalar depth = pair.Depth(Scalar(disparities[pixel_id]));
+      if (depth < Scalar(depth_min) || depth > Scalar(depth_max)) continue;
+      size_t sample_id = size_t(i) * size_t(width) + size_t(j);
+      depth_map.depths[sample_id] = float(depth);
+      points[sample_id] = camera.BackProject(Scalar(j * step_),
+                                             Scalar(i * step_), depth);
+    }
+  }
+
+  //Normals from plane fits over the continuous samples around each sample.
+  std::vector<float> depths(depth_map.depths);
+  for (int i = 0; i < height; i++)
+  {
+    for (int j = 0; j < width; j++)
+    {
+      size_t sample_id = size_t(i) * size_t(width) + size_t(j);
+      float depth = depths[sample_id];
+      if (depth <= 0.0f) continue;
+      const Vector3& point = points[sample_id];
+      Vector3 mean = Vector3::Zero();
+      Matrix33 covariance = Matrix33::Zero();
+      int number_of_samples = 0;
+      for (int ni = std::max(i - NORMAL_RADIUS, 0);
+           ni <= std::min(i + NORMAL_RADIUS, height - 1); ni++)
+      {
+        for (int nj = std::max(j - NORMAL_RADIUS, 0);
+             nj <= std::min(j + NORMAL_RADIUS, width - 1); nj++)
+        {
+          size_t neighbour_id = size_t(ni) * size_t(width) + size_t(nj);
+          float neighbour_depth = depths[neighbour_id];
+          if (neighbour_depth <= 0.0f ||
+              std::abs(Scalar(neighbour_depth - depth)) >
+              DEPTH_DISCONTINUITY * Scalar(depth)) continue;
+          Vector3 offset = points[neighbour_id] - point;
+          mean += offset;
+          covariance += offset * offset.transpose();
+          number_of_samples++;
+        }
+      }
+      if (number_of_samples < MIN_NORMAL_SAMPLES)
+      {
+        depth_map.depths[sample_id] = 0.0f;
+        continue;
+      }
+      mean /= Scalar(number_of_samples);
+      covariance -= Scalar(number_of_samples) * mean * mean.transpose();
+      Eigen::SelfAdjointEigenSolver<Matrix33> solver(covariance);
+      Vector3 normal = solver.eigenvectors().col(0);
+      normal.normalize();
+      if (normal.dot(camera.C - point) < Scalar(0)) normal = -normal;
+
+      size_t pixel_id = size_t(i * step_) * size_t(pair.width) +
+                        size_t(j * step_);
+      depth_map.scores[sample_id] = 1.0f;
+      for (int c = 0; c < 3; c++)
+      {
+        depth_map.normals[sample_id * 3 + c] = float(normal[c]);
+        depth_map.colors[sample_id * 3 + c] =
+          pair.left_colors[pixel_id * 3 + c];
+      }
+    }
+  }
+
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,50 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_SGM_DEPTH_ESTIMATOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_SGM_DEPTH_ESTIMATOR_HPP_
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/depth_map_estimator.hpp"
+#include "workflow/point_cloud/semi_global_matcher.hpp"
+#include "workflow/point_cloud/stereo_rectifier.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Depth map of a stereo pair by rectification and semi-global matching.
+ *
+ *  The depth map is sampled every step pixels of the rectified left image
+ *  and belongs to the rectified left camera, not to the view. Normals come
+ *  from plane fits over the neighbouring samples on the same surface, and
+ *  isolated samples are dropped.
+ */
+class HS_EXPORT SGMDepthEstimator
+{
+public:
+  SGMDepthEstimator(int step,
+                    int max_disparities = 256,
+                    size_t number_of_threads = 1);
+
+  int operator() (const MVSView& left,
+                  const MVSView& right,
+                  float depth_min,
+                  float depth_max,
+                  MVSCamera& camera,
+                  DepthMap& depth_map) const;
+
+private:
+  int step_;
+  int max_disparities_;
+  StereoRectifier rectifier_;
+  SemiGlobalMatcher matcher_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,186 @@
+#include <algorithm>
+#include <cmath>
+
+#include "workflow/point_cloud/stereo_rectifier.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef MVSCamera::Scalar Scalar;
+typedef MVSCamera::Vector3 Vector3;
+typedef MVSCamera::Matrix33 Matrix33;
+typedef RectifiedPair::Byte Byte;
+
+//Baselines closer than 60 degrees to the viewing direction are rejected.
+const Scalar MAX_BASELINE_COSINE = Scalar(0.5);
+//The matcher works on blocks of this many disparities.
+const int DISPARITY_ALIGNMENT = 16;
+
+Byte ToByte(float value)
+{
+  return Byte(std::min(std::max(value + 0.5f, 0.0f), 255.0f));
+}
+
+/**
+ *  Resample view through homography, which maps rectified pixels to view
+ *  pixels.
+ */
+void Resample(const MVSView& view, const Matrix33& homography,
+              int width, int height,
+              std::vector<Byte>& gray, std::vector<Byte>& mask,
+              std::vector<Byte>* colors)
+{
+  size_t number_of_pixels = size_t(width) * size_t(height);
+  gray.assign(number_of_pixels, 0);
+  mask.assign(number_of_pixels, 0);
+  if (colors) colors->assign(number_of_pixels * 3, 0);
+  for (int row = 0; row < height; row++)
+  {
+    for (int col = 0; col < width; col++)
+    {
+      Vector3 source = homography * Vector3(Scalar(col), Scalar(row), 1);
+      if (source[2] <= Scalar(0)) continue;
+      float source_col = float(source[0] / source[2]);
+      float source_row = float(source[1] / source[2]);
+      float value;
+      if (!view.SampleGray(source_col, source_row, value)) continue;
+      size_t pixel_id = size_t(row) * size_t(width) + size_t(col);
+      gray[pixel_id] = ToByte(value);
+      mask[pixel_id] = 1;
+      if (colors)
+      {
+        size_t source_id = size_t(int(source_row + 0.5f)) * size_t(view.width) +
+                           size_t(int(source_col + 0.5f));
+        for (int c = 0; c < 3; c++)
+        {
+          (*colors)[pixel_id * 3 + c] = view.colors[source_id * 3 + c];
+        }
+      }
+    }
+  }
+}
+
+}
+
+RectifiedPair::RectifiedPair()
+  : width(0)
+  , height(0)
+  , baseline(0)
+  , disparity_offset(0)
+{
+}
+
+RectifiedPair::Scalar RectifiedPair::Depth(Scalar disparity) const
+{
+  Scalar shifted = disparity + Scalar(disparity_offset);
+  if (shifted <= Scalar(0)) return Scalar(0);
+  return left_camera.K(0, 0) * baseline / shifted;
+}
+
+StereoRectifier::StereoRectifier(Scalar max_scale)
+  : max_scale_(max_scale)
+{
+}
+
+int StereoRectifier::operator() (const MVSView& left,
+                                 const MVSView& right,
+                                 float depth_min,
+                                 float depth_max,
+                                 int max_disparities,
+                                 RectifiedPair& pair,
+                                 int& number_of_disparities) const
+{
+  if (left.gray.empty() || right.gray.empty() ||
+      depth_min <= 0.0f || depth_max <= depth_min) return -1;
+
+  Vector3 baseline_vector = right.camera.C - left.camera.C;
+  Scalar baseline = baseline_vector.norm();
+  if (baseline <= Scalar(0)) return -1;
+  Vector3 x_axis = baseline_vector / baseline;
+  Vector3 z_mean = left.camera.ViewDirection() + right.camera.ViewDirection();
+  if (z_mean.norm() <= Scalar(0)) return -1;
+  z_mean.normalize();
+  if (std::abs(x_axis.dot(z_mean)) > MAX_BASELINE_COSINE) return -1;
+  Vector3 y_axis = z_mean.cross(x_axis).normalized();
+  Vector3 z_axis = x_axis.cross(y_axis);
+  Matrix33 rotation;
+  rotation.row(0) = x_axis.transpose();
+  rotation.row(1) = y_axis.transpose();
+  rotation.row(2) = z_axis.transpose();
+  Scalar focal = (left.camera.K(0, 0) + right.camera.K(0, 0)) * Scalar(0.5);
+
+  //Bounding box of the left view with the principal point at the origin.
+  Matrix33 to_rectified = rotation * left.camera.R.transpose() *
+                          left.camera.K_inverse;
+  Scalar min_x = 0, max_x = 0, min_y = 0, max_y = 0;
+  for (int corner = 0; corner < 4; corner++)
+  {
+    Scalar col = (corner & 1) ? Scalar(left.width - 1) : Scalar(0);
+    Scalar row = (corner & 2) ? Scalar(left.height - 1) : Scalar(0);
+    Vector3 ray = to_rectified * Vector3(col, row, 1);
+    if (ray[2] <= Scalar(0)) return -1;
+    Scalar x = focal * ray[0] / ray[2];
+    Scalar y = focal * ray[1] / ray[2];
+    min_x = corner == 0 ? x : std::min(min_x, x);
+    max_x = corner == 0 ? x : std::max(max_x, x);
+    min_y = corner == 0 ? y : std::min(min_y, y);
+    max_y = corner == 0 ? y : std::max(max_y, y);
+  }
+  int width = std::min(int(std::ceil(max_x - min_x)) + 1,
+                       int(Scalar(left.width) * max_scale_));
+  int height = std::min(int(std::ceil(max_y - min_y)) + 1,
+                        int(Scalar(left.height) * max_scale_));
+  if (width <= 0 || height <= 0) return -1;
+
+  Scalar disparity_min = focal * baseline / Scalar(depth_max);
+  Scalar disparity_max = focal * baseline / Scalar(depth_min);
+  pair.disparity_offset = int(std::floor(disparity_min));
+  number_of_disparities =
+    int(std::ceil(disparity_max)) - pair.disparity_offset + 1;
+  number_of_disparities = std::min(number_of_disparities, max_disparities);
+  number_of_disparities =
+    (number_of_disparities + DISPARITY_ALIGNMENT - 1) /
+    DISPARITY_ALIGNMENT * DISPARITY_ALIGNMENT;
+  if (number_of_disparities <= 0) return -1;
+
+  pair.width = width;
+  pair.height = height;
+  pair.baseline = baseline;
+  Matrix33 K = Matrix33::Identity();
+  K(0, 0) = focal;
+  K(1, 1) = focal;
+  K(0, 2) = (Scalar(width) - (max_x + min_x)) * Scalar(0.5);
+  K(1, 2) = (Scalar(height) - (max_y + min_y)) * Scalar(0.5);
+  pair.left_camera.K = K;
+  pair.left_camera.K_inverse = K.inverse();
+  pair.left_camera.R = rotation;
+  pair.left_camera.C = left.camera.C;
+  K(0, 2) += Scalar(pair.disparity_offset);
+  pair.right_camera.K = K;
+  pair.right_camera.K_inverse = K.inverse();
+  pair.right_camera.R = rotation;
+  pair.right_camera.C = right.camera.C;
+
+  Matrix33 left_homography = left.camera.K * left.camera.R *
+                             rotation.transpose() *
+                             pair.left_camera.K_inverse;
+  Matrix33 right_homography = right.camera.K * right.camera.R *
+                              rotation.transpose() *
+                              pair.right_camera.K_inverse;
+  Resample(left, left_homography, width, height,
+           pair.left_gray, pair.left_mask, &pair.left_colors);
+  Resample(right, right_homography, width, height,
+           pair.right_gray, pair.right_mask, nullptr);
+  return 0;
+}
+
+}
+}
+}
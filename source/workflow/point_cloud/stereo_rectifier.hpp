@@ -0,0 +1,84 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_STEREO_RECTIFIER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_STEREO_RECTIFIER_HPP_
+
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/mvs_view.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  A stereo pair resampled so that epipolar lines are image rows.
+ *
+ *  Both cameras share K and R and differ by baseline along the rectified x
+ *  axis. The right principal point is moved by disparity_offset, so a
+ *  point at depth z appears at x_left - x_right = f * baseline / z -
+ *  disparity_offset, which keeps the searched disparities small.
+ *  Masks are 0 where the rectified pixel falls outside the photo.
+ */
+struct HS_EXPORT RectifiedPair
+{
+  typedef MVSCamera::Scalar Scalar;
+  typedef MVSView::Byte Byte;
+
+  RectifiedPair();
+
+  //Depth of a left pixel with disparity x_left - x_right.
+  Scalar Depth(Scalar disparity) const;
+
+  int width;
+  int height;
+  Scalar baseline;
+  int disparity_offset;
+  MVSCamera left_camera;
+  MVSCamera right_camera;
+  std::vector<Byte> left_gray;
+  std::vector<Byte> left_mask;
+  std::vector<Byte> left_colors;
+  std::vector<Byte> right_gray;
+  std::vector<Byte> right_mask;
+};
+
+/**
+ *  Rectifies two undistorted views after Fusiello et al.
+ *
+ *  The rectified x axis is the baseline and z the mean of the two optical
+ *  axes. The rectified image covers the left view, capped at max_scale
+ *  times its size.
+ */
+class HS_EXPORT StereoRectifier
+{
+public:
+  typedef MVSCamera::Scalar Scalar;
+
+  StereoRectifier(Scalar max_scale = 1.5);
+
+  /**
+   *  depth_min and depth_max set disparity_offset and the number of
+   *  disparities to search. Fails if the baseline is too close to the
+   *  viewing direction for rectification.
+   */
+  int operator() (const MVSView& left,
+                  const MVSView& right,
+                  float depth_min,
+                  float depth_max,
+                  int max_disparities,
+                  RectifiedPair& pair,
+                  int& number_of_disparities) const;
+
+private:
+  Scalar max_scale_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,325 @@
+#include <algorithm>
+#include <map>
+#include <utility>
+
+#include <Eigen/Eigenvalues>
+
+#include "workflow/point_cloud/view_clusterer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+namespace
+{
+
+typedef ViewClusterer::Scalar Scalar;
+typedef ViewClusterer::Vector3 Vector3;
+typedef ViewClusterer::Vector3Container Vector3Container;
+typedef EIGEN_MATRIX(Scalar, 3, 3) Matrix33;
+
+/**
+ *  Best triangulation weight of point between two of views, only counting
+ *  views set in members if it is given.
+ */
+Scalar BestWeight(const Vector3Container& centers, const Vector3& point,
+                  const size_t* views, size_t number_of_views,
+                  const std::vector<char>* members)
+{
+  Scalar best = 0;
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    if (members && !(*members)[views[i]]) continue;
+    for (size_t j = i + 1; j < number_of_views; j++)
+    {
+      if (members && !(*members)[views[j]]) continue;
+      best = std::max(best, TriangulationWeight(centers[views[i]],
+                                                centers[views[j]], point));
+    }
+  }
+  return best;
+}
+
+//Clusters holding at least one of views, without duplicates.
+void CandidateClusters(const size_t* views, size_t number_of_views,
+                       const std::vector<std::vector<size_t> >& view_clusters,
+                       std::vector<size_t>& candidates)
+{
+  candidates.clear();
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    const std::vector<size_t>& clusters = view_clusters[views[i]];
+    candidates.insert(candidates.end(), clusters.begin(), clusters.end());
+  }
+  std::sort(candidates.begin(), candidates.end());
+  candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                   candidates.end());
+}
+
+}
+
+ViewClusterer::ViewClusterer(size_t cluster_size,
+                             float accuracy_threshold,
+                             float coverage_threshold)
+  : cluster_size_(std::max(cluster_size, size_t(2)))
+  , accuracy_threshold_(accuracy_threshold)
+  , coverage_threshold_(coverage_threshold)
+{
+}
+
+void ViewClusterer::Split(const Vector3Container& centers,
+                          std::vector<std::vector<size_t> >& clusters) const
+{
+  clusters.clear();
+  std::vector<std::vector<size_t> > parts(1);
+  for (size_t i = 0; i < centers.size(); i++)
+  {
+    parts[0].push_back(i);
+  }
+
+  while (!parts.empty())
+  {
+    std::vector<size_t> part;
+    part.swap(parts.back());
+    parts.pop_back();
+    if (part.size() <= cluster_size_)
+    {
+      clusters.push_back(part);
+      continue;
+    }
+
+    Vector3 mean = Vector3::Zero();
+    for (size_t i = 0; i < part.size(); i++)
+    {
+      mean += centers[part[i]];
+    }
+    mean /= Scalar(part.size());
+    Matrix33 covariance = Matrix33::Zero();
+    for (size_t i = 0; i < part.size(); i++)
+    {
+      Vector3 offset = centers[part[i]] - mean;
+      covariance += offset * offset.transpose();
+    }
+    Eigen::SelfAdjointEigenSolver<Matrix33> solver(covariance);
+    Vector3 axis = solver.eigenvectors().col(2);
+
+    std::vector<std::pair<Scalar, size_t> > projections(part.size());
+    for (size_t i = 0; i < part.size(); i++)
+    {
+      projections[i] = std::make_pair(axis.dot(centers[part[i]] - mean),
+                                      part[i]);
+    }
+    size_t half = part.size() / 2;
+    std::nth_element(projections.begin(), projections.begin() + half,
+                     projections.end());
+    std::vector<size_t> low;
+    std::vector<size_t> high;
+    for (size_t i = 0; i < projections.size(); i++)
+    {
+      (i < half ? low : high).push_back(projections[i].second);
+    }
+    //The low half is split first so the order is deterministic.
+    parts.push_back(high);
+    parts.push_back(low);
+  }
+}
+
+int ViewClusterer::operator() (const Vector3Container& centers,
+                               const Vector3Container& points,
+                               const std::vector<size_t>& point_offsets,
+                               const std::vector<size_t>& point_views,
+                               std::vector<std::vector<size_t> >& clusters,
+                               std::vector<size_t>& home_clusters) const
+{
+  size_t number_of_views = centers.size();
+  size_t number_of_points = points.size();
+  if (number_of_views == 0 ||
+      point_offsets.size() != number_of_points + 1 ||
+      point_offsets.back() > point_views.size())
+  {
+    return -1;
+  }
+  for (size_t i = 0; i < point_offsets.back(); i++)
+  {
+    if (point_views[i] >= number_of_views) return -1;
+  }
+
+  Split(centers, clusters);
+  size_t number_of_clusters = clusters.size();
+  home_clusters.assign(number_of_views, 0);
+  std::vector<std::vector<char> > members(
+    number_of_clusters, std::vector<char>(number_of_views, 0));
+  std::vector<std::vector<size_t> > view_clusters(number_of_views);
+  for (size_t c = 0; c < number_of_clusters; c++)
+  {
+    for (size_t i = 0; i < clusters[c].size(); i++)
+    {
+      size_t view_id = clusters[c][i];
+      home_clusters[view_id] = c;
+      members[c][view_id] = 1;
+      view_clusters[view_id].push_back(c);
+    }
+  }
+  if (number_of_clusters == 1) return 0;
+
+  //Weight a cluster must reach on each point, 0 if it cannot be triangulated.
+  std::vector<Scalar> required_weights(number_of_points, Scalar(0));
+  std::vector<size_t> view_offsets(number_of_views + 1, 0);
+  for (size_t k = 0; k < number_of_points; k++)
+  {
+    const size_t* views = point_views.data() + point_offsets[k];
+    size_t track_size = point_offsets[k + 1] - point_offsets[k];
+    required_weights[k] = Scalar(accuracy_threshold_) *
+                          BestWeight(centers, points[k], views, track_size,
+                                     nullptr);
+    if (required_weights[k] <= Scalar(0)) continue;
+    for (size_t i = 0; i < track_size; i++)
+    {
+      view_offsets[views[i] + 1]++;
+    }
+  }
+  for (size_t i = 0; i < number_of_views; i++)
+  {
+    view_offsets[i + 1] += view_offsets[i];
+  }
+  std::vector<size_t> view_points(view_offsets[number_of_views]);
+  std::vector<size_t> cursors(view_offsets.begin(), view_offsets.end() - 1);
+  for (size_t k = 0; k < number_of_points; k++)
+  {
+    if (required_weights[k] <= Scalar(0)) continue;
+    for (size_t i = point_offsets[k]; i < point_offsets[k + 1]; i++)
+    {
+      view_points[cursors[point_views[i]]++] = k;
+    }
+  }
+
+  std::vector<char> covered(number_of_points, 0);
+  std::vector<size_t> covered_counts(number_of_views, 0);
+  std::vector<size_t> candidates;
+  std::vector<size_t> pending;
+  for (size_t k = 0; k < number_of_points; k++)
+  {
+    if (required_weights[k] > Scalar(0)) pending.push_back(k);
+  }
+
+  while (1)
+  {
+    //Cover what the current clusters can.
+    for (size_t p = 0; p < pending.size(); p++)
+    {
+      size_t k = pending[p];
+      if (covered[k]) continue;
+      const size_t* views = point_views.data() + point_offsets[k];
+      size_t track_size = point_offsets[k + 1] - point_offsets[k];
+      CandidateClusters(views, track_size, view_clusters, candidates);
+      for (size_t i = 0; i < candidates.size(); i++)
+      {
+        if (BestWeight(centers, points[k], views, track_size,
+                       &members[candidates[i]]) >= required_weights[k])
+        {
+          covered[k] = 1;
+          for (size_t j = 0; j < track_size; j++)
+          {
+            covered_counts[views[j]]++;
+          }
+          break;
+        }
+      }
+    }
+
+    std::vector<char> satisfied(number_of_views, 0);
+    bool all_satisfied = true;
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      size_t total = view_offsets[i + 1] - view_offsets[i];
+      satisfied[i] = char(Scalar(covered_counts[i]) >=
+                          Scalar(coverage_threshold_) * Scalar(total));
+      if (!satisfied[i]) all_satisfied = false;
+    }
+    if (all_satisfied) break;
+
+    //Count the points each view would cover if added to each cluster.
+    std::vector<std::map<size_t, size_t> > gains(number_of_clusters);
+    for (size_t k = 0; k < number_of_points; k++)
+    {
+      if (covered[k] || required_weights[k] <= Scalar(0)) continue;
+      const size_t* views = point_views.data() + point_offsets[k];
+      size_t track_size = point_offsets[k + 1] - point_offsets[k];
+      bool needed = false;
+      for (size_t i = 0; i < track_size && !needed; i++)
+      {
+        needed = !satisfied[views[i]];
+      }
+      if (!needed) continue;
+
+      CandidateClusters(views, track_size, view_clusters, candidates);
+      for (size_t i = 0; i < candidates.size(); i++)
+      {
+        size_t c = candidates[i];
+        if (clusters[c].size() >= cluster_size_) continue;
+        const std::vector<char>& cluster_members = members[c];
+        for (size_t j = 0; j < track_size; j++)
+        {
+          if (cluster_members[views[j]]) continue;
+          Scalar best = 0;
+          for (size_t l = 0; l < track_size; l++)
+          {
+            if (!cluster_members[views[l]]) continue;
+            best = std::max(best, TriangulationWeight(centers[views[j]],
+                                                      centers[views[l]],
+                                                      points[k]));
+          }
+          if (best >= required_weights[k]) gains[c][views[j]]++;
+        }
+      }
+    }
+
+    //Each cluster takes its best view, lowest id on ties.
+    std::vector<char> touched(number_of_views, 0);
+    bool added = false;
+    for (size_t c = 0; c < number_of_clusters; c++)
+    {
+      size_t best_view = number_of_views;
+      size_t best_gain = 0;
+      std::map<size_t, size_t>::const_iterator itr = gains[c].begin();
+      for (; itr != gains[c].end(); ++itr)
+      {
+        if (itr->second > best_gain)
+        {
+          best_gain = itr->second;
+          best_view = itr->first;
+        }
+      }
+      if (best_view == number_of_views) continue;
+      clusters[c].push_back(best_view);
+      members[c][best_view] = 1;
+      view_clusters[best_view].push_back(c);
+      touched[best_view] = 1;
+      added = true;
+    }
+    if (!added) break;
+
+    pending.clear();
+    for (size_t i = 0; i < number_of_views; i++)
+    {
+      if (!touched[i]) continue;
+      for (size_t j = view_offsets[i]; j < view_offsets[i + 1]; j++)
+      {
+        if (!covered[view_points[j]]) pending.push_back(view_points[j]);
+      }
+    }
+  }
+
+  for (size_t c = 0; c < number_of_clusters; c++)
+  {
+    std::sort(clusters[c].begin(), clusters[c].end());
+  }
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,70 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_VIEW_CLUSTERER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_VIEW_CLUSTERER_HPP_
+
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/point_cloud/mvs_view.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Splits views into overlapping clusters for dense reconstruction, after
+ *  CMVS.
+ *
+ *  The views are first split recursively at the median of their centres
+ *  along the axis of largest spread, until no part has more than
+ *  cluster_size views. Each view's part is its home cluster.
+ *
+ *  A sparse point is covered by a cluster if the best triangulation weight
+ *  between two of its views in the cluster reaches accuracy_threshold times
+ *  the best over all its views. Views are then added to clusters that still
+ *  have room, best gain first, until every view has coverage_threshold of
+ *  its points covered by some cluster or nothing more can be gained.
+ */
+class HS_EXPORT ViewClusterer
+{
+public:
+  typedef MVSCamera::Scalar Scalar;
+  typedef MVSCamera::Vector3 Vector3;
+  typedef EIGEN_STD_VECTOR(Vector3) Vector3Container;
+
+  ViewClusterer(size_t cluster_size,
+                float accuracy_threshold,
+                float coverage_threshold);
+
+  /**
+   *  centers[i] is the camera centre of view i. The views seeing point k
+   *  are point_views[point_offsets[k], point_offsets[k + 1]).
+   *  Each cluster lists its view ids in increasing order.
+   */
+  int operator() (const Vector3Container& centers,
+                  const Vector3Container& points,
+                  const std::vector<size_t>& point_offsets,
+                  const std::vector<size_t>& point_views,
+                  std::vector<std::vector<size_t> >& clusters,
+                  std::vector<size_t>& home_clusters) const;
+
+private:
+  void Split(const Vector3Container& centers,
+             std::vector<std::vector<size_t> >& clusters) const;
+
+private:
+  size_t cluster_size_;
+  float accuracy_threshold_;
+  float coverage_threshold_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,348 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_COG_TILE_SINK_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_COG_TILE_SINK_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/raster_tile.hpp"
+#include "workflow/texture/tiff_writer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes the tiles of a raster into one Cloud Optimized GeoTIFF at path.
+ *
+ *  Tiles are cut into the blocks of the file as they come. Once all of its
+ *  pixels are in, a block is compressed and averaged down 2 x 2 into the
+ *  block of the next level, so that every level is built in the same pass
+ *  from pixels still in memory. Only blocks straddling tiles yet to come
+ *  are held, and blocks with nothing in them are left to the writer to
+ *  fill.
+ *
+ *  Empty pixels are no_data in single channel rasters and have a zero alpha
+ *  in RGBA ones.
+ */
+template <typename T>
+class CogTileSink : public RasterTileSink<T>
+{
+public:
+  typedef typename RasterTileSink<T>::Tile Tile;
+
+  //epsg_code is the projected system of the grid, 0 if unknown.
+  CogTileSink(const std::string& path, size_t number_of_threads,
+              size_t block_size = 512, int epsg_code = 0)
+    : path_(path)
+    , number_of_threads_(number_of_threads)
+    , block_size_(block_size)
+    , epsg_code_(epsg_code)
+    , channels_(0)
+    , no_data_(0) {}
+
+  virtual int Open(const RasterGrid& grid, size_t channels, T no_data)
+  {
+    TiffImage image;
+    image.width = grid.width;
+    image.height = grid.height;
+    image.channels = channels;
+    image.sample_type = TiffSampleTraits<T>::type;
+    image.georeferenced = true;
+    image.left = grid.left;
+    image.top = grid.top;
+    image.scale_x = grid.scale_x;
+    image.scale_y = grid.scale_y;
+    image.epsg_code = epsg_code_;
+    image.has_no_data = channels == 1;
+    image.no_data = double(no_data);
+    if (writer_.Open(path_, image, block_size_) != 0) return -1;
+    grid_ = grid;
+    channels_ = channels;
+    no_data_ = no_data;
+    partial_blocks_.assign(writer_.NumberOfLevels(), BlockMap());
+    return 0;
+  }
+
+  virtual int Write(const Tile& tile)
+  {
+    if (tile.channels != channels_ ||
+        tile.row >= grid_.NumberOfTileRows() ||
+        tile.column >= grid_.NumberOfTileColumns() ||
+        tile.width != grid_.TileWidth(tile.column) ||
+        tile.height != grid_.TileHeight(tile.row) ||
+        tile.pixels.size() != tile.width * tile.height * tile.channels)
+    {
+      return -1;
+    }
+    BlockContainer finished;
+    Paste(0, tile.column * grid_.tile_width, tile.row * grid_.tile_height,
+          tile.width, tile.height, tile.pixels.data(), finished);
+    return Flush(0, finished);
+  }
+
+  //Blocks some tile never came for are written as they are.
+  virtual int Close()
+  {
+    int result = 0;
+    for (size_t level = 0; level < partial_blocks_.size(); level++)
+    {
+      BlockContainer remaining;
+      for (typename BlockMap::iterator itr = partial_blocks_[level].begin();
+           itr != partial_blocks_[level].end(); ++itr)
+      {
+        remaining.push_back(Block());
+        remaining.back().Swap(itr->second);
+      }
+      partial_blocks_[level].clear();
+      if (Flush(level, remaining) != 0) result = -1;
+    }
+    partial_blocks_.clear();
+    if (writer_.Close() != 0) result = -1;
+    return result;
+  }
+
+private:
+  struct Block
+  {
+    Block() : row(0), column(0), covered(0) {}
+
+    void Swap(Block& other)
+    {
+      std::swap(row, other.row);
+      std::swap(column, other.column);
+      std::swap(covered, other.covered);
+      pixels.swap(other.pixels);
+    }
+
+    size_t row;
+    size_t column;
+    //Pixels pasted so far.
+    size_t covered;
+    //block_size x block_size, empty past the edge of the level.
+    std::vector<T> pixels;
+  };
+  typedef std::vector<Block> BlockContainer;
+  typedef std::map<size_t, Block> BlockMap;
+
+  //Encodes blocks and averages them down, one per index.
+  struct BlockWorker
+  {
+    BlockWorker(const CogTileSink& sink_, size_t level_,
+                const BlockContainer& blocks_)
+      : sink(sink_), level(level_), blocks(blocks_),
+        encoded(blocks_.size()), reduced(blocks_.size()), failed(false) {}
+
+    void operator() (size_t begin, size_t end)
+    {
+      size_t block_size = sink.block_size_;
+      size_t channels = sink.channels_;
+      bool has_next_level = level + 1 < sink.writer_.NumberOfLevels();
+      for (size_t i = begin; i < end; i++)
+      {
+        const Block& block = blocks[i];
+        bool empty = true;
+        for (size_t k = 0; k < block_size * block_size && empty; k++)
+        {
+          empty = !sink.Valid(&block.pixels[k * channels]);
+        }
+        if (empty) continue;
+        if (sink.writer_.EncodeBlock(block.pixels.data(), encoded[i]) != 0)
+        {
+          failed = true;
+          return;
+        }
+        if (!has_next_level) continue;
+
+        size_t width = sink.BlockWidth(level, block.column);
+        size_t height = sink.BlockHeight(level, block.row);
+        size_t reduced_width = (width + 1) / 2;
+        size_t reduced_height = (height + 1) / 2;
+        std::vector<T>& pixels = reduced[i];
+        pixels.resize(reduced_width * reduced_height * channels);
+        std::vector<double> sums(channels);
+        for (size_t y = 0; y < reduced_height; y++)
+        {
+          for (size_t x = 0; x < reduced_width; x++)
+          {
+            std::fill(sums.begin(), sums.end(), 0.0);
+            size_t number_of_valid = 0;
+            for (size_t dy = 0; dy < 2 && 2 * y + dy < height; dy++)
+            {
+              for (size_t dx = 0; dx < 2 && 2 * x + dx < width; dx++)
+              {
+                const T* source = &block.pixels[
+                  ((2 * y + dy) * block_size + 2 * x + dx) * channels];
+                if (!sink.Valid(source)) continue;
+                for (size_t c = 0; c < channels; c++)
+                {
+                  sums[c] += double(source[c]);
+                }
+                number_of_valid++;
+              }
+            }
+            T* target = &pixels[(y * reduced_width + x) * channels];
+            if (number_of_valid == 0)
+            {
+              sink.FillEmpty(target, 1);
+              continue;
+            }
+            for (size_t c = 0; c < channels; c++)
+            {
+              double mean = sums[c] / double(number_of_valid);
+              target[c] = std::numeric_limits<T>::is_integer ?
+                          T(std::floor(mean + 0.5)) : T(mean);
+            }
+          }
+        }
+      }
+    }
+
+    const CogTileSink& sink;
+    size_t level;
+    const BlockContainer& blocks;
+    std::vector<std::vector<char> > encoded;
+    //Empty for blocks with nothing in them.
+    std::vector<std::vector<T> > reduced;
+    std::atomic<bool> failed;
+  };
+
+  size_t BlockWidth(size_t level, size_t block_column) const
+  {
+    return std::min(block_size_,
+                    writer_.LevelWidth(level) - block_column * block_size_);
+  }
+
+  size_t BlockHeight(size_t level, size_t block_row) const
+  {
+    return std::min(block_size_,
+                    writer_.LevelHeight(level) - block_row * block_size_);
+  }
+
+  bool Valid(const T* pixel) const
+  {
+    if (channels_ == 1) return pixel[0] != no_data_;
+    if (channels_ == 4) return pixel[3] != T(0);
+    return true;
+  }
+
+  void FillEmpty(T* pixels, size_t number_of_pixels) const
+  {
+    std::fill(pixels, pixels + number_of_pixels * channels_,
+              channels_ == 1 ? no_data_ : T(0));
+  }
+
+  /**
+   *  Copy width x height pixels with their top left at (x, y) of a level
+   *  into its blocks, nothing but their coverage if pixels is null. Blocks
+   *  that are complete move to finished.
+   */
+  void Paste(size_t level, size_t x, size_t y, size_t width, size_t height,
+             const T* pixels, BlockContainer& finished)
+  {
+    size_t number_of_columns =
+      (writer_.LevelWidth(level) + block_size_ - 1) / block_size_;
+    BlockMap& blocks = partial_blocks_[level];
+    for (size_t block_row = y / block_size_;
+         block_row <= (y + height - 1) / block_size_; block_row++)
+    {
+      for (size_t block_column = x / block_size_;
+           block_column <= (x + width - 1) / block_size_; block_column++)
+      {
+        size_t block_id = block_row * number_of_columns + block_column;
+        Block& block = blocks[block_id];
+        if (block.pixels.empty())
+        {
+          block.row = block_row;
+          block.column = block_column;
+          block.pixels.resize(block_size_ * block_size_ * channels_);
+          FillEmpty(block.pixels.data(), block_size_ * block_size_);
+        }
+        size_t block_left = block_column * block_size_;
+        size_t block_top = block_row * block_size_;
+        size_t left = std::max(x, block_left);
+        size_t right = std::min(x + width, block_left + block_size_);
+        size_t top = std::max(y, block_top);
+        size_t bottom = std::min(y + height, block_top + block_size_);
+        if (pixels)
+        {
+          for (size_t row = top; row < bottom; row++)
+          {
+            const T* source =
+              pixels + ((row - y) * width + left - x) * channels_;
+            std::copy(source, source + (right - left) * channels_,
+                      &block.pixels[((row - block_top) * block_size_ +
+                                     left - block_left) * channels_]);
+          }
+        }
+        block.covered += (right - left) * (bottom - top);
+        if (block.covered == BlockWidth(level, block_column) *
+                             BlockHeight(level, block_row))
+        {
+          finished.push_back(Block());
+          finished.back().Swap(block);
+          blocks.erase(block_id);
+        }
+      }
+    }
+  }
+
+  //Write blocks of a level, and those they complete in the levels above.
+  int Flush(size_t level, BlockContainer& blocks)
+  {
+    for (; !blocks.empty(); level++)
+    {
+      BlockWorker worker(*this, level, blocks);
+      ParallelFor(0, blocks.size(), number_of_threads_, worker);
+      if (worker.failed) return -1;
+
+      BlockContainer finished;
+      for (size_t i = 0; i < blocks.size(); i++)
+      {
+        const Block& block = blocks[i];
+        if (!worker.encoded[i].empty() &&
+            writer_.WriteBlock(level, block.row, block.column,
+                               worker.encoded[i]) != 0)
+        {
+          return -1;
+        }
+        if (level + 1 < writer_.NumberOfLevels())
+        {
+          const std::vector<T>& reduced = worker.reduced[i];
+          Paste(level + 1, block.column * block_size_ / 2,
+                block.row * block_size_ / 2,
+                (BlockWidth(level, block.column) + 1) / 2,
+                (BlockHeight(level, block.row) + 1) / 2,
+                reduced.empty() ? nullptr : reduced.data(), finished);
+        }
+      }
+      blocks.swap(finished);
+    }
+    return 0;
+  }
+
+  std::string path_;
+  size_t number_of_threads_;
+  size_t block_size_;
+  int epsg_code_;
+  CogWriter writer_;
+  RasterGrid grid_;
+  size_t channels_;
+  T no_data_;
+  //Blocks waiting for more pixels, by level and block index.
+  std::vector<BlockMap> partial_blocks_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_FAN_OUT_TILE_SINK_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_FAN_OUT_TILE_SINK_HPP_
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "workflow/texture/raster_tile.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Hands every tile to several sinks, so one rasterization pass feeds all
+ *  output formats.
+ *
+ *  Each sink has a worker thread, started by Open and kept until Close,
+ *  that writes the tiles queued for it in order. Write only copies the
+ *  tile once and queues it for every sink, so producers serialized ahead
+ *  of this sink do not wait on encoding. Queues hold at most
+ *  queue_capacity tiles, Write waits for room past that. A failed sink
+ *  makes every later Write and the Close fail.
+ */
+template <typename T>
+class FanOutTileSink : public RasterTileSink<T>
+{
+public:
+  typedef RasterTileSink<T> Sink;
+  typedef typename Sink::Tile Tile;
+
+  explicit FanOutTileSink(size_t queue_capacity = 4)
+    : queue_capacity_(std::max(queue_capacity, size_t(1)))
+    , stopping_(false)
+    , failed_(false) {}
+
+  ~FanOutTileSink()
+  {
+    StopWorkers();
+  }
+
+  //The sink is not owned and must outlive this one.
+  void AddSink(Sink* sink)
+  {
+    sinks_.push_back(sink);
+  }
+
+  size_t NumberOfSinks() const
+  {
+    return sinks_.size();
+  }
+
+  virtual int Open(const RasterGrid& grid, size_t channels, T no_data)
+  {
+    StopWorkers();
+    for (size_t i = 0; i < sinks_.size(); i++)
+    {
+      if (sinks_[i]->Open(grid, channels, no_data) != 0) return -1;
+    }
+    stopping_ = false;
+    failed_ = false;
+    queues_.assign(sinks_.size(), TileQueue());
+    for (size_t i = 0; i < sinks_.size(); i++)
+    {
+      workers_.push_back(std::thread(&FanOutTileSink::WriteQueued, this, i));
+    }
+    return 0;
+  }
+
+  virtual int Write(const Tile& tile)
+  {
+    if (sinks_.empty()) return 0;
+    TilePtr shared_tile(new Tile(tile));
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (!failed_ && LongestQueue() >= queue_capacity_)
+    {
+      queue_not_full_.wait(lock);
+    }
+    if (failed_) return -1;
+    for (size_t i = 0; i < queues_.size(); i++)
+    {
+      queues_[i].push_back(shared_tile);
+    }
+    lock.unlock();
+    queue_not_empty_.notify_all();
+    return 0;
+  }
+
+  //Waits for the queued tiles, then closes every sink even if one fails.
+  virtual int Close()
+  {
+    StopWorkers();
+    int result = failed_ ? -1 : 0;
+    for (size_t i = 0; i < sinks_.size(); i++)
+    {
+      if (sinks_[i]->Close() != 0) result = -1;
+    }
+    return result;
+  }
+
+private:
+  typedef std::shared_ptr<const Tile> TilePtr;
+  typedef std::deque<TilePtr> TileQueue;
+
+  size_t LongestQueue() const
+  {
+    size_t longest = 0;
+    for (size_t i = 0; i < queues_.size(); i++)
+    {
+      longest = std::max(longest, queues_[i].size());
+    }
+    return longest;
+  }
+
+  //A tile leaves its queue once written, so it counts against the
+  //capacity until then. After a failure the rest is dropped unwritten.
+  void WriteQueued(size_t sink_id)
+  {
+    TileQueue& queue = queues_[sink_id];
+    while (true)
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      while (queue.empty() && !stopping_)
+      {
+        queue_not_empty_.wait(lock);
+      }
+      if (queue.empty()) return;
+      TilePtr tile = queue.front();
+      bool skip = failed_;
+      lock.unlock();
+
+      int result = skip ? 0 : sinks_[sink_id]->Write(*tile);
+
+      lock.lock();
+      queue.pop_front();
+      if (result != 0) failed_ = true;
+      lock.unlock();
+      queue_not_full_.notify_all();
+    }
+  }
+
+  void StopWorkers()
+  {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stopping_ = true;
+    }
+    queue_not_empty_.notify_all();
+    for (size_t i = 0; i < workers_.size(); i++)
+    {
+      workers_[i].join();
+    }
+    workers_.clear();
+  }
+
+  std::vector<Sink*> sinks_;
+  size_t queue_capacity_;
+
+  std::mutex mutex_;
+  std::condition_variable queue_not_empty_;
+  std::condition_variable queue_not_full_;
+  std::vector<TileQueue> queues_;
+  std::vector<std::thread> workers_;
+  bool stopping_;
+  bool failed_;
+};
+
+}
+}
+}
+
+#endif
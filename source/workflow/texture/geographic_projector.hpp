@@ -0,0 +1,37 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_GEOGRAPHIC_PROJECTOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_GEOGRAPHIC_PROJECTOR_HPP_
+
+#include <memory>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Converts planar points of the georeferenced frame to WGS84 longitude and
+ *  latitude in degrees and back. Implementations must be safe to call from
+ *  several threads at once.
+ */
+class GeographicProjector
+{
+public:
+  virtual ~GeographicProjector() {}
+
+  virtual int ToLongitudeLatitude(double x, double y,
+                                  double& longitude,
+                                  double& latitude) const = 0;
+  virtual int FromLongitudeLatitude(double longitude, double latitude,
+                                    double& x, double& y) const = 0;
+  //EPSG code of the georeferenced frame, 0 if it has none.
+  virtual int EpsgCode() const { return 0; }
+};
+typedef std::shared_ptr<GeographicProjector> GeographicProjectorPtr;
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,372 @@
+#include <algorithm>
+
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/texture/photo_tile_cache.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::SourcePhoto SourcePhoto;
+
+//Box filter by 2^level, the last row and column of boxes cut at the edge.
+void BuildLevel(const SourcePhoto& photo, int level, SourcePhoto& level_photo)
+{
+  size_t factor = size_t(1) << level;
+  level_photo.width = (photo.width + factor - 1) / factor;
+  level_photo.height = (photo.height + factor - 1) / factor;
+  level_photo.pixels.resize(level_photo.width * level_photo.height * 3);
+  for (size_t row = 0; row < level_photo.height; row++)
+  {
+    size_t row_end = std::min((row + 1) * factor, photo.height);
+    for (size_t col = 0; col < level_photo.width; col++)
+    {
+      size_t col_end = std::min((col + 1) * factor, photo.width);
+      size_t sum[3] = {0, 0, 0};
+      for (size_t r = row * factor; r < row_end; r++)
+      {
+        const uint8_t* pixel = &photo.pixels[(r * photo.width +
+                                              col * factor) * 3];
+        for (size_t c = col * factor; c < col_end; c++, pixel += 3)
+        {
+          sum[0] += pixel[0];
+          sum[1] += pixel[1];
+          sum[2] += pixel[2];
+        }
+      }
+      size_t count = (row_end - row * factor) * (col_end - col * factor);
+      uint8_t* level_pixel =
+        &level_photo.pixels[(row * level_photo.width + col) * 3];
+      for (int k = 0; k < 3; k++)
+      {
+        level_pixel[k] = uint8_t((sum[k] + count / 2) / count);
+      }
+    }
+  }
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+const size_t PhotoTileCache::TILE_SIZE;
+
+SourcePhoto::SourcePhoto()
+  : width(0)
+  , height(0)
+{
+}
+
+PhotoTile::PhotoTile()
+  : level_width(0)
+  , level_height(0)
+  , left(0)
+  , top(0)
+  , width(0)
+  , height(0)
+{
+}
+
+bool PhotoTile::Sample(double x, double y, uint8_t* rgb) const
+{
+  if (!(x >= double(left)) || !(y >= double(top)) ||
+      x > double(left + width - 1) || y > double(top + height - 1))
+  {
+    return false;
+  }
+  x -= double(left);
+  y -= double(top);
+  size_t x0 = size_t(x);
+  size_t y0 = size_t(y);
+  size_t x1 = std::min(x0 + 1, width - 1);
+  size_t y1 = std::min(y0 + 1, height - 1);
+  double u = x - double(x0);
+  double v = y - double(y0);
+  const uint8_t* p00 = &pixels[(y0 * width + x0) * 3];
+  const uint8_t* p01 = &pixels[(y0 * width + x1) * 3];
+  const uint8_t* p10 = &pixels[(y1 * width + x0) * 3];
+  const uint8_t* p11 = &pixels[(y1 * width + x1) * 3];
+  for (int k = 0; k < 3; k++)
+  {
+    double value = (p00[k] * (1 - u) + p01[k] * u) * (1 - v) +
+                   (p10[k] * (1 - u) + p11[k] * u) * v;
+    rgb[k] = uint8_t(std::min(std::max(value + 0.5, 0.0), 255.0));
+  }
+  return true;
+}
+
+PhotoTileCache::PhotoTileCache(const std::vector<std::string>& photo_paths,
+                               size_t capacity)
+  : photo_paths_(photo_paths)
+  , capacity_(capacity)
+  , failed_(photo_paths.size(), 0)
+  , number_of_loads_(0)
+  , size_in_bytes_(0)
+{
+}
+
+PhotoTileCache::~PhotoTileCache()
+{
+}
+
+PhotoTileCache::TilePtr PhotoTileCache::Tile(size_t photo_id, int level,
+                                             size_t tile_x, size_t tile_y)
+{
+  if (photo_id >= photo_paths_.size() || level < 0 || level > 30)
+  {
+    return TilePtr();
+  }
+  LevelKey level_key(photo_id, level);
+  TileKey key = {{photo_id, size_t(level), tile_x, tile_y}};
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (loading_.count(level_key))
+  {
+    loaded_.wait(lock);
+  }
+  if (failed_[photo_id]) return TilePtr();
+  auto itr_entry = entries_.find(key);
+  if (itr_entry != entries_.end())
+  {
+    lru_.splice(lru_.begin(), lru_, itr_entry->second);
+    return itr_entry->second->second;
+  }
+  auto itr_level = levels_.find(level_key);
+  if (itr_level != levels_.end() &&
+      (tile_x >= itr_level->second.number_of_columns ||
+       tile_y >= itr_level->second.number_of_rows))
+  {
+    return TilePtr();
+  }
+
+  TilePtr tile;
+  LoadLevel(photo_id, level, tile_x, tile_y, lock, tile);
+  return tile;
+}
+
+void PhotoTileCache::Prefetch(size_t photo_id, int level)
+{
+  if (photo_id >= photo_paths_.size() || level < 0 || level > 30) return;
+  LevelKey level_key(photo_id, level);
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (loading_.count(level_key))
+  {
+    loaded_.wait(lock);
+  }
+  if (failed_[photo_id]) return;
+  auto itr_level = levels_.find(level_key);
+  if (itr_level != levels_.end() &&
+      itr_level->second.number_of_held ==
+      itr_level->second.number_of_columns * itr_level->second.number_of_rows)
+  {
+    return;
+  }
+  TilePtr tile;
+  LoadLevel(photo_id, level, size_t(-1), size_t(-1), lock, tile);
+}
+
+size_t PhotoTileCache::NumberOfPhotos() const
+{
+  return photo_paths_.size();
+}
+
+size_t PhotoTileCache::NumberOfLoads() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return number_of_loads_;
+}
+
+size_t PhotoTileCache::SizeInBytes() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_in_bytes_;
+}
+
+int PhotoTileCache::LoadPhoto(const std::string& path,
+                              SourcePhoto& photo) const
+{
+  typedef hs::imgio::whole::ImageData ImageData;
+
+  ImageData image_data;
+  hs::imgio::whole::ImageIO image_io;
+  if (image_io.LoadImage(path, image_data) != 0) return -1;
+  int width = image_data.width();
+  int height = image_data.height();
+  int channel = image_data.channel();
+  if (width <= 0 || height <= 0 || channel <= 0) return -1;
+
+  photo.width = size_t(width);
+  photo.height = size_t(height);
+  photo.pixels.resize(photo.width * photo.height * 3);
+  for (int row = 0; row < height; row++)
+  {
+    for (int col = 0; col < width; col++)
+    {
+      uint8_t* pixel = &photo.pixels[(size_t(row) * photo.width + col) * 3];
+      for (int k = 0; k < 3; k++)
+      {
+        pixel[k] = image_data.GetByte(row, col, std::min(k, channel - 1));
+      }
+    }
+  }
+  return 0;
+}
+
+int PhotoTileCache::LoadLevel(size_t photo_id, int level,
+                              size_t tile_x, size_t tile_y,
+                              std::unique_lock<std::mutex>& lock,
+                              TilePtr& tile)
+{
+  //Decode outside the lock, held tiles stay available meanwhile.
+  LevelKey level_key(photo_id, level);
+  loading_.insert(level_key);
+  lock.unlock();
+
+  SourcePhoto level_photo;
+  int result = 0;
+  {
+    SourcePhoto photo;
+    result = LoadPhoto(photo_paths_[photo_id], photo);
+    if (result == 0 && level > 0)
+    {
+      BuildLevel(photo, level, level_photo);
+    }
+    else
+    {
+      std::swap(level_photo, photo);
+    }
+  }
+  if (result == 0 && level_photo.width == 0) result = -1;
+
+  std::vector<TilePtr> tiles;
+  size_t tiles_x = (level_photo.width + TILE_SIZE - 1) / TILE_SIZE;
+  size_t tiles_y = (level_photo.height + TILE_SIZE - 1) / TILE_SIZE;
+  if (result == 0)
+  {
+    for (size_t y = 0; y < tiles_y; y++)
+    {
+      for (size_t x = 0; x < tiles_x; x++)
+      {
+        std::shared_ptr<PhotoTile> new_tile(new PhotoTile);
+        new_tile->level_width = level_photo.width;
+        new_tile->level_height = level_photo.height;
+        new_tile->left = x * TILE_SIZE;
+        new_tile->top = y * TILE_SIZE;
+        new_tile->width = std::min(TILE_SIZE + 1,
+                                   level_photo.width - new_tile->left);
+        new_tile->height = std::min(TILE_SIZE + 1,
+                                    level_photo.height - new_tile->top);
+        new_tile->pixels.resize(new_tile->width * new_tile->height * 3);
+        for (size_t row = 0; row < new_tile->height; row++)
+        {
+          const uint8_t* source =
+            &level_photo.pixels[((new_tile->top + row) * level_photo.width +
+                                 new_tile->left) * 3];
+          std::copy(source, source + new_tile->width * 3,
+                    &new_tile->pixels[row * new_tile->width * 3]);
+        }
+        tiles.push_back(new_tile);
+      }
+    }
+  }
+
+  lock.lock();
+  loading_.erase(level_key);
+  loaded_.notify_all();
+  number_of_loads_++;
+  if (result != 0)
+  {
+    failed_[photo_id] = 1;
+    return -1;
+  }
+
+  levels_[level_key].number_of_columns = tiles_x;
+  levels_[level_key].number_of_rows = tiles_y;
+  //The wanted tile goes in last, so it is the one sure to stay.
+  size_t wanted = tile_x < tiles_x && tile_y < tiles_y ?
+                  tile_y * tiles_x + tile_x : tiles.size();
+  for (size_t i = 0; i < tiles.size(); i++)
+  {
+    if (i == wanted) continue;
+    TileKey key = {{photo_id, size_t(level), i % tiles_x, i / tiles_x}};
+    Insert(key, tiles[i]);
+  }
+  if (wanted < tiles.size())
+  {
+    TileKey key = {{photo_id, size_t(level), tile_x, tile_y}};
+    Insert(key, tiles[wanted]);
+    tile = tiles[wanted];
+  }
+  return 0;
+}
+
+void PhotoTileCache::Insert(const TileKey& key, const TilePtr& tile)
+{
+  LevelKey level_key(key[0], int(key[1]));
+  auto itr_entry = entries_.find(key);
+  if (itr_entry != entries_.end())
+  {
+    size_in_bytes_ -= itr_entry->second->second->pixels.size();
+    levels_[level_key].number_of_held--;
+    lru_.erase(itr_entry->second);
+    entries_.erase(itr_entry);
+  }
+  lru_.push_front(std::make_pair(key, tile));
+  entries_[key] = lru_.begin();
+  size_in_bytes_ += tile->pixels.size();
+  levels_[level_key].number_of_held++;
+
+  while (size_in_bytes_ > capacity_ && lru_.size() > 1)
+  {
+    const std::pair<TileKey, TilePtr>& last = lru_.back();
+    size_in_bytes_ -= last.second->pixels.size();
+    levels_[LevelKey(last.first[0], int(last.first[1]))].number_of_held--;
+    entries_.erase(last.first);
+    lru_.pop_back();
+  }
+}
+
+PhotoTileSampler::PhotoTileSampler(PhotoTileCache& photos)
+  : photos_(photos)
+{
+}
+
+bool PhotoTileSampler::Color(size_t photo_id, int level, double x, double y,
+                             uint8_t* rgb)
+{
+  double scale = 1.0 / double(size_t(1) << level);
+  double level_x = x * scale - 0.5;
+  double level_y = y * scale - 0.5;
+  if (!(level_x >= 0) || !(level_y >= 0)) return false;
+  size_t tile_x = size_t(level_x) / PhotoTileCache::TILE_SIZE;
+  size_t tile_y = size_t(level_y) / PhotoTileCache::TILE_SIZE;
+  TileKey tile_key = {{photo_id, size_t(level), tile_x, tile_y}};
+  if (tile_key != last_key_ || !last_tile_)
+  {
+    auto itr_tile = tiles_.find(tile_key);
+    if (itr_tile == tiles_.end())
+    {
+      itr_tile = tiles_.insert(std::make_pair(
+        tile_key, photos_.Tile(photo_id, level, tile_x, tile_y))).first;
+    }
+    last_key_ = tile_key;
+    last_tile_ = itr_tile->second;
+    if (!last_tile_) return false;
+  }
+  return last_tile_->Sample(level_x, level_y, rgb);
+}
+
+void PhotoTileSampler::Clear()
+{
+  tiles_.clear();
+  last_tile_.reset();
+}
+
+}
+}
+}
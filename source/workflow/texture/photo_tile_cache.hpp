@@ -0,0 +1,173 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_PHOTO_TILE_CACHE_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_PHOTO_TILE_CACHE_HPP_
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  A decoded photo, RGB row major.
+ */
+struct HS_EXPORT SourcePhoto
+{
+  SourcePhoto();
+
+  size_t width;
+  size_t height;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ *  Square piece of one pyramid level of a photo. It holds one extra row and
+ *  column of its neighbours so that it can be sampled up to its far edge.
+ */
+struct HS_EXPORT PhotoTile
+{
+  PhotoTile();
+
+  /**
+   *  Bilinear color at (x, y) in pixels of the level, pixel centres on
+   *  integers. Fails outside the tile.
+   */
+  bool Sample(double x, double y, uint8_t* rgb) const;
+
+  //Size of the level.
+  size_t level_width;
+  size_t level_height;
+  //First pixel held and the number held.
+  size_t left;
+  size_t top;
+  size_t width;
+  size_t height;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ *  Decoded photo tiles shared by the threads sampling them, keyed by
+ *  (photo, level, tile). Level l box filters the photo by 2^l.
+ *
+ *  Photos can only be decoded whole, so a miss decodes the photo and keeps
+ *  every tile of the level, the least recently used tiles dropped once
+ *  more than capacity bytes are held. A photo level requested while it is
+ *  being decoded is waited for, not decoded again.
+ */
+class HS_EXPORT PhotoTileCache
+{
+public:
+  typedef std::shared_ptr<const PhotoTile> TilePtr;
+
+  static const size_t TILE_SIZE = 256;
+
+  PhotoTileCache(const std::vector<std::string>& photo_paths,
+                 size_t capacity);
+  virtual ~PhotoTileCache();
+
+  /**
+   *  nullptr if the photo can not be decoded or has no such tile.
+   */
+  TilePtr Tile(size_t photo_id, int level, size_t tile_x, size_t tile_y);
+
+  /**
+   *  Decode the level now unless all its tiles are held, to be called ahead
+   *  of the threads that will sample it.
+   */
+  void Prefetch(size_t photo_id, int level);
+
+  size_t NumberOfPhotos() const;
+  //Photo decodes so far, for tuning the capacity.
+  size_t NumberOfLoads() const;
+  size_t SizeInBytes() const;
+
+protected:
+  virtual int LoadPhoto(const std::string& path, SourcePhoto& photo) const;
+
+private:
+  //Photo, level, tile x, tile y.
+  typedef std::array<size_t, 4> TileKey;
+  typedef std::pair<size_t, int> LevelKey;
+  typedef std::list<std::pair<TileKey, TilePtr> > LruList;
+
+  struct LevelState
+  {
+    LevelState()
+      : number_of_columns(0), number_of_rows(0), number_of_held(0) {}
+
+    //Tiles of the level, known once it was decoded.
+    size_t number_of_columns;
+    size_t number_of_rows;
+    size_t number_of_held;
+  };
+
+  /**
+   *  Decode a level and insert its tiles, with mutex_ held by lock on entry
+   *  and exit. tile is set to the wanted tile if the level has it. Fails if
+   *  the photo can not be decoded.
+   */
+  int LoadLevel(size_t photo_id, int level,
+                size_t tile_x, size_t tile_y,
+                std::unique_lock<std::mutex>& lock,
+                TilePtr& tile);
+  void Insert(const TileKey& key, const TilePtr& tile);
+
+  std::vector<std::string> photo_paths_;
+  size_t capacity_;
+  mutable std::mutex mutex_;
+  LruList lru_;
+  std::map<TileKey, LruList::iterator> entries_;
+  std::map<LevelKey, LevelState> levels_;
+  std::set<LevelKey> loading_;
+  std::condition_variable loaded_;
+  std::vector<char> failed_;
+  size_t number_of_loads_;
+  size_t size_in_bytes_;
+};
+
+/**
+ *  Colors from a PhotoTileCache for one thread, holding on to the tiles it
+ *  went through until cleared so that a run of samples locks the cache once
+ *  per tile.
+ */
+class HS_EXPORT PhotoTileSampler
+{
+public:
+  PhotoTileSampler(PhotoTileCache& photos);
+
+  /**
+   *  Bilinear color at (x, y) in pixels of the full photo, pixel centres at
+   *  half integers, sampled at the given level.
+   */
+  bool Color(size_t photo_id, int level, double x, double y, uint8_t* rgb);
+
+  //Let the cache drop the tiles held.
+  void Clear();
+
+private:
+  typedef std::array<size_t, 4> TileKey;
+
+  PhotoTileCache& photos_;
+  std::map<TileKey, PhotoTileCache::TilePtr> tiles_;
+  TileKey last_key_;
+  PhotoTileCache::TilePtr last_tile_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,107 @@
+#include <algorithm>
+
+#include "workflow/texture/raster_region.hpp"
+
+namespace
+{
+
+using hs::recon::workflow::RegionPoint;
+using hs::recon::workflow::RegionPolygon;
+
+//Even-odd rule.
+bool InsidePolygon(const RegionPolygon& polygon, double x, double y)
+{
+  bool inside = false;
+  for (size_t i = 0, j = polygon.size() - 1; i < polygon.size(); j = i++)
+  {
+    const RegionPoint& a = polygon[i];
+    const RegionPoint& b = polygon[j];
+    if ((a[1] > y) != (b[1] > y) &&
+        x < (b[0] - a[0]) * (y - a[1]) / (b[1] - a[1]) + a[0])
+    {
+      inside = !inside;
+    }
+  }
+  return inside;
+}
+
+//Liang-Barsky clipping of segment ab against the box.
+bool SegmentHitsBox(const RegionPoint& a, const RegionPoint& b,
+                    double min_x, double min_y, double max_x, double max_y)
+{
+  double t0 = 0, t1 = 1;
+  double delta[2] = {b[0] - a[0], b[1] - a[1]};
+  double mins[2] = {min_x, min_y};
+  double maxs[2] = {max_x, max_y};
+  for (int axis = 0; axis < 2; axis++)
+  {
+    if (delta[axis] == 0)
+    {
+      if (a[axis] < mins[axis] || a[axis] > maxs[axis]) return false;
+      continue;
+    }
+    double enter = (mins[axis] - a[axis]) / delta[axis];
+    double leave = (maxs[axis] - a[axis]) / delta[axis];
+    if (enter > leave) std::swap(enter, leave);
+    t0 = std::max(t0, enter);
+    t1 = std::min(t1, leave);
+    if (t0 > t1) return false;
+  }
+  return true;
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+int TilesInRegion(const RasterGrid& grid, const RegionPolygon& region,
+                  std::vector<size_t>& tile_ids)
+{
+  tile_ids.clear();
+  if (region.size() < 3) return -1;
+  double region_min_x = region[0][0], region_max_x = region[0][0];
+  double region_min_y = region[0][1], region_max_y = region[0][1];
+  for (size_t i = 1; i < region.size(); i++)
+  {
+    region_min_x = std::min(region_min_x, region[i][0]);
+    region_max_x = std::max(region_max_x, region[i][0]);
+    region_min_y = std::min(region_min_y, region[i][1]);
+    region_max_y = std::max(region_max_y, region[i][1]);
+  }
+
+  for (size_t row = 0; row < grid.NumberOfTileRows(); row++)
+  {
+    double max_y = grid.TileTop(row);
+    double min_y = max_y - double(grid.TileHeight(row)) * grid.scale_y;
+    if (min_y > region_max_y || max_y < region_min_y) continue;
+    for (size_t column = 0; column < grid.NumberOfTileColumns(); column++)
+    {
+      double min_x = grid.TileLeft(column);
+      double max_x = min_x + double(grid.TileWidth(column)) * grid.scale_x;
+      if (min_x > region_max_x || max_x < region_min_x) continue;
+      //Either an edge crosses the tile or the tile lies inside.
+      bool overlaps = InsidePolygon(region, 0.5 * (min_x + max_x),
+                                    0.5 * (min_y + max_y));
+      for (size_t i = 0, j = region.size() - 1;
+           i < region.size() && !overlaps; j = i++)
+      {
+        overlaps = SegmentHitsBox(region[j], region[i],
+                                  min_x, min_y, max_x, max_y);
+      }
+      if (overlaps)
+      {
+        tile_ids.push_back(row * grid.NumberOfTileColumns() + column);
+      }
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
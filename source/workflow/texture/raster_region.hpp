@@ -0,0 +1,35 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_RASTER_REGION_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_RASTER_REGION_HPP_
+
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/raster_tile.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+typedef EIGEN_VECTOR(double, 2) RegionPoint;
+//Simple polygon in the frame of the grid, in either winding order.
+typedef EIGEN_STD_VECTOR(RegionPoint) RegionPolygon;
+
+/**
+ *  Row major indices of the tiles of grid that share some area with
+ *  region, in ascending order. Fails on a polygon of less than 3 vertices.
+ */
+HS_EXPORT int TilesInRegion(const RasterGrid& grid,
+                            const RegionPolygon& region,
+                            std::vector<size_t>& tile_ids);
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,167 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_RASTER_TILE_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_RASTER_TILE_HPP_
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  North up raster cut in tiles of tile_width x tile_height pixels, the
+ *  last row and column of tiles being cut at the raster edge.
+ */
+struct RasterGrid
+{
+  RasterGrid()
+    : left(0), top(0), scale_x(1), scale_y(1), width(0), height(0),
+      tile_width(1), tile_height(1) {}
+
+  size_t NumberOfTileColumns() const
+  {
+    return (width + tile_width - 1) / tile_width;
+  }
+  size_t NumberOfTileRows() const
+  {
+    return (height + tile_height - 1) / tile_height;
+  }
+  size_t NumberOfTiles() const
+  {
+    return NumberOfTileColumns() * NumberOfTileRows();
+  }
+  size_t TileWidth(size_t column) const
+  {
+    return std::min(tile_width, width - column * tile_width);
+  }
+  size_t TileHeight(size_t row) const
+  {
+    return std::min(tile_height, height - row * tile_height);
+  }
+  //Corner of the top left pixel of a tile.
+  double TileLeft(size_t column) const
+  {
+    return left + double(column * tile_width) * scale_x;
+  }
+  double TileTop(size_t row) const
+  {
+    return top - double(row * tile_height) * scale_y;
+  }
+
+  template <typename Archive>
+  void serialize(Archive& archive)
+  {
+    archive(left, top, scale_x, scale_y, width, height,
+            tile_width, tile_height);
+  }
+
+  //Corner of the top left pixel.
+  double left;
+  double top;
+  //Ground size of a pixel.
+  double scale_x;
+  double scale_y;
+  size_t width;
+  size_t height;
+  size_t tile_width;
+  size_t tile_height;
+};
+
+//Pixels of one tile, row major with interleaved channels.
+template <typename T>
+struct RasterTile
+{
+  typedef T Sample;
+
+  size_t row;
+  size_t column;
+  size_t width;
+  size_t height;
+  size_t channels;
+  std::vector<T> pixels;
+};
+
+/**
+ *  Receives the tiles of a raster as they are produced, in any order. Calls
+ *  are serialized by the producer, implementations need no locking.
+ */
+template <typename T>
+class RasterTileSink
+{
+public:
+  typedef RasterTile<T> Tile;
+
+  virtual ~RasterTileSink() {}
+
+  virtual int Open(const RasterGrid& grid, size_t channels, T no_data) = 0;
+  virtual int Write(const Tile& tile) = 0;
+  virtual int Close() = 0;
+};
+
+/**
+ *  Passes tiles from concurrent producers to a sink one at a time and
+ *  reports the share of tiles written. Once a write fails or the progress
+ *  manager asks to stop, every later write fails.
+ */
+template <typename T>
+class SerializedTileWriter
+{
+public:
+  typedef RasterTile<T> Tile;
+  typedef RasterTileSink<T> Sink;
+
+  SerializedTileWriter(Sink& sink, size_t number_of_tiles,
+                       hs::progress::ProgressManager* progress_manager)
+    : sink_(sink)
+    , number_of_tiles_(std::max(number_of_tiles, size_t(1)))
+    , progress_manager_(progress_manager)
+    , number_of_written_(0)
+    , failed_(false) {}
+
+  int Write(const Tile& tile)
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (failed_) return -1;
+    if ((progress_manager_ && !progress_manager_->CheckKeepWorking()) ||
+        sink_.Write(tile) != 0)
+    {
+      failed_ = true;
+      return -1;
+    }
+    number_of_written_++;
+    if (progress_manager_)
+    {
+      progress_manager_->SetCurrentSubProgressCompleteRatio(
+        float(number_of_written_) / float(number_of_tiles_));
+    }
+    return 0;
+  }
+
+  //Lets producers skip work that would be thrown away.
+  bool failed() const
+  {
+    return failed_;
+  }
+
+private:
+  Sink& sink_;
+  size_t number_of_tiles_;
+  hs::progress::ProgressManager* progress_manager_;
+  size_t number_of_written_;
+  std::atomic<bool> failed_;
+  std::mutex mutex_;
+};
+
+}
+}
+}
+
+#endif
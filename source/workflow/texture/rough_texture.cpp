@@ -1,18 +1,27 @@
 #include <fstream>
+#include <iostream>
 #include <sstream>
 #include <limits>
+#include <memory>
 
 #include <cereal/types/array.hpp>
 #include <cereal/types/vector.hpp>
 #include <cereal/archives/portable_binary.hpp>
 
 //#include "hs_flowmodule/mesh_surface/kernel/mesh_type/mesh_type.hpp"
-#include "hs_texture/texture_multiview/dem_generator.hpp"
-#include "hs_texture/texture_multiview/dem_split_tiff_engine.hpp"
 #include "hs_texture/texture_multiview/triangles_image_selector.hpp"
-#include "hs_texture/texture_multiview/dom_generator.hpp"
-#include "hs_texture/texture_multiview/dom_split_tiff_engine.hpp"
-#include "hs_texture/texture_multiview/dom_split_jpg_engine.hpp"
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+#include "workflow/texture/cog_tile_sink.hpp"
+#include "workflow/texture/fan_out_tile_sink.hpp"
+#include "workflow/texture/split_jpg_tile_sink.hpp"
+#include "workflow/texture/split_tile_path.hpp"
+#include "workflow/texture/split_tiff_tile_sink.hpp"
+#include "workflow/texture/texture_atlas.hpp"
+#include "workflow/texture/tiled_dem_rasterizer.hpp"
+#include "workflow/texture/tiled_dom_rasterizer.hpp"
+#include "workflow/texture/visibility_image_selector.hpp"
+#include "workflow/texture/web_tile_sink.hpp"
 
 #include "workflow/texture/rough_texture.hpp"
 
@@ -24,6 +33,12 @@ namespace workflow
 {
 
 TextureConfig::TextureConfig()
+  : dem_output_type_flag_(OUTPUT_TIFF)
+  , web_tile_format_(WebTileSink::FORMAT_JPG)
+  , web_tile_scheme_(WebTileSink::SCHEME_XYZ)
+  , number_of_threads_(1)
+  , image_selector_type_(SELECTOR_EXHAUSTIVE)
+  , model_page_size_(0)
 {
   type_ = STEP_TEXTURE;
 }
@@ -83,11 +98,67 @@ void TextureConfig::set_images(const ImageParamsContainer& images)
   images_ = images;
 }
 
+void TextureConfig::set_dem_output_type(int output_type_flag)
+{
+  dem_output_type_flag_ = output_type_flag;
+}
+
 void TextureConfig::set_dom_output_type(int output_type_flag)
 {
   dom_output_type_flag_ = output_type_flag;
 }
 
+void TextureConfig::set_web_tile_format(int web_tile_format)
+{
+  web_tile_format_ = web_tile_format;
+}
+
+void TextureConfig::set_web_tile_scheme(int web_tile_scheme)
+{
+  web_tile_scheme_ = web_tile_scheme;
+}
+
+void TextureConfig::set_geographic_projector(
+  GeographicProjectorPtr geographic_projector)
+{
+  geographic_projector_ = geographic_projector;
+}
+
+void TextureConfig::set_region(const RegionPolygon& region)
+{
+  region_ = region;
+}
+
+void TextureConfig::set_region_box(double min_x, double min_y,
+                                   double max_x, double max_y)
+{
+  region_.resize(4);
+  region_[0] << min_x, min_y;
+  region_[1] << max_x, min_y;
+  region_[2] << max_x, max_y;
+  region_[3] << min_x, max_y;
+}
+
+void TextureConfig::set_number_of_threads(size_t number_of_threads)
+{
+  number_of_threads_ = number_of_threads;
+}
+
+void TextureConfig::set_image_selector_type(int image_selector_type)
+{
+  image_selector_type_ = image_selector_type;
+}
+
+void TextureConfig::set_model_path(const std::string& model_path)
+{
+  model_path_ = model_path;
+}
+
+void TextureConfig::set_model_page_size(int model_page_size)
+{
+  model_page_size_ = model_page_size;
+}
+
 double TextureConfig::dem_x_scale() const
 {
   return dem_x_scale_;
@@ -141,16 +212,92 @@ const TextureConfig::ImageParamsContainer& TextureConfig::images() const
   return images_;
 }
 
+int TextureConfig::dem_output_type_flag() const
+{
+  return dem_output_type_flag_;
+}
+
 int TextureConfig::dom_output_type_flag() const
 {
   return dom_output_type_flag_;
 }
 
+int TextureConfig::web_tile_format() const
+{
+  return web_tile_format_;
+}
+
+int TextureConfig::web_tile_scheme() const
+{
+  return web_tile_scheme_;
+}
+
+GeographicProjectorPtr TextureConfig::geographic_projector() const
+{
+  return geographic_projector_;
+}
+
+size_t TextureConfig::number_of_threads() const
+{
+  return number_of_threads_;
+}
+
+int TextureConfig::image_selector_type() const
+{
+  return image_selector_type_;
+}
+
+const std::string& TextureConfig::model_path() const
+{
+  return model_path_;
+}
+
+int TextureConfig::model_page_size() const
+{
+  return model_page_size_;
+}
+
+const RegionPolygon& TextureConfig::region() const
+{
+  return region_;
+}
+
 RoughTexture::RoughTexture()
 {
   type_ = STEP_TEXTURE;
 }
 
+int RoughTexture::CheckRegionOutputs(WorkflowStepConfig* config)
+{
+  TextureConfig* texture_config = static_cast<TextureConfig*>(config);
+  if (texture_config->region().empty()) return 0;
+
+  //Their overviews and atlas pages mix tiles from all over the surface,
+  //so they cannot be patched with the tiles of a region.
+  const int whole_outputs =
+    TextureConfig::OUTPUT_COG | TextureConfig::OUTPUT_WEB_TILES;
+  if (!texture_config->dem_path().empty() &&
+      (texture_config->dem_output_type_flag() & whole_outputs))
+  {
+    std::cout<<"DEM COG cannot be regenerated for a region only!\n";
+    return -1;
+  }
+  if (!texture_config->dom_path().empty() &&
+      (texture_config->dom_output_type_flag() & whole_outputs))
+  {
+    std::cout<<"DOM COG and web tiles cannot be regenerated "
+             <<"for a region only!\n";
+    return -1;
+  }
+  if (!texture_config->model_path().empty() &&
+      texture_config->model_page_size() > 0)
+  {
+    std::cout<<"Textured model cannot be regenerated for a region only!\n";
+    return -1;
+  }
+  return 0;
+}
+
 int RoughTexture::LoadSurfaceModel(WorkflowStepConfig* config,
                                    VertexContainer& vertices,
                                    TriangleContainer& triangles)
@@ -162,11 +309,22 @@ int RoughTexture::LoadSurfaceModel(WorkflowStepConfig* config,
   const TextureConfig::SimilarTransform& similar_transform =
     texture_config->similar_transform();
 
+  //The texture generators take double vertices and size_t ids.
   {
-    std::ifstream mesh_file(surface_model_path, std::ios::binary);
-    if (!mesh_file) return -1;
-    cereal::PortableBinaryInputArchive archive(mesh_file);
-    archive(vertices, triangles);
+    CompactMesh mesh;
+    if (LoadMesh(surface_model_path, mesh) != 0) return -1;
+    vertices.resize(mesh.vertices.size());
+    for (size_t i = 0; i < mesh.vertices.size(); i++)
+    {
+      vertices[i] = mesh.VertexPosition(i);
+    }
+    triangles.resize(mesh.triangles.size());
+    for (size_t i = 0; i < mesh.triangles.size(); i++)
+    {
+      triangles[i][0] = mesh.triangles[i][0];
+      triangles[i][1] = mesh.triangles[i][1];
+      triangles[i][2] = mesh.triangles[i][2];
+    }
   }
 
   for (auto& vertex : vertices)
@@ -211,37 +369,51 @@ int RoughTexture::GenerateDEM(WorkflowStepConfig* config,
                               const VertexContainer& vertices,
                               const TriangleContainer& triangles)
 {
-  typedef hs::texture::multiview::DEMGenerator<Scalar> Generator;
-  typedef hs::texture::multiview::DEMSplitTiffEngine<Scalar> Engine;
-
-  PlanarPoint min, max;
-  min << std::numeric_limits<Scalar>::max(),
-         std::numeric_limits<Scalar>::max();
-  max << -std::numeric_limits<Scalar>::max(),
-         -std::numeric_limits<Scalar>::max();
-  for (size_t i = 0; i < vertices.size(); i++)
-  {
-    min[0] = std::min(min[0], vertices[i][0]);
-    min[1] = std::min(min[1], vertices[i][1]);
-    max[0] = std::max(max[0], vertices[i][0]);
-    max[1] = std::max(max[1], vertices[i][1]);
-  }
+  typedef TiledDEMRasterizer::Height Height;
 
   TextureConfig* texture_config = static_cast<TextureConfig*>(config);
   const std::string& dem_path = texture_config->dem_path();
-  if (!dem_path.empty())
+  int output_type_flag = texture_config->dem_output_type_flag();
+  if (!dem_path.empty() &&
+      (output_type_flag &
+       (TextureConfig::OUTPUT_TIFF | TextureConfig::OUTPUT_COG)))
   {
     size_t tile_width = size_t(texture_config->dem_tile_x_size());
     size_t tile_height = size_t(texture_config->dem_tile_y_size());
     Scalar scale_x = texture_config->dem_x_scale();
     Scalar scale_y = texture_config->dem_y_scale();
-
-    Generator generator;
-    Engine engine;
-
-    return generator(dem_path, engine, vertices, triangles, min, max,
-                     tile_width, tile_height, Scalar(-32767),
-                     scale_x, scale_y, Scalar(0), &progress_manager_);
+    size_t number_of_threads = texture_config->number_of_threads();
+
+    bool in_region = !texture_config->region().empty();
+    RasterGrid grid;
+    std::vector<size_t> tile_ids;
+    if (PrepareRasterGrid(*texture_config, vertices, scale_x, scale_y,
+                          tile_width, tile_height, dem_path,
+                          grid, tile_ids) != 0)
+    {
+      return -1;
+    }
+    if (in_region && tile_ids.empty()) return 0;
+    GeographicProjectorPtr projector =
+      texture_config->geographic_projector();
+    int epsg_code = projector ? projector->EpsgCode() : 0;
+    //Tiles go to disk as they are finished.
+    SplitTiffTileSink<Height> tiff_sink(dem_path, epsg_code);
+    CogTileSink<Height> cog_sink(ReplaceExtension(dem_path, ".tif"),
+                                 number_of_threads, 512, epsg_code);
+    FanOutTileSink<Height> sink;
+    if (output_type_flag & TextureConfig::OUTPUT_TIFF)
+    {
+      sink.AddSink(&tiff_sink);
+    }
+    if (output_type_flag & TextureConfig::OUTPUT_COG)
+    {
+      sink.AddSink(&cog_sink);
+    }
+    TiledDEMRasterizer rasterizer(number_of_threads);
+    rasterizer.set_tile_ids(tile_ids);
+    return rasterizer(vertices, triangles, grid, Height(-32767), sink,
+                      &progress_manager_);
   }
   else
   {
@@ -254,37 +426,47 @@ int RoughTexture::GenerateDOM(WorkflowStepConfig* config,
                               const TriangleContainer& triangles)
 {
   typedef hs::texture::multiview::TrianglesImageSelector<Scalar> Selector;
-  typedef Selector::IntrinsicParams IntrinsicParams;
-  typedef Selector::ExtrinsicParams ExtrinsicParams;
-  typedef Selector::ImageParams SelectorImage;
   typedef Selector::ImageParamsContainer SelectorImageContainer;
-  typedef TextureConfig::ImageParams ConfigImage;
+  typedef VisibilityImageSelector::ImageParamsContainer
+          VisibilitySelectorImageContainer;
   typedef TextureConfig::ImageParamsContainer ConfigImageContainer;
-  typedef hs::texture::multiview::DOMGenerator<Scalar> Generator;
-  typedef Generator::ImageParams GeneratorImage;
-  typedef Generator::ImageParamsContainer GeneratorImageContainer;
-  typedef hs::texture::multiview::DOMSplitTIFFEngine<Scalar> Engine;
-  typedef hs::texture::multiview::DOMSplitJPGEngine<Scalar> JPGEngine;
-
-  PlanarPoint min, max;
-  min << std::numeric_limits<Scalar>::max(),
-         std::numeric_limits<Scalar>::max();
-  max << -std::numeric_limits<Scalar>::max(),
-         -std::numeric_limits<Scalar>::max();
-  for (size_t i = 0; i < vertices.size(); i++)
-  {
-    min[0] = std::min(min[0], vertices[i][0]);
-    min[1] = std::min(min[1], vertices[i][1]);
-    max[0] = std::max(max[0], vertices[i][0]);
-    max[1] = std::max(max[1], vertices[i][1]);
-  }
+  typedef TiledDOMRasterizer::ImageParamsContainer RasterizerImageContainer;
+  typedef TiledDOMRasterizer::Sample Sample;
 
   TextureConfig* texture_config = static_cast<TextureConfig*>(config);
   const std::string& dom_path = texture_config->dom_path();
   const TextureConfig::SimilarTransform& similar_transform =
     texture_config->similar_transform();
-  if (!dom_path.empty())
+  int output_type_flag = texture_config->dom_output_type_flag();
+  if (!dom_path.empty() &&
+      (output_type_flag &
+       (TextureConfig::OUTPUT_TIFF | TextureConfig::OUTPUT_JPG |
+        TextureConfig::OUTPUT_COG | TextureConfig::OUTPUT_WEB_TILES)))
   {
+    bool in_region = !texture_config->region().empty();
+    //Web tiles cannot be placed without knowing where the frame lies.
+    GeographicProjectorPtr projector =
+      texture_config->geographic_projector();
+    if ((output_type_flag & TextureConfig::OUTPUT_WEB_TILES) && !projector)
+    {
+      return -1;
+    }
+
+    size_t number_of_threads = texture_config->number_of_threads();
+    size_t tile_width = size_t(texture_config->dom_tile_x_size());
+    size_t tile_height = size_t(texture_config->dom_tile_y_size());
+    Scalar scale_x = texture_config->dom_x_scale();
+    Scalar scale_y = texture_config->dom_y_scale();
+    RasterGrid grid;
+    std::vector<size_t> tile_ids;
+    if (PrepareRasterGrid(*texture_config, vertices, scale_x, scale_y,
+                          tile_width, tile_height, dom_path,
+                          grid, tile_ids) != 0)
+    {
+      return -1;
+    }
+    if (in_region && tile_ids.empty()) return 0;
+
     const ConfigImageContainer& config_images = texture_config->images();
     SelectorImageContainer selector_images(config_images.size());
     for (size_t i = 0; i < config_images.size(); i++)
@@ -302,78 +484,108 @@ int RoughTexture::GenerateDOM(WorkflowStepConfig* config,
       selector_images[i].image_width = config_images[i].image_width;
       selector_images[i].image_height = config_images[i].image_height;
     }
+    //Images are only chosen for the triangles over the tiles of the region,
+    //still hidden by the whole surface.
+    std::vector<size_t> region_triangle_ids;
+    if (in_region)
+    {
+      TileSurfaceRasterizer surface(vertices, triangles, grid);
+      if (surface.BinTriangles(number_of_threads) != 0 ||
+          surface.TrianglesOfTiles(tile_ids, region_triangle_ids) != 0)
+      {
+        return -1;
+      }
+    }
     std::vector<size_t> triangle_image_indices;
-    Selector selector;
     progress_manager_.AddSubProgress(0.2f);
-    selector(selector_images, vertices, triangles, triangle_image_indices,
-             &progress_manager_);
-    progress_manager_.FinishCurrentSubProgress();
-
-    GeneratorImageContainer generator_images(config_images.size());
-    for (size_t i = 0; i < config_images.size(); i++)
+    if (in_region && region_triangle_ids.empty())
     {
-      generator_images[i].extrinsic_params = config_images[i].extrinsic_params;
-      generator_images[i].extrinsic_params.rotation() =
-        generator_images[i].extrinsic_params.rotation() *
-        similar_transform.rotation.Inverse();
-      generator_images[i].extrinsic_params.position() =
-        similar_transform.scale *
-        (similar_transform.rotation *
-         generator_images[i].extrinsic_params.position()) +
-        similar_transform.translate;
-      generator_images[i].intrinsic_params = config_images[i].intrinsic_params;
-      generator_images[i].image_path = config_images[i].image_path;
+      //Nothing is left over the region, its tiles are rewritten clear.
+      triangle_image_indices.clear();
     }
-    size_t tile_width = size_t(texture_config->dom_tile_x_size());
-    size_t tile_height = size_t(texture_config->dom_tile_y_size());
-    Scalar scale_x = texture_config->dom_x_scale();
-    Scalar scale_y = texture_config->dom_y_scale();
-
-    Generator generator;
-    progress_manager_.AddSubProgress(0.8f);
-    int result;
-    if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_TIFF)
+    else if (texture_config->image_selector_type() ==
+             TextureConfig::SELECTOR_VISIBILITY)
     {
-      if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_JPG)
+      VisibilitySelectorImageContainer
+        visibility_images(config_images.size());
+      for (size_t i = 0; i < config_images.size(); i++)
       {
-        progress_manager_.AddSubProgress(0.5f);
+        visibility_images[i].intrinsic_params =
+          selector_images[i].intrinsic_params;
+        visibility_images[i].extrinsic_params =
+          selector_images[i].extrinsic_params;
+        visibility_images[i].image_width = config_images[i].image_width;
+        visibility_images[i].image_height = config_images[i].image_height;
       }
-      Engine engine;
-      result =
-        generator(dom_path, engine, generator_images, vertices, triangles,
-        triangle_image_indices, min, max,
-        tile_width, tile_height,
-        scale_x, scale_y, Scalar(0), &progress_manager_);
-      if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_JPG)
+      VisibilityImageSelector selector(number_of_threads);
+      selector.set_triangle_ids(region_triangle_ids);
+      if (selector(visibility_images, vertices, triangles,
+                   triangle_image_indices, &progress_manager_) != 0)
       {
-        progress_manager_.FinishCurrentSubProgress();
+        return -1;
       }
     }
+    else
+    {
+      //This selector cannot be restricted, it picks for every triangle.
+      Selector selector;
+      selector(selector_images, vertices, triangles, triangle_image_indices,
+               &progress_manager_);
+    }
+    progress_manager_.FinishCurrentSubProgress();
 
-    if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_JPG)
+    RasterizerImageContainer rasterizer_images(config_images.size());
+    std::vector<std::string> photo_paths(config_images.size());
+    for (size_t i = 0; i < config_images.size(); i++)
     {
-      if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_TIFF)
-      {
-        progress_manager_.AddSubProgress(0.5f);
-      }
-      JPGEngine engine;
-      result =
-        generator(dom_path, engine, generator_images, vertices, triangles,
-        triangle_image_indices, min, max,
-        tile_width, tile_height,
-        scale_x, scale_y, Scalar(0), &progress_manager_);
-      if (texture_config->dom_output_type_flag() & TextureConfig::OUTPUT_TIFF)
-      {
-        progress_manager_.FinishCurrentSubProgress();
-      }
+      rasterizer_images[i].extrinsic_params =
+        selector_images[i].extrinsic_params;
+      rasterizer_images[i].intrinsic_params = config_images[i].intrinsic_params;
+      rasterizer_images[i].color_correction =
+        config_images[i].color_correction;
+      photo_paths[i] = config_images[i].image_path;
+    }
+
+    //One rasterization pass feeds every requested format.
+    int epsg_code = projector ? projector->EpsgCode() : 0;
+    SplitTiffTileSink<Sample> tiff_sink(ReplaceExtension(dom_path, ".tif"),
+                                        epsg_code);
+    SplitJpgTileSink jpg_sink(ReplaceExtension(dom_path, ".jpg"));
+    CogTileSink<Sample> cog_sink(ReplaceExtension(dom_path, ".tif"),
+                                 number_of_threads, 512, epsg_code);
+    FanOutTileSink<Sample> sink;
+    if (output_type_flag & TextureConfig::OUTPUT_TIFF)
+    {
+      sink.AddSink(&tiff_sink);
+    }
+    if (output_type_flag & TextureConfig::OUTPUT_JPG)
+    {
+      sink.AddSink(&jpg_sink);
+    }
+    if (output_type_flag & TextureConfig::OUTPUT_COG)
+    {
+      sink.AddSink(&cog_sink);
+    }
+    std::unique_ptr<WebTileSink> web_sink;
+    if (output_type_flag & TextureConfig::OUTPUT_WEB_TILES)
+    {
+      web_sink.reset(new WebTileSink(ReplaceExtension(dom_path, "_tiles"),
+                                     *projector,
+                                     texture_config->web_tile_format(),
+                                     texture_config->web_tile_scheme(),
+                                     number_of_threads));
+      sink.AddSink(web_sink.get());
     }
 
-    
-    //int result =
-    //  generator(dom_path, engine, generator_images, vertices, triangles,
-    //            triangle_image_indices, min, max,
-    //            tile_width, tile_height,
-    //            scale_x, scale_y, Scalar(0), &progress_manager_);
+    //Bytes of decoded photo tiles kept for the tiles still to come.
+    const size_t photo_cache_size = size_t(1) << 30;
+    PhotoTileCache photos(photo_paths, photo_cache_size);
+    TiledDOMRasterizer rasterizer(number_of_threads);
+    rasterizer.set_tile_ids(tile_ids);
+    progress_manager_.AddSubProgress(0.8f);
+    int result = rasterizer(rasterizer_images, photos, vertices, triangles,
+                            triangle_image_indices, grid, sink,
+                            &progress_manager_);
     progress_manager_.FinishCurrentSubProgress();
 
     return result;
@@ -385,12 +597,115 @@ int RoughTexture::GenerateDOM(WorkflowStepConfig* config,
 
 }
 
+int RoughTexture::GenerateModel(WorkflowStepConfig* config,
+                                const VertexContainer& vertices,
+                                const TriangleContainer& triangles)
+{
+  typedef TextureAtlasGenerator::ImageParamsContainer GeneratorImageContainer;
+  typedef TextureConfig::ImageParamsContainer ConfigImageContainer;
+
+  TextureConfig* texture_config = static_cast<TextureConfig*>(config);
+  const std::string& model_path = texture_config->model_path();
+  const TextureConfig::SimilarTransform& similar_transform =
+    texture_config->similar_transform();
+  if (!model_path.empty() && texture_config->model_page_size() > 0)
+  {
+    const ConfigImageContainer& config_images = texture_config->images();
+    GeneratorImageContainer images(config_images.size());
+    std::vector<std::string> photo_paths(config_images.size());
+    for (size_t i = 0; i < config_images.size(); i++)
+    {
+      images[i].extrinsic_params = config_images[i].extrinsic_params;
+      images[i].extrinsic_params.rotation() =
+        images[i].extrinsic_params.rotation() *
+        similar_transform.rotation.Inverse();
+      images[i].extrinsic_params.position() =
+        similar_transform.scale *
+        (similar_transform.rotation *
+         images[i].extrinsic_params.position()) +
+        similar_transform.translate;
+      images[i].intrinsic_params = config_images[i].intrinsic_params;
+      images[i].image_width = config_images[i].image_width;
+      images[i].image_height = config_images[i].image_height;
+      photo_paths[i] = config_images[i].image_path;
+    }
+
+    const size_t photo_cache_size = size_t(1) << 30;
+    PhotoTileCache photos(photo_paths, photo_cache_size);
+    TextureAtlasGenerator generator(
+      texture_config->number_of_threads(),
+      size_t(texture_config->model_page_size()));
+    TexturedMesh mesh;
+    if (generator(images, photos, vertices, triangles, mesh,
+                  &progress_manager_) != 0)
+    {
+      return -1;
+    }
+    return SaveTexturedMesh(model_path, mesh);
+  }
+  else
+  {
+    return 0;
+  }
+}
+
+int RoughTexture::PrepareRasterGrid(const TextureConfig& texture_config,
+                                    const VertexContainer& vertices,
+                                    Scalar scale_x, Scalar scale_y,
+                                    size_t tile_width, size_t tile_height,
+                                    const std::string& path,
+                                    RasterGrid& grid,
+                                    std::vector<size_t>& tile_ids)
+{
+  const RegionPolygon& region = texture_config.region();
+  std::string grid_path = ReplaceExtension(path, ".grid");
+  tile_ids.clear();
+  if (region.empty())
+  {
+    if (ComputeRasterGrid(vertices, scale_x, scale_y, tile_width, tile_height,
+                          texture_config.number_of_threads(), grid) != 0)
+    {
+      return -1;
+    }
+    std::ofstream grid_file(grid_path, std::ios::binary);
+    if (!grid_file) return -1;
+    cereal::PortableBinaryOutputArchive archive(grid_file);
+    archive(grid);
+    return 0;
+  }
+
+  //The grid of the earlier run, the surface may have been edited since.
+  //A grid computed anew would not line up with the tiles on disk.
+  std::ifstream grid_file(grid_path, std::ios::binary);
+  if (!grid_file)
+  {
+    std::cout<<"No raster grid at "<<grid_path
+             <<", generate the whole surface before a region!\n";
+    return -1;
+  }
+  //A truncated or foreign file cannot place the tiles of that run.
+  try
+  {
+    cereal::PortableBinaryInputArchive archive(grid_file);
+    archive(grid);
+  }
+  catch (const cereal::Exception&)
+  {
+    return -1;
+  }
+  if (grid.tile_width == 0 || grid.tile_height == 0) return -1;
+  return TilesInRegion(grid, region, tile_ids);
+}
+
 int RoughTexture::RunImplement(WorkflowStepConfig* config)
 {
   int result = 0;
 
   while (1)
   {
+    result = CheckRegionOutputs(config);
+    if (result != 0) break;
+
     VertexContainer vertices;
     TriangleContainer triangles;
     progress_manager_.AddSubProgress(0.1f);
@@ -398,16 +713,21 @@ int RoughTexture::RunImplement(WorkflowStepConfig* config)
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
-    progress_manager_.AddSubProgress(0.3f);
+    progress_manager_.AddSubProgress(0.2f);
     result = GenerateDEM(config, vertices, triangles);
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
-    progress_manager_.AddSubProgress(0.6f);
+    progress_manager_.AddSubProgress(0.4f);
     result = GenerateDOM(config, vertices, triangles);
     if (result != 0) break;
     progress_manager_.FinishCurrentSubProgress();
 
+    progress_manager_.AddSubProgress(0.3f);
+    result = GenerateModel(config, vertices, triangles);
+    if (result != 0) break;
+    progress_manager_.FinishCurrentSubProgress();
+
     break;
   }
 
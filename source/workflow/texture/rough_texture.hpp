@@ -5,6 +5,9 @@
 
 #include "hs_3d_reconstructor/config/hs_config.hpp"
 #include "workflow/common/workflow_step.hpp"
+#include "workflow/photo_orientation/color_balance_estimator.hpp"
+#include "workflow/texture/geographic_projector.hpp"
+#include "workflow/texture/raster_region.hpp"
 
 #include "hs_math/linear_algebra/eigen_macro.hpp"
 #include "hs_math/geometry/rotation.hpp"
@@ -35,6 +38,8 @@ public:
     std::string image_path;
     size_t image_width;
     size_t image_height;
+    //Applied to the orthophoto colors sampled from the photo.
+    ColorCorrection color_correction;
   };
   typedef EIGEN_STD_VECTOR(ImageParams) ImageParamsContainer;
 
@@ -49,7 +54,19 @@ public:
   {
     NO_OUTPUT = 0,
     OUTPUT_TIFF = 1,
-    OUTPUT_JPG = 2
+    OUTPUT_JPG = 2,
+    //One tiled, compressed GeoTIFF with overviews.
+    OUTPUT_COG = 4,
+    //Web Mercator tile pyramid, needs a geographic projector.
+    OUTPUT_WEB_TILES = 8
+  };
+
+  enum ImageSelectorType
+  {
+    //Every image tried for every triangle.
+    SELECTOR_EXHAUSTIVE = 0,
+    //Frustum hierarchy and depth buffers, for blocks of many photos.
+    SELECTOR_VISIBILITY
   };
 
   void set_dem_x_scale(double dem_x_scale);
@@ -57,6 +74,7 @@ public:
   void set_dem_path(const std::string& dem_path);
   void set_dem_tile_x_size(int dem_tile_x_size);
   void set_dem_tile_y_size(int dem_tile_y_size);
+  void set_dem_output_type(int output_type_flag);
   void set_dom_x_scale(double dom_x_scale);
   void set_dom_y_scale(double dom_y_scale);
   void set_dom_path(const std::string& dom_path);
@@ -66,12 +84,23 @@ public:
   void set_similar_transform(const SimilarTransform& similar_transform);
   void set_images(const ImageParamsContainer& images);
   void set_dom_output_type(int output_type_flag);
+  void set_web_tile_format(int web_tile_format);
+  void set_web_tile_scheme(int web_tile_scheme);
+  void set_geographic_projector(GeographicProjectorPtr geographic_projector);
+  void set_number_of_threads(size_t number_of_threads);
+  void set_image_selector_type(int image_selector_type);
+  void set_model_path(const std::string& model_path);
+  void set_model_page_size(int model_page_size);
+  void set_region(const RegionPolygon& region);
+  void set_region_box(double min_x, double min_y,
+                      double max_x, double max_y);
 
   double dem_x_scale() const;
   double dem_y_scale() const;
   const std::string& dem_path() const;
   int dem_tile_x_size() const;
   int dem_tile_y_size() const;
+  int dem_output_type_flag() const;
   double dom_x_scale() const;
   double dom_y_scale() const;
   const std::string& dom_path() const;
@@ -81,6 +110,14 @@ public:
   const SimilarTransform& similar_transform() const;
   const ImageParamsContainer& images() const;
   int dom_output_type_flag() const;
+  int web_tile_format() const;
+  int web_tile_scheme() const;
+  GeographicProjectorPtr geographic_projector() const;
+  size_t number_of_threads() const;
+  int image_selector_type() const;
+  const std::string& model_path() const;
+  int model_page_size() const;
+  const RegionPolygon& region() const;
 
 private:
   double dem_x_scale_;
@@ -88,6 +125,7 @@ private:
   std::string dem_path_;
   int dem_tile_x_size_;
   int dem_tile_y_size_;
+  int dem_output_type_flag_;
   double dom_x_scale_;
   double dom_y_scale_;
   std::string dom_path_;
@@ -97,6 +135,21 @@ private:
   SimilarTransform similar_transform_;
   ImageParamsContainer images_;
   int dom_output_type_flag_;
+  int web_tile_format_;
+  int web_tile_scheme_;
+  //Georeferenced frame to longitude and latitude, none if unknown.
+  GeographicProjectorPtr geographic_projector_;
+  size_t number_of_threads_;
+  int image_selector_type_;
+  //Textured OBJ of the surface model, none if empty or without a page
+  //size.
+  std::string model_path_;
+  int model_page_size_;
+  //Polygon in the georeferenced frame, the whole surface if empty. Only
+  //the split DEM and DOM tiles over it are regenerated, in place of those
+  //of an earlier run. COG, web tiles and the textured model cover the
+  //whole surface, a run asking for them with a region fails.
+  RegionPolygon region_;
   
 };
 typedef std::shared_ptr<TextureConfig> TextureConfigPtr;
@@ -112,7 +165,9 @@ private:
   typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
   typedef std::array<size_t, 3> Triangle;
   typedef std::vector<Triangle> TriangleContainer;
-  typedef EIGEN_VECTOR(Scalar, 2) PlanarPoint;
+
+  //Fails on a region with an output it cannot update in place.
+  int CheckRegionOutputs(WorkflowStepConfig* config);
 
   int LoadSurfaceModel(WorkflowStepConfig* config,
                        VertexContainer& vertices,
@@ -126,6 +181,23 @@ private:
                   const VertexContainer& vertices,
                   const TriangleContainer& triangles);
 
+  int GenerateModel(WorkflowStepConfig* config,
+                    const VertexContainer& vertices,
+                    const TriangleContainer& triangles);
+
+  /**
+   *  Grid of a raster at path and the tiles to rasterize. Without a region
+   *  the grid is computed and kept next to path, so that a later run
+   *  restricted to a region rewrites the very same tiles. tile_ids is left
+   *  empty for every tile. A region run fails without the kept grid.
+   */
+  int PrepareRasterGrid(const TextureConfig& texture_config,
+                        const VertexContainer& vertices,
+                        Scalar scale_x, Scalar scale_y,
+                        size_t tile_width, size_t tile_height,
+                        const std::string& path,
+                        RasterGrid& grid, std::vector<size_t>& tile_ids);
+
 protected:
   virtual int RunImplement(WorkflowStepConfig* config);
 };
@@ -0,0 +1,78 @@
+#include <fstream>
+#include <iomanip>
+
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/texture/split_jpg_tile_sink.hpp"
+#include "workflow/texture/split_tile_path.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+SplitJpgTileSink::SplitJpgTileSink(const std::string& path)
+  : path_(path)
+  , channels_(0)
+{
+}
+
+int SplitJpgTileSink::Open(const RasterGrid& grid, size_t channels,
+                           uint8_t no_data)
+{
+  (void)no_data;
+  if (channels == 0) return -1;
+  grid_ = grid;
+  channels_ = channels;
+  return 0;
+}
+
+int SplitJpgTileSink::Write(const Tile& tile)
+{
+  typedef hs::imgio::whole::ImageData ImageData;
+
+  if (tile.channels != channels_) return -1;
+  //Gray stays gray, anything with color is written as RGB.
+  int channels = channels_ >= 3 ? 3 : 1;
+  ImageData image_data;
+  image_data.CreateImage(int(tile.width), int(tile.height), channels);
+  for (size_t row = 0; row < tile.height; row++)
+  {
+    for (size_t column = 0; column < tile.width; column++)
+    {
+      const uint8_t* pixel =
+        &tile.pixels[(row * tile.width + column) * tile.channels];
+      for (int k = 0; k < channels; k++)
+      {
+        image_data.GetByte(int(row), int(column), k) = pixel[k];
+      }
+    }
+  }
+  std::string tile_path = SplitTilePath(path_, tile.row, tile.column);
+  hs::imgio::whole::ImageIO image_io;
+  if (image_io.SaveImage(tile_path, image_data) != 0) return -1;
+
+  //World file: pixel size, rotation terms, then the top left pixel centre.
+  std::ofstream world_file(ReplaceExtension(tile_path, ".jgw"));
+  if (!world_file) return -1;
+  world_file << std::setprecision(17)
+             << grid_.scale_x << "\n"
+             << 0.0 << "\n"
+             << 0.0 << "\n"
+             << -grid_.scale_y << "\n"
+             << grid_.TileLeft(tile.column) + 0.5 * grid_.scale_x << "\n"
+             << grid_.TileTop(tile.row) - 0.5 * grid_.scale_y << "\n";
+  return world_file ? 0 : -1;
+}
+
+int SplitJpgTileSink::Close()
+{
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,41 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_JPG_TILE_SINK_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_JPG_TILE_SINK_HPP_
+
+#include <cstdint>
+#include <string>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/raster_tile.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes each 8 bit tile as its own JPEG next to path, with a world file
+ *  for its georeference. Alpha is dropped, no data pixels stay black.
+ */
+class HS_EXPORT SplitJpgTileSink : public RasterTileSink<uint8_t>
+{
+public:
+  SplitJpgTileSink(const std::string& path);
+
+  virtual int Open(const RasterGrid& grid, size_t channels, uint8_t no_data);
+  virtual int Write(const Tile& tile);
+  virtual int Close();
+
+private:
+  std::string path_;
+  RasterGrid grid_;
+  size_t channels_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_TIFF_TILE_SINK_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_TIFF_TILE_SINK_HPP_
+
+#include <string>
+
+#include "workflow/texture/raster_tile.hpp"
+#include "workflow/texture/split_tile_path.hpp"
+#include "workflow/texture/tiff_writer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes each tile as its own georeferenced TIFF next to path.
+ */
+template <typename T>
+class SplitTiffTileSink : public RasterTileSink<T>
+{
+public:
+  typedef typename RasterTileSink<T>::Tile Tile;
+
+  //epsg_code is the projected system of the grid, 0 if unknown.
+  SplitTiffTileSink(const std::string& path, int epsg_code = 0)
+    : path_(path), epsg_code_(epsg_code), channels_(0), no_data_(0) {}
+
+  virtual int Open(const RasterGrid& grid, size_t channels, T no_data)
+  {
+    grid_ = grid;
+    channels_ = channels;
+    no_data_ = no_data;
+    return 0;
+  }
+
+  virtual int Write(const Tile& tile)
+  {
+    if (tile.channels != channels_) return -1;
+    TiffImage image;
+    image.width = tile.width;
+    image.height = tile.height;
+    image.channels = tile.channels;
+    image.sample_type = TiffSampleTraits<T>::type;
+    image.pixels = tile.pixels.data();
+    image.georeferenced = true;
+    image.left = grid_.TileLeft(tile.column);
+    image.top = grid_.TileTop(tile.row);
+    image.scale_x = grid_.scale_x;
+    image.scale_y = grid_.scale_y;
+    image.epsg_code = epsg_code_;
+    //Color tiles mark empty pixels with their alpha instead.
+    image.has_no_data = tile.channels == 1;
+    image.no_data = double(no_data_);
+    return WriteTiff(SplitTilePath(path_, tile.row, tile.column), image);
+  }
+
+  virtual int Close()
+  {
+    return 0;
+  }
+
+private:
+  std::string path_;
+  int epsg_code_;
+  RasterGrid grid_;
+  size_t channels_;
+  T no_data_;
+};
+
+}
+}
+}
+
+#endif
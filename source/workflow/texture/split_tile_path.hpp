@@ -0,0 +1,52 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_TILE_PATH_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_SPLIT_TILE_PATH_HPP_
+
+#include <cstdio>
+#include <string>
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+//Position of the extension dot of the file name, npos if it has none.
+inline size_t ExtensionPosition(const std::string& path)
+{
+  size_t separator = path.find_last_of("/\\");
+  size_t dot = path.find_last_of('.');
+  if (dot == std::string::npos ||
+      (separator != std::string::npos && dot < separator))
+  {
+    return std::string::npos;
+  }
+  return dot;
+}
+
+inline std::string ReplaceExtension(const std::string& path,
+                                    const std::string& extension)
+{
+  return path.substr(0, ExtensionPosition(path)) + extension;
+}
+
+//<stem>_<row>_<column><extension> for path <stem><extension>.
+inline std::string SplitTilePath(const std::string& path,
+                                 size_t row, size_t column)
+{
+  char suffix[64];
+  std::snprintf(suffix, sizeof(suffix), "_%llu_%llu",
+                (unsigned long long)row, (unsigned long long)column);
+  size_t dot = ExtensionPosition(path);
+  if (dot == std::string::npos)
+  {
+    return path + suffix;
+  }
+  return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,537 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <mutex>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/texture_atlas.hpp"
+#include "workflow/texture/view_label_smoother.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TextureAtlasGenerator Generator;
+typedef Generator::Scalar Scalar;
+typedef Generator::VertexContainer VertexContainer;
+typedef Generator::TriangleContainer TriangleContainer;
+typedef Generator::ImageParams ImageParams;
+typedef Generator::ImageParamsContainer ImageParamsContainer;
+typedef hs::recon::workflow::ViewLabelSmoother Smoother;
+typedef hs::recon::workflow::PhotoTileCache PhotoCache;
+typedef hs::recon::workflow::PhotoTileSampler PhotoSampler;
+typedef hs::recon::workflow::AtlasPage AtlasPage;
+typedef hs::recon::workflow::TexturedMesh TexturedMesh;
+typedef hs::sfm::ProjectiveFunctions<Scalar> ProjectiveFunctions;
+typedef EIGEN_VECTOR(Scalar, 2) Key;
+typedef EIGEN_STD_VECTOR(Key) KeyContainer;
+
+const int MAX_LEVEL = 8;
+const size_t CHART_BLOCK = 16;
+//Texels of the photo kept around each chart.
+const size_t CHART_MARGIN = 2;
+//Texels the charts are grown by over the empty ones.
+const size_t GUTTER_WIDTH = 4;
+
+/**
+ *  Connected triangles textured from one photo, cut from the photo box
+ *  [origin, origin + extent / scale) and placed on a page with the margin
+ *  around it.
+ */
+struct Chart
+{
+  size_t image_id;
+  std::vector<size_t> triangles;
+  //Vertices in ascending order with their keys in the photo.
+  std::vector<size_t> vertices;
+  KeyContainer keys;
+  Scalar origin_x;
+  Scalar origin_y;
+  Scalar scale;
+  int level;
+  size_t width;
+  size_t height;
+  size_t page;
+  size_t left;
+  size_t top;
+};
+
+//Projects the charts and sizes them.
+struct ChartWorker
+{
+  ChartWorker(const ImageParamsContainer& images_,
+              const VertexContainer& vertices_,
+              const TriangleContainer& triangles_,
+              size_t page_size_,
+              std::vector<Chart>& charts_)
+    : images(images_)
+    , vertices(vertices_)
+    , triangles(triangles_)
+    , page_size(page_size_)
+    , charts(charts_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      Measure(charts[i]);
+    }
+  }
+
+  void Measure(Chart& chart) const
+  {
+    const ImageParams& image = images[chart.image_id];
+    for (size_t k = 0; k < chart.triangles.size(); k++)
+    {
+      const TriangleContainer::value_type& triangle =
+        triangles[chart.triangles[k]];
+      chart.vertices.insert(chart.vertices.end(),
+                            triangle.begin(), triangle.end());
+    }
+    std::sort(chart.vertices.begin(), chart.vertices.end());
+    chart.vertices.erase(std::unique(chart.vertices.begin(),
+                                     chart.vertices.end()),
+                         chart.vertices.end());
+
+    //Corners reaching out of the photo are pulled onto its border.
+    Scalar width = Scalar(image.image_width);
+    Scalar height = Scalar(image.image_height);
+    Key min_key(width, height);
+    Key max_key(0, 0);
+    chart.keys.resize(chart.vertices.size());
+    for (size_t k = 0; k < chart.vertices.size(); k++)
+    {
+      Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                  image.intrinsic_params, image.extrinsic_params,
+                  vertices[chart.vertices[k]]);
+      if (!std::isfinite(key[0]) || !std::isfinite(key[1]))
+      {
+        key.setZero();
+      }
+      key[0] = std::min(std::max(key[0], Scalar(0)), width);
+      key[1] = std::min(std::max(key[1], Scalar(0)), height);
+      chart.keys[k] = key;
+      min_key = min_key.cwiseMin(key);
+      max_key = max_key.cwiseMax(key);
+    }
+
+    //Whole photo pixels, so that charts at full scale are not resampled.
+    chart.origin_x = std::floor(min_key[0]);
+    chart.origin_y = std::floor(min_key[1]);
+    Scalar extent_x = std::max(std::ceil(max_key[0]) - chart.origin_x,
+                               Scalar(1));
+    Scalar extent_y = std::max(std::ceil(max_key[1]) - chart.origin_y,
+                               Scalar(1));
+    size_t inner_size = page_size - 2 * CHART_MARGIN;
+    chart.scale = std::min(Scalar(1),
+                           Scalar(inner_size) / std::max(extent_x, extent_y));
+    chart.level = 0;
+    while (chart.level < MAX_LEVEL &&
+           Scalar(size_t(2) << chart.level) * chart.scale <= 1)
+    {
+      chart.level++;
+    }
+    chart.width = std::min(size_t(std::ceil(extent_x * chart.scale)),
+                           inner_size) + 2 * CHART_MARGIN;
+    chart.height = std::min(size_t(std::ceil(extent_y * chart.scale)),
+                            inner_size) + 2 * CHART_MARGIN;
+  }
+
+  const ImageParamsContainer& images;
+  const VertexContainer& vertices;
+  const TriangleContainer& triangles;
+  size_t page_size;
+  std::vector<Chart>& charts;
+};
+
+struct ChartTaller
+{
+  ChartTaller(const std::vector<Chart>& charts_) : charts(charts_) {}
+
+  bool operator() (size_t first, size_t second) const
+  {
+    if (charts[first].height != charts[second].height)
+    {
+      return charts[first].height > charts[second].height;
+    }
+    if (charts[first].width != charts[second].width)
+    {
+      return charts[first].width > charts[second].width;
+    }
+    return first < second;
+  }
+
+  const std::vector<Chart>& charts;
+};
+
+struct ChartImageLess
+{
+  ChartImageLess(const std::vector<Chart>& charts_) : charts(charts_) {}
+
+  bool operator() (size_t first, size_t second) const
+  {
+    if (charts[first].image_id != charts[second].image_id)
+    {
+      return charts[first].image_id < charts[second].image_id;
+    }
+    return first < second;
+  }
+
+  const std::vector<Chart>& charts;
+};
+
+/**
+ *  Cuts the charts from their photos onto the pages, margin included.
+ *  Charts do not overlap, so each texel is written by one thread.
+ */
+struct FillWorker
+{
+  FillWorker(const std::vector<Chart>& charts_,
+             const std::vector<size_t>& fill_order_,
+             PhotoCache& photos_,
+             hs::progress::ProgressManager* progress_manager_,
+             std::vector<AtlasPage>& pages_,
+             std::vector<std::vector<uint8_t> >& masks_)
+    : charts(charts_)
+    , fill_order(fill_order_)
+    , photos(photos_)
+    , progress_manager(progress_manager_)
+    , pages(pages_)
+    , masks(masks_)
+    , number_of_filled(0)
+    , cancelled(false) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    PhotoSampler sampler(photos);
+    for (size_t position = begin; position < end; position++)
+    {
+      if (cancelled) return;
+      Fill(charts[fill_order[position]], sampler);
+      sampler.Clear();
+      Report();
+    }
+  }
+
+  void Fill(const Chart& chart, PhotoSampler& sampler)
+  {
+    AtlasPage& page = pages[chart.page];
+    std::vector<uint8_t>& mask = masks[chart.page];
+    for (size_t row = 0; row < chart.height; row++)
+    {
+      Scalar y = chart.origin_y +
+                 (Scalar(row) + 0.5 - Scalar(CHART_MARGIN)) / chart.scale;
+      for (size_t column = 0; column < chart.width; column++)
+      {
+        Scalar x = chart.origin_x +
+                   (Scalar(column) + 0.5 - Scalar(CHART_MARGIN)) /
+                   chart.scale;
+        size_t texel_id = (chart.top + row) * page.width +
+                          chart.left + column;
+        if (sampler.Color(chart.image_id, chart.level, x, y,
+                          &page.pixels[texel_id * 3]))
+        {
+          mask[texel_id] = 1;
+        }
+      }
+    }
+  }
+
+  void Report()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    number_of_filled++;
+    if (!progress_manager) return;
+    if (!progress_manager->CheckKeepWorking())
+    {
+      cancelled = true;
+      return;
+    }
+    progress_manager->SetCurrentSubProgressCompleteRatio(
+      float(number_of_filled) / float(fill_order.size()));
+  }
+
+  const std::vector<Chart>& charts;
+  const std::vector<size_t>& fill_order;
+  PhotoCache& photos;
+  hs::progress::ProgressManager* progress_manager;
+  std::vector<AtlasPage>& pages;
+  std::vector<std::vector<uint8_t> >& masks;
+  std::mutex mutex;
+  size_t number_of_filled;
+  std::atomic<bool> cancelled;
+};
+
+/**
+ *  One step of growing the filled texels of a page: each empty texel next
+ *  to filled ones takes their mean. Reads only texels filled before the
+ *  step, so rows can be grown concurrently.
+ */
+struct GrowWorker
+{
+  GrowWorker(const std::vector<uint8_t>& mask_,
+             std::vector<uint8_t>& grown_mask_,
+             AtlasPage& page_)
+    : mask(mask_)
+    , grown_mask(grown_mask_)
+    , page(page_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t row = begin; row < end; row++)
+    {
+      for (size_t column = 0; column < page.width; column++)
+      {
+        size_t texel_id = row * page.width + column;
+        grown_mask[texel_id] = mask[texel_id];
+        if (mask[texel_id]) continue;
+        unsigned sums[3] = {0, 0, 0};
+        unsigned count = 0;
+        for (size_t neighbour_row = row > 0 ? row - 1 : row;
+             neighbour_row <= row + 1 && neighbour_row < page.height;
+             neighbour_row++)
+        {
+          for (size_t neighbour_column = column > 0 ? column - 1 : column;
+               neighbour_column <= column + 1 &&
+               neighbour_column < page.width;
+               neighbour_column++)
+          {
+            size_t neighbour_id = neighbour_row * page.width +
+                                  neighbour_column;
+            if (!mask[neighbour_id]) continue;
+            for (int k = 0; k < 3; k++)
+            {
+              sums[k] += page.pixels[neighbour_id * 3 + k];
+            }
+            count++;
+          }
+        }
+        if (count == 0) continue;
+        for (int k = 0; k < 3; k++)
+        {
+          page.pixels[texel_id * 3 + k] =
+            uint8_t((sums[k] + count / 2) / count);
+        }
+        grown_mask[texel_id] = 1;
+      }
+    }
+  }
+
+  const std::vector<uint8_t>& mask;
+  std::vector<uint8_t>& grown_mask;
+  AtlasPage& page;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+TextureAtlasGenerator::TextureAtlasGenerator(size_t number_of_threads,
+                                             size_t page_size,
+                                             Scalar smoothness)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , page_size_(std::max(page_size, 4 * CHART_MARGIN))
+  , smoothness_(smoothness)
+{
+}
+
+int TextureAtlasGenerator::operator() (
+  const ImageParamsContainer& images,
+  PhotoTileCache& photos,
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  TexturedMesh& mesh,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  mesh = TexturedMesh();
+  if (photos.NumberOfPhotos() != images.size()) return -1;
+
+  //Photos seeing each triangle, with costs relative to the best of them.
+  std::vector<size_t> begins;
+  std::vector<size_t> candidates;
+  std::vector<Scalar> scores;
+  if (progress_manager) progress_manager->AddSubProgress(0.3f);
+  VisibilityImageSelector selector(number_of_threads_);
+  if (selector.Score(images, vertices, triangles, begins, candidates, scores,
+                     progress_manager) != 0)
+  {
+    return -1;
+  }
+  if (progress_manager) progress_manager->FinishCurrentSubProgress();
+
+  size_t number_of_triangles = triangles.size();
+  std::vector<size_t> visible_begins(number_of_triangles + 1, 0);
+  std::vector<size_t> visible_candidates;
+  std::vector<Scalar> costs;
+  std::vector<size_t> labels(number_of_triangles, Smoother::NO_LABEL);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    Scalar best_score = 0;
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      if (scores[slot] > best_score)
+      {
+        best_score = scores[slot];
+        labels[i] = candidates[slot];
+      }
+    }
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      if (!(scores[slot] > 0)) continue;
+      visible_candidates.push_back(candidates[slot]);
+      costs.push_back(1 - scores[slot] / best_score);
+    }
+    visible_begins[i + 1] = visible_candidates.size();
+  }
+  if (progress_manager) progress_manager->AddSubProgress(0.1f);
+  Smoother smoother(smoothness_);
+  if (smoother(triangles, visible_begins, visible_candidates, costs, labels,
+               progress_manager) != 0)
+  {
+    return -1;
+  }
+  if (progress_manager) progress_manager->FinishCurrentSubProgress();
+
+  //Charts are the connected triangles of one photo.
+  std::vector<size_t> neighbour_begins;
+  std::vector<size_t> neighbours;
+  TriangleNeighbours(triangles, neighbour_begins, neighbours);
+  std::vector<Chart> charts;
+  std::vector<char> visited(number_of_triangles, 0);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    if (visited[i] || labels[i] == Smoother::NO_LABEL) continue;
+    charts.push_back(Chart());
+    Chart& chart = charts.back();
+    chart.image_id = labels[i];
+    chart.triangles.push_back(i);
+    visited[i] = 1;
+    for (size_t k = 0; k < chart.triangles.size(); k++)
+    {
+      size_t triangle_id = chart.triangles[k];
+      for (size_t j = neighbour_begins[triangle_id];
+           j < neighbour_begins[triangle_id + 1]; j++)
+      {
+        size_t neighbour = neighbours[j];
+        if (visited[neighbour] || labels[neighbour] != chart.image_id)
+        {
+          continue;
+        }
+        visited[neighbour] = 1;
+        chart.triangles.push_back(neighbour);
+      }
+    }
+  }
+  ChartWorker chart_worker(images, vertices, triangles, page_size_, charts);
+  ParallelForDynamic(0, charts.size(), number_of_threads_, CHART_BLOCK,
+                     chart_worker);
+
+  //Rows of charts, tallest first, a new page once a page is full.
+  std::vector<size_t> pack_order(charts.size());
+  for (size_t i = 0; i < charts.size(); i++) pack_order[i] = i;
+  std::sort(pack_order.begin(), pack_order.end(), ChartTaller(charts));
+  size_t cursor_x = 0;
+  size_t row_top = 0;
+  size_t row_height = 0;
+  for (size_t position = 0; position < pack_order.size(); position++)
+  {
+    Chart& chart = charts[pack_order[position]];
+    if (cursor_x + chart.width > page_size_)
+    {
+      row_top += row_height;
+      cursor_x = 0;
+      row_height = 0;
+    }
+    if (mesh.pages.empty() || row_top + chart.height > page_size_)
+    {
+      mesh.pages.push_back(AtlasPage());
+      cursor_x = 0;
+      row_top = 0;
+      row_height = 0;
+    }
+    AtlasPage& page = mesh.pages.back();
+    chart.page = mesh.pages.size() - 1;
+    chart.left = cursor_x;
+    chart.top = row_top;
+    cursor_x += chart.width;
+    row_height = std::max(row_height, chart.height);
+    page.width = std::max(page.width, chart.left + chart.width);
+    page.height = std::max(page.height, chart.top + chart.height);
+  }
+  std::vector<std::vector<uint8_t> > masks(mesh.pages.size());
+  for (size_t i = 0; i < mesh.pages.size(); i++)
+  {
+    AtlasPage& page = mesh.pages[i];
+    page.pixels.assign(page.width * page.height * 3, 0);
+    masks[i].assign(page.width * page.height, 0);
+  }
+
+  //Charts of one photo one after another, while its tiles are cached.
+  std::vector<size_t> fill_order(pack_order);
+  std::sort(fill_order.begin(), fill_order.end(), ChartImageLess(charts));
+  if (progress_manager) progress_manager->AddSubProgress(0.6f);
+  FillWorker fill_worker(charts, fill_order, photos, progress_manager,
+                         mesh.pages, masks);
+  ParallelForDynamic(0, fill_order.size(), number_of_threads_, 1,
+                     fill_worker);
+  if (fill_worker.cancelled) return -1;
+  if (progress_manager) progress_manager->FinishCurrentSubProgress();
+
+  std::vector<uint8_t> grown_mask;
+  for (size_t i = 0; i < mesh.pages.size(); i++)
+  {
+    grown_mask.resize(masks[i].size());
+    for (size_t step = 0; step < GUTTER_WIDTH; step++)
+    {
+      GrowWorker grow_worker(masks[i], grown_mask, mesh.pages[i]);
+      ParallelFor(0, mesh.pages[i].height, number_of_threads_, grow_worker);
+      masks[i].swap(grown_mask);
+    }
+  }
+
+  //Texture coordinates of each chart vertex on its page.
+  mesh.vertices = vertices;
+  mesh.triangles = triangles;
+  TexturedMesh::Triangle no_texcoords = {{0, 0, 0}};
+  mesh.triangle_texcoords.assign(number_of_triangles, no_texcoords);
+  mesh.triangle_pages.assign(number_of_triangles, TexturedMesh::NO_PAGE);
+  for (size_t i = 0; i < charts.size(); i++)
+  {
+    const Chart& chart = charts[i];
+    const AtlasPage& page = mesh.pages[chart.page];
+    size_t first_texcoord = mesh.texcoords.size();
+    for (size_t k = 0; k < chart.vertices.size(); k++)
+    {
+      Scalar x = Scalar(chart.left + CHART_MARGIN) +
+                 (chart.keys[k][0] - chart.origin_x) * chart.scale;
+      Scalar y = Scalar(chart.top + CHART_MARGIN) +
+                 (chart.keys[k][1] - chart.origin_y) * chart.scale;
+      mesh.texcoords.push_back(TexturedMesh::TexCoord(
+        x / Scalar(page.width), 1 - y / Scalar(page.height)));
+    }
+    for (size_t k = 0; k < chart.triangles.size(); k++)
+    {
+      size_t triangle_id = chart.triangles[k];
+      for (int j = 0; j < 3; j++)
+      {
+        size_t position =
+          std::lower_bound(chart.vertices.begin(), chart.vertices.end(),
+                           triangles[triangle_id][j]) -
+          chart.vertices.begin();
+        mesh.triangle_texcoords[triangle_id][j] = first_texcoord + position;
+      }
+      mesh.triangle_pages[triangle_id] = chart.page;
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,74 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TEXTURE_ATLAS_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TEXTURE_ATLAS_HPP_
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/photo_tile_cache.hpp"
+#include "workflow/texture/textured_mesh.hpp"
+#include "workflow/texture/visibility_image_selector.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Textures a mesh from its photos into atlas pages.
+ *
+ *  Each triangle is scored against the photos that see it by a
+ *  VisibilityImageSelector, then the picks are smoothed by a
+ *  ViewLabelSmoother so that neighbouring triangles share photos. Connected
+ *  triangles of the same photo form a chart, cut from that photo at its own
+ *  resolution, or scaled down to fit a page, and packed onto pages in rows.
+ *
+ *  Charts are cut with a margin of the photo around them, and the texels
+ *  left empty are grown over from their neighbours, so that filtering
+ *  across a chart border never reads texels of another chart. Charts are
+ *  filled concurrently, those of one photo one after another, through a
+ *  shared tile cache.
+ */
+class HS_EXPORT TextureAtlasGenerator
+{
+public:
+  typedef VisibilityImageSelector::Scalar Scalar;
+  typedef VisibilityImageSelector::VertexContainer VertexContainer;
+  typedef VisibilityImageSelector::TriangleContainer TriangleContainer;
+  typedef VisibilityImageSelector::ImageParams ImageParams;
+  typedef VisibilityImageSelector::ImageParamsContainer ImageParamsContainer;
+
+  /**
+   *  Pages are at most page_size texels on a side. smoothness is the cost
+   *  of a seam along one edge against data costs in [0, 1), 0 for the best
+   *  scored photo of a triangle.
+   */
+  TextureAtlasGenerator(size_t number_of_threads,
+                        size_t page_size = 4096,
+                        Scalar smoothness = 0.3);
+
+  /**
+   *  photos holds the photos of images in the same order. Triangles no
+   *  photo sees are left untextured.
+   */
+  int operator() (const ImageParamsContainer& images,
+                  PhotoTileCache& photos,
+                  const VertexContainer& vertices,
+                  const TriangleContainer& triangles,
+                  TexturedMesh& mesh,
+                  hs::progress::ProgressManager* progress_manager =
+                    nullptr) const;
+
+private:
+  size_t number_of_threads_;
+  size_t page_size_;
+  Scalar smoothness_;
+};
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,373 @@
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <sstream>
+
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/texture/split_tile_path.hpp"
+#include "workflow/texture/textured_mesh.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TexturedMesh TexturedMesh;
+typedef hs::recon::workflow::AtlasPage AtlasPage;
+typedef hs::imgio::whole::ImageData ImageData;
+
+const size_t NO_TEXCOORD = size_t(-1);
+
+//Directory part of path, with its trailing separator.
+std::string DirectoryOf(const std::string& path)
+{
+  size_t separator = path.find_last_of("/\\");
+  return separator == std::string::npos ?
+         std::string() : path.substr(0, separator + 1);
+}
+
+std::string FileNameOf(const std::string& path)
+{
+  size_t separator = path.find_last_of("/\\");
+  return separator == std::string::npos ?
+         path : path.substr(separator + 1);
+}
+
+std::string PageName(const std::string& stem, size_t page_id)
+{
+  std::ostringstream name;
+  name << stem << "_" << page_id << ".jpg";
+  return name.str();
+}
+
+//The rest of the line after its keyword, without surrounding blanks.
+std::string Argument(std::istringstream& line_stream)
+{
+  std::string argument;
+  std::getline(line_stream, argument);
+  size_t first = argument.find_first_not_of(" \t\r");
+  if (first == std::string::npos) return std::string();
+  size_t last = argument.find_last_not_of(" \t\r");
+  return argument.substr(first, last - first + 1);
+}
+
+int SavePage(const std::string& path, const AtlasPage& page)
+{
+  ImageData image_data;
+  image_data.CreateImage(int(page.width), int(page.height), 3);
+  for (size_t row = 0; row < page.height; row++)
+  {
+    for (size_t column = 0; column < page.width; column++)
+    {
+      const uint8_t* pixel = &page.pixels[(row * page.width + column) * 3];
+      for (int k = 0; k < 3; k++)
+      {
+        image_data.GetByte(int(row), int(column), k) = pixel[k];
+      }
+    }
+  }
+  hs::imgio::whole::ImageIO image_io;
+  return image_io.SaveImage(path, image_data);
+}
+
+int LoadPage(const std::string& path, AtlasPage& page)
+{
+  ImageData image_data;
+  hs::imgio::whole::ImageIO image_io;
+  if (image_io.LoadImage(path, image_data) != 0) return -1;
+  int channels = image_data.channel();
+  if (image_data.width() <= 0 || image_data.height() <= 0 || channels <= 0)
+  {
+    return -1;
+  }
+  page.width = size_t(image_data.width());
+  page.height = size_t(image_data.height());
+  page.pixels.resize(page.width * page.height * 3);
+  for (size_t row = 0; row < page.height; row++)
+  {
+    for (size_t column = 0; column < page.width; column++)
+    {
+      uint8_t* pixel = &page.pixels[(row * page.width + column) * 3];
+      for (int k = 0; k < 3; k++)
+      {
+        pixel[k] = image_data.GetByte(int(row), int(column),
+                                      channels >= 3 ? k : 0);
+      }
+    }
+  }
+  return 0;
+}
+
+//Materials with a loadable map_Kd become pages.
+void LoadMaterials(const std::string& path,
+                   std::map<std::string, size_t>& material_pages,
+                   std::vector<AtlasPage>& pages)
+{
+  std::ifstream material_file(path);
+  if (!material_file) return;
+  std::string material;
+  std::string line;
+  while (std::getline(material_file, line))
+  {
+    std::istringstream line_stream(line);
+    std::string keyword;
+    line_stream >> keyword;
+    if (keyword == "newmtl")
+    {
+      material = Argument(line_stream);
+    }
+    else if (keyword == "map_Kd" && !material.empty() &&
+             material_pages.find(material) == material_pages.end())
+    {
+      AtlasPage page;
+      if (LoadPage(DirectoryOf(path) + Argument(line_stream), page) == 0)
+      {
+        material_pages[material] = pages.size();
+        pages.push_back(page);
+      }
+    }
+  }
+}
+
+/**
+ *  One corner of a face, "v", "v/vt", "v//vn" or "v/vt/vn", 1 based or
+ *  negative from the end. texcoord_id is NO_TEXCOORD when absent.
+ */
+bool ParseCorner(const std::string& corner,
+                 size_t number_of_vertices, size_t number_of_texcoords,
+                 size_t& vertex_id, size_t& texcoord_id)
+{
+  const char* begin = corner.c_str();
+  char* end = nullptr;
+  long vertex = std::strtol(begin, &end, 10);
+  if (end == begin) return false;
+  vertex_id = vertex > 0 ? size_t(vertex - 1) :
+              number_of_vertices - size_t(-vertex);
+  if (vertex == 0 || vertex_id >= number_of_vertices) return false;
+
+  texcoord_id = NO_TEXCOORD;
+  if (*end != '/' || end[1] == '/' || end[1] == '\0') return true;
+  begin = end + 1;
+  long texcoord = std::strtol(begin, &end, 10);
+  if (end == begin) return true;
+  texcoord_id = texcoord > 0 ? size_t(texcoord - 1) :
+                number_of_texcoords - size_t(-texcoord);
+  return texcoord != 0 && texcoord_id < number_of_texcoords;
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+const size_t TexturedMesh::NO_PAGE;
+
+AtlasPage::AtlasPage()
+  : width(0)
+  , height(0)
+{
+}
+
+int SaveTexturedMesh(const std::string& path, const TexturedMesh& mesh)
+{
+  size_t number_of_triangles = mesh.triangles.size();
+  if (mesh.triangle_texcoords.size() != number_of_triangles ||
+      mesh.triangle_pages.size() != number_of_triangles)
+  {
+    return -1;
+  }
+  for (size_t i = 0; i < mesh.pages.size(); i++)
+  {
+    if (mesh.pages[i].pixels.size() !=
+        mesh.pages[i].width * mesh.pages[i].height * 3)
+    {
+      return -1;
+    }
+  }
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    size_t page_id = mesh.triangle_pages[i];
+    for (int j = 0; j < 3; j++)
+    {
+      if (mesh.triangles[i][j] >= mesh.vertices.size()) return -1;
+      if (page_id != TexturedMesh::NO_PAGE &&
+          mesh.triangle_texcoords[i][j] >= mesh.texcoords.size())
+      {
+        return -1;
+      }
+    }
+    if (page_id != TexturedMesh::NO_PAGE && page_id >= mesh.pages.size())
+    {
+      return -1;
+    }
+  }
+
+  std::string directory = DirectoryOf(path);
+  std::string material_name = FileNameOf(ReplaceExtension(path, ".mtl"));
+  std::string stem = FileNameOf(ReplaceExtension(path, ""));
+  {
+    std::ofstream material_file(directory + material_name);
+    if (!material_file) return -1;
+    for (size_t i = 0; i < mesh.pages.size(); i++)
+    {
+      if (SavePage(directory + PageName(stem, i), mesh.pages[i]) != 0)
+      {
+        return -1;
+      }
+      material_file << "newmtl page_" << i << "\n"
+                    << "Ka 1 1 1\n"
+                    << "Kd 1 1 1\n"
+                    << "d 1\n"
+                    << "illum 1\n"
+                    << "map_Kd " << PageName(stem, i) << "\n\n";
+    }
+    if (!material_file) return -1;
+  }
+
+  std::ofstream obj_file(path);
+  if (!obj_file) return -1;
+  obj_file << "mtllib " << material_name << "\n";
+  //Georeferenced coordinates need their millimetres.
+  obj_file << std::setprecision(15);
+  for (size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    const TexturedMesh::Vertex& vertex = mesh.vertices[i];
+    obj_file << "v " << vertex[0] << " " << vertex[1] << " " << vertex[2]
+             << "\n";
+  }
+  obj_file << std::setprecision(8);
+  for (size_t i = 0; i < mesh.texcoords.size(); i++)
+  {
+    obj_file << "vt " << mesh.texcoords[i][0] << " " << mesh.texcoords[i][1]
+             << "\n";
+  }
+
+  //Triangles grouped by page + 1, which wraps NO_PAGE round to the first
+  //group.
+  std::vector<size_t> page_begins(mesh.pages.size() + 2, 0);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    page_begins[mesh.triangle_pages[i] + 2]++;
+  }
+  for (size_t i = 0; i + 1 < page_begins.size(); i++)
+  {
+    page_begins[i + 1] += page_begins[i];
+  }
+  std::vector<size_t> order(number_of_triangles);
+  std::vector<size_t> page_ends(page_begins.begin(), page_begins.end() - 1);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    order[page_ends[mesh.triangle_pages[i] + 1]++] = i;
+  }
+  for (size_t position = 0; position < number_of_triangles; position++)
+  {
+    size_t triangle_id = order[position];
+    size_t page_id = mesh.triangle_pages[triangle_id];
+    const TexturedMesh::Triangle& triangle = mesh.triangles[triangle_id];
+    if (page_id == TexturedMesh::NO_PAGE)
+    {
+      obj_file << "f " << triangle[0] + 1 << " " << triangle[1] + 1 << " "
+               << triangle[2] + 1 << "\n";
+      continue;
+    }
+    if (position == page_begins[page_id + 1])
+    {
+      obj_file << "usemtl page_" << page_id << "\n";
+    }
+    const TexturedMesh::Triangle& texcoords =
+      mesh.triangle_texcoords[triangle_id];
+    obj_file << "f " << triangle[0] + 1 << "/" << texcoords[0] + 1 << " "
+             << triangle[1] + 1 << "/" << texcoords[1] + 1 << " "
+             << triangle[2] + 1 << "/" << texcoords[2] + 1 << "\n";
+  }
+  return obj_file ? 0 : -1;
+}
+
+int LoadTexturedMesh(const std::string& path, TexturedMesh& mesh)
+{
+  mesh = TexturedMesh();
+  std::ifstream obj_file(path);
+  if (!obj_file) return -1;
+
+  std::map<std::string, size_t> material_pages;
+  size_t page_id = TexturedMesh::NO_PAGE;
+  std::vector<size_t> vertex_ids;
+  std::vector<size_t> texcoord_ids;
+  std::string line;
+  while (std::getline(obj_file, line))
+  {
+    std::istringstream line_stream(line);
+    std::string keyword;
+    line_stream >> keyword;
+    if (keyword == "v")
+    {
+      TexturedMesh::Vertex vertex;
+      if (!(line_stream >> vertex[0] >> vertex[1] >> vertex[2])) return -1;
+      mesh.vertices.push_back(vertex);
+    }
+    else if (keyword == "vt")
+    {
+      TexturedMesh::TexCoord texcoord;
+      if (!(line_stream >> texcoord[0] >> texcoord[1])) return -1;
+      mesh.texcoords.push_back(texcoord);
+    }
+    else if (keyword == "mtllib")
+    {
+      LoadMaterials(DirectoryOf(path) + Argument(line_stream),
+                    material_pages, mesh.pages);
+    }
+    else if (keyword == "usemtl")
+    {
+      auto itr_page = material_pages.find(Argument(line_stream));
+      page_id = itr_page == material_pages.end() ?
+                TexturedMesh::NO_PAGE : itr_page->second;
+    }
+    else if (keyword == "f")
+    {
+      vertex_ids.clear();
+      texcoord_ids.clear();
+      bool textured = page_id != TexturedMesh::NO_PAGE;
+      std::string corner;
+      while (line_stream >> corner)
+      {
+        size_t vertex_id;
+        size_t texcoord_id;
+        if (!ParseCorner(corner, mesh.vertices.size(), mesh.texcoords.size(),
+                         vertex_id, texcoord_id))
+        {
+          return -1;
+        }
+        textured = textured && texcoord_id != NO_TEXCOORD;
+        vertex_ids.push_back(vertex_id);
+        texcoord_ids.push_back(texcoord_id);
+      }
+      if (vertex_ids.size() < 3) return -1;
+      for (size_t i = 1; i + 1 < vertex_ids.size(); i++)
+      {
+        TexturedMesh::Triangle triangle =
+          {{vertex_ids[0], vertex_ids[i], vertex_ids[i + 1]}};
+        TexturedMesh::Triangle texcoords = {{0, 0, 0}};
+        if (textured)
+        {
+          texcoords[0] = texcoord_ids[0];
+          texcoords[1] = texcoord_ids[i];
+          texcoords[2] = texcoord_ids[i + 1];
+        }
+        mesh.triangles.push_back(triangle);
+        mesh.triangle_texcoords.push_back(texcoords);
+        mesh.triangle_pages.push_back(textured ?
+                                      page_id : TexturedMesh::NO_PAGE);
+      }
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
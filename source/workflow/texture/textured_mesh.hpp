@@ -0,0 +1,76 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TEXTURED_MESH_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TEXTURED_MESH_HPP_
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  One texture image of an atlas, RGB row major, top row first.
+ */
+struct HS_EXPORT AtlasPage
+{
+  AtlasPage();
+
+  size_t width;
+  size_t height;
+  std::vector<uint8_t> pixels;
+};
+
+/**
+ *  Triangle mesh whose triangles are textured from atlas pages. Texture
+ *  coordinates are in [0, 1] over their page, v pointing up as in OBJ.
+ */
+struct HS_EXPORT TexturedMesh
+{
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef std::array<size_t, 3> Triangle;
+  typedef std::vector<Triangle> TriangleContainer;
+  typedef EIGEN_VECTOR(Scalar, 2) TexCoord;
+  typedef EIGEN_STD_VECTOR(TexCoord) TexCoordContainer;
+
+  //Page of triangles no photo sees.
+  static const size_t NO_PAGE = size_t(-1);
+
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  TexCoordContainer texcoords;
+  //Texture coordinates of the corners of each triangle.
+  TriangleContainer triangle_texcoords;
+  std::vector<size_t> triangle_pages;
+  std::vector<AtlasPage> pages;
+};
+
+/**
+ *  Write path as Wavefront OBJ, with the materials in the .mtl beside it
+ *  and page i as <name>_<i>.jpg. Untextured triangles come first, before
+ *  any material is used.
+ */
+HS_EXPORT int SaveTexturedMesh(const std::string& path,
+                               const TexturedMesh& mesh);
+
+/**
+ *  Read an OBJ written by SaveTexturedMesh. Polygons are split into fans
+ *  and faces of materials without a loadable map_Kd are left untextured.
+ */
+HS_EXPORT int LoadTexturedMesh(const std::string& path, TexturedMesh& mesh);
+
+}
+}
+}
+
+#endif
@@ -0,0 +1,665 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <vector>
+
+#include <zlib.h>
+
+#include "workflow/texture/tiff_writer.hpp"
+
+namespace
+{
+
+using hs::recon::workflow::TiffImage;
+using hs::recon::workflow::TIFF_SAMPLE_FLOAT32;
+
+enum TiffType
+{
+  TIFF_ASCII = 2,
+  TIFF_SHORT = 3,
+  TIFF_LONG = 4,
+  TIFF_DOUBLE = 12,
+  TIFF_LONG8 = 16
+};
+
+void Append(std::vector<char>& buffer, const void* data, size_t size)
+{
+  const char* bytes = static_cast<const char*>(data);
+  buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+//Offsets and counts take 8 bytes in BigTIFF, 4 in classic TIFF.
+void AppendOffset(std::vector<char>& buffer, uint64_t value, bool big)
+{
+  if (big)
+  {
+    Append(buffer, &value, sizeof(value));
+  }
+  else
+  {
+    uint32_t short_value = uint32_t(value);
+    Append(buffer, &short_value, sizeof(short_value));
+  }
+}
+
+/**
+ *  Entries of an image file directory. Values are stored in the host byte
+ *  order, which the header announces.
+ */
+class DirectoryBuilder
+{
+public:
+  explicit DirectoryBuilder(bool big = false) : big_(big) {}
+
+  void AddShorts(uint16_t tag, const std::vector<uint16_t>& values)
+  {
+    Add(tag, TIFF_SHORT, uint32_t(values.size()), &values[0],
+        values.size() * sizeof(uint16_t));
+  }
+
+  void AddShort(uint16_t tag, uint16_t value)
+  {
+    Add(tag, TIFF_SHORT, 1, &value, sizeof(value));
+  }
+
+  void AddLong(uint16_t tag, uint32_t value)
+  {
+    Add(tag, TIFF_LONG, 1, &value, sizeof(value));
+  }
+
+  //Offsets into the file and byte counts, as LONG8 in BigTIFF.
+  void AddOffsets(uint16_t tag, const std::vector<uint64_t>& values)
+  {
+    if (big_)
+    {
+      Add(tag, TIFF_LONG8, uint32_t(values.size()), &values[0],
+          values.size() * sizeof(uint64_t));
+    }
+    else
+    {
+      std::vector<uint32_t> short_values(values.begin(), values.end());
+      Add(tag, TIFF_LONG, uint32_t(values.size()), &short_values[0],
+          values.size() * sizeof(uint32_t));
+    }
+  }
+
+  void AddDoubles(uint16_t tag, const std::vector<double>& values)
+  {
+    Add(tag, TIFF_DOUBLE, uint32_t(values.size()), &values[0],
+        values.size() * sizeof(double));
+  }
+
+  void AddAscii(uint16_t tag, const std::string& value)
+  {
+    Add(tag, TIFF_ASCII, uint32_t(value.size() + 1), value.c_str(),
+        value.size() + 1);
+  }
+
+  //Entries are written by increasing tag, whatever order they came in.
+  std::vector<char> Serialize(uint64_t offset,
+                              uint64_t next_directory = 0) const
+  {
+    std::vector<Entry> entries = entries_;
+    std::stable_sort(entries.begin(), entries.end(), EntryTagLess);
+    size_t field_size = big_ ? 8 : 4;
+    size_t entry_size = big_ ? 20 : 12;
+    uint64_t data_offset = offset + (big_ ? 8 : 2) +
+                           entry_size * entries.size() + field_size;
+    std::vector<char> directory;
+    std::vector<char> data;
+    if (big_)
+    {
+      uint64_t number_of_entries = entries.size();
+      Append(directory, &number_of_entries, sizeof(number_of_entries));
+    }
+    else
+    {
+      uint16_t number_of_entries = uint16_t(entries.size());
+      Append(directory, &number_of_entries, sizeof(number_of_entries));
+    }
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      const Entry& entry = entries[i];
+      Append(directory, &entry.tag, sizeof(entry.tag));
+      Append(directory, &entry.type, sizeof(entry.type));
+      AppendOffset(directory, entry.count, big_);
+      if (entry.value.size() <= field_size)
+      {
+        char inline_value[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        std::memcpy(inline_value, entry.value.data(), entry.value.size());
+        Append(directory, inline_value, field_size);
+      }
+      else
+      {
+        //Values out of line start on a word boundary.
+        if (data.size() % 2) data.push_back(0);
+        AppendOffset(directory, data_offset + data.size(), big_);
+        data.insert(data.end(), entry.value.begin(), entry.value.end());
+      }
+    }
+    AppendOffset(directory, next_directory, big_);
+    directory.insert(directory.end(), data.begin(), data.end());
+    return directory;
+  }
+
+private:
+  struct Entry
+  {
+    uint16_t tag;
+    uint16_t type;
+    uint32_t count;
+    std::vector<char> value;
+  };
+
+  static bool EntryTagLess(const Entry& entry0, const Entry& entry1)
+  {
+    return entry0.tag < entry1.tag;
+  }
+
+  void Add(uint16_t tag, uint16_t type, uint32_t count, const void* value,
+           size_t size)
+  {
+    Entry entry;
+    entry.tag = tag;
+    entry.type = type;
+    entry.count = count;
+    Append(entry.value, value, size);
+    entries_.push_back(entry);
+  }
+
+  bool big_;
+  std::vector<Entry> entries_;
+};
+
+bool LittleEndianHost()
+{
+  uint16_t value = 1;
+  char first;
+  std::memcpy(&first, &value, 1);
+  return first == 1;
+}
+
+size_t BytesPerSample(const TiffImage& image)
+{
+  return image.sample_type == TIFF_SAMPLE_FLOAT32 ? 4 : 1;
+}
+
+void WriteHeader(std::ofstream& file, uint64_t first_directory, bool big)
+{
+  std::vector<char> header;
+  header.push_back(LittleEndianHost() ? 'I' : 'M');
+  header.push_back(header[0]);
+  uint16_t magic = big ? 43 : 42;
+  Append(header, &magic, sizeof(magic));
+  if (big)
+  {
+    //Size of an offset, then a reserved word.
+    uint16_t offset_size = 8;
+    uint16_t reserved = 0;
+    Append(header, &offset_size, sizeof(offset_size));
+    Append(header, &reserved, sizeof(reserved));
+  }
+  AppendOffset(header, first_directory, big);
+  file.write(header.data(), std::streamsize(header.size()));
+}
+
+//Layout of the samples, the same for every level.
+void AddSampleTags(const TiffImage& image, DirectoryBuilder& builder)
+{
+  uint16_t channels = uint16_t(image.channels);
+  bool color = channels >= 3;
+  builder.AddShorts(258, std::vector<uint16_t>(
+    channels, uint16_t(BytesPerSample(image) * 8)));
+  builder.AddShort(262, color ? 2 : 1);
+  builder.AddShort(277, channels);
+  builder.AddShort(284, 1);
+  uint16_t extra_samples = channels - (color ? 3 : 1);
+  if (extra_samples > 0)
+  {
+    //An alpha channel after RGB, anything else is left unspecified.
+    std::vector<uint16_t> extra(extra_samples, 0);
+    if (color) extra[0] = 2;
+    builder.AddShorts(338, extra);
+  }
+  builder.AddShorts(339, std::vector<uint16_t>(
+    channels, image.sample_type == TIFF_SAMPLE_FLOAT32 ? 3 : 1));
+}
+
+//GeoTIFF keys, by increasing id as the key directory wants them.
+enum GeoKey
+{
+  GT_MODEL_TYPE_GEO_KEY = 1024,
+  GT_RASTER_TYPE_GEO_KEY = 1025,
+  PROJECTED_CS_TYPE_GEO_KEY = 3072
+};
+
+const uint16_t MODEL_TYPE_PROJECTED = 1;
+const uint16_t RASTER_PIXEL_IS_AREA = 1;
+//Codes from here up are user defined in GeoTIFF.
+const int USER_DEFINED_CODE = 32767;
+
+//A key held in the directory itself rather than in another tag.
+void AppendGeoKey(std::vector<uint16_t>& directory, uint16_t key,
+                  uint16_t value)
+{
+  directory.push_back(key);
+  directory.push_back(0);
+  directory.push_back(1);
+  directory.push_back(value);
+}
+
+/**
+ *  Pixel scale and tie point of the top left corner, then the key
+ *  directory: a projected frame with pixels covering areas, in the EPSG
+ *  system of the image when it is known.
+ */
+void AddGeoreferenceTags(const TiffImage& image, DirectoryBuilder& builder)
+{
+  if (!image.georeferenced) return;
+  std::vector<double> pixel_scale(3, 0.0);
+  pixel_scale[0] = image.scale_x;
+  pixel_scale[1] = image.scale_y;
+  builder.AddDoubles(33550, pixel_scale);
+  std::vector<double> tie_point(6, 0.0);
+  tie_point[3] = image.left;
+  tie_point[4] = image.top;
+  builder.AddDoubles(33922, tie_point);
+
+  //Version 1.1.0, the key count is filled in last.
+  std::vector<uint16_t> geo_keys;
+  geo_keys.push_back(1);
+  geo_keys.push_back(1);
+  geo_keys.push_back(0);
+  geo_keys.push_back(0);
+  AppendGeoKey(geo_keys, GT_MODEL_TYPE_GEO_KEY, MODEL_TYPE_PROJECTED);
+  AppendGeoKey(geo_keys, GT_RASTER_TYPE_GEO_KEY, RASTER_PIXEL_IS_AREA);
+  if (image.epsg_code > 0 && image.epsg_code < USER_DEFINED_CODE)
+  {
+    AppendGeoKey(geo_keys, PROJECTED_CS_TYPE_GEO_KEY,
+                 uint16_t(image.epsg_code));
+  }
+  geo_keys[3] = uint16_t(geo_keys.size() / 4 - 1);
+  builder.AddShorts(34735, geo_keys);
+}
+
+void AddNoDataTag(const TiffImage& image, DirectoryBuilder& builder)
+{
+  if (!image.has_no_data) return;
+  char no_data[64];
+  std::snprintf(no_data, sizeof(no_data), "%.17g", image.no_data);
+  builder.AddAscii(42113, no_data);
+}
+
+//Pixels of no data, or zero where there is no no data value.
+void EmptyPixels(const TiffImage& image, size_t number_of_pixels,
+                 std::vector<char>& pixels)
+{
+  size_t number_of_samples = number_of_pixels * image.channels;
+  pixels.assign(number_of_samples * BytesPerSample(image), 0);
+  if (!image.has_no_data) return;
+  if (image.sample_type == TIFF_SAMPLE_FLOAT32)
+  {
+    float no_data = float(image.no_data);
+    for (size_t i = 0; i < number_of_samples; i++)
+    {
+      std::memcpy(&pixels[i * sizeof(float)], &no_data, sizeof(float));
+    }
+  }
+  else
+  {
+    std::fill(pixels.begin(), pixels.end(), char(uint8_t(image.no_data)));
+  }
+}
+
+/**
+ *  GDAL reads this from right after the header to trust the layout of a
+ *  cloud optimized file without walking it.
+ */
+std::string StructuralMetadata()
+{
+  std::string layout = "LAYOUT=IFDS_BEFORE_DATA\n"
+                       "BLOCK_ORDER=ROW_MAJOR\n"
+                       "KNOWN_INCOMPATIBLE_EDITION=NO\n";
+  char size[64];
+  std::snprintf(size, sizeof(size),
+                "GDAL_STRUCTURAL_METADATA_SIZE=%06d bytes\n",
+                int(layout.size()));
+  return size + layout;
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+TiffImage::TiffImage()
+  : width(0)
+  , height(0)
+  , channels(1)
+  , sample_type(TIFF_SAMPLE_UINT8)
+  , pixels(nullptr)
+  , georeferenced(false)
+  , left(0)
+  , top(0)
+  , scale_x(1)
+  , scale_y(1)
+  , epsg_code(0)
+  , has_no_data(false)
+  , no_data(0)
+{
+}
+
+int WriteTiff(const std::string& path, const TiffImage& image)
+{
+  if (image.width == 0 || image.height == 0 || image.channels == 0 ||
+      image.pixels == nullptr)
+  {
+    return -1;
+  }
+  uint64_t data_size = uint64_t(image.width) * image.height *
+                       image.channels * BytesPerSample(image);
+  //Classic TIFF addresses 4GB, with room left for the directory.
+  if (data_size > uint64_t(std::numeric_limits<uint32_t>::max()) - 4096)
+  {
+    return -1;
+  }
+
+  const uint32_t data_offset = 8;
+  uint32_t directory_offset = data_offset + uint32_t(data_size);
+  directory_offset += directory_offset % 2;
+
+  DirectoryBuilder builder;
+  builder.AddLong(256, uint32_t(image.width));
+  builder.AddLong(257, uint32_t(image.height));
+  builder.AddShort(259, 1);
+  builder.AddLong(273, data_offset);
+  builder.AddLong(278, uint32_t(image.height));
+  builder.AddLong(279, uint32_t(data_size));
+  AddSampleTags(image, builder);
+  AddGeoreferenceTags(image, builder);
+  AddNoDataTag(image, builder);
+  std::vector<char> directory = builder.Serialize(directory_offset);
+
+  std::ofstream file(path, std::ios::binary);
+  if (!file) return -1;
+  WriteHeader(file, directory_offset, false);
+  file.write(static_cast<const char*>(image.pixels),
+             std::streamsize(data_size));
+  if (data_size % 2) file.put(0);
+  file.write(directory.data(), std::streamsize(directory.size()));
+  return file ? 0 : -1;
+}
+
+CogWriter::CogWriter()
+  : block_size_(0)
+  , blocks_size_(0)
+{
+}
+
+CogWriter::~CogWriter()
+{
+  if (blocks_file_.is_open())
+  {
+    blocks_file_.close();
+    std::remove((path_ + ".blocks").c_str());
+  }
+}
+
+int CogWriter::Open(const std::string& path, const TiffImage& image,
+                    size_t block_size)
+{
+  if (blocks_file_.is_open() || image.width == 0 || image.height == 0 ||
+      image.channels == 0 || block_size == 0 || block_size % 16 != 0)
+  {
+    return -1;
+  }
+  path_ = path;
+  image_ = image;
+  image_.pixels = nullptr;
+  block_size_ = block_size;
+  levels_.clear();
+  size_t width = image.width;
+  size_t height = image.height;
+  while (1)
+  {
+    Level level;
+    level.width = width;
+    level.height = height;
+    level.number_of_columns = (width + block_size - 1) / block_size;
+    size_t number_of_blocks =
+      level.number_of_columns * ((height + block_size - 1) / block_size);
+    level.offsets.assign(number_of_blocks, 0);
+    level.byte_counts.assign(number_of_blocks, 0);
+    levels_.push_back(level);
+    if (width <= block_size && height <= block_size) break;
+    width = (width + 1) / 2;
+    height = (height + 1) / 2;
+  }
+
+  blocks_size_ = 0;
+  blocks_file_.open(path_ + ".blocks", std::ios::binary | std::ios::trunc);
+  return blocks_file_ ? 0 : -1;
+}
+
+size_t CogWriter::NumberOfLevels() const
+{
+  return levels_.size();
+}
+
+size_t CogWriter::LevelWidth(size_t level) const
+{
+  return levels_[level].width;
+}
+
+size_t CogWriter::LevelHeight(size_t level) const
+{
+  return levels_[level].height;
+}
+
+int CogWriter::EncodeBlock(const void* pixels,
+                           std::vector<char>& encoded) const
+{
+  size_t row_size = block_size_ * image_.channels * BytesPerSample(image_);
+  size_t block_bytes = row_size * block_size_;
+  const Bytef* source = static_cast<const Bytef*>(pixels);
+  //Bytes go through the horizontal predictor, each sample stored as the
+  //difference from the one of the pixel to its left.
+  std::vector<Bytef> differences;
+  if (image_.sample_type == TIFF_SAMPLE_UINT8)
+  {
+    differences.assign(source, source + block_bytes);
+    for (size_t row = 0; row < block_size_; row++)
+    {
+      Bytef* row_samples = differences.data() + row * row_size;
+      for (size_t i = row_size - 1; i >= image_.channels; i--)
+      {
+        row_samples[i] = Bytef(row_samples[i] -
+                               row_samples[i - image_.channels]);
+      }
+    }
+    source = differences.data();
+  }
+
+  uLongf encoded_size = compressBound(uLong(block_bytes));
+  encoded.resize(encoded_size);
+  if (compress2(reinterpret_cast<Bytef*>(encoded.data()), &encoded_size,
+                source, uLong(block_bytes), Z_DEFAULT_COMPRESSION) != Z_OK)
+  {
+    return -1;
+  }
+  encoded.resize(encoded_size);
+  return 0;
+}
+
+int CogWriter::WriteBlock(size_t level, size_t block_row,
+                          size_t block_column,
+                          const std::vector<char>& encoded)
+{
+  if (!blocks_file_.is_open() || level >= levels_.size() ||
+      encoded.empty())
+  {
+    return -1;
+  }
+  Level& current = levels_[level];
+  size_t block_id = block_row * current.number_of_columns + block_column;
+  if (block_column >= current.number_of_columns ||
+      block_id >= current.offsets.size() ||
+      current.byte_counts[block_id] != 0)
+  {
+    return -1;
+  }
+  blocks_file_.write(encoded.data(), std::streamsize(encoded.size()));
+  if (!blocks_file_) return -1;
+  current.offsets[block_id] = blocks_size_;
+  current.byte_counts[block_id] = encoded.size();
+  blocks_size_ += encoded.size();
+  return 0;
+}
+
+int CogWriter::Close()
+{
+  if (!blocks_file_.is_open()) return -1;
+  blocks_file_.close();
+  std::string blocks_path = path_ + ".blocks";
+  int result = blocks_file_.fail() ? -1 : WriteLayout(blocks_path);
+  std::remove(blocks_path.c_str());
+  levels_.clear();
+  return result;
+}
+
+std::vector<char> CogWriter::LevelDirectory(
+  const std::vector<uint64_t>& offsets,
+  const std::vector<uint64_t>& byte_counts, size_t level, bool big,
+  uint64_t offset, uint64_t next_directory) const
+{
+  DirectoryBuilder builder(big);
+  //Levels past the first are reduced resolution copies of it.
+  if (level > 0) builder.AddLong(254, 1);
+  builder.AddLong(256, uint32_t(levels_[level].width));
+  builder.AddLong(257, uint32_t(levels_[level].height));
+  builder.AddShort(259, 8);
+  if (image_.sample_type == TIFF_SAMPLE_UINT8) builder.AddShort(317, 2);
+  builder.AddLong(322, uint32_t(block_size_));
+  builder.AddLong(323, uint32_t(block_size_));
+  builder.AddOffsets(324, offsets);
+  builder.AddOffsets(325, byte_counts);
+  AddSampleTags(image_, builder);
+  if (level == 0) AddGeoreferenceTags(image_, builder);
+  AddNoDataTag(image_, builder);
+  return builder.Serialize(offset, next_directory);
+}
+
+int CogWriter::WriteLayout(const std::string& blocks_path) const
+{
+  //Readers other than GDAL reject blocks left out, so those never written
+  //get a copy of one block of no data each.
+  std::vector<char> empty_block;
+  {
+    std::vector<char> pixels;
+    EmptyPixels(image_, block_size_ * block_size_, pixels);
+    if (EncodeBlock(pixels.data(), empty_block) != 0) return -1;
+  }
+
+  std::string metadata = StructuralMetadata();
+  size_t number_of_levels = levels_.size();
+  std::vector<std::vector<uint64_t> > byte_counts(number_of_levels);
+  for (size_t level = 0; level < number_of_levels; level++)
+  {
+    byte_counts[level] = levels_[level].byte_counts;
+    for (size_t i = 0; i < byte_counts[level].size(); i++)
+    {
+      if (byte_counts[level][i] == 0)
+      {
+        byte_counts[level][i] = empty_block.size();
+      }
+    }
+  }
+  std::vector<std::vector<uint64_t> > offsets(number_of_levels);
+  std::vector<uint64_t> directory_offsets(number_of_levels);
+  std::vector<std::vector<char> > directories(number_of_levels);
+
+  //Lay the directories out with placeholder offsets, whose size does not
+  //depend on their value, then the blocks after them, coarsest first.
+  bool big = false;
+  while (1)
+  {
+    uint64_t offset = (big ? 16 : 8) + metadata.size();
+    for (size_t level = 0; level < number_of_levels; level++)
+    {
+      offset += offset % 2;
+      directory_offsets[level] = offset;
+      offsets[level].assign(levels_[level].offsets.size(), 0);
+      offset += LevelDirectory(offsets[level], byte_counts[level], level,
+                               big, 0, 0).size();
+    }
+    for (size_t level = number_of_levels; level-- > 0;)
+    {
+      for (size_t i = 0; i < byte_counts[level].size(); i++)
+      {
+        offsets[level][i] = offset;
+        offset += byte_counts[level][i];
+      }
+    }
+    if (big || offset <= uint64_t(std::numeric_limits<uint32_t>::max()))
+    {
+      break;
+    }
+    big = true;
+  }
+
+  for (size_t level = 0; level < number_of_levels; level++)
+  {
+    uint64_t next_directory =
+      level + 1 < number_of_levels ? directory_offsets[level + 1] : 0;
+    directories[level] = LevelDirectory(offsets[level], byte_counts[level],
+                                        level, big,
+                                        directory_offsets[level],
+                                        next_directory);
+  }
+
+  std::ofstream file(path_, std::ios::binary);
+  std::ifstream blocks_file(blocks_path, std::ios::binary);
+  if (!file || !blocks_file) return -1;
+  WriteHeader(file, directory_offsets[0], big);
+  file.write(metadata.data(), std::streamsize(metadata.size()));
+  uint64_t position = (big ? 16 : 8) + metadata.size();
+  for (size_t level = 0; level < number_of_levels; level++)
+  {
+    if (position % 2)
+    {
+      file.put(0);
+      position++;
+    }
+    file.write(directories[level].data(),
+               std::streamsize(directories[level].size()));
+    position += directories[level].size();
+  }
+  std::vector<char> block;
+  for (size_t level = number_of_levels; level-- > 0;)
+  {
+    const Level& current = levels_[level];
+    for (size_t i = 0; i < current.byte_counts.size(); i++)
+    {
+      if (current.byte_counts[i] == 0)
+      {
+        file.write(empty_block.data(), std::streamsize(empty_block.size()));
+        continue;
+      }
+      block.resize(size_t(current.byte_counts[i]));
+      blocks_file.seekg(std::streamoff(current.offsets[i]));
+      blocks_file.read(block.data(), std::streamsize(block.size()));
+      file.write(block.data(), std::streamsize(block.size()));
+    }
+  }
+  return file && blocks_file ? 0 : -1;
+}
+
+}
+}
+}
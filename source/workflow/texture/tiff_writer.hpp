@@ -0,0 +1,137 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TIFF_WRITER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TIFF_WRITER_HPP_
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+enum TiffSampleType
+{
+  TIFF_SAMPLE_UINT8 = 0,
+  TIFF_SAMPLE_FLOAT32
+};
+
+template <typename T> struct TiffSampleTraits;
+
+template <>
+struct TiffSampleTraits<uint8_t>
+{
+  static const TiffSampleType type = TIFF_SAMPLE_UINT8;
+};
+
+template <>
+struct TiffSampleTraits<float>
+{
+  static const TiffSampleType type = TIFF_SAMPLE_FLOAT32;
+};
+
+struct HS_EXPORT TiffImage
+{
+  TiffImage();
+
+  size_t width;
+  size_t height;
+  size_t channels;
+  TiffSampleType sample_type;
+  //Row major, channels interleaved.
+  const void* pixels;
+  //Written as GeoTIFF pixel scale, tie point and key directory when
+  //georeferenced.
+  bool georeferenced;
+  double left;
+  double top;
+  double scale_x;
+  double scale_y;
+  //Projected coordinate system of left and top, 0 if unknown.
+  int epsg_code;
+  //Written as the GDAL no data tag when has_no_data.
+  bool has_no_data;
+  double no_data;
+};
+
+/**
+ *  Write image as an uncompressed, single strip baseline TIFF.
+ */
+HS_EXPORT int WriteTiff(const std::string& path, const TiffImage& image);
+
+/**
+ *  Writes a Cloud Optimized GeoTIFF: Deflate compressed blocks of
+ *  block_size x block_size pixels, with reduced resolution levels each half
+ *  the size of the one before, down to the first that fits in one block.
+ *  The directories of every level lead the file and the blocks follow,
+ *  coarsest level first, so a reader gets at any level with a few range
+ *  reads.
+ *
+ *  Blocks may be written in any order. They are kept aside in <path>.blocks
+ *  until Close lays the file out, as BigTIFF if it passes 4GB.
+ */
+class HS_EXPORT CogWriter
+{
+public:
+  CogWriter();
+  ~CogWriter();
+
+  /**
+   *  image describes level 0, its pixels are not used. block_size is a
+   *  multiple of 16.
+   */
+  int Open(const std::string& path, const TiffImage& image,
+           size_t block_size);
+
+  size_t NumberOfLevels() const;
+  size_t LevelWidth(size_t level) const;
+  size_t LevelHeight(size_t level) const;
+
+  /**
+   *  Compress a block of block_size x block_size pixels for WriteBlock,
+   *  edge blocks padded out. Safe to call concurrently.
+   */
+  int EncodeBlock(const void* pixels, std::vector<char>& encoded) const;
+
+  //Blocks never written are filled with no data, or zeros without it.
+  int WriteBlock(size_t level, size_t block_row, size_t block_column,
+                 const std::vector<char>& encoded);
+
+  int Close();
+
+private:
+  struct Level
+  {
+    size_t width;
+    size_t height;
+    size_t number_of_columns;
+    //Where each block went in the blocks file, row major.
+    std::vector<uint64_t> offsets;
+    std::vector<uint64_t> byte_counts;
+  };
+
+  //Directory of a level at offset, its blocks at offsets in the file.
+  std::vector<char> LevelDirectory(const std::vector<uint64_t>& offsets,
+                                   const std::vector<uint64_t>& byte_counts,
+                                   size_t level, bool big, uint64_t offset,
+                                   uint64_t next_directory) const;
+  int WriteLayout(const std::string& blocks_path) const;
+
+  std::string path_;
+  TiffImage image_;
+  size_t block_size_;
+  std::vector<Level> levels_;
+  std::ofstream blocks_file_;
+  uint64_t blocks_size_;
+};
+
+}
+}
+}
+
+#endif
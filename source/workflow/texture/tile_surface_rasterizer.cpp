@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/tile_surface_rasterizer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TileSurfaceRasterizer Rasterizer;
+typedef Rasterizer::Scalar Scalar;
+typedef Rasterizer::Vertex Vertex;
+typedef Rasterizer::VertexContainer VertexContainer;
+typedef Rasterizer::Triangle Triangle;
+typedef Rasterizer::TriangleContainer TriangleContainer;
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+
+//First and last tile column, then row, a triangle covers. Empty when the
+//first column is past the last one.
+typedef std::array<uint32_t, 4> TileRange;
+
+const size_t TRIANGLE_BLOCK = 1 << 14;
+
+//Position in pixel units, pixel centres on integers.
+inline void ToPixel(const RasterGrid& grid, const Vertex& vertex,
+                    Scalar& x, Scalar& y)
+{
+  x = (vertex[0] - grid.left) / grid.scale_x - 0.5;
+  y = (grid.top - vertex[1]) / grid.scale_y - 0.5;
+}
+
+struct BoxWorker
+{
+  BoxWorker(const VertexContainer& vertices_, size_t number_of_ranges_,
+            std::vector<Scalar>& boxes_)
+    : vertices(vertices_), number_of_ranges(number_of_ranges_),
+      boxes(boxes_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t range = begin; range < end; range++)
+    {
+      Scalar* box = &boxes[range * 4];
+      box[0] = box[1] = std::numeric_limits<Scalar>::max();
+      box[2] = box[3] = -std::numeric_limits<Scalar>::max();
+      size_t vertex_begin = vertices.size() * range / number_of_ranges;
+      size_t vertex_end = vertices.size() * (range + 1) / number_of_ranges;
+      for (size_t i = vertex_begin; i < vertex_end; i++)
+      {
+        box[0] = std::min(box[0], vertices[i][0]);
+        box[1] = std::min(box[1], vertices[i][1]);
+        box[2] = std::max(box[2], vertices[i][0]);
+        box[3] = std::max(box[3], vertices[i][1]);
+      }
+    }
+  }
+
+  const VertexContainer& vertices;
+  size_t number_of_ranges;
+  std::vector<Scalar>& boxes;
+};
+
+struct TileRangeWorker
+{
+  TileRangeWorker(const VertexContainer& vertices_,
+                  const TriangleContainer& triangles_,
+                  const RasterGrid& grid_,
+                  std::vector<TileRange>& ranges_)
+    : vertices(vertices_), triangles(triangles_), grid(grid_),
+      ranges(ranges_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      Scalar min_x = std::numeric_limits<Scalar>::max();
+      Scalar min_y = std::numeric_limits<Scalar>::max();
+      Scalar max_x = -std::numeric_limits<Scalar>::max();
+      Scalar max_y = -std::numeric_limits<Scalar>::max();
+      for (int k = 0; k < 3; k++)
+      {
+        Scalar x, y;
+        ToPixel(grid, vertices[triangles[i][k]], x, y);
+        min_x = std::min(min_x, x);
+        min_y = std::min(min_y, y);
+        max_x = std::max(max_x, x);
+        max_y = std::max(max_y, y);
+      }
+      //Pixel centres inside the footprint.
+      Scalar first_column = std::max(std::ceil(min_x), Scalar(0));
+      Scalar first_row = std::max(std::ceil(min_y), Scalar(0));
+      Scalar last_column = std::min(std::floor(max_x),
+                                    Scalar(grid.width) - 1);
+      Scalar last_row = std::min(std::floor(max_y), Scalar(grid.height) - 1);
+      TileRange& range = ranges[i];
+      if (first_column > last_column || first_row > last_row)
+      {
+        range[0] = 1;
+        range[1] = 0;
+        continue;
+      }
+      range[0] = uint32_t(size_t(first_column) / grid.tile_width);
+      range[1] = uint32_t(size_t(last_column) / grid.tile_width);
+      range[2] = uint32_t(size_t(first_row) / grid.tile_height);
+      range[3] = uint32_t(size_t(last_row) / grid.tile_height);
+    }
+  }
+
+  const VertexContainer& vertices;
+  const TriangleContainer& triangles;
+  const RasterGrid& grid;
+  std::vector<TileRange>& ranges;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+const size_t TileSurfaceRasterizer::NO_TRIANGLE;
+
+TileSurfaceRasterizer::TileSurfaceRasterizer(
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  const RasterGrid& grid)
+  : vertices_(vertices)
+  , triangles_(triangles)
+  , grid_(grid)
+{
+}
+
+int TileSurfaceRasterizer::BinTriangles(size_t number_of_threads)
+{
+  if (grid_.width == 0 || grid_.height == 0 ||
+      grid_.tile_width == 0 || grid_.tile_height == 0 ||
+      !(grid_.scale_x > 0) || !(grid_.scale_y > 0))
+  {
+    return -1;
+  }
+  for (size_t i = 0; i < triangles_.size(); i++)
+  {
+    if (triangles_[i][0] >= vertices_.size() ||
+        triangles_[i][1] >= vertices_.size() ||
+        triangles_[i][2] >= vertices_.size())
+    {
+      return -1;
+    }
+  }
+
+  std::vector<TileRange> ranges(triangles_.size());
+  TileRangeWorker range_worker(vertices_, triangles_, grid_, ranges);
+  ParallelForDynamic(0, triangles_.size(), number_of_threads,
+                     TRIANGLE_BLOCK, range_worker);
+
+  //Counts, then offsets, then the triangles of each tile in order.
+  size_t number_of_columns = grid_.NumberOfTileColumns();
+  size_t number_of_tiles = grid_.NumberOfTiles();
+  bin_begins_.assign(number_of_tiles + 1, 0);
+  for (size_t i = 0; i < ranges.size(); i++)
+  {
+    const TileRange& range = ranges[i];
+    for (uint32_t row = range[2]; row <= range[3] && range[0] <= range[1];
+         row++)
+    {
+      for (uint32_t column = range[0]; column <= range[1]; column++)
+      {
+        bin_begins_[row * number_of_columns + column + 1]++;
+      }
+    }
+  }
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    bin_begins_[i + 1] += bin_begins_[i];
+  }
+  bins_.resize(bin_begins_[number_of_tiles]);
+  std::vector<size_t> bin_ends(bin_begins_.begin(), bin_begins_.end() - 1);
+  for (size_t i = 0; i < ranges.size(); i++)
+  {
+    const TileRange& range = ranges[i];
+    for (uint32_t row = range[2]; row <= range[3] && range[0] <= range[1];
+         row++)
+    {
+      for (uint32_t column = range[0]; column <= range[1]; column++)
+      {
+        bins_[bin_ends[row * number_of_columns + column]++] = i;
+      }
+    }
+  }
+  return 0;
+}
+
+void TileSurfaceRasterizer::Rasterize(size_t row, size_t column,
+                                      std::vector<Scalar>& heights,
+                                      std::vector<size_t>& triangle_ids) const
+{
+  size_t tile_width = grid_.TileWidth(column);
+  size_t tile_height = grid_.TileHeight(row);
+  heights.assign(tile_width * tile_height,
+                 -std::numeric_limits<Scalar>::max());
+  triangle_ids.assign(tile_width * tile_height, NO_TRIANGLE);
+
+  //Tile pixels, shifted to the tile origin.
+  Scalar column_origin = Scalar(column * grid_.tile_width);
+  Scalar row_origin = Scalar(row * grid_.tile_height);
+  size_t tile_id = row * grid_.NumberOfTileColumns() + column;
+  for (size_t i = bin_begins_[tile_id]; i < bin_begins_[tile_id + 1]; i++)
+  {
+    const Triangle& triangle = triangles_[bins_[i]];
+    Scalar x[3], y[3], z[3];
+    for (int k = 0; k < 3; k++)
+    {
+      const Vertex& vertex = vertices_[triangle[k]];
+      ToPixel(grid_, vertex, x[k], y[k]);
+      x[k] -= column_origin;
+      y[k] -= row_origin;
+      z[k] = vertex[2];
+    }
+    Scalar area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0) continue;
+
+    Scalar min_x = std::min(std::min(x[0], x[1]), x[2]);
+    Scalar max_x = std::max(std::max(x[0], x[1]), x[2]);
+    Scalar min_y = std::min(std::min(y[0], y[1]), y[2]);
+    Scalar max_y = std::max(std::max(y[0], y[1]), y[2]);
+    int first_column = int(std::max(std::ceil(min_x), Scalar(0)));
+    int last_column = int(std::min(std::floor(max_x),
+                                   Scalar(tile_width) - 1));
+    int first_row = int(std::max(std::ceil(min_y), Scalar(0)));
+    int last_row = int(std::min(std::floor(max_y), Scalar(tile_height) - 1));
+
+    //Barycentric weights, a hair of tolerance so shared edges leave no gap.
+    const Scalar epsilon = -1e-9;
+    for (int pixel_row = first_row; pixel_row <= last_row; pixel_row++)
+    {
+      for (int pixel_column = first_column; pixel_column <= last_column;
+           pixel_column++)
+      {
+        Scalar px = Scalar(pixel_column);
+        Scalar py = Scalar(pixel_row);
+        Scalar w0 = ((x[1] - px) * (y[2] - py) - (x[2] - px) * (y[1] - py)) /
+                    area;
+        Scalar w1 = ((x[2] - px) * (y[0] - py) - (x[0] - px) * (y[2] - py)) /
+                    area;
+        Scalar w2 = 1 - w0 - w1;
+        if (w0 < epsilon || w1 < epsilon || w2 < epsilon) continue;
+        Scalar height = w0 * z[0] + w1 * z[1] + w2 * z[2];
+        size_t pixel_id = size_t(pixel_row) * tile_width +
+                          size_t(pixel_column);
+        if (triangle_ids[pixel_id] == NO_TRIANGLE ||
+            height > heights[pixel_id])
+        {
+          heights[pixel_id] = height;
+          triangle_ids[pixel_id] = bins_[i];
+        }
+      }
+    }
+  }
+}
+
+const size_t* TileSurfaceRasterizer::BinBegin(size_t row,
+                                              size_t column) const
+{
+  size_t tile_id = row * grid_.NumberOfTileColumns() + column;
+  return bins_.data() + bin_begins_[tile_id];
+}
+
+const size_t* TileSurfaceRasterizer::BinEnd(size_t row, size_t column) const
+{
+  size_t tile_id = row * grid_.NumberOfTileColumns() + column;
+  return bins_.data() + bin_begins_[tile_id + 1];
+}
+
+int TileSurfaceRasterizer::TrianglesOfTiles(
+  const std::vector<size_t>& tile_ids,
+  std::vector<size_t>& triangle_ids) const
+{
+  triangle_ids.clear();
+  std::vector<bool> binned(triangles_.size(), false);
+  for (size_t i = 0; i < tile_ids.size(); i++)
+  {
+    if (tile_ids[i] + 1 >= bin_begins_.size()) return -1;
+    for (size_t j = bin_begins_[tile_ids[i]];
+         j < bin_begins_[tile_ids[i] + 1]; j++)
+    {
+      binned[bins_[j]] = true;
+    }
+  }
+  for (size_t i = 0; i < binned.size(); i++)
+  {
+    if (binned[i]) triangle_ids.push_back(i);
+  }
+  return 0;
+}
+
+const RasterGrid& TileSurfaceRasterizer::grid() const
+{
+  return grid_;
+}
+
+int ComputeRasterGrid(const TileSurfaceRasterizer::VertexContainer& vertices,
+                      double scale_x, double scale_y,
+                      size_t tile_width, size_t tile_height,
+                      size_t number_of_threads,
+                      RasterGrid& grid)
+{
+  if (vertices.empty() || !(scale_x > 0) || !(scale_y > 0) ||
+      tile_width == 0 || tile_height == 0)
+  {
+    return -1;
+  }
+  number_of_threads = std::max(number_of_threads, size_t(1));
+  std::vector<Scalar> boxes(number_of_threads * 4);
+  BoxWorker box_worker(vertices, number_of_threads, boxes);
+  ParallelFor(0, number_of_threads, number_of_threads, box_worker);
+  Scalar min_x = boxes[0];
+  Scalar min_y = boxes[1];
+  Scalar max_x = boxes[2];
+  Scalar max_y = boxes[3];
+  for (size_t i = 1; i < number_of_threads; i++)
+  {
+    min_x = std::min(min_x, boxes[i * 4]);
+    min_y = std::min(min_y, boxes[i * 4 + 1]);
+    max_x = std::max(max_x, boxes[i * 4 + 2]);
+    max_y = std::max(max_y, boxes[i * 4 + 3]);
+  }
+
+  grid.left = min_x;
+  grid.top = max_y;
+  grid.scale_x = scale_x;
+  grid.scale_y = scale_y;
+  grid.width = std::max(size_t(std::ceil((max_x - min_x) / scale_x)),
+                        size_t(1));
+  grid.height = std::max(size_t(std::ceil((max_y - min_y) / scale_y)),
+                         size_t(1));
+  grid.tile_width = tile_width;
+  grid.tile_height = tile_height;
+  return 0;
+}
+
+}
+}
+}
@@ -0,0 +1,95 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILE_SURFACE_RASTERIZER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILE_SURFACE_RASTERIZER_HPP_
+
+#include <array>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/raster_tile.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Top surface of a mesh over the pixel centres of a raster, one tile at a
+ *  time.
+ *
+ *  BinTriangles indexes the triangles by the tiles their pixel footprint
+ *  covers, after which tiles can be rasterized concurrently, each touching
+ *  only the triangles of its own bin.
+ */
+class HS_EXPORT TileSurfaceRasterizer
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef std::array<size_t, 3> Triangle;
+  typedef std::vector<Triangle> TriangleContainer;
+
+  static const size_t NO_TRIANGLE = size_t(-1);
+
+  TileSurfaceRasterizer(const VertexContainer& vertices,
+                        const TriangleContainer& triangles,
+                        const RasterGrid& grid);
+
+  /**
+   *  Fails on an empty grid or a triangle referring to a missing vertex.
+   */
+  int BinTriangles(size_t number_of_threads);
+
+  /**
+   *  Height of the highest triangle over each pixel centre of the tile and
+   *  the index of that triangle, NO_TRIANGLE where there is none. Safe to
+   *  call from several threads.
+   */
+  void Rasterize(size_t row, size_t column,
+                 std::vector<Scalar>& heights,
+                 std::vector<size_t>& triangle_ids) const;
+
+  /**
+   *  Triangles binned to a tile, as [begin, end) of triangle indices.
+   */
+  const size_t* BinBegin(size_t row, size_t column) const;
+  const size_t* BinEnd(size_t row, size_t column) const;
+
+  /**
+   *  Triangles binned to any of the tiles at these row major indices, in
+   *  ascending order. Fails on an index past the grid.
+   */
+  int TrianglesOfTiles(const std::vector<size_t>& tile_ids,
+                       std::vector<size_t>& triangle_ids) const;
+
+  const RasterGrid& grid() const;
+
+private:
+  const VertexContainer& vertices_;
+  const TriangleContainer& triangles_;
+  RasterGrid grid_;
+  std::vector<size_t> bin_begins_;
+  std::vector<size_t> bins_;
+};
+
+/**
+ *  Grid over the planar bounding box of vertices, with pixels of
+ *  scale_x x scale_y.
+ */
+HS_EXPORT int ComputeRasterGrid(
+  const TileSurfaceRasterizer::VertexContainer& vertices,
+  double scale_x, double scale_y,
+  size_t tile_width, size_t tile_height,
+  size_t number_of_threads,
+  RasterGrid& grid);
+
+}
+}
+}
+
+#endif
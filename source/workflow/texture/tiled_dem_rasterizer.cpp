@@ -0,0 +1,111 @@
+#include <algorithm>
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/tiled_dem_rasterizer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDEMRasterizer Rasterizer;
+typedef Rasterizer::Scalar Scalar;
+typedef Rasterizer::Height Height;
+typedef hs::recon::workflow::TileSurfaceRasterizer SurfaceRasterizer;
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::RasterTile<Height> Tile;
+typedef hs::recon::workflow::SerializedTileWriter<Height> TileWriter;
+
+struct RasterizeWorker
+{
+  RasterizeWorker(const SurfaceRasterizer& surface_,
+                  const std::vector<size_t>& tile_ids_,
+                  Height no_data_,
+                  TileWriter& writer_)
+    : surface(surface_), tile_ids(tile_ids_), no_data(no_data_),
+      writer(writer_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    const RasterGrid& grid = surface.grid();
+    size_t number_of_columns = grid.NumberOfTileColumns();
+    std::vector<Scalar> heights;
+    std::vector<size_t> triangle_ids;
+    for (size_t i = begin; i < end; i++)
+    {
+      if (writer.failed()) return;
+      size_t tile_id = tile_ids[i];
+      Tile tile;
+      tile.row = tile_id / number_of_columns;
+      tile.column = tile_id % number_of_columns;
+      tile.width = grid.TileWidth(tile.column);
+      tile.height = grid.TileHeight(tile.row);
+      tile.channels = 1;
+      surface.Rasterize(tile.row, tile.column, heights, triangle_ids);
+      tile.pixels.resize(heights.size());
+      for (size_t i = 0; i < heights.size(); i++)
+      {
+        tile.pixels[i] =
+          triangle_ids[i] == SurfaceRasterizer::NO_TRIANGLE ?
+          no_data : Height(heights[i]);
+      }
+      if (writer.Write(tile) != 0) return;
+    }
+  }
+
+  const SurfaceRasterizer& surface;
+  const std::vector<size_t>& tile_ids;
+  Height no_data;
+  TileWriter& writer;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+TiledDEMRasterizer::TiledDEMRasterizer(size_t number_of_threads)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+{
+}
+
+void TiledDEMRasterizer::set_tile_ids(const std::vector<size_t>& tile_ids)
+{
+  tile_ids_ = tile_ids;
+}
+
+int TiledDEMRasterizer::operator() (
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  const RasterGrid& grid,
+  Height no_data,
+  Sink& sink,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  std::vector<size_t> tile_ids = tile_ids_;
+  if (tile_ids.empty())
+  {
+    tile_ids.resize(grid.NumberOfTiles());
+    for (size_t i = 0; i < tile_ids.size(); i++) tile_ids[i] = i;
+  }
+  for (size_t i = 0; i < tile_ids.size(); i++)
+  {
+    if (tile_ids[i] >= grid.NumberOfTiles()) return -1;
+  }
+
+  SurfaceRasterizer surface(vertices, triangles, grid);
+  if (surface.BinTriangles(number_of_threads_) != 0) return -1;
+
+  if (sink.Open(grid, 1, no_data) != 0) return -1;
+  TileWriter writer(sink, tile_ids.size(), progress_manager);
+  RasterizeWorker worker(surface, tile_ids, no_data, writer);
+  ParallelForDynamic(0, tile_ids.size(), number_of_threads_, 1, worker);
+  if (sink.Close() != 0) return -1;
+  return writer.failed() ? -1 : 0;
+}
+
+}
+}
+}
@@ -0,0 +1,68 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILED_DEM_RASTERIZER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILED_DEM_RASTERIZER_HPP_
+
+#include <vector>
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/raster_tile.hpp"
+#include "workflow/texture/tile_surface_rasterizer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Rasterizes the heights of a mesh tile by tile.
+ *
+ *  Triangles are binned to the tiles their pixel footprint covers, then
+ *  the tiles are rasterized concurrently, each from its own bin, and handed
+ *  to the sink as soon as they are done. Memory holds the bins and the
+ *  tiles in flight, never the whole raster.
+ */
+class HS_EXPORT TiledDEMRasterizer
+{
+public:
+  typedef TileSurfaceRasterizer::Scalar Scalar;
+  typedef TileSurfaceRasterizer::Vertex Vertex;
+  typedef TileSurfaceRasterizer::VertexContainer VertexContainer;
+  typedef TileSurfaceRasterizer::Triangle Triangle;
+  typedef TileSurfaceRasterizer::TriangleContainer TriangleContainer;
+  typedef float Height;
+  typedef RasterTileSink<Height> Sink;
+
+  TiledDEMRasterizer(size_t number_of_threads);
+
+  /**
+   *  Rasterize only the tiles at these row major indices, every tile of the
+   *  grid if empty. Fails on an index past the grid.
+   */
+  void set_tile_ids(const std::vector<size_t>& tile_ids);
+
+  /**
+   *  Each pixel takes the height of the highest triangle over its centre,
+   *  no_data where there is none.
+   */
+  int operator() (const VertexContainer& vertices,
+                  const TriangleContainer& triangles,
+                  const RasterGrid& grid,
+                  Height no_data,
+                  Sink& sink,
+                  hs::progress::ProgressManager* progress_manager =
+                    nullptr) const;
+
+private:
+  size_t number_of_threads_;
+  std::vector<size_t> tile_ids_;
+};
+
+}
+}
+}
+
+#endif
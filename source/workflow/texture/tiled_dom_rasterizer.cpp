@@ -0,0 +1,455 @@
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/tiled_dom_rasterizer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDOMRasterizer Rasterizer;
+typedef Rasterizer::Scalar Scalar;
+typedef Rasterizer::Vertex Vertex;
+typedef Rasterizer::VertexContainer VertexContainer;
+typedef Rasterizer::TriangleContainer TriangleContainer;
+typedef Rasterizer::Sample Sample;
+typedef Rasterizer::ImageParamsContainer ImageParamsContainer;
+typedef hs::recon::workflow::TileSurfaceRasterizer SurfaceRasterizer;
+typedef hs::recon::workflow::PhotoTileCache PhotoCache;
+typedef hs::recon::workflow::PhotoTileSampler PhotoSampler;
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::RasterTile<Sample> Tile;
+typedef hs::recon::workflow::SerializedTileWriter<Sample> TileWriter;
+typedef hs::sfm::ProjectiveFunctions<Scalar> ProjectiveFunctions;
+typedef EIGEN_VECTOR(Scalar, 2) Key;
+
+const int MAX_LEVEL = 8;
+const size_t NO_IMAGE = size_t(-1);
+
+/**
+ *  Images a tile samples, the most used first, and the level each would be
+ *  sampled at by this tile alone.
+ */
+struct TilePlan
+{
+  std::vector<size_t> images;
+  std::vector<int> levels;
+};
+
+inline size_t ImageOf(const std::vector<size_t>& triangle_image_indices,
+                      size_t number_of_images, size_t triangle_id)
+{
+  size_t image_id = triangle_id < triangle_image_indices.size() ?
+                    triangle_image_indices[triangle_id] : NO_IMAGE;
+  return image_id < number_of_images ? image_id : NO_IMAGE;
+}
+
+struct PlanWorker
+{
+  PlanWorker(const ImageParamsContainer& images_,
+             const VertexContainer& vertices_,
+             const TriangleContainer& triangles_,
+             const std::vector<size_t>& triangle_image_indices_,
+             const SurfaceRasterizer& surface_,
+             const std::vector<size_t>& tile_ids_,
+             std::vector<TilePlan>& plans_)
+    : images(images_)
+    , vertices(vertices_)
+    , triangles(triangles_)
+    , triangle_image_indices(triangle_image_indices_)
+    , surface(surface_)
+    , tile_ids(tile_ids_)
+    , plans(plans_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    const RasterGrid& grid = surface.grid();
+    size_t number_of_columns = grid.NumberOfTileColumns();
+    for (size_t position = begin; position < end; position++)
+    {
+      size_t tile_id = tile_ids[position];
+      size_t row = tile_id / number_of_columns;
+      size_t column = tile_id % number_of_columns;
+      std::map<size_t, size_t> counts;
+      Scalar height = 0;
+      size_t number_of_triangles = 0;
+      for (const size_t* bin = surface.BinBegin(row, column);
+           bin != surface.BinEnd(row, column); ++bin)
+      {
+        size_t image_id = ImageOf(triangle_image_indices, images.size(), *bin);
+        if (image_id == NO_IMAGE) continue;
+        counts[image_id]++;
+        height += vertices[triangles[*bin][0]][2];
+        number_of_triangles++;
+      }
+      if (counts.empty()) continue;
+      height /= Scalar(number_of_triangles);
+
+      std::vector<std::pair<size_t, size_t> > ranked;
+      for (auto itr_count = counts.begin(); itr_count != counts.end();
+           ++itr_count)
+      {
+        ranked.push_back(std::make_pair(itr_count->second, itr_count->first));
+      }
+      std::sort(ranked.begin(), ranked.end(),
+                std::greater<std::pair<size_t, size_t> >());
+
+      Vertex centre(grid.TileLeft(column) +
+                    0.5 * Scalar(grid.TileWidth(column)) * grid.scale_x,
+                    grid.TileTop(row) -
+                    0.5 * Scalar(grid.TileHeight(row)) * grid.scale_y,
+                    height);
+      TilePlan& plan = plans[tile_id];
+      for (size_t i = 0; i < ranked.size(); i++)
+      {
+        plan.images.push_back(ranked[i].second);
+        plan.levels.push_back(Level(images[ranked[i].second], centre, grid));
+      }
+    }
+  }
+
+  //Coarsest level whose pixels are still no larger than an output pixel.
+  static int Level(const Rasterizer::ImageParams& image,
+                   const Vertex& point, const RasterGrid& grid)
+  {
+    Vertex east = point;
+    east[0] += grid.scale_x;
+    Vertex north = point;
+    north[1] += grid.scale_y;
+    Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                image.intrinsic_params, image.extrinsic_params, point);
+    Key east_key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                     image.intrinsic_params, image.extrinsic_params, east);
+    Key north_key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                      image.intrinsic_params, image.extrinsic_params, north);
+    Scalar footprint = std::min((east_key - key).norm(),
+                                (north_key - key).norm());
+    if (!(footprint >= 2)) return 0;
+    return std::min(int(std::floor(std::log2(footprint))), MAX_LEVEL);
+  }
+
+  const ImageParamsContainer& images;
+  const VertexContainer& vertices;
+  const TriangleContainer& triangles;
+  const std::vector<size_t>& triangle_image_indices;
+  const SurfaceRasterizer& surface;
+  const std::vector<size_t>& tile_ids;
+  std::vector<TilePlan>& plans;
+};
+
+/**
+ *  Tiles grouped by the photo they use most, groups in the order a
+ *  serpentine walk over the tiles first meets them, then empty tiles. Within
+ *  a group tiles follow the serpentine walk too, so consecutive tiles keep
+ *  sharing photos.
+ */
+void ScheduleTiles(const RasterGrid& grid, size_t number_of_images,
+                   const std::vector<TilePlan>& plans,
+                   std::vector<size_t>& schedule)
+{
+  size_t number_of_columns = grid.NumberOfTileColumns();
+  size_t number_of_tiles = grid.NumberOfTiles();
+  std::vector<size_t> walk(number_of_tiles);
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    size_t row = i / number_of_columns;
+    size_t column = i % number_of_columns;
+    if (row % 2) column = number_of_columns - 1 - column;
+    walk[i] = row * number_of_columns + column;
+  }
+
+  std::vector<size_t> image_ranks(number_of_images, NO_IMAGE);
+  size_t number_of_ranks = 0;
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    const TilePlan& plan = plans[walk[i]];
+    if (plan.images.empty()) continue;
+    if (image_ranks[plan.images[0]] == NO_IMAGE)
+    {
+      image_ranks[plan.images[0]] = number_of_ranks++;
+    }
+  }
+
+  std::vector<std::pair<size_t, size_t> > keys(number_of_tiles);
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    const TilePlan& plan = plans[walk[i]];
+    keys[i].first = plan.images.empty() ?
+                    number_of_ranks : image_ranks[plan.images[0]];
+    keys[i].second = i;
+  }
+  std::sort(keys.begin(), keys.end());
+  schedule.resize(number_of_tiles);
+  for (size_t i = 0; i < number_of_tiles; i++)
+  {
+    schedule[i] = walk[keys[i].second];
+  }
+}
+
+/**
+ *  Shared between the workers and the prefetcher: how far the workers got
+ *  along the schedule.
+ */
+struct ScheduleProgress
+{
+  ScheduleProgress() : number_of_started(0), done(false) {}
+
+  void Start()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    number_of_started++;
+    changed.notify_all();
+  }
+
+  void Finish()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    changed.notify_all();
+  }
+
+  size_t number_of_started;
+  bool done;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+/**
+ *  Decodes the photos of the tiles up to lookahead positions ahead of the
+ *  workers.
+ */
+struct PrefetchWorker
+{
+  PrefetchWorker(const std::vector<TilePlan>& plans_,
+                 const std::vector<size_t>& schedule_,
+                 const std::vector<int>& image_levels_,
+                 size_t lookahead_,
+                 PhotoCache& photos_,
+                 ScheduleProgress& progress_)
+    : plans(plans_)
+    , schedule(schedule_)
+    , image_levels(image_levels_)
+    , lookahead(lookahead_)
+    , photos(photos_)
+    , progress(progress_) {}
+
+  void operator() ()
+  {
+    for (size_t position = 0; position < schedule.size(); position++)
+    {
+      {
+        std::unique_lock<std::mutex> lock(progress.mutex);
+        while (!progress.done &&
+               position >= progress.number_of_started + lookahead)
+        {
+          progress.changed.wait(lock);
+        }
+        if (progress.done) return;
+      }
+      const TilePlan& plan = plans[schedule[position]];
+      for (size_t i = 0; i < plan.images.size(); i++)
+      {
+        photos.Prefetch(plan.images[i], image_levels[plan.images[i]]);
+      }
+    }
+  }
+
+  const std::vector<TilePlan>& plans;
+  const std::vector<size_t>& schedule;
+  const std::vector<int>& image_levels;
+  size_t lookahead;
+  PhotoCache& photos;
+  ScheduleProgress& progress;
+};
+
+struct RasterizeWorker
+{
+  RasterizeWorker(const ImageParamsContainer& images_,
+                  PhotoCache& photos_,
+                  const std::vector<size_t>& triangle_image_indices_,
+                  const std::vector<int>& image_levels_,
+                  const std::vector<size_t>& schedule_,
+                  const SurfaceRasterizer& surface_,
+                  ScheduleProgress& progress_,
+                  TileWriter& writer_)
+    : images(images_)
+    , photos(photos_)
+    , triangle_image_indices(triangle_image_indices_)
+    , image_levels(image_levels_)
+    , schedule(schedule_)
+    , surface(surface_)
+    , progress(progress_)
+    , writer(writer_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    const RasterGrid& grid = surface.grid();
+    size_t number_of_columns = grid.NumberOfTileColumns();
+    std::vector<Scalar> heights;
+    std::vector<size_t> triangle_ids;
+    PhotoSampler sampler(photos);
+    for (size_t position = begin; position < end; position++)
+    {
+      if (writer.failed()) return;
+      progress.Start();
+      size_t tile_id = schedule[position];
+      Tile tile;
+      tile.row = tile_id / number_of_columns;
+      tile.column = tile_id % number_of_columns;
+      tile.width = grid.TileWidth(tile.column);
+      tile.height = grid.TileHeight(tile.row);
+      tile.channels = Rasterizer::NUMBER_OF_CHANNELS;
+      tile.pixels.assign(tile.width * tile.height * tile.channels, 0);
+      surface.Rasterize(tile.row, tile.column, heights, triangle_ids);
+      Colorize(grid, heights, triangle_ids, sampler, tile);
+      sampler.Clear();
+      if (writer.Write(tile) != 0) return;
+    }
+  }
+
+  void Colorize(const RasterGrid& grid,
+                const std::vector<Scalar>& heights,
+                const std::vector<size_t>& triangle_ids,
+                PhotoSampler& sampler,
+                Tile& tile) const
+  {
+    double left = grid.TileLeft(tile.column);
+    double top = grid.TileTop(tile.row);
+    for (size_t row = 0; row < tile.height; row++)
+    {
+      for (size_t column = 0; column < tile.width; column++)
+      {
+        size_t pixel_id = row * tile.width + column;
+        if (triangle_ids[pixel_id] == SurfaceRasterizer::NO_TRIANGLE)
+        {
+          continue;
+        }
+        size_t image_id = ImageOf(triangle_image_indices, images.size(),
+                                  triangle_ids[pixel_id]);
+        if (image_id == NO_IMAGE) continue;
+
+        Vertex point(left + (Scalar(column) + 0.5) * grid.scale_x,
+                     top - (Scalar(row) + 0.5) * grid.scale_y,
+                     heights[pixel_id]);
+        Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                    images[image_id].intrinsic_params,
+                    images[image_id].extrinsic_params,
+                    point);
+        Sample* pixel = &tile.pixels[pixel_id * tile.channels];
+        if (sampler.Color(image_id, image_levels[image_id], key[0], key[1],
+                          pixel))
+        {
+          images[image_id].color_correction.Apply(pixel);
+          pixel[3] = 255;
+        }
+      }
+    }
+  }
+
+  const ImageParamsContainer& images;
+  PhotoCache& photos;
+  const std::vector<size_t>& triangle_image_indices;
+  const std::vector<int>& image_levels;
+  const std::vector<size_t>& schedule;
+  const SurfaceRasterizer& surface;
+  ScheduleProgress& progress;
+  TileWriter& writer;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+const size_t TiledDOMRasterizer::NUMBER_OF_CHANNELS;
+
+TiledDOMRasterizer::TiledDOMRasterizer(size_t number_of_threads)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+{
+}
+
+void TiledDOMRasterizer::set_tile_ids(const std::vector<size_t>& tile_ids)
+{
+  tile_ids_ = tile_ids;
+}
+
+int TiledDOMRasterizer::operator() (
+  const ImageParamsContainer& images,
+  PhotoTileCache& photos,
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  const std::vector<size_t>& triangle_image_indices,
+  const RasterGrid& grid,
+  Sink& sink,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  if (photos.NumberOfPhotos() != images.size()) return -1;
+  std::vector<bool> selected(grid.NumberOfTiles(), tile_ids_.empty());
+  for (size_t i = 0; i < tile_ids_.size(); i++)
+  {
+    if (tile_ids_[i] >= selected.size()) return -1;
+    selected[tile_ids_[i]] = true;
+  }
+  std::vector<size_t> selected_tile_ids;
+  for (size_t i = 0; i < selected.size(); i++)
+  {
+    if (selected[i]) selected_tile_ids.push_back(i);
+  }
+  SurfaceRasterizer surface(vertices, triangles, grid);
+  if (surface.BinTriangles(number_of_threads_) != 0) return -1;
+
+  //Which photos each tile needs, and at which level each photo is read:
+  //the finest any of its tiles asks for, so it is decoded at one level.
+  //Tiles left out get no plan.
+  std::vector<TilePlan> plans(grid.NumberOfTiles());
+  PlanWorker plan_worker(images, vertices, triangles, triangle_image_indices,
+                         surface, selected_tile_ids, plans);
+  ParallelForDynamic(0, selected_tile_ids.size(), number_of_threads_, 16,
+                     plan_worker);
+  std::vector<int> image_levels(images.size(), MAX_LEVEL);
+  for (size_t i = 0; i < plans.size(); i++)
+  {
+    for (size_t j = 0; j < plans[i].images.size(); j++)
+    {
+      int& level = image_levels[plans[i].images[j]];
+      level = std::min(level, plans[i].levels[j]);
+    }
+  }
+  std::vector<size_t> schedule;
+  ScheduleTiles(grid, images.size(), plans, schedule);
+  std::vector<size_t> selected_schedule;
+  for (size_t i = 0; i < schedule.size(); i++)
+  {
+    if (selected[schedule[i]]) selected_schedule.push_back(schedule[i]);
+  }
+  schedule.swap(selected_schedule);
+
+  if (sink.Open(grid, NUMBER_OF_CHANNELS, Sample(0)) != 0) return -1;
+  TileWriter writer(sink, schedule.size(), progress_manager);
+  ScheduleProgress progress;
+  PrefetchWorker prefetch_worker(plans, schedule, image_levels,
+                                 number_of_threads_ * 2, photos, progress);
+  std::thread prefetch_thread(std::ref(prefetch_worker));
+  RasterizeWorker worker(images, photos, triangle_image_indices,
+                         image_levels, schedule, surface, progress, writer);
+  ParallelForDynamic(0, schedule.size(), number_of_threads_, 1, worker);
+  progress.Finish();
+  prefetch_thread.join();
+  if (sink.Close() != 0) return -1;
+  return writer.failed() ? -1 : 0;
+}
+
+}
+}
+}
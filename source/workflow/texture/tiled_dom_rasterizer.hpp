@@ -0,0 +1,96 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILED_DOM_RASTERIZER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_TILED_DOM_RASTERIZER_HPP_
+
+#include <cstdint>
+#include <vector>
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/photo_orientation/color_balance_estimator.hpp"
+#include "workflow/texture/raster_tile.hpp"
+#include "workflow/texture/photo_tile_cache.hpp"
+#include "workflow/texture/tile_surface_rasterizer.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Orthophoto of a mesh, rasterized tile by tile.
+ *
+ *  Each pixel centre is lifted to the top surface of the mesh and colored
+ *  from the photo assigned to the triangle there. Tiles are rasterized
+ *  concurrently and handed to the sink once done, so several outputs can be
+ *  fed from one pass through a FanOutTileSink.
+ *
+ *  Photos are sampled at the pyramid level closest to the ground size of a
+ *  pixel, through a shared tile cache. Tiles mostly colored from the same
+ *  photo are scheduled one after another, and a prefetch thread decodes the
+ *  photos of the tiles ahead of the workers, so that each photo tends to be
+ *  decoded once.
+ */
+class HS_EXPORT TiledDOMRasterizer
+{
+public:
+  typedef TileSurfaceRasterizer::Scalar Scalar;
+  typedef TileSurfaceRasterizer::Vertex Vertex;
+  typedef TileSurfaceRasterizer::VertexContainer VertexContainer;
+  typedef TileSurfaceRasterizer::Triangle Triangle;
+  typedef TileSurfaceRasterizer::TriangleContainer TriangleContainer;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+  typedef uint8_t Sample;
+  typedef RasterTileSink<Sample> Sink;
+
+  //Cameras in the frame of the vertices, and the correction of the colors
+  //sampled from each photo.
+  struct ImageParams
+  {
+    IntrinsicParams intrinsic_params;
+    ExtrinsicParams extrinsic_params;
+    ColorCorrection color_correction;
+  };
+  typedef EIGEN_STD_VECTOR(ImageParams) ImageParamsContainer;
+
+  //RGBA, alpha is 0 where nothing was seen.
+  static const size_t NUMBER_OF_CHANNELS = 4;
+
+  TiledDOMRasterizer(size_t number_of_threads);
+
+  /**
+   *  Rasterize only the tiles at these row major indices, every tile of the
+   *  grid if empty. Fails on an index past the grid.
+   */
+  void set_tile_ids(const std::vector<size_t>& tile_ids);
+
+  /**
+   *  triangle_image_indices holds the image of each triangle, photos the
+   *  photos of images in the same order. Triangles whose image is out of
+   *  range are left transparent.
+   */
+  int operator() (const ImageParamsContainer& images,
+                  PhotoTileCache& photos,
+                  const VertexContainer& vertices,
+                  const TriangleContainer& triangles,
+                  const std::vector<size_t>& triangle_image_indices,
+                  const RasterGrid& grid,
+                  Sink& sink,
+                  hs::progress::ProgressManager* progress_manager =
+                    nullptr) const;
+
+private:
+  size_t number_of_threads_;
+  std::vector<size_t> tile_ids_;
+};
+
+}
+}
+}
+
+#endif
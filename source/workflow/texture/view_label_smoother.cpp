@@ -0,0 +1,398 @@
+#include <algorithm>
+#include <limits>
+
+#include "workflow/texture/view_label_smoother.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ViewLabelSmoother Smoother;
+typedef Smoother::Scalar Scalar;
+typedef Smoother::Triangle Triangle;
+typedef Smoother::TriangleContainer TriangleContainer;
+
+const size_t NO_NODE = size_t(-1);
+//Residual capacities below this are taken as saturated.
+const Scalar EPSILON = 1e-12;
+
+//An edge of a triangle, keyed by its vertices in ascending order.
+struct TriangleEdge
+{
+  bool operator< (const TriangleEdge& other) const
+  {
+    if (first != other.first) return first < other.first;
+    if (second != other.second) return second < other.second;
+    return triangle < other.triangle;
+  }
+
+  size_t first;
+  size_t second;
+  size_t triangle;
+};
+
+/**
+ *  Directed graph with a maximum flow by Dinic's algorithm. Each edge is
+ *  stored next to its reverse, so edge e ^ 1 is the reverse of edge e.
+ */
+class FlowGraph
+{
+public:
+  void Reset(size_t number_of_nodes)
+  {
+    heads_.assign(number_of_nodes, NO_NODE);
+    edges_.clear();
+  }
+
+  void AddEdge(size_t from, size_t to,
+               Scalar capacity, Scalar reverse_capacity)
+  {
+    Edge edge = {to, heads_[from], capacity};
+    heads_[from] = edges_.size();
+    edges_.push_back(edge);
+    Edge reverse = {from, heads_[to], reverse_capacity};
+    heads_[to] = edges_.size();
+    edges_.push_back(reverse);
+  }
+
+  void MaxFlow(size_t source, size_t sink)
+  {
+    while (Layer(source, sink))
+    {
+      current_ = heads_;
+      while (Augment(source, sink)) {}
+    }
+  }
+
+  //After MaxFlow, whether the node is on the source side of the minimum cut.
+  bool OnSourceSide(size_t node) const
+  {
+    return levels_[node] != NO_NODE;
+  }
+
+private:
+  struct Edge
+  {
+    size_t to;
+    size_t next;
+    Scalar capacity;
+  };
+
+  //Breadth first distances from the source over unsaturated edges.
+  bool Layer(size_t source, size_t sink)
+  {
+    levels_.assign(heads_.size(), NO_NODE);
+    queue_.clear();
+    levels_[source] = 0;
+    queue_.push_back(source);
+    for (size_t i = 0; i < queue_.size(); i++)
+    {
+      size_t node = queue_[i];
+      for (size_t e = heads_[node]; e != NO_NODE; e = edges_[e].next)
+      {
+        if (edges_[e].capacity > EPSILON && levels_[edges_[e].to] == NO_NODE)
+        {
+          levels_[edges_[e].to] = levels_[node] + 1;
+          queue_.push_back(edges_[e].to);
+        }
+      }
+    }
+    return levels_[sink] != NO_NODE;
+  }
+
+  /**
+   *  Push flow along one path of the layered graph. Nodes found to lead
+   *  nowhere are dropped from the layers.
+   */
+  bool Augment(size_t source, size_t sink)
+  {
+    path_.clear();
+    size_t node = source;
+    while (node != sink)
+    {
+      size_t& e = current_[node];
+      while (e != NO_NODE &&
+             !(edges_[e].capacity > EPSILON &&
+               levels_[edges_[e].to] == levels_[node] + 1))
+      {
+        e = edges_[e].next;
+      }
+      if (e == NO_NODE)
+      {
+        if (node == source) return false;
+        levels_[node] = NO_NODE;
+        size_t back = path_.back();
+        path_.pop_back();
+        node = edges_[back ^ 1].to;
+        current_[node] = edges_[back].next;
+        continue;
+      }
+      path_.push_back(e);
+      node = edges_[e].to;
+    }
+
+    Scalar flow = std::numeric_limits<Scalar>::max();
+    for (size_t i = 0; i < path_.size(); i++)
+    {
+      flow = std::min(flow, edges_[path_[i]].capacity);
+    }
+    for (size_t i = 0; i < path_.size(); i++)
+    {
+      edges_[path_[i]].capacity -= flow;
+      edges_[path_[i] ^ 1].capacity += flow;
+    }
+    return true;
+  }
+
+  std::vector<size_t> heads_;
+  std::vector<Edge> edges_;
+  std::vector<size_t> levels_;
+  std::vector<size_t> current_;
+  std::vector<size_t> queue_;
+  std::vector<size_t> path_;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+void TriangleNeighbours(const std::vector<std::array<size_t, 3> >& triangles,
+                        std::vector<size_t>& begins,
+                        std::vector<size_t>& neighbours)
+{
+  std::vector<TriangleEdge> edges;
+  edges.reserve(triangles.size() * 3);
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      size_t first = triangles[i][j];
+      size_t second = triangles[i][(j + 1) % 3];
+      if (first == second) continue;
+      TriangleEdge edge = {std::min(first, second), std::max(first, second),
+                           i};
+      edges.push_back(edge);
+    }
+  }
+  std::sort(edges.begin(), edges.end());
+
+  //Every pair of triangles on an edge, counted then filled.
+  begins.assign(triangles.size() + 1, 0);
+  for (int pass = 0; pass < 2; pass++)
+  {
+    std::vector<size_t> ends(begins.begin(), begins.end() - 1);
+    size_t group_begin = 0;
+    while (group_begin < edges.size())
+    {
+      size_t group_end = group_begin + 1;
+      while (group_end < edges.size() &&
+             edges[group_end].first == edges[group_begin].first &&
+             edges[group_end].second == edges[group_begin].second)
+      {
+        group_end++;
+      }
+      for (size_t i = group_begin; i < group_end; i++)
+      {
+        for (size_t j = group_begin; j < group_end; j++)
+        {
+          if (edges[i].triangle == edges[j].triangle) continue;
+          if (pass == 0)
+          {
+            begins[edges[i].triangle + 1]++;
+          }
+          else
+          {
+            neighbours[ends[edges[i].triangle]++] = edges[j].triangle;
+          }
+        }
+      }
+      group_begin = group_end;
+    }
+    if (pass == 0)
+    {
+      for (size_t i = 0; i < triangles.size(); i++)
+      {
+        begins[i + 1] += begins[i];
+      }
+      neighbours.resize(begins.back());
+    }
+  }
+}
+
+const size_t ViewLabelSmoother::NO_LABEL;
+
+ViewLabelSmoother::ViewLabelSmoother(Scalar smoothness,
+                                     size_t number_of_sweeps)
+  : smoothness_(std::max(smoothness, Scalar(0)))
+  , number_of_sweeps_(number_of_sweeps)
+{
+}
+
+int ViewLabelSmoother::operator() (
+  const TriangleContainer& triangles,
+  const std::vector<size_t>& begins,
+  const std::vector<size_t>& candidates,
+  const std::vector<Scalar>& costs,
+  std::vector<size_t>& labels,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  size_t number_of_triangles = triangles.size();
+  if (begins.size() != number_of_triangles + 1 ||
+      labels.size() != number_of_triangles ||
+      candidates.size() != begins.back() ||
+      costs.size() != candidates.size())
+  {
+    return -1;
+  }
+
+  //Cost of the current label of each triangle, checking it is a candidate.
+  size_t number_of_labels = 0;
+  std::vector<Scalar> label_costs(number_of_triangles, 0);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    if (begins[i] > begins[i + 1]) return -1;
+    bool found = labels[i] == NO_LABEL && begins[i] == begins[i + 1];
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      if (candidates[slot] == NO_LABEL || !(costs[slot] >= 0)) return -1;
+      number_of_labels = std::max(number_of_labels, candidates[slot] + 1);
+      if (candidates[slot] == labels[i])
+      {
+        found = true;
+        label_costs[i] = costs[slot];
+      }
+    }
+    if (!found) return -1;
+  }
+  if (smoothness_ == 0 || number_of_labels < 2) return 0;
+
+  //The slots of each label, so that a move visits only its own triangles.
+  std::vector<size_t> label_begins(number_of_labels + 1, 0);
+  for (size_t slot = 0; slot < candidates.size(); slot++)
+  {
+    label_begins[candidates[slot] + 1]++;
+  }
+  for (size_t i = 0; i < number_of_labels; i++)
+  {
+    label_begins[i + 1] += label_begins[i];
+  }
+  std::vector<size_t> label_triangles(candidates.size());
+  std::vector<Scalar> label_slot_costs(candidates.size());
+  std::vector<size_t> label_ends(label_begins.begin(),
+                                 label_begins.end() - 1);
+  for (size_t i = 0; i < number_of_triangles; i++)
+  {
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      size_t position = label_ends[candidates[slot]]++;
+      label_triangles[position] = i;
+      label_slot_costs[position] = costs[slot];
+    }
+  }
+
+  std::vector<size_t> neighbour_begins;
+  std::vector<size_t> neighbours;
+  TriangleNeighbours(triangles, neighbour_begins, neighbours);
+
+  FlowGraph graph;
+  std::vector<size_t> nodes(number_of_triangles, NO_NODE);
+  std::vector<size_t> region;
+  std::vector<Scalar> region_costs;
+  //Cost of each node staying and of it switching.
+  std::vector<Scalar> keep_costs;
+  std::vector<Scalar> switch_costs;
+  for (size_t sweep = 0; sweep < number_of_sweeps_; sweep++)
+  {
+    bool changed = false;
+    for (size_t alpha = 0; alpha < number_of_labels; alpha++)
+    {
+      if (progress_manager && !progress_manager->CheckKeepWorking())
+      {
+        return -1;
+      }
+      region.clear();
+      region_costs.clear();
+      for (size_t position = label_begins[alpha];
+           position < label_begins[alpha + 1]; position++)
+      {
+        size_t triangle_id = label_triangles[position];
+        if (labels[triangle_id] == alpha) continue;
+        nodes[triangle_id] = region.size();
+        region.push_back(triangle_id);
+        region_costs.push_back(label_slot_costs[position]);
+      }
+      if (region.empty()) continue;
+
+      size_t source = region.size();
+      size_t sink = source + 1;
+      graph.Reset(region.size() + 2);
+      keep_costs.assign(region.size(), 0);
+      switch_costs.assign(region.size(), 0);
+      for (size_t p = 0; p < region.size(); p++)
+      {
+        size_t triangle_id = region[p];
+        size_t label = labels[triangle_id];
+        keep_costs[p] += label_costs[triangle_id];
+        switch_costs[p] += region_costs[p];
+        for (size_t k = neighbour_begins[triangle_id];
+             k < neighbour_begins[triangle_id + 1]; k++)
+        {
+          size_t neighbour = neighbours[k];
+          size_t neighbour_label = labels[neighbour];
+          if (neighbour_label == NO_LABEL) continue;
+          size_t q = nodes[neighbour];
+          if (q == NO_NODE)
+          {
+            if (label != neighbour_label) keep_costs[p] += smoothness_;
+            if (alpha != neighbour_label) switch_costs[p] += smoothness_;
+          }
+          else if (p < q)
+          {
+            //Both keep: a seam if their labels differ, one switches: a
+            //seam, both switch: none.
+            Scalar both_keep = label != neighbour_label ? smoothness_ : 0;
+            switch_costs[p] += smoothness_ - both_keep;
+            switch_costs[q] -= smoothness_;
+            graph.AddEdge(q, p, 2 * smoothness_ - both_keep, 0);
+          }
+        }
+      }
+      //Nodes left on the source side switch to alpha, so that those
+      //the cut does not reach keep their label.
+      for (size_t p = 0; p < region.size(); p++)
+      {
+        if (switch_costs[p] > keep_costs[p])
+        {
+          graph.AddEdge(p, sink, switch_costs[p] - keep_costs[p], 0);
+        }
+        else if (keep_costs[p] > switch_costs[p])
+        {
+          graph.AddEdge(source, p, keep_costs[p] - switch_costs[p], 0);
+        }
+      }
+      graph.MaxFlow(source, sink);
+
+      for (size_t p = 0; p < region.size(); p++)
+      {
+        size_t triangle_id = region[p];
+        nodes[triangle_id] = NO_NODE;
+        if (graph.OnSourceSide(p))
+        {
+          labels[triangle_id] = alpha;
+          label_costs[triangle_id] = region_costs[p];
+          changed = true;
+        }
+      }
+    }
+    if (!changed) break;
+  }
+  return 0;
+}
+
+}
+}
+}
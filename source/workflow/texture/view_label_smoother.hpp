@@ -0,0 +1,78 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_VIEW_LABEL_SMOOTHER_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_VIEW_LABEL_SMOOTHER_HPP_
+
+#include <array>
+#include <vector>
+
+#include "hs_progress/progress_utility/progress_manager.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Triangles sharing an edge with each triangle: those of triangle i are
+ *  neighbours[begins[i], begins[i + 1]). Collapsed edges are skipped.
+ */
+HS_EXPORT void TriangleNeighbours(
+  const std::vector<std::array<size_t, 3> >& triangles,
+  std::vector<size_t>& begins,
+  std::vector<size_t>& neighbours);
+
+/**
+ *  Picks the image each triangle is textured from among its candidates,
+ *  trading the data cost of each pick against a constant cost for every
+ *  pair of neighbouring triangles textured from different images, so that
+ *  seams between photos become few and short.
+ *
+ *  The energy is lowered by alpha expansion: each move lets the triangles
+ *  that may take one image switch to it or keep their own, and is solved
+ *  exactly as a minimum cut. A move only spans the triangles that are
+ *  candidates of its image.
+ */
+class HS_EXPORT ViewLabelSmoother
+{
+public:
+  typedef double Scalar;
+  typedef std::array<size_t, 3> Triangle;
+  typedef std::vector<Triangle> TriangleContainer;
+
+  //Label of triangles without candidates.
+  static const size_t NO_LABEL = size_t(-1);
+
+  /**
+   *  smoothness is the cost of a seam along one edge, in the units of the
+   *  data costs. Stops after number_of_sweeps rounds over the images or
+   *  once a round changes nothing.
+   */
+  ViewLabelSmoother(Scalar smoothness, size_t number_of_sweeps = 4);
+
+  /**
+   *  The candidates of triangle i are candidates[begins[i], begins[i + 1])
+   *  with their data costs at the same positions, none negative. labels
+   *  holds the starting pick of each triangle, one of its candidates or
+   *  NO_LABEL when it has none, and receives the result.
+   */
+  int operator() (const TriangleContainer& triangles,
+                  const std::vector<size_t>& begins,
+                  const std::vector<size_t>& candidates,
+                  const std::vector<Scalar>& costs,
+                  std::vector<size_t>& labels,
+                  hs::progress::ProgressManager* progress_manager =
+                    nullptr) const;
+
+private:
+  Scalar smoothness_;
+  size_t number_of_sweeps_;
+};
+
+}
+}
+}
+
+#endif
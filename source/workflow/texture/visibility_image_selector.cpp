@@ -0,0 +1,775 @@
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <mutex>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/visibility_image_selector.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::VisibilityImageSelector Selector;
+typedef Selector::Scalar Scalar;
+typedef Selector::Vertex Vertex;
+typedef Selector::VertexContainer VertexContainer;
+typedef Selector::Triangle Triangle;
+typedef Selector::TriangleContainer TriangleContainer;
+typedef Selector::ImageParams ImageParams;
+typedef Selector::ImageParamsContainer ImageParamsContainer;
+typedef hs::sfm::ProjectiveFunctions<Scalar> ProjectiveFunctions;
+typedef EIGEN_VECTOR(Scalar, 2) Key;
+typedef EIGEN_STD_VECTOR(Key) KeyContainer;
+typedef EIGEN_MATRIX(Scalar, 3, 3) Matrix33;
+
+const size_t TRIANGLE_BLOCK = 1 << 12;
+const size_t LEAF_SIZE = 4;
+const size_t NO_SLOT = size_t(-1);
+//Widening of the frustums for lens distortion.
+const Scalar FRUSTUM_MARGIN = 0.1;
+//How far behind the depth buffer, relative to its depth, a triangle too
+//small to cover a pixel may lie and still be seen.
+const Scalar DEPTH_TOLERANCE = 0.01;
+//Triangles reaching out of a photo only go to it when no photo holds them.
+const Scalar PARTIAL_WEIGHT = 1e-3;
+
+struct Box
+{
+  Box()
+    : min(Vertex::Constant(std::numeric_limits<Scalar>::max()))
+    , max(Vertex::Constant(-std::numeric_limits<Scalar>::max())) {}
+
+  void Extend(const Vertex& point)
+  {
+    min = min.cwiseMin(point);
+    max = max.cwiseMax(point);
+  }
+
+  void Extend(const Box& box)
+  {
+    min = min.cwiseMin(box.min);
+    max = max.cwiseMax(box.max);
+  }
+
+  bool Overlaps(const Box& box) const
+  {
+    return (min.array() <= box.max.array()).all() &&
+           (box.min.array() <= max.array()).all();
+  }
+
+  bool Empty() const
+  {
+    return !(min.array() <= max.array()).all();
+  }
+
+  Vertex min;
+  Vertex max;
+};
+
+/**
+ *  Side planes of the view of an image and the plane of its camera centre,
+ *  normals pointing inwards, with the box they cut from the scene.
+ */
+struct Frustum
+{
+  Frustum() : valid(false) {}
+
+  //Conservative: only triangles wholly outside one plane are rejected.
+  bool Holds(const Vertex& a, const Vertex& b, const Vertex& c) const
+  {
+    for (int i = 0; i < 5; i++)
+    {
+      if (normals[i].dot(a - centre) < 0 &&
+          normals[i].dot(b - centre) < 0 &&
+          normals[i].dot(c - centre) < 0)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Vertex centre;
+  Vertex normals[5];
+  Box box;
+  bool valid;
+};
+
+void BuildFrustum(const ImageParams& image, const Box& scene,
+                  Frustum& frustum)
+{
+  const Selector::IntrinsicParams& intrinsic_params = image.intrinsic_params;
+  Scalar focal_length = intrinsic_params.focal_length();
+  Scalar focal_length_y = focal_length * intrinsic_params.pixel_ratio();
+  if (image.image_width == 0 || image.image_height == 0 ||
+      !(focal_length > 0) || !(focal_length_y > 0))
+  {
+    return;
+  }
+  Matrix33 rotation(image.extrinsic_params.rotation());
+  Matrix33 inverse_rotation = rotation.transpose();
+  frustum.centre = image.extrinsic_params.position();
+
+  //Image corners in normalized coordinates, in turn around the image.
+  Scalar corners[4][2] =
+  {
+    {0, 0},
+    {Scalar(image.image_width), 0},
+    {Scalar(image.image_width), Scalar(image.image_height)},
+    {0, Scalar(image.image_height)}
+  };
+  Key normalized[4];
+  Key middle = Key::Zero();
+  for (int i = 0; i < 4; i++)
+  {
+    Scalar y = (corners[i][1] - intrinsic_params.principal_point_y()) /
+               focal_length_y;
+    Scalar x = (corners[i][0] - intrinsic_params.principal_point_x() -
+                intrinsic_params.skew() * y) / focal_length;
+    normalized[i] << x, y;
+    middle += normalized[i] / 4;
+  }
+  Vertex rays[4];
+  for (int i = 0; i < 4; i++)
+  {
+    Key corner = middle + (normalized[i] - middle) * (1 + FRUSTUM_MARGIN);
+    rays[i] = inverse_rotation * Vertex(corner[0], corner[1], 1);
+  }
+  Vertex forward = inverse_rotation.col(2);
+
+  //Deepest the scene reaches along the view.
+  Scalar far = 0;
+  for (int i = 0; i < 8; i++)
+  {
+    Vertex corner((i & 1) ? scene.max[0] : scene.min[0],
+                  (i & 2) ? scene.max[1] : scene.min[1],
+                  (i & 4) ? scene.max[2] : scene.min[2]);
+    far = std::max(far, forward.dot(corner - frustum.centre));
+  }
+  if (!(far > 0)) return;
+
+  frustum.box.Extend(frustum.centre);
+  for (int i = 0; i < 4; i++)
+  {
+    Vertex normal = rays[i].cross(rays[(i + 1) % 4]);
+    if (normal.dot(forward) < 0) normal = -normal;
+    frustum.normals[i] = normal;
+    frustum.box.Extend(Vertex(frustum.centre + rays[i] * far));
+  }
+  frustum.normals[4] = forward;
+  frustum.box.min = frustum.box.min.cwiseMax(scene.min);
+  frustum.box.max = frustum.box.max.cwiseMin(scene.max);
+  frustum.valid = !frustum.box.Empty();
+}
+
+struct CentroidLess
+{
+  CentroidLess(const std::vector<Frustum>& frustums_, int axis_)
+    : frustums(frustums_), axis(axis_) {}
+
+  bool operator() (size_t first, size_t second) const
+  {
+    const Box& first_box = frustums[first].box;
+    const Box& second_box = frustums[second].box;
+    return first_box.min[axis] + first_box.max[axis] <
+           second_box.min[axis] + second_box.max[axis];
+  }
+
+  const std::vector<Frustum>& frustums;
+  int axis;
+};
+
+/**
+ *  Bounding volume hierarchy over the boxes of the valid frustums, split at
+ *  the median centre along the longest axis.
+ */
+class FrustumHierarchy
+{
+public:
+  FrustumHierarchy(const std::vector<Frustum>& frustums)
+    : frustums_(frustums)
+  {
+    for (size_t i = 0; i < frustums_.size(); i++)
+    {
+      if (frustums_[i].valid) order_.push_back(i);
+    }
+    if (!order_.empty()) Build(0, order_.size());
+  }
+
+  //Images whose frustum may see part of abc, appended to images.
+  void Query(const Vertex& a, const Vertex& b, const Vertex& c,
+             std::vector<size_t>& stack, std::vector<size_t>& images) const
+  {
+    if (nodes_.empty()) return;
+    Box box;
+    box.Extend(a);
+    box.Extend(b);
+    box.Extend(c);
+    stack.clear();
+    stack.push_back(0);
+    while (!stack.empty())
+    {
+      const Node& node = nodes_[stack.back()];
+      stack.pop_back();
+      if (!node.box.Overlaps(box)) continue;
+      if (node.left == 0)
+      {
+        for (size_t i = node.begin; i < node.end; i++)
+        {
+          const Frustum& frustum = frustums_[order_[i]];
+          if (frustum.box.Overlaps(box) && frustum.Holds(a, b, c))
+          {
+            images.push_back(order_[i]);
+          }
+        }
+      }
+      else
+      {
+        stack.push_back(node.left);
+        stack.push_back(node.right);
+      }
+    }
+  }
+
+private:
+  //A leaf when left is 0, the root never being a child.
+  struct Node
+  {
+    Box box;
+    size_t begin;
+    size_t end;
+    size_t left;
+    size_t right;
+  };
+
+  size_t Build(size_t begin, size_t end)
+  {
+    size_t node_id = nodes_.size();
+    nodes_.push_back(Node());
+    Box box;
+    Box centres;
+    for (size_t i = begin; i < end; i++)
+    {
+      const Box& frustum_box = frustums_[order_[i]].box;
+      box.Extend(frustum_box);
+      centres.Extend(Vertex((frustum_box.min + frustum_box.max) / 2));
+    }
+    nodes_[node_id].box = box;
+    nodes_[node_id].begin = begin;
+    nodes_[node_id].end = end;
+    nodes_[node_id].left = 0;
+    nodes_[node_id].right = 0;
+    if (end - begin <= LEAF_SIZE) return node_id;
+
+    int axis = 0;
+    Vertex extent = centres.max - centres.min;
+    if (extent[1] > extent[axis]) axis = 1;
+    if (extent[2] > extent[axis]) axis = 2;
+    size_t middle = begin + (end - begin) / 2;
+    std::nth_element(order_.begin() + begin, order_.begin() + middle,
+                     order_.begin() + end, CentroidLess(frustums_, axis));
+    size_t left = Build(begin, middle);
+    size_t right = Build(middle, end);
+    nodes_[node_id].left = left;
+    nodes_[node_id].right = right;
+    return node_id;
+  }
+
+  const std::vector<Frustum>& frustums_;
+  std::vector<size_t> order_;
+  std::vector<Node> nodes_;
+};
+
+/**
+ *  Candidate images of each triangle. Counts them into begins[i + 1] first,
+ *  then, with begins turned into offsets, writes them in ascending order.
+ */
+struct CandidateWorker
+{
+  CandidateWorker(const FrustumHierarchy& hierarchy_,
+                  const VertexContainer& vertices_,
+                  const TriangleContainer& triangles_,
+                  bool counting_,
+                  std::vector<size_t>& begins_,
+                  std::vector<size_t>& candidates_)
+    : hierarchy(hierarchy_)
+    , vertices(vertices_)
+    , triangles(triangles_)
+    , counting(counting_)
+    , begins(begins_)
+    , candidates(candidates_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    std::vector<size_t> stack;
+    std::vector<size_t> images;
+    for (size_t i = begin; i < end; i++)
+    {
+      images.clear();
+      hierarchy.Query(vertices[triangles[i][0]],
+                      vertices[triangles[i][1]],
+                      vertices[triangles[i][2]],
+                      stack, images);
+      if (counting)
+      {
+        begins[i + 1] = images.size();
+      }
+      else
+      {
+        std::sort(images.begin(), images.end());
+        std::copy(images.begin(), images.end(),
+                  candidates.begin() + begins[i]);
+      }
+    }
+  }
+
+  const FrustumHierarchy& hierarchy;
+  const VertexContainer& vertices;
+  const TriangleContainer& triangles;
+  bool counting;
+  std::vector<size_t>& begins;
+  std::vector<size_t>& candidates;
+};
+
+/**
+ *  Renders the candidate triangles of each image into a depth buffer and
+ *  scores the visible ones by the photo pixels they cover.
+ */
+struct VisibilityWorker
+{
+  enum State
+  {
+    STATE_HIDDEN = 0,
+    //In front of the camera.
+    STATE_PROJECTED,
+    //Over at least one pixel centre of the depth buffer.
+    STATE_COVERED,
+    STATE_VISIBLE
+  };
+
+  VisibilityWorker(const ImageParamsContainer& images_,
+                   const VertexContainer& vertices_,
+                   const TriangleContainer& triangles_,
+                   const std::vector<size_t>& slot_triangles_,
+                   const std::vector<size_t>& image_begins_,
+                   const std::vector<size_t>& image_slots_,
+                   const std::vector<bool>& rendered_images_,
+                   size_t depth_buffer_size_,
+                   hs::progress::ProgressManager* progress_manager_,
+                   std::vector<Scalar>& scores_)
+    : images(images_)
+    , vertices(vertices_)
+    , triangles(triangles_)
+    , slot_triangles(slot_triangles_)
+    , image_begins(image_begins_)
+    , image_slots(image_slots_)
+    , rendered_images(rendered_images_)
+    , depth_buffer_size(depth_buffer_size_)
+    , progress_manager(progress_manager_)
+    , scores(scores_)
+    , number_of_rendered(0)
+    , cancelled(false) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    std::vector<Scalar> buffer;
+    std::vector<size_t> owners;
+    KeyContainer keys;
+    std::vector<Scalar> inverse_depths;
+    std::vector<char> states;
+    for (size_t image_id = begin; image_id < end; image_id++)
+    {
+      if (cancelled) return;
+      Render(image_id, buffer, owners, keys, inverse_depths, states);
+      Report();
+    }
+  }
+
+  void Render(size_t image_id,
+              std::vector<Scalar>& buffer,
+              std::vector<size_t>& owners,
+              KeyContainer& keys,
+              std::vector<Scalar>& inverse_depths,
+              std::vector<char>& states)
+  {
+    const ImageParams& image = images[image_id];
+    size_t slot_begin = image_begins[image_id];
+    size_t number_of_slots = image_begins[image_id + 1] - slot_begin;
+    if (number_of_slots == 0 || !rendered_images[image_id]) return;
+
+    Scalar width = Scalar(image.image_width);
+    Scalar height = Scalar(image.image_height);
+    Scalar scale = std::min(Scalar(1),
+                            Scalar(depth_buffer_size) /
+                            std::max(width, height));
+    size_t buffer_width = std::max(size_t(std::ceil(width * scale)),
+                                   size_t(1));
+    size_t buffer_height = std::max(size_t(std::ceil(height * scale)),
+                                    size_t(1));
+    //Inverse depths, 0 where nothing was drawn.
+    buffer.assign(buffer_width * buffer_height, 0);
+    owners.assign(buffer_width * buffer_height, NO_SLOT);
+    keys.resize(number_of_slots * 3);
+    inverse_depths.resize(number_of_slots * 3);
+    states.assign(number_of_slots, char(STATE_HIDDEN));
+
+    Matrix33 rotation(image.extrinsic_params.rotation());
+    Vertex forward = rotation.row(2).transpose();
+    const Vertex& centre = image.extrinsic_params.position();
+    for (size_t k = 0; k < number_of_slots; k++)
+    {
+      const Triangle& triangle =
+        triangles[slot_triangles[image_slots[slot_begin + k]]];
+      bool projected = true;
+      for (int j = 0; j < 3 && projected; j++)
+      {
+        const Vertex& vertex = vertices[triangle[j]];
+        Scalar depth = forward.dot(vertex - centre);
+        Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                    image.intrinsic_params, image.extrinsic_params, vertex);
+        projected = depth > 0 && std::isfinite(key[0]) &&
+                    std::isfinite(key[1]);
+        keys[k * 3 + j] = key;
+        inverse_depths[k * 3 + j] = 1 / depth;
+      }
+      if (!projected) continue;
+      states[k] = char(STATE_PROJECTED);
+      if (Draw(k, scale, buffer_width, buffer_height, keys, inverse_depths,
+               buffer, owners))
+      {
+        states[k] = char(STATE_COVERED);
+      }
+    }
+
+    for (size_t i = 0; i < owners.size(); i++)
+    {
+      if (owners[i] != NO_SLOT) states[owners[i]] = char(STATE_VISIBLE);
+    }
+    //Triangles between the pixel centres are judged by their centroid.
+    for (size_t k = 0; k < number_of_slots; k++)
+    {
+      if (states[k] != char(STATE_PROJECTED)) continue;
+      Key centroid = (keys[k * 3] + keys[k * 3 + 1] + keys[k * 3 + 2]) *
+                     (scale / 3);
+      if (!(centroid[0] >= 0) || !(centroid[1] >= 0)) continue;
+      size_t column = size_t(centroid[0]);
+      size_t row = size_t(centroid[1]);
+      if (column >= buffer_width || row >= buffer_height) continue;
+      Scalar inverse_depth = (inverse_depths[k * 3] +
+                              inverse_depths[k * 3 + 1] +
+                              inverse_depths[k * 3 + 2]) / 3;
+      if (buffer[row * buffer_width + column] <=
+          inverse_depth * (1 + DEPTH_TOLERANCE))
+      {
+        states[k] = char(STATE_VISIBLE);
+      }
+    }
+
+    for (size_t k = 0; k < number_of_slots; k++)
+    {
+      if (states[k] != char(STATE_VISIBLE)) continue;
+      const Key& a = keys[k * 3];
+      const Key& b = keys[k * 3 + 1];
+      const Key& c = keys[k * 3 + 2];
+      Scalar score = std::abs((b[0] - a[0]) * (c[1] - a[1]) -
+                              (b[1] - a[1]) * (c[0] - a[0])) / 2;
+      for (int j = 0; j < 3; j++)
+      {
+        const Key& key = keys[k * 3 + j];
+        if (key[0] < 0 || key[1] < 0 || key[0] > width || key[1] > height)
+        {
+          score *= PARTIAL_WEIGHT;
+          break;
+        }
+      }
+      scores[image_slots[slot_begin + k]] = score;
+    }
+  }
+
+  //Whether the triangle lies over any pixel centre.
+  static bool Draw(size_t k, Scalar scale,
+                   size_t buffer_width, size_t buffer_height,
+                   const KeyContainer& keys,
+                   const std::vector<Scalar>& inverse_depths,
+                   std::vector<Scalar>& buffer,
+                   std::vector<size_t>& owners)
+  {
+    Key a = keys[k * 3] * scale;
+    Key b = keys[k * 3 + 1] * scale;
+    Key c = keys[k * 3 + 2] * scale;
+    Scalar area = (b[0] - a[0]) * (c[1] - a[1]) -
+                  (b[1] - a[1]) * (c[0] - a[0]);
+    if (area == 0) return false;
+    Scalar first_column =
+      std::max(std::ceil(std::min(a[0], std::min(b[0], c[0])) - 0.5),
+               Scalar(0));
+    Scalar last_column =
+      std::min(std::floor(std::max(a[0], std::max(b[0], c[0])) - 0.5),
+               Scalar(buffer_width) - 1);
+    Scalar first_row =
+      std::max(std::ceil(std::min(a[1], std::min(b[1], c[1])) - 0.5),
+               Scalar(0));
+    Scalar last_row =
+      std::min(std::floor(std::max(a[1], std::max(b[1], c[1])) - 0.5),
+               Scalar(buffer_height) - 1);
+    if (first_column > last_column || first_row > last_row) return false;
+
+    //Inverse depth is linear in the image, depth itself is not.
+    bool covered = false;
+    for (size_t row = size_t(first_row); row <= size_t(last_row); row++)
+    {
+      Scalar y = Scalar(row) + 0.5;
+      for (size_t column = size_t(first_column);
+           column <= size_t(last_column); column++)
+      {
+        Scalar x = Scalar(column) + 0.5;
+        Scalar wa = ((b[0] - x) * (c[1] - y) - (b[1] - y) * (c[0] - x)) /
+                    area;
+        Scalar wb = ((c[0] - x) * (a[1] - y) - (c[1] - y) * (a[0] - x)) /
+                    area;
+        Scalar wc = 1 - wa - wb;
+        if (wa < 0 || wb < 0 || wc < 0) continue;
+        covered = true;
+        Scalar inverse_depth = wa * inverse_depths[k * 3] +
+                               wb * inverse_depths[k * 3 + 1] +
+                               wc * inverse_depths[k * 3 + 2];
+        size_t pixel_id = row * buffer_width + column;
+        if (inverse_depth > buffer[pixel_id])
+        {
+          buffer[pixel_id] = inverse_depth;
+          owners[pixel_id] = k;
+        }
+      }
+    }
+    return covered;
+  }
+
+  void Report()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    number_of_rendered++;
+    if (!progress_manager) return;
+    if (!progress_manager->CheckKeepWorking())
+    {
+      cancelled = true;
+      return;
+    }
+    progress_manager->SetCurrentSubProgressCompleteRatio(
+      float(number_of_rendered) / float(images.size()));
+  }
+
+  const ImageParamsContainer& images;
+  const VertexContainer& vertices;
+  const TriangleContainer& triangles;
+  const std::vector<size_t>& slot_triangles;
+  const std::vector<size_t>& image_begins;
+  const std::vector<size_t>& image_slots;
+  const std::vector<bool>& rendered_images;
+  size_t depth_buffer_size;
+  hs::progress::ProgressManager* progress_manager;
+  std::vector<Scalar>& scores;
+  std::mutex mutex;
+  size_t number_of_rendered;
+  std::atomic<bool> cancelled;
+};
+
+//Best scored candidate of each triangle, the lower image on a tie.
+struct SelectWorker
+{
+  SelectWorker(const std::vector<size_t>& begins_,
+               const std::vector<size_t>& candidates_,
+               const std::vector<Scalar>& scores_,
+               std::vector<size_t>& triangle_image_indices_)
+    : begins(begins_)
+    , candidates(candidates_)
+    , scores(scores_)
+    , triangle_image_indices(triangle_image_indices_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    for (size_t i = begin; i < end; i++)
+    {
+      size_t best_image = Selector::NO_IMAGE;
+      Scalar best_score = 0;
+      for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+      {
+        if (scores[slot] > best_score)
+        {
+          best_score = scores[slot];
+          best_image = candidates[slot];
+        }
+      }
+      triangle_image_indices[i] = best_image;
+    }
+  }
+
+  const std::vector<size_t>& begins;
+  const std::vector<size_t>& candidates;
+  const std::vector<Scalar>& scores;
+  std::vector<size_t>& triangle_image_indices;
+};
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+const size_t VisibilityImageSelector::NO_IMAGE;
+
+VisibilityImageSelector::VisibilityImageSelector(size_t number_of_threads,
+                                                 size_t depth_buffer_size)
+  : number_of_threads_(std::max(number_of_threads, size_t(1)))
+  , depth_buffer_size_(std::max(depth_buffer_size, size_t(1)))
+{
+}
+
+void VisibilityImageSelector::set_triangle_ids(
+  const std::vector<size_t>& triangle_ids)
+{
+  triangle_ids_ = triangle_ids;
+}
+
+int VisibilityImageSelector::operator() (
+  const ImageParamsContainer& images,
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  std::vector<size_t>& triangle_image_indices,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  std::vector<size_t> begins;
+  std::vector<size_t> candidates;
+  std::vector<Scalar> scores;
+  if (Score(images, vertices, triangles, begins, candidates, scores,
+            progress_manager) != 0)
+  {
+    return -1;
+  }
+  triangle_image_indices.assign(triangles.size(), NO_IMAGE);
+  SelectWorker select_worker(begins, candidates, scores,
+                             triangle_image_indices);
+  ParallelFor(0, triangles.size(), number_of_threads_, select_worker);
+  return 0;
+}
+
+int VisibilityImageSelector::Score(
+  const ImageParamsContainer& images,
+  const VertexContainer& vertices,
+  const TriangleContainer& triangles,
+  std::vector<size_t>& begins,
+  std::vector<size_t>& candidates,
+  std::vector<Scalar>& scores,
+  hs::progress::ProgressManager* progress_manager) const
+{
+  begins.assign(triangles.size() + 1, 0);
+  candidates.clear();
+  scores.clear();
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    if (triangles[i][0] >= vertices.size() ||
+        triangles[i][1] >= vertices.size() ||
+        triangles[i][2] >= vertices.size())
+    {
+      return -1;
+    }
+  }
+  std::vector<bool> selected(triangles.size(), triangle_ids_.empty());
+  for (size_t i = 0; i < triangle_ids_.size(); i++)
+  {
+    if (triangle_ids_[i] >= triangles.size()) return -1;
+    selected[triangle_ids_[i]] = true;
+  }
+  if (triangles.empty() || images.empty()) return 0;
+
+  Box scene;
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    scene.Extend(vertices[i]);
+  }
+  std::vector<Frustum> frustums(images.size());
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    BuildFrustum(images[i], scene, frustums[i]);
+  }
+  FrustumHierarchy hierarchy(frustums);
+
+  //Candidate images of each triangle, offsets first. Triangles not
+  //selected are kept too, they may hide selected ones.
+  CandidateWorker count_worker(hierarchy, vertices, triangles, true,
+                               begins, candidates);
+  ParallelForDynamic(0, triangles.size(), number_of_threads_,
+                     TRIANGLE_BLOCK, count_worker);
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    begins[i + 1] += begins[i];
+  }
+  candidates.resize(begins.back());
+  CandidateWorker fill_worker(hierarchy, vertices, triangles, false,
+                              begins, candidates);
+  ParallelForDynamic(0, triangles.size(), number_of_threads_,
+                     TRIANGLE_BLOCK, fill_worker);
+
+  //The same slots grouped by image, so that each image writes only the
+  //scores of its own slots.
+  std::vector<size_t> slot_triangles(candidates.size());
+  std::vector<size_t> image_begins(images.size() + 1, 0);
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      slot_triangles[slot] = i;
+      image_begins[candidates[slot] + 1]++;
+    }
+  }
+  for (size_t i = 0; i < images.size(); i++)
+  {
+    image_begins[i + 1] += image_begins[i];
+  }
+  std::vector<size_t> image_slots(candidates.size());
+  std::vector<size_t> image_ends(image_begins.begin(),
+                                 image_begins.end() - 1);
+  for (size_t slot = 0; slot < candidates.size(); slot++)
+  {
+    image_slots[image_ends[candidates[slot]]++] = slot;
+  }
+
+  //Only images that may see a selected triangle are rendered.
+  std::vector<bool> rendered_images(images.size(), false);
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    if (!selected[i]) continue;
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      rendered_images[candidates[slot]] = true;
+    }
+  }
+
+  scores.assign(candidates.size(), 0);
+  VisibilityWorker visibility_worker(images, vertices, triangles,
+                                     slot_triangles, image_begins,
+                                     image_slots, rendered_images,
+                                     depth_buffer_size_,
+                                     progress_manager, scores);
+  ParallelForDynamic(0, images.size(), number_of_threads_, 1,
+                     visibility_worker);
+  if (visibility_worker.cancelled) return -1;
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    if (selected[i]) continue;
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      scores[slot] = 0;
+    }
+  }
+  return 0;
+}
+
+}
+}
+}
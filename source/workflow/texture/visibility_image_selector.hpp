@@ -0,0 +1,104 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_VISIBILITY_IMAGE_SELECTOR_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_VISIBILITY_IMAGE_SELECTOR_HPP_
+
+#include <array>
+#include <vector>
+
+#include "hs_math/linear_algebra/eigen_macro.hpp"
+#include "hs_progress/progress_utility/progress_manager.hpp"
+#include "hs_sfm/sfm_utility/camera_type.hpp"
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Picks the image each triangle of a mesh is textured from.
+ *
+ *  The view frustums of the images are indexed by a bounding volume
+ *  hierarchy, so each triangle is only tested against the images that can
+ *  see its place. Every image then renders its candidate triangles into a
+ *  depth buffer, keeping those not hidden behind others, and each triangle
+ *  goes to the image it covers the most pixels of. Images are rendered
+ *  concurrently.
+ */
+class HS_EXPORT VisibilityImageSelector
+{
+public:
+  typedef double Scalar;
+  typedef EIGEN_VECTOR(Scalar, 3) Vertex;
+  typedef EIGEN_STD_VECTOR(Vertex) VertexContainer;
+  typedef std::array<size_t, 3> Triangle;
+  typedef std::vector<Triangle> TriangleContainer;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+  typedef hs::sfm::CameraExtrinsicParams<Scalar> ExtrinsicParams;
+
+  //Cameras in the frame of the vertices.
+  struct ImageParams
+  {
+    IntrinsicParams intrinsic_params;
+    ExtrinsicParams extrinsic_params;
+    size_t image_width;
+    size_t image_height;
+  };
+  typedef EIGEN_STD_VECTOR(ImageParams) ImageParamsContainer;
+
+  //Image index of triangles no image sees.
+  static const size_t NO_IMAGE = size_t(-1);
+
+  /**
+   *  Depth buffers are at most depth_buffer_size pixels on their longer
+   *  side, coarser than the photos they stand for.
+   */
+  VisibilityImageSelector(size_t number_of_threads,
+                          size_t depth_buffer_size = 1024);
+
+  /**
+   *  Select images only for the triangles at these indices, for every
+   *  triangle if empty. The others still hide them, but get NO_IMAGE and
+   *  no scores, and images that may see none of them are not rendered.
+   *  Fails on an index past the triangles.
+   */
+  void set_triangle_ids(const std::vector<size_t>& triangle_ids);
+
+  /**
+   *  Fails on a triangle referring to a missing vertex or when the
+   *  progress manager asks to stop.
+   */
+  int operator() (const ImageParamsContainer& images,
+                  const VertexContainer& vertices,
+                  const TriangleContainer& triangles,
+                  std::vector<size_t>& triangle_image_indices,
+                  hs::progress::ProgressManager* progress_manager =
+                    nullptr) const;
+
+  /**
+   *  Every image that may see each triangle, scored by the photo pixels the
+   *  triangle covers in it, 0 where hidden. The images of triangle i are
+   *  candidates[begins[i], begins[i + 1]) in ascending order, with their
+   *  scores at the same positions.
+   */
+  int Score(const ImageParamsContainer& images,
+            const VertexContainer& vertices,
+            const TriangleContainer& triangles,
+            std::vector<size_t>& begins,
+            std::vector<size_t>& candidates,
+            std::vector<Scalar>& scores,
+            hs::progress::ProgressManager* progress_manager = nullptr) const;
+
+private:
+  size_t number_of_threads_;
+  size_t depth_buffer_size_;
+  std::vector<size_t> triangle_ids_;
+};
+
+}
+}
+}
+
+#endif
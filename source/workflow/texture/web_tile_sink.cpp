@@ -0,0 +1,713 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/common/parallel_for.hpp"
+#include "workflow/texture/web_tile_sink.hpp"
+
+namespace
+{
+
+const double PI = 3.14159265358979323846;
+const double EARTH_RADIUS = 6378137.0;
+//Half the width of the Web Mercator plane.
+const double ORIGIN_SHIFT = PI * EARTH_RADIUS;
+//Web Mercator stops short of the poles.
+const double MAX_LATITUDE = 85.0511287798066;
+const size_t TILE_SIZE = hs::recon::workflow::WebTileSink::TILE_SIZE;
+//Pixels between exact reprojections, those in between are interpolated.
+const size_t LATTICE_STEP = 16;
+const size_t LATTICE_SIZE = TILE_SIZE / LATTICE_STEP + 1;
+//Raster samples taken along each edge to find its geographic extent.
+const size_t NUMBER_OF_EDGE_SAMPLES = 64;
+
+double MercatorX(double longitude)
+{
+  return EARTH_RADIUS * longitude * PI / 180.0;
+}
+
+double MercatorY(double latitude)
+{
+  latitude = std::max(-MAX_LATITUDE, std::min(MAX_LATITUDE, latitude));
+  return EARTH_RADIUS * std::log(std::tan(PI / 4.0 + latitude * PI / 360.0));
+}
+
+double Longitude(double mercator_x)
+{
+  return mercator_x / EARTH_RADIUS * 180.0 / PI;
+}
+
+double Latitude(double mercator_y)
+{
+  return (2.0 * std::atan(std::exp(mercator_y / EARTH_RADIUS)) - PI / 2.0) *
+         180.0 / PI;
+}
+
+//Ground size of a pixel of a zoom at the equator.
+double Resolution(int zoom)
+{
+  return 2.0 * ORIGIN_SHIFT / (double(TILE_SIZE) * double(size_t(1) << zoom));
+}
+
+size_t TileIndex(double offset, double tile_span, int zoom)
+{
+  double index = std::floor(offset / tile_span);
+  double last = double((size_t(1) << zoom) - 1);
+  return size_t(std::max(0.0, std::min(last, index)));
+}
+
+}
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+void WebTileSink::WebTile::Swap(WebTile& other)
+{
+  std::swap(x, other.x);
+  std::swap(y, other.y);
+  std::swap(number_of_children, other.number_of_children);
+  pixels.swap(other.pixels);
+}
+
+//Finds the raster tiles under each finest tile from samples of its edges.
+struct WebTileSink::FootprintWorker
+{
+  FootprintWorker(WebTileSink& sink_) : sink(sink_) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    const Level& level = sink.levels_[0];
+    const RasterGrid& grid = sink.grid_;
+    double resolution = Resolution(level.zoom);
+    for (size_t i = begin; i < end; i++)
+    {
+      size_t x = level.min_x + i % level.NumberOfColumns();
+      size_t y = level.min_y + i / level.NumberOfColumns();
+      double min_column = std::numeric_limits<double>::max();
+      double min_row = std::numeric_limits<double>::max();
+      double max_column = -std::numeric_limits<double>::max();
+      double max_row = -std::numeric_limits<double>::max();
+      for (size_t k = 0; k < 4 * (LATTICE_SIZE - 1); k++)
+      {
+        size_t side = k / (LATTICE_SIZE - 1);
+        size_t step = (k % (LATTICE_SIZE - 1)) * LATTICE_STEP;
+        size_t end = TILE_SIZE;
+        size_t u = side == 0 ? step : side == 1 ? end :
+                   side == 2 ? end - step : 0;
+        size_t v = side == 0 ? 0 : side == 1 ? step :
+                   side == 2 ? end : end - step;
+        double mercator_x =
+          -ORIGIN_SHIFT + double(x * TILE_SIZE + u) * resolution;
+        double mercator_y =
+          ORIGIN_SHIFT - double(y * TILE_SIZE + v) * resolution;
+        double column = 0, row = 0;
+        if (!sink.MercatorToRaster(mercator_x, mercator_y, column, row))
+        {
+          continue;
+        }
+        min_column = std::min(min_column, column);
+        min_row = std::min(min_row, row);
+        max_column = std::max(max_column, column);
+        max_row = std::max(max_row, row);
+      }
+
+      //A pixel of margin for the interpolation.
+      FinestTile& tile = sink.finest_tiles_[i];
+      if (min_column > max_column ||
+          max_column < -1.0 || min_column > double(grid.width) + 1.0 ||
+          max_row < -1.0 || min_row > double(grid.height) + 1.0)
+      {
+        continue;
+      }
+      size_t left = size_t(std::max(0.0, std::floor(min_column) - 1.0));
+      size_t top = size_t(std::max(0.0, std::floor(min_row) - 1.0));
+      size_t right = size_t(std::min(double(grid.width - 1),
+                                     std::floor(max_column) + 1.0));
+      size_t bottom = size_t(std::min(double(grid.height - 1),
+                                      std::floor(max_row) + 1.0));
+      tile.min_column = left / grid.tile_width;
+      tile.max_column = right / grid.tile_width;
+      tile.min_row = top / grid.tile_height;
+      tile.max_row = bottom / grid.tile_height;
+    }
+  }
+
+  WebTileSink& sink;
+};
+
+//Reprojects finest tiles from the raster tiles under them.
+struct WebTileSink::RenderWorker
+{
+  RenderWorker(const WebTileSink& sink_, const std::vector<size_t>& indices_)
+    : sink(sink_), indices(indices_), pixels(indices_.size()) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    const Level& level = sink.levels_[0];
+    double resolution = Resolution(level.zoom);
+    std::vector<double> lattice_columns(LATTICE_SIZE * LATTICE_SIZE);
+    std::vector<double> lattice_rows(LATTICE_SIZE * LATTICE_SIZE);
+    std::vector<bool> lattice_valid(LATTICE_SIZE * LATTICE_SIZE);
+    std::vector<uint8_t> neighbor(4);
+    for (size_t i = begin; i < end; i++)
+    {
+      const FinestTile& tile = sink.finest_tiles_[indices[i]];
+      if (tile.min_row > tile.max_row) continue;
+      size_t x = level.min_x + indices[i] % level.NumberOfColumns();
+      size_t y = level.min_y + indices[i] / level.NumberOfColumns();
+      for (size_t k = 0; k < LATTICE_SIZE * LATTICE_SIZE; k++)
+      {
+        double mercator_x = -ORIGIN_SHIFT +
+          double(x * TILE_SIZE + (k % LATTICE_SIZE) * LATTICE_STEP) *
+          resolution;
+        double mercator_y = ORIGIN_SHIFT -
+          double(y * TILE_SIZE + (k / LATTICE_SIZE) * LATTICE_STEP) *
+          resolution;
+        double column = 0, row = 0;
+        lattice_valid[k] =
+          sink.MercatorToRaster(mercator_x, mercator_y, column, row);
+        lattice_columns[k] = column;
+        lattice_rows[k] = row;
+      }
+
+      std::vector<uint8_t>& tile_pixels = pixels[i];
+      tile_pixels.assign(TILE_SIZE * TILE_SIZE * 4, 0);
+      bool empty = true;
+      for (size_t v = 0; v < TILE_SIZE; v++)
+      {
+        size_t lattice_v = v / LATTICE_STEP;
+        double fraction_v =
+          (double(v % LATTICE_STEP) + 0.5) / double(LATTICE_STEP);
+        for (size_t u = 0; u < TILE_SIZE; u++)
+        {
+          size_t lattice_u = u / LATTICE_STEP;
+          double fraction_u =
+            (double(u % LATTICE_STEP) + 0.5) / double(LATTICE_STEP);
+          size_t corner = lattice_v * LATTICE_SIZE + lattice_u;
+          size_t corners[4] = {corner, corner + 1, corner + LATTICE_SIZE,
+                               corner + LATTICE_SIZE + 1};
+          double weights[4] = {(1 - fraction_u) * (1 - fraction_v),
+                               fraction_u * (1 - fraction_v),
+                               (1 - fraction_u) * fraction_v,
+                               fraction_u * fraction_v};
+          double column = 0, row = 0;
+          bool valid = true;
+          for (size_t k = 0; k < 4; k++)
+          {
+            valid = valid && lattice_valid[corners[k]];
+            column += weights[k] * lattice_columns[corners[k]];
+            row += weights[k] * lattice_rows[corners[k]];
+          }
+          if (!valid) continue;
+
+          //Nothing where the nearest raster pixel is empty.
+          const uint8_t* nearest = Pixel(tile, std::floor(column),
+                                         std::floor(row));
+          if (!nearest) continue;
+
+          double sample_column = column - 0.5;
+          double sample_row = row - 0.5;
+          double left = std::floor(sample_column);
+          double top = std::floor(sample_row);
+          double sums[4] = {0, 0, 0, 0};
+          double sum_weight = 0;
+          for (size_t k = 0; k < 4; k++)
+          {
+            double neighbor_column = left + double(k % 2);
+            double neighbor_row = top + double(k / 2);
+            const uint8_t* pixel = Pixel(tile, neighbor_column, neighbor_row);
+            if (!pixel) continue;
+            double weight =
+              (1.0 - std::abs(sample_column - neighbor_column)) *
+              (1.0 - std::abs(sample_row - neighbor_row));
+            sink.ToRGBA(pixel, neighbor.data());
+            for (size_t c = 0; c < 3; c++)
+            {
+              sums[c] += weight * double(neighbor[c]);
+            }
+            sum_weight += weight;
+          }
+          uint8_t* target = &tile_pixels[(v * TILE_SIZE + u) * 4];
+          if (sum_weight <= 0)
+          {
+            sink.ToRGBA(nearest, target);
+          }
+          else
+          {
+            for (size_t c = 0; c < 3; c++)
+            {
+              target[c] = uint8_t(std::floor(sums[c] / sum_weight + 0.5));
+            }
+          }
+          target[3] = 255;
+          empty = false;
+        }
+      }
+      if (empty) std::vector<uint8_t>().swap(tile_pixels);
+    }
+  }
+
+  //Valid raster pixel at (column, row), null if there is none.
+  const uint8_t* Pixel(const FinestTile& tile,
+                       double column, double row) const
+  {
+    const RasterGrid& grid = sink.grid_;
+    if (column < 0 || row < 0 ||
+        column >= double(grid.width) || row >= double(grid.height))
+    {
+      return nullptr;
+    }
+    size_t pixel_column = size_t(column);
+    size_t pixel_row = size_t(row);
+    size_t tile_column = pixel_column / grid.tile_width;
+    size_t tile_row = pixel_row / grid.tile_height;
+    if (tile_column < tile.min_column || tile_column > tile.max_column ||
+        tile_row < tile.min_row || tile_row > tile.max_row)
+    {
+      return nullptr;
+    }
+    const std::vector<uint8_t>& raster_pixels =
+      sink.raster_pixels_[tile_row * grid.NumberOfTileColumns() +
+                          tile_column];
+    if (raster_pixels.empty()) return nullptr;
+    size_t offset =
+      ((pixel_row - tile_row * grid.tile_height) *
+       grid.TileWidth(tile_column) +
+       pixel_column - tile_column * grid.tile_width) * sink.channels_;
+    const uint8_t* pixel = &raster_pixels[offset];
+    return sink.ValidPixel(pixel) ? pixel : nullptr;
+  }
+
+  const WebTileSink& sink;
+  const std::vector<size_t>& indices;
+  std::vector<std::vector<uint8_t> > pixels;
+};
+
+//Writes tiles of a level and averages them down for their parents.
+struct WebTileSink::WriteWorker
+{
+  WriteWorker(const WebTileSink& sink_, size_t level_,
+              const WebTileContainer& tiles_)
+    : sink(sink_), level(level_), tiles(tiles_),
+      reduced(tiles_.size()), failed(false) {}
+
+  void operator() (size_t begin, size_t end)
+  {
+    typedef hs::imgio::whole::ImageData ImageData;
+
+    bool has_next_level = level + 1 < sink.levels_.size();
+    for (size_t i = begin; i < end; i++)
+    {
+      const WebTile& tile = tiles[i];
+      if (tile.pixels.empty()) continue;
+      int channels = sink.format_ == FORMAT_PNG ? 4 : 3;
+      ImageData image_data;
+      image_data.CreateImage(int(TILE_SIZE), int(TILE_SIZE), channels);
+      for (size_t row = 0; row < TILE_SIZE; row++)
+      {
+        for (size_t column = 0; column < TILE_SIZE; column++)
+        {
+          const uint8_t* pixel =
+            &tile.pixels[(row * TILE_SIZE + column) * 4];
+          for (int k = 0; k < channels; k++)
+          {
+            image_data.GetByte(int(row), int(column), k) = pixel[k];
+          }
+        }
+      }
+      hs::imgio::whole::ImageIO image_io;
+      if (image_io.SaveImage(
+            sink.TilePath(sink.levels_[level], tile.x, tile.y),
+            image_data) != 0)
+      {
+        failed = true;
+        return;
+      }
+      if (!has_next_level) continue;
+
+      size_t half = TILE_SIZE / 2;
+      std::vector<uint8_t>& pixels = reduced[i];
+      pixels.assign(half * half * 4, 0);
+      for (size_t y = 0; y < half; y++)
+      {
+        for (size_t x = 0; x < half; x++)
+        {
+          double sums[3] = {0, 0, 0};
+          size_t number_of_valid = 0;
+          for (size_t k = 0; k < 4; k++)
+          {
+            const uint8_t* source = &tile.pixels[
+              ((2 * y + k / 2) * TILE_SIZE + 2 * x + k % 2) * 4];
+            if (source[3] == 0) continue;
+            for (size_t c = 0; c < 3; c++)
+            {
+              sums[c] += double(source[c]);
+            }
+            number_of_valid++;
+          }
+          if (number_of_valid == 0) continue;
+          uint8_t* target = &pixels[(y * half + x) * 4];
+          for (size_t c = 0; c < 3; c++)
+          {
+            target[c] = uint8_t(
+              std::floor(sums[c] / double(number_of_valid) + 0.5));
+          }
+          target[3] = 255;
+        }
+      }
+    }
+  }
+
+  const WebTileSink& sink;
+  size_t level;
+  const WebTileContainer& tiles;
+  //Quarter of the parent tile, empty for tiles with nothing in them.
+  std::vector<std::vector<uint8_t> > reduced;
+  std::atomic<bool> failed;
+};
+
+WebTileSink::WebTileSink(const std::string& directory,
+                         const GeographicProjector& projector,
+                         int format, int scheme, size_t number_of_threads)
+  : directory_(directory)
+  , projector_(projector)
+  , format_(format)
+  , scheme_(scheme)
+  , number_of_threads_(number_of_threads)
+  , channels_(0)
+  , no_data_(0)
+{
+}
+
+int WebTileSink::Open(const RasterGrid& grid, size_t channels,
+                      uint8_t no_data)
+{
+  if (channels != 1 && channels != 3 && channels != 4) return -1;
+  if (grid.width == 0 || grid.height == 0) return -1;
+  grid_ = grid;
+  channels_ = channels;
+  no_data_ = no_data;
+  if (ComputeLevels() != 0) return -1;
+
+  for (size_t level = 0; level < levels_.size(); level++)
+  {
+    for (size_t x = levels_[level].min_x; x <= levels_[level].max_x; x++)
+    {
+      boost::system::error_code error_code;
+      boost::filesystem::create_directories(
+        boost::filesystem::path(TilePath(levels_[level], x, 0)).parent_path(),
+        error_code);
+      if (error_code) return -1;
+    }
+  }
+
+  const Level& finest = levels_[0];
+  finest_tiles_.assign(finest.NumberOfColumns() * finest.NumberOfRows(),
+                       FinestTile());
+  FootprintWorker footprint_worker(*this);
+  ParallelFor(0, finest_tiles_.size(), number_of_threads_, footprint_worker);
+
+  size_t number_of_raster_tiles = grid_.NumberOfTiles();
+  raster_dependents_.assign(number_of_raster_tiles, std::vector<size_t>());
+  raster_references_.assign(number_of_raster_tiles, 0);
+  raster_pixels_.assign(number_of_raster_tiles, std::vector<uint8_t>());
+  partial_tiles_.assign(levels_.size(), WebTileMap());
+  std::vector<size_t> ready;
+  for (size_t i = 0; i < finest_tiles_.size(); i++)
+  {
+    FinestTile& tile = finest_tiles_[i];
+    for (size_t row = tile.min_row; row <= tile.max_row; row++)
+    {
+      for (size_t column = tile.min_column; column <= tile.max_column;
+           column++)
+      {
+        size_t raster_id = row * grid_.NumberOfTileColumns() + column;
+        raster_dependents_[raster_id].push_back(i);
+        raster_references_[raster_id]++;
+        tile.number_of_missing++;
+      }
+    }
+    //Tiles outside the raster go up the pyramid empty right away.
+    if (tile.number_of_missing == 0) ready.push_back(i);
+  }
+  return Render(ready);
+}
+
+int WebTileSink::Write(const Tile& tile)
+{
+  if (tile.channels != channels_ ||
+      tile.row >= grid_.NumberOfTileRows() ||
+      tile.column >= grid_.NumberOfTileColumns() ||
+      tile.width != grid_.TileWidth(tile.column) ||
+      tile.height != grid_.TileHeight(tile.row) ||
+      tile.pixels.size() != tile.width * tile.height * tile.channels)
+  {
+    return -1;
+  }
+  size_t raster_id = tile.row * grid_.NumberOfTileColumns() + tile.column;
+  if (raster_references_[raster_id] == 0) return 0;
+  raster_pixels_[raster_id] = tile.pixels;
+
+  std::vector<size_t> ready;
+  const std::vector<size_t>& dependents = raster_dependents_[raster_id];
+  for (size_t i = 0; i < dependents.size(); i++)
+  {
+    FinestTile& finest_tile = finest_tiles_[dependents[i]];
+    if (--finest_tile.number_of_missing == 0 && !finest_tile.rendered)
+    {
+      ready.push_back(dependents[i]);
+    }
+  }
+  return Render(ready);
+}
+
+//Finest tiles some raster tile never came for are made of what there is.
+int WebTileSink::Close()
+{
+  std::vector<size_t> remaining;
+  for (size_t i = 0; i < finest_tiles_.size(); i++)
+  {
+    if (!finest_tiles_[i].rendered) remaining.push_back(i);
+  }
+  int result = Render(remaining);
+
+  finest_tiles_.clear();
+  raster_dependents_.clear();
+  raster_references_.clear();
+  raster_pixels_.clear();
+  partial_tiles_.clear();
+  return result;
+}
+
+int WebTileSink::min_zoom() const
+{
+  return levels_.empty() ? -1 : levels_.back().zoom;
+}
+
+int WebTileSink::max_zoom() const
+{
+  return levels_.empty() ? -1 : levels_.front().zoom;
+}
+
+int WebTileSink::ComputeLevels()
+{
+  levels_.clear();
+  double min_longitude = std::numeric_limits<double>::max();
+  double min_latitude = std::numeric_limits<double>::max();
+  double max_longitude = -std::numeric_limits<double>::max();
+  double max_latitude = -std::numeric_limits<double>::max();
+  double ground_width = double(grid_.width) * grid_.scale_x;
+  double ground_height = double(grid_.height) * grid_.scale_y;
+  for (size_t k = 0; k < 4 * NUMBER_OF_EDGE_SAMPLES; k++)
+  {
+    size_t side = k / NUMBER_OF_EDGE_SAMPLES;
+    double step =
+      double(k % NUMBER_OF_EDGE_SAMPLES) / double(NUMBER_OF_EDGE_SAMPLES);
+    double u = side == 0 ? step : side == 1 ? 1.0 :
+               side == 2 ? 1.0 - step : 0.0;
+    double v = side == 0 ? 0.0 : side == 1 ? step :
+               side == 2 ? 1.0 : 1.0 - step;
+    double longitude, latitude;
+    if (projector_.ToLongitudeLatitude(grid_.left + u * ground_width,
+                                       grid_.top - v * ground_height,
+                                       longitude, latitude) != 0)
+    {
+      return -1;
+    }
+    min_longitude = std::min(min_longitude, longitude);
+    min_latitude = std::min(min_latitude, latitude);
+    max_longitude = std::max(max_longitude, longitude);
+    max_latitude = std::max(max_latitude, latitude);
+  }
+  min_latitude = std::max(min_latitude, -MAX_LATITUDE);
+  max_latitude = std::min(max_latitude, MAX_LATITUDE);
+  if (min_latitude > max_latitude) return -1;
+
+  //Web Mercator stretches ground distances by 1 / cos(latitude).
+  double center_latitude = 0.5 * (min_latitude + max_latitude) * PI / 180.0;
+  double pixel_size =
+    std::min(grid_.scale_x, grid_.scale_y) / std::cos(center_latitude);
+  if (!(pixel_size > 0)) return -1;
+  double zoom = std::ceil(std::log(Resolution(0) / pixel_size) /
+                          std::log(2.0) - 1e-9);
+  Level level;
+  level.zoom = int(std::max(0.0, std::min(double(MAX_ZOOM), zoom)));
+  double tile_span = double(TILE_SIZE) * Resolution(level.zoom);
+  level.min_x = TileIndex(MercatorX(min_longitude) + ORIGIN_SHIFT,
+                          tile_span, level.zoom);
+  level.max_x = TileIndex(MercatorX(max_longitude) + ORIGIN_SHIFT,
+                          tile_span, level.zoom);
+  level.min_y = TileIndex(ORIGIN_SHIFT - MercatorY(max_latitude),
+                          tile_span, level.zoom);
+  level.max_y = TileIndex(ORIGIN_SHIFT - MercatorY(min_latitude),
+                          tile_span, level.zoom);
+  levels_.push_back(level);
+  while (level.zoom > 0 &&
+         (level.NumberOfColumns() > 1 || level.NumberOfRows() > 1))
+  {
+    level.zoom--;
+    level.min_x /= 2;
+    level.min_y /= 2;
+    level.max_x /= 2;
+    level.max_y /= 2;
+    levels_.push_back(level);
+  }
+  return 0;
+}
+
+bool WebTileSink::ValidPixel(const uint8_t* pixel) const
+{
+  if (channels_ == 1) return pixel[0] != no_data_;
+  if (channels_ == 4) return pixel[3] != 0;
+  return true;
+}
+
+void WebTileSink::ToRGBA(const uint8_t* pixel, uint8_t* rgba) const
+{
+  for (size_t c = 0; c < 3; c++)
+  {
+    rgba[c] = channels_ == 1 ? pixel[0] : pixel[c];
+  }
+  rgba[3] = 255;
+}
+
+bool WebTileSink::MercatorToRaster(double mercator_x, double mercator_y,
+                                   double& column, double& row) const
+{
+  double x, y;
+  if (projector_.FromLongitudeLatitude(Longitude(mercator_x),
+                                       Latitude(mercator_y), x, y) != 0)
+  {
+    return false;
+  }
+  column = (x - grid_.left) / grid_.scale_x;
+  row = (grid_.top - y) / grid_.scale_y;
+  return true;
+}
+
+std::string WebTileSink::TilePath(const Level& level,
+                                  size_t x, size_t y) const
+{
+  if (scheme_ == SCHEME_TMS)
+  {
+    y = (size_t(1) << level.zoom) - 1 - y;
+  }
+  std::string extension = format_ == FORMAT_PNG ? ".png" : ".jpg";
+  boost::filesystem::path path(directory_);
+  path /= std::to_string(level.zoom);
+  path /= std::to_string(x);
+  path /= std::to_string(y) + extension;
+  return path.string();
+}
+
+size_t WebTileSink::NumberOfChildren(size_t level, size_t x, size_t y) const
+{
+  const Level& child_level = levels_[level - 1];
+  size_t number_of_columns =
+    std::min(2 * x + 1, child_level.max_x) -
+    std::max(2 * x, child_level.min_x) + 1;
+  size_t number_of_rows =
+    std::min(2 * y + 1, child_level.max_y) -
+    std::max(2 * y, child_level.min_y) + 1;
+  return number_of_columns * number_of_rows;
+}
+
+int WebTileSink::Render(const std::vector<size_t>& indices)
+{
+  if (indices.empty()) return 0;
+  RenderWorker worker(*this, indices);
+  ParallelForDynamic(0, indices.size(), number_of_threads_, 1, worker);
+
+  const Level& level = levels_[0];
+  WebTileContainer tiles(indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+  {
+    FinestTile& finest_tile = finest_tiles_[indices[i]];
+    finest_tile.rendered = true;
+    for (size_t row = finest_tile.min_row; row <= finest_tile.max_row; row++)
+    {
+      for (size_t column = finest_tile.min_column;
+           column <= finest_tile.max_column; column++)
+      {
+        size_t raster_id = row * grid_.NumberOfTileColumns() + column;
+        if (--raster_references_[raster_id] == 0)
+        {
+          std::vector<uint8_t>().swap(raster_pixels_[raster_id]);
+          std::vector<size_t>().swap(raster_dependents_[raster_id]);
+        }
+      }
+    }
+    tiles[i].x = level.min_x + indices[i] % level.NumberOfColumns();
+    tiles[i].y = level.min_y + indices[i] / level.NumberOfColumns();
+    tiles[i].pixels.swap(worker.pixels[i]);
+  }
+  return Flush(0, tiles);
+}
+
+int WebTileSink::Flush(size_t level, WebTileContainer& tiles)
+{
+  for (; !tiles.empty(); level++)
+  {
+    WriteWorker worker(*this, level, tiles);
+    ParallelFor(0, tiles.size(), number_of_threads_, worker);
+    if (worker.failed) return -1;
+    if (level + 1 == levels_.size()) break;
+
+    const Level& parent_level = levels_[level + 1];
+    WebTileMap& parents = partial_tiles_[level + 1];
+    WebTileContainer finished;
+    size_t half = TILE_SIZE / 2;
+    for (size_t i = 0; i < tiles.size(); i++)
+    {
+      size_t parent_x = tiles[i].x / 2;
+      size_t parent_y = tiles[i].y / 2;
+      size_t parent_id =
+        (parent_y - parent_level.min_y) * parent_level.NumberOfColumns() +
+        parent_x - parent_level.min_x;
+      WebTile& parent = parents[parent_id];
+      parent.x = parent_x;
+      parent.y = parent_y;
+      const std::vector<uint8_t>& reduced = worker.reduced[i];
+      if (!reduced.empty())
+      {
+        if (parent.pixels.empty())
+        {
+          parent.pixels.assign(TILE_SIZE * TILE_SIZE * 4, 0);
+        }
+        size_t left = (tiles[i].x % 2) * half;
+        size_t top = (tiles[i].y % 2) * half;
+        for (size_t row = 0; row < half; row++)
+        {
+          std::copy(reduced.begin() + row * half * 4,
+                    reduced.begin() + (row + 1) * half * 4,
+                    parent.pixels.begin() +
+                    ((top + row) * TILE_SIZE + left) * 4);
+        }
+      }
+      parent.number_of_children++;
+      if (parent.number_of_children ==
+          NumberOfChildren(level + 1, parent_x, parent_y))
+      {
+        finished.push_back(WebTile());
+        finished.back().Swap(parent);
+        parents.erase(parent_id);
+      }
+    }
+    tiles.swap(finished);
+  }
+  return 0;
+}
+
+}
+}
+}
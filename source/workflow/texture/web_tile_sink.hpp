@@ -0,0 +1,161 @@
+#ifndef _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_WEB_TILE_SINK_HPP_
+#define _HS_3D_RECONSTRUCTOR_WORKFLOW_TEXTURE_WEB_TILE_SINK_HPP_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "hs_3d_reconstructor/config/hs_config.hpp"
+
+#include "workflow/texture/geographic_projector.hpp"
+#include "workflow/texture/raster_tile.hpp"
+
+namespace hs
+{
+namespace recon
+{
+namespace workflow
+{
+
+/**
+ *  Writes an 8 bit raster as a Web Mercator tile pyramid of 256 x 256
+ *  images, <directory>/<zoom>/<x>/<y>.<extension>.
+ *
+ *  The finest zoom is the first whose pixels are no larger than the raster
+ *  ones, the coarsest the first holding the whole raster in one tile. A
+ *  tile of the finest zoom is reprojected once all raster tiles under it
+ *  have come, then averaged 2 x 2 into its parent, so that every zoom is
+ *  built in the same pass. Raster tiles are released once no tile waits
+ *  for them.
+ *
+ *  Tiles with nothing in them are not written. PNG tiles keep the empty
+ *  pixels transparent, JPEG ones make them black.
+ */
+class HS_EXPORT WebTileSink : public RasterTileSink<uint8_t>
+{
+public:
+  enum Format
+  {
+    FORMAT_JPG = 0,
+    FORMAT_PNG
+  };
+
+  enum Scheme
+  {
+    //Rows counted from the north, as slippy maps do.
+    SCHEME_XYZ = 0,
+    //Rows counted from the south.
+    SCHEME_TMS
+  };
+
+  enum
+  {
+    TILE_SIZE = 256,
+    MAX_ZOOM = 24
+  };
+
+  WebTileSink(const std::string& directory,
+              const GeographicProjector& projector,
+              int format, int scheme, size_t number_of_threads);
+
+  virtual int Open(const RasterGrid& grid, size_t channels, uint8_t no_data);
+  virtual int Write(const Tile& tile);
+  virtual int Close();
+
+  int min_zoom() const;
+  int max_zoom() const;
+
+private:
+  //Web Mercator tile range of a zoom, rows counted from the north.
+  struct Level
+  {
+    int zoom;
+    size_t min_x;
+    size_t min_y;
+    size_t max_x;
+    size_t max_y;
+
+    size_t NumberOfColumns() const
+    {
+      return max_x - min_x + 1;
+    }
+    size_t NumberOfRows() const
+    {
+      return max_y - min_y + 1;
+    }
+  };
+
+  //RGBA pixels of a tile of some zoom, empty if nothing is in it.
+  struct WebTile
+  {
+    WebTile() : x(0), y(0), number_of_children(0) {}
+
+    void Swap(WebTile& other);
+
+    size_t x;
+    size_t y;
+    //Children averaged in so far.
+    size_t number_of_children;
+    std::vector<uint8_t> pixels;
+  };
+  typedef std::vector<WebTile> WebTileContainer;
+  typedef std::map<size_t, WebTile> WebTileMap;
+
+  //Tile of the finest zoom and the raster tiles it reads.
+  struct FinestTile
+  {
+    FinestTile()
+      : min_row(1), max_row(0), min_column(1), max_column(0),
+        number_of_missing(0), rendered(false) {}
+
+    size_t min_row;
+    size_t max_row;
+    size_t min_column;
+    size_t max_column;
+    size_t number_of_missing;
+    bool rendered;
+  };
+
+  struct FootprintWorker;
+  struct RenderWorker;
+  struct WriteWorker;
+
+  int ComputeLevels();
+  bool ValidPixel(const uint8_t* pixel) const;
+  void ToRGBA(const uint8_t* pixel, uint8_t* rgba) const;
+  //Pixel coordinates of the raster at Web Mercator point (mx, my).
+  bool MercatorToRaster(double mx, double my,
+                        double& column, double& row) const;
+  std::string TilePath(const Level& level, size_t x, size_t y) const;
+  size_t NumberOfChildren(size_t level, size_t x, size_t y) const;
+
+  //Reproject the finest tiles at indices and pass them up the pyramid.
+  int Render(const std::vector<size_t>& indices);
+  //Write tiles of a level, and those they complete in the levels above.
+  int Flush(size_t level, WebTileContainer& tiles);
+
+  std::string directory_;
+  const GeographicProjector& projector_;
+  int format_;
+  int scheme_;
+  size_t number_of_threads_;
+  RasterGrid grid_;
+  size_t channels_;
+  uint8_t no_data_;
+  //Finest zoom first.
+  std::vector<Level> levels_;
+  std::vector<FinestTile> finest_tiles_;
+  //Finest tiles waiting for each raster tile.
+  std::vector<std::vector<size_t> > raster_dependents_;
+  std::vector<size_t> raster_references_;
+  std::vector<std::vector<uint8_t> > raster_pixels_;
+  //Tiles waiting for more children, by level and tile index.
+  std::vector<WebTileMap> partial_tiles_;
+};
+
+}
+}
+}
+
+#endif
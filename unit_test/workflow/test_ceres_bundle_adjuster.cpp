@@ -0,0 +1,157 @@
+#include <cmath>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include "workflow/photo_orientation/ceres_bundle_adjuster.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::CeresBundleAdjuster Adjuster;
+typedef hs::recon::workflow::BundleAdjustmentOptions Options;
+typedef Adjuster::Scalar Scalar;
+typedef Adjuster::Keyset Keyset;
+typedef Keyset::Key Key;
+typedef Adjuster::Point Point;
+typedef EIGEN_MATRIX(Scalar, 3, 3) Matrix33;
+
+Matrix33 AngleAxisMatrix(const Point& rotation)
+{
+  Scalar angle = rotation.norm();
+  if (angle == Scalar(0)) return Matrix33::Identity();
+  return Eigen::AngleAxis<Scalar>(angle, rotation / angle).toRotationMatrix();
+}
+
+//Without control points the adjustment may only move the scene inside the
+//gauge held by the first camera and the baseline to the second one.
+TEST(TestCeresBundleAdjuster, GaugeTest)
+{
+  size_t number_of_cameras = 4;
+  size_t number_of_points = 100;
+  Scalar focal_length = 1000;
+  Scalar principal_point = 500;
+
+  std::mt19937 generator(3);
+  std::uniform_real_distribution<Scalar> distribution(-1, 1);
+
+  //Cameras 10 in front of the points looking at them, spread along x.
+  Adjuster::ExtrinsicParamsContainer truth_extrinsics(number_of_cameras);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    Point rotation(0.05 * distribution(generator),
+                   0.05 * distribution(generator),
+                   0.05 * distribution(generator));
+    Point position(Scalar(3 * i), distribution(generator), Scalar(-10));
+    for (size_t j = 0; j < 3; j++)
+    {
+      truth_extrinsics[i].rotation()[j] = rotation[j];
+      truth_extrinsics[i].position()[j] = position[j];
+    }
+  }
+  Adjuster::PointContainer truth_points(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    truth_points[i] << 4.5 + 4 * distribution(generator),
+                       3 * distribution(generator),
+                       2 * distribution(generator);
+  }
+
+  Adjuster::KeysetContainer keysets(number_of_cameras);
+  hs::sfm::TrackContainer tracks(number_of_points);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    Point rotation;
+    Point position;
+    for (size_t j = 0; j < 3; j++)
+    {
+      rotation[j] = truth_extrinsics[i].rotation()[j];
+      position[j] = truth_extrinsics[i].position()[j];
+    }
+    Matrix33 rotation_matrix = AngleAxisMatrix(rotation);
+    for (size_t j = 0; j < number_of_points; j++)
+    {
+      Point camera = rotation_matrix * (truth_points[j] - position);
+      Key key;
+      key << focal_length * camera[0] / camera[2] + principal_point,
+             focal_length * camera[1] / camera[2] + principal_point;
+      tracks[j].push_back(std::make_pair(i, keysets[i].size()));
+      keysets[i].AddKey(key);
+    }
+  }
+
+  hs::sfm::ObjectIndexMap image_intrinsic_map(number_of_cameras);
+  hs::sfm::ObjectIndexMap image_extrinsic_map(number_of_cameras);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    image_intrinsic_map[i] = 0;
+    image_extrinsic_map[i] = i;
+  }
+  hs::sfm::ObjectIndexMap track_point_map(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    track_point_map[i] = i;
+  }
+  hs::sfm::ViewInfoIndexer view_info_indexer;
+  view_info_indexer.SetViewInfoByTracks(tracks);
+
+  //Perturb everything but the first camera and the x of the second, which
+  //is its largest baseline coordinate.
+  Adjuster::IntrinsicParamsContainer intrinsic_params_set(
+    1, Adjuster::IntrinsicParams(focal_length, 0,
+                                 principal_point, principal_point, 1));
+  Adjuster::ExtrinsicParamsContainer extrinsic_params_set = truth_extrinsics;
+  for (size_t i = 1; i < number_of_cameras; i++)
+  {
+    for (size_t j = 0; j < 3; j++)
+    {
+      extrinsic_params_set[i].rotation()[j] += 0.01 * distribution(generator);
+      if (i == 1 && j == 0) continue;
+      extrinsic_params_set[i].position()[j] += 0.1 * distribution(generator);
+    }
+  }
+  Adjuster::PointContainer points = truth_points;
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    points[i] += 0.1 * Point(distribution(generator),
+                             distribution(generator),
+                             distribution(generator));
+  }
+
+  Options options;
+  options.backend = Options::BACKEND_CERES_SPARSE_SCHUR;
+  options.refine_intrinsics = false;
+  Adjuster adjuster(options, 2);
+  ASSERT_EQ(0, adjuster(keysets, image_intrinsic_map, image_extrinsic_map,
+                        tracks, track_point_map, view_info_indexer,
+                        intrinsic_params_set, extrinsic_params_set, points));
+
+  for (size_t j = 0; j < 3; j++)
+  {
+    ASSERT_EQ(truth_extrinsics[0].rotation()[j],
+              extrinsic_params_set[0].rotation()[j]);
+    ASSERT_EQ(truth_extrinsics[0].position()[j],
+              extrinsic_params_set[0].position()[j]);
+  }
+  ASSERT_EQ(truth_extrinsics[1].position()[0],
+            extrinsic_params_set[1].position()[0]);
+
+  //With the gauge held the only solution is the true scene.
+  Scalar threshold = 1e-4;
+  for (size_t i = 1; i < number_of_cameras; i++)
+  {
+    for (size_t j = 0; j < 3; j++)
+    {
+      ASSERT_NEAR(truth_extrinsics[i].rotation()[j],
+                  extrinsic_params_set[i].rotation()[j], threshold);
+      ASSERT_NEAR(truth_extrinsics[i].position()[j],
+                  extrinsic_params_set[i].position()[j], threshold);
+    }
+  }
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    ASSERT_NEAR(0, (truth_points[i] - points[i]).norm(), threshold);
+  }
+}
+
+}
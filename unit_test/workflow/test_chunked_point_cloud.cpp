@@ -0,0 +1,120 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+#include "workflow/common/chunked_point_cloud.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ChunkedPointCloudWriter Writer;
+typedef hs::recon::workflow::ChunkedPointCloudReader Reader;
+typedef Writer::Scalar Scalar;
+typedef Writer::Vector3 Vector3;
+typedef Writer::PointCloudData PointCloudData;
+
+Scalar Random(Scalar range)
+{
+  return Scalar(std::rand()) / Scalar(RAND_MAX) * range;
+}
+
+void GeneratePointCloud(size_t number_of_points, PointCloudData& point_cloud)
+{
+  std::srand(3);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    //Far from the origin, as georeferenced clouds are.
+    point_cloud.VertexData().push_back(
+      Vector3(500000 + Random(1000), 3000000 + Random(1000), Random(50)));
+    Vector3 normal(Random(2) - 1, Random(2) - 1, Random(2) - 1);
+    point_cloud.NormalData().push_back(normal.normalized());
+    point_cloud.ColorData().push_back(
+      Vector3(Scalar(i % 256), Scalar(i % 7), 255) / 255.0);
+  }
+}
+
+TEST(TestChunkedPointCloud, NormalTest)
+{
+  std::srand(5);
+  for (int i = 0; i < 10000; i++)
+  {
+    Vector3 normal(Random(2) - 1, Random(2) - 1, Random(2) - 1);
+    normal.normalize();
+    int16_t packed[2];
+    Vector3 unpacked;
+    hs::recon::workflow::PackNormal(normal.data(), packed);
+    hs::recon::workflow::UnpackNormal(packed, unpacked.data());
+    ASSERT_NEAR(1.0, unpacked.norm(), 1e-6);
+    ASSERT_LT(0.99999, normal.dot(unpacked));
+  }
+}
+
+TEST(TestChunkedPointCloud, SimpleTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(20000, point_cloud);
+  std::string path = "test_chunked_point_cloud.bin";
+
+  Writer writer(1000);
+  ASSERT_EQ(0, writer(point_cloud, path, true));
+  ASSERT_TRUE(Reader::IsChunkedFile(path));
+  Reader reader;
+  ASSERT_EQ(0, reader.Open(path));
+  ASSERT_EQ(size_t(20000), reader.NumberOfPoints());
+  ASSERT_EQ(size_t(20), reader.NumberOfChunks());
+
+  PointCloudData read_cloud;
+  ASSERT_EQ(0, reader.Read(read_cloud));
+  ASSERT_EQ(size_t(20000), read_cloud.VertexData().size());
+  ASSERT_EQ(size_t(20000), read_cloud.NormalData().size());
+  ASSERT_EQ(size_t(20000), read_cloud.ColorData().size());
+
+  //Only the points inside the box, from the chunks it touches.
+  Vector3 box_min(500100, 3000200, 0);
+  Vector3 box_max(500300, 3000300, 50);
+  size_t number_of_inside = 0;
+  for (size_t i = 0; i < point_cloud.VertexData().size(); i++)
+  {
+    const Vector3& point = point_cloud.VertexData()[i];
+    if ((point.array() >= box_min.array()).all() &&
+        (point.array() <= box_max.array()).all()) number_of_inside++;
+  }
+  size_t number_of_touched = 0;
+  for (size_t i = 0; i < reader.NumberOfChunks(); i++)
+  {
+    if (reader.ChunkIntersects(i, box_min, box_max)) number_of_touched++;
+  }
+  ASSERT_GT(reader.NumberOfChunks() / 2, number_of_touched);
+  PointCloudData box_cloud;
+  ASSERT_EQ(0, reader.Read(box_min, box_max, box_cloud));
+  ASSERT_NEAR(double(number_of_inside), double(box_cloud.VertexData().size()),
+              2.0);
+  reader.Close();
+  std::remove(path.c_str());
+}
+
+TEST(TestChunkedPointCloud, OrderTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(5000, point_cloud);
+  std::string path = "test_chunked_point_cloud_order.bin";
+  ASSERT_EQ(0, hs::recon::workflow::SavePointCloud(point_cloud, path, false));
+
+  PointCloudData read_cloud;
+  ASSERT_EQ(0, hs::recon::workflow::LoadPointCloud(path, read_cloud));
+  ASSERT_EQ(point_cloud.VertexData().size(), read_cloud.VertexData().size());
+  for (size_t i = 0; i < point_cloud.VertexData().size(); i++)
+  {
+    ASSERT_LT((point_cloud.VertexData()[i] -
+               read_cloud.VertexData()[i]).norm(), 1e-3);
+    ASSERT_LT(0.9999, point_cloud.NormalData()[i].dot(
+                        read_cloud.NormalData()[i]));
+    ASSERT_NEAR(point_cloud.ColorData()[i][0],
+                read_cloud.ColorData()[i][0], 0.5 / 255.0);
+  }
+  std::remove(path.c_str());
+}
+
+}
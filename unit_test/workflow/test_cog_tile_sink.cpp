@@ -0,0 +1,382 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+#include <zlib.h>
+
+#include "workflow/texture/cog_tile_sink.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+
+//Integer tags of one directory of a little endian classic TIFF.
+struct Directory
+{
+  std::map<uint16_t, std::vector<uint64_t> > values;
+  uint64_t offset;
+
+  uint64_t Value(uint16_t tag) const
+  {
+    std::map<uint16_t, std::vector<uint64_t> >::const_iterator itr =
+      values.find(tag);
+    return itr == values.end() || itr->second.empty() ? 0 : itr->second[0];
+  }
+};
+
+template <typename V>
+V Read(const std::vector<char>& file, uint64_t offset)
+{
+  V value;
+  std::memcpy(&value, &file[size_t(offset)], sizeof(V));
+  return value;
+}
+
+std::vector<Directory> ReadDirectories(const std::vector<char>& file)
+{
+  std::vector<Directory> directories;
+  uint64_t offset = Read<uint32_t>(file, 4);
+  while (offset != 0)
+  {
+    Directory directory;
+    directory.offset = offset;
+    uint16_t number_of_entries = Read<uint16_t>(file, offset);
+    for (uint16_t i = 0; i < number_of_entries; i++)
+    {
+      uint64_t entry = offset + 2 + 12 * uint64_t(i);
+      uint16_t tag = Read<uint16_t>(file, entry);
+      uint16_t type = Read<uint16_t>(file, entry + 2);
+      uint32_t count = Read<uint32_t>(file, entry + 4);
+      size_t size = type == 3 ? 2 : 4;
+      if (type != 3 && type != 4) continue;
+      uint64_t values = entry + 8;
+      if (size * count > 4) values = Read<uint32_t>(file, entry + 8);
+      for (uint32_t k = 0; k < count; k++)
+      {
+        directory.values[tag].push_back(
+          type == 3 ? Read<uint16_t>(file, values + 2 * k) :
+                      Read<uint32_t>(file, values + 4 * k));
+      }
+    }
+    directories.push_back(directory);
+    offset = Read<uint32_t>(
+      file, offset + 2 + 12 * uint64_t(number_of_entries));
+  }
+  return directories;
+}
+
+//Pixels of a level, empty blocks left as zeros.
+template <typename T>
+std::vector<T> DecodeLevel(const std::vector<char>& file,
+                           const Directory& directory)
+{
+  size_t width = size_t(directory.Value(256));
+  size_t height = size_t(directory.Value(257));
+  size_t channels = size_t(directory.Value(277));
+  size_t block_size = size_t(directory.Value(322));
+  size_t number_of_columns = (width + block_size - 1) / block_size;
+  const std::vector<uint64_t>& offsets = directory.values.at(324);
+  const std::vector<uint64_t>& byte_counts = directory.values.at(325);
+  std::vector<T> pixels(width * height * channels, T(0));
+  std::vector<T> block(block_size * block_size * channels);
+  for (size_t i = 0; i < offsets.size(); i++)
+  {
+    if (byte_counts[i] == 0) continue;
+    uLongf size = uLongf(block.size() * sizeof(T));
+    EXPECT_EQ(Z_OK, uncompress(reinterpret_cast<Bytef*>(block.data()), &size,
+                               reinterpret_cast<const Bytef*>(
+                                 &file[size_t(offsets[i])]),
+                               uLong(byte_counts[i])));
+    if (directory.Value(317) == 2)
+    {
+      uint8_t* samples = reinterpret_cast<uint8_t*>(block.data());
+      size_t row_size = block_size * channels;
+      for (size_t row = 0; row < block_size; row++)
+      {
+        uint8_t* row_samples = samples + row * row_size;
+        for (size_t k = channels; k < row_size; k++)
+        {
+          row_samples[k] = uint8_t(row_samples[k] + row_samples[k - channels]);
+        }
+      }
+    }
+    size_t block_left = (i % number_of_columns) * block_size;
+    size_t block_top = (i / number_of_columns) * block_size;
+    for (size_t y = 0; y < block_size && block_top + y < height; y++)
+    {
+      for (size_t x = 0; x < block_size && block_left + x < width; x++)
+      {
+        for (size_t c = 0; c < channels; c++)
+        {
+          pixels[((block_top + y) * width + block_left + x) * channels + c] =
+            block[(y * block_size + x) * channels + c];
+        }
+      }
+    }
+  }
+  return pixels;
+}
+
+std::vector<char> ReadFile(const std::string& path)
+{
+  std::ifstream file(path, std::ios::binary);
+  return std::vector<char>((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+}
+
+//Feed a whole raster to a sink tile by tile, last tile first.
+template <typename T>
+int WriteRaster(const RasterGrid& grid, size_t channels, T no_data,
+                const std::vector<T>& pixels,
+                hs::recon::workflow::RasterTileSink<T>& sink)
+{
+  if (sink.Open(grid, channels, no_data) != 0) return -1;
+  for (size_t tile_id = grid.NumberOfTiles(); tile_id-- > 0;)
+  {
+    hs::recon::workflow::RasterTile<T> tile;
+    tile.row = tile_id / grid.NumberOfTileColumns();
+    tile.column = tile_id % grid.NumberOfTileColumns();
+    tile.width = grid.TileWidth(tile.column);
+    tile.height = grid.TileHeight(tile.row);
+    tile.channels = channels;
+    for (size_t y = 0; y < tile.height; y++)
+    {
+      size_t begin = ((tile.row * grid.tile_height + y) * grid.width +
+                      tile.column * grid.tile_width) * channels;
+      tile.pixels.insert(tile.pixels.end(), pixels.begin() + begin,
+                         pixels.begin() + begin + tile.width * channels);
+    }
+    if (sink.Write(tile) != 0) return -1;
+  }
+  return sink.Close();
+}
+
+}
+
+TEST(TestCogTileSink, ColorTest)
+{
+  //Tiles and blocks do not line up, and the lower right corner is empty.
+  RasterGrid grid;
+  grid.left = 500;
+  grid.top = 800;
+  grid.scale_x = 0.5;
+  grid.scale_y = 0.5;
+  grid.width = 300;
+  grid.height = 200;
+  grid.tile_width = 96;
+  grid.tile_height = 80;
+  std::vector<uint8_t> pixels(grid.width * grid.height * 4);
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      uint8_t* pixel = &pixels[(y * grid.width + x) * 4];
+      bool empty = x >= 192 && y >= 128;
+      pixel[0] = empty ? 0 : uint8_t(x);
+      pixel[1] = empty ? 0 : uint8_t(y);
+      pixel[2] = empty ? 0 : uint8_t((x * y) % 251);
+      pixel[3] = empty ? 0 : 255;
+    }
+  }
+  std::string path = "test_cog_tile_sink_color.tif";
+  hs::recon::workflow::CogTileSink<uint8_t> sink(path, 3, 64, 32650);
+  ASSERT_EQ(0, WriteRaster(grid, 4, uint8_t(0), pixels, sink));
+  std::ifstream blocks_file(path + ".blocks");
+  ASSERT_FALSE(bool(blocks_file));
+
+  std::vector<char> file = ReadFile(path);
+  ASSERT_LT(size_t(64), file.size());
+  ASSERT_EQ('I', file[0]);
+  ASSERT_EQ(42, Read<uint16_t>(file, 2));
+  ASSERT_EQ(0, std::memcmp(&file[8], "GDAL_STRUCTURAL_METADATA_SIZE=", 30));
+
+  std::vector<Directory> directories = ReadDirectories(file);
+  ASSERT_EQ(size_t(4), directories.size());
+  size_t widths[4] = {300, 150, 75, 38};
+  size_t heights[4] = {200, 100, 50, 25};
+  for (size_t level = 0; level < directories.size(); level++)
+  {
+    const Directory& directory = directories[level];
+    ASSERT_EQ(widths[level], directory.Value(256));
+    ASSERT_EQ(heights[level], directory.Value(257));
+    ASSERT_EQ(8u, directory.Value(259));
+    ASSERT_EQ(64u, directory.Value(322));
+    ASSERT_EQ(level > 0 ? 1u : 0u, directory.Value(254));
+  }
+  //Only full resolution is georeferenced: a projected frame, pixels as
+  //areas, then the EPSG system.
+  const std::vector<uint64_t>& geo_keys = directories[0].values[34735];
+  uint64_t expected_geo_keys[16] = {1, 1, 0, 3,
+                                    1024, 0, 1, 1,
+                                    1025, 0, 1, 1,
+                                    3072, 0, 1, 32650};
+  ASSERT_EQ(std::vector<uint64_t>(expected_geo_keys, expected_geo_keys + 16),
+            geo_keys);
+  for (size_t level = 1; level < directories.size(); level++)
+  {
+    ASSERT_EQ(0u, directories[level].values.count(34735));
+  }
+  //Directories first, then the blocks of the coarsest level onward, each
+  //level row by row.
+  uint64_t last_block_end = directories.back().offset;
+  for (size_t level = directories.size(); level-- > 0;)
+  {
+    const std::vector<uint64_t>& offsets = directories[level].values[324];
+    const std::vector<uint64_t>& byte_counts =
+      directories[level].values[325];
+    for (size_t i = 0; i < offsets.size(); i++)
+    {
+      ASSERT_LT(0u, byte_counts[i]);
+      ASSERT_LE(last_block_end, offsets[i]);
+      last_block_end = offsets[i] + byte_counts[i];
+    }
+  }
+  ASSERT_EQ(uint64_t(file.size()), last_block_end);
+  //Blocks wholly in the empty corner are filled alike.
+  ASSERT_EQ(directories[0].values[325][2 * 5 + 3],
+            directories[0].values[325][2 * 5 + 4]);
+
+  std::vector<uint8_t> level0 = DecodeLevel<uint8_t>(file, directories[0]);
+  ASSERT_EQ(pixels, level0);
+
+  std::vector<uint8_t> level1 = DecodeLevel<uint8_t>(file, directories[1]);
+  for (size_t y = 0; y < heights[1]; y++)
+  {
+    for (size_t x = 0; x < widths[1]; x++)
+    {
+      for (size_t c = 0; c < 4; c++)
+      {
+        double sum = 0;
+        int number_of_valid = 0;
+        for (size_t dy = 0; dy < 2; dy++)
+        {
+          for (size_t dx = 0; dx < 2; dx++)
+          {
+            const uint8_t* source =
+              &pixels[((2 * y + dy) * grid.width + 2 * x + dx) * 4];
+            if (source[3] == 0) continue;
+            sum += source[c];
+            number_of_valid++;
+          }
+        }
+        int expected = number_of_valid == 0 ? 0 :
+                       int(std::floor(sum / number_of_valid + 0.5));
+        ASSERT_EQ(expected, int(level1[(y * widths[1] + x) * 4 + c]));
+      }
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TestCogTileSink, HeightTest)
+{
+  //Odd sizes, no data in a band across the middle.
+  RasterGrid grid;
+  grid.width = 131;
+  grid.height = 71;
+  grid.tile_width = 64;
+  grid.tile_height = 64;
+  const float no_data = -32767.0f;
+  std::vector<float> heights(grid.width * grid.height);
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      heights[y * grid.width + x] =
+        y >= 30 && y < 37 ? no_data : float(x) * 0.25f + float(y);
+    }
+  }
+  std::string path = "test_cog_tile_sink_height.tif";
+  hs::recon::workflow::CogTileSink<float> sink(path, 2, 32);
+  ASSERT_EQ(0, WriteRaster(grid, 1, no_data, heights, sink));
+
+  std::vector<char> file = ReadFile(path);
+  std::vector<Directory> directories = ReadDirectories(file);
+  ASSERT_EQ(size_t(4), directories.size());
+  ASSERT_EQ(17u, directories[3].Value(256));
+  ASSERT_EQ(9u, directories[3].Value(257));
+  ASSERT_EQ(0u, directories[0].Value(317));
+  //Without an EPSG code only the model and raster types are keyed.
+  ASSERT_EQ(size_t(12), directories[0].values[34735].size());
+  ASSERT_EQ(2u, directories[0].values[34735][3]);
+  std::vector<float> level0 = DecodeLevel<float>(file, directories[0]);
+  ASSERT_EQ(heights, level0);
+
+  std::vector<float> level1 = DecodeLevel<float>(file, directories[1]);
+  size_t width1 = 66;
+  for (size_t y = 0; y < 36; y++)
+  {
+    for (size_t x = 0; x < width1; x++)
+    {
+      double sum = 0;
+      int number_of_valid = 0;
+      for (size_t dy = 0; dy < 2 && 2 * y + dy < grid.height; dy++)
+      {
+        for (size_t dx = 0; dx < 2 && 2 * x + dx < grid.width; dx++)
+        {
+          float height = heights[(2 * y + dy) * grid.width + 2 * x + dx];
+          if (height == no_data) continue;
+          sum += height;
+          number_of_valid++;
+        }
+      }
+      float expected =
+        number_of_valid == 0 ? no_data : float(sum / number_of_valid);
+      ASSERT_FLOAT_EQ(expected, level1[y * width1 + x]);
+    }
+  }
+  std::remove(path.c_str());
+}
+
+TEST(TestCogTileSink, InvalidTest)
+{
+  RasterGrid grid;
+  grid.width = 40;
+  grid.height = 40;
+  grid.tile_width = 32;
+  grid.tile_height = 32;
+  hs::recon::workflow::CogTileSink<uint8_t> odd_sink(
+    "test_cog_tile_sink_invalid.tif", 1, 40);
+  ASSERT_EQ(-1, odd_sink.Open(grid, 4, 0));
+
+  std::string path = "test_cog_tile_sink_invalid.tif";
+  hs::recon::workflow::CogTileSink<uint8_t> sink(path, 1, 16);
+  ASSERT_EQ(0, sink.Open(grid, 4, 0));
+  hs::recon::workflow::RasterTile<uint8_t> tile;
+  tile.row = 0;
+  tile.column = 1;
+  tile.width = 32;
+  tile.height = 32;
+  tile.channels = 4;
+  tile.pixels.assign(32 * 32 * 4, 255);
+  ASSERT_EQ(-1, sink.Write(tile));
+  //Blocks of missing tiles are filled with nothing.
+  tile.column = 0;
+  ASSERT_EQ(0, sink.Write(tile));
+  ASSERT_EQ(0, sink.Close());
+  std::vector<char> file = ReadFile(path);
+  std::vector<Directory> directories = ReadDirectories(file);
+  ASSERT_EQ(size_t(3), directories.size());
+  const std::vector<uint64_t>& byte_counts = directories[0].values[325];
+  ASSERT_EQ(size_t(9), byte_counts.size());
+  ASSERT_EQ(byte_counts[2], byte_counts[8]);
+  std::vector<uint8_t> level0 = DecodeLevel<uint8_t>(file, directories[0]);
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      uint8_t expected = x < 32 && y < 32 ? 255 : 0;
+      ASSERT_EQ(expected, level0[(y * grid.width + x) * 4 + 3]);
+    }
+  }
+  std::remove(path.c_str());
+}
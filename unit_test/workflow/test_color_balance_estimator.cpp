@@ -0,0 +1,175 @@
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "workflow/photo_orientation/color_balance_estimator.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ColorBalanceEstimator Estimator;
+typedef hs::recon::workflow::ColorCorrection ColorCorrection;
+typedef Estimator::Observation Observation;
+typedef Estimator::ObservationContainer ObservationContainer;
+typedef Estimator::CorrectionContainer CorrectionContainer;
+
+/**
+ *  Strip of photos each seeing the points of its neighbours, with photo i
+ *  exposed by gains[i] and offsets[i] on every channel.
+ */
+ObservationContainer GenerateStrip(const std::vector<float>& gains,
+                                   const std::vector<float>& offsets,
+                                   std::vector<float>& point_colors)
+{
+  std::mt19937 generator(7);
+  std::uniform_real_distribution<float> color(30.0f, 180.0f);
+  std::normal_distribution<float> noise(0.0f, 1.0f);
+  const size_t points_per_photo = 200;
+  size_t number_of_images = gains.size();
+  point_colors.resize((number_of_images + 1) * points_per_photo);
+  for (size_t i = 0; i < point_colors.size(); i++)
+  {
+    point_colors[i] = color(generator);
+  }
+
+  ObservationContainer observations;
+  for (size_t image_id = 0; image_id < number_of_images; image_id++)
+  {
+    //Two runs of points, the second shared with the next photo.
+    for (size_t point_id = image_id * points_per_photo;
+         point_id < (image_id + 2) * points_per_photo; point_id++)
+    {
+      Observation observation;
+      observation.point_id = point_id;
+      observation.image_id = image_id;
+      for (size_t channel = 0; channel < 3; channel++)
+      {
+        observation.color[channel] =
+          gains[image_id] * point_colors[point_id] + offsets[image_id] +
+          noise(generator);
+      }
+      observations.push_back(observation);
+    }
+  }
+  return observations;
+}
+
+//Root mean square spread of the corrected colors of each point.
+double Spread(const ObservationContainer& observations,
+              const CorrectionContainer& corrections,
+              size_t number_of_points)
+{
+  std::vector<double> sums(number_of_points, 0);
+  std::vector<double> squares(number_of_points, 0);
+  std::vector<double> counts(number_of_points, 0);
+  for (size_t i = 0; i < observations.size(); i++)
+  {
+    const Observation& observation = observations[i];
+    const ColorCorrection& correction = corrections[observation.image_id];
+    double value = correction.gain[0] * observation.color[0] +
+                   correction.offset[0];
+    sums[observation.point_id] += value;
+    squares[observation.point_id] += value * value;
+    counts[observation.point_id] += 1;
+  }
+  double spread = 0;
+  double number_of_shared = 0;
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    if (counts[i] < 2) continue;
+    double mean = sums[i] / counts[i];
+    spread += squares[i] / counts[i] - mean * mean;
+    number_of_shared += 1;
+  }
+  return std::sqrt(spread / number_of_shared);
+}
+
+}
+
+TEST(TestColorBalanceEstimator, StripTest)
+{
+  std::vector<float> gains = {1.0f, 1.2f, 0.85f, 1.1f, 0.95f};
+  std::vector<float> offsets = {0.0f, -10.0f, 12.0f, 4.0f, -3.0f};
+  std::vector<float> point_colors;
+  ObservationContainer observations =
+    GenerateStrip(gains, offsets, point_colors);
+
+  CorrectionContainer identities(gains.size());
+  double spread_before =
+    Spread(observations, identities, point_colors.size());
+
+  CorrectionContainer serial_corrections;
+  CorrectionContainer parallel_corrections;
+  ASSERT_EQ(0, Estimator(1, 50)(gains.size(), observations,
+                                serial_corrections));
+  ASSERT_EQ(0, Estimator(4, 50)(gains.size(), observations,
+                                parallel_corrections));
+  ASSERT_EQ(gains.size(), serial_corrections.size());
+  double spread_after =
+    Spread(observations, serial_corrections, point_colors.size());
+  ASSERT_LT(spread_after, spread_before * 0.2);
+  //Each photo only reads what the others wrote in the previous round.
+  for (size_t i = 0; i < gains.size(); i++)
+  {
+    for (size_t channel = 0; channel < 3; channel++)
+    {
+      ASSERT_EQ(serial_corrections[i].gain[channel],
+                parallel_corrections[i].gain[channel]);
+      ASSERT_EQ(serial_corrections[i].offset[channel],
+                parallel_corrections[i].offset[channel]);
+    }
+  }
+  //Gains undo the relative exposure of neighbours.
+  for (size_t i = 0; i + 1 < gains.size(); i++)
+  {
+    double ratio = (serial_corrections[i].gain[0] * gains[i]) /
+                   (serial_corrections[i + 1].gain[0] * gains[i + 1]);
+    ASSERT_NEAR(1.0, ratio, 0.05);
+  }
+}
+
+TEST(TestColorBalanceEstimator, UnseenImageTest)
+{
+  ObservationContainer observations(2);
+  observations[0].point_id = 0;
+  observations[0].image_id = 0;
+  observations[0].color = {{100.0f, 100.0f, 100.0f}};
+  observations[1].point_id = 0;
+  observations[1].image_id = 2;
+  observations[1].color = {{120.0f, 110.0f, 100.0f}};
+
+  CorrectionContainer corrections;
+  ASSERT_EQ(0, Estimator(2)(3, observations, corrections));
+  ASSERT_EQ(size_t(3), corrections.size());
+  ASSERT_TRUE(corrections[1].IsIdentity());
+  ASSERT_FALSE(corrections[0].IsIdentity());
+  //The two photos meet between their colors.
+  uint8_t first[3] = {100, 100, 100};
+  uint8_t second[3] = {120, 110, 100};
+  corrections[0].Apply(first);
+  corrections[2].Apply(second);
+  ASSERT_LE(std::abs(int(first[0]) - int(second[0])), 4);
+  ASSERT_GT(int(first[0]), 100);
+  ASSERT_LT(int(second[0]), 120);
+  ASSERT_EQ(100, int(first[2]));
+
+  observations[1].image_id = 3;
+  ASSERT_EQ(-1, Estimator(2)(3, observations, corrections));
+}
+
+TEST(TestColorBalanceEstimator, ApplyTest)
+{
+  ColorCorrection correction;
+  ASSERT_TRUE(correction.IsIdentity());
+  correction.gain[0] = 2.0f;
+  correction.offset[1] = -20.0f;
+  correction.offset[2] = 0.4f;
+  uint8_t rgb[3] = {200, 10, 50};
+  correction.Apply(rgb);
+  ASSERT_EQ(255, int(rgb[0]));
+  ASSERT_EQ(0, int(rgb[1]));
+  ASSERT_EQ(50, int(rgb[2]));
+}
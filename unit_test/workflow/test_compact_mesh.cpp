@@ -0,0 +1,155 @@
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <cereal/types/array.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+#include "workflow/mesh_surface/mesh_stream_writer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::CompactMesh CompactMesh;
+typedef hs::recon::workflow::MeshStreamWriter Writer;
+typedef Writer::Scalar Scalar;
+typedef Writer::Vertex Vertex;
+typedef Writer::VertexContainer VertexContainer;
+typedef Writer::Triangle Triangle;
+typedef Writer::TriangleContainer TriangleContainer;
+
+Scalar Random(Scalar range)
+{
+  return Scalar(std::rand()) / Scalar(RAND_MAX) * range;
+}
+
+void GenerateMesh(size_t number_of_vertices, VertexContainer& vertices,
+                  TriangleContainer& triangles)
+{
+  std::srand(23);
+  for (size_t i = 0; i < number_of_vertices; i++)
+  {
+    vertices.push_back(Vertex(500000 + Random(1000), 3000000 + Random(1000),
+                              Random(50)));
+  }
+  for (size_t i = 0; i + 2 < number_of_vertices; i++)
+  {
+    Triangle triangle = {{CompactMesh::Index(i), CompactMesh::Index(i + 1),
+                          CompactMesh::Index(i + 2)}};
+    triangles.push_back(triangle);
+  }
+}
+
+void CheckMesh(const VertexContainer& vertices,
+               const TriangleContainer& triangles, const CompactMesh& mesh)
+{
+  ASSERT_EQ(vertices.size(), mesh.vertices.size());
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    //Floats keep millimetres within a kilometre of the origin.
+    ASSERT_GT(1e-3, (mesh.VertexPosition(i) - vertices[i]).norm());
+  }
+  ASSERT_TRUE(mesh.triangles == triangles);
+}
+
+TEST(TestCompactMesh, StreamTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateMesh(1000, vertices, triangles);
+
+  std::string path = "test_compact_mesh_stream.bin";
+  {
+    Writer writer;
+    ASSERT_EQ(0, writer.Open(path, vertices));
+    TriangleContainer batch;
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+      batch.push_back(triangles[i]);
+      if (batch.size() == 100 || i + 1 == triangles.size())
+      {
+        ASSERT_EQ(0, writer.Append(batch));
+        batch.clear();
+      }
+    }
+    ASSERT_EQ(triangles.size(), writer.NumberOfTriangles());
+    ASSERT_EQ(0, writer.Close());
+  }
+
+  CompactMesh mesh;
+  ASSERT_EQ(0, hs::recon::workflow::LoadMesh(path, mesh));
+  CheckMesh(vertices, triangles, mesh);
+  std::remove(path.c_str());
+}
+
+TEST(TestCompactMesh, LegacyTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateMesh(500, vertices, triangles);
+  std::vector<std::array<size_t, 3> > legacy_triangles;
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    std::array<size_t, 3> triangle = {{triangles[i][0], triangles[i][1],
+                                       triangles[i][2]}};
+    legacy_triangles.push_back(triangle);
+  }
+
+  std::string path = "test_compact_mesh_legacy.bin";
+  {
+    std::ofstream file(path, std::ios::binary);
+    cereal::PortableBinaryOutputArchive archive(file);
+    archive(vertices, legacy_triangles);
+  }
+  CompactMesh mesh;
+  ASSERT_EQ(0, hs::recon::workflow::LoadMesh(path, mesh));
+  CheckMesh(vertices, triangles, mesh);
+
+  //Ids out of range are rejected.
+  legacy_triangles[7][1] = vertices.size();
+  {
+    std::ofstream file(path, std::ios::binary);
+    cereal::PortableBinaryOutputArchive archive(file);
+    archive(vertices, legacy_triangles);
+  }
+  ASSERT_EQ(-1, hs::recon::workflow::LoadMesh(path, mesh));
+  std::remove(path.c_str());
+}
+
+TEST(TestCompactMesh, TruncatedTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateMesh(100, vertices, triangles);
+  std::string path = "test_compact_mesh_truncated.bin";
+  {
+    Writer writer;
+    ASSERT_EQ(0, writer.Open(path, vertices));
+    ASSERT_EQ(0, writer.Append(triangles));
+    ASSERT_EQ(0, writer.Close());
+  }
+  std::string data;
+  {
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), data.size() - 5);
+  }
+  CompactMesh mesh;
+  ASSERT_EQ(-1, hs::recon::workflow::LoadMesh(path, mesh));
+  ASSERT_EQ(-1, hs::recon::workflow::LoadMesh("not_a_mesh.bin", mesh));
+  std::remove(path.c_str());
+}
+
+}
@@ -0,0 +1,163 @@
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+#include <gtest/gtest.h>
+
+#include <cereal/types/utility.hpp>
+#include <cereal/types/vector.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/photo_orientation/compact_track_container.hpp"
+
+namespace
+{
+
+TEST(TestCompactTrackContainer, SaveLoadTest)
+{
+  typedef hs::recon::workflow::CompactTrackContainer CompactTrackContainer;
+
+  hs::sfm::TrackContainer tracks(3);
+  tracks[0].push_back(std::make_pair(size_t(0), size_t(10)));
+  tracks[0].push_back(std::make_pair(size_t(1), size_t(11)));
+  tracks[1].push_back(std::make_pair(size_t(1), size_t(20)));
+  tracks[1].push_back(std::make_pair(size_t(2), size_t(21)));
+  tracks[1].push_back(std::make_pair(size_t(0), size_t(22)));
+  tracks[2].push_back(std::make_pair(size_t(2), size_t(30)));
+  tracks[2].push_back(std::make_pair(size_t(0), size_t(31)));
+
+  hs::sfm::ObjectIndexMap track_point_map(tracks.size());
+  track_point_map[0] = 0;
+  track_point_map[2] = 1;
+
+  hs::sfm::ViewInfoIndexer view_info_indexer;
+  view_info_indexer.SetViewInfoByTracks(tracks);
+
+  std::vector<int> image_ids;
+  image_ids.push_back(5);
+  image_ids.push_back(7);
+  image_ids.push_back(9);
+
+  CompactTrackContainer compact_tracks;
+  ASSERT_EQ(0, compact_tracks.Build(tracks, track_point_map,
+                                    view_info_indexer, image_ids));
+  ASSERT_EQ(0, compact_tracks.Save("compact_tracks_test.bin"));
+
+  CompactTrackContainer compact_tracks_loaded;
+  ASSERT_EQ(0, compact_tracks_loaded.Load("compact_tracks_test.bin"));
+  ASSERT_EQ(tracks.size(), compact_tracks_loaded.NumberOfTracks());
+  ASSERT_EQ(size_t(7), compact_tracks_loaded.NumberOfViews());
+  for (size_t i = 0; i < tracks.size(); i++)
+  {
+    ASSERT_EQ(tracks[i].size(), compact_tracks_loaded.TrackSize(i));
+    for (size_t j = 0; j < tracks[i].size(); j++)
+    {
+      ASSERT_EQ(CompactTrackContainer::Index(image_ids[tracks[i][j].first]),
+                compact_tracks_loaded.TrackImageIds(i)[j]);
+      ASSERT_EQ(CompactTrackContainer::Index(tracks[i][j].second),
+                compact_tracks_loaded.TrackKeyIds(i)[j]);
+    }
+  }
+  ASSERT_TRUE(compact_tracks_loaded.IsPointValid(0));
+  ASSERT_FALSE(compact_tracks_loaded.IsPointValid(1));
+  ASSERT_EQ(CompactTrackContainer::Index(1),
+            compact_tracks_loaded.PointId(2));
+  compact_tracks_loaded.Clear();
+
+  //Offsets of the mapped file running backwards or past the views.
+  std::vector<char> file;
+  {
+    std::ifstream tracks_file("compact_tracks_test.bin", std::ios::binary);
+    file.assign(std::istreambuf_iterator<char>(tracks_file),
+                std::istreambuf_iterator<char>());
+  }
+  //Offsets are 0, 2, 5, 7 behind the 24 byte header.
+  const size_t offsets_begin = 24;
+  size_t bad_indices[2] = {1, 3};
+  CompactTrackContainer::Offset bad_offsets[2] = {6, 9};
+  for (size_t i = 0; i < 2; i++)
+  {
+    std::vector<char> corrupt = file;
+    std::memcpy(&corrupt[offsets_begin + bad_indices[i] *
+                         sizeof(CompactTrackContainer::Offset)],
+                &bad_offsets[i], sizeof(CompactTrackContainer::Offset));
+    {
+      std::ofstream tracks_file("compact_tracks_test.bin",
+                                std::ios::binary);
+      tracks_file.write(corrupt.data(), std::streamsize(corrupt.size()));
+    }
+    ASSERT_EQ(-1, compact_tracks_loaded.Load("compact_tracks_test.bin"));
+    ASSERT_EQ(size_t(0), compact_tracks_loaded.NumberOfTracks());
+  }
+
+  std::vector<CompactTrackContainer::Offset> offsets = {0, 3, 2, 4};
+  std::vector<CompactTrackContainer::Index> ids(4, 0);
+  std::vector<CompactTrackContainer::Index> key_ids(4, 0);
+  std::vector<CompactTrackContainer::Index> point_ids(3, 0);
+  ASSERT_EQ(-1, compact_tracks_loaded.Assign(offsets, ids, key_ids,
+                                             point_ids));
+}
+
+TEST(TestCompactTrackContainer, LegacyLoadTest)
+{
+  typedef hs::recon::workflow::CompactTrackContainer CompactTrackContainer;
+
+  //Tracks of photo ids as earlier versions archived them.
+  hs::sfm::TrackContainer tracks(2);
+  tracks[0].push_back(std::make_pair(size_t(5), size_t(10)));
+  tracks[0].push_back(std::make_pair(size_t(7), size_t(11)));
+  tracks[1].push_back(std::make_pair(size_t(9), size_t(20)));
+  tracks[1].push_back(std::make_pair(size_t(5), size_t(21)));
+  tracks[1].push_back(std::make_pair(size_t(7), size_t(22)));
+  hs::sfm::ObjectIndexMap track_point_map(tracks.size());
+  track_point_map[1] = 0;
+  {
+    std::ofstream tracks_file("legacy_tracks_test.bin", std::ios::binary);
+    cereal::PortableBinaryOutputArchive archive(tracks_file);
+    archive(tracks, track_point_map);
+  }
+
+  CompactTrackContainer compact_tracks;
+  ASSERT_EQ(0, compact_tracks.Load("legacy_tracks_test.bin"));
+  ASSERT_EQ(size_t(2), compact_tracks.NumberOfTracks());
+  ASSERT_EQ(size_t(5), compact_tracks.NumberOfViews());
+  ASSERT_EQ(size_t(3), compact_tracks.TrackSize(1));
+  ASSERT_EQ(CompactTrackContainer::Index(9),
+            compact_tracks.TrackImageIds(1)[0]);
+  ASSERT_EQ(CompactTrackContainer::Index(22),
+            compact_tracks.TrackKeyIds(1)[2]);
+  ASSERT_FALSE(compact_tracks.IsPointValid(0));
+  ASSERT_EQ(CompactTrackContainer::Index(0), compact_tracks.PointId(1));
+
+  //Neither layout.
+  {
+    std::ofstream tracks_file("legacy_tracks_test.bin", std::ios::binary);
+    tracks_file << "not tracks";
+  }
+  ASSERT_NE(0, compact_tracks.Load("legacy_tracks_test.bin"));
+}
+
+TEST(TestCompactImageViewContainer, TransposeTest)
+{
+  typedef hs::recon::workflow::CompactImageViewContainer ViewContainer;
+
+  hs::sfm::TrackContainer tracks(2);
+  tracks[0].push_back(std::make_pair(size_t(0), size_t(3)));
+  tracks[0].push_back(std::make_pair(size_t(2), size_t(4)));
+  tracks[1].push_back(std::make_pair(size_t(2), size_t(5)));
+
+  ViewContainer image_views;
+  ASSERT_EQ(0, image_views.Build(tracks, 3));
+  ASSERT_EQ(size_t(3), image_views.NumberOfImages());
+  ASSERT_EQ(size_t(1), image_views.NumberOfViews(0));
+  ASSERT_EQ(size_t(0), image_views.NumberOfViews(1));
+  ASSERT_EQ(size_t(2), image_views.NumberOfViews(2));
+  ASSERT_EQ(ViewContainer::Index(0), image_views.TrackIds(2)[0]);
+  ASSERT_EQ(ViewContainer::Index(4), image_views.KeyIds(2)[0]);
+  ASSERT_EQ(ViewContainer::Index(1), image_views.TrackIds(2)[1]);
+  ASSERT_EQ(ViewContainer::Index(5), image_views.KeyIds(2)[1]);
+
+  ASSERT_EQ(-1, image_views.Build(tracks, 2));
+}
+
+}
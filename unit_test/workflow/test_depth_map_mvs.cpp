@@ -0,0 +1,192 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "workflow/point_cloud/depth_map_estimator.hpp"
+#include "workflow/point_cloud/depth_map_fusion.hpp"
+#include "workflow/point_cloud/depth_map_tiles.hpp"
+#include "workflow/point_cloud/depth_map_mvs.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::MVSCamera MVSCamera;
+typedef hs::recon::workflow::MVSView MVSView;
+typedef MVSCamera::Scalar Scalar;
+typedef MVSCamera::Vector3 Vector3;
+
+float CellValue(int x, int y)
+{
+  unsigned int hash = unsigned(x) * 73856093u ^ unsigned(y) * 19349663u;
+  hash = (hash ^ (hash >> 13)) * 1274126177u;
+  return float((hash >> 8) & 255u);
+}
+
+//Bilinear value noise with 0.1 cells.
+float GroundTexture(Scalar x, Scalar y)
+{
+  Scalar u = x * 10.0 + 1000.0;
+  Scalar v = y * 10.0 + 1000.0;
+  int x0 = int(std::floor(u));
+  int y0 = int(std::floor(v));
+  float a = float(u - Scalar(x0));
+  float b = float(v - Scalar(y0));
+  return (CellValue(x0, y0) * (1.0f - a) + CellValue(x0 + 1, y0) * a) *
+         (1.0f - b) +
+         (CellValue(x0, y0 + 1) * (1.0f - a) + CellValue(x0 + 1, y0 + 1) * a) *
+         b;
+}
+
+//Nadir view of the textured plane z = 0 from (x, y, height).
+MVSView RenderView(int photo_id, Scalar x, Scalar y, Scalar height)
+{
+  MVSView view;
+  view.photo_id = photo_id;
+  view.width = 128;
+  view.height = 128;
+  view.camera.K << 200, 0, 64,
+                   0, 200, 64,
+                   0, 0, 1;
+  view.camera.K_inverse = view.camera.K.inverse();
+  view.camera.R << 1, 0, 0,
+                   0, -1, 0,
+                   0, 0, -1;
+  view.camera.C << x, y, height;
+  view.gray.resize(size_t(view.width) * size_t(view.height));
+  view.colors.resize(view.gray.size() * 3);
+  for (int row = 0; row < view.height; row++)
+  {
+    for (int col = 0; col < view.width; col++)
+    {
+      Vector3 point = view.camera.BackProject(col, row, height);
+      size_t pixel_id = size_t(row) * size_t(view.width) + size_t(col);
+      view.gray[pixel_id] = GroundTexture(point[0], point[1]);
+      for (int k = 0; k < 3; k++)
+      {
+        view.colors[pixel_id * 3 + k] = MVSView::Byte(view.gray[pixel_id]);
+      }
+    }
+  }
+  return view;
+}
+
+TEST(TestDepthMapMVS, SimpleTest)
+{
+  std::vector<MVSView> views;
+  views.push_back(RenderView(0, 0, 0, 10));
+  views.push_back(RenderView(1, 1, 0, 10));
+  views.push_back(RenderView(2, 0, 1, 10));
+  views.push_back(RenderView(3, 1, 1, 10));
+
+  //Sparse points on the ground pick neighbours and depth ranges.
+  hs::recon::workflow::DepthMapMVSOptions options;
+  options.number_of_neighbours = 3;
+  options.number_of_threads = 2;
+  hs::recon::workflow::DepthMapMVS depth_map_mvs(options);
+  hs::recon::workflow::DepthMapMVS::Vector3Container sparse_points;
+  for (int i = -5; i <= 6; i++)
+  {
+    for (int j = -5; j <= 6; j++)
+    {
+      sparse_points.push_back(Vector3(Scalar(i) * 0.5, Scalar(j) * 0.5, 0));
+    }
+  }
+  std::vector<std::vector<size_t> > neighbours;
+  std::vector<float> depth_ranges;
+  depth_map_mvs.SelectNeighbours(views, sparse_points,
+                                 neighbours, depth_ranges);
+  ASSERT_EQ(size_t(3), neighbours[0].size());
+  ASSERT_GT(10.0f, depth_ranges[0]);
+  ASSERT_LT(10.0f, depth_ranges[1]);
+
+  //Every sparse point is a track over the four photos.
+  typedef hs::recon::workflow::CompactTrackContainer CompactTrackContainer;
+  std::vector<CompactTrackContainer::Offset> offsets(1, 0);
+  std::vector<CompactTrackContainer::Index> image_ids;
+  std::vector<CompactTrackContainer::Index> key_ids;
+  std::vector<CompactTrackContainer::Index> point_ids;
+  for (size_t i = 0; i < sparse_points.size(); i++)
+  {
+    for (size_t k = 0; k < views.size(); k++)
+    {
+      image_ids.push_back(CompactTrackContainer::Index(views[k].photo_id));
+      key_ids.push_back(CompactTrackContainer::Index(i));
+    }
+    offsets.push_back(CompactTrackContainer::Offset(image_ids.size()));
+    point_ids.push_back(CompactTrackContainer::Index(i));
+  }
+  CompactTrackContainer tracks;
+  ASSERT_EQ(0, tracks.Assign(offsets, image_ids, key_ids, point_ids));
+  std::vector<std::vector<size_t> > track_neighbours;
+  std::vector<float> track_depth_ranges;
+  depth_map_mvs.SelectNeighboursFromTracks(views, tracks, sparse_points,
+                                           track_neighbours,
+                                           track_depth_ranges);
+  ASSERT_EQ(size_t(3), track_neighbours[0].size());
+  ASSERT_GT(10.0f, track_depth_ranges[0]);
+  ASSERT_LT(10.0f, track_depth_ranges[1]);
+
+  hs::recon::workflow::DepthMapEstimator estimator(2, 2, 0.7f, 2);
+  std::vector<hs::recon::workflow::DepthMap> depth_maps(views.size());
+  for (size_t i = 0; i < views.size(); i++)
+  {
+    std::vector<const MVSView*> neighbour_views;
+    for (size_t k = 0; k < neighbours[i].size(); k++)
+    {
+      neighbour_views.push_back(&views[neighbours[i][k]]);
+    }
+    ASSERT_EQ(0, estimator(views[i], neighbour_views,
+                           depth_ranges[i * 2], depth_ranges[i * 2 + 1],
+                           depth_maps[i]));
+  }
+
+  const hs::recon::workflow::DepthMap& depth_map = depth_maps[0];
+  ASSERT_EQ(64, depth_map.width);
+  //Corners seen by no neighbour may match wrongly, fusion drops them.
+  size_t number_of_valid = 0;
+  size_t number_of_accurate = 0;
+  for (size_t i = 0; i < depth_map.Size(); i++)
+  {
+    if (depth_map.depths[i] <= 0.0f) continue;
+    number_of_valid++;
+    if (std::abs(depth_map.depths[i] - 10.0f) < 0.1f &&
+        depth_map.normals[i * 3 + 2] > 0.9f)
+    {
+      number_of_accurate++;
+    }
+  }
+  ASSERT_LT(depth_map.Size() / 2, number_of_valid);
+  ASSERT_LT(number_of_valid * 95 / 100, number_of_accurate);
+
+  std::vector<MVSCamera> cameras;
+  std::vector<std::string> depth_map_paths;
+  std::vector<std::string> fused_paths;
+  hs::recon::workflow::DepthMapTileWriter writer(16);
+  for (size_t i = 0; i < views.size(); i++)
+  {
+    cameras.push_back(views[i].camera);
+    depth_map_paths.push_back(
+      "test_depth_map_mvs_depth_" + std::to_string(i) + ".bin");
+    fused_paths.push_back(
+      "test_depth_map_mvs_fused_" + std::to_string(i) + ".bin");
+    ASSERT_EQ(0, writer(depth_maps[i], depth_map_paths[i]));
+  }
+  hs::recon::workflow::DepthMapFusion fusion(2, 2);
+  hs::recon::workflow::DepthMapFusion::PointCloudData point_cloud;
+  ASSERT_EQ(0, fusion(cameras, depth_map_paths, neighbours, fused_paths,
+                      point_cloud));
+  for (size_t i = 0; i < depth_map_paths.size(); i++)
+  {
+    std::remove(depth_map_paths[i].c_str());
+  }
+  ASSERT_LT(number_of_valid / 2, point_cloud.VertexData().size());
+  for (size_t i = 0; i < point_cloud.VertexData().size(); i++)
+  {
+    ASSERT_NEAR(0.0, point_cloud.VertexData()[i][2], 0.1);
+    ASSERT_LT(0.9, point_cloud.NormalData()[i][2]);
+  }
+}
+
+}
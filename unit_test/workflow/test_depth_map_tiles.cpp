@@ -0,0 +1,73 @@
+#include <cmath>
+#include <cstdio>
+
+#include <gtest/gtest.h>
+
+#include "workflow/point_cloud/depth_map_tiles.hpp"
+
+namespace
+{
+
+TEST(TestDepthMapTiles, SimpleTest)
+{
+  //Sloped depths around 500 with holes and an empty 8 x 8 tile.
+  hs::recon::workflow::DepthMap depth_map;
+  depth_map.Reset(21, 13, 2);
+  for (int i = 0; i < depth_map.height; i++)
+  {
+    for (int j = 0; j < depth_map.width; j++)
+    {
+      size_t sample_id = size_t(i) * size_t(depth_map.width) + size_t(j);
+      if ((i + j) % 5 == 0 || (i < 8 && j >= 8 && j < 16)) continue;
+      depth_map.depths[sample_id] = 500.0f + 0.37f * float(i) -
+                                    0.21f * float(j);
+      depth_map.scores[sample_id] = 0.8f;
+      depth_map.normals[sample_id * 3 + 0] = 0.6f;
+      depth_map.normals[sample_id * 3 + 1] = 0.0f;
+      depth_map.normals[sample_id * 3 + 2] = 0.8f;
+      depth_map.colors[sample_id * 3 + 0] =
+        hs::recon::workflow::DepthMap::Byte(i * 10);
+      depth_map.colors[sample_id * 3 + 1] =
+        hs::recon::workflow::DepthMap::Byte(j * 10);
+      depth_map.colors[sample_id * 3 + 2] = 7;
+    }
+  }
+
+  const char* path = "test_depth_map_tiles.bin";
+  hs::recon::workflow::DepthMapTileWriter writer(8);
+  ASSERT_EQ(0, writer(depth_map, path));
+
+  {
+    hs::recon::workflow::DepthMapTileReader reader;
+    ASSERT_EQ(0, reader.Open(path));
+    ASSERT_EQ(21, reader.width());
+    ASSERT_EQ(13, reader.height());
+    ASSERT_EQ(2, reader.step());
+    ASSERT_EQ(0.0f, reader.Depth(-1, 0));
+    ASSERT_EQ(0.0f, reader.Depth(0, 21));
+
+    hs::recon::workflow::DepthMap read_map;
+    ASSERT_EQ(0, reader.Read(read_map));
+    for (size_t i = 0; i < depth_map.Size(); i++)
+    {
+      if (depth_map.depths[i] <= 0.0f)
+      {
+        ASSERT_EQ(0.0f, read_map.depths[i]);
+        continue;
+      }
+      //Offsets inside a tile are a few units, so half precision is fine.
+      ASSERT_NEAR(depth_map.depths[i], read_map.depths[i], 0.01f);
+      ASSERT_NEAR(0.8f, read_map.scores[i], 0.001f);
+      ASSERT_NEAR(0.6f, read_map.normals[i * 3 + 0], 0.001f);
+      ASSERT_NEAR(0.8f, read_map.normals[i * 3 + 2], 0.001f);
+      for (int c = 0; c < 3; c++)
+      {
+        ASSERT_EQ(depth_map.colors[i * 3 + c], read_map.colors[i * 3 + c]);
+      }
+    }
+  }
+
+  std::remove(path);
+}
+
+}
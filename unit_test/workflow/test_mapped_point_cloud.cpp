@@ -0,0 +1,180 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include <gtest/gtest.h>
+
+#include "workflow/common/mapped_point_cloud.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ChunkedPointCloudWriter Writer;
+typedef hs::recon::workflow::ChunkedPointCloudReader Reader;
+typedef hs::recon::workflow::MappedPointCloud MappedPointCloud;
+typedef Writer::Scalar Scalar;
+typedef Writer::Vector3 Vector3;
+typedef Writer::PointCloudData PointCloudData;
+
+Scalar Random(Scalar range)
+{
+  return Scalar(std::rand()) / Scalar(RAND_MAX) * range;
+}
+
+void GeneratePointCloud(size_t number_of_points, PointCloudData& point_cloud)
+{
+  std::srand(7);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    point_cloud.VertexData().push_back(
+      Vector3(500000 + Random(1000), 3000000 + Random(1000), Random(50)));
+    Vector3 normal(Random(2) - 1, Random(2) - 1, Random(2) - 1);
+    point_cloud.NormalData().push_back(normal.normalized());
+    point_cloud.ColorData().push_back(
+      Vector3(Scalar(i % 256), Scalar(i % 5), 255) / 255.0);
+  }
+}
+
+TEST(TestMappedPointCloud, SimpleTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(20000, point_cloud);
+  std::string path = "test_mapped_point_cloud.bin";
+  Writer writer(1000);
+  ASSERT_EQ(0, writer(point_cloud, path, true));
+
+  //The mapped arrays must decode to what the stream reader gives.
+  Reader reader;
+  ASSERT_EQ(0, reader.Open(path));
+  PointCloudData read_cloud;
+  ASSERT_EQ(0, reader.Read(read_cloud));
+  reader.Close();
+
+  MappedPointCloud mapped_cloud;
+  ASSERT_EQ(0, mapped_cloud.Open(path));
+  ASSERT_EQ(size_t(20000), mapped_cloud.NumberOfPoints());
+  ASSERT_EQ(size_t(20), mapped_cloud.NumberOfChunks());
+  ASSERT_TRUE(mapped_cloud.HasNormals());
+  ASSERT_TRUE(mapped_cloud.HasColors());
+  size_t number_of_points = 0;
+  for (size_t i = 0; i < mapped_cloud.NumberOfChunks(); i++)
+  {
+    MappedPointCloud::Chunk chunk = mapped_cloud.GetChunk(i);
+    ASSERT_EQ(chunk.number_of_points * 3, chunk.positions.size());
+    ASSERT_EQ(chunk.number_of_points * 2, chunk.normals.size());
+    ASSERT_EQ(chunk.number_of_points * 3, chunk.colors.size());
+    for (size_t k = 0; k < chunk.number_of_points; k++)
+    {
+      size_t point_id = chunk.first_point + k;
+      ASSERT_LT((read_cloud.VertexData()[point_id] -
+                 MappedPointCloud::Position(chunk, k)).norm(), 1e-9);
+      ASSERT_LT((read_cloud.NormalData()[point_id] -
+                 MappedPointCloud::Normal(chunk, k)).norm(), 1e-9);
+      ASSERT_LT((read_cloud.ColorData()[point_id] -
+                 MappedPointCloud::Color(chunk, k)).norm(), 1e-9);
+      ASSERT_TRUE(
+        (MappedPointCloud::Position(chunk, k).array() >=
+         mapped_cloud.BoxMin().array() - 1e-3).all());
+      ASSERT_TRUE(
+        (MappedPointCloud::Position(chunk, k).array() <=
+         mapped_cloud.BoxMax().array() + 1e-3).all());
+    }
+    number_of_points += chunk.number_of_points;
+  }
+  ASSERT_EQ(size_t(20000), number_of_points);
+  mapped_cloud.Close();
+  ASSERT_FALSE(mapped_cloud.IsOpen());
+  std::remove(path.c_str());
+}
+
+TEST(TestMappedPointCloud, PositionsTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(5000, point_cloud);
+  std::string path = "test_mapped_point_cloud_positions.bin";
+  ASSERT_EQ(0, hs::recon::workflow::SavePointCloud(point_cloud, path, false));
+
+  MappedPointCloud::Vector3Container positions;
+  ASSERT_EQ(0, hs::recon::workflow::LoadPointCloudPositions(path, positions));
+  ASSERT_EQ(point_cloud.VertexData().size(), positions.size());
+  for (size_t i = 0; i < positions.size(); i++)
+  {
+    ASSERT_LT((point_cloud.VertexData()[i] - positions[i]).norm(), 1e-3);
+  }
+
+  MappedPointCloud::Vector3Container normals;
+  ASSERT_EQ(0, hs::recon::workflow::LoadOrientedPointCloud(path, positions,
+                                                           normals));
+  ASSERT_EQ(point_cloud.NormalData().size(), normals.size());
+  for (size_t i = 0; i < normals.size(); i++)
+  {
+    ASSERT_LT((point_cloud.VertexData()[i] - positions[i]).norm(), 1e-3);
+    ASSERT_LT((point_cloud.NormalData()[i] - normals[i]).norm(), 1e-3);
+  }
+
+  //Clouds without normals cannot be oriented.
+  point_cloud.NormalData().clear();
+  ASSERT_EQ(0, hs::recon::workflow::SavePointCloud(point_cloud, path, false));
+  ASSERT_EQ(-1, hs::recon::workflow::LoadOrientedPointCloud(path, positions,
+                                                            normals));
+  std::remove(path.c_str());
+}
+
+TEST(TestMappedPointCloud, PositionViewTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(5000, point_cloud);
+  std::string path = "test_mapped_point_cloud_view.bin";
+  Writer writer(1000);
+  ASSERT_EQ(0, writer(point_cloud, path, false));
+
+  hs::recon::workflow::PointPositionView view;
+  ASSERT_EQ(0, view.Open(path));
+  ASSERT_EQ(point_cloud.VertexData().size(), view.size());
+  //Random access across chunk borders.
+  for (size_t i = 0; i < view.size(); i += 7)
+  {
+    ASSERT_LT((point_cloud.VertexData()[i] - view[i]).norm(), 1e-3);
+  }
+  ASSERT_LT((point_cloud.VertexData()[999] - view[999]).norm(), 1e-3);
+  ASSERT_LT((point_cloud.VertexData()[1000] - view[1000]).norm(), 1e-3);
+  view.Close();
+  ASSERT_TRUE(view.empty());
+
+  hs::recon::workflow::PointPositionView wrapped(
+    point_cloud.VertexData().data(), point_cloud.VertexData().size());
+  ASSERT_EQ(point_cloud.VertexData().size(), wrapped.size());
+  ASSERT_EQ(point_cloud.VertexData()[42], wrapped[42]);
+
+  ASSERT_EQ(-1, view.Open("test_mapped_point_cloud_missing.bin"));
+  std::remove(path.c_str());
+}
+
+TEST(TestMappedPointCloud, TruncatedTest)
+{
+  PointCloudData point_cloud;
+  GeneratePointCloud(3000, point_cloud);
+  std::string path = "test_mapped_point_cloud_truncated.bin";
+  Writer writer(1000);
+  ASSERT_EQ(0, writer(point_cloud, path, false));
+
+  //Cut the file inside the data of the last chunk but keep a valid
+  //header, the table offset then points past the end.
+  std::string data;
+  {
+    std::ifstream file(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(file),
+                std::istreambuf_iterator<char>());
+  }
+  {
+    std::ofstream file(path, std::ios::binary);
+    file.write(data.data(), std::streamsize(data.size() / 2));
+  }
+  MappedPointCloud mapped_cloud;
+  ASSERT_NE(0, mapped_cloud.Open(path));
+  ASSERT_FALSE(mapped_cloud.IsOpen());
+  std::remove(path.c_str());
+}
+
+}
@@ -0,0 +1,204 @@
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "workflow/mesh_surface/mesh_simplifier.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::CompactMesh CompactMesh;
+typedef hs::recon::workflow::MeshSimplifier Simplifier;
+typedef hs::recon::workflow::MeshSimplifierOptions Options;
+typedef CompactMesh::Index Index;
+typedef CompactMesh::Vertex Vertex;
+typedef CompactMesh::Triangle Triangle;
+
+float Height(float x, float y, float bump)
+{
+  return bump * std::exp(-((x - 50) * (x - 50) + (y - 50) * (y - 50)) /
+                         400.0f);
+}
+
+//Height field over a 100 x 100 square with a bump in the middle.
+void GenerateGrid(int size, float bump, CompactMesh& mesh)
+{
+  mesh.origin = CompactMesh::Position(500000, 3000000, 100);
+  float step = 100.0f / float(size - 1);
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      mesh.vertices.push_back(Vertex(x * step, y * step,
+                                     Height(x * step, y * step, bump)));
+    }
+  }
+  for (int y = 0; y + 1 < size; y++)
+  {
+    for (int x = 0; x + 1 < size; x++)
+    {
+      Index a = Index(y * size + x);
+      Index b = a + 1;
+      Index c = a + Index(size);
+      Index d = c + 1;
+      Triangle first = {{a, b, d}};
+      Triangle second = {{a, d, c}};
+      mesh.triangles.push_back(first);
+      mesh.triangles.push_back(second);
+    }
+  }
+}
+
+//Each edge is used once in each direction, except on the border.
+void CheckManifold(const CompactMesh& mesh, size_t& number_of_border_edges)
+{
+  std::map<std::pair<Index, Index>, int> edges;
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    const Triangle& triangle = mesh.triangles[i];
+    ASSERT_LT(triangle[0], mesh.vertices.size());
+    ASSERT_LT(triangle[1], mesh.vertices.size());
+    ASSERT_LT(triangle[2], mesh.vertices.size());
+    const Vertex& a = mesh.vertices[triangle[0]];
+    const Vertex& b = mesh.vertices[triangle[1]];
+    const Vertex& c = mesh.vertices[triangle[2]];
+    //Facing up, as the input.
+    ASSERT_LT(0.0f, (b - a).cross(c - a)[2]);
+    for (int k = 0; k < 3; k++)
+    {
+      edges[std::make_pair(triangle[k], triangle[(k + 1) % 3])]++;
+    }
+  }
+  number_of_border_edges = 0;
+  std::map<std::pair<Index, Index>, int>::const_iterator itr_edge =
+    edges.begin();
+  for (; itr_edge != edges.end(); ++itr_edge)
+  {
+    ASSERT_EQ(1, itr_edge->second);
+    if (edges.count(std::make_pair(itr_edge->first.second,
+                                   itr_edge->first.first)) == 0)
+    {
+      number_of_border_edges++;
+    }
+  }
+}
+
+TEST(TestMeshSimplifier, TargetTest)
+{
+  CompactMesh mesh;
+  GenerateGrid(201, 20, mesh);
+  size_t number_of_triangles = mesh.triangles.size();
+
+  Options options;
+  options.target_triangles = number_of_triangles / 10;
+  options.number_of_threads = 4;
+  ASSERT_EQ(0, Simplifier(options)(mesh));
+  ASSERT_GE(options.target_triangles * 3 / 2, mesh.triangles.size());
+  ASSERT_LE(options.target_triangles / 2, mesh.triangles.size());
+
+  size_t number_of_border_edges = 0;
+  CheckManifold(mesh, number_of_border_edges);
+  //Border vertices stay in place.
+  ASSERT_EQ(size_t(4 * 200), number_of_border_edges);
+  for (size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    const Vertex& vertex = mesh.vertices[i];
+    ASSERT_GT(0.5f, std::abs(vertex[2] - Height(vertex[0], vertex[1], 20)));
+  }
+}
+
+TEST(TestMeshSimplifier, ErrorTest)
+{
+  //A plane collapses to little more than its border within any error.
+  CompactMesh mesh;
+  GenerateGrid(101, 0, mesh);
+  Options options;
+  options.max_error = 1e-3;
+  options.number_of_threads = 2;
+  ASSERT_EQ(0, Simplifier(options)(mesh));
+  ASSERT_GT(size_t(1000), mesh.triangles.size());
+  size_t number_of_border_edges = 0;
+  CheckManifold(mesh, number_of_border_edges);
+  for (size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    ASSERT_GT(1e-3f, std::abs(mesh.vertices[i][2]));
+  }
+
+  //The bound holds for the distance to the surface, heights on the slope
+  //of the bump differ a bit more.
+  CompactMesh bumped_mesh;
+  GenerateGrid(101, 20, bumped_mesh);
+  size_t number_of_triangles = bumped_mesh.triangles.size();
+  options.max_error = 0.05;
+  ASSERT_EQ(0, Simplifier(options)(bumped_mesh));
+  ASSERT_GT(number_of_triangles, bumped_mesh.triangles.size());
+  for (size_t i = 0; i < bumped_mesh.vertices.size(); i++)
+  {
+    const Vertex& vertex = bumped_mesh.vertices[i];
+    ASSERT_GT(0.25f, std::abs(vertex[2] - Height(vertex[0], vertex[1], 20)));
+  }
+}
+
+TEST(TestMeshSimplifier, ThreadsTest)
+{
+  CompactMesh serial_mesh;
+  GenerateGrid(301, 20, serial_mesh);
+  CompactMesh parallel_mesh = serial_mesh;
+  Options options;
+  options.target_triangles = serial_mesh.triangles.size() / 8;
+  options.number_of_threads = 1;
+  ASSERT_EQ(0, Simplifier(options)(serial_mesh));
+  options.number_of_threads = 3;
+  ASSERT_EQ(0, Simplifier(options)(parallel_mesh));
+  ASSERT_TRUE(serial_mesh.vertices == parallel_mesh.vertices);
+  ASSERT_TRUE(serial_mesh.triangles == parallel_mesh.triangles);
+}
+
+TEST(TestMeshSimplifier, LodTest)
+{
+  ASSERT_EQ(std::string("dir/mesh_lod2.bin"),
+            hs::recon::workflow::MeshLodPath("dir/mesh.bin", 2));
+  ASSERT_EQ(std::string("dir.d/mesh_lod1"),
+            hs::recon::workflow::MeshLodPath("dir.d/mesh", 1));
+
+  CompactMesh mesh;
+  GenerateGrid(101, 20, mesh);
+  std::string path = "test_mesh_simplifier.bin";
+  ASSERT_EQ(0, hs::recon::workflow::SaveMesh(path, mesh));
+  ASSERT_EQ(0, hs::recon::workflow::BuildMeshLods(path, 2, 0.25, 0, 2));
+
+  size_t previous = mesh.triangles.size();
+  for (int level = 1; level <= 2; level++)
+  {
+    size_t number_of_vertices = 0;
+    size_t number_of_triangles = 0;
+    ASSERT_EQ(0, hs::recon::workflow::ReadMeshSize(
+      hs::recon::workflow::MeshLodPath(path, level), number_of_vertices,
+      number_of_triangles));
+    ASSERT_GT(previous / 2, number_of_triangles);
+    previous = number_of_triangles;
+  }
+
+  CompactMesh lod;
+  ASSERT_EQ(0, hs::recon::workflow::LoadMeshLod(path, mesh.triangles.size(),
+                                                lod));
+  ASSERT_EQ(mesh.triangles.size(), lod.triangles.size());
+  ASSERT_EQ(0, hs::recon::workflow::LoadMeshLod(path, previous, lod));
+  ASSERT_EQ(previous, lod.triangles.size());
+  ASSERT_EQ(0, hs::recon::workflow::LoadMeshLod(path, 1, lod));
+  ASSERT_EQ(previous, lod.triangles.size());
+
+  //Fewer levels remove the ones left over.
+  ASSERT_EQ(0, hs::recon::workflow::BuildMeshLods(path, 1, 0.25, 0, 2));
+  ASSERT_NE(0, std::remove(
+    hs::recon::workflow::MeshLodPath(path, 2).c_str()));
+  ASSERT_EQ(0, std::remove(
+    hs::recon::workflow::MeshLodPath(path, 1).c_str()));
+  std::remove(path.c_str());
+}
+
+}
@@ -0,0 +1,107 @@
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+#include "workflow/point_cloud/point_cloud_filter.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::PointCloudFilter PointCloudFilter;
+typedef PointCloudFilter::Scalar Scalar;
+typedef PointCloudFilter::Vector3 Vector3;
+typedef PointCloudFilter::PointCloudData PointCloudData;
+
+void AddPoint(const Vector3& point, PointCloudData& point_cloud)
+{
+  point_cloud.VertexData().push_back(point);
+  point_cloud.NormalData().push_back(Vector3(0, 0, 1));
+  point_cloud.ColorData().push_back(Vector3(100, 100, 100));
+}
+
+TEST(TestPointCloudFilter, MortonCodeTest)
+{
+  ASSERT_EQ(PointCloudFilter::Code(1), PointCloudFilter::MortonCode(1, 0, 0));
+  ASSERT_EQ(PointCloudFilter::Code(2), PointCloudFilter::MortonCode(0, 1, 0));
+  ASSERT_EQ(PointCloudFilter::Code(4), PointCloudFilter::MortonCode(0, 0, 1));
+  ASSERT_EQ(PointCloudFilter::Code(9), PointCloudFilter::MortonCode(3, 0, 0));
+  ASSERT_EQ(PointCloudFilter::Code(0x7FFFFFFFFFFFFFFFULL),
+            PointCloudFilter::MortonCode(0x1FFFFF, 0x1FFFFF, 0x1FFFFF));
+}
+
+TEST(TestPointCloudFilter, SortTest)
+{
+  PointCloudData point_cloud;
+  std::srand(7);
+  for (int i = 0; i < 300000; i++)
+  {
+    AddPoint(Vector3(Scalar(std::rand() % 1000),
+                     Scalar(std::rand() % 1000),
+                     Scalar(std::rand() % 100)), point_cloud);
+  }
+  hs::recon::workflow::PointCloudFilterOptions options;
+  options.number_of_threads = 4;
+  PointCloudFilter filter(options);
+  Vector3 origin;
+  std::vector<PointCloudFilter::CodedPoint> coded_points;
+  ASSERT_EQ(Scalar(1),
+            filter.SortByCell(point_cloud, 1, origin, coded_points));
+  ASSERT_EQ(point_cloud.VertexData().size(), coded_points.size());
+  std::vector<char> visited(coded_points.size(), 0);
+  for (size_t i = 0; i < coded_points.size(); i++)
+  {
+    if (i > 0) ASSERT_LE(coded_points[i - 1].first, coded_points[i].first);
+    const Vector3& point = point_cloud.VertexData()[coded_points[i].second];
+    ASSERT_EQ(PointCloudFilter::MortonCode(uint32_t(point[0]),
+                                           uint32_t(point[1]),
+                                           uint32_t(point[2])),
+              coded_points[i].first);
+    visited[coded_points[i].second] = 1;
+  }
+  for (size_t i = 0; i < visited.size(); i++)
+  {
+    ASSERT_EQ(1, int(visited[i]));
+  }
+}
+
+TEST(TestPointCloudFilter, SimpleTest)
+{
+  //A plane sampled every 0.1 by three views, and some stray points.
+  PointCloudData point_cloud;
+  for (int view = 0; view < 3; view++)
+  {
+    for (int i = 0; i < 40; i++)
+    {
+      for (int j = 0; j < 40; j++)
+      {
+        AddPoint(Vector3(Scalar(j) * 0.1 + 0.05 + Scalar(view) * 0.001,
+                         Scalar(i) * 0.1 + 0.05, 0.001 * Scalar(view)),
+                 point_cloud);
+      }
+    }
+  }
+  for (int i = 0; i < 10; i++)
+  {
+    AddPoint(Vector3(Scalar(i) * 0.4, 1, 2 + Scalar(i)), point_cloud);
+  }
+
+  hs::recon::workflow::PointCloudFilterOptions options;
+  options.duplicate_distance = 0.025f;
+  options.outlier_neighbours = 8;
+  options.outlier_radius = 0.4f;
+  options.voxel_size = 0.2f;
+  options.number_of_threads = 2;
+  PointCloudFilter filter(options);
+  ASSERT_EQ(0, filter(point_cloud));
+  ASSERT_EQ(size_t(400), point_cloud.VertexData().size());
+  ASSERT_EQ(size_t(400), point_cloud.NormalData().size());
+  ASSERT_EQ(size_t(400), point_cloud.ColorData().size());
+  for (size_t i = 0; i < point_cloud.VertexData().size(); i++)
+  {
+    ASSERT_NEAR(0.0, point_cloud.VertexData()[i][2], 0.01);
+    ASSERT_NEAR(1.0, point_cloud.NormalData()[i][2], 1e-9);
+    ASSERT_NEAR(100.0, point_cloud.ColorData()[i][0], 1e-9);
+  }
+}
+
+}
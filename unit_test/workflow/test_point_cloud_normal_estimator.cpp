@@ -0,0 +1,205 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <thread>
+
+#include <gtest/gtest.h>
+
+#include "hs_sfm/sfm_pipeline/point_cloud_norm_calculator.hpp"
+
+#include "workflow/photo_orientation/point_cloud_normal_estimator.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::PointCloudNormalEstimator Estimator;
+typedef Estimator::Scalar Scalar;
+typedef Estimator::Vector3 Vector3;
+typedef Estimator::Vector3Container Vector3Container;
+
+TEST(TestPointCloudNormalEstimator, SimpleTest)
+{
+  Vector3Container camera_centers(3);
+  camera_centers[0] = Vector3(0, 0, 10);
+  camera_centers[1] = Vector3(10, 0, 0);
+  camera_centers[2] = Vector3(0, 10, 0);
+  std::vector<char> camera_flags(3, 1);
+  camera_flags[2] = 0;
+
+  Vector3Container points(3, Vector3::Zero());
+  hs::sfm::TrackContainer tracks(3);
+  hs::sfm::ObjectIndexMap track_point_map(3);
+  //Point 0 seen by camera 0 and 1.
+  tracks[0].push_back(std::make_pair(size_t(0), size_t(0)));
+  tracks[0].push_back(std::make_pair(size_t(1), size_t(0)));
+  track_point_map[0] = 0;
+  //Point 1 only seen by the unoriented camera 2.
+  tracks[1].push_back(std::make_pair(size_t(2), size_t(1)));
+  track_point_map[1] = 1;
+  //Point 2 only seen by camera 1.
+  tracks[2].push_back(std::make_pair(size_t(1), size_t(2)));
+  track_point_map[2] = 2;
+
+  Vector3Container normals(points.size());
+  Estimator estimator(4);
+  ASSERT_EQ(0, estimator(tracks, track_point_map,
+                         camera_centers, camera_flags,
+                         points, normals.data()));
+
+  Scalar threshold = 1e-10;
+  Scalar component = std::sqrt(Scalar(0.5));
+  ASSERT_NEAR(component, normals[0][0], threshold);
+  ASSERT_NEAR(0, normals[0][1], threshold);
+  ASSERT_NEAR(component, normals[0][2], threshold);
+  ASSERT_NEAR(0, normals[1][0], threshold);
+  ASSERT_NEAR(0, normals[1][1], threshold);
+  ASSERT_NEAR(1, normals[1][2], threshold);
+  ASSERT_NEAR(1, normals[2][0], threshold);
+  ASSERT_NEAR(0, normals[2][1], threshold);
+  ASSERT_NEAR(0, normals[2][2], threshold);
+}
+
+//Matches the projection based calculator it replaces in
+//IncrementalPhotoOrientation::SavePointCloud when every camera sees every
+//point.
+TEST(TestPointCloudNormalEstimator, CalculatorTest)
+{
+  typedef hs::sfm::pipeline::PointCloudNormCalculator<Scalar> NormCalculator;
+  typedef NormCalculator::CameraParamsContainer CameraParamsContainer;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+
+  size_t number_of_cameras = 6;
+  size_t number_of_points = 50;
+
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<Scalar> distribution(-10, 10);
+
+  Vector3Container camera_centers(number_of_cameras);
+  std::vector<char> camera_flags(number_of_cameras, 1);
+  CameraParamsContainer camera_params_set(number_of_cameras);
+  IntrinsicParams intrinsic_params(1000, 0, 2000, 1500, 1, 0, 0, 0);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    camera_centers[i] << distribution(generator),
+                         distribution(generator),
+                         Scalar(-100);
+    camera_params_set[i].intrinsic_params = intrinsic_params;
+    camera_params_set[i].extrinsic_params.position() = camera_centers[i];
+    camera_params_set[i].image_width = 4000;
+    camera_params_set[i].image_height = 3000;
+  }
+
+  Vector3Container points(number_of_points);
+  hs::sfm::TrackContainer tracks(number_of_points);
+  hs::sfm::ObjectIndexMap track_point_map(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    points[i] << distribution(generator),
+                 distribution(generator),
+                 Scalar(0);
+    for (size_t j = 0; j < number_of_cameras; j++)
+    {
+      tracks[i].push_back(std::make_pair(j, i));
+    }
+    track_point_map[i] = i;
+  }
+
+  Vector3Container norms;
+  NormCalculator calculator;
+  calculator(camera_params_set, points, norms);
+  Vector3Container normals(number_of_points);
+  Estimator estimator(2);
+  ASSERT_EQ(0, estimator(tracks, track_point_map,
+                         camera_centers, camera_flags,
+                         points, normals.data()));
+
+  ASSERT_EQ(number_of_points, norms.size());
+  Scalar threshold = 1e-8;
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    ASSERT_NEAR(norms[i][0], normals[i][0], threshold);
+    ASSERT_NEAR(norms[i][1], normals[i][1], threshold);
+    ASSERT_NEAR(norms[i][2], normals[i][2], threshold);
+  }
+}
+
+//Times the estimator against the projection based calculator it replaces
+//in IncrementalPhotoOrientation::SavePointCloud. Disabled, run it with
+//--gtest_also_run_disabled_tests.
+TEST(TestPointCloudNormalEstimator, DISABLED_BenchmarkTest)
+{
+  typedef hs::sfm::pipeline::PointCloudNormCalculator<Scalar> NormCalculator;
+  typedef NormCalculator::CameraParamsContainer CameraParamsContainer;
+  typedef hs::sfm::CameraIntrinsicParams<Scalar> IntrinsicParams;
+
+  size_t number_of_cameras = 400;
+  size_t number_of_points = 200000;
+  size_t views_per_point = 4;
+
+  std::mt19937 generator(0);
+  std::uniform_real_distribution<Scalar> distribution(-100, 100);
+  std::uniform_int_distribution<size_t> camera_distribution(
+    0, number_of_cameras - 1);
+
+  Vector3Container camera_centers(number_of_cameras);
+  std::vector<char> camera_flags(number_of_cameras, 1);
+  CameraParamsContainer camera_params_set(number_of_cameras);
+  IntrinsicParams intrinsic_params(1000, 0, 2000, 1500, 1, 0, 0, 0);
+  for (size_t i = 0; i < number_of_cameras; i++)
+  {
+    camera_centers[i] << distribution(generator),
+                         distribution(generator),
+                         Scalar(-100);
+    camera_params_set[i].intrinsic_params = intrinsic_params;
+    camera_params_set[i].extrinsic_params.position() = camera_centers[i];
+    camera_params_set[i].image_width = 4000;
+    camera_params_set[i].image_height = 3000;
+  }
+
+  Vector3Container points(number_of_points);
+  hs::sfm::TrackContainer tracks(number_of_points);
+  hs::sfm::ObjectIndexMap track_point_map(number_of_points);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    points[i] << distribution(generator),
+                 distribution(generator),
+                 Scalar(0);
+    for (size_t j = 0; j < views_per_point; j++)
+    {
+      tracks[i].push_back(std::make_pair(camera_distribution(generator), i));
+    }
+    track_point_map[i] = i;
+  }
+
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point start = Clock::now();
+  Vector3Container norms;
+  NormCalculator calculator;
+  calculator(camera_params_set, points, norms);
+  Clock::time_point middle = Clock::now();
+  Vector3Container normals(number_of_points);
+  Estimator estimator(std::max(std::thread::hardware_concurrency(), 1u));
+  ASSERT_EQ(0, estimator(tracks, track_point_map,
+                         camera_centers, camera_flags,
+                         points, normals.data()));
+  Clock::time_point end = Clock::now();
+
+  typedef std::chrono::milliseconds Milliseconds;
+  std::cout<<"PointCloudNormCalculator: "
+           <<std::chrono::duration_cast<Milliseconds>(middle - start).count()
+           <<"ms\n";
+  std::cout<<"PointCloudNormalEstimator: "
+           <<std::chrono::duration_cast<Milliseconds>(end - middle).count()
+           <<"ms\n";
+
+  //Every camera is below the plane, so all normals point down.
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    ASSERT_NEAR(1, normals[i].norm(), 1e-8);
+    ASSERT_GT(0, normals[i][2]);
+  }
+}
+
+}
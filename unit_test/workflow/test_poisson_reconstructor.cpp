@@ -0,0 +1,126 @@
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "workflow/mesh_surface/poisson_reconstructor.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::PoissonReconstructor Reconstructor;
+typedef hs::recon::workflow::PoissonReconstructorOptions Options;
+typedef Reconstructor::Scalar Scalar;
+typedef Reconstructor::Vector3 Vector3;
+typedef Reconstructor::Vector3Container Vector3Container;
+typedef Reconstructor::TriangleContainer TriangleContainer;
+
+const Scalar PI = 3.14159265358979323846;
+
+void GenerateSphere(const Vector3& center, Scalar radius,
+                    size_t number_of_points,
+                    Vector3Container& points, Vector3Container& normals)
+{
+  std::srand(17);
+  for (size_t i = 0; i < number_of_points; i++)
+  {
+    Scalar z = Scalar(std::rand()) / Scalar(RAND_MAX) * 2 - 1;
+    Scalar phi = Scalar(std::rand()) / Scalar(RAND_MAX) * 2 * PI;
+    Scalar r = std::sqrt(std::max(1 - z * z, Scalar(0)));
+    Vector3 normal(r * std::cos(phi), r * std::sin(phi), z);
+    points.push_back(center + normal * radius);
+    normals.push_back(normal);
+  }
+}
+
+TEST(TestPoissonReconstructor, SphereTest)
+{
+  Vector3 center(500000, 3000000, 120);
+  Scalar radius = 10;
+  Vector3Container points;
+  Vector3Container normals;
+  GenerateSphere(center, radius, 20000, points, normals);
+
+  Options options;
+  options.depth = 6;
+  options.min_depth = 4;
+  options.number_of_threads = 1;
+  Vector3Container vertices;
+  TriangleContainer triangles;
+  ASSERT_EQ(0, Reconstructor(options)(points, normals, vertices, triangles));
+  ASSERT_LT(100, triangles.size());
+
+  //Within two cells of the sphere.
+  Scalar cell_size = 2 * radius * options.cube_ratio / Scalar(1 << 6);
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    ASSERT_GT(2 * cell_size, std::abs((vertices[i] - center).norm() - radius));
+  }
+
+  //Closed: every edge is used once in each direction. Facing out.
+  std::map<std::pair<size_t, size_t>, int> edges;
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    const Vector3& a = vertices[triangles[i][0]];
+    const Vector3& b = vertices[triangles[i][1]];
+    const Vector3& c = vertices[triangles[i][2]];
+    Vector3 normal = (b - a).cross(c - a);
+    ASSERT_LT(0, normal.dot((a + b + c) / 3 - center));
+    for (int k = 0; k < 3; k++)
+    {
+      edges[std::make_pair(size_t(triangles[i][k]),
+                           size_t(triangles[i][(k + 1) % 3]))]++;
+    }
+  }
+  std::map<std::pair<size_t, size_t>, int>::const_iterator itr_edge =
+    edges.begin();
+  for (; itr_edge != edges.end(); ++itr_edge)
+  {
+    ASSERT_EQ(1, itr_edge->second);
+    ASSERT_EQ(1, edges.count(std::make_pair(itr_edge->first.second,
+                                            itr_edge->first.first)));
+  }
+}
+
+TEST(TestPoissonReconstructor, ThreadsTest)
+{
+  Vector3Container points;
+  Vector3Container normals;
+  GenerateSphere(Vector3(0, 0, 0), 1, 5000, points, normals);
+
+  Options options;
+  options.depth = 5;
+  options.min_depth = 3;
+  Vector3Container serial_vertices;
+  TriangleContainer serial_triangles;
+  options.number_of_threads = 1;
+  ASSERT_EQ(0, Reconstructor(options)(points, normals,
+                                      serial_vertices, serial_triangles));
+  Vector3Container parallel_vertices;
+  TriangleContainer parallel_triangles;
+  options.number_of_threads = 3;
+  ASSERT_EQ(0, Reconstructor(options)(points, normals,
+                                      parallel_vertices, parallel_triangles));
+
+  ASSERT_TRUE(serial_vertices == parallel_vertices);
+  ASSERT_TRUE(serial_triangles == parallel_triangles);
+}
+
+TEST(TestPoissonReconstructor, InvalidTest)
+{
+  Options options;
+  Vector3Container points;
+  Vector3Container normals;
+  Vector3Container vertices;
+  TriangleContainer triangles;
+  ASSERT_EQ(-1, Reconstructor(options)(points, normals, vertices, triangles));
+  points.push_back(Vector3(1, 2, 3));
+  normals.push_back(Vector3(0, 0, 1));
+  ASSERT_EQ(-1, Reconstructor(options)(points, normals, vertices, triangles));
+  points.push_back(Vector3(2, 2, 3));
+  ASSERT_EQ(-1, Reconstructor(options)(points, normals, vertices, triangles));
+}
+
+}
@@ -0,0 +1,92 @@
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "workflow/texture/raster_region.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::RegionPoint RegionPoint;
+typedef hs::recon::workflow::RegionPolygon RegionPolygon;
+
+//4 x 3 tiles of 10 x 10 units, the last column and row 5 units wide.
+RasterGrid MakeGrid()
+{
+  RasterGrid grid;
+  grid.left = 100;
+  grid.top = 200;
+  grid.scale_x = 0.5;
+  grid.scale_y = 0.5;
+  grid.width = 70;
+  grid.height = 50;
+  grid.tile_width = 20;
+  grid.tile_height = 20;
+  return grid;
+}
+
+}
+
+TEST(TestRasterRegion, BoxTest)
+{
+  RasterGrid grid = MakeGrid();
+  //From the middle of tile (0, 1) to the middle of tile (1, 2).
+  RegionPolygon region(4);
+  region[0] << 115, 195;
+  region[1] << 125, 195;
+  region[2] << 125, 185;
+  region[3] << 115, 185;
+  std::vector<size_t> tile_ids;
+  ASSERT_EQ(0, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+  std::vector<size_t> expected = {1, 2, 5, 6};
+  ASSERT_EQ(expected, tile_ids);
+
+  //Wholly inside one tile.
+  region[0] << 131, 179;
+  region[1] << 134, 179;
+  region[2] << 134, 176;
+  region[3] << 131, 176;
+  ASSERT_EQ(0, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+  expected = {11};
+  ASSERT_EQ(expected, tile_ids);
+
+  //Around the whole grid.
+  region[0] << 0, 0;
+  region[1] << 0, 300;
+  region[2] << 300, 300;
+  region[3] << 300, 0;
+  ASSERT_EQ(0, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+  ASSERT_EQ(grid.NumberOfTiles(), tile_ids.size());
+
+  //Off the grid.
+  region[0] << 500, 500;
+  region[1] << 510, 500;
+  region[2] << 510, 510;
+  region[3] << 500, 510;
+  ASSERT_EQ(0, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+  ASSERT_TRUE(tile_ids.empty());
+}
+
+TEST(TestRasterRegion, TriangleTest)
+{
+  RasterGrid grid = MakeGrid();
+  //Thin diagonal sliver from the top left to the bottom right tile, whose
+  //bounding box covers every tile.
+  RegionPolygon region(3);
+  region[0] << 101, 199;
+  region[1] << 102, 199;
+  region[2] << 134, 176;
+  std::vector<size_t> tile_ids;
+  ASSERT_EQ(0, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+  std::vector<size_t> expected = {0, 1, 5, 6, 10, 11};
+  ASSERT_EQ(expected, tile_ids);
+}
+
+TEST(TestRasterRegion, InvalidTest)
+{
+  RasterGrid grid = MakeGrid();
+  RegionPolygon region(2, RegionPoint(110, 190));
+  std::vector<size_t> tile_ids;
+  ASSERT_EQ(-1, hs::recon::workflow::TilesInRegion(grid, region, tile_ids));
+}
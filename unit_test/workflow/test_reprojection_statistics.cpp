@@ -0,0 +1,105 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "workflow/photo_orientation/reprojection_statistics.hpp"
+
+namespace
+{
+
+TEST(TestReprojectionStatistics, SimpleTest)
+{
+  typedef hs::recon::workflow::ReprojectionStatisticsCalculator Calculator;
+  typedef hs::recon::workflow::ReprojectionStatistics Statistics;
+  typedef hs::recon::workflow::CompactTrackContainer CompactTrackContainer;
+  typedef CompactTrackContainer::Index Index;
+  typedef CompactTrackContainer::Offset Offset;
+  typedef Calculator::Scalar Scalar;
+  typedef Calculator::Keyset Keyset;
+  typedef Keyset::Key Key;
+
+  //Both cameras at the origin looking down z, points project to (0, 0).
+  Keyset keyset_a;
+  Keyset keyset_b;
+  Key key;
+  key << 3, 4;
+  keyset_a.AddKey(key); //error 5
+  key << 0, 1;
+  keyset_a.AddKey(key); //error 1
+  key << 6, 8;
+  keyset_b.AddKey(key); //error 10
+  key << 0, 2;
+  keyset_b.AddKey(key); //error 2
+
+  Calculator::CameraContainer cameras(2);
+  cameras[0].photo_id = 7;
+  cameras[0].intrinsic_params = Calculator::IntrinsicParams(1000, 0, 0, 0, 1);
+  cameras[0].keyset = &keyset_a;
+  cameras[1].photo_id = 2;
+  cameras[1].intrinsic_params = Calculator::IntrinsicParams(1000, 0, 0, 0, 1);
+  cameras[1].keyset = &keyset_b;
+
+  Calculator::PointContainer points(2, Calculator::Point(0, 0, 10));
+
+  //Track 0: (7,0) (2,0) (9,0), photo 9 is unknown.
+  //Track 1: (7,1) (2,1).
+  //Track 2: (2,1) without point.
+  std::vector<Offset> offsets;
+  offsets.push_back(0);
+  offsets.push_back(3);
+  offsets.push_back(5);
+  offsets.push_back(6);
+  std::vector<Index> image_ids;
+  std::vector<Index> key_ids;
+  image_ids.push_back(7); key_ids.push_back(0);
+  image_ids.push_back(2); key_ids.push_back(0);
+  image_ids.push_back(9); key_ids.push_back(0);
+  image_ids.push_back(7); key_ids.push_back(1);
+  image_ids.push_back(2); key_ids.push_back(1);
+  image_ids.push_back(2); key_ids.push_back(1);
+  std::vector<Index> point_ids;
+  point_ids.push_back(0);
+  point_ids.push_back(1);
+  point_ids.push_back(CompactTrackContainer::INVALID_INDEX);
+  CompactTrackContainer tracks;
+  ASSERT_EQ(0, tracks.Assign(offsets, image_ids, key_ids, point_ids));
+
+  Statistics statistics;
+  Calculator calculator(4, Scalar(4), Scalar(1), 8);
+  ASSERT_EQ(0, calculator(tracks, points, cameras, statistics));
+
+  Scalar threshold = 1e-5;
+  ASSERT_EQ(4u, statistics.overall.number_of_projections);
+  ASSERT_EQ(2u, statistics.overall.number_of_outliers);
+  ASSERT_NEAR(4.5, statistics.overall.mean, threshold);
+  ASSERT_NEAR(std::sqrt(32.5), statistics.overall.rms, threshold);
+  ASSERT_NEAR(3.5, statistics.overall.median, threshold);
+  ASSERT_NEAR(10.0, statistics.overall.max, threshold);
+
+  ASSERT_EQ(7u, statistics.photo_ids[0]);
+  ASSERT_EQ(2u, statistics.photo_summaries[0].number_of_projections);
+  ASSERT_NEAR(3.0, statistics.photo_summaries[0].median, threshold);
+  ASSERT_NEAR(std::sqrt(13.0), statistics.photo_summaries[0].rms, threshold);
+  ASSERT_EQ(1u, statistics.photo_summaries[1].number_of_outliers);
+
+  ASSERT_NEAR(7.5, statistics.track_median[0], threshold);
+  ASSERT_EQ(2u, statistics.track_outliers[0]);
+  ASSERT_NEAR(std::sqrt(2.5), statistics.track_rms[1], threshold);
+  ASSERT_GT(0.0f, statistics.track_rms[2]);
+
+  //Bins of width 1, the last one takes everything larger.
+  ASSERT_EQ(1u, statistics.histogram[1]);
+  ASSERT_EQ(1u, statistics.histogram[2]);
+  ASSERT_EQ(1u, statistics.histogram[5]);
+  ASSERT_EQ(1u, statistics.histogram[7]);
+
+  ASSERT_EQ(0, statistics.Save("reprojection_statistics_test.bin"));
+  Statistics statistics_loaded;
+  ASSERT_EQ(0, statistics_loaded.Load("reprojection_statistics_test.bin"));
+  ASSERT_EQ(statistics.track_median, statistics_loaded.track_median);
+  ASSERT_EQ(statistics.histogram, statistics_loaded.histogram);
+  ASSERT_NEAR(statistics.overall.rms, statistics_loaded.overall.rms,
+              threshold);
+}
+
+}
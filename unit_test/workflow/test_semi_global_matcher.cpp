@@ -0,0 +1,111 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "workflow/point_cloud/sgm_depth_estimator.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::MVSCamera MVSCamera;
+typedef hs::recon::workflow::MVSView MVSView;
+typedef MVSCamera::Scalar Scalar;
+typedef MVSCamera::Vector3 Vector3;
+
+float CellValue(int x, int y)
+{
+  unsigned int hash = unsigned(x) * 73856093u ^ unsigned(y) * 19349663u;
+  hash = (hash ^ (hash >> 13)) * 1274126177u;
+  return float((hash >> 8) & 255u);
+}
+
+//Bilinear value noise with 0.1 cells.
+float GroundTexture(Scalar x, Scalar y)
+{
+  Scalar u = x * 10.0 + 1000.0;
+  Scalar v = y * 10.0 + 1000.0;
+  int x0 = int(std::floor(u));
+  int y0 = int(std::floor(v));
+  float a = float(u - Scalar(x0));
+  float b = float(v - Scalar(y0));
+  return (CellValue(x0, y0) * (1.0f - a) + CellValue(x0 + 1, y0) * a) *
+         (1.0f - b) +
+         (CellValue(x0, y0 + 1) * (1.0f - a) + CellValue(x0 + 1, y0 + 1) * a) *
+         b;
+}
+
+//Nadir view of the textured plane z = 0 from (x, y, height).
+MVSView RenderView(int photo_id, Scalar x, Scalar y, Scalar height)
+{
+  MVSView view;
+  view.photo_id = photo_id;
+  view.width = 128;
+  view.height = 128;
+  view.camera.K << 200, 0, 64,
+                   0, 200, 64,
+                   0, 0, 1;
+  view.camera.K_inverse = view.camera.K.inverse();
+  view.camera.R << 1, 0, 0,
+                   0, -1, 0,
+                   0, 0, -1;
+  view.camera.C << x, y, height;
+  view.gray.resize(size_t(view.width) * size_t(view.height));
+  view.colors.resize(view.gray.size() * 3);
+  for (int row = 0; row < view.height; row++)
+  {
+    for (int col = 0; col < view.width; col++)
+    {
+      Vector3 point = view.camera.BackProject(col, row, height);
+      size_t pixel_id = size_t(row) * size_t(view.width) + size_t(col);
+      view.gray[pixel_id] = GroundTexture(point[0], point[1]);
+      for (int k = 0; k < 3; k++)
+      {
+        view.colors[pixel_id * 3 + k] = MVSView::Byte(view.gray[pixel_id]);
+      }
+    }
+  }
+  return view;
+}
+
+TEST(TestSemiGlobalMatcher, SimpleTest)
+{
+  MVSView left = RenderView(0, 0, 0, 10);
+  MVSView right = RenderView(1, 1, 0, 10);
+
+  hs::recon::workflow::StereoRectifier rectifier;
+  hs::recon::workflow::RectifiedPair pair;
+  int number_of_disparities;
+  ASSERT_EQ(0, rectifier(left, right, 8.0f, 12.5f, 256,
+                         pair, number_of_disparities));
+  ASSERT_EQ(0, number_of_disparities % 16);
+  //The views are already rectified, so rows stay rows.
+  Vector3 point(0.3, -0.2, 0);
+  hs::recon::workflow::MVSCamera::Vector2 left_pixel;
+  hs::recon::workflow::MVSCamera::Vector2 right_pixel;
+  ASSERT_NEAR(10.0, pair.left_camera.Project(point, left_pixel), 1e-9);
+  pair.right_camera.Project(point, right_pixel);
+  ASSERT_NEAR(left_pixel[1], right_pixel[1], 1e-9);
+  ASSERT_NEAR(10.0, pair.Depth(left_pixel[0] - right_pixel[0]), 1e-9);
+
+  hs::recon::workflow::SGMDepthEstimator estimator(2, 256, 2);
+  MVSCamera camera;
+  hs::recon::workflow::DepthMap depth_map;
+  ASSERT_EQ(0, estimator(left, right, 8.0f, 12.5f, camera, depth_map));
+  size_t number_of_valid = 0;
+  size_t number_of_accurate = 0;
+  for (size_t i = 0; i < depth_map.Size(); i++)
+  {
+    if (depth_map.depths[i] <= 0.0f) continue;
+    number_of_valid++;
+    if (std::abs(depth_map.depths[i] - 10.0f) < 0.1f &&
+        depth_map.normals[i * 3 + 2] > 0.9f)
+    {
+      number_of_accurate++;
+    }
+  }
+  //The right view covers the left but for a strip of 20 pixels.
+  ASSERT_LT(depth_map.Size() / 2, number_of_valid);
+  ASSERT_LT(number_of_valid * 95 / 100, number_of_accurate);
+}
+
+}
@@ -0,0 +1,70 @@
+#include <fstream>
+
+#include <gtest/gtest.h>
+
+#include <cereal/types/vector.hpp>
+#include <cereal/types/map.hpp>
+#include <cereal/types/utility.hpp>
+#include <cereal/archives/portable_binary.hpp>
+
+#include "workflow/photo_orientation/streaming_track_builder.hpp"
+
+namespace
+{
+
+TEST(TestStreamingTrackBuilder, SimpleTest)
+{
+  typedef hs::recon::workflow::StreamingTrackBuilder Builder;
+  typedef hs::recon::workflow::CompactTrackContainer CompactTrackContainer;
+  typedef CompactTrackContainer::Index Index;
+
+  //Photo ids 3, 5, 8 with 4 keys each.
+  std::vector<int> image_ids;
+  image_ids.push_back(3);
+  image_ids.push_back(5);
+  image_ids.push_back(8);
+  std::vector<size_t> number_of_keys(3, 4);
+
+  hs::sfm::MatchContainer matches;
+  //Track (3,0)-(5,1)-(8,2).
+  matches[hs::sfm::ImagePair(3, 5)].push_back(hs::sfm::KeyPair(0, 1));
+  matches[hs::sfm::ImagePair(5, 8)].push_back(hs::sfm::KeyPair(1, 2));
+  //Track (3,1)-(8,3).
+  matches[hs::sfm::ImagePair(3, 8)].push_back(hs::sfm::KeyPair(1, 3));
+  //Inconsistent: (3,2)-(5,2)-(3,3).
+  matches[hs::sfm::ImagePair(3, 5)].push_back(hs::sfm::KeyPair(2, 2));
+  matches[hs::sfm::ImagePair(5, 3)].push_back(hs::sfm::KeyPair(2, 3));
+  //Unknown photo is ignored.
+  matches[hs::sfm::ImagePair(3, 9)].push_back(hs::sfm::KeyPair(3, 0));
+
+  {
+    std::ofstream matches_file("streaming_matches_test.bin", std::ios::binary);
+    cereal::PortableBinaryOutputArchive archive(matches_file);
+    archive(matches);
+  }
+
+  CompactTrackContainer tracks;
+  Builder builder(4, 2, 1);
+  ASSERT_EQ(0, builder("streaming_matches_test.bin", image_ids,
+                       number_of_keys, tracks));
+
+  ASSERT_EQ(size_t(2), tracks.NumberOfTracks());
+  ASSERT_EQ(size_t(5), tracks.NumberOfViews());
+
+  ASSERT_EQ(size_t(3), tracks.TrackSize(0));
+  ASSERT_EQ(Index(3), tracks.TrackImageIds(0)[0]);
+  ASSERT_EQ(Index(0), tracks.TrackKeyIds(0)[0]);
+  ASSERT_EQ(Index(5), tracks.TrackImageIds(0)[1]);
+  ASSERT_EQ(Index(1), tracks.TrackKeyIds(0)[1]);
+  ASSERT_EQ(Index(8), tracks.TrackImageIds(0)[2]);
+  ASSERT_EQ(Index(2), tracks.TrackKeyIds(0)[2]);
+
+  ASSERT_EQ(size_t(2), tracks.TrackSize(1));
+  ASSERT_EQ(Index(3), tracks.TrackImageIds(1)[0]);
+  ASSERT_EQ(Index(1), tracks.TrackKeyIds(1)[0]);
+  ASSERT_EQ(Index(8), tracks.TrackImageIds(1)[1]);
+  ASSERT_EQ(Index(3), tracks.TrackKeyIds(1)[1]);
+  ASSERT_FALSE(tracks.IsPointValid(0));
+}
+
+}
@@ -0,0 +1,352 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include <gtest/gtest.h>
+
+#include "hs_sfm/sfm_utility/projective_functions.hpp"
+
+#include "workflow/texture/texture_atlas.hpp"
+#include "workflow/texture/view_label_smoother.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TextureAtlasGenerator Generator;
+typedef hs::recon::workflow::TexturedMesh TexturedMesh;
+typedef hs::recon::workflow::AtlasPage AtlasPage;
+typedef hs::recon::workflow::SourcePhoto SourcePhoto;
+typedef hs::recon::workflow::PhotoTileCache PhotoTileCache;
+typedef hs::recon::workflow::VisibilityImageSelector Selector;
+typedef Generator::Scalar Scalar;
+typedef Selector::Vertex Vertex;
+typedef Generator::VertexContainer VertexContainer;
+typedef Selector::Triangle Triangle;
+typedef Generator::TriangleContainer TriangleContainer;
+typedef Generator::ImageParams ImageParams;
+typedef Generator::ImageParamsContainer ImageParamsContainer;
+typedef hs::sfm::ProjectiveFunctions<Scalar> ProjectiveFunctions;
+typedef EIGEN_VECTOR(Scalar, 2) Key;
+
+//Unit squares over [-size, size]^2 moved by offset, two triangles each.
+void GenerateSquares(int size, const Vertex& offset,
+                     VertexContainer& vertices, TriangleContainer& triangles)
+{
+  size_t first = vertices.size();
+  size_t side = size_t(2 * size + 1);
+  for (int y = -size; y <= size; y++)
+  {
+    for (int x = -size; x <= size; x++)
+    {
+      vertices.push_back(Vertex(x, y, 0) + offset);
+    }
+  }
+  for (size_t y = 0; y + 1 < side; y++)
+  {
+    for (size_t x = 0; x + 1 < side; x++)
+    {
+      size_t a = first + y * side + x;
+      size_t b = a + 1;
+      size_t c = a + side;
+      size_t d = c + 1;
+      Triangle first_triangle = {{a, b, d}};
+      Triangle second_triangle = {{a, d, c}};
+      triangles.push_back(first_triangle);
+      triangles.push_back(second_triangle);
+    }
+  }
+}
+
+//A 256 x 256 nadir image with its centre over (x, y, z).
+ImageParams NadirImage(Scalar x, Scalar y, Scalar z)
+{
+  ImageParams image;
+  image.intrinsic_params = Selector::IntrinsicParams(100, 0, 128, 128, 1);
+  image.extrinsic_params.rotation()[0] = Scalar(M_PI);
+  image.extrinsic_params.rotation()[1] = Scalar(0);
+  image.extrinsic_params.rotation()[2] = Scalar(0);
+  image.extrinsic_params.position() << x, y, z;
+  image.image_width = 256;
+  image.image_height = 256;
+  return image;
+}
+
+/**
+ *  "photo_<i>" is 256 x 256 with red growing with the column, green with
+ *  the row and blue 100 * i.
+ */
+class GeneratedPhotoCache : public PhotoTileCache
+{
+public:
+  GeneratedPhotoCache(size_t number_of_photos)
+    : PhotoTileCache(PhotoPaths(number_of_photos), 1 << 24) {}
+
+protected:
+  virtual int LoadPhoto(const std::string& path, SourcePhoto& photo) const
+  {
+    if (path.compare(0, 6, "photo_") != 0) return -1;
+    int photo_id = std::atoi(path.c_str() + 6);
+    photo.width = 256;
+    photo.height = 256;
+    photo.pixels.resize(photo.width * photo.height * 3);
+    for (size_t row = 0; row < photo.height; row++)
+    {
+      for (size_t column = 0; column < photo.width; column++)
+      {
+        uint8_t* pixel = &photo.pixels[(row * photo.width + column) * 3];
+        pixel[0] = uint8_t(column);
+        pixel[1] = uint8_t(row);
+        pixel[2] = uint8_t(100 * photo_id);
+      }
+    }
+    return 0;
+  }
+
+private:
+  static std::vector<std::string> PhotoPaths(size_t number_of_photos)
+  {
+    std::vector<std::string> photo_paths;
+    for (size_t i = 0; i < number_of_photos; i++)
+    {
+      photo_paths.push_back("photo_" + std::to_string(i));
+    }
+    return photo_paths;
+  }
+};
+
+//Texel under the texture coordinates at the centroid of a triangle.
+const uint8_t* CentroidTexel(const TexturedMesh& mesh, size_t triangle_id)
+{
+  const AtlasPage& page = mesh.pages[mesh.triangle_pages[triangle_id]];
+  TexturedMesh::TexCoord texcoord = TexturedMesh::TexCoord::Zero();
+  for (int j = 0; j < 3; j++)
+  {
+    texcoord += mesh.texcoords[mesh.triangle_texcoords[triangle_id][j]] / 3;
+  }
+  size_t column = size_t(texcoord[0] * Scalar(page.width));
+  size_t row = size_t((1 - texcoord[1]) * Scalar(page.height));
+  return &page.pixels[(row * page.width + column) * 3];
+}
+
+//Photo each triangle was textured from, told by the blue of its texels.
+size_t PhotoOf(const TexturedMesh& mesh, size_t triangle_id)
+{
+  return size_t(CentroidTexel(mesh, triangle_id)[2]) / 100;
+}
+
+/**
+ *  Largest difference between the texel at the centroid of each triangle
+ *  and the photo pixel the centroid projects to.
+ */
+Scalar ColorError(const ImageParamsContainer& images,
+                  const TexturedMesh& mesh)
+{
+  Scalar error = 0;
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    const ImageParams& image = images[PhotoOf(mesh, i)];
+    Vertex centroid = (mesh.vertices[mesh.triangles[i][0]] +
+                       mesh.vertices[mesh.triangles[i][1]] +
+                       mesh.vertices[mesh.triangles[i][2]]) / 3;
+    Key key = ProjectiveFunctions::WorldPointProjectToImageKey(
+                image.intrinsic_params, image.extrinsic_params, centroid);
+    const uint8_t* texel = CentroidTexel(mesh, i);
+    error = std::max(error, std::abs(Scalar(texel[0]) - (key[0] - 0.5)));
+    error = std::max(error, std::abs(Scalar(texel[1]) - (key[1] - 0.5)));
+  }
+  return error;
+}
+
+size_t NumberOfSeams(const TexturedMesh& mesh)
+{
+  std::vector<size_t> begins;
+  std::vector<size_t> neighbours;
+  hs::recon::workflow::TriangleNeighbours(mesh.triangles, begins,
+                                          neighbours);
+  size_t number_of_seams = 0;
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    for (size_t k = begins[i]; k < begins[i + 1]; k++)
+    {
+      if (i < neighbours[k] &&
+          PhotoOf(mesh, i) != PhotoOf(mesh, neighbours[k]))
+      {
+        number_of_seams++;
+      }
+    }
+  }
+  return number_of_seams;
+}
+
+}
+
+TEST(TestTextureAtlas, ColorTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(5, Vertex::Zero(), vertices, triangles);
+  ImageParamsContainer images(1, NadirImage(0, 0, 10));
+  GeneratedPhotoCache photos(1);
+
+  TexturedMesh mesh;
+  ASSERT_EQ(0, Generator(2)(images, photos, vertices, triangles, mesh));
+  ASSERT_EQ(triangles.size(), mesh.triangles.size());
+  ASSERT_EQ(size_t(1), mesh.pages.size());
+  //One chart of 100 photo pixels and its margin.
+  ASSERT_GE(mesh.pages[0].width, size_t(100));
+  ASSERT_LE(mesh.pages[0].width, size_t(110));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(size_t(0), mesh.triangle_pages[i]);
+    for (int j = 0; j < 3; j++)
+    {
+      const TexturedMesh::TexCoord& texcoord =
+        mesh.texcoords[mesh.triangle_texcoords[i][j]];
+      ASSERT_GE(texcoord[0], 0);
+      ASSERT_LE(texcoord[0], 1);
+      ASSERT_GE(texcoord[1], 0);
+      ASSERT_LE(texcoord[1], 1);
+    }
+  }
+  ASSERT_LE(ColorError(images, mesh), 1.5);
+
+  //Triangles out of every photo are left untextured.
+  images[0] = NadirImage(100, 0, 10);
+  ASSERT_EQ(0, Generator(2)(images, photos, vertices, triangles, mesh));
+  ASSERT_TRUE(mesh.pages.empty());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(TexturedMesh::NO_PAGE, mesh.triangle_pages[i]);
+  }
+}
+
+TEST(TestTextureAtlas, SeamTest)
+{
+  //Ridges facing the two photos in turn.
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(6, Vertex::Zero(), vertices, triangles);
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    vertices[i][2] = 0.8 * std::sin(vertices[i][0] * 1.3) *
+                     std::cos(vertices[i][1] * 0.7);
+  }
+  ImageParamsContainer images;
+  images.push_back(NadirImage(-3, 0, 10));
+  images.push_back(NadirImage(3, 0, 10));
+  GeneratedPhotoCache photos(2);
+
+  TexturedMesh rough_mesh;
+  ASSERT_EQ(0, Generator(4, 4096, 0)(images, photos, vertices, triangles,
+                                     rough_mesh));
+  TexturedMesh smooth_mesh;
+  ASSERT_EQ(0, Generator(4)(images, photos, vertices, triangles,
+                            smooth_mesh));
+  TexturedMesh single_mesh;
+  ASSERT_EQ(0, Generator(4, 4096, 10)(images, photos, vertices, triangles,
+                                      single_mesh));
+  ASSERT_LE(ColorError(images, rough_mesh), 1.5);
+  ASSERT_LE(ColorError(images, smooth_mesh), 1.5);
+  ASSERT_LE(ColorError(images, single_mesh), 1.5);
+
+  size_t rough_seams = NumberOfSeams(rough_mesh);
+  ASSERT_GT(rough_seams, size_t(0));
+  ASSERT_LT(NumberOfSeams(smooth_mesh), rough_seams);
+  ASSERT_EQ(size_t(0), NumberOfSeams(single_mesh));
+}
+
+TEST(TestTextureAtlas, PagesTest)
+{
+  //Two charts of 60 photo pixels.
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(3, Vertex::Zero(), vertices, triangles);
+  GenerateSquares(3, Vertex(7, 0, 0), vertices, triangles);
+  ImageParamsContainer images(1, NadirImage(3.5, 0, 10));
+  GeneratedPhotoCache photos(1);
+
+  //Each fills a page of 64 with its margin.
+  TexturedMesh mesh;
+  ASSERT_EQ(0, Generator(2, 64)(images, photos, vertices, triangles, mesh));
+  ASSERT_EQ(size_t(2), mesh.pages.size());
+  for (size_t i = 0; i < mesh.pages.size(); i++)
+  {
+    ASSERT_EQ(size_t(64), mesh.pages[i].width);
+    ASSERT_EQ(size_t(64), mesh.pages[i].height);
+  }
+  ASSERT_NE(mesh.triangle_pages.front(), mesh.triangle_pages.back());
+  ASSERT_LE(ColorError(images, mesh), 1.5);
+
+  //Scaled down to fit smaller pages.
+  ASSERT_EQ(0, Generator(2, 48)(images, photos, vertices, triangles, mesh));
+  ASSERT_EQ(size_t(2), mesh.pages.size());
+  for (size_t i = 0; i < mesh.pages.size(); i++)
+  {
+    ASSERT_LE(mesh.pages[i].width, size_t(48));
+    ASSERT_LE(mesh.pages[i].height, size_t(48));
+  }
+  ASSERT_LE(ColorError(images, mesh), 2.0);
+}
+
+TEST(TestTextureAtlas, SaveLoadTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(2, Vertex(500000.125, 4000000.25, 10), vertices,
+                  triangles);
+  //One row of triangles out of the photo.
+  ImageParamsContainer images(1, NadirImage(500000.125, 4000000.25 + 12.5,
+                                            20));
+  GeneratedPhotoCache photos(1);
+  TexturedMesh mesh;
+  ASSERT_EQ(0, Generator(1)(images, photos, vertices, triangles, mesh));
+  size_t number_of_untextured = 0;
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    if (mesh.triangle_pages[i] == TexturedMesh::NO_PAGE)
+    {
+      number_of_untextured++;
+    }
+  }
+  ASSERT_GT(number_of_untextured, size_t(0));
+  ASSERT_LT(number_of_untextured, triangles.size());
+
+  std::string path = "test_texture_atlas.obj";
+  ASSERT_EQ(0, hs::recon::workflow::SaveTexturedMesh(path, mesh));
+  TexturedMesh loaded_mesh;
+  ASSERT_EQ(0, hs::recon::workflow::LoadTexturedMesh(path, loaded_mesh));
+  std::remove(path.c_str());
+  std::remove("test_texture_atlas.mtl");
+  std::remove("test_texture_atlas_0.jpg");
+
+  ASSERT_EQ(mesh.vertices.size(), loaded_mesh.vertices.size());
+  for (size_t i = 0; i < mesh.vertices.size(); i++)
+  {
+    ASSERT_LT((mesh.vertices[i] - loaded_mesh.vertices[i]).norm(), 1e-6);
+  }
+  ASSERT_EQ(mesh.pages.size(), loaded_mesh.pages.size());
+  ASSERT_EQ(mesh.pages[0].width, loaded_mesh.pages[0].width);
+  ASSERT_EQ(mesh.pages[0].height, loaded_mesh.pages[0].height);
+
+  //Untextured triangles come first, the rest keep their order.
+  ASSERT_EQ(mesh.triangles.size(), loaded_mesh.triangles.size());
+  size_t untextured_position = 0;
+  size_t textured_position = number_of_untextured;
+  for (size_t i = 0; i < mesh.triangles.size(); i++)
+  {
+    bool textured = mesh.triangle_pages[i] != TexturedMesh::NO_PAGE;
+    size_t position = textured ? textured_position++ : untextured_position++;
+    ASSERT_EQ(mesh.triangles[i], loaded_mesh.triangles[position]);
+    ASSERT_EQ(mesh.triangle_pages[i], loaded_mesh.triangle_pages[position]);
+    if (!textured) continue;
+    for (int j = 0; j < 3; j++)
+    {
+      const TexturedMesh::TexCoord& texcoord =
+        mesh.texcoords[mesh.triangle_texcoords[i][j]];
+      const TexturedMesh::TexCoord& loaded_texcoord =
+        loaded_mesh.texcoords[loaded_mesh.triangle_texcoords[position][j]];
+      ASSERT_LT((texcoord - loaded_texcoord).norm(), 1e-6);
+    }
+  }
+}
@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "workflow/mesh_surface/compact_mesh.hpp"
+#include "workflow/mesh_surface/tiled_delaunay_triangulator.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDelaunayTriangulator Triangulator;
+typedef hs::recon::workflow::MeshStreamWriter Writer;
+typedef hs::recon::workflow::CompactMesh CompactMesh;
+typedef Triangulator::Scalar Scalar;
+typedef Triangulator::Vertex Vertex;
+typedef Triangulator::VertexContainer VertexContainer;
+typedef Triangulator::Triangle Triangle;
+typedef Triangulator::TriangleContainer TriangleContainer;
+
+Scalar Random(Scalar range)
+{
+  return Scalar(std::rand()) / Scalar(RAND_MAX) * range;
+}
+
+int Triangulate(const VertexContainer& vertices, size_t tile_capacity,
+                size_t number_of_threads, const std::string& path,
+                size_t& number_of_tiles)
+{
+  Writer writer;
+  if (writer.Open(path, vertices) != 0) return -1;
+  Triangulator triangulator(tile_capacity, number_of_threads);
+  if (triangulator(vertices, writer) != 0) return -1;
+  number_of_tiles = triangulator.NumberOfTiles();
+  return writer.Close();
+}
+
+//Triangles of mesh.bin rotated to start at their lowest id, then sorted.
+int LoadTriangles(const std::string& path, size_t number_of_vertices,
+                  TriangleContainer& triangles)
+{
+  CompactMesh mesh;
+  if (hs::recon::workflow::LoadMesh(path, mesh) != 0) return -1;
+  if (mesh.vertices.size() != number_of_vertices) return -1;
+  triangles.swap(mesh.triangles);
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    Triangle& triangle = triangles[i];
+    std::rotate(triangle.begin(),
+                std::min_element(triangle.begin(), triangle.end()),
+                triangle.end());
+  }
+  std::sort(triangles.begin(), triangles.end());
+  return 0;
+}
+
+Scalar Circumradius(const VertexContainer& vertices, const Triangle& triangle)
+{
+  Vertex a = vertices[triangle[0]];
+  Vertex b = vertices[triangle[1]];
+  Vertex c = vertices[triangle[2]];
+  a[2] = b[2] = c[2] = 0;
+  Scalar ab = (b - a).norm();
+  Scalar bc = (c - b).norm();
+  Scalar ca = (a - c).norm();
+  Scalar area2 = (b - a).cross(c - a).norm();
+  return ab * bc * ca / (2 * area2);
+}
+
+/**
+ *  Tiles must only output triangles of the whole cloud, once each, and
+ *  keep every triangle whose circumradius is below max_radius.
+ */
+void CompareWithSingleTile(const VertexContainer& vertices,
+                           size_t tile_capacity, Scalar max_radius)
+{
+  std::string single_path = "test_tiled_delaunay_single.bin";
+  std::string tiled_path = "test_tiled_delaunay_tiled.bin";
+  size_t number_of_tiles = 0;
+  ASSERT_EQ(0, Triangulate(vertices, 0, 1, single_path, number_of_tiles));
+  ASSERT_EQ(size_t(1), number_of_tiles);
+  ASSERT_EQ(0, Triangulate(vertices, tile_capacity, 4, tiled_path,
+                           number_of_tiles));
+  ASSERT_LT(size_t(4), number_of_tiles);
+
+  TriangleContainer single_triangles;
+  TriangleContainer tiled_triangles;
+  ASSERT_EQ(0, LoadTriangles(single_path, vertices.size(),
+                             single_triangles));
+  ASSERT_EQ(0, LoadTriangles(tiled_path, vertices.size(), tiled_triangles));
+  ASSERT_LT(vertices.size(), single_triangles.size());
+  ASSERT_TRUE(std::adjacent_find(tiled_triangles.begin(),
+                                 tiled_triangles.end()) ==
+              tiled_triangles.end());
+  ASSERT_TRUE(std::includes(single_triangles.begin(), single_triangles.end(),
+                            tiled_triangles.begin(), tiled_triangles.end()));
+  TriangleContainer missing;
+  std::set_difference(single_triangles.begin(), single_triangles.end(),
+                      tiled_triangles.begin(), tiled_triangles.end(),
+                      std::back_inserter(missing));
+  for (size_t i = 0; i < missing.size(); i++)
+  {
+    ASSERT_LT(max_radius, Circumradius(vertices, missing[i]));
+  }
+  ASSERT_GT(single_triangles.size() / 50, missing.size());
+  std::remove(single_path.c_str());
+  std::remove(tiled_path.c_str());
+}
+
+TEST(TestTiledDelaunayTriangulator, UniformTest)
+{
+  std::srand(11);
+  VertexContainer vertices;
+  for (size_t i = 0; i < 3000; i++)
+  {
+    vertices.push_back(Vertex(500000 + Random(1000), 3000000 + Random(400),
+                              Random(30)));
+  }
+  CompareWithSingleTile(vertices, 200, 20);
+}
+
+TEST(TestTiledDelaunayTriangulator, SpatialSortTest)
+{
+  std::srand(19);
+  VertexContainer vertices;
+  for (size_t i = 0; i < 3000; i++)
+  {
+    vertices.push_back(Vertex(Random(1000), Random(400), Random(30)));
+  }
+  VertexContainer sorted = vertices;
+  Triangulator(200, 4).SpatialSort(sorted);
+
+  //A permutation of the vertices.
+  ASSERT_EQ(vertices.size(), sorted.size());
+  std::vector<std::array<Scalar, 3> > before, after;
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    std::array<Scalar, 3> a = {{vertices[i][0], vertices[i][1],
+                                vertices[i][2]}};
+    std::array<Scalar, 3> b = {{sorted[i][0], sorted[i][1], sorted[i][2]}};
+    before.push_back(a);
+    after.push_back(b);
+  }
+  std::sort(before.begin(), before.end());
+  std::sort(after.begin(), after.end());
+  ASSERT_TRUE(before == after);
+
+  //Consecutive vertices are neighbours, far closer than in random order.
+  Scalar sorted_length = 0;
+  Scalar random_length = 0;
+  for (size_t i = 1; i < vertices.size(); i++)
+  {
+    sorted_length += (sorted[i] - sorted[i - 1]).head<2>().norm();
+    random_length += (vertices[i] - vertices[i - 1]).head<2>().norm();
+  }
+  ASSERT_GT(random_length / 10, sorted_length);
+
+  CompareWithSingleTile(sorted, 200, 20);
+}
+
+TEST(TestTiledDelaunayTriangulator, ClusteredTest)
+{
+  //Dense patches in a sparse field make tiles grow their margins.
+  std::srand(13);
+  VertexContainer vertices;
+  for (size_t i = 0; i < 2500; i++)
+  {
+    Scalar x = i % 5 == 0 ? Random(1000) : 100 + Random(60);
+    Scalar y = i % 5 == 0 ? Random(1000) : (i % 2 ? 800 : 100) + Random(60);
+    vertices.push_back(Vertex(x, y, Random(10)));
+  }
+  CompareWithSingleTile(vertices, 150, 30);
+}
+
+TEST(TestTiledDelaunayTriangulator, ThreadTest)
+{
+  std::srand(17);
+  VertexContainer vertices;
+  for (size_t i = 0; i < 2000; i++)
+  {
+    vertices.push_back(Vertex(Random(100), Random(100), Random(5)));
+  }
+  std::string paths[2] =
+  {
+    "test_tiled_delaunay_thread_1.bin",
+    "test_tiled_delaunay_thread_3.bin"
+  };
+  size_t number_of_tiles = 0;
+  ASSERT_EQ(0, Triangulate(vertices, 100, 1, paths[0], number_of_tiles));
+  ASSERT_EQ(0, Triangulate(vertices, 100, 3, paths[1], number_of_tiles));
+
+  //Byte for byte the same whatever the number of threads.
+  std::string data[2];
+  for (int i = 0; i < 2; i++)
+  {
+    std::ifstream file(paths[i], std::ios::binary);
+    data[i].assign(std::istreambuf_iterator<char>(file),
+                   std::istreambuf_iterator<char>());
+    std::remove(paths[i].c_str());
+  }
+  ASSERT_FALSE(data[0].empty());
+  ASSERT_TRUE(data[0] == data[1]);
+}
+
+}
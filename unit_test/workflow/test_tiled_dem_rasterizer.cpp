@@ -0,0 +1,307 @@
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "workflow/texture/split_tiff_tile_sink.hpp"
+#include "workflow/texture/tiled_dem_rasterizer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDEMRasterizer Rasterizer;
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::RasterTileSink<float> Sink;
+typedef Sink::Tile Tile;
+typedef Rasterizer::Vertex Vertex;
+typedef Rasterizer::VertexContainer VertexContainer;
+typedef Rasterizer::Triangle Triangle;
+typedef Rasterizer::TriangleContainer TriangleContainer;
+
+double PlaneHeight(double x, double y)
+{
+  return 100 + 0.5 * x - 0.25 * y;
+}
+
+//Plane over a 100 x 50 rectangle with its corner at (1000, 2000).
+void GeneratePlane(int size, VertexContainer& vertices,
+                   TriangleContainer& triangles)
+{
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      double px = 1000 + 100.0 * x / (size - 1);
+      double py = 2000 + 50.0 * y / (size - 1);
+      vertices.push_back(Vertex(px, py, PlaneHeight(px, py)));
+    }
+  }
+  for (int y = 0; y + 1 < size; y++)
+  {
+    for (int x = 0; x + 1 < size; x++)
+    {
+      size_t a = size_t(y * size + x);
+      size_t b = a + 1;
+      size_t c = a + size_t(size);
+      size_t d = c + 1;
+      Triangle first = {{a, b, d}};
+      Triangle second = {{a, d, c}};
+      triangles.push_back(first);
+      triangles.push_back(second);
+    }
+  }
+}
+
+class MemorySink : public Sink
+{
+public:
+  virtual int Open(const RasterGrid& grid, size_t channels, float no_data)
+  {
+    grid_ = grid;
+    opened = channels == 1 && no_data == -32767.0f;
+    return 0;
+  }
+
+  virtual int Write(const Tile& tile)
+  {
+    std::pair<size_t, size_t> key(tile.row, tile.column);
+    if (tiles.count(key)) return -1;
+    tiles[key] = tile;
+    return 0;
+  }
+
+  virtual int Close()
+  {
+    closed = true;
+    return 0;
+  }
+
+  float Pixel(size_t x, size_t y) const
+  {
+    std::pair<size_t, size_t> key(y / grid_.tile_height,
+                                  x / grid_.tile_width);
+    const Tile& tile = tiles.find(key)->second;
+    return tile.pixels[(y % grid_.tile_height) * tile.width +
+                       x % grid_.tile_width];
+  }
+
+  std::map<std::pair<size_t, size_t>, Tile> tiles;
+  bool opened = false;
+  bool closed = false;
+
+private:
+  RasterGrid grid_;
+};
+
+}
+
+TEST(TestTiledDEMRasterizer, PlaneTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GeneratePlane(21, vertices, triangles);
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 0.5, 0.5, 64, 48, 4, grid));
+  ASSERT_EQ(size_t(200), grid.width);
+  ASSERT_EQ(size_t(100), grid.height);
+  ASSERT_EQ(1000.0, grid.left);
+  ASSERT_EQ(2050.0, grid.top);
+
+  MemorySink sink;
+  Rasterizer rasterizer(4);
+  ASSERT_EQ(0, rasterizer(vertices, triangles, grid, -32767.0f, sink));
+  ASSERT_TRUE(sink.opened);
+  ASSERT_TRUE(sink.closed);
+  ASSERT_EQ(grid.NumberOfTiles(), sink.tiles.size());
+  ASSERT_EQ(size_t(4 * 3), sink.tiles.size());
+  ASSERT_EQ(size_t(200 - 3 * 64), sink.tiles[std::make_pair(2, 3)].width);
+  ASSERT_EQ(size_t(100 - 2 * 48), sink.tiles[std::make_pair(2, 3)].height);
+
+  //Every pixel centre lies on the plane.
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      double px = grid.left + (x + 0.5) * grid.scale_x;
+      double py = grid.top - (y + 0.5) * grid.scale_y;
+      ASSERT_NEAR(PlaneHeight(px, py), sink.Pixel(x, y), 1e-3);
+    }
+  }
+}
+
+TEST(TestTiledDEMRasterizer, NoDataTest)
+{
+  //Only the lower left triangle of the square.
+  VertexContainer vertices;
+  vertices.push_back(Vertex(0, 0, 10));
+  vertices.push_back(Vertex(40, 0, 10));
+  vertices.push_back(Vertex(0, 40, 10));
+  vertices.push_back(Vertex(40, 40, 10));
+  TriangleContainer triangles(1);
+  triangles[0][0] = 0;
+  triangles[0][1] = 1;
+  triangles[0][2] = 2;
+
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 16, 16, 1, grid));
+  MemorySink sink;
+  Rasterizer rasterizer(2);
+  ASSERT_EQ(0, rasterizer(vertices, triangles, grid, -32767.0f, sink));
+  ASSERT_EQ(size_t(9), sink.tiles.size());
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      //Distance to the top left corner in pixels, rows run downwards.
+      double sum = (x + 0.5) + (grid.height - y - 0.5);
+      if (sum < 39.5)
+      {
+        ASSERT_EQ(10.0f, sink.Pixel(x, y));
+      }
+      else if (sum > 40.5)
+      {
+        ASSERT_EQ(-32767.0f, sink.Pixel(x, y));
+      }
+    }
+  }
+}
+
+TEST(TestTiledDEMRasterizer, ThreadsTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GeneratePlane(51, vertices, triangles);
+  //Fold the plane so that overlapping triangles keep the higher one.
+  for (size_t i = 0; i < vertices.size(); i++)
+  {
+    vertices[i][2] += 3 * std::sin(vertices[i][0] * 0.1);
+  }
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 0.3, 0.2, 32, 32, 3, grid));
+
+  MemorySink serial_sink;
+  MemorySink parallel_sink;
+  ASSERT_EQ(0, Rasterizer(1)(vertices, triangles, grid, -32767.0f,
+                             serial_sink));
+  ASSERT_EQ(0, Rasterizer(8)(vertices, triangles, grid, -32767.0f,
+                             parallel_sink));
+  ASSERT_EQ(serial_sink.tiles.size(), parallel_sink.tiles.size());
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      ASSERT_EQ(serial_sink.Pixel(x, y), parallel_sink.Pixel(x, y));
+    }
+  }
+}
+
+TEST(TestTiledDEMRasterizer, TileIdsTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GeneratePlane(21, vertices, triangles);
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 0.5, 0.5, 64, 48, 2, grid));
+
+  MemorySink full_sink;
+  ASSERT_EQ(0, Rasterizer(2)(vertices, triangles, grid, -32767.0f,
+                             full_sink));
+  //Only the chosen tiles come, the same as in a full run.
+  std::vector<size_t> tile_ids = {1, 6, 11};
+  MemorySink sink;
+  Rasterizer rasterizer(2);
+  rasterizer.set_tile_ids(tile_ids);
+  ASSERT_EQ(0, rasterizer(vertices, triangles, grid, -32767.0f, sink));
+  ASSERT_TRUE(sink.closed);
+  ASSERT_EQ(tile_ids.size(), sink.tiles.size());
+  for (size_t i = 0; i < tile_ids.size(); i++)
+  {
+    std::pair<size_t, size_t> key(tile_ids[i] / grid.NumberOfTileColumns(),
+                                  tile_ids[i] % grid.NumberOfTileColumns());
+    ASSERT_EQ(1u, sink.tiles.count(key));
+    ASSERT_EQ(full_sink.tiles[key].pixels, sink.tiles[key].pixels);
+  }
+
+  //Each triangle binned to the chosen tiles, once and in order.
+  hs::recon::workflow::TileSurfaceRasterizer surface(vertices, triangles,
+                                                     grid);
+  ASSERT_EQ(0, surface.BinTriangles(2));
+  std::set<size_t> binned;
+  for (size_t i = 0; i < tile_ids.size(); i++)
+  {
+    size_t row = tile_ids[i] / grid.NumberOfTileColumns();
+    size_t column = tile_ids[i] % grid.NumberOfTileColumns();
+    binned.insert(surface.BinBegin(row, column), surface.BinEnd(row, column));
+  }
+  std::vector<size_t> triangle_ids;
+  ASSERT_EQ(0, surface.TrianglesOfTiles(tile_ids, triangle_ids));
+  ASSERT_FALSE(triangle_ids.empty());
+  ASSERT_GT(triangles.size(), triangle_ids.size());
+  ASSERT_EQ(std::vector<size_t>(binned.begin(), binned.end()), triangle_ids);
+
+  tile_ids.push_back(grid.NumberOfTiles());
+  ASSERT_EQ(-1, surface.TrianglesOfTiles(tile_ids, triangle_ids));
+  rasterizer.set_tile_ids(tile_ids);
+  MemorySink invalid_sink;
+  ASSERT_EQ(-1, rasterizer(vertices, triangles, grid, -32767.0f,
+                           invalid_sink));
+}
+
+TEST(TestTiledDEMRasterizer, SplitTiffTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GeneratePlane(5, vertices, triangles);
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 64, 64, 1, grid));
+  std::string path = "test_tiled_dem_rasterizer.tif";
+  hs::recon::workflow::SplitTiffTileSink<float> sink(path);
+  Rasterizer rasterizer(2);
+  ASSERT_EQ(0, rasterizer(vertices, triangles, grid, -32767.0f, sink));
+
+  std::string tile_path = hs::recon::workflow::SplitTilePath(path, 0, 1);
+  ASSERT_EQ("test_tiled_dem_rasterizer_0_1.tif", tile_path);
+  for (size_t row = 0; row < grid.NumberOfTileRows(); row++)
+  {
+    for (size_t column = 0; column < grid.NumberOfTileColumns(); column++)
+    {
+      tile_path = hs::recon::workflow::SplitTilePath(path, row, column);
+      std::ifstream file(tile_path, std::ios::binary);
+      ASSERT_TRUE(bool(file));
+      char header[4];
+      file.read(header, 4);
+      ASSERT_TRUE((header[0] == 'I' && header[1] == 'I' && header[2] == 42) ||
+                  (header[0] == 'M' && header[1] == 'M' && header[3] == 42));
+      file.close();
+      std::remove(tile_path.c_str());
+    }
+  }
+}
+
+TEST(TestTiledDEMRasterizer, InvalidTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  RasterGrid grid;
+  ASSERT_EQ(-1, hs::recon::workflow::ComputeRasterGrid(
+                  vertices, 1, 1, 64, 64, 1, grid));
+  GeneratePlane(3, vertices, triangles);
+  ASSERT_EQ(-1, hs::recon::workflow::ComputeRasterGrid(
+                  vertices, 0, 1, 64, 64, 1, grid));
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 64, 64, 1, grid));
+  triangles[0][1] = vertices.size();
+  MemorySink sink;
+  ASSERT_EQ(-1, Rasterizer(1)(vertices, triangles, grid, -32767.0f, sink));
+}
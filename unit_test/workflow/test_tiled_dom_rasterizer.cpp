@@ -0,0 +1,505 @@
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <utility>
+
+#include <gtest/gtest.h>
+
+#include "workflow/texture/fan_out_tile_sink.hpp"
+#include "workflow/texture/tiled_dom_rasterizer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::TiledDOMRasterizer Rasterizer;
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::SourcePhoto SourcePhoto;
+typedef hs::recon::workflow::PhotoTileCache PhotoTileCache;
+typedef Rasterizer::Sink Sink;
+typedef Sink::Tile Tile;
+typedef Rasterizer::Scalar Scalar;
+typedef Rasterizer::Vertex Vertex;
+typedef Rasterizer::VertexContainer VertexContainer;
+typedef Rasterizer::Triangle Triangle;
+typedef Rasterizer::TriangleContainer TriangleContainer;
+typedef Rasterizer::ImageParamsContainer ImageParamsContainer;
+
+//Flat ground over a 100 x 50 rectangle with its corner at (1000, 2000).
+void GenerateGround(int size, VertexContainer& vertices,
+                    TriangleContainer& triangles)
+{
+  for (int y = 0; y < size; y++)
+  {
+    for (int x = 0; x < size; x++)
+    {
+      vertices.push_back(Vertex(1000 + 100.0 * x / (size - 1),
+                                2000 + 50.0 * y / (size - 1), 0));
+    }
+  }
+  for (int y = 0; y + 1 < size; y++)
+  {
+    for (int x = 0; x + 1 < size; x++)
+    {
+      size_t a = size_t(y * size + x);
+      size_t b = a + 1;
+      size_t c = a + size_t(size);
+      size_t d = c + 1;
+      Triangle first = {{a, b, d}};
+      Triangle second = {{a, d, c}};
+      triangles.push_back(first);
+      triangles.push_back(second);
+    }
+  }
+}
+
+//Nadir cameras 100 above the middle of the ground, 2 pixels per unit.
+void GenerateImages(size_t number_of_images, ImageParamsContainer& images)
+{
+  images.resize(number_of_images);
+  for (size_t i = 0; i < number_of_images; i++)
+  {
+    images[i].intrinsic_params = Rasterizer::IntrinsicParams(200, 0, 128, 128,
+                                                             1);
+    images[i].extrinsic_params.rotation()[0] = Scalar(M_PI);
+    images[i].extrinsic_params.rotation()[1] = Scalar(0);
+    images[i].extrinsic_params.rotation()[2] = Scalar(0);
+    images[i].extrinsic_params.position() << 1050, 2025, 100;
+  }
+}
+
+/**
+ *  Photos made up from their path. "photo_<i>" is 256 x 256 with red
+ *  growing with the column and green with the row, "large_<i>" is 600 x 300
+ *  with both growing four times slower. Blue is 100 * i.
+ */
+class GeneratedPhotoCache : public PhotoTileCache
+{
+public:
+  GeneratedPhotoCache(const std::vector<std::string>& photo_paths,
+                      size_t capacity)
+    : PhotoTileCache(photo_paths, capacity) {}
+
+protected:
+  virtual int LoadPhoto(const std::string& path, SourcePhoto& photo) const
+  {
+    size_t step = 1;
+    if (path.compare(0, 6, "photo_") == 0)
+    {
+      photo.width = 256;
+      photo.height = 256;
+    }
+    else if (path.compare(0, 6, "large_") == 0)
+    {
+      photo.width = 600;
+      photo.height = 300;
+      step = 4;
+    }
+    else
+    {
+      return -1;
+    }
+    int photo_id = std::atoi(path.c_str() + 6);
+    photo.pixels.resize(photo.width * photo.height * 3);
+    for (size_t row = 0; row < photo.height; row++)
+    {
+      for (size_t column = 0; column < photo.width; column++)
+      {
+        uint8_t* pixel = &photo.pixels[(row * photo.width + column) * 3];
+        pixel[0] = uint8_t(column / step);
+        pixel[1] = uint8_t(row / step);
+        pixel[2] = uint8_t(100 * photo_id);
+      }
+    }
+    return 0;
+  }
+};
+
+std::vector<std::string> PhotoPaths(size_t number_of_photos)
+{
+  std::vector<std::string> photo_paths;
+  for (size_t i = 0; i < number_of_photos; i++)
+  {
+    photo_paths.push_back("photo_" + std::to_string(i));
+  }
+  return photo_paths;
+}
+
+class FailingSink : public Sink
+{
+public:
+  FailingSink() : closed(false) {}
+
+  virtual int Open(const RasterGrid&, size_t, uint8_t) { return 0; }
+  virtual int Write(const Tile&) { return -1; }
+  virtual int Close()
+  {
+    closed = true;
+    return 0;
+  }
+
+  bool closed;
+};
+
+class MemorySink : public Sink
+{
+public:
+  MemorySink() : opened(false), closed(false), number_of_channels(0) {}
+
+  virtual int Open(const RasterGrid& grid, size_t channels, uint8_t no_data)
+  {
+    (void)no_data;
+    grid_ = grid;
+    opened = true;
+    number_of_channels = channels;
+    return 0;
+  }
+
+  virtual int Write(const Tile& tile)
+  {
+    std::pair<size_t, size_t> key(tile.row, tile.column);
+    if (tiles.count(key)) return -1;
+    tiles[key] = tile;
+    return 0;
+  }
+
+  virtual int Close()
+  {
+    closed = true;
+    return 0;
+  }
+
+  const uint8_t* Pixel(size_t x, size_t y) const
+  {
+    std::pair<size_t, size_t> key(y / grid_.tile_height,
+                                  x / grid_.tile_width);
+    const Tile& tile = tiles.find(key)->second;
+    return &tile.pixels[((y % grid_.tile_height) * tile.width +
+                         x % grid_.tile_width) * tile.channels];
+  }
+
+  std::map<std::pair<size_t, size_t>, Tile> tiles;
+  bool opened;
+  bool closed;
+  size_t number_of_channels;
+
+private:
+  RasterGrid grid_;
+};
+
+}
+
+TEST(TestTiledDOMRasterizer, ColorTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateGround(11, vertices, triangles);
+  ImageParamsContainer images;
+  GenerateImages(2, images);
+  //West half from the first photo, east half from the second, the last
+  //row of triangles from none.
+  std::vector<size_t> triangle_image_indices(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    size_t cell = i / 2;
+    triangle_image_indices[i] = (cell % 10) < 5 ? 0 : 1;
+    if (cell / 10 == 9) triangle_image_indices[i] = size_t(-1);
+  }
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 32, 32, 2, grid));
+
+  GeneratedPhotoCache photos(PhotoPaths(2), 1 << 24);
+  MemorySink sink;
+  Rasterizer rasterizer(4);
+  ASSERT_EQ(0, rasterizer(images, photos, vertices, triangles,
+                          triangle_image_indices, grid, sink));
+  ASSERT_TRUE(sink.opened);
+  ASSERT_TRUE(sink.closed);
+  ASSERT_EQ(Rasterizer::NUMBER_OF_CHANNELS, sink.number_of_channels);
+  ASSERT_EQ(grid.NumberOfTiles(), sink.tiles.size());
+  ASSERT_EQ(size_t(2), photos.NumberOfLoads());
+
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      double px = grid.left + (x + 0.5) * grid.scale_x;
+      double py = grid.top - (y + 0.5) * grid.scale_y;
+      const uint8_t* pixel = sink.Pixel(x, y);
+      //Keep clear of the cell borders where the photo switches.
+      double cell_x = std::fmod(px - 1000, 10);
+      double cell_y = std::fmod(py - 2000, 5);
+      if (cell_x < 0.5 || cell_x > 9.5 || cell_y < 0.5 || cell_y > 4.5)
+      {
+        continue;
+      }
+      if (py > 2045)
+      {
+        ASSERT_EQ(0, pixel[3]);
+        continue;
+      }
+      //Two photo pixels to an output pixel, sampled from level 1.
+      ASSERT_EQ(255, pixel[3]);
+      ASSERT_NEAR(128 + 2 * (px - 1050) - 0.5, pixel[0], 1.5);
+      ASSERT_NEAR(128 - 2 * (py - 2025) - 0.5, pixel[1], 1.5);
+      ASSERT_EQ(px < 1050 ? 0 : 100, pixel[2]);
+    }
+  }
+}
+
+TEST(TestTiledDOMRasterizer, TileIdsTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateGround(11, vertices, triangles);
+  ImageParamsContainer images;
+  GenerateImages(2, images);
+  std::vector<size_t> triangle_image_indices(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    triangle_image_indices[i] = ((i / 2) % 10) < 5 ? 0 : 1;
+  }
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 32, 32, 2, grid));
+
+  GeneratedPhotoCache full_photos(PhotoPaths(2), 1 << 24);
+  MemorySink full_sink;
+  ASSERT_EQ(0, Rasterizer(2)(images, full_photos, vertices, triangles,
+                             triangle_image_indices, grid, full_sink));
+
+  //The western column of tiles only needs the first photo, and comes out
+  //as in the full run.
+  std::vector<size_t> tile_ids;
+  for (size_t row = 0; row < grid.NumberOfTileRows(); row++)
+  {
+    tile_ids.push_back(row * grid.NumberOfTileColumns());
+  }
+  GeneratedPhotoCache photos(PhotoPaths(2), 1 << 24);
+  MemorySink sink;
+  Rasterizer rasterizer(2);
+  rasterizer.set_tile_ids(tile_ids);
+  ASSERT_EQ(0, rasterizer(images, photos, vertices, triangles,
+                          triangle_image_indices, grid, sink));
+  ASSERT_TRUE(sink.closed);
+  ASSERT_EQ(size_t(1), photos.NumberOfLoads());
+  ASSERT_EQ(tile_ids.size(), sink.tiles.size());
+  for (auto itr_tile = sink.tiles.begin(); itr_tile != sink.tiles.end();
+       ++itr_tile)
+  {
+    ASSERT_EQ(size_t(0), itr_tile->first.second);
+    ASSERT_EQ(full_sink.tiles[itr_tile->first].pixels,
+              itr_tile->second.pixels);
+  }
+
+  tile_ids.push_back(grid.NumberOfTiles());
+  rasterizer.set_tile_ids(tile_ids);
+  MemorySink invalid_sink;
+  ASSERT_EQ(-1, rasterizer(images, photos, vertices, triangles,
+                           triangle_image_indices, grid, invalid_sink));
+}
+
+TEST(TestTiledDOMRasterizer, ColorCorrectionTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateGround(11, vertices, triangles);
+  ImageParamsContainer images;
+  GenerateImages(2, images);
+  images[0].color_correction.offset[2] = 5.0f;
+  images[1].color_correction.gain[2] = 1.5f;
+  images[1].color_correction.offset[2] = -10.0f;
+  std::vector<size_t> triangle_image_indices(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    triangle_image_indices[i] = ((i / 2) % 10) < 5 ? 0 : 1;
+  }
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 1, 1, 32, 32, 2, grid));
+
+  GeneratedPhotoCache photos(PhotoPaths(2), 1 << 24);
+  MemorySink sink;
+  ASSERT_EQ(0, Rasterizer(2)(images, photos, vertices, triangles,
+                             triangle_image_indices, grid, sink));
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      double px = grid.left + (x + 0.5) * grid.scale_x;
+      double cell_x = std::fmod(px - 1000, 10);
+      if (cell_x < 0.5 || cell_x > 9.5) continue;
+      const uint8_t* pixel = sink.Pixel(x, y);
+      ASSERT_EQ(255, pixel[3]);
+      ASSERT_EQ(px < 1050 ? 5 : 140, pixel[2]);
+    }
+  }
+}
+
+TEST(TestTiledDOMRasterizer, FanOutTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateGround(11, vertices, triangles);
+  ImageParamsContainer images;
+  GenerateImages(1, images);
+  std::vector<size_t> triangle_image_indices(triangles.size(), 0);
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 0.5, 0.5, 64, 64, 1, grid));
+
+  //One pass, one decode, the same tiles in every sink.
+  GeneratedPhotoCache photos(PhotoPaths(1), 1 << 24);
+  MemorySink first_sink;
+  MemorySink second_sink;
+  MemorySink third_sink;
+  hs::recon::workflow::FanOutTileSink<uint8_t> sink;
+  sink.AddSink(&first_sink);
+  sink.AddSink(&second_sink);
+  sink.AddSink(&third_sink);
+  ASSERT_EQ(0, Rasterizer(3)(images, photos, vertices, triangles,
+                             triangle_image_indices, grid, sink));
+  ASSERT_EQ(size_t(1), photos.NumberOfLoads());
+  ASSERT_TRUE(third_sink.opened);
+  ASSERT_TRUE(third_sink.closed);
+  ASSERT_EQ(grid.NumberOfTiles(), first_sink.tiles.size());
+  ASSERT_EQ(first_sink.tiles.size(), second_sink.tiles.size());
+  ASSERT_EQ(first_sink.tiles.size(), third_sink.tiles.size());
+  for (auto itr_tile = first_sink.tiles.begin();
+       itr_tile != first_sink.tiles.end(); ++itr_tile)
+  {
+    ASSERT_EQ(itr_tile->second.pixels,
+              second_sink.tiles[itr_tile->first].pixels);
+    ASSERT_EQ(itr_tile->second.pixels,
+              third_sink.tiles[itr_tile->first].pixels);
+  }
+
+  //A sink failing on its queue fails the pass, the others still close.
+  FailingSink failing_sink;
+  MemorySink fourth_sink;
+  hs::recon::workflow::FanOutTileSink<uint8_t> failing_fan_out(1);
+  failing_fan_out.AddSink(&fourth_sink);
+  failing_fan_out.AddSink(&failing_sink);
+  ASSERT_EQ(-1, Rasterizer(3)(images, photos, vertices, triangles,
+                              triangle_image_indices, grid,
+                              failing_fan_out));
+  ASSERT_TRUE(fourth_sink.closed);
+  ASSERT_TRUE(failing_sink.closed);
+}
+
+TEST(TestTiledDOMRasterizer, ThreadsTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateGround(31, vertices, triangles);
+  ImageParamsContainer images;
+  GenerateImages(3, images);
+  std::vector<size_t> triangle_image_indices(triangles.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    triangle_image_indices[i] = (i / 7) % 3;
+  }
+  RasterGrid grid;
+  ASSERT_EQ(0, hs::recon::workflow::ComputeRasterGrid(
+                 vertices, 0.4, 0.3, 48, 40, 1, grid));
+
+  //The parallel pass keeps one photo tile at a time.
+  GeneratedPhotoCache serial_photos(PhotoPaths(3), 1 << 24);
+  GeneratedPhotoCache parallel_photos(PhotoPaths(3), 1);
+  MemorySink serial_sink;
+  MemorySink parallel_sink;
+  ASSERT_EQ(0, Rasterizer(1)(images, serial_photos, vertices, triangles,
+                             triangle_image_indices, grid, serial_sink));
+  ASSERT_EQ(0, Rasterizer(8)(images, parallel_photos, vertices, triangles,
+                             triangle_image_indices, grid, parallel_sink));
+  ASSERT_EQ(size_t(3), serial_photos.NumberOfLoads());
+  ASSERT_EQ(serial_sink.tiles.size(), parallel_sink.tiles.size());
+  for (auto itr_tile = serial_sink.tiles.begin();
+       itr_tile != serial_sink.tiles.end(); ++itr_tile)
+  {
+    ASSERT_EQ(itr_tile->second.pixels,
+              parallel_sink.tiles[itr_tile->first].pixels);
+  }
+}
+
+TEST(TestTiledDOMRasterizer, PhotoTileCacheTest)
+{
+  std::vector<std::string> photo_paths;
+  photo_paths.push_back("large_0");
+  photo_paths.push_back("large_1");
+  photo_paths.push_back("missing");
+  GeneratedPhotoCache photos(photo_paths, 1 << 24);
+
+  //600 x 300 cut into 3 x 2 tiles, the last ones narrower.
+  photos.Prefetch(0, 0);
+  ASSERT_EQ(size_t(1), photos.NumberOfLoads());
+  PhotoTileCache::TilePtr tile = photos.Tile(0, 0, 2, 1);
+  ASSERT_TRUE(bool(tile));
+  ASSERT_EQ(size_t(512), tile->left);
+  ASSERT_EQ(size_t(256), tile->top);
+  ASSERT_EQ(size_t(88), tile->width);
+  ASSERT_EQ(size_t(44), tile->height);
+  ASSERT_EQ(size_t(600), tile->level_width);
+  ASSERT_FALSE(bool(photos.Tile(0, 0, 3, 0)));
+  ASSERT_FALSE(bool(photos.Tile(0, 0, 0, 2)));
+  photos.Prefetch(0, 0);
+  ASSERT_EQ(size_t(1), photos.NumberOfLoads());
+
+  //Neighbouring tiles overlap by one pixel.
+  uint8_t rgb[3];
+  PhotoTileCache::TilePtr first = photos.Tile(0, 0, 0, 0);
+  PhotoTileCache::TilePtr second = photos.Tile(0, 0, 1, 0);
+  ASSERT_TRUE(first->Sample(255.5, 10, rgb));
+  ASSERT_EQ(64, rgb[0]);
+  ASSERT_TRUE(first->Sample(256, 10, rgb));
+  ASSERT_EQ(64, rgb[0]);
+  ASSERT_EQ(2, rgb[1]);
+  ASSERT_FALSE(first->Sample(256.5, 10, rgb));
+  ASSERT_TRUE(second->Sample(256, 10, rgb));
+  ASSERT_EQ(64, rgb[0]);
+  ASSERT_FALSE(second->Sample(255.5, 10, rgb));
+
+  //Level 1 halves the photo into 2 x 1 tiles.
+  tile = photos.Tile(1, 1, 1, 0);
+  ASSERT_EQ(size_t(2), photos.NumberOfLoads());
+  ASSERT_TRUE(bool(tile));
+  ASSERT_EQ(size_t(300), tile->level_width);
+  ASSERT_EQ(size_t(150), tile->level_height);
+  ASSERT_EQ(size_t(44), tile->width);
+  ASSERT_EQ(size_t(150), tile->height);
+  ASSERT_TRUE(tile->Sample(260, 10, rgb));
+  ASSERT_EQ(130, rgb[0]);
+  ASSERT_EQ(5, rgb[1]);
+  ASSERT_EQ(100, rgb[2]);
+  ASSERT_FALSE(bool(photos.Tile(1, 1, 0, 1)));
+  ASSERT_EQ(size_t(2), photos.NumberOfLoads());
+
+  //Failures are remembered.
+  ASSERT_FALSE(bool(photos.Tile(2, 0, 0, 0)));
+  ASSERT_FALSE(bool(photos.Tile(2, 1, 0, 0)));
+  photos.Prefetch(2, 0);
+  ASSERT_FALSE(bool(photos.Tile(3, 0, 0, 0)));
+  ASSERT_EQ(size_t(3), photos.NumberOfLoads());
+}
+
+TEST(TestTiledDOMRasterizer, PhotoTileCacheEvictionTest)
+{
+  std::vector<std::string> photo_paths(1, "large_0");
+  //Room for one full tile.
+  size_t tile_size = 257 * 257 * 3;
+  GeneratedPhotoCache photos(photo_paths, tile_size);
+  photos.Prefetch(0, 0);
+  ASSERT_EQ(size_t(1), photos.NumberOfLoads());
+  ASSERT_LE(photos.SizeInBytes(), tile_size);
+
+  //The wanted tile stays while the rest of the level is dropped.
+  PhotoTileCache::TilePtr tile = photos.Tile(0, 0, 0, 0);
+  ASSERT_TRUE(bool(tile));
+  ASSERT_EQ(size_t(2), photos.NumberOfLoads());
+  ASSERT_EQ(tile, photos.Tile(0, 0, 0, 0));
+  ASSERT_EQ(size_t(2), photos.NumberOfLoads());
+  ASSERT_EQ(tile_size, photos.SizeInBytes());
+  photos.Prefetch(0, 0);
+  ASSERT_EQ(size_t(3), photos.NumberOfLoads());
+}
@@ -0,0 +1,83 @@
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "workflow/point_cloud/view_clusterer.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ViewClusterer ViewClusterer;
+typedef ViewClusterer::Scalar Scalar;
+typedef ViewClusterer::Vector3 Vector3;
+
+TEST(TestViewClusterer, SimpleTest)
+{
+  //A strip of 16 views 10 above a line of points, each point seen by the
+  //views within 3 of it.
+  ViewClusterer::Vector3Container centers;
+  for (int i = 0; i < 16; i++)
+  {
+    centers.push_back(Vector3(Scalar(i), 0, 10));
+  }
+  ViewClusterer::Vector3Container points;
+  std::vector<size_t> point_offsets(1, 0);
+  std::vector<size_t> point_views;
+  for (int k = 0; k <= 60; k++)
+  {
+    Vector3 point(Scalar(k) * 0.25, 0, 0);
+    for (size_t i = 0; i < centers.size(); i++)
+    {
+      if (std::abs(centers[i][0] - point[0]) <= 3.0) point_views.push_back(i);
+    }
+    points.push_back(point);
+    point_offsets.push_back(point_views.size());
+  }
+
+  ViewClusterer clusterer(6, 0.7f, 0.7f);
+  std::vector<std::vector<size_t> > clusters;
+  std::vector<size_t> home_clusters;
+  ASSERT_EQ(0, clusterer(centers, points, point_offsets, point_views,
+                         clusters, home_clusters));
+  ASSERT_LT(size_t(1), clusters.size());
+  ASSERT_EQ(centers.size(), home_clusters.size());
+  for (size_t c = 0; c < clusters.size(); c++)
+  {
+    ASSERT_GE(size_t(6), clusters[c].size());
+  }
+  for (size_t i = 0; i < centers.size(); i++)
+  {
+    const std::vector<size_t>& home = clusters[home_clusters[i]];
+    ASSERT_TRUE(std::binary_search(home.begin(), home.end(), i));
+  }
+
+  //Every point can be triangulated in some cluster nearly as well as from
+  //all views.
+  for (size_t k = 0; k < points.size(); k++)
+  {
+    Scalar best_all = 0;
+    Scalar best_cluster = 0;
+    for (size_t i = point_offsets[k]; i < point_offsets[k + 1]; i++)
+    {
+      for (size_t j = i + 1; j < point_offsets[k + 1]; j++)
+      {
+        Scalar weight = hs::recon::workflow::TriangulationWeight(
+          centers[point_views[i]], centers[point_views[j]], points[k]);
+        best_all = std::max(best_all, weight);
+        for (size_t c = 0; c < clusters.size(); c++)
+        {
+          if (std::binary_search(clusters[c].begin(), clusters[c].end(),
+                                 point_views[i]) &&
+              std::binary_search(clusters[c].begin(), clusters[c].end(),
+                                 point_views[j]))
+          {
+            best_cluster = std::max(best_cluster, weight);
+          }
+        }
+      }
+    }
+    ASSERT_LE(best_all * 0.7, best_cluster + 1e-12);
+  }
+}
+
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include <gtest/gtest.h>
+
+#include "workflow/texture/view_label_smoother.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::ViewLabelSmoother Smoother;
+typedef Smoother::Scalar Scalar;
+typedef Smoother::Triangle Triangle;
+typedef Smoother::TriangleContainer TriangleContainer;
+
+//Grid of width x height squares, two triangles each.
+void GenerateGrid(size_t width, size_t height, TriangleContainer& triangles)
+{
+  for (size_t y = 0; y < height; y++)
+  {
+    for (size_t x = 0; x < width; x++)
+    {
+      size_t a = y * (width + 1) + x;
+      size_t b = a + 1;
+      size_t c = a + width + 1;
+      size_t d = c + 1;
+      Triangle first = {{a, b, d}};
+      Triangle second = {{a, d, c}};
+      triangles.push_back(first);
+      triangles.push_back(second);
+    }
+  }
+}
+
+Scalar Energy(const std::vector<size_t>& neighbour_begins,
+              const std::vector<size_t>& neighbours,
+              const std::vector<size_t>& begins,
+              const std::vector<size_t>& candidates,
+              const std::vector<Scalar>& costs,
+              const std::vector<size_t>& labels,
+              Scalar smoothness)
+{
+  Scalar energy = 0;
+  for (size_t i = 0; i < labels.size(); i++)
+  {
+    for (size_t slot = begins[i]; slot < begins[i + 1]; slot++)
+    {
+      if (candidates[slot] == labels[i]) energy += costs[slot];
+    }
+    for (size_t k = neighbour_begins[i]; k < neighbour_begins[i + 1]; k++)
+    {
+      if (i < neighbours[k] && labels[i] != labels[neighbours[k]])
+      {
+        energy += smoothness;
+      }
+    }
+  }
+  return energy;
+}
+
+}
+
+TEST(TestViewLabelSmoother, NeighboursTest)
+{
+  TriangleContainer triangles;
+  GenerateGrid(2, 2, triangles);
+  //A collapsed triangle shares no edge.
+  Triangle collapsed = {{0, 0, 8}};
+  triangles.push_back(collapsed);
+  std::vector<size_t> begins;
+  std::vector<size_t> neighbours;
+  hs::recon::workflow::TriangleNeighbours(triangles, begins, neighbours);
+  ASSERT_EQ(triangles.size() + 1, begins.size());
+  //Four diagonals and four edges between the squares.
+  ASSERT_EQ(size_t(16), neighbours.size());
+  //The lower triangle of the first square borders its upper one and the
+  //upper one of the next square, which also borders the square above.
+  ASSERT_EQ(size_t(2), begins[1] - begins[0]);
+  ASSERT_EQ(size_t(3), begins[4] - begins[3]);
+  ASSERT_EQ(begins[8], begins[9]);
+}
+
+TEST(TestViewLabelSmoother, SmoothTest)
+{
+  //Two photos see every triangle, the second slightly better on a few.
+  TriangleContainer triangles;
+  GenerateGrid(8, 4, triangles);
+  std::vector<size_t> begins(1, 0);
+  std::vector<size_t> candidates;
+  std::vector<Scalar> costs;
+  std::vector<size_t> labels;
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    bool noisy = i % 7 == 3;
+    candidates.push_back(0);
+    costs.push_back(noisy ? Scalar(0.1) : Scalar(0));
+    candidates.push_back(1);
+    costs.push_back(noisy ? Scalar(0) : Scalar(0.5));
+    begins.push_back(candidates.size());
+    labels.push_back(noisy ? 1 : 0);
+  }
+
+  std::vector<size_t> unsmoothed = labels;
+  ASSERT_EQ(0, Smoother(0)(triangles, begins, candidates, costs,
+                           unsmoothed));
+  ASSERT_EQ(labels, unsmoothed);
+
+  ASSERT_EQ(0, Smoother(0.3)(triangles, begins, candidates, costs, labels));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(size_t(0), labels[i]);
+  }
+}
+
+TEST(TestViewLabelSmoother, ExpansionBoundTest)
+{
+  //Alpha expansion stays within twice the lowest energy under Potts costs.
+  TriangleContainer triangles;
+  GenerateGrid(3, 2, triangles);
+  size_t number_of_labels = 3;
+  Scalar smoothness = 0.4;
+  std::vector<size_t> neighbour_begins;
+  std::vector<size_t> neighbours;
+  hs::recon::workflow::TriangleNeighbours(triangles, neighbour_begins,
+                                          neighbours);
+  std::srand(7);
+  for (int trial = 0; trial < 5; trial++)
+  {
+    std::vector<size_t> begins(1, 0);
+    std::vector<size_t> candidates;
+    std::vector<Scalar> costs;
+    std::vector<size_t> labels;
+    for (size_t i = 0; i < triangles.size(); i++)
+    {
+      size_t first = candidates.size();
+      for (size_t label = 0; label < number_of_labels; label++)
+      {
+        if (std::rand() % 4 == 0 && label + 1 < number_of_labels) continue;
+        candidates.push_back(label);
+        costs.push_back(Scalar(std::rand() % 100) / 100);
+      }
+      begins.push_back(candidates.size());
+      labels.push_back(candidates[first]);
+    }
+    Scalar start = Energy(neighbour_begins, neighbours, begins, candidates,
+                          costs, labels, smoothness);
+    ASSERT_EQ(0, Smoother(smoothness)(triangles, begins, candidates, costs,
+                                      labels));
+    Scalar smoothed = Energy(neighbour_begins, neighbours, begins,
+                             candidates, costs, labels, smoothness);
+    ASSERT_LE(smoothed, start + 1e-9);
+
+    //Every labelling from the candidates.
+    std::vector<size_t> choices(triangles.size(), 0);
+    std::vector<size_t> labelling(triangles.size());
+    Scalar lowest = smoothed;
+    while (true)
+    {
+      for (size_t i = 0; i < triangles.size(); i++)
+      {
+        labelling[i] = candidates[begins[i] + choices[i]];
+      }
+      lowest = std::min(lowest, Energy(neighbour_begins, neighbours, begins,
+                                       candidates, costs, labelling,
+                                       smoothness));
+      size_t i = 0;
+      while (i < triangles.size() &&
+             ++choices[i] == begins[i + 1] - begins[i])
+      {
+        choices[i++] = 0;
+      }
+      if (i == triangles.size()) break;
+    }
+    ASSERT_LE(smoothed, 2 * lowest + 1e-9);
+  }
+}
+
+TEST(TestViewLabelSmoother, InvalidTest)
+{
+  TriangleContainer triangles;
+  GenerateGrid(1, 1, triangles);
+  std::vector<size_t> begins(1, 0);
+  begins.push_back(1);
+  begins.push_back(1);
+  std::vector<size_t> candidates(1, 0);
+  std::vector<Scalar> costs(1, 0);
+  std::vector<size_t> labels(2, Smoother::NO_LABEL);
+  ASSERT_EQ(-1, Smoother(1)(triangles, begins, candidates, costs, labels));
+  labels[0] = 0;
+  ASSERT_EQ(0, Smoother(1)(triangles, begins, candidates, costs, labels));
+  ASSERT_EQ(Smoother::NO_LABEL, labels[1]);
+}
@@ -0,0 +1,243 @@
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+#include "workflow/texture/visibility_image_selector.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::VisibilityImageSelector Selector;
+typedef Selector::Scalar Scalar;
+typedef Selector::Vertex Vertex;
+typedef Selector::VertexContainer VertexContainer;
+typedef Selector::Triangle Triangle;
+typedef Selector::TriangleContainer TriangleContainer;
+typedef Selector::ImageParams ImageParams;
+typedef Selector::ImageParamsContainer ImageParamsContainer;
+
+//Unit squares over [-size, size]^2 at height z, two triangles each.
+void GenerateSquares(int size, Scalar z, VertexContainer& vertices,
+                     TriangleContainer& triangles)
+{
+  size_t first = vertices.size();
+  size_t side = size_t(2 * size + 1);
+  for (int y = -size; y <= size; y++)
+  {
+    for (int x = -size; x <= size; x++)
+    {
+      vertices.push_back(Vertex(x, y, z));
+    }
+  }
+  for (size_t y = 0; y + 1 < side; y++)
+  {
+    for (size_t x = 0; x + 1 < side; x++)
+    {
+      size_t a = first + y * side + x;
+      size_t b = a + 1;
+      size_t c = a + side;
+      size_t d = c + 1;
+      Triangle first_triangle = {{a, b, d}};
+      Triangle second_triangle = {{a, d, c}};
+      triangles.push_back(first_triangle);
+      triangles.push_back(second_triangle);
+    }
+  }
+}
+
+//A 200 x 200 nadir image with its centre over (x, y, z).
+ImageParams NadirImage(Scalar x, Scalar y, Scalar z)
+{
+  ImageParams image;
+  image.intrinsic_params = Selector::IntrinsicParams(100, 0, 100, 100, 1);
+  image.extrinsic_params.rotation()[0] = Scalar(M_PI);
+  image.extrinsic_params.rotation()[1] = Scalar(0);
+  image.extrinsic_params.rotation()[2] = Scalar(0);
+  image.extrinsic_params.position() << x, y, z;
+  image.image_width = 200;
+  image.image_height = 200;
+  return image;
+}
+
+Vertex Centroid(const VertexContainer& vertices, const Triangle& triangle)
+{
+  return (vertices[triangle[0]] + vertices[triangle[1]] +
+          vertices[triangle[2]]) / 3;
+}
+
+}
+
+TEST(TestVisibilityImageSelector, ClosestTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(5, 0, vertices, triangles);
+  //The low image sees the ground largest, the upturned one sees nothing.
+  ImageParamsContainer images;
+  images.push_back(NadirImage(0, 0, 20));
+  images.push_back(NadirImage(0, 0, 10));
+  images.push_back(NadirImage(0, 0, 10));
+  images[2].extrinsic_params.rotation()[0] = Scalar(0);
+  images.push_back(NadirImage(100, 0, 10));
+
+  std::vector<size_t> triangle_image_indices;
+  Selector selector(2);
+  ASSERT_EQ(0, selector(images, vertices, triangles,
+                        triangle_image_indices));
+  ASSERT_EQ(triangles.size(), triangle_image_indices.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(size_t(1), triangle_image_indices[i]);
+  }
+
+  //Without it, the high one.
+  images.erase(images.begin() + 1);
+  ASSERT_EQ(0, selector(images, vertices, triangles,
+                        triangle_image_indices));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(size_t(0), triangle_image_indices[i]);
+  }
+
+  //Out of every view.
+  images.erase(images.begin());
+  ASSERT_EQ(0, selector(images, vertices, triangles,
+                        triangle_image_indices));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    ASSERT_EQ(Selector::NO_IMAGE, triangle_image_indices[i]);
+  }
+}
+
+TEST(TestVisibilityImageSelector, OcclusionTest)
+{
+  //A roof over [-2, 2]^2 at height 5 hides [-4, 4]^2 of the ground from a
+  //camera at height 10.
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(8, 0, vertices, triangles);
+  size_t number_of_ground = triangles.size();
+  GenerateSquares(2, 5, vertices, triangles);
+  ImageParamsContainer images;
+  images.push_back(NadirImage(0, 0, 10));
+  images[0].image_width = 400;
+  images[0].image_height = 400;
+  images[0].intrinsic_params = Selector::IntrinsicParams(100, 0, 200, 200, 1);
+
+  std::vector<size_t> triangle_image_indices;
+  ASSERT_EQ(0, Selector(1)(images, vertices, triangles,
+                           triangle_image_indices));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    Vertex centroid = Centroid(vertices, triangles[i]);
+    Scalar distance = std::max(std::abs(centroid[0]), std::abs(centroid[1]));
+    if (i >= number_of_ground || distance > 4.5)
+    {
+      ASSERT_EQ(size_t(0), triangle_image_indices[i]);
+    }
+    else if (distance < 3.5)
+    {
+      ASSERT_EQ(Selector::NO_IMAGE, triangle_image_indices[i]);
+    }
+  }
+
+  //A coarse depth buffer still tells the two apart.
+  ASSERT_EQ(0, Selector(1, 64)(images, vertices, triangles,
+                               triangle_image_indices));
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    Vertex centroid = Centroid(vertices, triangles[i]);
+    Scalar distance = std::max(std::abs(centroid[0]), std::abs(centroid[1]));
+    if (i >= number_of_ground || distance > 4.5)
+    {
+      ASSERT_EQ(size_t(0), triangle_image_indices[i]);
+    }
+    else if (distance < 3.5)
+    {
+      ASSERT_EQ(Selector::NO_IMAGE, triangle_image_indices[i]);
+    }
+  }
+}
+
+TEST(TestVisibilityImageSelector, TriangleIdsTest)
+{
+  //The roof of OcclusionTest, left out of the selection but still hiding
+  //the ground under it.
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(8, 0, vertices, triangles);
+  size_t number_of_ground = triangles.size();
+  GenerateSquares(2, 5, vertices, triangles);
+  ImageParamsContainer images;
+  images.push_back(NadirImage(0, 0, 10));
+  images[0].image_width = 400;
+  images[0].image_height = 400;
+  images[0].intrinsic_params = Selector::IntrinsicParams(100, 0, 200, 200, 1);
+  //Out of view of every selected triangle, so it is not rendered.
+  images.push_back(NadirImage(100, 0, 10));
+
+  std::vector<size_t> full_indices;
+  ASSERT_EQ(0, Selector(1)(images, vertices, triangles, full_indices));
+  std::vector<size_t> triangle_ids;
+  for (size_t i = 0; i < number_of_ground; i += 3)
+  {
+    triangle_ids.push_back(i);
+  }
+  Selector selector(2);
+  selector.set_triangle_ids(triangle_ids);
+  std::vector<size_t> triangle_image_indices;
+  ASSERT_EQ(0, selector(images, vertices, triangles,
+                        triangle_image_indices));
+  ASSERT_EQ(triangles.size(), triangle_image_indices.size());
+  for (size_t i = 0; i < triangles.size(); i++)
+  {
+    if (i < number_of_ground && i % 3 == 0)
+    {
+      ASSERT_EQ(full_indices[i], triangle_image_indices[i]);
+    }
+    else
+    {
+      ASSERT_EQ(Selector::NO_IMAGE, triangle_image_indices[i]);
+    }
+  }
+
+  triangle_ids.push_back(triangles.size());
+  selector.set_triangle_ids(triangle_ids);
+  ASSERT_EQ(-1, selector(images, vertices, triangles,
+                         triangle_image_indices));
+}
+
+TEST(TestVisibilityImageSelector, ThreadsTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(20, 0, vertices, triangles);
+  GenerateSquares(3, 4, vertices, triangles);
+  ImageParamsContainer images;
+  for (int y = -4; y <= 4; y++)
+  {
+    for (int x = -4; x <= 4; x++)
+    {
+      images.push_back(NadirImage(x * 5, y * 5, 12 + (x + y + 8) % 3));
+    }
+  }
+
+  std::vector<size_t> serial_indices;
+  std::vector<size_t> parallel_indices;
+  ASSERT_EQ(0, Selector(1)(images, vertices, triangles, serial_indices));
+  ASSERT_EQ(0, Selector(8)(images, vertices, triangles, parallel_indices));
+  ASSERT_EQ(serial_indices, parallel_indices);
+}
+
+TEST(TestVisibilityImageSelector, InvalidTest)
+{
+  VertexContainer vertices;
+  TriangleContainer triangles;
+  GenerateSquares(1, 0, vertices, triangles);
+  Triangle triangle = {{0, 1, vertices.size()}};
+  triangles.push_back(triangle);
+  ImageParamsContainer images(1, NadirImage(0, 0, 10));
+  std::vector<size_t> triangle_image_indices;
+  ASSERT_EQ(-1, Selector(1)(images, vertices, triangles,
+                            triangle_image_indices));
+}
@@ -0,0 +1,221 @@
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <gtest/gtest.h>
+
+#include "hs_image_io/whole_io/image_data.hpp"
+#include "hs_image_io/whole_io/image_io.hpp"
+
+#include "workflow/texture/web_tile_sink.hpp"
+
+namespace
+{
+
+typedef hs::recon::workflow::RasterGrid RasterGrid;
+typedef hs::recon::workflow::WebTileSink WebTileSink;
+
+const double PI = 3.14159265358979323846;
+const double EARTH_RADIUS = 6378137.0;
+//Ground size of a pixel of zoom 10.
+const double RESOLUTION = 2.0 * PI * EARTH_RADIUS / (256.0 * 1024.0);
+
+//Georeferenced frame being Web Mercator itself.
+class MercatorProjector : public hs::recon::workflow::GeographicProjector
+{
+public:
+  virtual int ToLongitudeLatitude(double x, double y,
+                                  double& longitude, double& latitude) const
+  {
+    longitude = x / EARTH_RADIUS * 180.0 / PI;
+    latitude = (2.0 * std::atan(std::exp(y / EARTH_RADIUS)) - PI / 2.0) *
+               180.0 / PI;
+    return 0;
+  }
+
+  virtual int FromLongitudeLatitude(double longitude, double latitude,
+                                    double& x, double& y) const
+  {
+    x = EARTH_RADIUS * longitude * PI / 180.0;
+    y = EARTH_RADIUS * std::log(std::tan(PI / 4.0 + latitude * PI / 360.0));
+    return 0;
+  }
+};
+
+/**
+ *  612 x 384 raster lined up with the pixels of zoom 10, starting 10 pixels
+ *  into tile (512, 510). Columns from 502 on are empty.
+ */
+RasterGrid MakeGrid(std::vector<uint8_t>& pixels)
+{
+  RasterGrid grid;
+  grid.left = 10 * RESOLUTION;
+  grid.top = (2 * 256 - 10) * RESOLUTION;
+  grid.scale_x = RESOLUTION;
+  grid.scale_y = RESOLUTION;
+  grid.width = 612;
+  grid.height = 384;
+  grid.tile_width = 200;
+  grid.tile_height = 150;
+  pixels.resize(grid.width * grid.height * 4);
+  for (size_t y = 0; y < grid.height; y++)
+  {
+    for (size_t x = 0; x < grid.width; x++)
+    {
+      uint8_t* pixel = &pixels[(y * grid.width + x) * 4];
+      bool empty = x >= 502;
+      pixel[0] = empty ? 0 : uint8_t(x);
+      pixel[1] = empty ? 0 : uint8_t(y);
+      pixel[2] = empty ? 0 : 7;
+      pixel[3] = empty ? 0 : 255;
+    }
+  }
+  return grid;
+}
+
+//Feed a raster to a sink tile by tile, last tile first, skipping one.
+int WriteRaster(const RasterGrid& grid, const std::vector<uint8_t>& pixels,
+                WebTileSink& sink, size_t skipped_tile_id)
+{
+  if (sink.Open(grid, 4, 0) != 0) return -1;
+  for (size_t tile_id = grid.NumberOfTiles(); tile_id-- > 0;)
+  {
+    if (tile_id == skipped_tile_id) continue;
+    WebTileSink::Tile tile;
+    tile.row = tile_id / grid.NumberOfTileColumns();
+    tile.column = tile_id % grid.NumberOfTileColumns();
+    tile.width = grid.TileWidth(tile.column);
+    tile.height = grid.TileHeight(tile.row);
+    tile.channels = 4;
+    for (size_t y = 0; y < tile.height; y++)
+    {
+      size_t begin = ((tile.row * grid.tile_height + y) * grid.width +
+                      tile.column * grid.tile_width) * 4;
+      tile.pixels.insert(tile.pixels.end(), pixels.begin() + begin,
+                         pixels.begin() + begin + tile.width * 4);
+    }
+    if (sink.Write(tile) != 0) return -1;
+  }
+  return sink.Close();
+}
+
+}
+
+TEST(TestWebTileSink, PngTest)
+{
+  typedef hs::imgio::whole::ImageData ImageData;
+
+  std::vector<uint8_t> pixels;
+  RasterGrid grid = MakeGrid(pixels);
+  MercatorProjector projector;
+  std::string directory = "test_web_tile_sink_png";
+  WebTileSink sink(directory, projector, WebTileSink::FORMAT_PNG,
+                   WebTileSink::SCHEME_XYZ, 3);
+  ASSERT_EQ(0, WriteRaster(grid, pixels, sink, grid.NumberOfTiles()));
+  ASSERT_EQ(10, sink.max_zoom());
+  ASSERT_EQ(8, sink.min_zoom());
+
+  hs::imgio::whole::ImageIO image_io;
+  for (size_t tile_x = 512; tile_x < 514; tile_x++)
+  {
+    for (size_t tile_y = 510; tile_y < 512; tile_y++)
+    {
+      ImageData image_data;
+      ASSERT_EQ(0, image_io.LoadImage(
+        directory + "/10/" + std::to_string(tile_x) + "/" +
+        std::to_string(tile_y) + ".png", image_data));
+      ASSERT_EQ(4, image_data.channel());
+      for (size_t v = 0; v < 256; v++)
+      {
+        for (size_t u = 0; u < 256; u++)
+        {
+          int x = int((tile_x - 512) * 256 + u) - 10;
+          int y = int((tile_y - 510) * 256 + v) - 10;
+          bool inside = x >= 0 && x < 502 && y >= 0 && y < 384;
+          const uint8_t* pixel =
+            inside ? &pixels[(size_t(y) * grid.width + size_t(x)) * 4] :
+                     nullptr;
+          for (int c = 0; c < 4; c++)
+          {
+            ASSERT_EQ(inside ? int(pixel[c]) : 0,
+                      int(image_data.GetByte(int(v), int(u), c)));
+          }
+        }
+      }
+    }
+  }
+  //Nothing under the easternmost tiles.
+  ImageData empty_data;
+  ASSERT_NE(0, image_io.LoadImage(directory + "/10/514/510.png",
+                                  empty_data));
+
+  //Zoom 9 averages the four tiles under it.
+  ImageData parent_data;
+  ASSERT_EQ(0, image_io.LoadImage(directory + "/9/256/255.png",
+                                  parent_data));
+  ASSERT_EQ(21, int(parent_data.GetByte(10, 15, 0)));
+  ASSERT_EQ(11, int(parent_data.GetByte(10, 15, 1)));
+  ASSERT_EQ(7, int(parent_data.GetByte(10, 15, 2)));
+  ASSERT_EQ(255, int(parent_data.GetByte(10, 15, 3)));
+  ASSERT_EQ(0, int(parent_data.GetByte(2, 2, 3)));
+
+  ImageData root_data;
+  ASSERT_EQ(0, image_io.LoadImage(directory + "/8/128/127.png", root_data));
+  ASSERT_NE(0, image_io.LoadImage(directory + "/7/64/63.png", root_data));
+  boost::filesystem::remove_all(directory);
+}
+
+TEST(TestWebTileSink, TmsJpgTest)
+{
+  typedef hs::imgio::whole::ImageData ImageData;
+
+  std::vector<uint8_t> pixels;
+  RasterGrid grid = MakeGrid(pixels);
+  MercatorProjector projector;
+  std::string directory = "test_web_tile_sink_jpg";
+  WebTileSink sink(directory, projector, WebTileSink::FORMAT_JPG,
+                   WebTileSink::SCHEME_TMS, 2);
+  //The first raster tile never comes, the tiles over it are left empty.
+  ASSERT_EQ(0, WriteRaster(grid, pixels, sink, 0));
+
+  hs::imgio::whole::ImageIO image_io;
+  ImageData image_data;
+  ASSERT_NE(0, image_io.LoadImage(directory + "/10/512/510.jpg",
+                                  image_data));
+  ASSERT_EQ(0, image_io.LoadImage(directory + "/10/512/513.jpg",
+                                  image_data));
+  ASSERT_EQ(3, image_data.channel());
+  //Raster tile 0 held the top left 200 x 150 pixels.
+  ASSERT_EQ(0, int(image_data.GetByte(100, 100, 0)));
+  ASSERT_EQ(240, int(image_data.GetByte(100, 250, 0)));
+  ASSERT_EQ(90, int(image_data.GetByte(100, 250, 1)));
+  ASSERT_EQ(0, image_io.LoadImage(directory + "/10/513/512.jpg",
+                                  image_data));
+  ASSERT_EQ(0, image_io.LoadImage(directory + "/8/128/128.jpg",
+                                  image_data));
+  boost::filesystem::remove_all(directory);
+}
+
+TEST(TestWebTileSink, InvalidTest)
+{
+  std::vector<uint8_t> pixels;
+  RasterGrid grid = MakeGrid(pixels);
+  MercatorProjector projector;
+  std::string directory = "test_web_tile_sink_invalid";
+  WebTileSink sink(directory, projector,
+                   WebTileSink::FORMAT_PNG, WebTileSink::SCHEME_XYZ, 1);
+  ASSERT_NE(0, sink.Open(grid, 2, 0));
+  ASSERT_EQ(0, sink.Open(grid, 4, 0));
+  WebTileSink::Tile tile;
+  tile.row = 0;
+  tile.column = 0;
+  tile.width = 10;
+  tile.height = 10;
+  tile.channels = 4;
+  tile.pixels.resize(400);
+  ASSERT_NE(0, sink.Write(tile));
+  ASSERT_EQ(0, sink.Close());
+  boost::filesystem::remove_all(directory);
+}